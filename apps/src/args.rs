@@ -338,6 +338,7 @@ pub const SERVER_USAGE: &str = "Usage:
 
 Options:
   --listen <addr>             Listen on the given IP:port [default: 127.0.0.1:4433]
+  --threads <n>               Number of worker threads [default: 1].
   --cert <file>               TLS certificate path [default: src/bin/cert.crt]
   --key <file>                TLS certificate key path [default: src/bin/cert.key]
   --root <dir>                Root directory [default: src/bin/root/]
@@ -366,6 +367,7 @@ Options:
 // Application-specific arguments that compliment the `CommonArgs`.
 pub struct ServerArgs {
     pub listen: String,
+    pub threads: usize,
     pub no_retry: bool,
     pub root: String,
     pub index: String,
@@ -378,6 +380,7 @@ impl Args for ServerArgs {
         let args = docopt.parse().unwrap_or_else(|e| e.exit());
 
         let listen = args.get_str("--listen").to_string();
+        let threads = args.get_str("--threads").parse::<usize>().unwrap();
         let no_retry = args.get_bool("--no-retry");
         let root = args.get_str("--root").to_string();
         let index = args.get_str("--index").to_string();
@@ -386,6 +389,7 @@ impl Args for ServerArgs {
 
         ServerArgs {
             listen,
+            threads,
             no_retry,
             root,
             index,
@@ -37,20 +37,28 @@ use std::rc::Rc;
 
 use std::cell::RefCell;
 
+use std::sync::atomic;
+use std::sync::mpsc;
+use std::sync::Arc;
+
 use ring::rand::*;
 
 use quiche_apps::args::*;
 
 use quiche_apps::common::*;
 
+use quiche_apps::shard;
+
 const MAX_BUF_SIZE: usize = 65535;
 
 const MAX_DATAGRAM_SIZE: usize = 1350;
 
-fn main() {
-    let mut buf = [0; MAX_BUF_SIZE];
-    let mut out = [0; MAX_DATAGRAM_SIZE];
+const WAKER: mio::Token = mio::Token(1);
 
+/// Number of packets received by all the workers, used to name dumped packets.
+static PKT_COUNT: atomic::AtomicUsize = atomic::AtomicUsize::new(0);
+
+fn main() {
     env_logger::builder()
         .default_format_timestamp_nanos(true)
         .init();
@@ -60,15 +68,129 @@ fn main() {
     let conn_args = CommonArgs::with_docopt(&docopt);
     let args = ServerArgs::with_docopt(&docopt);
 
+    // Connection IDs carry the index of the worker owning the connection in
+    // their first byte.
+    let threads = args.threads;
+    assert!((1..=256).contains(&threads), "invalid number of threads");
+
+    // Create the UDP listening sockets, one per worker.
+    let listen: net::SocketAddr = args.listen.parse().unwrap();
+
+    let sockets = if threads == 1 {
+        vec![net::UdpSocket::bind(listen).unwrap()]
+    } else {
+        let first = shard::bind_reuseport(listen).unwrap();
+
+        // Bind the other sockets to the port that was actually picked.
+        let listen = first.local_addr().unwrap();
+
+        let mut sockets = vec![first];
+
+        for _ in 1..threads {
+            sockets.push(shard::bind_reuseport(listen).unwrap());
+        }
+
+        // Without steering the kernel spreads packets over the sockets by
+        // 4-tuple, so the workers forward them to each other instead.
+        if let Err(e) = shard::attach_steering(&sockets[0], threads) {
+            warn!("packet steering unavailable, forwarding packets: {:?}", e);
+        }
+
+        sockets
+    };
+
+    info!(
+        "listening on {:} with {} worker(s)",
+        sockets[0].local_addr().unwrap(),
+        threads
+    );
+
+    let polls: Vec<mio::Poll> =
+        (0..threads).map(|_| mio::Poll::new().unwrap()).collect();
+
+    let wakers = polls
+        .iter()
+        .map(|p| Arc::new(mio::Waker::new(p.registry(), WAKER).unwrap()))
+        .collect();
+
+    let (router, queues) = shard::Router::new(wakers);
+
+    let rng = SystemRandom::new();
+    let conn_id_seed =
+        ring::hmac::Key::generate(ring::hmac::HMAC_SHA256, &rng).unwrap();
+
+    let conn_args = Arc::new(conn_args);
+    let args = Arc::new(args);
+
+    let handles: Vec<_> = polls
+        .into_iter()
+        .zip(sockets)
+        .zip(queues)
+        .enumerate()
+        .map(|(id, ((poll, socket), queue))| {
+            socket.set_nonblocking(true).unwrap();
+
+            let worker = Worker {
+                id,
+                threads,
+                poll,
+                socket: mio::net::UdpSocket::from_std(socket),
+                queue,
+                router: router.clone(),
+            };
+
+            let conn_args = conn_args.clone();
+            let args = args.clone();
+            let conn_id_seed = conn_id_seed.clone();
+
+            std::thread::Builder::new()
+                .name(format!("quiche-worker-{}", id))
+                .spawn(move || run(worker, &conn_args, &args, &conn_id_seed))
+                .unwrap()
+        })
+        .collect();
+
+    for handle in handles {
+        handle.join().unwrap();
+    }
+}
+
+/// A server worker, owning a socket and the connections it accepted.
+struct Worker {
+    id: usize,
+
+    threads: usize,
+
+    poll: mio::Poll,
+
+    socket: mio::net::UdpSocket,
+
+    /// Packets forwarded by the other workers.
+    queue: mpsc::Receiver<shard::Forwarded>,
+
+    router: shard::Router,
+}
+
+fn run(
+    worker: Worker, conn_args: &CommonArgs, args: &ServerArgs,
+    conn_id_seed: &ring::hmac::Key,
+) {
+    let Worker {
+        id,
+        threads,
+        mut poll,
+        mut socket,
+        queue,
+        router,
+    } = worker;
+
+    let mut buf = [0; MAX_BUF_SIZE];
+    let mut out = [0; MAX_DATAGRAM_SIZE];
+
     // Setup the event loop.
-    let mut poll = mio::Poll::new().unwrap();
     let mut events = mio::Events::with_capacity(1024);
 
-    // Create the UDP listening socket, and register it with the event loop.
-    let mut socket =
-        mio::net::UdpSocket::bind(args.listen.parse().unwrap()).unwrap();
-    info!("listening on {:}", socket.local_addr().unwrap());
-
+    // Register the UDP listening socket with the event loop.
     poll.registry()
         .register(&mut socket, mio::Token(0), mio::Interest::READABLE)
         .unwrap();
@@ -129,14 +251,8 @@ fn main() {
         config.enable_dgram(true, 1000, 1000);
     }
 
-    let rng = SystemRandom::new();
-    let conn_id_seed =
-        ring::hmac::Key::generate(ring::hmac::HMAC_SHA256, &rng).unwrap();
-
     let mut clients = ClientMap::new();
 
-    let mut pkt_count = 0;
-
     let mut continue_write = false;
 
     loop {
@@ -165,18 +281,27 @@ fn main() {
                 break 'read;
             }
 
-            let (len, from) = match socket.recv_from(&mut buf) {
-                Ok(v) => v,
+            // Packets forwarded by other workers are handled first.
+            let (len, from, forwarded) = match queue.try_recv() {
+                Ok((pkt, from)) => {
+                    buf[..pkt.len()].copy_from_slice(&pkt);
 
-                Err(e) => {
-                    // There are no more UDP packets to read, so end the read
-                    // loop.
-                    if e.kind() == std::io::ErrorKind::WouldBlock {
-                        trace!("recv() would block");
-                        break 'read;
-                    }
+                    (pkt.len(), from, true)
+                },
+
+                Err(_) => match socket.recv_from(&mut buf) {
+                    Ok((len, from)) => (len, from, false),
 
-                    panic!("recv() failed: {:?}", e);
+                    Err(e) => {
+                        // There are no more UDP packets to read, so end the
+                        // read loop.
+                        if e.kind() == std::io::ErrorKind::WouldBlock {
+                            trace!("recv() would block");
+                            break 'read;
+                        }
+
+                        panic!("recv() failed: {:?}", e);
+                    },
                 },
             };
 
@@ -185,6 +310,7 @@ fn main() {
             let pkt_buf = &mut buf[..len];
 
             if let Some(target_path) = conn_args.dump_packet_path.as_ref() {
+                let pkt_count = PKT_COUNT.load(atomic::Ordering::Relaxed);
                 let path = format!("{}/{}.pkt", target_path, pkt_count);
 
                 if let Ok(f) = std::fs::File::create(&path) {
@@ -193,7 +319,7 @@ fn main() {
                 }
             }
 
-            pkt_count += 1;
+            PKT_COUNT.fetch_add(1, atomic::Ordering::Relaxed);
 
             // Parse the QUIC packet's header.
             let hdr = match quiche::Header::from_slice(
@@ -210,9 +336,27 @@ fn main() {
 
             trace!("got packet {:?}", hdr);
 
-            let conn_id = ring::hmac::sign(&conn_id_seed, &hdr.dcid);
-            let conn_id = &conn_id.as_ref()[..quiche::MAX_CONN_ID_LEN];
-            let conn_id = conn_id.to_vec().into();
+            // Hand packets of connections owned by another worker over to it.
+            if threads > 1 && !forwarded {
+                let owner = shard::worker_of(&hdr.dcid, threads);
+
+                if owner != id {
+                    trace!("forwarding packet to worker {}", owner);
+
+                    router.forward(owner, pkt_buf, from);
+                    continue 'read;
+                }
+            }
+
+            let conn_id = ring::hmac::sign(conn_id_seed, &hdr.dcid);
+            let mut conn_id =
+                conn_id.as_ref()[..quiche::MAX_CONN_ID_LEN].to_vec();
+
+            if threads > 1 {
+                shard::tag_conn_id(&mut conn_id, id);
+            }
+
+            let conn_id = conn_id.into();
 
             // Lookup a connection based on the packet's connection ID. If there
             // is no connection matching, create a new one.
@@ -353,7 +497,7 @@ fn main() {
                 }
             };
 
-            let recv_info = quiche::RecvInfo { from };
+            let recv_info = quiche::RecvInfo { from, ecn: 0 };
 
             // Process potentially coalesced packets.
             let read = match client.conn.recv(pkt_buf, recv_info) {
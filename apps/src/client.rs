@@ -258,7 +258,7 @@ pub fn connect(
 
             pkt_count += 1;
 
-            let recv_info = quiche::RecvInfo { from };
+            let recv_info = quiche::RecvInfo { from, ecn: 0 };
 
             // Process potentially coalesced packets.
             let read = match conn.recv(&mut buf[..len], recv_info) {
@@ -30,3 +30,4 @@ extern crate log;
 pub mod args;
 pub mod client;
 pub mod common;
+pub mod shard;
@@ -0,0 +1,266 @@
+// Copyright (C) 2022, Cloudflare, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//! Server sharding helpers.
+//!
+//! A sharded server runs one worker per thread. Each worker owns a UDP socket
+//! bound to the same address with `SO_REUSEPORT`, and the connections created
+//! from the packets received on it.
+//!
+//! The first byte of the connection IDs issued by a worker is its index, so
+//! the worker that owns a connection can be found from the destination
+//! connection ID of any of its packets, whatever 4-tuple they come from. On
+//! Linux a classic BPF program attached to the sockets makes the kernel
+//! deliver packets to that worker directly. Elsewhere, or when the program
+//! can't be attached, workers forward packets to each other through a
+//! [`Router`].
+
+use std::io;
+use std::net;
+
+use std::sync::mpsc;
+use std::sync::Arc;
+
+/// Returns the index of the worker that owns the connection a packet with the
+/// given destination connection ID belongs to.
+///
+/// Connection IDs chosen by clients are spread over the workers.
+pub fn worker_of(dcid: &[u8], workers: usize) -> usize {
+    match dcid.first() {
+        Some(v) => *v as usize % workers,
+
+        None => 0,
+    }
+}
+
+/// Marks a connection ID issued by the given worker as owned by it.
+pub fn tag_conn_id(cid: &mut [u8], worker: usize) {
+    assert!(worker <= u8::MAX as usize);
+
+    cid[0] = worker as u8;
+}
+
+/// Creates a UDP socket bound to `addr` that shares the address with the other
+/// sockets bound with this function.
+///
+/// The kernel numbers sockets sharing an address in the order they are bound,
+/// sockets must be bound in the order of the workers using them.
+#[cfg(unix)]
+pub fn bind_reuseport(addr: net::SocketAddr) -> io::Result<net::UdpSocket> {
+    use std::os::unix::io::FromRawFd;
+
+    let (family, sa, sa_len) = to_sockaddr(&addr);
+
+    let fd = unsafe { libc::socket(family, libc::SOCK_DGRAM, 0) };
+    if fd < 0 {
+        return Err(io::Error::last_os_error());
+    }
+
+    // Owning the descriptor right away closes it on error.
+    let socket = unsafe { net::UdpSocket::from_raw_fd(fd) };
+
+    let one: libc::c_int = 1;
+
+    let rc = unsafe {
+        libc::setsockopt(
+            fd,
+            libc::SOL_SOCKET,
+            libc::SO_REUSEPORT,
+            &one as *const _ as *const libc::c_void,
+            std::mem::size_of_val(&one) as libc::socklen_t,
+        )
+    };
+    if rc < 0 {
+        return Err(io::Error::last_os_error());
+    }
+
+    let rc = unsafe {
+        libc::bind(fd, &sa as *const _ as *const libc::sockaddr, sa_len)
+    };
+    if rc < 0 {
+        return Err(io::Error::last_os_error());
+    }
+
+    Ok(socket)
+}
+
+#[cfg(not(unix))]
+pub fn bind_reuseport(_addr: net::SocketAddr) -> io::Result<net::UdpSocket> {
+    Err(io::Error::new(
+        io::ErrorKind::Other,
+        "SO_REUSEPORT is not supported",
+    ))
+}
+
+#[cfg(unix)]
+fn to_sockaddr(
+    addr: &net::SocketAddr,
+) -> (libc::c_int, libc::sockaddr_storage, libc::socklen_t) {
+    let mut sa: libc::sockaddr_storage = unsafe { std::mem::zeroed() };
+
+    match addr {
+        net::SocketAddr::V4(addr) => {
+            let sin =
+                unsafe { &mut *(&mut sa as *mut _ as *mut libc::sockaddr_in) };
+
+            sin.sin_family = libc::AF_INET as libc::sa_family_t;
+            sin.sin_port = addr.port().to_be();
+            sin.sin_addr = libc::in_addr {
+                s_addr: u32::from_ne_bytes(addr.ip().octets()),
+            };
+
+            (
+                libc::AF_INET,
+                sa,
+                std::mem::size_of::<libc::sockaddr_in>() as libc::socklen_t,
+            )
+        },
+
+        net::SocketAddr::V6(addr) => {
+            let sin6 =
+                unsafe { &mut *(&mut sa as *mut _ as *mut libc::sockaddr_in6) };
+
+            sin6.sin6_family = libc::AF_INET6 as libc::sa_family_t;
+            sin6.sin6_port = addr.port().to_be();
+            sin6.sin6_flowinfo = addr.flowinfo();
+            sin6.sin6_addr = libc::in6_addr {
+                s6_addr: addr.ip().octets(),
+            };
+            sin6.sin6_scope_id = addr.scope_id();
+
+            (
+                libc::AF_INET6,
+                sa,
+                std::mem::size_of::<libc::sockaddr_in6>() as libc::socklen_t,
+            )
+        },
+    }
+}
+
+/// Attaches to the sockets sharing the address of `socket` a program that
+/// delivers each packet to the socket of the worker returned by
+/// [`worker_of()`] for its destination connection ID.
+///
+/// [`worker_of()`]: fn.worker_of.html
+#[cfg(target_os = "linux")]
+pub fn attach_steering(
+    socket: &net::UdpSocket, workers: usize,
+) -> io::Result<()> {
+    use std::os::unix::io::AsRawFd;
+
+    // Classic BPF opcodes, see linux/filter.h.
+    const LDB_ABS: u16 = 0x00 | 0x10 | 0x20;
+    const JSET_K: u16 = 0x05 | 0x40 | 0x00;
+    const JA: u16 = 0x05 | 0x00;
+    const MOD_K: u16 = 0x04 | 0x90 | 0x00;
+    const RET_A: u16 = 0x06 | 0x10;
+
+    fn insn(code: u16, jt: u8, jf: u8, k: u32) -> libc::sock_filter {
+        libc::sock_filter { code, jt, jf, k }
+    }
+
+    // The program runs on the UDP payload. The destination connection ID
+    // starts at offset 6 in long header packets and 1 in short header ones.
+    let mut filter = [
+        insn(LDB_ABS, 0, 0, 0),
+        insn(JSET_K, 0, 2, 0x80),
+        insn(LDB_ABS, 0, 0, 6),
+        insn(JA, 0, 0, 1),
+        insn(LDB_ABS, 0, 0, 1),
+        insn(MOD_K, 0, 0, workers as u32),
+        insn(RET_A, 0, 0, 0),
+    ];
+
+    let prog = libc::sock_fprog {
+        len: filter.len() as u16,
+        filter: filter.as_mut_ptr(),
+    };
+
+    let rc = unsafe {
+        libc::setsockopt(
+            socket.as_raw_fd(),
+            libc::SOL_SOCKET,
+            libc::SO_ATTACH_REUSEPORT_CBPF,
+            &prog as *const _ as *const libc::c_void,
+            std::mem::size_of_val(&prog) as libc::socklen_t,
+        )
+    };
+    if rc < 0 {
+        return Err(io::Error::last_os_error());
+    }
+
+    Ok(())
+}
+
+#[cfg(not(target_os = "linux"))]
+pub fn attach_steering(
+    _socket: &net::UdpSocket, _workers: usize,
+) -> io::Result<()> {
+    Err(io::Error::new(
+        io::ErrorKind::Other,
+        "packet steering is not supported",
+    ))
+}
+
+/// A packet forwarded from a worker to another.
+pub type Forwarded = (Vec<u8>, net::SocketAddr);
+
+/// Forwards packets received by a worker to the worker that owns their
+/// connection, for when the kernel doesn't steer them.
+#[derive(Clone)]
+pub struct Router {
+    workers: Vec<(mpsc::Sender<Forwarded>, Arc<mio::Waker>)>,
+}
+
+impl Router {
+    /// Creates a router and the queues of forwarded packets of each worker.
+    ///
+    /// The worker owning the `i`-th queue is woken up with the `i`-th waker.
+    pub fn new(
+        wakers: Vec<Arc<mio::Waker>>,
+    ) -> (Router, Vec<mpsc::Receiver<Forwarded>>) {
+        let mut workers = Vec::with_capacity(wakers.len());
+        let mut queues = Vec::with_capacity(wakers.len());
+
+        for waker in wakers {
+            let (tx, rx) = mpsc::channel();
+
+            workers.push((tx, waker));
+            queues.push(rx);
+        }
+
+        (Router { workers }, queues)
+    }
+
+    /// Queues a packet for the given worker and wakes it up.
+    pub fn forward(&self, worker: usize, pkt: &[u8], from: net::SocketAddr) {
+        let (tx, waker) = &self.workers[worker];
+
+        if tx.send((pkt.to_vec(), from)).is_ok() {
+            waker.wake().ok();
+        }
+    }
+}
@@ -44,7 +44,7 @@ fuzz_target!(|data: &[u8]| {
     )
     .unwrap();
 
-    let info = quiche::RecvInfo { from };
+    let info = quiche::RecvInfo { from, ecn: 0 };
 
     conn.recv(&mut buf, info).ok();
 });
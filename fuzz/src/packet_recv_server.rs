@@ -45,7 +45,7 @@ fuzz_target!(|data: &[u8]| {
     let mut conn =
         quiche::accept(&SCID, None, from, &mut CONFIG.lock().unwrap()).unwrap();
 
-    let info = quiche::RecvInfo { from };
+    let info = quiche::RecvInfo { from, ecn: 0 };
 
     conn.recv(&mut buf, info).ok();
 });
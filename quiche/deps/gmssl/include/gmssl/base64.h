@@ -29,6 +29,8 @@ BASE64 Public API
 	base64_decode_init
 	base64_decode_update
 	base64_decode_finish
+	base64_encode
+	base64_decode
 
 */
 
@@ -62,6 +64,19 @@ int  base64_decode_update(BASE64_CTX *ctx, const uint8_t *in, int inlen, uint8_t
 int  base64_decode_finish(BASE64_CTX *ctx, uint8_t *out, int *outlen);
 
 
+/*
+One-shot codec for whole buffers, vectorized with SSSE3/AVX2 when built with
+ENABLE_BASE64_SIMD. base64_encode() writes BASE64_ENCODE_RAW_LENGTH(inlen)
+characters without line breaks. base64_decode() skips whitespace and line
+breaks, padding is only accepted at the end, out must have room for
+inlen/4*3 bytes.
+*/
+# define BASE64_ENCODE_RAW_LENGTH(l)	(((l)+2)/3*4)
+
+int base64_encode(const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen);
+int base64_decode(const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen);
+
+
 int base64_encode_block(unsigned char *t, const unsigned char *f, int dlen);
 int base64_decode_block(unsigned char *t, const unsigned char *f, int n);
 
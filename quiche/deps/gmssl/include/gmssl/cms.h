@@ -22,6 +22,8 @@ References:
 #include <string.h>
 #include <stdint.h>
 #include <sys/types.h>
+#include <gmssl/sm3.h>
+#include <gmssl/sm4.h>
 #include <gmssl/x509.h>
 
 
@@ -267,6 +269,10 @@ typedef struct {
 	SM2_KEY *sign_key;
 } CMS_CERTS_AND_KEY;
 
+int cms_implicit_signers_certs_to_der(int index,
+	const CMS_CERTS_AND_KEY *signers, size_t signers_cnt,
+	uint8_t **out, size_t *outlen);
+
 int cms_signed_data_sign_to_der(
 	const CMS_CERTS_AND_KEY *signers, size_t signers_cnt,
 	int content_type, const uint8_t *data, size_t datalen, // 当OID_cms_data时为raw data
@@ -538,6 +544,117 @@ int cms_set_key_agreement_info(
 	const uint8_t *user_cert, size_t user_cert_len,
 	const uint8_t *user_id, size_t user_id_len);
 
+/*
+Streaming SignedData and EnvelopedData
+
+	The content (always OID_cms_data) is given or returned piece by piece,
+	neither side keeps the whole message in memory.
+
+	With a known content_len the output is the DER of cms_sign() and
+	cms_envelop(). With CMS_CONTENT_LEN_UNKNOWN, or when the DER lengths
+	would not fit in 4 bytes, the ContentInfo is BER with indefinite lengths
+	and the content is a constructed OCTET STRING, one segment per update.
+
+	The SignedData digest covers the encoded inner ContentInfo up to the
+	content octets, then the content octets, segment headers excluded. For
+	DER input this is the digest of cms_sign().
+
+	init() and finish() write at most maxlen bytes, update() writes at most
+	inlen + CMS_STREAM_UPDATE_OVERHEAD bytes. The verify and deenvelop side
+	accept both encodings, the content is output before finish() returns,
+	so it must not be used unless finish() succeeds.
+*/
+#define CMS_CONTENT_LEN_UNKNOWN		((size_t)-1)
+#define CMS_STREAM_UPDATE_OVERHEAD	32
+#define CMS_STREAM_MAX_BUFFER		(1024 * 1024) // headers and trailing fields of a parsed message
+
+typedef struct {
+	int state;
+	int indefinite;
+	size_t total_len; // length of the DER ContentInfo
+	size_t nbytes; // input so far
+	size_t content_left; // of the DER content or of the current segment
+	uint8_t segment_header[8];
+	size_t segment_header_len;
+	uint8_t *buf; // header, then the fields after the content
+	size_t buf_len;
+	size_t buf_size;
+} CMS_STREAM;
+
+typedef struct {
+	const CMS_CERTS_AND_KEY *signers;
+	size_t signers_cnt;
+	const uint8_t *crls;
+	size_t crls_len;
+	size_t signer_infos_len;
+	int indefinite;
+	size_t content_len;
+	size_t nbytes;
+	SM3_CTX sm3_ctx;
+} CMS_SIGN_CTX;
+
+int cms_sign_init(CMS_SIGN_CTX *ctx,
+	const CMS_CERTS_AND_KEY *signers, size_t signers_cnt,
+	const uint8_t *crls, size_t crls_len,
+	size_t content_len,
+	uint8_t *out, size_t *outlen, size_t maxlen);
+int cms_sign_update(CMS_SIGN_CTX *ctx, const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen);
+int cms_sign_finish(CMS_SIGN_CTX *ctx, uint8_t *out, size_t *outlen, size_t maxlen);
+
+typedef struct {
+	CMS_STREAM stream;
+	SM3_CTX sm3_ctx;
+	// set by cms_verify_finish(), valid until cms_verify_cleanup()
+	const uint8_t *certs;
+	size_t certs_len;
+	const uint8_t *crls;
+	size_t crls_len;
+	const uint8_t *signer_infos;
+	size_t signer_infos_len;
+} CMS_VERIFY_CTX;
+
+int cms_verify_init(CMS_VERIFY_CTX *ctx);
+int cms_verify_update(CMS_VERIFY_CTX *ctx, const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen);
+int cms_verify_finish(CMS_VERIFY_CTX *ctx);
+void cms_verify_cleanup(CMS_VERIFY_CTX *ctx);
+
+typedef struct {
+	const uint8_t *shared_info1;
+	size_t shared_info1_len;
+	const uint8_t *shared_info2;
+	size_t shared_info2_len;
+	int indefinite;
+	size_t content_len;
+	size_t nbytes;
+	SM4_CBC_CTX sm4_ctx;
+} CMS_ENVELOP_CTX;
+
+int cms_envelop_init(CMS_ENVELOP_CTX *ctx,
+	const uint8_t *rcpt_certs, size_t rcpt_certs_len,
+	int enc_algor, const uint8_t *key, size_t keylen, const uint8_t *iv, size_t ivlen,
+	size_t content_len,
+	const uint8_t *shared_info1, size_t shared_info1_len,
+	const uint8_t *shared_info2, size_t shared_info2_len,
+	uint8_t *out, size_t *outlen, size_t maxlen);
+int cms_envelop_update(CMS_ENVELOP_CTX *ctx, const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen);
+int cms_envelop_finish(CMS_ENVELOP_CTX *ctx, uint8_t *out, size_t *outlen, size_t maxlen);
+
+typedef struct {
+	CMS_STREAM stream;
+	const SM2_KEY *rcpt_key;
+	const uint8_t *rcpt_issuer;
+	size_t rcpt_issuer_len;
+	const uint8_t *rcpt_serial;
+	size_t rcpt_serial_len;
+	SM4_CBC_CTX sm4_ctx;
+} CMS_DEENVELOP_CTX;
+
+int cms_deenvelop_init(CMS_DEENVELOP_CTX *ctx,
+	const SM2_KEY *rcpt_key, const uint8_t *rcpt_cert, size_t rcpt_cert_len);
+int cms_deenvelop_update(CMS_DEENVELOP_CTX *ctx, const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen);
+int cms_deenvelop_finish(CMS_DEENVELOP_CTX *ctx, uint8_t *out, size_t *outlen); // at most SM4_BLOCK_SIZE bytes
+void cms_deenvelop_cleanup(CMS_DEENVELOP_CTX *ctx);
+
 #define PEM_CMS "CMS"
 int cms_to_pem(const uint8_t *cms, size_t cms_len, FILE *fp);
 int cms_from_pem(uint8_t *cms, size_t *cms_len, size_t maxlen, FILE *fp);
@@ -30,6 +30,8 @@ PBKDF2 Public API
 	PBKDF2_MAX_SALT_SIZE
 
 	pbkdf2_hmac_sm3_genkey
+	pbkdf2_hmac_sm3_genkey_batch
+	pbkdf2_hmac_sm3_verify_batch
 */
 
 
@@ -47,6 +49,25 @@ int pbkdf2_hmac_sm3_genkey(
 	const char *pass, size_t passlen, const uint8_t *salt, size_t saltlen, size_t iter,
 	size_t outlen, uint8_t *out);
 
+/*
+Batch PBKDF2-HMAC-SM3 for servers deriving or checking many keys at once.
+The output blocks of all jobs share the multi-lane SM3, jobs with the same
+iteration count batch best. For verification `out` holds the stored key and
+results[i] is set to 1 if job i matches, 0 otherwise.
+*/
+typedef struct {
+	const char *pass;
+	size_t passlen;
+	const uint8_t *salt;
+	size_t saltlen;
+	size_t count;
+	size_t outlen;
+	uint8_t *out;
+} PBKDF2_SM3_JOB;
+
+int pbkdf2_hmac_sm3_genkey_batch(const PBKDF2_SM3_JOB *jobs, size_t jobs_cnt);
+int pbkdf2_hmac_sm3_verify_batch(const PBKDF2_SM3_JOB *jobs, size_t jobs_cnt, int *results);
+
 
 #ifdef __cplusplus
 }
@@ -25,6 +25,25 @@ extern "C" {
 
 int pem_read(FILE *fp, const char *name, uint8_t *out, size_t *outlen, size_t maxlen);
 int pem_write(FILE *fp, const char *name, const uint8_t *in, size_t inlen);
+// Decode all `name` blocks of a file into one new buffer, returns 0 if there is none
+int pem_read_bundle(const char *file, const char *name, uint8_t **out, size_t *outlen);
+
+// Incremental PEM for data that does not fit in memory
+typedef struct {
+	FILE *fp;
+	BASE64_CTX base64_ctx;
+	char end_line[80];
+	int end;
+} PEM_CTX;
+
+#define PEM_READ_MIN_OUTLEN	128 // decoded bytes of one line
+
+int pem_write_init(PEM_CTX *ctx, FILE *fp, const char *name);
+int pem_write_update(PEM_CTX *ctx, const uint8_t *in, size_t inlen);
+int pem_write_finish(PEM_CTX *ctx);
+int pem_read_init(PEM_CTX *ctx, FILE *fp, const char *name);
+// Returns 0 after the END line, maxlen must be at least PEM_READ_MIN_OUTLEN
+int pem_read_update(PEM_CTX *ctx, uint8_t *out, size_t *outlen, size_t maxlen);
 
 
 #ifdef __cplusplus
@@ -13,6 +13,7 @@
 
 #include <string.h>
 #include <stdint.h>
+#include <pthread.h>
 #include <gmssl/sm2.h>
 
 
@@ -36,6 +37,14 @@ SDF Public API
 	SDF_KEY
 	sdf_sign
 	sdf_release_key
+
+	SDF_ASYNC
+	sdf_async_init
+	sdf_async_submit
+	sdf_async_poll
+	sdf_async_wait
+	sdf_async_sign
+	sdf_async_cleanup
 */
 
 typedef struct {
@@ -62,6 +71,97 @@ int sdf_release_key(SDF_KEY *key);
 int sdf_close_device(SDF_DEVICE *dev);
 void sdf_unload_library(void);
 
+/*
+SDF_ASYNC
+
+	Job queue in front of one device. Each worker thread owns a session
+	holding the access right of the sign key, and takes its share of the
+	queued jobs, at most SDF_ASYNC_MAX_BATCH, at a time. In a batch the random
+	requests are served by a single SDF_GenerateRandom() call and
+	consecutive encrypt jobs with the same wrapped key share one imported
+	key handle.
+
+	The job is owned by the caller and must stay valid until it is done.
+	The callback, if any, is called from the worker thread before the job
+	is marked done, sdf_async_poll() returns 1 once it is done and
+	sdf_async_wait() blocks until then. job->ret is 1 on success.
+*/
+
+#define SDF_ASYNC_MAX_WORKERS	64
+#define SDF_ASYNC_MAX_BATCH	32
+#define SDF_ASYNC_RAND_BATCH_SIZE	4096 // bytes of random requested in one call
+#define SDF_ASYNC_MAX_WRAPPED_KEY_SIZE	64
+
+enum {
+	SDF_JOB_sign = 1,
+	SDF_JOB_encrypt,
+	SDF_JOB_rand_bytes,
+};
+
+typedef struct SDF_JOB_st SDF_JOB;
+typedef void (*SDF_JOB_CALLBACK)(SDF_JOB *job, void *arg);
+
+struct SDF_JOB_st {
+	int type;
+	int ret;
+	int done;
+	SDF_JOB_CALLBACK callback;
+	void *callback_arg;
+	struct SDF_JOB_st *next;
+
+	// SDF_JOB_sign, DER signature of dgst by the sign key of the SDF_ASYNC
+	uint8_t dgst[32];
+	uint8_t sig[SM2_MAX_SIGNATURE_SIZE];
+	size_t siglen;
+
+	// SDF_JOB_encrypt, the session key is wrapped by the KEK kek_index of the device
+	unsigned int kek_index;
+	uint8_t wrapped_key[SDF_ASYNC_MAX_WRAPPED_KEY_SIZE];
+	size_t wrapped_key_len;
+	unsigned int alg_id; // SGD algorithm identifier, e.g. SGD_SM4_CBC
+	uint8_t iv[16];
+	const uint8_t *in;
+	size_t inlen;
+	uint8_t *out; // inlen bytes, more if the algorithm pads
+	size_t outlen;
+
+	// SDF_JOB_rand_bytes
+	uint8_t *buf;
+	size_t len;
+};
+
+void sdf_job_init_sign(SDF_JOB *job, const uint8_t dgst[32]);
+int sdf_job_init_encrypt(SDF_JOB *job, unsigned int kek_index, const uint8_t *wrapped_key, size_t wrapped_key_len,
+	unsigned int alg_id, const uint8_t iv[16], const uint8_t *in, size_t inlen, uint8_t *out);
+void sdf_job_init_rand_bytes(SDF_JOB *job, uint8_t *buf, size_t len);
+
+typedef struct {
+	SM2_KEY public_key; // of the sign key
+	int sign_key_index; // -1 if no sign key
+	void *dev_handle;
+	const char *pass; // only during sdf_async_init()
+
+	pthread_mutex_t lock;
+	pthread_cond_t job_cond;
+	pthread_cond_t done_cond;
+	SDF_JOB *head;
+	SDF_JOB *tail;
+	size_t queued;
+	int stop;
+	pthread_t workers[SDF_ASYNC_MAX_WORKERS];
+	size_t workers_cnt;
+	size_t workers_ready;
+	size_t workers_failed;
+} SDF_ASYNC;
+
+// sign_key_index < 0 for a queue without sign jobs, pass is then ignored
+int sdf_async_init(SDF_ASYNC *async, SDF_DEVICE *dev, int sign_key_index, const char *pass, size_t workers);
+int sdf_async_submit(SDF_ASYNC *async, SDF_JOB *job, SDF_JOB_CALLBACK callback, void *callback_arg);
+int sdf_async_poll(SDF_ASYNC *async, const SDF_JOB *job);
+int sdf_async_wait(SDF_ASYNC *async, const SDF_JOB *job);
+int sdf_async_sign(SDF_ASYNC *async, const uint8_t dgst[32], uint8_t *sig, size_t *siglen);
+void sdf_async_cleanup(SDF_ASYNC *async);
+
 
 #ifdef __cplusplus
 }
@@ -46,6 +46,8 @@ SM2 Public API
 	sm2_verify
 	sm2_encrypt
 	sm2_decrypt
+	sm2_encrypt_raw
+	sm2_decrypt_raw
 	sm2_ecdh
 
 	SM2_SIGN_CTX
@@ -138,9 +140,11 @@ void sm2_jacobian_point_dbl(SM2_JACOBIAN_POINT *R, const SM2_JACOBIAN_POINT *P);
 void sm2_jacobian_point_add(SM2_JACOBIAN_POINT *R, const SM2_JACOBIAN_POINT *P, const SM2_JACOBIAN_POINT *Q);
 void sm2_jacobian_point_sub(SM2_JACOBIAN_POINT *R, const SM2_JACOBIAN_POINT *P, const SM2_JACOBIAN_POINT *Q);
 void sm2_jacobian_point_mul(SM2_JACOBIAN_POINT *R, const SM2_BN k, const SM2_JACOBIAN_POINT *P);
+void sm2_jacobian_point_mul_ladder(SM2_JACOBIAN_POINT *R, const SM2_BN k, const SM2_JACOBIAN_POINT *P); // k in [1, n-1], same sequence of operations for every k
 void sm2_jacobian_point_to_bytes(const SM2_JACOBIAN_POINT *P, uint8_t out[64]);
 void sm2_jacobian_point_from_bytes(SM2_JACOBIAN_POINT *P, const uint8_t in[64]);
 void sm2_jacobian_point_mul_generator(SM2_JACOBIAN_POINT *R, const SM2_BN k);
+void sm2_jacobian_point_mul_generator_table(SM2_JACOBIAN_POINT *R, const SM2_BN k); // k in [1, n-1], 64 KB table built on first use
 void sm2_jacobian_point_mul_sum(SM2_JACOBIAN_POINT *R, const SM2_BN t, const SM2_JACOBIAN_POINT *P, const SM2_BN s); // 应该返回错误
 void sm2_jacobian_point_from_hex(SM2_JACOBIAN_POINT *P, const char hex[64 * 2]); // 应该返回错误
 
@@ -368,6 +372,25 @@ int sm2_decrypt(const SM2_KEY *key, const uint8_t *in, size_t inlen, uint8_t *ou
 
 int sm2_pub_encrypt(uint8_t * public_key,const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen);
 
+/*
+SM2 Raw Ciphertext
+
+	C1 || C3 || C2, with C1 = 04 || x1 || y1 the uncompressed point, C3 the
+	32-byte hash and C2 as long as the plaintext. The size is known from
+	the plaintext length, there is no DER to encode or parse, which suits
+	small fixed-size payloads such as the transport of a session key.
+	k * G uses a precomputed table, k * P and d * C1 the Montgomery ladder.
+	in and out must not overlap.
+*/
+#define SM2_RAW_CIPHERTEXT_SIZE(inlen)	(65 + 32 + (inlen))
+#define SM2_MAX_RAW_CIPHERTEXT_SIZE	SM2_RAW_CIPHERTEXT_SIZE(SM2_MAX_PLAINTEXT_SIZE)
+
+int sm2_encrypt_raw(const SM2_POINT *public_key, const uint8_t *in, size_t inlen, uint8_t *out);
+int sm2_decrypt_raw(const SM2_KEY *key, const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen);
+
+// out = in xor KDF(x2 || y2, inlen), returns 0 when the key stream is all zero
+int sm2_kdf_xor(const uint8_t xy[64], const uint8_t *in, size_t inlen, uint8_t *out);
+
 int sm2_ecdh(const SM2_KEY *key, const SM2_POINT *peer_public, SM2_POINT *out);
 
 
@@ -0,0 +1,91 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#ifndef GMSSL_SM2_KEY_POOL_H
+#define GMSSL_SM2_KEY_POOL_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <gmssl/sm2.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+SM2 Key Pool Public API
+
+	SM2_KEY_POOL
+	sm2_key_pool_init
+	sm2_key_pool_get
+	sm2_key_pool_count
+	sm2_key_pool_get_stats
+	sm2_key_pool_cleanup
+	sm2_key_pool_new
+	sm2_key_pool_free
+*/
+
+/*
+SM2_KEY_POOL
+
+	Ring of pre-generated SM2 keypairs for ephemeral use, such as ECDHE
+	keys or the key of a key transport, so that sm2_key_generate() does not
+	run on the connection setup path. A background thread fills the ring
+	and sleeps until a taker leaves no more than low_water keys in it.
+
+	sm2_key_pool_get() does not take a lock: the slots carry sequence
+	numbers and takers claim them with a compare-and-swap. When the ring is
+	empty the key is generated inline, this is counted as a miss. Every key
+	is handed out once and wiped from the ring. After a fork() the keys
+	generated before it are never handed out in the child, which has no
+	refill thread, so every get is then a miss.
+*/
+
+#define SM2_KEY_POOL_MAX_SIZE	65536
+
+typedef struct {
+	uint64_t seq;
+	SM2_KEY key;
+} SM2_KEY_POOL_SLOT;
+
+typedef struct {
+	SM2_KEY_POOL_SLOT *slots;
+	size_t size; // power of 2
+	size_t low_water;
+	unsigned int generation; // fork generation of the keys
+	uint64_t head; // next slot to take
+	uint64_t tail; // next slot to fill, only written by the refill thread
+	uint64_t hits;
+	uint64_t misses;
+	int refill;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int stop;
+	pthread_t thread;
+} SM2_KEY_POOL;
+
+// size is rounded up to a power of 2, low_water must be less than size
+int sm2_key_pool_init(SM2_KEY_POOL *pool, size_t size, size_t low_water);
+int sm2_key_pool_get(SM2_KEY_POOL *pool, SM2_KEY *key);
+size_t sm2_key_pool_count(const SM2_KEY_POOL *pool);
+void sm2_key_pool_get_stats(const SM2_KEY_POOL *pool, uint64_t *hits, uint64_t *misses);
+void sm2_key_pool_cleanup(SM2_KEY_POOL *pool);
+
+// For callers that do not see the structure, e.g. through an FFI
+SM2_KEY_POOL *sm2_key_pool_new(size_t size, size_t low_water);
+void sm2_key_pool_free(SM2_KEY_POOL *pool);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
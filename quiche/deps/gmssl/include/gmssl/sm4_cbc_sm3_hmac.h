@@ -0,0 +1,52 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#ifndef GMSSL_SM4_CBC_SM3_HMAC_H
+#define GMSSL_SM4_CBC_SM3_HMAC_H
+
+#include <stdint.h>
+#include <string.h>
+#include <gmssl/sm3.h>
+#include <gmssl/sm4.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+Stitched SM4-CBC + SM3 kernels
+
+	Each chunk is one SM3 compression over `sm3_in` and four SM4-CBC blocks
+	over `in`. The two dependency chains are independent, so the rounds are
+	interleaved to keep both in flight. The caller keeps the two streams
+	apart: `sm3_in` must not overlap the bytes written to `out` in the same
+	chunk. `iv` is updated to the last ciphertext block.
+
+	SM4_CBC_SM3_CHUNK_SIZE
+	sm4_cbc_encrypt_sm3_compress
+	sm4_cbc_decrypt_sm3_compress
+*/
+
+#define SM4_CBC_SM3_CHUNK_SIZE	(SM3_BLOCK_SIZE)
+
+void sm4_cbc_encrypt_sm3_compress(const SM4_KEY *key, uint8_t iv[SM4_BLOCK_SIZE],
+	const uint8_t *in, uint8_t *out,
+	uint32_t digest[SM3_STATE_WORDS], const uint8_t *sm3_in,
+	size_t nchunks);
+void sm4_cbc_decrypt_sm3_compress(const SM4_KEY *key, uint8_t iv[SM4_BLOCK_SIZE],
+	const uint8_t *in, uint8_t *out,
+	uint32_t digest[SM3_STATE_WORDS], const uint8_t *sm3_in,
+	size_t nchunks);
+
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -229,6 +229,7 @@ int  sm9_fp4_rand(sm9_fp4_t r);
 int  sm9_fp4_equ(const sm9_fp4_t a, const sm9_fp4_t b);
 void sm9_fp4_add(sm9_fp4_t r, const sm9_fp4_t a, const sm9_fp4_t b);
 void sm9_fp4_dbl(sm9_fp4_t r, const sm9_fp4_t a);
+void sm9_fp4_tri(sm9_fp4_t r, const sm9_fp4_t a);
 void sm9_fp4_sub(sm9_fp4_t r, const sm9_fp4_t a, const sm9_fp4_t b);
 void sm9_fp4_neg(sm9_fp4_t r, const sm9_fp4_t a);
 void sm9_fp4_mul(sm9_fp4_t r, const sm9_fp4_t a, const sm9_fp4_t b);
@@ -273,6 +274,18 @@ void sm9_fp12_mul(sm9_fp12_t r, const sm9_fp12_t a, const sm9_fp12_t b);
 void sm9_fp12_sqr(sm9_fp12_t r, const sm9_fp12_t a);
 void sm9_fp12_inv(sm9_fp12_t r, const sm9_fp12_t a);
 void sm9_fp12_pow(sm9_fp12_t r, const sm9_fp12_t a, const sm9_bn_t k);
+void sm9_fp12_cyclotomic_sqr(sm9_fp12_t r, const sm9_fp12_t a);
+void sm9_fp12_cyclotomic_pow(sm9_fp12_t r, const sm9_fp12_t a, const sm9_bn_t k);
+
+// fixed-base exponentiation for a cyclotomic a, such as a pairing value
+#define SM9_FP12_TABLE_TEETH	4
+#define SM9_FP12_TABLE_SIZE	(1 << SM9_FP12_TABLE_TEETH)
+typedef struct {
+	sm9_fp12_t powers[SM9_FP12_TABLE_SIZE];
+} SM9_FP12_TABLE;
+
+void sm9_fp12_table_init(SM9_FP12_TABLE *table, const sm9_fp12_t a);
+void sm9_fp12_pow_table(sm9_fp12_t r, const sm9_bn_t k, const SM9_FP12_TABLE *table);
 void sm9_fp12_to_bytes(const sm9_fp12_t a, uint8_t buf[32 * 12]);
 int  sm9_fp12_from_bytes(sm9_fp12_t r, const uint8_t in[32 * 12]);
 void sm9_fp12_to_hex(const sm9_fp12_t a, char hex[65 * 12]);
@@ -314,6 +327,16 @@ void sm9_point_neg(SM9_POINT *R, const SM9_POINT *P);
 void sm9_point_sub(SM9_POINT *R, const SM9_POINT *P, const SM9_POINT *Q);
 void sm9_point_mul(SM9_POINT *R, const sm9_bn_t k, const SM9_POINT *P);
 void sm9_point_mul_generator(SM9_POINT *R, const sm9_bn_t k);
+
+// fixed-base comb, k*P in 32 doublings and up to 32 additions
+#define SM9_POINT_TABLE_TEETH	8
+#define SM9_POINT_TABLE_SIZE	(1 << SM9_POINT_TABLE_TEETH)
+typedef struct {
+	SM9_POINT points[SM9_POINT_TABLE_SIZE];
+} SM9_POINT_TABLE;
+
+void sm9_point_table_init(SM9_POINT_TABLE *table, const SM9_POINT *P);
+void sm9_point_mul_table(SM9_POINT *R, const sm9_bn_t k, const SM9_POINT_TABLE *table);
 void sm9_point_from_hex(SM9_POINT *R, const char hex[65 * 2]);		
 int sm9_point_to_uncompressed_octets(const SM9_POINT *P, uint8_t octets[65]);
 int sm9_point_from_uncompressed_octets(SM9_POINT *P, const uint8_t octets[65]);
@@ -362,6 +385,20 @@ void sm9_final_exponent_hard_part(sm9_fp12_t r, const sm9_fp12_t f);
 void sm9_final_exponent(sm9_fp12_t r, const sm9_fp12_t f);
 void sm9_pairing(sm9_fp12_t r, const SM9_TWIST_POINT *Q, const SM9_POINT *P);
 
+// Miller loop lines of a fixed Q, {a0, a1/yP, a4/xP} per step
+#define SM9_PAIRING_LINES	82
+typedef struct {
+	sm9_fp2_t lines[SM9_PAIRING_LINES][3];
+	int infinity;
+} SM9_PAIRING_TABLE;
+
+void sm9_pairing_table_init(SM9_PAIRING_TABLE *table, const SM9_TWIST_POINT *Q);
+void sm9_pairing_with_table(sm9_fp12_t r, const SM9_PAIRING_TABLE *table, const SM9_POINT *P);
+void sm9_pairing2_with_tables(sm9_fp12_t r,
+	const SM9_PAIRING_TABLE *table1, const SM9_POINT *P1,
+	const SM9_PAIRING_TABLE *table2, const SM9_POINT *P2);
+const SM9_PAIRING_TABLE *sm9_p2_pairing_table_get(void);
+
 
 /* private key extract algorithms */
 #define SM9_HID_SIGN		0x01
@@ -562,6 +599,42 @@ int sm9_decrypt(const SM9_ENC_KEY *key, const char *id, size_t idlen,
 	const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen);
 
 
+/*
+Master public key precomputation
+
+	The pairing g = e(P1, Ppubs) or g = e(Ppube, P2) depends only on the master
+	public key. SM9_MASTER_PRECOMP caches g with a fixed-base table of its
+	powers, plus the Miller lines of Ppubs for verification or a comb table of
+	Ppube for encryption, so that signing and encryption need no pairing. The
+	object is about 100 KB, allocate it on the heap.
+*/
+typedef struct {
+	int hid; // SM9_HID_SIGN or SM9_HID_ENC
+	SM9_TWIST_POINT Ppubs;
+	SM9_POINT Ppube;
+	sm9_fp12_t g;
+	SM9_FP12_TABLE g_table;
+	SM9_PAIRING_TABLE Ppubs_lines; // SM9_HID_SIGN
+	SM9_POINT_TABLE Ppube_table; // SM9_HID_ENC
+} SM9_MASTER_PRECOMP;
+
+int sm9_sign_master_precomp_init(SM9_MASTER_PRECOMP *pre, const SM9_SIGN_MASTER_KEY *mpk);
+int sm9_enc_master_precomp_init(SM9_MASTER_PRECOMP *pre, const SM9_ENC_MASTER_KEY *mpk);
+
+int sm9_do_sign_precomp(const SM9_SIGN_KEY *key, const SM9_MASTER_PRECOMP *pre,
+	const SM3_CTX *sm3_ctx, SM9_SIGNATURE *sig);
+int sm9_do_verify_precomp(const SM9_MASTER_PRECOMP *pre, const char *id, size_t idlen,
+	const SM3_CTX *sm3_ctx, const SM9_SIGNATURE *sig);
+int sm9_sign_finish_precomp(SM9_SIGN_CTX *ctx, const SM9_SIGN_KEY *key,
+	const SM9_MASTER_PRECOMP *pre, uint8_t *sig, size_t *siglen);
+int sm9_verify_finish_precomp(SM9_SIGN_CTX *ctx, const uint8_t *sig, size_t siglen,
+	const SM9_MASTER_PRECOMP *pre, const char *id, size_t idlen);
+int sm9_kem_encrypt_precomp(const SM9_MASTER_PRECOMP *pre, const char *id, size_t idlen,
+	size_t klen, uint8_t *kbuf, SM9_POINT *C);
+int sm9_encrypt_precomp(const SM9_MASTER_PRECOMP *pre, const char *id, size_t idlen,
+	const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen);
+
+
 
 #ifdef  __cplusplus
 }
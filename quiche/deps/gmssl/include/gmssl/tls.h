@@ -25,6 +25,10 @@
 #include <gmssl/sm4.h>
 #include <gmssl/digest.h>
 #include <gmssl/block_cipher.h>
+#include <gmssl/x509_crl.h>
+#include <gmssl/x509_store.h>
+#include <gmssl/sdf.h>
+#include <gmssl/sm2_key_pool.h>
 
 
 #ifdef __cplusplus
@@ -570,7 +574,11 @@ int tls_record_get_handshake_certificate(const uint8_t *record, uint8_t *certs,
 int tls_server_key_exchange_print(FILE *fp, const uint8_t *ske, size_t skelen, int format, int indent);
 
 #define TLS_MAX_SIGNATURE_SIZE	SM2_MAX_SIGNATURE_SIZE
-int tls_sign_server_ecdh_params(const SM2_KEY *server_sign_key,
+// Finishes with the private key of ctx, or with the device key of sign_offload if not NULL
+int tls_sm2_sign_finish(SM2_SIGN_CTX *ctx, SDF_ASYNC *sign_offload, uint8_t *sig, size_t *siglen);
+// From ecdhe_pool if not NULL
+int tls_ecdhe_key_generate(SM2_KEY_POOL *ecdhe_pool, SM2_KEY *key);
+int tls_sign_server_ecdh_params(const SM2_KEY *server_sign_key, SDF_ASYNC *sign_offload,
 	const uint8_t client_random[32], const uint8_t server_random[32],
 	int curve, const SM2_POINT *point, uint8_t *sig, size_t *siglen);
 int tls_verify_server_ecdh_params(const SM2_KEY *server_sign_key,
@@ -723,13 +731,24 @@ typedef struct {
 	SM2_KEY signkey;
 	SM2_KEY kenckey;
 	int verify_depth;
+	X509_STORE *store; // built from cacerts, shared by the connections
+	const X509_CRL_INDEX *crls; // not owned
+	size_t crls_cnt;
+	SDF_ASYNC *sign_offload; // not owned, signkey is then a public key
+	SM2_KEY_POOL *ecdhe_pool; // not owned
 } TLS_CTX;
 
 int tls_ctx_init(TLS_CTX *ctx, int protocol, int is_client);
 int tls_ctx_set_cipher_suites(TLS_CTX *ctx, const int *cipher_suites, size_t cipher_suites_cnt);
 int tls_ctx_set_ca_certificates(TLS_CTX *ctx, const char *cacertsfile, int depth);
+// Peer chains are rejected with certificate_revoked if listed, the indexes must outlive ctx and its connections
+int tls_ctx_set_crl_indexes(TLS_CTX *ctx, const X509_CRL_INDEX *crls, size_t crls_cnt);
 int tls_ctx_set_certificate_and_key(TLS_CTX *ctx, const char *chainfile,
 	const char *keyfile, const char *keypass);
+// The sign key stays in the device, offload must outlive ctx and its connections
+int tls_ctx_set_certificate_and_offload_key(TLS_CTX *ctx, const char *chainfile, SDF_ASYNC *offload);
+// Ephemeral ECDHE keys are taken from pool, which must outlive ctx and its connections
+int tls_ctx_set_ecdhe_key_pool(TLS_CTX *ctx, SM2_KEY_POOL *pool);
 int tls_ctx_set_tlcp_server_certificate_and_keys(TLS_CTX *ctx, const char *chainfile,
 	const char *signkeyfile, const char *signkeypass,
 	const char *kenckeyfile, const char *kenckeypass);
@@ -770,9 +789,14 @@ typedef struct {
 	size_t client_certs_len;
 	uint8_t ca_certs[2048];
 	size_t ca_certs_len;
+	X509_STORE *store;
+	const X509_CRL_INDEX *crls;
+	size_t crls_cnt;
 
 	SM2_KEY sign_key;
 	SM2_KEY kenc_key;
+	SDF_ASYNC *sign_offload;
+	SM2_KEY_POOL *ecdhe_pool;
 
 	int verify_result;
 
@@ -13,6 +13,10 @@
 #define GMSSL_X509_CRL_H
 
 
+#include <time.h>
+#include <stdint.h>
+#include <gmssl/x509.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -270,6 +274,59 @@ int x509_crl_find_revoked_cert_by_serial_number(const uint8_t *a, size_t alen,
 
 int x509_crls_print(FILE *fp, int fmt, int ind, const char *label, const uint8_t *d, size_t dlen);
 
+
+/*
+Indexed CRL
+
+	X509_CRL_INDEX keeps the revoked serial numbers of one issuer sorted, a
+	revocation check is a binary search instead of decoding every
+	revokedCertificate of the CRL. The entries are fixed size records
+	without pointers, x509_crl_index_save() writes them to a file that
+	x509_crl_index_map() maps back without any DER parsing. The file is in
+	host byte order, it is a local cache and not an interchange format.
+
+	A delta CRL (RFC 5280 5.2.4) is merged with x509_crl_index_apply_delta():
+	its entries are added, entries with reason removeFromCRL are deleted.
+	The caller verifies CRL signatures before indexing them.
+
+	x509_crl_index_find_revoked() returns 1 and the entry if the serial
+	number is revoked, 0 if not.
+	x509_certs_check_revocation() returns 1 if no certificate of the chain
+	is revoked by one of the indexes, 0 if one is.
+*/
+#define X509_CRL_INDEX_NO_REASON	0xff
+
+typedef struct {
+	uint8_t serial[X509_SERIAL_NUMBER_MAX_LEN];
+	uint8_t serial_len;
+	uint8_t reason; // X509_CRL_REASON or X509_CRL_INDEX_NO_REASON
+	uint8_t reserved[2];
+	int64_t revoke_date;
+} X509_CRL_ENTRY;
+
+typedef struct {
+	uint8_t *issuer;
+	size_t issuer_len;
+	time_t this_update;
+	time_t next_update;
+	int crl_number; // -1 if the CRL has no CRLNumber
+	X509_CRL_ENTRY *entries;
+	size_t entries_cnt;
+	void *map; // set when the entries are mapped from a file
+	size_t map_len;
+} X509_CRL_INDEX;
+
+int x509_crl_index_init(X509_CRL_INDEX *idx, const uint8_t *crl, size_t crl_len);
+int x509_crl_index_apply_delta(X509_CRL_INDEX *idx, const uint8_t *delta_crl, size_t delta_crl_len);
+int x509_crl_index_find_revoked(const X509_CRL_INDEX *idx,
+	const uint8_t *serial, size_t serial_len, const X509_CRL_ENTRY **entry);
+int x509_crl_index_save(const X509_CRL_INDEX *idx, FILE *fp);
+int x509_crl_index_map(X509_CRL_INDEX *idx, const char *file);
+void x509_crl_index_cleanup(X509_CRL_INDEX *idx);
+
+int x509_certs_check_revocation(const uint8_t *certs, size_t certslen,
+	const X509_CRL_INDEX *crls, size_t crls_cnt);
+
 #ifdef  __cplusplus
 }
 #endif
@@ -0,0 +1,111 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+
+#ifndef GMSSL_X509_STORE_H
+#define GMSSL_X509_STORE_H
+
+
+#include <time.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <gmssl/sm2.h>
+#include <gmssl/sm3.h>
+#include <gmssl/x509.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+X509_STORE
+
+	Trust anchors and known intermediate CA certificates, parsed once and
+	indexed by subject name and SubjectKeyIdentifier.
+
+	Certificates of the verified chains are cached in parsed form by their
+	SM3 hash, with the SM2 public key decoded and its Z value for
+	SM2_DEFAULT_ID computed. Every verified (certificate, issuer) signature
+	is remembered by the hashes of both certificates, so a chain seen before
+	is checked with hashing and validity-time comparisons only. A remembered
+	link is used only while now is within the validity of both certificates.
+
+	Certificates are added before the store is shared, x509_store_verify()
+	and x509_store_verify_tlcp() may be called from many threads.
+
+	The verify functions return 1 if the chain leads to a trusted
+	certificate and -1 otherwise, verify_result is set to 1 or to an
+	X509_VERIFY_ERR. depth is the maximum number of certificates of the
+	path, the trust anchor excluded.
+*/
+
+#define X509_STORE_BUCKETS		256
+#define X509_STORE_CERT_CACHE_SIZE	128
+#define X509_STORE_LINK_CACHE_SIZE	256
+#define X509_STORE_MAX_CHAIN		8
+
+// Parsed certificate, the offsets are valid for any copy of the DER with the same hash
+typedef struct {
+	uint8_t hash[SM3_DIGEST_SIZE];
+	size_t certlen; // 0 for an empty cache slot
+	size_t tbs_offset, tbs_len;
+	size_t sig_offset, sig_len;
+	size_t issuer_offset, issuer_len;
+	size_t subject_offset, subject_len;
+	size_t ski_offset, ski_len; // SubjectKeyIdentifier, ski_len is 0 if absent
+	size_t akid_offset, akid_len; // AuthorityKeyIdentifier keyIdentifier, akid_len is 0 if absent
+	int signature_algor;
+	time_t not_before;
+	time_t not_after;
+	SM2_KEY public_key;
+	uint8_t z[SM3_DIGEST_SIZE];
+} X509_CERT_INFO;
+
+typedef struct X509_STORE_ENTRY_st {
+	uint8_t *cert;
+	X509_CERT_INFO info;
+	int trusted;
+	struct X509_STORE_ENTRY_st *next;
+	struct X509_STORE_ENTRY_st *next_by_subject;
+	struct X509_STORE_ENTRY_st *next_by_ski;
+} X509_STORE_ENTRY;
+
+typedef struct {
+	uint8_t cert_hash[SM3_DIGEST_SIZE];
+	uint8_t issuer_hash[SM3_DIGEST_SIZE];
+	time_t not_before; // the later not_before of the two certificates
+	time_t not_after; // the earlier not_after, 0 for an empty slot
+} X509_STORE_LINK;
+
+typedef struct {
+	X509_STORE_ENTRY *entries;
+	size_t entries_cnt;
+	X509_STORE_ENTRY *by_subject[X509_STORE_BUCKETS];
+	X509_STORE_ENTRY *by_ski[X509_STORE_BUCKETS];
+
+	pthread_mutex_t lock; // protects the two caches
+	X509_CERT_INFO cert_cache[X509_STORE_CERT_CACHE_SIZE];
+	X509_STORE_LINK link_cache[X509_STORE_LINK_CACHE_SIZE];
+} X509_STORE;
+
+int x509_store_init(X509_STORE *store);
+int x509_store_add_cert(X509_STORE *store, const uint8_t *cert, size_t certlen, int trusted);
+int x509_store_add_certs(X509_STORE *store, const uint8_t *certs, size_t certslen, int trusted);
+int x509_store_verify(X509_STORE *store, const uint8_t *certs, size_t certslen,
+	int depth, int *verify_result);
+int x509_store_verify_tlcp(X509_STORE *store, const uint8_t *certs, size_t certslen,
+	int depth, int *verify_result);
+void x509_store_cleanup(X509_STORE *store);
+
+
+#ifdef  __cplusplus
+}
+#endif
+#endif
@@ -43,6 +43,11 @@ ZUC Public API
 
 	zuc_eea_encrypt
 	zuc_eia_generate_mac
+
+	ZUC_EEA_JOB
+	zuc_eea_encrypt_batch
+	ZUC_EIA_JOB
+	zuc_eia_generate_mac_batch
 */
 
 
@@ -89,6 +94,48 @@ ZUC_UINT32 zuc_eia_generate_mac(const ZUC_UINT32 *data, size_t nbits,
 	const uint8_t key[ZUC_KEY_SIZE], ZUC_UINT32 count, ZUC_UINT5 bearer,
 	ZUC_BIT direction);
 
+/*
+Batch EEA3/EIA3
+
+	Independent bearers are run side by side, one ZUC state per SIMD lane
+	(16 with AVX-512, 8 with AVX2, one at a time otherwise). Every
+	job gives the same result as the single bearer function with the same
+	arguments. Jobs of similar length batch best, a group of lanes is
+	clocked until its longest job is done.
+*/
+typedef struct {
+	const uint8_t *key;
+	ZUC_UINT32 count;
+	ZUC_UINT5 bearer;
+	ZUC_BIT direction;
+	const ZUC_UINT32 *in;
+	ZUC_UINT32 *out;
+	size_t nbits;
+} ZUC_EEA_JOB;
+
+typedef struct {
+	const uint8_t *key;
+	ZUC_UINT32 count;
+	ZUC_UINT5 bearer;
+	ZUC_BIT direction;
+	const ZUC_UINT32 *data;
+	size_t nbits;
+	ZUC_UINT32 mac; // output
+} ZUC_EIA_JOB;
+
+void zuc_eea_encrypt_batch(const ZUC_EEA_JOB *jobs, size_t njobs);
+int zuc_eia_generate_mac_batch(ZUC_EIA_JOB *jobs, size_t njobs);
+
+// Raw keystream of many (key, iv) pairs, `iv` is ZUC_IV_SIZE or ZUC256_IV_SIZE bytes
+typedef struct {
+	const uint8_t *key;
+	const uint8_t *iv;
+	ZUC_UINT32 *keystream;
+	size_t nwords;
+} ZUC_KEYSTREAM_JOB;
+
+void zuc_generate_keystream_batch(const ZUC_KEYSTREAM_JOB *jobs, size_t njobs);
+
 
 # define ZUC256_KEY_SIZE	32
 # define ZUC256_IV_SIZE		23
@@ -103,6 +150,7 @@ typedef ZUC_STATE ZUC256_STATE;
 void zuc256_init(ZUC256_STATE *state, const uint8_t key[ZUC256_KEY_SIZE], const uint8_t iv[ZUC256_IV_SIZE]);
 #define zuc256_generate_keystream(state,nwords,words) zuc_generate_keystream(state,nwords,words)
 #define zuc256_generate_keyword(state) zuc_generate_keyword(state)
+void zuc256_generate_keystream_batch(const ZUC_KEYSTREAM_JOB *jobs, size_t njobs);
 
 
 typedef struct ZUC256_MAC_CTX_st {
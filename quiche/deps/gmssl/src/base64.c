@@ -15,6 +15,7 @@
 #include <assert.h>
 #include <gmssl/base64.h>
 #include <gmssl/error.h>
+#include "base64_lcl.h"
 
 static unsigned char conv_ascii2bin(unsigned char a);
 #define conv_bin2ascii(a)       (data_bin2ascii[(a)&0x3f])
@@ -156,6 +157,15 @@ int base64_encode_block(unsigned char *t, const unsigned char *f, int dlen)
     int i, ret = 0;
     unsigned long l;
 
+#ifdef ENABLE_BASE64_SIMD
+    if (dlen > 0) {
+        i = (int)base64_encode_simd(t, f, dlen);
+        t += i / 3 * 4;
+        f += i;
+        dlen -= i;
+        ret = i / 3 * 4;
+    }
+#endif
     for (i = dlen; i > 0; i -= 3) {
         if (i >= 3) {
             l = (((unsigned long)f[0]) << 16L) |
@@ -341,7 +351,14 @@ int base64_decode_block(unsigned char *t, const unsigned char *f, int n)
     if (n % 4 != 0)
         return (-1);
 
-    for (i = 0; i < n; i += 4) {
+    i = 0;
+#ifdef ENABLE_BASE64_SIMD
+    i = (int)base64_decode_simd(t, f, n);
+    t += i / 4 * 3;
+    f += i;
+    ret = i / 4 * 3;
+#endif
+    for (; i < n; i += 4) {
         a = conv_ascii2bin(*(f++));
         b = conv_ascii2bin(*(f++));
         c = conv_ascii2bin(*(f++));
@@ -376,3 +393,105 @@ int base64_decode_finish(BASE64_CTX *ctx, uint8_t *out, int *outl)
     } else
         return (1);
 }
+
+int base64_encode(const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen)
+{
+	size_t i = 0;
+	uint32_t l;
+
+	if (!in || !out || !outlen) {
+		error_print();
+		return -1;
+	}
+	*outlen = 0;
+#ifdef ENABLE_BASE64_SIMD
+	i = base64_encode_simd(out, in, inlen);
+	out += i/3 * 4;
+#endif
+	for (; inlen - i >= 3; i += 3) {
+		l = ((uint32_t)in[i] << 16) | ((uint32_t)in[i + 1] << 8) | in[i + 2];
+		*out++ = conv_bin2ascii(l >> 18);
+		*out++ = conv_bin2ascii(l >> 12);
+		*out++ = conv_bin2ascii(l >> 6);
+		*out++ = conv_bin2ascii(l);
+	}
+	if (inlen - i) {
+		l = (uint32_t)in[i] << 16;
+		if (inlen - i == 2) {
+			l |= (uint32_t)in[i + 1] << 8;
+		}
+		*out++ = conv_bin2ascii(l >> 18);
+		*out++ = conv_bin2ascii(l >> 12);
+		*out++ = (inlen - i == 1) ? '=' : conv_bin2ascii(l >> 6);
+		*out++ = '=';
+	}
+	*outlen = (inlen + 2)/3 * 4;
+	return 1;
+}
+
+int base64_decode(const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen)
+{
+	uint8_t *p = out;
+	uint32_t quad = 0;
+	int n = 0; // characters in quad
+	int pad = 0;
+	size_t i = 0;
+
+	if (!in || !out || !outlen) {
+		error_print();
+		return -1;
+	}
+	while (i < inlen) {
+		unsigned char c, v;
+
+#ifdef ENABLE_BASE64_SIMD
+		// whole lines go to the vector code, only line breaks and padding are left here
+		if (n == 0 && !pad && inlen - i >= 16) {
+			size_t done = base64_decode_simd(p, in + i, inlen - i);
+			i += done;
+			p += done/4 * 3;
+			if (i == inlen) {
+				break;
+			}
+		}
+#endif
+		c = in[i++];
+		v = conv_ascii2bin(c);
+
+		if (v == B64_WS || v == B64_EOLN || v == B64_CR) {
+			continue;
+		}
+		if (c == '=') {
+			if (n < 2 || n + pad == 4) {
+				error_print();
+				return -1;
+			}
+			if (n + ++pad == 4) {
+				quad <<= 6 * pad;
+				*p++ = (uint8_t)(quad >> 16);
+				if (n == 3) {
+					*p++ = (uint8_t)(quad >> 8);
+				}
+			}
+			continue;
+		}
+		if (pad || v > 0x3f) {
+			error_print();
+			return -1;
+		}
+		quad = (quad << 6) | v;
+		if (++n == 4) {
+			*p++ = (uint8_t)(quad >> 16);
+			*p++ = (uint8_t)(quad >> 8);
+			*p++ = (uint8_t)quad;
+			quad = 0;
+			n = 0;
+		}
+	}
+	if (n && n + pad != 4) {
+		error_print();
+		return -1;
+	}
+	*outlen = p - out;
+	return 1;
+}
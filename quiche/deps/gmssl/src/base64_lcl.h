@@ -0,0 +1,31 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#ifndef GMSSL_BASE64_LCL_H
+#define GMSSL_BASE64_LCL_H
+
+#include <gmssl/base64.h>
+
+#ifdef ENABLE_BASE64_SIMD
+/*
+ * Vector kernels for the head of a buffer, the caller finishes the tail with
+ * the scalar code. Both return 0 on CPUs without SSSE3.
+ *
+ * base64_encode_simd() encodes whole 3-byte groups and returns the number of
+ * input bytes consumed, a multiple of 3, having written 4/3 of that.
+ * base64_decode_simd() stops at the first vector holding a character outside
+ * the alphabet ('=', line breaks), it returns the number of characters
+ * consumed, a multiple of 4, having written 3/4 of that.
+ */
+size_t base64_encode_simd(uint8_t *out, const uint8_t *in, size_t inlen);
+size_t base64_decode_simd(uint8_t *out, const uint8_t *in, size_t inlen);
+#endif
+
+#endif
@@ -0,0 +1,236 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#include <string.h>
+#include <immintrin.h>
+#include "base64_lcl.h"
+
+/*
+ * SSSE3 and AVX2 base64 in the style of W. Mula and D. Lemire. Encoding
+ * spreads 12 (24) input bytes to 16 (32) 6-bit indices with one shuffle and
+ * two multiplies, then maps an index to its character by adding an offset
+ * looked up from the index range. Decoding classifies every character by
+ * its two nibbles, any character outside the alphabet makes the whole vector
+ * fall back to the scalar code, then packs the 6-bit values back with
+ * multiply-adds. The kernels are compiled with target attributes and chosen
+ * at run time.
+ *
+ * A vector load reads 4 bytes past the 12 (24) input bytes of a step, and a
+ * decoded vector is stored through a stack buffer, so neither reads past the
+ * end of the input nor writes past the output.
+ */
+
+__attribute__((target("ssse3")))
+static inline __m128i enc_reshuffle_ssse3(__m128i in)
+{
+	__m128i t0, t1, t2, t3;
+
+	in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+	t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+	t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+	t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+	return _mm_or_si128(t1, t3);
+}
+
+__attribute__((target("ssse3")))
+static inline __m128i enc_translate_ssse3(__m128i idx)
+{
+	const __m128i lut = _mm_setr_epi8(
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+	__m128i r = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+	__m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+	r = _mm_or_si128(r, _mm_and_si128(less, _mm_set1_epi8(13)));
+	return _mm_add_epi8(_mm_shuffle_epi8(lut, r), idx);
+}
+
+__attribute__((target("ssse3")))
+static size_t base64_encode_ssse3(uint8_t *out, const uint8_t *in, size_t inlen)
+{
+	size_t done = 0;
+
+	while (inlen - done >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + done));
+		v = enc_translate_ssse3(enc_reshuffle_ssse3(v));
+		_mm_storeu_si128((__m128i *)out, v);
+		out += 16;
+		done += 12;
+	}
+	return done;
+}
+
+__attribute__((target("avx2")))
+static size_t base64_encode_avx2(uint8_t *out, const uint8_t *in, size_t inlen)
+{
+	const __m256i shuf = _mm256_set_epi8(
+		10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+		10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+	const __m256i lut = _mm256_setr_epi8(
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+	size_t done = 0;
+
+	while (inlen - done >= 28) {
+		__m256i v, t0, t1, t2, t3, r, less;
+
+		// bytes 0..11 to the low lane and 12..23 to the high lane
+		v = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(in + done))),
+			_mm_loadu_si128((const __m128i *)(in + done + 12)), 1);
+		v = _mm256_shuffle_epi8(v, shuf);
+		t0 = _mm256_and_si256(v, _mm256_set1_epi32(0x0fc0fc00));
+		t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+		t2 = _mm256_and_si256(v, _mm256_set1_epi32(0x003f03f0));
+		t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+		v = _mm256_or_si256(t1, t3);
+
+		r = _mm256_subs_epu8(v, _mm256_set1_epi8(51));
+		less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), v);
+		r = _mm256_or_si256(r, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+		v = _mm256_add_epi8(_mm256_shuffle_epi8(lut, r), v);
+
+		_mm256_storeu_si256((__m256i *)out, v);
+		out += 32;
+		done += 24;
+	}
+	return done + base64_encode_ssse3(out, in + done, inlen - done);
+}
+
+__attribute__((target("ssse3")))
+static size_t base64_decode_ssse3(uint8_t *out, const uint8_t *in, size_t inlen)
+{
+	const __m128i lut_lo = _mm_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m128i lut_hi = _mm_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71,
+		0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i pack = _mm_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	uint8_t buf[16];
+	size_t done = 0;
+
+	while (inlen - done >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(in + done));
+		__m128i hi = _mm_and_si128(_mm_srli_epi32(v, 4), _mm_set1_epi8(0x0f));
+		__m128i lo = _mm_and_si128(v, _mm_set1_epi8(0x0f));
+		__m128i bad, eq_2f;
+
+		bad = _mm_and_si128(_mm_shuffle_epi8(lut_lo, lo), _mm_shuffle_epi8(lut_hi, hi));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) != 0xffff) {
+			break;
+		}
+		eq_2f = _mm_cmpeq_epi8(v, _mm_set1_epi8(0x2f));
+		v = _mm_add_epi8(v, _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2f, hi)));
+
+		v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+		v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+		v = _mm_shuffle_epi8(v, pack);
+		_mm_storeu_si128((__m128i *)buf, v);
+		memcpy(out, buf, 12);
+		out += 12;
+		done += 16;
+	}
+	return done;
+}
+
+__attribute__((target("avx2")))
+static size_t base64_decode_avx2(uint8_t *out, const uint8_t *in, size_t inlen)
+{
+	const __m256i lut_lo = _mm256_setr_epi8(
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m256i lut_hi = _mm256_setr_epi8(
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lut_roll = _mm256_setr_epi8(
+		0, 16, 19, 4, -65, -65, -71, -71,
+		0, 0, 0, 0, 0, 0, 0, 0,
+		0, 16, 19, 4, -65, -65, -71, -71,
+		0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i pack = _mm256_setr_epi8(
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	uint8_t buf[32];
+	size_t done = 0;
+
+	while (inlen - done >= 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(in + done));
+		__m256i hi = _mm256_and_si256(_mm256_srli_epi32(v, 4), _mm256_set1_epi8(0x0f));
+		__m256i lo = _mm256_and_si256(v, _mm256_set1_epi8(0x0f));
+		__m256i eq_2f;
+
+		if (!_mm256_testz_si256(_mm256_shuffle_epi8(lut_lo, lo), _mm256_shuffle_epi8(lut_hi, hi))) {
+			break;
+		}
+		eq_2f = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x2f));
+		v = _mm256_add_epi8(v, _mm256_shuffle_epi8(lut_roll, _mm256_add_epi8(eq_2f, hi)));
+
+		v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+		v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+		v = _mm256_shuffle_epi8(v, pack);
+		// 12 bytes in each lane, gather them in the low 24 bytes
+		v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+		_mm256_storeu_si256((__m256i *)buf, v);
+		memcpy(out, buf, 24);
+		out += 24;
+		done += 32;
+	}
+	return done + base64_decode_ssse3(out, in + done, inlen - done);
+}
+
+static int base64_cpu_level = -1; // 2 AVX2, 1 SSSE3, 0 none
+
+static int base64_cpu_init(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		base64_cpu_level = 2;
+	} else if (__builtin_cpu_supports("ssse3")) {
+		base64_cpu_level = 1;
+	} else {
+		base64_cpu_level = 0;
+	}
+	return base64_cpu_level;
+}
+
+size_t base64_encode_simd(uint8_t *out, const uint8_t *in, size_t inlen)
+{
+	int level = base64_cpu_level < 0 ? base64_cpu_init() : base64_cpu_level;
+
+	if (level == 2) {
+		return base64_encode_avx2(out, in, inlen);
+	} else if (level == 1) {
+		return base64_encode_ssse3(out, in, inlen);
+	}
+	return 0;
+}
+
+size_t base64_decode_simd(uint8_t *out, const uint8_t *in, size_t inlen)
+{
+	int level = base64_cpu_level < 0 ? base64_cpu_init() : base64_cpu_level;
+
+	if (level == 2) {
+		return base64_decode_avx2(out, in, inlen);
+	} else if (level == 1) {
+		return base64_decode_ssse3(out, in, inlen);
+	}
+	return 0;
+}
@@ -0,0 +1,1187 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <gmssl/asn1.h>
+#include <gmssl/sm2.h>
+#include <gmssl/sm3.h>
+#include <gmssl/sm4.h>
+#include <gmssl/oid.h>
+#include <gmssl/x509.h>
+#include <gmssl/x509_alg.h>
+#include <gmssl/error.h>
+#include <gmssl/cms.h>
+
+
+#define CMS_STREAM_HEADER	0
+#define CMS_STREAM_CONTENT	1
+#define CMS_STREAM_SEGMENT	2
+#define CMS_STREAM_TAIL		3
+
+#define CMS_DER_MAX_LEN		((size_t)0xffffffff) // asn1_length_to_der() outputs at most 4 length bytes
+#define CMS_DER_MAX_HEADERS	256 // tags, lengths, versions and OIDs around the content
+#define CMS_SM2_SIGNATURE_SIZE	71 // sm2_sign_ex() with fixed_outlen
+
+
+static int cms_indefinite_header_to_der(int tag, uint8_t **out, size_t *outlen)
+{
+	if (out && *out) {
+		*(*out)++ = (uint8_t)tag;
+		*(*out)++ = 0x80;
+	}
+	*outlen += 2;
+	return 1;
+}
+
+static int cms_end_of_contents_to_der(int count, uint8_t **out, size_t *outlen)
+{
+	int i;
+	for (i = 0; i < count; i++) {
+		if (out && *out) {
+			*(*out)++ = 0x00;
+			*(*out)++ = 0x00;
+		}
+		*outlen += 2;
+	}
+	return 1;
+}
+
+static int cms_end_of_contents_from_der(int count, const uint8_t **in, size_t *inlen)
+{
+	int i;
+	for (i = 0; i < count; i++) {
+		if (*inlen < 2 || (*in)[0] != 0x00 || (*in)[1] != 0x00) {
+			error_print();
+			return -1;
+		}
+		*in += 2;
+		*inlen -= 2;
+	}
+	return 1;
+}
+
+// Returns 0 if the input ends before the header does
+static int cms_ber_header_from_der(int *tag, size_t *len, int *indefinite, const uint8_t **in, size_t *inlen)
+{
+	const uint8_t *p = *in;
+	size_t nbytes = 0;
+	size_t i;
+
+	if (*inlen < 2) {
+		return 0;
+	}
+	*tag = p[0];
+	*len = 0;
+	*indefinite = 0;
+	if (p[1] == 0x80) {
+		if (!(p[0] & ASN1_TAG_CONSTRUCTED)) {
+			error_print();
+			return -1;
+		}
+		*indefinite = 1;
+	} else if (p[1] < 0x80) {
+		*len = p[1];
+	} else {
+		nbytes = p[1] & 0x7f;
+		if (nbytes > 4) {
+			error_print();
+			return -1;
+		}
+		if (*inlen < 2 + nbytes) {
+			return 0;
+		}
+		for (i = 0; i < nbytes; i++) {
+			*len = (*len << 8) | p[2 + i];
+		}
+	}
+	*in += 2 + nbytes;
+	*inlen -= 2 + nbytes;
+	return 1;
+}
+
+// `end` is the offset from `start` where the value ends, undefined for indefinite lengths
+static int cms_ber_header_expect(int tag, const uint8_t *start, size_t *end, int *indefinite,
+	const uint8_t **in, size_t *inlen)
+{
+	int ret;
+	int t;
+	size_t len;
+
+	if ((ret = cms_ber_header_from_der(&t, &len, indefinite, in, inlen)) != 1) {
+		if (ret < 0) error_print();
+		return ret;
+	}
+	if (t != tag) {
+		error_print();
+		return -1;
+	}
+	*end = (size_t)(*in - start) + len;
+	return 1;
+}
+
+// A complete definite length TLV
+static int cms_ber_tlv_from_der(int tag, const uint8_t **tlv, size_t *tlvlen, const uint8_t **in, size_t *inlen)
+{
+	const uint8_t *p = *in;
+	size_t plen = *inlen;
+	int t;
+	size_t len;
+	int indefinite;
+	int ret;
+
+	if ((ret = cms_ber_header_from_der(&t, &len, &indefinite, &p, &plen)) != 1) {
+		if (ret < 0) error_print();
+		return ret;
+	}
+	if (t != tag || indefinite) {
+		error_print();
+		return -1;
+	}
+	if (plen < len) {
+		return 0;
+	}
+	*tlv = *in;
+	*tlvlen = (size_t)(p - *in) + len;
+	*in = p + len;
+	*inlen = plen - len;
+	return 1;
+}
+
+// Length of a ContentInfo with content_len bytes of [0] EXPLICIT content
+static size_t cms_content_info_len(int content_type, size_t content_len)
+{
+	uint8_t buf[32];
+	uint8_t *p = buf;
+	size_t len = 0;
+
+	cms_content_info_header_to_der(content_type, content_len, &p, &len);
+	return len + content_len;
+}
+
+static int cms_stream_init(CMS_STREAM *s)
+{
+	memset(s, 0, sizeof(CMS_STREAM));
+	s->state = CMS_STREAM_HEADER;
+	return 1;
+}
+
+static void cms_stream_cleanup(CMS_STREAM *s)
+{
+	if (s->buf) {
+		free(s->buf);
+	}
+	memset(s, 0, sizeof(CMS_STREAM));
+}
+
+static int cms_stream_append(CMS_STREAM *s, const uint8_t *in, size_t inlen)
+{
+	uint8_t *buf;
+	size_t size;
+
+	if (inlen > CMS_STREAM_MAX_BUFFER - s->buf_len) {
+		error_print();
+		return -1;
+	}
+	if (s->buf_len + inlen > s->buf_size) {
+		size = s->buf_size ? s->buf_size : 1024;
+		while (size < s->buf_len + inlen) {
+			size *= 2;
+		}
+		if (!(buf = realloc(s->buf, size))) {
+			error_print();
+			return -1;
+		}
+		s->buf = buf;
+		s->buf_size = size;
+	}
+	memcpy(s->buf + s->buf_len, in, inlen);
+	s->buf_len += inlen;
+	return 1;
+}
+
+/*
+The header function parses the ContentInfo up to the content, it returns 0
+until the header is complete, then sets indefinite, total_len and
+content_left of the stream. The content function gets the content octets.
+*/
+typedef int (*CMS_STREAM_HEADER_FUNC)(void *ctx, CMS_STREAM *s, const uint8_t *d, size_t dlen, size_t *hdrlen);
+typedef int (*CMS_STREAM_CONTENT_FUNC)(void *ctx, const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen);
+
+static int cms_stream_update(CMS_STREAM *s, void *ctx,
+	CMS_STREAM_HEADER_FUNC header_func, CMS_STREAM_CONTENT_FUNC content_func,
+	const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen)
+{
+	uint8_t *buf;
+	const uint8_t *p;
+	size_t len, hdrlen, n;
+	int tag, indefinite;
+	int ret;
+
+	*outlen = 0;
+	while (inlen) {
+		switch (s->state) {
+		case CMS_STREAM_HEADER:
+			// a few KB at a time, the content must not go into the buffer
+			len = inlen < 4096 ? inlen : 4096;
+			if (cms_stream_append(s, in, len) != 1) {
+				error_print();
+				return -1;
+			}
+			in += len;
+			inlen -= len;
+			if ((ret = header_func(ctx, s, s->buf, s->buf_len, &hdrlen)) != 1) {
+				if (ret < 0) {
+					error_print();
+					return -1;
+				}
+				break;
+			}
+			if (s->indefinite) {
+				s->state = CMS_STREAM_SEGMENT;
+			} else {
+				s->state = s->content_left ? CMS_STREAM_CONTENT : CMS_STREAM_TAIL;
+			}
+			// the buffered input after the header
+			buf = s->buf;
+			len = s->buf_len - hdrlen;
+			s->buf = NULL;
+			s->buf_len = s->buf_size = 0;
+			ret = cms_stream_update(s, ctx, header_func, content_func, buf + hdrlen, len, out, &n);
+			free(buf);
+			if (ret != 1) {
+				error_print();
+				return -1;
+			}
+			if (out) out += n;
+			*outlen += n;
+			break;
+
+		case CMS_STREAM_CONTENT:
+			len = inlen < s->content_left ? inlen : s->content_left;
+			if (content_func(ctx, in, len, out, &n) != 1) {
+				error_print();
+				return -1;
+			}
+			if (out) out += n;
+			*outlen += n;
+			in += len;
+			inlen -= len;
+			s->content_left -= len;
+			if (!s->content_left) {
+				s->state = s->indefinite ? CMS_STREAM_SEGMENT : CMS_STREAM_TAIL;
+			}
+			break;
+
+		case CMS_STREAM_SEGMENT:
+			if (s->segment_header_len >= sizeof(s->segment_header)) {
+				error_print();
+				return -1;
+			}
+			s->segment_header[s->segment_header_len++] = *in++;
+			inlen--;
+			p = s->segment_header;
+			len = s->segment_header_len;
+			if ((ret = cms_ber_header_from_der(&tag, &s->content_left, &indefinite, &p, &len)) != 1) {
+				if (ret < 0) {
+					error_print();
+					return -1;
+				}
+				break;
+			}
+			s->segment_header_len = 0;
+			if (tag == 0 && !indefinite && !s->content_left) {
+				// end-of-contents of the constructed OCTET STRING
+				s->state = CMS_STREAM_TAIL;
+			} else if (tag == ASN1_TAG_OCTET_STRING && !indefinite) {
+				if (s->content_left) {
+					s->state = CMS_STREAM_CONTENT;
+				}
+			} else {
+				error_print();
+				return -1;
+			}
+			break;
+
+		case CMS_STREAM_TAIL:
+			if (cms_stream_append(s, in, inlen) != 1) {
+				error_print();
+				return -1;
+			}
+			inlen = 0;
+			break;
+		}
+	}
+	return 1;
+}
+
+static int cms_stream_finish(CMS_STREAM *s)
+{
+	if (s->state != CMS_STREAM_TAIL) {
+		error_print();
+		return -1;
+	}
+	if (!s->indefinite && s->nbytes != s->total_len) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+static int cms_signer_infos_length(const CMS_CERTS_AND_KEY *signers, size_t signers_cnt, size_t *len)
+{
+	uint8_t sig[CMS_SM2_SIGNATURE_SIZE] = {0};
+	const uint8_t *issuer;
+	size_t issuer_len;
+	const uint8_t *serial;
+	size_t serial_len;
+	size_t i;
+
+	*len = 0;
+	for (i = 0; i < signers_cnt; i++) {
+		if (x509_cert_get_issuer_and_serial_number(
+				signers[i].certs, signers[i].certs_len,
+				&issuer, &issuer_len, &serial, &serial_len) != 1
+			|| cms_signer_info_to_der(CMS_version_v1,
+				issuer, issuer_len, serial, serial_len,
+				OID_sm3, NULL, 0,
+				OID_sm2sign_with_sm3, sig, sizeof(sig),
+				NULL, 0, NULL, len) != 1) {
+			error_print();
+			return -1;
+		}
+	}
+	return 1;
+}
+
+// certificates, crls and signerInfos of the SignedData
+static int cms_sign_tail_len(const CMS_SIGN_CTX *ctx, size_t *len)
+{
+	*len = 0;
+	if (cms_implicit_signers_certs_to_der(0, ctx->signers, ctx->signers_cnt, NULL, len) < 0
+		|| asn1_implicit_set_to_der(1, ctx->crls, ctx->crls_len, NULL, len) < 0
+		|| asn1_set_header_to_der(ctx->signer_infos_len, NULL, len) != 1) {
+		error_print();
+		return -1;
+	}
+	*len += ctx->signer_infos_len;
+	return 1;
+}
+
+
+int cms_sign_init(CMS_SIGN_CTX *ctx,
+	const CMS_CERTS_AND_KEY *signers, size_t signers_cnt,
+	const uint8_t *crls, size_t crls_len,
+	size_t content_len,
+	uint8_t *out, size_t *outlen, size_t maxlen)
+{
+	int digest_algors[] = { OID_sm3 };
+	size_t digest_algors_cnt = sizeof(digest_algors)/sizeof(int);
+	uint8_t header[CMS_DER_MAX_HEADERS];
+	uint8_t *p = header;
+	size_t len = 0;
+	size_t content_info_offset;
+	size_t tail_len;
+
+	if (!ctx || !signers || !signers_cnt || !outlen) {
+		error_print();
+		return -1;
+	}
+	memset(ctx, 0, sizeof(CMS_SIGN_CTX));
+	ctx->signers = signers;
+	ctx->signers_cnt = signers_cnt;
+	ctx->crls = crls;
+	ctx->crls_len = crls_len;
+	ctx->content_len = content_len;
+
+	if (cms_signer_infos_length(signers, signers_cnt, &ctx->signer_infos_len) != 1
+		|| cms_sign_tail_len(ctx, &tail_len) != 1) {
+		error_print();
+		return -1;
+	}
+	ctx->indefinite = (content_len == CMS_CONTENT_LEN_UNKNOWN
+		|| tail_len > CMS_DER_MAX_LEN/2
+		|| content_len > CMS_DER_MAX_LEN - tail_len - CMS_DER_MAX_HEADERS);
+
+	if (ctx->indefinite) {
+		if (cms_indefinite_header_to_der(ASN1_TAG_SEQUENCE, &p, &len) != 1
+			|| cms_content_type_to_der(OID_cms_signed_data, &p, &len) != 1
+			|| cms_indefinite_header_to_der(ASN1_TAG_EXPLICIT(0), &p, &len) != 1
+			|| cms_indefinite_header_to_der(ASN1_TAG_SEQUENCE, &p, &len) != 1) {
+			error_print();
+			return -1;
+		}
+	} else {
+		size_t octets_len = 0;
+		size_t signed_data_len = 0;
+		size_t signed_data_header_len = 0;
+
+		if (asn1_octet_string_header_to_der(content_len, NULL, &octets_len) != 1
+			|| asn1_int_to_der(CMS_version_v1, NULL, &signed_data_len) != 1
+			|| cms_digest_algors_to_der(digest_algors, digest_algors_cnt, NULL, &signed_data_len) != 1
+			|| asn1_sequence_header_to_der(signed_data_len, NULL, &signed_data_header_len) != 1) {
+			error_print();
+			return -1;
+		}
+		octets_len += content_len;
+		signed_data_len += cms_content_info_len(OID_cms_data, octets_len) + tail_len;
+		signed_data_header_len = 0;
+		if (asn1_sequence_header_to_der(signed_data_len, NULL, &signed_data_header_len) != 1
+			|| cms_content_info_header_to_der(OID_cms_signed_data,
+				signed_data_header_len + signed_data_len, &p, &len) != 1
+			|| asn1_sequence_header_to_der(signed_data_len, &p, &len) != 1) {
+			error_print();
+			return -1;
+		}
+	}
+	if (asn1_int_to_der(CMS_version_v1, &p, &len) != 1
+		|| cms_digest_algors_to_der(digest_algors, digest_algors_cnt, &p, &len) != 1) {
+		error_print();
+		return -1;
+	}
+
+	// the digest starts at the inner ContentInfo
+	content_info_offset = len;
+	if (ctx->indefinite) {
+		if (cms_indefinite_header_to_der(ASN1_TAG_SEQUENCE, &p, &len) != 1
+			|| cms_content_type_to_der(OID_cms_data, &p, &len) != 1
+			|| cms_indefinite_header_to_der(ASN1_TAG_EXPLICIT(0), &p, &len) != 1
+			|| cms_indefinite_header_to_der(ASN1_TAG_OCTET_STRING|ASN1_TAG_CONSTRUCTED, &p, &len) != 1) {
+			error_print();
+			return -1;
+		}
+	} else {
+		size_t octets_len = 0;
+		if (asn1_octet_string_header_to_der(content_len, NULL, &octets_len) != 1
+			|| cms_content_info_header_to_der(OID_cms_data, octets_len + content_len, &p, &len) != 1
+			|| asn1_octet_string_header_to_der(content_len, &p, &len) != 1) {
+			error_print();
+			return -1;
+		}
+	}
+	sm3_init(&ctx->sm3_ctx);
+	sm3_update(&ctx->sm3_ctx, header + content_info_offset, len - content_info_offset);
+
+	if (len > maxlen) {
+		error_print();
+		return -1;
+	}
+	memcpy(out, header, len);
+	*outlen = len;
+	return 1;
+}
+
+int cms_sign_update(CMS_SIGN_CTX *ctx, const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen)
+{
+	uint8_t *p = out;
+
+	*outlen = 0;
+	if (!inlen) {
+		return 1;
+	}
+	if (ctx->indefinite) {
+		if (inlen > CMS_DER_MAX_LEN) {
+			error_print();
+			return -1;
+		}
+		asn1_octet_string_header_to_der(inlen, &p, outlen);
+	} else if (inlen > ctx->content_len - ctx->nbytes) {
+		error_print();
+		return -1;
+	}
+	memcpy(p, in, inlen);
+	*outlen += inlen;
+	sm3_update(&ctx->sm3_ctx, in, inlen);
+	ctx->nbytes += inlen;
+	return 1;
+}
+
+int cms_sign_finish(CMS_SIGN_CTX *ctx, uint8_t *out, size_t *outlen, size_t maxlen)
+{
+	const uint8_t *issuer;
+	size_t issuer_len;
+	const uint8_t *serial;
+	size_t serial_len;
+	size_t len;
+	size_t i;
+
+	if (!ctx->indefinite && ctx->nbytes != ctx->content_len) {
+		error_print();
+		return -1;
+	}
+	if (cms_sign_tail_len(ctx, &len) != 1) {
+		error_print();
+		return -1;
+	}
+	if (ctx->indefinite) {
+		len += 2 * 6;
+	}
+	if (len > maxlen) {
+		error_print();
+		return -1;
+	}
+
+	*outlen = 0;
+	if (ctx->indefinite) {
+		// OCTET STRING, [0] and the inner ContentInfo
+		cms_end_of_contents_to_der(3, &out, outlen);
+	}
+	if (cms_implicit_signers_certs_to_der(0, ctx->signers, ctx->signers_cnt, &out, outlen) < 0
+		|| asn1_implicit_set_to_der(1, ctx->crls, ctx->crls_len, &out, outlen) < 0
+		|| asn1_set_header_to_der(ctx->signer_infos_len, &out, outlen) != 1) {
+		error_print();
+		return -1;
+	}
+	for (i = 0; i < ctx->signers_cnt; i++) {
+		if (x509_cert_get_issuer_and_serial_number(
+				ctx->signers[i].certs, ctx->signers[i].certs_len,
+				&issuer, &issuer_len, &serial, &serial_len) != 1
+			|| cms_signer_info_sign_to_der(&ctx->sm3_ctx, ctx->signers[i].sign_key,
+				issuer, issuer_len, serial, serial_len,
+				NULL, 0, NULL, 0, &out, outlen) != 1) {
+			error_print();
+			return -1;
+		}
+	}
+	if (ctx->indefinite) {
+		// SignedData, [0] and the ContentInfo
+		cms_end_of_contents_to_der(3, &out, outlen);
+	}
+	if (*outlen != len) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+static int cms_verify_header(void *ctx, CMS_STREAM *s, const uint8_t *d, size_t dlen, size_t *hdrlen)
+{
+	SM3_CTX *sm3_ctx = &((CMS_VERIFY_CTX *)ctx)->sm3_ctx;
+	const uint8_t *p = d;
+	size_t len = dlen;
+	size_t end[6];
+	int indefinite[6];
+	const uint8_t *tlv;
+	size_t tlvlen;
+	const uint8_t *content_info;
+	int content_type;
+	int version;
+	int digest_algors[4];
+	size_t digest_algors_cnt;
+	int tag;
+	int ret, i;
+
+	if ((ret = cms_ber_header_expect(ASN1_TAG_SEQUENCE, d, &end[0], &indefinite[0], &p, &len)) != 1
+		|| (ret = cms_ber_tlv_from_der(ASN1_TAG_OBJECT_IDENTIFIER, &tlv, &tlvlen, &p, &len)) != 1) {
+		goto end;
+	}
+	if (cms_content_type_from_der(&content_type, &tlv, &tlvlen) != 1
+		|| content_type != OID_cms_signed_data) {
+		error_print();
+		return -1;
+	}
+	if ((ret = cms_ber_header_expect(ASN1_TAG_EXPLICIT(0), d, &end[1], &indefinite[1], &p, &len)) != 1
+		|| (ret = cms_ber_header_expect(ASN1_TAG_SEQUENCE, d, &end[2], &indefinite[2], &p, &len)) != 1
+		|| (ret = cms_ber_tlv_from_der(ASN1_TAG_INTEGER, &tlv, &tlvlen, &p, &len)) != 1) {
+		goto end;
+	}
+	if (asn1_int_from_der(&version, &tlv, &tlvlen) != 1
+		|| version != CMS_version_v1) {
+		error_print();
+		return -1;
+	}
+	if ((ret = cms_ber_tlv_from_der(ASN1_TAG_SET, &tlv, &tlvlen, &p, &len)) != 1) {
+		goto end;
+	}
+	if (cms_digest_algors_from_der(digest_algors, &digest_algors_cnt,
+			sizeof(digest_algors)/sizeof(digest_algors[0]), &tlv, &tlvlen) != 1
+		|| digest_algors_cnt != 1
+		|| digest_algors[0] != OID_sm3) {
+		error_print();
+		return -1;
+	}
+
+	content_info = p;
+	if ((ret = cms_ber_header_expect(ASN1_TAG_SEQUENCE, d, &end[3], &indefinite[3], &p, &len)) != 1
+		|| (ret = cms_ber_tlv_from_der(ASN1_TAG_OBJECT_IDENTIFIER, &tlv, &tlvlen, &p, &len)) != 1) {
+		goto end;
+	}
+	if (cms_content_type_from_der(&content_type, &tlv, &tlvlen) != 1
+		|| content_type != OID_cms_data) {
+		error_print();
+		return -1;
+	}
+	if ((ret = cms_ber_header_expect(ASN1_TAG_EXPLICIT(0), d, &end[4], &indefinite[4], &p, &len)) != 1) {
+		goto end;
+	}
+	tag = indefinite[0] ? ASN1_TAG_OCTET_STRING|ASN1_TAG_CONSTRUCTED : ASN1_TAG_OCTET_STRING;
+	if ((ret = cms_ber_header_expect(tag, d, &end[5], &indefinite[5], &p, &len)) != 1) {
+		goto end;
+	}
+
+	// either BER with indefinite lengths or DER
+	for (i = 1; i < 6; i++) {
+		if (indefinite[i] != indefinite[0]) {
+			error_print();
+			return -1;
+		}
+	}
+	*hdrlen = (size_t)(p - d);
+	s->indefinite = indefinite[0];
+	if (!s->indefinite) {
+		if (end[1] != end[0] || end[2] != end[0]
+			|| end[4] != end[3] || end[5] != end[3] || end[3] > end[2]) {
+			error_print();
+			return -1;
+		}
+		s->total_len = end[0];
+		s->content_left = end[5] - *hdrlen;
+	}
+	sm3_init(sm3_ctx);
+	sm3_update(sm3_ctx, content_info, (size_t)(p - content_info));
+	return 1;
+end:
+	if (ret < 0) error_print();
+	return ret;
+}
+
+static int cms_verify_content(void *ctx, const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen)
+{
+	sm3_update(&((CMS_VERIFY_CTX *)ctx)->sm3_ctx, in, inlen);
+	if (out) {
+		memcpy(out, in, inlen);
+		*outlen = inlen;
+	} else {
+		*outlen = 0;
+	}
+	return 1;
+}
+
+int cms_verify_init(CMS_VERIFY_CTX *ctx)
+{
+	memset(ctx, 0, sizeof(CMS_VERIFY_CTX));
+	cms_stream_init(&ctx->stream);
+	return 1;
+}
+
+int cms_verify_update(CMS_VERIFY_CTX *ctx, const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen)
+{
+	ctx->stream.nbytes += inlen;
+	if (cms_stream_update(&ctx->stream, ctx, cms_verify_header, cms_verify_content,
+		in, inlen, out, outlen) != 1) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+int cms_verify_finish(CMS_VERIFY_CTX *ctx)
+{
+	const uint8_t *p;
+	size_t len;
+	const uint8_t *signer_infos;
+	size_t signer_infos_len;
+
+	if (cms_stream_finish(&ctx->stream) != 1) {
+		error_print();
+		return -1;
+	}
+	p = ctx->stream.buf;
+	len = ctx->stream.buf_len;
+	if (ctx->stream.indefinite) {
+		// [0] and the inner ContentInfo
+		if (cms_end_of_contents_from_der(2, &p, &len) != 1) {
+			error_print();
+			return -1;
+		}
+	}
+	if (asn1_implicit_set_from_der(0, &ctx->certs, &ctx->certs_len, &p, &len) < 0
+		|| asn1_implicit_set_from_der(1, &ctx->crls, &ctx->crls_len, &p, &len) < 0
+		|| asn1_set_from_der(&ctx->signer_infos, &ctx->signer_infos_len, &p, &len) != 1
+		|| (ctx->stream.indefinite && cms_end_of_contents_from_der(3, &p, &len) != 1)
+		|| asn1_length_is_zero(len) != 1) {
+		error_print();
+		return -1;
+	}
+	if (!ctx->signer_infos_len) {
+		error_print();
+		return -1;
+	}
+
+	signer_infos = ctx->signer_infos;
+	signer_infos_len = ctx->signer_infos_len;
+	while (signer_infos_len) {
+		const uint8_t *cert;
+		size_t certlen;
+		const uint8_t *issuer;
+		size_t issuer_len;
+		const uint8_t *serial;
+		size_t serial_len;
+		const uint8_t *authed_attrs;
+		size_t authed_attrs_len;
+		const uint8_t *unauthed_attrs;
+		size_t unauthed_attrs_len;
+
+		if (cms_signer_info_verify_from_der(
+			&ctx->sm3_ctx, ctx->certs, ctx->certs_len,
+			&cert, &certlen,
+			&issuer, &issuer_len,
+			&serial, &serial_len,
+			&authed_attrs, &authed_attrs_len,
+			&unauthed_attrs, &unauthed_attrs_len,
+			&signer_infos, &signer_infos_len) != 1) {
+			error_print();
+			return -1;
+		}
+	}
+	return 1;
+}
+
+void cms_verify_cleanup(CMS_VERIFY_CTX *ctx)
+{
+	if (ctx) {
+		cms_stream_cleanup(&ctx->stream);
+		memset(ctx, 0, sizeof(CMS_VERIFY_CTX));
+	}
+}
+
+static int cms_envelop_header_to_der(const CMS_ENVELOP_CTX *ctx,
+	const uint8_t *rcpt_infos, size_t rcpt_infos_len,
+	int enc_algor, const uint8_t *iv, size_t ivlen,
+	uint8_t **out, size_t *outlen)
+{
+	size_t enced_content_len;
+	size_t enced_content_info_len = 0;
+	size_t enveloped_data_len = 0;
+	size_t len = 0;
+
+	if (ctx->indefinite) {
+		if (cms_indefinite_header_to_der(ASN1_TAG_SEQUENCE, out, outlen) != 1
+			|| cms_content_type_to_der(OID_cms_enveloped_data, out, outlen) != 1
+			|| cms_indefinite_header_to_der(ASN1_TAG_EXPLICIT(0), out, outlen) != 1
+			|| cms_indefinite_header_to_der(ASN1_TAG_SEQUENCE, out, outlen) != 1
+			|| asn1_int_to_der(CMS_version_v1, out, outlen) != 1
+			|| asn1_set_to_der(rcpt_infos, rcpt_infos_len, out, outlen) != 1
+			|| cms_indefinite_header_to_der(ASN1_TAG_SEQUENCE, out, outlen) != 1
+			|| cms_content_type_to_der(OID_cms_data, out, outlen) != 1
+			|| x509_encryption_algor_to_der(enc_algor, iv, ivlen, out, outlen) != 1
+			|| cms_indefinite_header_to_der(ASN1_TAG_EXPLICIT(0), out, outlen) != 1) {
+			error_print();
+			return -1;
+		}
+		return 1;
+	}
+
+	enced_content_len = (ctx->content_len/SM4_BLOCK_SIZE + 1) * SM4_BLOCK_SIZE;
+	if (cms_content_type_to_der(OID_cms_data, NULL, &enced_content_info_len) != 1
+		|| x509_encryption_algor_to_der(enc_algor, iv, ivlen, NULL, &enced_content_info_len) != 1
+		|| asn1_header_to_der(ASN1_TAG_IMPLICIT(0), enced_content_len, NULL, &enced_content_info_len) != 1
+		|| asn1_implicit_octet_string_to_der(1, ctx->shared_info1, ctx->shared_info1_len, NULL, &enced_content_info_len) < 0
+		|| asn1_implicit_octet_string_to_der(2, ctx->shared_info2, ctx->shared_info2_len, NULL, &enced_content_info_len) < 0
+		|| asn1_int_to_der(CMS_version_v1, NULL, &enveloped_data_len) != 1
+		|| asn1_set_to_der(rcpt_infos, rcpt_infos_len, NULL, &enveloped_data_len) != 1
+		|| asn1_sequence_header_to_der(enced_content_info_len + enced_content_len, NULL, &enveloped_data_len) != 1) {
+		error_print();
+		return -1;
+	}
+	enced_content_info_len += enced_content_len;
+	enveloped_data_len += enced_content_info_len;
+	if (asn1_sequence_header_to_der(enveloped_data_len, NULL, &len) != 1
+		|| cms_content_info_header_to_der(OID_cms_enveloped_data, len + enveloped_data_len, out, outlen) != 1
+		|| asn1_sequence_header_to_der(enveloped_data_len, out, outlen) != 1
+		|| asn1_int_to_der(CMS_version_v1, out, outlen) != 1
+		|| asn1_set_to_der(rcpt_infos, rcpt_infos_len, out, outlen) != 1
+		|| asn1_sequence_header_to_der(enced_content_info_len, out, outlen) != 1
+		|| cms_content_type_to_der(OID_cms_data, out, outlen) != 1
+		|| x509_encryption_algor_to_der(enc_algor, iv, ivlen, out, outlen) != 1
+		|| asn1_header_to_der(ASN1_TAG_IMPLICIT(0), enced_content_len, out, outlen) != 1) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+int cms_envelop_init(CMS_ENVELOP_CTX *ctx,
+	const uint8_t *rcpt_certs, size_t rcpt_certs_len,
+	int enc_algor, const uint8_t *key, size_t keylen, const uint8_t *iv, size_t ivlen,
+	size_t content_len,
+	const uint8_t *shared_info1, size_t shared_info1_len,
+	const uint8_t *shared_info2, size_t shared_info2_len,
+	uint8_t *out, size_t *outlen, size_t maxlen)
+{
+	int ret = -1;
+	const uint8_t *certs = rcpt_certs;
+	size_t certs_len = rcpt_certs_len;
+	size_t rcpt_cnt = 0;
+	uint8_t *rcpt_infos = NULL;
+	size_t rcpt_infos_len = 0;
+	uint8_t *p;
+	size_t len = 0;
+
+	if (!ctx || !rcpt_certs || !rcpt_certs_len || !key || !iv || !outlen) {
+		error_print();
+		return -1;
+	}
+	if (enc_algor != OID_sm4_cbc || keylen != SM4_KEY_SIZE || ivlen != SM4_BLOCK_SIZE) {
+		error_print();
+		return -1;
+	}
+	memset(ctx, 0, sizeof(CMS_ENVELOP_CTX));
+	ctx->shared_info1 = shared_info1;
+	ctx->shared_info1_len = shared_info1_len;
+	ctx->shared_info2 = shared_info2;
+	ctx->shared_info2_len = shared_info2_len;
+	ctx->content_len = content_len;
+
+	while (certs_len) {
+		const uint8_t *cert;
+		size_t certlen;
+		if (asn1_any_from_der(&cert, &certlen, &certs, &certs_len) != 1) {
+			error_print();
+			return -1;
+		}
+		rcpt_cnt++;
+	}
+	// a RecipientInfo is shorter than the certificate plus the encrypted key
+	if (!(rcpt_infos = malloc(rcpt_certs_len + rcpt_cnt * SM2_MAX_CIPHERTEXT_SIZE))) {
+		error_print();
+		return -1;
+	}
+	p = rcpt_infos;
+	certs = rcpt_certs;
+	certs_len = rcpt_certs_len;
+	while (certs_len) {
+		const uint8_t *cert;
+		size_t certlen;
+		const uint8_t *issuer;
+		size_t issuer_len;
+		const uint8_t *serial;
+		size_t serial_len;
+		SM2_KEY public_key;
+
+		if (asn1_any_from_der(&cert, &certlen, &certs, &certs_len) != 1
+			|| x509_cert_get_issuer_and_serial_number(cert, certlen,
+				&issuer, &issuer_len, &serial, &serial_len) != 1
+			|| x509_cert_get_subject_public_key(cert, certlen, &public_key) != 1
+			|| cms_recipient_info_encrypt_to_der(&public_key,
+				issuer, issuer_len, serial, serial_len,
+				key, keylen, &p, &rcpt_infos_len) != 1) {
+			error_print();
+			goto end;
+		}
+	}
+
+	ctx->indefinite = (content_len == CMS_CONTENT_LEN_UNKNOWN
+		|| rcpt_infos_len + shared_info1_len + shared_info2_len > CMS_DER_MAX_LEN/2
+		|| content_len > CMS_DER_MAX_LEN - rcpt_infos_len - shared_info1_len - shared_info2_len
+			- CMS_DER_MAX_HEADERS);
+
+	if (cms_envelop_header_to_der(ctx, rcpt_infos, rcpt_infos_len,
+			enc_algor, iv, ivlen, NULL, &len) != 1
+		|| asn1_length_le(len, maxlen) != 1) {
+		error_print();
+		goto end;
+	}
+	*outlen = 0;
+	if (cms_envelop_header_to_der(ctx, rcpt_infos, rcpt_infos_len,
+			enc_algor, iv, ivlen, &out, outlen) != 1
+		|| sm4_cbc_encrypt_init(&ctx->sm4_ctx, key, iv) != 1) {
+		error_print();
+		goto end;
+	}
+	ret = 1;
+end:
+	free(rcpt_infos);
+	return ret;
+}
+
+int cms_envelop_update(CMS_ENVELOP_CTX *ctx, const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen)
+{
+	uint8_t *p = out;
+	size_t len;
+
+	*outlen = 0;
+	if (!ctx->indefinite) {
+		if (inlen > ctx->content_len - ctx->nbytes) {
+			error_print();
+			return -1;
+		}
+		if (sm4_cbc_encrypt_update(&ctx->sm4_ctx, in, inlen, out, outlen) != 1) {
+			error_print();
+			return -1;
+		}
+		ctx->nbytes += inlen;
+		return 1;
+	}
+
+	// one segment of the whole blocks, its length is known before encryption
+	if (inlen > CMS_DER_MAX_LEN - SM4_BLOCK_SIZE) {
+		error_print();
+		return -1;
+	}
+	len = (ctx->sm4_ctx.block_nbytes + inlen) / SM4_BLOCK_SIZE * SM4_BLOCK_SIZE;
+	if (len) {
+		asn1_octet_string_header_to_der(len, &p, outlen);
+	}
+	if (sm4_cbc_encrypt_update(&ctx->sm4_ctx, in, inlen, p, &len) != 1) {
+		error_print();
+		return -1;
+	}
+	*outlen += len;
+	ctx->nbytes += inlen;
+	return 1;
+}
+
+int cms_envelop_finish(CMS_ENVELOP_CTX *ctx, uint8_t *out, size_t *outlen, size_t maxlen)
+{
+	uint8_t block[SM4_BLOCK_SIZE];
+	size_t block_len;
+	size_t len = 0;
+
+	if (!ctx->indefinite && ctx->nbytes != ctx->content_len) {
+		error_print();
+		return -1;
+	}
+	if (sm4_cbc_encrypt_finish(&ctx->sm4_ctx, block, &block_len) != 1) {
+		error_print();
+		return -1;
+	}
+	memset(&ctx->sm4_ctx, 0, sizeof(SM4_CBC_CTX));
+
+	if (ctx->indefinite) {
+		asn1_octet_string_header_to_der(block_len, NULL, &len);
+		len += 2 + 2 * 4;
+	}
+	len += block_len;
+	if (asn1_implicit_octet_string_to_der(1, ctx->shared_info1, ctx->shared_info1_len, NULL, &len) < 0
+		|| asn1_implicit_octet_string_to_der(2, ctx->shared_info2, ctx->shared_info2_len, NULL, &len) < 0
+		|| asn1_length_le(len, maxlen) != 1) {
+		error_print();
+		return -1;
+	}
+
+	*outlen = 0;
+	if (ctx->indefinite) {
+		asn1_octet_string_to_der(block, block_len, &out, outlen);
+		// [0] encryptedContent
+		cms_end_of_contents_to_der(1, &out, outlen);
+	} else {
+		asn1_data_to_der(block, block_len, &out, outlen);
+	}
+	memset(block, 0, sizeof(block));
+	if (asn1_implicit_octet_string_to_der(1, ctx->shared_info1, ctx->shared_info1_len, &out, outlen) < 0
+		|| asn1_implicit_octet_string_to_der(2, ctx->shared_info2, ctx->shared_info2_len, &out, outlen) < 0) {
+		error_print();
+		return -1;
+	}
+	if (ctx->indefinite) {
+		// EncryptedContentInfo, EnvelopedData, [0] and the ContentInfo
+		cms_end_of_contents_to_der(4, &out, outlen);
+	}
+	return 1;
+}
+
+static int cms_deenvelop_header(void *_ctx, CMS_STREAM *s, const uint8_t *d, size_t dlen, size_t *hdrlen)
+{
+	CMS_DEENVELOP_CTX *ctx = (CMS_DEENVELOP_CTX *)_ctx;
+	const uint8_t *p = d;
+	size_t len = dlen;
+	size_t end[5];
+	int indefinite[5];
+	const uint8_t *tlv;
+	size_t tlvlen;
+	const uint8_t *rcpt_infos;
+	size_t rcpt_infos_len;
+	int content_type;
+	int version;
+	int enc_algor;
+	const uint8_t *iv;
+	size_t ivlen;
+	uint8_t key[32];
+	size_t keylen;
+	int tag;
+	int ret, i;
+
+	if ((ret = cms_ber_header_expect(ASN1_TAG_SEQUENCE, d, &end[0], &indefinite[0], &p, &len)) != 1
+		|| (ret = cms_ber_tlv_from_der(ASN1_TAG_OBJECT_IDENTIFIER, &tlv, &tlvlen, &p, &len)) != 1) {
+		goto end;
+	}
+	if (cms_content_type_from_der(&content_type, &tlv, &tlvlen) != 1
+		|| content_type != OID_cms_enveloped_data) {
+		error_print();
+		return -1;
+	}
+	if ((ret = cms_ber_header_expect(ASN1_TAG_EXPLICIT(0), d, &end[1], &indefinite[1], &p, &len)) != 1
+		|| (ret = cms_ber_header_expect(ASN1_TAG_SEQUENCE, d, &end[2], &indefinite[2], &p, &len)) != 1
+		|| (ret = cms_ber_tlv_from_der(ASN1_TAG_INTEGER, &tlv, &tlvlen, &p, &len)) != 1) {
+		goto end;
+	}
+	if (asn1_int_from_der(&version, &tlv, &tlvlen) != 1
+		|| version != CMS_version_v1) {
+		error_print();
+		return -1;
+	}
+	if ((ret = cms_ber_tlv_from_der(ASN1_TAG_SET, &tlv, &tlvlen, &p, &len)) != 1) {
+		goto end;
+	}
+	if (asn1_set_from_der(&rcpt_infos, &rcpt_infos_len, &tlv, &tlvlen) != 1) {
+		error_print();
+		return -1;
+	}
+	if ((ret = cms_ber_header_expect(ASN1_TAG_SEQUENCE, d, &end[3], &indefinite[3], &p, &len)) != 1
+		|| (ret = cms_ber_tlv_from_der(ASN1_TAG_OBJECT_IDENTIFIER, &tlv, &tlvlen, &p, &len)) != 1) {
+		goto end;
+	}
+	if (cms_content_type_from_der(&content_type, &tlv, &tlvlen) != 1
+		|| content_type != OID_cms_data) {
+		error_print();
+		return -1;
+	}
+	if ((ret = cms_ber_tlv_from_der(ASN1_TAG_SEQUENCE, &tlv, &tlvlen, &p, &len)) != 1) {
+		goto end;
+	}
+	if (x509_encryption_algor_from_der(&enc_algor, &iv, &ivlen, &tlv, &tlvlen) != 1
+		|| enc_algor != OID_sm4_cbc
+		|| ivlen != SM4_BLOCK_SIZE) {
+		error_print();
+		return -1;
+	}
+	tag = indefinite[0] ? ASN1_TAG_EXPLICIT(0) : ASN1_TAG_IMPLICIT(0);
+	if ((ret = cms_ber_header_expect(tag, d, &end[4], &indefinite[4], &p, &len)) != 1) {
+		goto end;
+	}
+
+	for (i = 1; i < 5; i++) {
+		if (indefinite[i] != indefinite[0]) {
+			error_print();
+			return -1;
+		}
+	}
+	*hdrlen = (size_t)(p - d);
+	s->indefinite = indefinite[0];
+	if (!s->indefinite) {
+		if (end[1] != end[0] || end[2] != end[0] || end[3] != end[0] || end[4] > end[3]) {
+			error_print();
+			return -1;
+		}
+		s->total_len = end[0];
+		s->content_left = end[4] - *hdrlen;
+	}
+
+	ret = 0;
+	while (rcpt_infos_len) {
+		if ((ret = cms_recipient_info_decrypt_from_der(
+			ctx->rcpt_key,
+			ctx->rcpt_issuer, ctx->rcpt_issuer_len,
+			ctx->rcpt_serial, ctx->rcpt_serial_len,
+			key, &keylen, sizeof(key),
+			&rcpt_infos, &rcpt_infos_len)) < 0) {
+			error_print();
+			return -1;
+		} else if (ret) {
+			break;
+		}
+	}
+	if (!ret || keylen != SM4_KEY_SIZE) {
+		memset(key, 0, sizeof(key));
+		error_print();
+		return -1;
+	}
+	sm4_cbc_decrypt_init(&ctx->sm4_ctx, key, iv);
+	memset(key, 0, sizeof(key));
+	return 1;
+end:
+	if (ret < 0) error_print();
+	return ret;
+}
+
+static int cms_deenvelop_content(void *ctx, const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen)
+{
+	if (sm4_cbc_decrypt_update(&((CMS_DEENVELOP_CTX *)ctx)->sm4_ctx, in, inlen, out, outlen) != 1) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+int cms_deenvelop_init(CMS_DEENVELOP_CTX *ctx,
+	const SM2_KEY *rcpt_key, const uint8_t *rcpt_cert, size_t rcpt_cert_len)
+{
+	SM2_KEY public_key;
+
+	if (!ctx || !rcpt_key || !rcpt_cert || !rcpt_cert_len) {
+		error_print();
+		return -1;
+	}
+	memset(ctx, 0, sizeof(CMS_DEENVELOP_CTX));
+	if (x509_cert_get_issuer_and_serial_number(rcpt_cert, rcpt_cert_len,
+			&ctx->rcpt_issuer, &ctx->rcpt_issuer_len,
+			&ctx->rcpt_serial, &ctx->rcpt_serial_len) != 1
+		|| x509_cert_get_subject_public_key(rcpt_cert, rcpt_cert_len, &public_key) != 1) {
+		error_print();
+		return -1;
+	}
+	if (memcmp(&public_key, rcpt_key, sizeof(SM2_POINT)) != 0) {
+		error_print();
+		return -1;
+	}
+	ctx->rcpt_key = rcpt_key;
+	cms_stream_init(&ctx->stream);
+	return 1;
+}
+
+int cms_deenvelop_update(CMS_DEENVELOP_CTX *ctx, const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen)
+{
+	ctx->stream.nbytes += inlen;
+	if (cms_stream_update(&ctx->stream, ctx, cms_deenvelop_header, cms_deenvelop_content,
+		in, inlen, out, outlen) != 1) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+int cms_deenvelop_finish(CMS_DEENVELOP_CTX *ctx, uint8_t *out, size_t *outlen)
+{
+	const uint8_t *p;
+	size_t len;
+	const uint8_t *shared_info1;
+	size_t shared_info1_len;
+	const uint8_t *shared_info2;
+	size_t shared_info2_len;
+
+	if (cms_stream_finish(&ctx->stream) != 1) {
+		error_print();
+		return -1;
+	}
+	p = ctx->stream.buf;
+	len = ctx->stream.buf_len;
+	if (asn1_implicit_octet_string_from_der(1, &shared_info1, &shared_info1_len, &p, &len) < 0
+		|| asn1_implicit_octet_string_from_der(2, &shared_info2, &shared_info2_len, &p, &len) < 0
+		|| (ctx->stream.indefinite && cms_end_of_contents_from_der(4, &p, &len) != 1)
+		|| asn1_length_is_zero(len) != 1) {
+		error_print();
+		return -1;
+	}
+	if (sm4_cbc_decrypt_finish(&ctx->sm4_ctx, out, outlen) != 1) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+void cms_deenvelop_cleanup(CMS_DEENVELOP_CTX *ctx)
+{
+	if (ctx) {
+		cms_stream_cleanup(&ctx->stream);
+		memset(ctx, 0, sizeof(CMS_DEENVELOP_CTX));
+	}
+}
@@ -84,6 +84,8 @@
 #include <gmssl/oid.h>
 #include <gmssl/endian.h>
 #include <gmssl/mem.h>
+#include <gmssl/pbkdf2.h>
+#include "sm3_lcl.h"
 
 int pbkdf2_genkey(const DIGEST *digest,
 	const char *pass, size_t passlen,
@@ -136,53 +138,235 @@ int pbkdf2_genkey(const DIGEST *digest,
 	return 1;
 }
 
-int pbkdf2_hmac_sm3_genkey(
-	const char *pass, size_t passlen,
-	const uint8_t *salt, size_t saltlen, size_t count,
-	size_t outlen, uint8_t *out)
+/*
+PBKDF2-HMAC-SM3 in SM3_MAX_LANES lanes
+
+	Every output block T_i of every job is an independent hash chain, a lane
+	task. After U_1, each iteration is two compressions of a single padded
+	block from fixed states, H(ipad) and H(opad) of the lane's password, so
+	the lanes run the chains side by side with sm3_compress_lanes(). The
+	values stay lane-interleaved for the whole run, U and T are only encoded
+	to bytes at the end. Tasks are sorted by iteration count so that lanes of
+	a group finish together.
+*/
+
+#define IPAD	0x36
+#define OPAD	0x5c
+
+typedef struct {
+	const PBKDF2_SM3_JOB *job;
+	uint8_t *out;
+	size_t outlen; // <= SM3_DIGEST_SIZE
+	uint32_t index; // T_index
+	size_t count;
+} PBKDF2_SM3_TASK;
+
+static int pbkdf2_sm3_task_cmp(const void *a, const void *b)
 {
-	SM3_HMAC_CTX ctx;
-	SM3_HMAC_CTX ctx_tmpl;
-	uint32_t iter = 1;
-	uint8_t iter_be[4];
-	uint8_t tmp_block[SM3_DIGEST_SIZE];
-	uint8_t key_block[SM3_DIGEST_SIZE];
-	size_t len;
+	size_t ca = ((const PBKDF2_SM3_TASK *)a)->count;
+	size_t cb = ((const PBKDF2_SM3_TASK *)b)->count;
+	return (ca > cb) - (ca < cb);
+}
 
-	sm3_hmac_init(&ctx_tmpl, (uint8_t *)pass, passlen);
+static void pbkdf2_hmac_sm3_lanes(const PBKDF2_SM3_TASK *tasks, size_t ntasks)
+{
+	uint32_t Vin[8][SM3_MAX_LANES];
+	uint32_t Vout[8][SM3_MAX_LANES];
+	uint32_t V[8][SM3_MAX_LANES];
+	uint32_t M[16][SM3_MAX_LANES];
+	uint32_t T[8][SM3_MAX_LANES];
+	uint32_t mask[SM3_MAX_LANES];
+	uint8_t block[SM3_DIGEST_SIZE];
+	uint8_t opad_key[SM3_BLOCK_SIZE];
+	SM3_HMAC_CTX ctx;
+	SM3_CTX opad_ctx;
+	size_t count = 0;
+	size_t iter, i, l;
+
+	memset(Vin, 0, sizeof(Vin));
+	memset(Vout, 0, sizeof(Vout));
+	memset(M, 0, sizeof(M));
+	memset(T, 0, sizeof(T));
+
+	for (l = 0; l < ntasks; l++) {
+		const PBKDF2_SM3_JOB *job = tasks[l].job;
+		uint8_t index_be[4];
+
+		sm3_hmac_init(&ctx, (const uint8_t *)job->pass, job->passlen);
+		for (i = 0; i < SM3_BLOCK_SIZE; i++) {
+			opad_key[i] = ctx.key[i] ^ IPAD ^ OPAD;
+		}
+		sm3_init(&opad_ctx);
+		sm3_update(&opad_ctx, opad_key, SM3_BLOCK_SIZE);
+		for (i = 0; i < 8; i++) {
+			Vin[i][l] = ctx.sm3_ctx.digest[i];
+			Vout[i][l] = opad_ctx.digest[i];
+		}
 
-	while (outlen > 0) {
-		size_t i;
+		// U_1 = PRF(P, S || INT(i))
+		PUTU32(index_be, tasks[l].index);
+		sm3_hmac_update(&ctx, job->salt, job->saltlen);
+		sm3_hmac_update(&ctx, index_be, sizeof(index_be));
+		sm3_hmac_finish(&ctx, block);
+		for (i = 0; i < 8; i++) {
+			T[i][l] = GETU32(block + i * 4);
+		}
+		if (tasks[l].count > count) {
+			count = tasks[l].count;
+		}
+	}
 
-		PUTU32(iter_be, iter);
-		iter++;
+	// padding of a 32-byte message after the 64-byte key block
+	for (l = 0; l < SM3_MAX_LANES; l++) {
+		M[8][l] = 0x80000000;
+		M[15][l] = (SM3_BLOCK_SIZE + SM3_DIGEST_SIZE) * 8;
+	}
+	memcpy(M, T, sizeof(T));
 
-		ctx = ctx_tmpl;
-		sm3_hmac_update(&ctx, salt, saltlen);
-		sm3_hmac_update(&ctx, iter_be, sizeof(iter_be));
-		sm3_hmac_finish(&ctx, tmp_block);
-		memcpy(key_block, tmp_block, SM3_DIGEST_SIZE);
+	for (iter = 1; iter < count; iter++) {
+		for (l = 0; l < SM3_MAX_LANES; l++) {
+			mask[l] = (l < ntasks && iter < tasks[l].count) ? 0xffffffff : 0;
+		}
+		// inner hash H(ipad || U) is the message of the outer one
+		memcpy(V, Vin, sizeof(V));
+		sm3_compress_lanes(V, (const uint32_t (*)[SM3_MAX_LANES])M, ntasks);
+		memcpy(M, V, sizeof(V));
+		memcpy(V, Vout, sizeof(V));
+		sm3_compress_lanes(V, (const uint32_t (*)[SM3_MAX_LANES])M, ntasks);
+		memcpy(M, V, sizeof(V));
+		for (i = 0; i < 8; i++) {
+			for (l = 0; l < SM3_MAX_LANES; l++) {
+				T[i][l] ^= V[i][l] & mask[l];
+			}
+		}
+	}
 
-		for (i = 1; i < count; i++) {
-			ctx = ctx_tmpl;
-			sm3_hmac_update(&ctx, tmp_block, SM3_DIGEST_SIZE);
-			sm3_hmac_finish(&ctx, tmp_block);
-			memxor(key_block, tmp_block, SM3_DIGEST_SIZE);
+	for (l = 0; l < ntasks; l++) {
+		for (i = 0; i < 8; i++) {
+			PUTU32(block + i * 4, T[i][l]);
 		}
+		memcpy(tasks[l].out, block, tasks[l].outlen);
+	}
 
-		if (outlen < SM3_DIGEST_SIZE) {
-			memcpy(out, key_block, outlen);
-			out += outlen;
-			outlen = 0;
-		} else {
-			memcpy(out, key_block, SM3_DIGEST_SIZE);
-			out += len;
-			outlen -= len;
+	gmssl_secure_clear(Vin, sizeof(Vin));
+	gmssl_secure_clear(Vout, sizeof(Vout));
+	gmssl_secure_clear(V, sizeof(V));
+	gmssl_secure_clear(M, sizeof(M));
+	gmssl_secure_clear(T, sizeof(T));
+	gmssl_secure_clear(block, sizeof(block));
+	gmssl_secure_clear(opad_key, sizeof(opad_key));
+	gmssl_secure_clear(&ctx, sizeof(ctx));
+	gmssl_secure_clear(&opad_ctx, sizeof(opad_ctx));
+}
+
+int pbkdf2_hmac_sm3_genkey_batch(const PBKDF2_SM3_JOB *jobs, size_t jobs_cnt)
+{
+	PBKDF2_SM3_TASK *tasks;
+	size_t ntasks = 0;
+	size_t i, n;
+
+	if (!jobs || !jobs_cnt) {
+		error_print();
+		return -1;
+	}
+	for (i = 0; i < jobs_cnt; i++) {
+		if ((!jobs[i].pass && jobs[i].passlen)
+			|| (!jobs[i].salt && jobs[i].saltlen)
+			|| !jobs[i].out || !jobs[i].outlen
+			|| jobs[i].count > PBKDF2_MAX_ITER
+			|| (jobs[i].outlen - 1)/SM3_DIGEST_SIZE >= UINT32_MAX) {
+			error_print();
+			return -1;
+		}
+		ntasks += (jobs[i].outlen + SM3_DIGEST_SIZE - 1)/SM3_DIGEST_SIZE;
+	}
+	if (!(tasks = (PBKDF2_SM3_TASK *)malloc(sizeof(PBKDF2_SM3_TASK) * ntasks))) {
+		error_print();
+		return -1;
+	}
+	for (i = 0, n = 0; i < jobs_cnt; i++) {
+		size_t off;
+		for (off = 0; off < jobs[i].outlen; off += SM3_DIGEST_SIZE) {
+			tasks[n].job = &jobs[i];
+			tasks[n].out = jobs[i].out + off;
+			tasks[n].outlen = jobs[i].outlen - off < SM3_DIGEST_SIZE ? jobs[i].outlen - off : SM3_DIGEST_SIZE;
+			tasks[n].index = (uint32_t)(off/SM3_DIGEST_SIZE + 1);
+			tasks[n].count = jobs[i].count;
+			n++;
 		}
 	}
+	qsort(tasks, ntasks, sizeof(PBKDF2_SM3_TASK), pbkdf2_sm3_task_cmp);
 
-	memset(&ctx, 0, sizeof(ctx));
-	memset(key_block, 0, sizeof(key_block));
-	memset(tmp_block, 0, sizeof(key_block));
+	for (i = 0; i < ntasks; i += SM3_MAX_LANES) {
+		pbkdf2_hmac_sm3_lanes(tasks + i, ntasks - i < SM3_MAX_LANES ? ntasks - i : SM3_MAX_LANES);
+	}
+	free(tasks);
+	return 1;
+}
+
+int pbkdf2_hmac_sm3_verify_batch(const PBKDF2_SM3_JOB *jobs, size_t jobs_cnt, int *results)
+{
+	PBKDF2_SM3_JOB *derived;
+	uint8_t *keys;
+	size_t keys_len = 0;
+	size_t i;
+
+	if (!jobs || !jobs_cnt || !results) {
+		error_print();
+		return -1;
+	}
+	for (i = 0; i < jobs_cnt; i++) {
+		keys_len += jobs[i].outlen;
+	}
+	if (!(derived = (PBKDF2_SM3_JOB *)malloc(sizeof(PBKDF2_SM3_JOB) * jobs_cnt))) {
+		error_print();
+		return -1;
+	}
+	if (!(keys = (uint8_t *)malloc(keys_len ? keys_len : 1))) {
+		error_print();
+		free(derived);
+		return -1;
+	}
+	keys_len = 0;
+	for (i = 0; i < jobs_cnt; i++) {
+		derived[i] = jobs[i];
+		derived[i].out = keys + keys_len;
+		keys_len += jobs[i].outlen;
+	}
+	if (pbkdf2_hmac_sm3_genkey_batch(derived, jobs_cnt) != 1) {
+		error_print();
+		gmssl_secure_clear(keys, keys_len);
+		free(keys);
+		free(derived);
+		return -1;
+	}
+	for (i = 0; i < jobs_cnt; i++) {
+		results[i] = gmssl_secure_memcmp(derived[i].out, jobs[i].out, jobs[i].outlen) == 0 ? 1 : 0;
+	}
+	gmssl_secure_clear(keys, keys_len);
+	free(keys);
+	free(derived);
+	return 1;
+}
+
+int pbkdf2_hmac_sm3_genkey(
+	const char *pass, size_t passlen,
+	const uint8_t *salt, size_t saltlen, size_t count,
+	size_t outlen, uint8_t *out)
+{
+	PBKDF2_SM3_JOB job;
+
+	job.pass = pass;
+	job.passlen = passlen;
+	job.salt = salt;
+	job.saltlen = saltlen;
+	job.count = count;
+	job.outlen = outlen;
+	job.out = out;
+
+	if (pbkdf2_hmac_sm3_genkey_batch(&job, 1) != 1) {
+		error_print();
+		return -1;
+	}
 	return 1;
 }
@@ -11,6 +11,12 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/stat.h>
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
 #include <gmssl/pem.h>
 #include <gmssl/error.h>
 
@@ -27,7 +33,7 @@ int pem_write(FILE* fp, const char* name, const uint8_t* data, size_t datalen)
 		return -1;
 	}
 
-	if (!(b64 = malloc(datalen * 2))) {
+	if (!(b64 = malloc(BASE64_ENCODE_LENGTH(datalen)))) {
 		error_print();
 		return -1;
 	}
@@ -39,6 +45,7 @@ int pem_write(FILE* fp, const char* name, const uint8_t* data, size_t datalen)
 	ret += fprintf(fp, "-----BEGIN %s-----\n", name);
 	ret += fprintf(fp, "%s", (char *)b64);
 	ret += fprintf(fp, "-----END %s-----\n", name);
+	free(b64);
 	//return ret;
 	return 1;
 }
@@ -99,3 +106,239 @@ int pem_read(FILE *fp, const char *name, uint8_t *data, size_t *datalen, size_t
 	*datalen += len;
 	return 1;
 }
+
+int pem_write_init(PEM_CTX *ctx, FILE *fp, const char *name)
+{
+	memset(ctx, 0, sizeof(PEM_CTX));
+	ctx->fp = fp;
+	snprintf(ctx->end_line, sizeof(ctx->end_line), "-----END %s-----\n", name);
+	base64_encode_init(&ctx->base64_ctx);
+	if (fprintf(fp, "-----BEGIN %s-----\n", name) < 0) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+int pem_write_update(PEM_CTX *ctx, const uint8_t *in, size_t inlen)
+{
+	uint8_t b64[BASE64_ENCODE_LENGTH(3072)];
+	int len;
+
+	while (inlen) {
+		int n = inlen < 3072 ? (int)inlen : 3072;
+		base64_encode_update(&ctx->base64_ctx, in, n, b64, &len);
+		if (fwrite(b64, 1, len, ctx->fp) != (size_t)len) {
+			error_print();
+			return -1;
+		}
+		in += n;
+		inlen -= n;
+	}
+	return 1;
+}
+
+int pem_write_finish(PEM_CTX *ctx)
+{
+	uint8_t b64[BASE64_ENCODE_LENGTH(64)];
+	int len;
+
+	base64_encode_finish(&ctx->base64_ctx, b64, &len);
+	if (fwrite(b64, 1, len, ctx->fp) != (size_t)len
+		|| fputs(ctx->end_line, ctx->fp) < 0) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+int pem_read_init(PEM_CTX *ctx, FILE *fp, const char *name)
+{
+	char line[80];
+	char begin_line[80];
+
+	memset(ctx, 0, sizeof(PEM_CTX));
+	ctx->fp = fp;
+	snprintf(begin_line, sizeof(begin_line), "-----BEGIN %s-----\n", name);
+	snprintf(ctx->end_line, sizeof(ctx->end_line), "-----END %s-----\n", name);
+	if (!fgets(line, sizeof(line), fp)
+		|| strcmp(line, begin_line) != 0) {
+		error_print();
+		return -1;
+	}
+	base64_decode_init(&ctx->base64_ctx);
+	return 1;
+}
+
+int pem_read_update(PEM_CTX *ctx, uint8_t *out, size_t *outlen, size_t maxlen)
+{
+	char line[80];
+	int len;
+
+	if (maxlen < PEM_READ_MIN_OUTLEN) {
+		error_print();
+		return -1;
+	}
+	*outlen = 0;
+	if (ctx->end) {
+		return 0;
+	}
+	while (maxlen - *outlen >= PEM_READ_MIN_OUTLEN) {
+		if (!fgets(line, sizeof(line), ctx->fp)) {
+			error_print();
+			return -1;
+		}
+		if (strcmp(line, ctx->end_line) == 0) {
+			base64_decode_finish(&ctx->base64_ctx, out, &len);
+			*outlen += len;
+			ctx->end = 1;
+			break;
+		}
+		if (base64_decode_update(&ctx->base64_ctx, (uint8_t *)line, (int)strlen(line), out, &len) < 0) {
+			error_print();
+			return -1;
+		}
+		out += len;
+		*outlen += len;
+	}
+	return (*outlen || !ctx->end) ? 1 : 0;
+}
+
+/*
+The whole file is mapped (read into memory on Windows) and scanned once, each
+BEGIN/END pair is decoded straight into the output buffer, which is sized from
+the file length so it never grows. Text outside the blocks, such as the
+comments of a CA bundle, and blocks of other types are skipped.
+*/
+static int pem_map_file(const char *file, const uint8_t **data, size_t *datalen)
+{
+	struct stat st;
+#ifndef WIN32
+	int fd;
+	void *p;
+
+	if ((fd = open(file, O_RDONLY)) < 0) {
+		error_print();
+		return -1;
+	}
+	if (fstat(fd, &st) < 0) {
+		error_print();
+		close(fd);
+		return -1;
+	}
+	*data = NULL;
+	*datalen = (size_t)st.st_size;
+	if (*datalen) {
+		if ((p = mmap(NULL, *datalen, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+			error_print();
+			close(fd);
+			return -1;
+		}
+		madvise(p, *datalen, MADV_SEQUENTIAL);
+		*data = p;
+	}
+	close(fd);
+#else
+	FILE *fp;
+	uint8_t *p = NULL;
+
+	if (!(fp = fopen(file, "rb"))
+		|| fstat(fileno(fp), &st) < 0
+		|| !(p = malloc((size_t)st.st_size + 1))
+		|| fread(p, 1, (size_t)st.st_size, fp) != (size_t)st.st_size) {
+		error_print();
+		if (fp) fclose(fp);
+		if (p) free(p);
+		return -1;
+	}
+	fclose(fp);
+	*data = p;
+	*datalen = (size_t)st.st_size;
+#endif
+	return 1;
+}
+
+static void pem_unmap_file(const uint8_t *data, size_t datalen)
+{
+#ifndef WIN32
+	if (data) munmap((void *)data, datalen);
+#else
+	free((void *)data);
+#endif
+}
+
+static const uint8_t *pem_find(const uint8_t *p, const uint8_t *end, const char *str, size_t len)
+{
+	while ((size_t)(end - p) >= len) {
+		if (!(p = memchr(p, str[0], end - p - len + 1))) {
+			return NULL;
+		}
+		if (memcmp(p, str, len) == 0) {
+			return p;
+		}
+		p++;
+	}
+	return NULL;
+}
+
+int pem_read_bundle(const char *file, const char *name, uint8_t **out, size_t *outlen)
+{
+	int ret = -1;
+	char begin_line[80];
+	char end_line[80];
+	size_t begin_len, end_len;
+	const uint8_t *data = NULL;
+	size_t datalen = 0;
+	const uint8_t *p, *q, *limit;
+	uint8_t *buf = NULL;
+	size_t len = 0;
+	size_t n;
+
+	if (!file || !name || !out || !outlen) {
+		error_print();
+		return -1;
+	}
+	begin_len = snprintf(begin_line, sizeof(begin_line), "-----BEGIN %s-----", name);
+	end_len = snprintf(end_line, sizeof(end_line), "-----END %s-----", name);
+	if (begin_len >= sizeof(begin_line) || end_len >= sizeof(end_line)) {
+		error_print();
+		return -1;
+	}
+
+	if (pem_map_file(file, &data, &datalen) != 1) {
+		error_print();
+		return -1;
+	}
+	if (!(buf = malloc(datalen/4 * 3 + 1))) {
+		error_print();
+		goto end;
+	}
+
+	p = data;
+	limit = data + datalen;
+	while ((p = pem_find(p, limit, begin_line, begin_len)) != NULL) {
+		p += begin_len;
+		if (!(q = pem_find(p, limit, end_line, end_len))) {
+			error_print();
+			goto end;
+		}
+		if (base64_decode(p, q - p, buf + len, &n) != 1 || !n) {
+			error_print();
+			goto end;
+		}
+		len += n;
+		p = q + end_len;
+	}
+	if (!len) {
+		ret = 0;
+		goto end;
+	}
+	*out = buf;
+	*outlen = len;
+	buf = NULL;
+	ret = 1;
+end:
+	if (buf) free(buf);
+	pem_unmap_file(data, datalen);
+	return ret;
+}
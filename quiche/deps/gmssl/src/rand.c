@@ -8,23 +8,181 @@
  */
 
 
-
 #include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <gmssl/mem.h>
 #include <gmssl/rand.h>
+#include <gmssl/digest.h>
+#include <gmssl/hash_drbg.h>
 #include <gmssl/error.h>
 
-#define RAND_MAX_BUF_SIZE 4096
+/*
+ * rand_bytes() output comes from a per-thread SM3 Hash_DRBG. Each thread
+ * seeds its own instance from the kernel on first use and reseeds it after
+ * RAND_DRBG_RESEED_INTERVAL requests, so the common case is a few SM3
+ * compressions without any system call or lock. Small requests are served
+ * from a per-thread output buffer that amortizes the per-request DRBG update
+ * over many draws; consumed bytes are wiped. A fork() bumps a global
+ * generation number and every instance in the child drops its buffer and
+ * reseeds before its next output, so parent and child never share a stream.
+ */
 
-int rand_bytes(uint8_t *buf, size_t len)
+#define RAND_DRBG_ENTROPY_SIZE		32
+#define RAND_DRBG_NONCE_SIZE		16
+#define RAND_DRBG_RESEED_INTERVAL	(1 << 16)
+#define RAND_DRBG_MAX_REQUEST_SIZE	(1 << 16) // SP 800-90A: 2^19 bits per request
+#define RAND_DRBG_BUF_SIZE		512
+
+typedef struct {
+	HASH_DRBG drbg;
+	unsigned int generation;
+	int inited;
+	uint8_t buf[RAND_DRBG_BUF_SIZE];
+	size_t buf_len; // unread bytes at the end of buf
+} RAND_DRBG_STATE;
+
+static __thread RAND_DRBG_STATE rand_drbg_state;
+static volatile unsigned int rand_fork_generation = 1;
+static pthread_once_t rand_atfork_once = PTHREAD_ONCE_INIT;
+
+static void rand_atfork_child(void)
 {
-	FILE *fp;
-	if (!buf) {
+	rand_fork_generation++;
+}
+
+static void rand_atfork_register(void)
+{
+	pthread_atfork(NULL, NULL, rand_atfork_child);
+}
+
+static int urandom_bytes(uint8_t *buf, size_t len)
+{
+	int fd;
+
+	if ((fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC)) < 0) {
 		error_print();
 		return -1;
 	}
-	if (len > RAND_MAX_BUF_SIZE) {
+	while (len) {
+		ssize_t n = read(fd, buf, len);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			error_print();
+			close(fd);
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+	close(fd);
+	return 1;
+}
+
+// Kernel entropy, getrandom(2) when available and /dev/urandom otherwise
+static int rand_entropy_bytes(uint8_t *buf, size_t len)
+{
+#ifdef SYS_getrandom
+	while (len) {
+		long n = syscall(SYS_getrandom, buf, len, 0);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0 && errno == ENOSYS) {
+			return urandom_bytes(buf, len);
+		}
+		if (n <= 0) {
+			error_print();
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 1;
+#else
+	return urandom_bytes(buf, len);
+#endif
+}
+
+/*
+ * Personalization and additional input for (re)seeding: the pid separates
+ * forked processes even if the kernel source is weak, and RDSEED, when built
+ * in, is mixed in as an independent source. A failing RDSEED is not an error,
+ * the kernel entropy alone is sufficient.
+ */
+static size_t rand_additional_input(uint8_t *buf, size_t buflen)
+{
+	pid_t pid = getpid();
+	const void *tid = &rand_drbg_state;
+	size_t len = 0;
+
+	memcpy(buf + len, &pid, sizeof(pid));
+	len += sizeof(pid);
+	memcpy(buf + len, &tid, sizeof(tid));
+	len += sizeof(tid);
+
+#ifdef ENABLE_RAND_RDSEED
+	if (buflen - len >= 32 && rdseed_bytes(buf + len, 32) == 1) {
+		len += 32;
+	}
+#else
+	(void)buflen;
+#endif
+	return len;
+}
+
+static int rand_drbg_seed(RAND_DRBG_STATE *state)
+{
+	uint8_t entropy[RAND_DRBG_ENTROPY_SIZE + RAND_DRBG_NONCE_SIZE];
+	uint8_t additional[64];
+	size_t additional_len;
+	unsigned int generation = rand_fork_generation;
+	int ret = -1;
+
+	if (rand_entropy_bytes(entropy, sizeof(entropy)) != 1) {
+		error_print();
+		goto end;
+	}
+	additional_len = rand_additional_input(additional, sizeof(additional));
+
+	if (!state->inited) {
+		if (hash_drbg_init(&state->drbg, DIGEST_sm3(),
+			entropy, RAND_DRBG_ENTROPY_SIZE,
+			entropy + RAND_DRBG_ENTROPY_SIZE, RAND_DRBG_NONCE_SIZE,
+			additional, additional_len) != 1) {
+			error_print();
+			goto end;
+		}
+	} else {
+		if (hash_drbg_reseed(&state->drbg,
+			entropy, sizeof(entropy), additional, additional_len) != 1) {
+			error_print();
+			goto end;
+		}
+	}
+	gmssl_secure_clear(state->buf, sizeof(state->buf));
+	state->buf_len = 0;
+	state->generation = generation;
+	state->inited = 1;
+	ret = 1;
+end:
+	gmssl_secure_clear(entropy, sizeof(entropy));
+	gmssl_secure_clear(additional, sizeof(additional));
+	return ret;
+}
+
+int rand_bytes(uint8_t *buf, size_t len)
+{
+	RAND_DRBG_STATE *state = &rand_drbg_state;
+
+	if (!buf) {
 		error_print();
 		return -1;
 	}
@@ -32,15 +190,42 @@ int rand_bytes(uint8_t *buf, size_t len)
 		return 0;
 	}
 
-	if (!(fp = fopen("/dev/urandom", "rb"))) {
-		error_print();
-		return -1;
+	if (!state->inited) {
+		pthread_once(&rand_atfork_once, rand_atfork_register);
 	}
-	if (fread(buf, 1, len, fp) != len) {
-		error_print();
-		fclose(fp);
-		return -1;
+	if (!state->inited
+		|| state->generation != rand_fork_generation
+		|| state->drbg.reseed_counter > RAND_DRBG_RESEED_INTERVAL) {
+		if (rand_drbg_seed(state) != 1) {
+			error_print();
+			return -1;
+		}
+	}
+
+	if (len <= RAND_DRBG_BUF_SIZE/2) {
+		uint8_t *p;
+		if (state->buf_len < len) {
+			if (hash_drbg_generate(&state->drbg, NULL, 0, sizeof(state->buf), state->buf) != 1) {
+				error_print();
+				return -1;
+			}
+			state->buf_len = sizeof(state->buf);
+		}
+		p = state->buf + sizeof(state->buf) - state->buf_len;
+		memcpy(buf, p, len);
+		gmssl_secure_clear(p, len);
+		state->buf_len -= len;
+		return 1;
+	}
+
+	while (len) {
+		size_t n = len < RAND_DRBG_MAX_REQUEST_SIZE ? len : RAND_DRBG_MAX_REQUEST_SIZE;
+		if (hash_drbg_generate(&state->drbg, NULL, 0, n, buf) != 1) {
+			error_print();
+			return -1;
+		}
+		buf += n;
+		len -= n;
 	}
-	fclose(fp);
 	return 1;
 }
@@ -43,7 +43,7 @@ static int SDF_ECCrefPublicKey_to_SM2_KEY(const ECCrefPublicKey *ref, SM2_KEY *s
 	return SDR_OK;
 }
 
-static int SDF_ECCSignature_to_SM2_SIGNATURE(const ECCSignature *ref, SM2_SIGNATURE *sig)
+int SDF_ECCSignature_to_SM2_SIGNATURE(const ECCSignature *ref, SM2_SIGNATURE *sig)
 {
 	if (memcmp(ref->r, zeros, sizeof(zeros)) != 0
 		|| memcmp(ref->s, zeros, sizeof(zeros)) != 0) {
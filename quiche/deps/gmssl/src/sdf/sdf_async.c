@@ -0,0 +1,405 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <gmssl/sdf.h>
+#include <gmssl/sm2.h>
+#include <gmssl/mem.h>
+#include <gmssl/error.h>
+#include "sdf.h"
+#include "sdf_ext.h"
+
+
+void sdf_job_init_sign(SDF_JOB *job, const uint8_t dgst[32])
+{
+	memset(job, 0, sizeof(SDF_JOB));
+	job->type = SDF_JOB_sign;
+	memcpy(job->dgst, dgst, 32);
+}
+
+int sdf_job_init_encrypt(SDF_JOB *job, unsigned int kek_index, const uint8_t *wrapped_key, size_t wrapped_key_len,
+	unsigned int alg_id, const uint8_t iv[16], const uint8_t *in, size_t inlen, uint8_t *out)
+{
+	if (!job || !wrapped_key || !wrapped_key_len || !iv || !in || !inlen || !out) {
+		error_print();
+		return -1;
+	}
+	if (wrapped_key_len > SDF_ASYNC_MAX_WRAPPED_KEY_SIZE || inlen > UINT32_MAX) {
+		error_print();
+		return -1;
+	}
+	memset(job, 0, sizeof(SDF_JOB));
+	job->type = SDF_JOB_encrypt;
+	job->kek_index = kek_index;
+	memcpy(job->wrapped_key, wrapped_key, wrapped_key_len);
+	job->wrapped_key_len = wrapped_key_len;
+	job->alg_id = alg_id;
+	memcpy(job->iv, iv, 16);
+	job->in = in;
+	job->inlen = inlen;
+	job->out = out;
+	return 1;
+}
+
+void sdf_job_init_rand_bytes(SDF_JOB *job, uint8_t *buf, size_t len)
+{
+	memset(job, 0, sizeof(SDF_JOB));
+	job->type = SDF_JOB_rand_bytes;
+	job->buf = buf;
+	job->len = len;
+}
+
+static int sdf_async_do_sign(SDF_ASYNC *async, void *hSession, SDF_JOB *job)
+{
+	ECCSignature ecc_sig;
+	SM2_SIGNATURE sm2_sig;
+	uint8_t *p = job->sig;
+
+	if (async->sign_key_index < 0) {
+		error_print();
+		return -1;
+	}
+	if (SDF_InternalSign_ECC(hSession, async->sign_key_index, job->dgst, 32, &ecc_sig) != SDR_OK
+		|| SDF_ECCSignature_to_SM2_SIGNATURE(&ecc_sig, &sm2_sig) != SDR_OK) {
+		error_print();
+		return -1;
+	}
+	job->siglen = 0;
+	if (sm2_signature_to_der(&sm2_sig, &p, &job->siglen) != 1) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+static int sdf_async_same_key(const SDF_JOB *a, const SDF_JOB *b)
+{
+	return a->kek_index == b->kek_index
+		&& a->wrapped_key_len == b->wrapped_key_len
+		&& memcmp(a->wrapped_key, b->wrapped_key, a->wrapped_key_len) == 0;
+}
+
+static int sdf_async_do_encrypt(void *hSession, void *hKey, SDF_JOB *job)
+{
+	unsigned int outlen;
+
+	if (SDF_Encrypt(hSession, hKey, job->alg_id, job->iv,
+		(unsigned char *)job->in, (unsigned int)job->inlen, job->out, &outlen) != SDR_OK) {
+		error_print();
+		return -1;
+	}
+	job->outlen = outlen;
+	return 1;
+}
+
+static void sdf_async_run_batch(SDF_ASYNC *async, void *hSession, SDF_JOB **jobs, size_t cnt)
+{
+	uint8_t rand_buf[SDF_ASYNC_RAND_BATCH_SIZE];
+	size_t rand_len = 0;
+	int rand_served[SDF_ASYNC_MAX_BATCH] = {0};
+	void *hKey = NULL;
+	const SDF_JOB *key_job = NULL;
+	size_t i;
+
+	// random requests that fit in rand_buf are served by one device call
+	for (i = 0; i < cnt; i++) {
+		if (jobs[i]->type == SDF_JOB_rand_bytes && jobs[i]->len <= sizeof(rand_buf) - rand_len) {
+			rand_len += jobs[i]->len;
+			rand_served[i] = 1;
+		}
+	}
+	if (rand_len) {
+		int ret = SDF_GenerateRandom(hSession, (unsigned int)rand_len, rand_buf) == SDR_OK ? 1 : -1;
+		size_t off = 0;
+
+		for (i = 0; i < cnt; i++) {
+			if (rand_served[i]) {
+				memcpy(jobs[i]->buf, rand_buf + off, jobs[i]->len);
+				off += jobs[i]->len;
+				jobs[i]->ret = ret;
+			}
+		}
+		gmssl_secure_clear(rand_buf, rand_len);
+	}
+
+	for (i = 0; i < cnt; i++) {
+		SDF_JOB *job = jobs[i];
+
+		switch (job->type) {
+		case SDF_JOB_sign:
+			job->ret = sdf_async_do_sign(async, hSession, job);
+			break;
+		case SDF_JOB_encrypt:
+			if (!key_job || !sdf_async_same_key(key_job, job)) {
+				if (hKey) {
+					SDF_DestroyKey(hSession, hKey);
+					hKey = NULL;
+				}
+				key_job = NULL;
+				if (SDF_ImportKeyWithKEK(hSession, job->alg_id, job->kek_index,
+					job->wrapped_key, (unsigned int)job->wrapped_key_len, &hKey) != SDR_OK) {
+					error_print();
+					job->ret = -1;
+					break;
+				}
+				key_job = job;
+			}
+			job->ret = sdf_async_do_encrypt(hSession, hKey, job);
+			break;
+		case SDF_JOB_rand_bytes:
+			if (rand_served[i]) {
+				break;
+			}
+			job->ret = SDF_GenerateRandom(hSession, (unsigned int)job->len, job->buf) == SDR_OK ? 1 : -1;
+			break;
+		default:
+			error_print();
+			job->ret = -1;
+		}
+	}
+	if (hKey) {
+		SDF_DestroyKey(hSession, hKey);
+	}
+}
+
+static void *sdf_async_worker(void *arg)
+{
+	SDF_ASYNC *async = (SDF_ASYNC *)arg;
+	void *hSession = NULL;
+	int access_right = 0;
+	SDF_JOB *batch[SDF_ASYNC_MAX_BATCH];
+	size_t max_cnt, cnt, i;
+	int ok = 0;
+
+	if (SDF_OpenSession(async->dev_handle, &hSession) == SDR_OK) {
+		if (async->sign_key_index < 0) {
+			ok = 1;
+		} else if (SDF_GetPrivateKeyAccessRight(hSession, async->sign_key_index,
+			(unsigned char *)async->pass, (unsigned int)strlen(async->pass)) == SDR_OK) {
+			access_right = 1;
+			ok = 1;
+		}
+	}
+
+	pthread_mutex_lock(&async->lock);
+	if (ok) {
+		async->workers_ready++;
+	} else {
+		async->workers_failed++;
+	}
+	pthread_cond_broadcast(&async->done_cond);
+	if (!ok) {
+		pthread_mutex_unlock(&async->lock);
+		goto end;
+	}
+
+	for (;;) {
+		while (!async->head && !async->stop) {
+			pthread_cond_wait(&async->job_cond, &async->lock);
+		}
+		if (!async->head) {
+			break;
+		}
+		// share a short queue among the workers instead of serving it in one batch
+		max_cnt = async->queued / async->workers_cnt;
+		if (max_cnt < 1) {
+			max_cnt = 1;
+		} else if (max_cnt > SDF_ASYNC_MAX_BATCH) {
+			max_cnt = SDF_ASYNC_MAX_BATCH;
+		}
+		for (cnt = 0; async->head && cnt < max_cnt; cnt++) {
+			batch[cnt] = async->head;
+			async->head = async->head->next;
+		}
+		async->queued -= cnt;
+		if (!async->head) {
+			async->tail = NULL;
+		}
+		pthread_mutex_unlock(&async->lock);
+
+		sdf_async_run_batch(async, hSession, batch, cnt);
+		for (i = 0; i < cnt; i++) {
+			if (batch[i]->callback) {
+				batch[i]->callback(batch[i], batch[i]->callback_arg);
+			}
+		}
+
+		pthread_mutex_lock(&async->lock);
+		for (i = 0; i < cnt; i++) {
+			batch[i]->done = 1;
+		}
+		pthread_cond_broadcast(&async->done_cond);
+	}
+	pthread_mutex_unlock(&async->lock);
+
+end:
+	if (access_right) SDF_ReleasePrivateKeyAccessRight(hSession, async->sign_key_index);
+	if (hSession) SDF_CloseSession(hSession);
+	return NULL;
+}
+
+int sdf_async_init(SDF_ASYNC *async, SDF_DEVICE *dev, int sign_key_index, const char *pass, size_t workers)
+{
+	SDF_KEY key;
+	size_t i;
+
+	if (!async || !dev || !workers || workers > SDF_ASYNC_MAX_WORKERS) {
+		error_print();
+		return -1;
+	}
+	if (sign_key_index >= 0 && !pass) {
+		error_print();
+		return -1;
+	}
+
+	memset(async, 0, sizeof(SDF_ASYNC));
+	async->sign_key_index = sign_key_index < 0 ? -1 : sign_key_index;
+	async->dev_handle = dev->handle;
+	async->pass = pass;
+	if (sign_key_index >= 0) {
+		if (sdf_load_sign_key(dev, &key, sign_key_index, pass) != 1) {
+			error_print();
+			return -1;
+		}
+		async->public_key = key.public_key;
+		sdf_release_key(&key);
+	}
+
+	if (pthread_mutex_init(&async->lock, NULL) != 0) {
+		error_print();
+		return -1;
+	}
+	if (pthread_cond_init(&async->job_cond, NULL) != 0) {
+		pthread_mutex_destroy(&async->lock);
+		error_print();
+		return -1;
+	}
+	if (pthread_cond_init(&async->done_cond, NULL) != 0) {
+		pthread_cond_destroy(&async->job_cond);
+		pthread_mutex_destroy(&async->lock);
+		error_print();
+		return -1;
+	}
+
+	for (i = 0; i < workers; i++) {
+		if (pthread_create(&async->workers[i], NULL, sdf_async_worker, async) != 0) {
+			error_print();
+			break;
+		}
+		async->workers_cnt++;
+	}
+
+	pthread_mutex_lock(&async->lock);
+	while (async->workers_ready + async->workers_failed < async->workers_cnt) {
+		pthread_cond_wait(&async->done_cond, &async->lock);
+	}
+	async->pass = NULL;
+	pthread_mutex_unlock(&async->lock);
+
+	if (async->workers_cnt < workers || async->workers_failed) {
+		error_print();
+		sdf_async_cleanup(async);
+		return -1;
+	}
+	return 1;
+}
+
+int sdf_async_submit(SDF_ASYNC *async, SDF_JOB *job, SDF_JOB_CALLBACK callback, void *callback_arg)
+{
+	if (!async || !job) {
+		error_print();
+		return -1;
+	}
+	job->ret = 0;
+	job->done = 0;
+	job->callback = callback;
+	job->callback_arg = callback_arg;
+	job->next = NULL;
+
+	pthread_mutex_lock(&async->lock);
+	if (async->stop) {
+		pthread_mutex_unlock(&async->lock);
+		error_print();
+		return -1;
+	}
+	if (async->tail) {
+		async->tail->next = job;
+	} else {
+		async->head = job;
+	}
+	async->tail = job;
+	async->queued++;
+	pthread_cond_signal(&async->job_cond);
+	pthread_mutex_unlock(&async->lock);
+	return 1;
+}
+
+int sdf_async_poll(SDF_ASYNC *async, const SDF_JOB *job)
+{
+	int done;
+
+	pthread_mutex_lock(&async->lock);
+	done = job->done == 1;
+	pthread_mutex_unlock(&async->lock);
+	return done;
+}
+
+int sdf_async_wait(SDF_ASYNC *async, const SDF_JOB *job)
+{
+	pthread_mutex_lock(&async->lock);
+	while (job->done != 1) {
+		pthread_cond_wait(&async->done_cond, &async->lock);
+	}
+	pthread_mutex_unlock(&async->lock);
+	return job->ret == 1 ? 1 : -1;
+}
+
+int sdf_async_sign(SDF_ASYNC *async, const uint8_t dgst[32], uint8_t *sig, size_t *siglen)
+{
+	SDF_JOB job;
+
+	if (!async || !dgst || !sig || !siglen) {
+		error_print();
+		return -1;
+	}
+	sdf_job_init_sign(&job, dgst);
+	if (sdf_async_submit(async, &job, NULL, NULL) != 1
+		|| sdf_async_wait(async, &job) != 1) {
+		error_print();
+		return -1;
+	}
+	memcpy(sig, job.sig, job.siglen);
+	*siglen = job.siglen;
+	return 1;
+}
+
+void sdf_async_cleanup(SDF_ASYNC *async)
+{
+	size_t i;
+
+	if (!async || !async->dev_handle) {
+		return;
+	}
+	// queued jobs are still served
+	pthread_mutex_lock(&async->lock);
+	async->stop = 1;
+	pthread_cond_broadcast(&async->job_cond);
+	pthread_mutex_unlock(&async->lock);
+	for (i = 0; i < async->workers_cnt; i++) {
+		pthread_join(async->workers[i], NULL);
+	}
+	pthread_cond_destroy(&async->done_cond);
+	pthread_cond_destroy(&async->job_cond);
+	pthread_mutex_destroy(&async->lock);
+	memset(async, 0, sizeof(SDF_ASYNC));
+}
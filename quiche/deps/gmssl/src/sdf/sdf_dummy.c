@@ -11,6 +11,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifndef WIN32
+#include <unistd.h>
+#endif
 #include "../sgd.h"
 #include "sdf.h"
 
@@ -19,6 +22,17 @@ static char *sessionHandle = "SDF Session Handle";
 static char *keyHandle = "SDF Key Handle";
 static char *agreementHandle = "SDF Agreement Handle";
 
+// SDF_DUMMY_LATENCY_US in the environment delays the sign, encrypt and random calls
+static void dummy_device_latency(void)
+{
+#ifndef WIN32
+	const char *latency = getenv("SDF_DUMMY_LATENCY_US");
+	if (latency) {
+		usleep((useconds_t)atol(latency));
+	}
+#endif
+}
+
 unsigned char rsaPublicKeyBuf[516] = {
 	0x00,0x04,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
 	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
@@ -232,6 +246,7 @@ int SDF_GenerateRandom(
 	unsigned int uiLength,
 	unsigned char *pucRandom)
 {
+	dummy_device_latency();
 	return SDR_OK;
 }
 
@@ -511,7 +526,7 @@ int SDF_ImportKeyWithKEK(
 	unsigned int uiKeyLength,
 	void **phKeyHandle)
 {
-	if (!phKeyHandle || !(*phKeyHandle))
+	if (!phKeyHandle)
 		return SDR_INARGERR;
 	*phKeyHandle = keyHandle;
 	return SDR_OK;
@@ -584,6 +599,13 @@ int SDF_InternalSign_ECC(
 	unsigned int uiDataLength,
 	ECCSignature *pucSignature)
 {
+	if (!pucData || uiDataLength != 32 || !pucSignature)
+		return SDR_INARGERR;
+	dummy_device_latency();
+	/* not a valid signature, r and s are the input */
+	memset(pucSignature, 0, sizeof(ECCSignature));
+	memcpy(pucSignature->r + ECCref_MAX_LEN - 32, pucData, 32);
+	memcpy(pucSignature->s + ECCref_MAX_LEN - 32, pucData, 32);
 	return SDR_OK;
 }
 
@@ -623,6 +645,9 @@ int SDF_Encrypt(
 {
 	if (!puiEncDataLength)
 		return SDR_INARGERR;
+	dummy_device_latency();
+	if (pucData && pucEncData)
+		memcpy(pucEncData, pucData, uiDataLength);
 	*puiEncDataLength = uiDataLength;
 	return SDR_OK;
 }
@@ -14,6 +14,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <gmssl/sm2.h>
 #include "../sgd.h"
 #include "sdf.h"
 
@@ -46,6 +47,7 @@ int SDF_FreeECCCipher(ECCCipher *cipher);
 int SDF_PrintECCCipher(FILE *out, ECCCipher *cipher);
 int SDF_PrintECCSignature(FILE *out, ECCSignature *sig);
 const char *SDF_GetErrorReason(int err);
+int SDF_ECCSignature_to_SM2_SIGNATURE(const ECCSignature *ref, SM2_SIGNATURE *sig);
 
 
 #ifdef __cplusplus
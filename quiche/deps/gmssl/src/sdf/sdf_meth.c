@@ -48,7 +48,7 @@ SDF_METHOD *SDF_METHOD_load_library(const char *so_path)
 	}
 
 #else
-	if (!(sdf->dso = dlopen(so_path, 0/*RTLD_LAZY*/))) { // FIXME: dlfcn.h, dlopen, RTLD_LAZY not in windows!
+	if (!(sdf->dso = dlopen(so_path, RTLD_LAZY))) {
 		fprintf(stderr, "%s %d: %s\n", __FILE__, __LINE__, dlerror());
 		SDFerr(SDF_F_SDF_METHOD_LOAD_LIBRARY, SDF_R_DSO_LOAD_FAILURE);
 		goto end;
@@ -114,7 +114,13 @@ end:
 
 void SDF_METHOD_free(SDF_METHOD *meth)
 {
-	if (meth) free(meth->dso);
+	if (meth && meth->dso) {
+#ifdef WIN32
+		FreeLibrary(meth->dso);
+#else
+		dlclose(meth->dso);
+#endif
+	}
 	free(meth);
 }
 
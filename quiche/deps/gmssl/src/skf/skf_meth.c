@@ -49,7 +49,7 @@ SKF_METHOD *SKF_METHOD_load_library(const char *so_path)
 	}
 
 #else	
-	if (!(skf->dso = dlopen(so_path, 0/*RTLD_LAZY*/))) {//FIXME:dlopen not in windows			
+	if (!(skf->dso = dlopen(so_path, RTLD_LAZY))) {
 		SKFerr(SKF_F_SKF_METHOD_LOAD_LIBRARY, SKF_R_DSO_LOAD_FAILURE);
 		goto end;
 	}
@@ -147,7 +147,12 @@ end:
 
 void SKF_METHOD_free(SKF_METHOD *meth)
 {
-	if (meth)
-		free(meth->dso);
+	if (meth && meth->dso) {
+#ifdef WIN32
+		FreeLibrary(meth->dso);
+#else
+		dlclose(meth->dso);
+#endif
+	}
 	free(meth);
 }
@@ -12,6 +12,8 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include <gmssl/mem.h>
 #include <gmssl/sm2.h>
 #include <gmssl/asn1.h>
 #include <gmssl/rand.h>
@@ -955,6 +957,296 @@ void sm2_jacobian_point_mul(SM2_JACOBIAN_POINT *R, const SM2_BN k, const SM2_JAC
 	sm2_jacobian_point_copy(R, Q);
 }
 
+/*
+ * Montgomery ladder with co-Z arithmetic (Goundar, Joye, Miyaji; Rivain).
+ * R0 and R1 share their Z coordinate, which is never computed: XYCZ-ADDC
+ * gives (P + Q, P - Q) and XYCZ-ADD gives (P + Q, P) on a common new Z. Every
+ * bit costs the same ADDC + ADD (9M + 5S) whatever its value, the bit only
+ * selects which register is which through a masked swap.
+ */
+
+static void sm2_bn_cswap(SM2_BN a, SM2_BN b, uint64_t swap)
+{
+	uint64_t mask = 0 - swap;
+	uint64_t t;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		t = (a[i] ^ b[i]) & mask;
+		a[i] ^= t;
+		b[i] ^= t;
+	}
+}
+
+// (X2, Y2) = P + Q, (X1, Y1) = P with the Z of the sum
+static void sm2_xycz_add(SM2_BN X1, SM2_BN Y1, SM2_BN X2, SM2_BN Y2)
+{
+	SM2_BN C, W1, W2, A1, D, T;
+
+	sm2_fp_sub(T, X1, X2);
+	sm2_fp_sqr(C, T);
+	sm2_fp_mul(W1, X1, C);
+	sm2_fp_mul(W2, X2, C);
+	sm2_fp_sub(T, Y1, Y2);
+	sm2_fp_sqr(D, T);
+	sm2_fp_sub(A1, W1, W2);
+	sm2_fp_mul(A1, A1, Y1);
+
+	sm2_fp_sub(X2, D, W1);
+	sm2_fp_sub(X2, X2, W2);
+	sm2_fp_sub(D, W1, X2);
+	sm2_fp_mul(Y2, T, D);
+	sm2_fp_sub(Y2, Y2, A1);
+
+	sm2_bn_copy(X1, W1);
+	sm2_bn_copy(Y1, A1);
+}
+
+// (X2, Y2) = P + Q, (X1, Y1) = P - Q with the Z of the sum
+static void sm2_xycz_addc(SM2_BN X1, SM2_BN Y1, SM2_BN X2, SM2_BN Y2)
+{
+	SM2_BN C, W1, W2, A1, D, T, S;
+
+	sm2_fp_sub(T, X1, X2);
+	sm2_fp_sqr(C, T);
+	sm2_fp_mul(W1, X1, C);
+	sm2_fp_mul(W2, X2, C);
+	sm2_fp_sub(A1, W1, W2);
+	sm2_fp_mul(A1, A1, Y1);
+	sm2_fp_add(S, Y1, Y2);
+	sm2_fp_sub(T, Y1, Y2);
+
+	// P + Q
+	sm2_fp_sqr(D, T);
+	sm2_fp_sub(X2, D, W1);
+	sm2_fp_sub(X2, X2, W2);
+	sm2_fp_sub(D, W1, X2);
+	sm2_fp_mul(Y2, T, D);
+	sm2_fp_sub(Y2, Y2, A1);
+
+	// P - Q
+	sm2_fp_sqr(D, S);
+	sm2_fp_sub(X1, D, W1);
+	sm2_fp_sub(X1, X1, W2);
+	sm2_fp_sub(D, W1, X1);
+	sm2_fp_mul(Y1, S, D);
+	sm2_fp_sub(Y1, Y1, A1);
+}
+
+void sm2_jacobian_point_mul_ladder(SM2_JACOBIAN_POINT *R, const SM2_BN k, const SM2_JACOBIAN_POINT *P)
+{
+	SM2_JACOBIAN_POINT _T, *T = &_T;
+	SM2_BN x, y;
+	SM2_BN e, e2;
+	SM2_BN X0, Y0, X1, Y1;
+	SM2_BN Z, t;
+	uint64_t carry, mask, b;
+	int i;
+
+	sm2_jacobian_point_get_xy(P, x, y);
+
+	// e = k + n, or k + 2n when that is still below 2^256, so that the
+	// ladder always runs over 257 bits with the top one set
+	sm2_bn_add(e, k, SM2_N);
+	carry = e[7] >> 32;
+	e[7] &= 0xffffffff;
+	sm2_bn_add(e2, e, SM2_N);
+	e2[7] &= 0xffffffff;
+	mask = carry - 1;
+	for (i = 0; i < 8; i++) {
+		e[i] = (e[i] & ~mask) | (e2[i] & mask);
+	}
+
+	// R1 = 2P, R0 = P on the same Z
+	sm2_jacobian_point_set_xy(T, x, y);
+	sm2_jacobian_point_dbl(T, T);
+	sm2_bn_copy(X1, T->X);
+	sm2_bn_copy(Y1, T->Y);
+	sm2_fp_sqr(t, T->Z);
+	sm2_fp_mul(X0, x, t);
+	sm2_fp_mul(t, t, T->Z);
+	sm2_fp_mul(Y0, y, t);
+
+	for (i = 255; i > 0; i--) {
+		b = (e[i / 32] >> (i % 32)) & 1;
+		// (R0, R1) = (2R0, R0 + R1) or (R0 + R1, 2R1)
+		sm2_bn_cswap(X0, X1, b);
+		sm2_bn_cswap(Y0, Y1, b);
+		sm2_xycz_addc(X0, Y0, X1, Y1);
+		sm2_xycz_add(X1, Y1, X0, Y0);
+		sm2_bn_cswap(X0, X1, b);
+		sm2_bn_cswap(Y0, Y1, b);
+	}
+
+	b = e[0] & 1;
+	sm2_bn_cswap(X0, X1, b);
+	sm2_bn_cswap(Y0, Y1, b);
+	sm2_xycz_addc(X0, Y0, X1, Y1);
+
+	// (X0, Y0) is now +P or -P, which gives back the common Z: the inverse
+	// of the final Z is +/- y * X0 / (x * Y0 * (X1 - X0))
+	sm2_fp_sub(Z, X1, X0);
+	sm2_fp_mul(Z, Z, Y0);
+	sm2_fp_mul(Z, Z, x);
+	sm2_fp_inv(Z, Z);
+	sm2_fp_mul(Z, Z, X0);
+	sm2_fp_neg(t, y);
+	mask = 0 - b;
+	for (i = 0; i < 8; i++) {
+		t[i] = (y[i] & mask) | (t[i] & ~mask);
+	}
+	sm2_fp_mul(Z, Z, t);
+
+	sm2_xycz_add(X1, Y1, X0, Y0);
+	sm2_bn_cswap(X0, X1, b);
+	sm2_bn_cswap(Y0, Y1, b);
+
+	sm2_fp_sqr(t, Z);
+	sm2_fp_mul(X0, X0, t);
+	sm2_fp_mul(t, t, Z);
+	sm2_fp_mul(Y0, Y0, t);
+	sm2_jacobian_point_set_xy(R, X0, Y0);
+
+	// The co-Z formulas can not go through the point at infinity, which is
+	// only met for a few scalars next to 0 or n, or when x is zero. These
+	// give a point off the curve and are done with the generic method.
+	if (sm2_bn_is_zero(x) || sm2_jacobian_point_is_on_curve(R) != 1) {
+		sm2_jacobian_point_set_xy(T, x, y);
+		sm2_jacobian_point_mul(R, k, T);
+	}
+
+	sm2_bn_clean(e);
+	sm2_bn_clean(e2);
+}
+
+/*
+ * Fixed-base multiplication of G with a table of the odd multiples
+ * 1G, 3G, .., 15G of every 16^i G, 65 windows of 8 affine points (64 KB)
+ * built once on first use. The scalar is made odd and recoded into signed
+ * odd digits (Joye, Tunstall), no digit is zero so every window is one
+ * masked lookup and one mixed addition, without any doubling, whatever the
+ * value of k.
+ */
+
+#define SM2_G_TABLE_WINDOWS	65
+
+static SM2_BN sm2_g_table[SM2_G_TABLE_WINDOWS][8][2];
+static pthread_once_t sm2_g_table_once = PTHREAD_ONCE_INIT;
+
+static void sm2_g_table_init(void)
+{
+	SM2_JACOBIAN_POINT B, D, P[8];
+	SM2_BN x, y;
+	SM2_BN acc[8], inv, t;
+	int i, j;
+
+	sm2_jacobian_point_copy(&B, SM2_G);
+	for (i = 0; i < SM2_G_TABLE_WINDOWS; i++) {
+		// D = 2B, P[j] = (2j + 1)B
+		sm2_jacobian_point_dbl(&D, &B);
+		sm2_jacobian_point_get_xy(&D, x, y);
+		sm2_jacobian_point_set_xy(&D, x, y);
+		sm2_jacobian_point_copy(&P[0], &B);
+		for (j = 1; j < 8; j++) {
+			sm2_jacobian_point_add(&P[j], &P[j - 1], &D);
+		}
+
+		// one inversion for the 8 points
+		sm2_bn_copy(acc[0], P[0].Z);
+		for (j = 1; j < 8; j++) {
+			sm2_fp_mul(acc[j], acc[j - 1], P[j].Z);
+		}
+		sm2_fp_inv(inv, acc[7]);
+		for (j = 7; j >= 0; j--) {
+			if (j > 0) {
+				sm2_fp_mul(t, inv, acc[j - 1]);
+				sm2_fp_mul(inv, inv, P[j].Z);
+			} else {
+				sm2_bn_copy(t, inv);
+			}
+			sm2_fp_mul(sm2_g_table[i][j][1], P[j].Y, t);
+			sm2_fp_sqr(t, t);
+			sm2_fp_mul(sm2_g_table[i][j][0], P[j].X, t);
+			sm2_fp_mul(sm2_g_table[i][j][1], sm2_g_table[i][j][1], t);
+		}
+
+		// B = 16B = 8D
+		sm2_jacobian_point_dbl(&B, &D);
+		sm2_jacobian_point_dbl(&B, &B);
+		sm2_jacobian_point_dbl(&B, &B);
+		sm2_jacobian_point_get_xy(&B, x, y);
+		sm2_jacobian_point_set_xy(&B, x, y);
+	}
+}
+
+void sm2_jacobian_point_mul_generator_table(SM2_JACOBIAN_POINT *R, const SM2_BN k)
+{
+	SM2_JACOBIAN_POINT _Q, *Q = &_Q;
+	uint32_t w[9];
+	int digits[SM2_G_TABLE_WINDOWS];
+	int64_t c;
+	uint64_t odd, mask, sign;
+	uint32_t idx;
+	SM2_BN y;
+	int i, j, l;
+
+	pthread_once(&sm2_g_table_once, sm2_g_table_init);
+
+	// e = k, or k + n when k is even, n is odd
+	odd = k[0] & 1;
+	mask = odd - 1;
+	c = 0;
+	for (i = 0; i < 8; i++) {
+		c += (int64_t)k[i] + (int64_t)(SM2_N[i] & mask);
+		w[i] = (uint32_t)c;
+		c >>= 32;
+	}
+	w[8] = (uint32_t)c;
+
+	// e = sum d_i 16^i with d_i odd in [-15, 15], the last one is 1 or 3
+	for (i = 0; i < SM2_G_TABLE_WINDOWS - 1; i++) {
+		digits[i] = (int)(w[0] & 31) - 16;
+		c = -(int64_t)digits[i];
+		for (j = 0; j < 9; j++) {
+			c += w[j];
+			w[j] = (uint32_t)c;
+			c >>= 32;
+		}
+		for (j = 0; j < 8; j++) {
+			w[j] = (w[j] >> 4) | (w[j + 1] << 28);
+		}
+		w[8] >>= 4;
+	}
+	digits[i] = (int)w[0];
+
+	for (i = SM2_G_TABLE_WINDOWS - 1; i >= 0; i--) {
+		sign = (uint64_t)(digits[i] >> 31) & 1;
+		idx = (uint32_t)((digits[i] ^ -(int)sign) + (int)sign) >> 1;
+
+		sm2_bn_set_zero(Q->X);
+		sm2_bn_set_zero(Q->Y);
+		for (j = 0; j < 8; j++) {
+			mask = 0 - (uint64_t)(j == (int)idx);
+			for (l = 0; l < 8; l++) {
+				Q->X[l] |= sm2_g_table[i][j][0][l] & mask;
+				Q->Y[l] |= sm2_g_table[i][j][1][l] & mask;
+			}
+		}
+		sm2_bn_set_one(Q->Z);
+		sm2_fp_neg(y, Q->Y);
+		sm2_bn_cswap(Q->Y, y, sign);
+
+		if (i == SM2_G_TABLE_WINDOWS - 1) {
+			sm2_jacobian_point_copy(R, Q);
+		} else {
+			sm2_jacobian_point_add(R, R, Q);
+		}
+	}
+
+	gmssl_secure_clear(w, sizeof(w));
+	gmssl_secure_clear(digits, sizeof(digits));
+}
+
 void sm2_jacobian_point_to_bytes(const SM2_JACOBIAN_POINT *P, uint8_t out[64])
 {
 	SM2_BN x;
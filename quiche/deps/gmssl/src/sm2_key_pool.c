@@ -0,0 +1,256 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <gmssl/mem.h>
+#include <gmssl/sm2_key_pool.h>
+#include <gmssl/error.h>
+
+/*
+ * The ring is a bounded queue with a sequence number per slot (D. Vyukov).
+ * A slot at position pos is free to fill when its sequence is pos, holds a
+ * key when it is pos + 1, and is given back for the next round as
+ * pos + size once the taker has copied the key out. There is one filler,
+ * the refill thread, so only takers race, on head.
+ */
+
+static volatile unsigned int sm2_key_pool_fork_generation = 1;
+static pthread_once_t sm2_key_pool_atfork_once = PTHREAD_ONCE_INIT;
+
+static void sm2_key_pool_atfork_child(void)
+{
+	sm2_key_pool_fork_generation++;
+}
+
+static void sm2_key_pool_atfork_register(void)
+{
+	pthread_atfork(NULL, NULL, sm2_key_pool_atfork_child);
+}
+
+static int sm2_key_pool_is_full(SM2_KEY_POOL *pool)
+{
+	uint64_t pos = pool->tail;
+	SM2_KEY_POOL_SLOT *slot = &pool->slots[pos & (pool->size - 1)];
+
+	return __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos;
+}
+
+static void sm2_key_pool_put(SM2_KEY_POOL *pool, const SM2_KEY *key)
+{
+	uint64_t pos = pool->tail;
+	SM2_KEY_POOL_SLOT *slot = &pool->slots[pos & (pool->size - 1)];
+
+	slot->key = *key;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&pool->tail, pos + 1, __ATOMIC_RELEASE);
+}
+
+static void *sm2_key_pool_refill(void *arg)
+{
+	SM2_KEY_POOL *pool = (SM2_KEY_POOL *)arg;
+	SM2_KEY key;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (!pool->stop && !__atomic_load_n(&pool->refill, __ATOMIC_ACQUIRE)) {
+			pthread_cond_wait(&pool->cond, &pool->lock);
+		}
+		if (pool->stop) {
+			break;
+		}
+		// takers that drain the ring while it is filled ask for one more pass
+		__atomic_store_n(&pool->refill, 0, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&pool->lock);
+
+		while (!__atomic_load_n(&pool->stop, __ATOMIC_ACQUIRE) && !sm2_key_pool_is_full(pool)) {
+			if (sm2_key_generate(&key) != 1) {
+				error_print();
+				break;
+			}
+			sm2_key_pool_put(pool, &key);
+		}
+		pthread_mutex_lock(&pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	gmssl_secure_clear(&key, sizeof(key));
+	return NULL;
+}
+
+static void sm2_key_pool_wakeup(SM2_KEY_POOL *pool)
+{
+	// only the first taker below the mark pays for the lock
+	if (__atomic_exchange_n(&pool->refill, 1, __ATOMIC_ACQ_REL) == 0) {
+		pthread_mutex_lock(&pool->lock);
+		pthread_cond_signal(&pool->cond);
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+int sm2_key_pool_init(SM2_KEY_POOL *pool, size_t size, size_t low_water)
+{
+	size_t n = 1;
+	size_t i;
+
+	if (!pool || !size) {
+		error_print();
+		return -1;
+	}
+	if (size > SM2_KEY_POOL_MAX_SIZE) {
+		error_print();
+		return -1;
+	}
+	while (n < size) {
+		n <<= 1;
+	}
+	if (low_water >= n) {
+		error_print();
+		return -1;
+	}
+
+	memset(pool, 0, sizeof(SM2_KEY_POOL));
+	pthread_once(&sm2_key_pool_atfork_once, sm2_key_pool_atfork_register);
+
+	if (!(pool->slots = (SM2_KEY_POOL_SLOT *)malloc(sizeof(SM2_KEY_POOL_SLOT) * n))) {
+		error_print();
+		return -1;
+	}
+	memset(pool->slots, 0, sizeof(SM2_KEY_POOL_SLOT) * n);
+	for (i = 0; i < n; i++) {
+		pool->slots[i].seq = i;
+	}
+	pool->size = n;
+	pool->low_water = low_water;
+	pool->generation = sm2_key_pool_fork_generation;
+	pool->refill = 1;
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->cond, NULL);
+	if (pthread_create(&pool->thread, NULL, sm2_key_pool_refill, pool) != 0) {
+		error_print();
+		pthread_mutex_destroy(&pool->lock);
+		pthread_cond_destroy(&pool->cond);
+		free(pool->slots);
+		memset(pool, 0, sizeof(SM2_KEY_POOL));
+		return -1;
+	}
+	return 1;
+}
+
+int sm2_key_pool_get(SM2_KEY_POOL *pool, SM2_KEY *key)
+{
+	SM2_KEY_POOL_SLOT *slot;
+	uint64_t pos;
+	uint64_t seq;
+
+	if (!pool || !key) {
+		error_print();
+		return -1;
+	}
+	if (pool->generation != sm2_key_pool_fork_generation) {
+		goto miss;
+	}
+
+	pos = __atomic_load_n(&pool->head, __ATOMIC_RELAXED);
+	for (;;) {
+		slot = &pool->slots[pos & (pool->size - 1)];
+		seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+		if (seq == pos + 1) {
+			// a failed exchange reloads pos
+			if (__atomic_compare_exchange_n(&pool->head, &pos, pos + 1, 1,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if ((int64_t)(seq - (pos + 1)) < 0) {
+			sm2_key_pool_wakeup(pool);
+			goto miss;
+		} else {
+			pos = __atomic_load_n(&pool->head, __ATOMIC_RELAXED);
+		}
+	}
+	*key = slot->key;
+	gmssl_secure_clear(&slot->key, sizeof(SM2_KEY));
+	__atomic_store_n(&slot->seq, pos + pool->size, __ATOMIC_RELEASE);
+	__atomic_fetch_add(&pool->hits, 1, __ATOMIC_RELAXED);
+
+	if (sm2_key_pool_count(pool) <= pool->low_water) {
+		sm2_key_pool_wakeup(pool);
+	}
+	return 1;
+
+miss:
+	__atomic_fetch_add(&pool->misses, 1, __ATOMIC_RELAXED);
+	return sm2_key_generate(key);
+}
+
+size_t sm2_key_pool_count(const SM2_KEY_POOL *pool)
+{
+	uint64_t head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+	uint64_t tail = __atomic_load_n(&pool->tail, __ATOMIC_ACQUIRE);
+
+	return tail > head ? (size_t)(tail - head) : 0;
+}
+
+void sm2_key_pool_get_stats(const SM2_KEY_POOL *pool, uint64_t *hits, uint64_t *misses)
+{
+	if (hits) {
+		*hits = __atomic_load_n(&pool->hits, __ATOMIC_RELAXED);
+	}
+	if (misses) {
+		*misses = __atomic_load_n(&pool->misses, __ATOMIC_RELAXED);
+	}
+}
+
+void sm2_key_pool_cleanup(SM2_KEY_POOL *pool)
+{
+	if (!pool || !pool->slots) {
+		return;
+	}
+	// the refill thread was not inherited by a forked child
+	if (pool->generation == sm2_key_pool_fork_generation) {
+		pthread_mutex_lock(&pool->lock);
+		__atomic_store_n(&pool->stop, 1, __ATOMIC_RELEASE);
+		pthread_cond_signal(&pool->cond);
+		pthread_mutex_unlock(&pool->lock);
+		pthread_join(pool->thread, NULL);
+		pthread_mutex_destroy(&pool->lock);
+		pthread_cond_destroy(&pool->cond);
+	}
+	gmssl_secure_clear(pool->slots, sizeof(SM2_KEY_POOL_SLOT) * pool->size);
+	free(pool->slots);
+	memset(pool, 0, sizeof(SM2_KEY_POOL));
+}
+
+SM2_KEY_POOL *sm2_key_pool_new(size_t size, size_t low_water)
+{
+	SM2_KEY_POOL *pool;
+
+	if (!(pool = (SM2_KEY_POOL *)malloc(sizeof(SM2_KEY_POOL)))) {
+		error_print();
+		return NULL;
+	}
+	if (sm2_key_pool_init(pool, size, low_water) != 1) {
+		error_print();
+		free(pool);
+		return NULL;
+	}
+	return pool;
+}
+
+void sm2_key_pool_free(SM2_KEY_POOL *pool)
+{
+	if (pool) {
+		sm2_key_pool_cleanup(pool);
+		free(pool);
+	}
+}
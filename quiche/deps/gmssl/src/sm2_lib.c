@@ -408,17 +408,21 @@ int sm2_verify_finish(SM2_SIGN_CTX *ctx, const uint8_t *sig, size_t siglen)
 int sm2_kdf(const uint8_t *in, size_t inlen, size_t outlen, uint8_t *out)
 {
 	SM3_CTX ctx;
+	SM3_CTX in_ctx;
 	uint8_t counter_be[4];
 	uint8_t dgst[SM3_DIGEST_SIZE];
 	uint32_t counter = 1;
 	size_t len;
 
+	// the input is hashed once, only the counter is hashed per block
+	sm3_init(&in_ctx);
+	sm3_update(&in_ctx, in, inlen);
+
 	while (outlen) {
 		PUTU32(counter_be, counter);
 		counter++;
 
-		sm3_init(&ctx);
-		sm3_update(&ctx, in, inlen);
+		ctx = in_ctx;
 		sm3_update(&ctx, counter_be, sizeof(counter_be));
 		sm3_finish(&ctx, dgst);
 
@@ -429,10 +433,48 @@ int sm2_kdf(const uint8_t *in, size_t inlen, size_t outlen, uint8_t *out)
 	}
 
 	memset(&ctx, 0, sizeof(SM3_CTX));
+	memset(&in_ctx, 0, sizeof(SM3_CTX));
 	memset(dgst, 0, sizeof(dgst));
 	return 1;
 }
 
+int sm2_kdf_xor(const uint8_t xy[64], const uint8_t *in, size_t inlen, uint8_t *out)
+{
+	SM3_CTX ctx;
+	SM3_CTX xy_ctx;
+	uint8_t counter_be[4];
+	uint8_t dgst[SM3_DIGEST_SIZE];
+	uint32_t counter = 1;
+	uint8_t nonzero = 0;
+	size_t len, i;
+
+	// x2 || y2 is one SM3 block, compressed once for all the counters
+	sm3_init(&xy_ctx);
+	sm3_update(&xy_ctx, xy, 64);
+
+	while (inlen) {
+		PUTU32(counter_be, counter);
+		counter++;
+
+		ctx = xy_ctx;
+		sm3_update(&ctx, counter_be, sizeof(counter_be));
+		sm3_finish(&ctx, dgst);
+
+		len = inlen < SM3_DIGEST_SIZE ? inlen : SM3_DIGEST_SIZE;
+		for (i = 0; i < len; i++) {
+			nonzero |= dgst[i];
+			out[i] = in[i] ^ dgst[i];
+		}
+		in += len;
+		out += len;
+		inlen -= len;
+	}
+
+	memset(&ctx, 0, sizeof(SM3_CTX));
+	memset(&xy_ctx, 0, sizeof(SM3_CTX));
+	memset(dgst, 0, sizeof(dgst));
+	return nonzero ? 1 : 0;
+}
 
 int sm2Pub_do_encrypt_ex(uint8_t * public_key, int fixed_outlen, const uint8_t *in, size_t inlen, SM2_CIPHERTEXT *out)
 {
@@ -440,7 +482,6 @@ int sm2Pub_do_encrypt_ex(uint8_t * public_key, int fixed_outlen, const uint8_t *
 	SM2_JACOBIAN_POINT _P, *P = &_P;
 	SM3_CTX sm3_ctx;
 	uint8_t buf[64];
-	int i;
 
 retry:
 	// rand k in [1, n - 1]
@@ -467,14 +508,8 @@ retry:
 	sm2_jacobian_point_to_bytes(P, buf);
 
 
-	// t = KDF(x2 || y2, klen)
-	sm2_kdf(buf, sizeof(buf), inlen, out->ciphertext);
-
-
-	// C2 = M xor t
-	for (i = 0; i < inlen; i++) {
-		out->ciphertext[i] ^= in[i];
-	}
+	// C2 = M xor KDF(x2 || y2, klen)
+	if (sm2_kdf_xor(buf, in, inlen, out->ciphertext) != 1) goto retry;
 	out->ciphertext_size = (uint32_t)inlen;
 
 	// C3 = Hash(x2 || m || y2)
@@ -495,7 +530,6 @@ int sm2_do_encrypt_ex(const SM2_KEY *key, int fixed_outlen, const uint8_t *in, s
 	SM2_JACOBIAN_POINT _P, *P = &_P;
 	SM3_CTX sm3_ctx;
 	uint8_t buf[64];
-	int i;
 
 retry:
 	// rand k in [1, n - 1]
@@ -522,14 +556,8 @@ retry:
 	sm2_jacobian_point_to_bytes(P, buf);
 
 
-	// t = KDF(x2 || y2, klen)
-	sm2_kdf(buf, sizeof(buf), inlen, out->ciphertext);
-
-
-	// C2 = M xor t
-	for (i = 0; i < inlen; i++) {
-		out->ciphertext[i] ^= in[i];
-	}
+	// C2 = M xor KDF(x2 || y2, klen)
+	if (sm2_kdf_xor(buf, in, inlen, out->ciphertext) != 1) goto retry;
 	out->ciphertext_size = (uint32_t)inlen;
 
 	// C3 = Hash(x2 || m || y2)
@@ -555,7 +583,6 @@ int sm2_do_decrypt(const SM2_KEY *key, const SM2_CIPHERTEXT *in, uint8_t *out, s
 	SM3_CTX sm3_ctx;
 	uint8_t buf[64];
 	uint8_t hash[32];
-	int i;
 
 	// FIXME: check SM2_CIPHERTEXT format
 
@@ -582,11 +609,10 @@ int sm2_do_decrypt(const SM2_KEY *key, const SM2_CIPHERTEXT *in, uint8_t *out, s
 		return -1;
 	}
 
-	sm2_kdf(buf, sizeof(buf), inlen, out);
-
-	// M = C2 xor t
-	for (i = 0; i < inlen; i++) {
-		out[i] ^= in->ciphertext[i];
+	// M = C2 xor KDF(x2 || y2, klen)
+	if (sm2_kdf_xor(buf, in->ciphertext, inlen, out) != 1) {
+		error_print();
+		return -1;
 	}
 	*outlen = inlen;
 
@@ -741,6 +767,7 @@ int sm2_pub_encrypt(uint8_t * public_key, const uint8_t *in, size_t inlen, uint8
 		error_print();
 		return -1;
 	}
+	return 1;
 }
 
 int sm2_decrypt(const SM2_KEY *key, const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen)
@@ -763,6 +790,120 @@ int sm2_decrypt(const SM2_KEY *key, const uint8_t *in, size_t inlen, uint8_t *ou
 	return 1;
 }
 
+int sm2_encrypt_raw(const SM2_POINT *public_key, const uint8_t *in, size_t inlen, uint8_t *out)
+{
+	SM2_BN k;
+	SM2_JACOBIAN_POINT _P, *P = &_P;
+	SM2_JACOBIAN_POINT _Q, *Q = &_Q;
+	SM3_CTX sm3_ctx;
+	uint8_t buf[64];
+
+	if (!public_key || !in || !out) {
+		error_print();
+		return -1;
+	}
+	if (inlen < SM2_MIN_PLAINTEXT_SIZE || inlen > SM2_MAX_PLAINTEXT_SIZE) {
+		error_print();
+		return -1;
+	}
+	sm2_jacobian_point_from_bytes(Q, (const uint8_t *)public_key);
+	if (sm2_jacobian_point_is_on_curve(Q) != 1) {
+		error_print();
+		return -1;
+	}
+
+retry:
+	// rand k in [1, n - 1]
+	sm2_bn_rand_range(k, SM2_N);
+	if (sm2_bn_is_zero(k)) goto retry;
+
+	// C1 = k * G = (x1, y1)
+	sm2_jacobian_point_mul_generator_table(P, k);
+	out[0] = 0x04;
+	sm2_jacobian_point_to_bytes(P, out + 1);
+
+	// (x2, y2) = k * P
+	sm2_jacobian_point_mul_ladder(P, k, Q);
+	sm2_jacobian_point_to_bytes(P, buf);
+
+	// C2 = M xor KDF(x2 || y2, klen)
+	if (sm2_kdf_xor(buf, in, inlen, out + 65 + 32) != 1) goto retry;
+
+	// C3 = Hash(x2 || M || y2)
+	sm3_init(&sm3_ctx);
+	sm3_update(&sm3_ctx, buf, 32);
+	sm3_update(&sm3_ctx, in, inlen);
+	sm3_update(&sm3_ctx, buf + 32, 32);
+	sm3_finish(&sm3_ctx, out + 65);
+
+	sm2_bn_clean(k);
+	gmssl_secure_clear(buf, sizeof(buf));
+	return 1;
+}
+
+int sm2_decrypt_raw(const SM2_KEY *key, const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen)
+{
+	SM2_BN d;
+	SM2_JACOBIAN_POINT _P, *P = &_P;
+	SM3_CTX sm3_ctx;
+	uint8_t buf[64];
+	uint8_t hash[32];
+	size_t mlen;
+
+	if (!key || !in || !out || !outlen) {
+		error_print();
+		return -1;
+	}
+	if (inlen < SM2_RAW_CIPHERTEXT_SIZE(SM2_MIN_PLAINTEXT_SIZE)
+		|| inlen > SM2_RAW_CIPHERTEXT_SIZE(SM2_MAX_PLAINTEXT_SIZE)) {
+		error_print();
+		return -1;
+	}
+	mlen = inlen - SM2_RAW_CIPHERTEXT_SIZE(0);
+
+	// C1 must be on the curve before the private key touches it
+	if (in[0] != 0x04) {
+		error_print();
+		return -1;
+	}
+	sm2_jacobian_point_from_bytes(P, in + 1);
+	if (sm2_jacobian_point_is_on_curve(P) != 1) {
+		error_print();
+		return -1;
+	}
+
+	// (x2, y2) = d * C1
+	sm2_bn_from_bytes(d, key->private_key);
+	sm2_jacobian_point_mul_ladder(P, d, P);
+	sm2_bn_clean(d);
+	sm2_jacobian_point_to_bytes(P, buf);
+
+	// M = C2 xor KDF(x2 || y2, klen)
+	if (sm2_kdf_xor(buf, in + 65 + 32, mlen, out) != 1) {
+		error_print();
+		goto err;
+	}
+
+	// u = Hash(x2 || M || y2) must be C3
+	sm3_init(&sm3_ctx);
+	sm3_update(&sm3_ctx, buf, 32);
+	sm3_update(&sm3_ctx, out, mlen);
+	sm3_update(&sm3_ctx, buf + 32, 32);
+	sm3_finish(&sm3_ctx, hash);
+	if (gmssl_secure_memcmp(hash, in + 65, sizeof(hash)) != 0) {
+		error_print();
+		goto err;
+	}
+
+	gmssl_secure_clear(buf, sizeof(buf));
+	*outlen = mlen;
+	return 1;
+err:
+	gmssl_secure_clear(buf, sizeof(buf));
+	gmssl_secure_clear(out, mlen);
+	return -1;
+}
+
 int sm2_ecdh(const SM2_KEY *key, const SM2_POINT *peer_public, SM2_POINT *out)
 {
 	if (!key || !peer_public || !out) {
@@ -0,0 +1,41 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#include <string.h>
+#include <gmssl/endian.h>
+#include "sm3_lcl.h"
+
+
+void sm3_compress_lanes(uint32_t V[8][SM3_MAX_LANES], const uint32_t M[16][SM3_MAX_LANES], size_t nlanes)
+{
+	uint32_t digest[8];
+	uint8_t block[SM3_BLOCK_SIZE];
+	size_t i, l;
+
+#ifdef ENABLE_SM3_LANES_AVX2
+	if (sm3_avx2_supported()) {
+		sm3_compress_x8_avx2(V, M);
+		return;
+	}
+#endif
+	for (l = 0; l < nlanes; l++) {
+		for (i = 0; i < 8; i++) {
+			digest[i] = V[i][l];
+		}
+		for (i = 0; i < 16; i++) {
+			PUTU32(block + i * 4, M[i][l]);
+		}
+		sm3_compress_blocks(digest, block, 1);
+		for (i = 0; i < 8; i++) {
+			V[i][l] = digest[i];
+		}
+	}
+	memset(block, 0, sizeof(block));
+}
@@ -0,0 +1,128 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#include <immintrin.h>
+#include "sm3_lcl.h"
+
+/*
+ * 8-lane SM3 compression with AVX2, each 32-bit element of a vector belongs
+ * to one independent state. The round function is the one of sm3.c with the
+ * registers renamed instead of moved, the message expansion is computed in
+ * full before the rounds. The kernel is compiled with a target attribute and
+ * chosen at run time, the library still runs on CPUs without AVX2.
+ */
+
+static const uint32_t SM3_K[64] = {
+	0x79cc4519U, 0xf3988a32U, 0xe7311465U, 0xce6228cbU,
+	0x9cc45197U, 0x3988a32fU, 0x7311465eU, 0xe6228cbcU,
+	0xcc451979U, 0x988a32f3U, 0x311465e7U, 0x6228cbceU,
+	0xc451979cU, 0x88a32f39U, 0x11465e73U, 0x228cbce6U,
+	0x9d8a7a87U, 0x3b14f50fU, 0x7629ea1eU, 0xec53d43cU,
+	0xd8a7a879U, 0xb14f50f3U, 0x629ea1e7U, 0xc53d43ceU,
+	0x8a7a879dU, 0x14f50f3bU, 0x29ea1e76U, 0x53d43cecU,
+	0xa7a879d8U, 0x4f50f3b1U, 0x9ea1e762U, 0x3d43cec5U,
+	0x7a879d8aU, 0xf50f3b14U, 0xea1e7629U, 0xd43cec53U,
+	0xa879d8a7U, 0x50f3b14fU, 0xa1e7629eU, 0x43cec53dU,
+	0x879d8a7aU, 0x0f3b14f5U, 0x1e7629eaU, 0x3cec53d4U,
+	0x79d8a7a8U, 0xf3b14f50U, 0xe7629ea1U, 0xcec53d43U,
+	0x9d8a7a87U, 0x3b14f50fU, 0x7629ea1eU, 0xec53d43cU,
+	0xd8a7a879U, 0xb14f50f3U, 0x629ea1e7U, 0xc53d43ceU,
+	0x8a7a879dU, 0x14f50f3bU, 0x29ea1e76U, 0x53d43cecU,
+	0xa7a879d8U, 0x4f50f3b1U, 0x9ea1e762U, 0x3d43cec5U,
+};
+
+#define ROL(x,n)	_mm256_or_si256(_mm256_slli_epi32((x),(n)), _mm256_srli_epi32((x),32-(n)))
+#define XOR(a,b)	_mm256_xor_si256((a),(b))
+#define ADD(a,b)	_mm256_add_epi32((a),(b))
+#define P0(x)		XOR(XOR((x), ROL((x), 9)), ROL((x),17))
+#define P1(x)		XOR(XOR((x), ROL((x),15)), ROL((x),23))
+
+#define FF00(x,y,z)	XOR(XOR((x),(y)),(z))
+#define FF16(x,y,z)	_mm256_or_si256(_mm256_and_si256((x), _mm256_or_si256((y),(z))), _mm256_and_si256((y),(z)))
+#define GG00(x,y,z)	XOR(XOR((x),(y)),(z))
+#define GG16(x,y,z)	XOR(_mm256_and_si256(XOR((y),(z)), (x)), (z))
+
+#define R(A, B, C, D, E, F, G, H, xx)						\
+	A12 = ROL(A, 12);							\
+	SS1 = ROL(ADD(ADD(A12, E), _mm256_set1_epi32((int)SM3_K[j])), 7);	\
+	SS2 = XOR(SS1, A12);							\
+	TT1 = ADD(ADD(ADD(FF##xx(A, B, C), D), SS2), XOR(W[j], W[j + 4]));	\
+	TT2 = ADD(ADD(ADD(GG##xx(E, F, G), H), SS1), W[j]);			\
+	B = ROL(B, 9);								\
+	H = TT1;								\
+	F = ROL(F, 19);								\
+	D = P0(TT2);								\
+	j++
+
+#define R8(A, B, C, D, E, F, G, H, xx)		\
+	R(A, B, C, D, E, F, G, H, xx);		\
+	R(H, A, B, C, D, E, F, G, xx);		\
+	R(G, H, A, B, C, D, E, F, xx);		\
+	R(F, G, H, A, B, C, D, E, xx);		\
+	R(E, F, G, H, A, B, C, D, xx);		\
+	R(D, E, F, G, H, A, B, C, xx);		\
+	R(C, D, E, F, G, H, A, B, xx);		\
+	R(B, C, D, E, F, G, H, A, xx)
+
+__attribute__((target("avx2")))
+void sm3_compress_x8_avx2(uint32_t V[8][SM3_MAX_LANES], const uint32_t M[16][SM3_MAX_LANES])
+{
+	__m256i A, B, C, D, E, F, G, H;
+	__m256i A12, SS1, SS2, TT1, TT2;
+	__m256i W[68];
+	int j;
+
+	for (j = 0; j < 16; j++) {
+		W[j] = _mm256_loadu_si256((const __m256i *)M[j]);
+	}
+	for (; j < 68; j++) {
+		W[j] = XOR(XOR(P1(XOR(XOR(W[j - 16], W[j - 9]), ROL(W[j - 3], 15))),
+			ROL(W[j - 13], 7)), W[j - 6]);
+	}
+
+	A = _mm256_loadu_si256((const __m256i *)V[0]);
+	B = _mm256_loadu_si256((const __m256i *)V[1]);
+	C = _mm256_loadu_si256((const __m256i *)V[2]);
+	D = _mm256_loadu_si256((const __m256i *)V[3]);
+	E = _mm256_loadu_si256((const __m256i *)V[4]);
+	F = _mm256_loadu_si256((const __m256i *)V[5]);
+	G = _mm256_loadu_si256((const __m256i *)V[6]);
+	H = _mm256_loadu_si256((const __m256i *)V[7]);
+
+	j = 0;
+	R8(A, B, C, D, E, F, G, H, 00);
+	R8(A, B, C, D, E, F, G, H, 00);
+	R8(A, B, C, D, E, F, G, H, 16);
+	R8(A, B, C, D, E, F, G, H, 16);
+	R8(A, B, C, D, E, F, G, H, 16);
+	R8(A, B, C, D, E, F, G, H, 16);
+	R8(A, B, C, D, E, F, G, H, 16);
+	R8(A, B, C, D, E, F, G, H, 16);
+
+	_mm256_storeu_si256((__m256i *)V[0], XOR(_mm256_loadu_si256((const __m256i *)V[0]), A));
+	_mm256_storeu_si256((__m256i *)V[1], XOR(_mm256_loadu_si256((const __m256i *)V[1]), B));
+	_mm256_storeu_si256((__m256i *)V[2], XOR(_mm256_loadu_si256((const __m256i *)V[2]), C));
+	_mm256_storeu_si256((__m256i *)V[3], XOR(_mm256_loadu_si256((const __m256i *)V[3]), D));
+	_mm256_storeu_si256((__m256i *)V[4], XOR(_mm256_loadu_si256((const __m256i *)V[4]), E));
+	_mm256_storeu_si256((__m256i *)V[5], XOR(_mm256_loadu_si256((const __m256i *)V[5]), F));
+	_mm256_storeu_si256((__m256i *)V[6], XOR(_mm256_loadu_si256((const __m256i *)V[6]), G));
+	_mm256_storeu_si256((__m256i *)V[7], XOR(_mm256_loadu_si256((const __m256i *)V[7]), H));
+}
+
+static int sm3_cpu_avx2 = -1;
+
+int sm3_avx2_supported(void)
+{
+	if (sm3_cpu_avx2 < 0) {
+		__builtin_cpu_init();
+		sm3_cpu_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+	}
+	return sm3_cpu_avx2;
+}
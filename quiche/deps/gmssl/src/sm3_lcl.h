@@ -0,0 +1,35 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#ifndef GMSSL_SM3_LCL_H
+#define GMSSL_SM3_LCL_H
+
+#include <gmssl/sm3.h>
+
+void sm3_compress_blocks(uint32_t digest[8], const uint8_t *data, size_t blocks);
+
+/*
+ * Multi-lane compression of one block for each of `nlanes` independent
+ * states. The data is interleaved by lane: word i of lane l is V[i][l] for
+ * the state and M[i][l] for the message, message words are already decoded
+ * from big-endian. Hash chains like the PBKDF2 iterations keep their values
+ * in this layout from one block to the next, the digest words of a lane are
+ * the message words of the next block.
+ */
+#define SM3_MAX_LANES	8
+
+void sm3_compress_lanes(uint32_t V[8][SM3_MAX_LANES], const uint32_t M[16][SM3_MAX_LANES], size_t nlanes);
+
+#ifdef ENABLE_SM3_LANES_AVX2
+int sm3_avx2_supported(void);
+void sm3_compress_x8_avx2(uint32_t V[8][SM3_MAX_LANES], const uint32_t M[16][SM3_MAX_LANES]);
+#endif
+
+#endif
@@ -0,0 +1,200 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#include <string.h>
+#include <gmssl/sm3.h>
+#include <gmssl/sm4.h>
+#include <gmssl/endian.h>
+#include <gmssl/sm4_cbc_sm3_hmac.h>
+#include "sm4_lcl.h"
+
+
+#define P0(x) ((x) ^ ROL32((x), 9) ^ ROL32((x),17))
+#define P1(x) ((x) ^ ROL32((x),15) ^ ROL32((x),23))
+
+#define FF00(x,y,z)  ((x) ^ (y) ^ (z))
+#define FF16(x,y,z)  (((x)&(y)) | ((x)&(z)) | ((y)&(z)))
+#define GG00(x,y,z)  ((x) ^ (y) ^ (z))
+#define GG16(x,y,z)  ((((y)^(z)) & (x)) ^ (z))
+
+static const uint32_t K[64] = {
+	0x79cc4519U, 0xf3988a32U, 0xe7311465U, 0xce6228cbU,
+	0x9cc45197U, 0x3988a32fU, 0x7311465eU, 0xe6228cbcU,
+	0xcc451979U, 0x988a32f3U, 0x311465e7U, 0x6228cbceU,
+	0xc451979cU, 0x88a32f39U, 0x11465e73U, 0x228cbce6U,
+	0x9d8a7a87U, 0x3b14f50fU, 0x7629ea1eU, 0xec53d43cU,
+	0xd8a7a879U, 0xb14f50f3U, 0x629ea1e7U, 0xc53d43ceU,
+	0x8a7a879dU, 0x14f50f3bU, 0x29ea1e76U, 0x53d43cecU,
+	0xa7a879d8U, 0x4f50f3b1U, 0x9ea1e762U, 0x3d43cec5U,
+	0x7a879d8aU, 0xf50f3b14U, 0xea1e7629U, 0xd43cec53U,
+	0xa879d8a7U, 0x50f3b14fU, 0xa1e7629eU, 0x43cec53dU,
+	0x879d8a7aU, 0x0f3b14f5U, 0x1e7629eaU, 0x3cec53d4U,
+	0x79d8a7a8U, 0xf3b14f50U, 0xe7629ea1U, 0xcec53d43U,
+	0x9d8a7a87U, 0x3b14f50fU, 0x7629ea1eU, 0xec53d43cU,
+	0xd8a7a879U, 0xb14f50f3U, 0x629ea1e7U, 0xc53d43ceU,
+	0x8a7a879dU, 0x14f50f3bU, 0x29ea1e76U, 0x53d43cecU,
+	0xa7a879d8U, 0x4f50f3b1U, 0x9ea1e762U, 0x3d43cec5U,
+};
+
+/* one SM3 round on (A..H), rotating the state in place */
+#define SM3_ROUND(j, FF, GG)						\
+	SS1 = ROL32((ROL32(A, 12) + E + K[j]), 7);			\
+	SS2 = SS1 ^ ROL32(A, 12);					\
+	TT1 = FF(A, B, C) + D + SS2 + (W[j] ^ W[(j) + 4]);		\
+	TT2 = GG(E, F, G) + H + SS1 + W[j];				\
+	D = C;								\
+	C = ROL32(B, 9);						\
+	B = A;								\
+	A = TT1;							\
+	H = G;								\
+	G = ROL32(F, 19);						\
+	F = E;								\
+	E = P0(TT2)
+
+/* one SM4 T-table round on (x0..x3), shifting the window in place */
+#define SM4_ROUND(i)							\
+	t = x1 ^ x2 ^ x3 ^ rk[i];					\
+	t = x0								\
+		^ ROL32(SM4_T[(uint8_t)t], 8)				\
+		^ ROL32(SM4_T[(uint8_t)(t >> 8)], 16)			\
+		^ ROL32(SM4_T[(uint8_t)(t >> 16)], 24)			\
+		^ SM4_T[t >> 24];					\
+	x0 = x1;							\
+	x1 = x2;							\
+	x2 = x3;							\
+	x3 = t
+
+/*
+ * Every SM4 block takes 32 rounds and covers 16 of the 64 SM3 rounds, so
+ * two SM4 rounds are issued per SM3 round. The SM3 message expansion has no
+ * dependency on the cipher and is done up front.
+ */
+static void sm4_cbc_sm3_chunks(const SM4_KEY *key, uint8_t iv[16],
+	const uint8_t *in, uint8_t *out,
+	uint32_t digest[8], const uint8_t *sm3_in,
+	size_t nchunks, int enc)
+{
+	const uint32_t *rk = key->rk;
+	uint32_t A, B, C, D, E, F, G, H;
+	uint32_t SS1, SS2, TT1, TT2;
+	uint32_t W[68];
+	uint32_t x0, x1, x2, x3, t;
+	uint32_t v0, v1, v2, v3;
+	uint32_t c0, c1, c2, c3;
+	int b, j, r;
+
+	v0 = GETU32(iv     );
+	v1 = GETU32(iv +  4);
+	v2 = GETU32(iv +  8);
+	v3 = GETU32(iv + 12);
+
+	while (nchunks--) {
+		for (j = 0; j < 16; j++) {
+			W[j] = GETU32(sm3_in + j*4);
+		}
+		for (; j < 68; j++) {
+			W[j] = P1(W[j - 16] ^ W[j - 9] ^ ROL32(W[j - 3], 15))
+				^ ROL32(W[j - 13], 7) ^ W[j - 6];
+		}
+
+		A = digest[0];
+		B = digest[1];
+		C = digest[2];
+		D = digest[3];
+		E = digest[4];
+		F = digest[5];
+		G = digest[6];
+		H = digest[7];
+
+		j = 0;
+		for (b = 0; b < 4; b++) {
+			c0 = GETU32(in     );
+			c1 = GETU32(in +  4);
+			c2 = GETU32(in +  8);
+			c3 = GETU32(in + 12);
+
+			if (enc) {
+				x0 = c0 ^ v0;
+				x1 = c1 ^ v1;
+				x2 = c2 ^ v2;
+				x3 = c3 ^ v3;
+			} else {
+				x0 = c0;
+				x1 = c1;
+				x2 = c2;
+				x3 = c3;
+			}
+
+			for (r = 0; r < 32; r += 2, j++) {
+				SM4_ROUND(r);
+				if (j < 16) {
+					SM3_ROUND(j, FF00, GG00);
+				} else {
+					SM3_ROUND(j, FF16, GG16);
+				}
+				SM4_ROUND(r + 1);
+			}
+
+			if (enc) {
+				v0 = x3;
+				v1 = x2;
+				v2 = x1;
+				v3 = x0;
+				PUTU32(out     , v0);
+				PUTU32(out +  4, v1);
+				PUTU32(out +  8, v2);
+				PUTU32(out + 12, v3);
+			} else {
+				PUTU32(out     , x3 ^ v0);
+				PUTU32(out +  4, x2 ^ v1);
+				PUTU32(out +  8, x1 ^ v2);
+				PUTU32(out + 12, x0 ^ v3);
+				v0 = c0;
+				v1 = c1;
+				v2 = c2;
+				v3 = c3;
+			}
+			in += 16;
+			out += 16;
+		}
+
+		digest[0] ^= A;
+		digest[1] ^= B;
+		digest[2] ^= C;
+		digest[3] ^= D;
+		digest[4] ^= E;
+		digest[5] ^= F;
+		digest[6] ^= G;
+		digest[7] ^= H;
+
+		sm3_in += SM3_BLOCK_SIZE;
+	}
+
+	PUTU32(iv     , v0);
+	PUTU32(iv +  4, v1);
+	PUTU32(iv +  8, v2);
+	PUTU32(iv + 12, v3);
+}
+
+void sm4_cbc_encrypt_sm3_compress(const SM4_KEY *key, uint8_t iv[16],
+	const uint8_t *in, uint8_t *out,
+	uint32_t digest[8], const uint8_t *sm3_in,
+	size_t nchunks)
+{
+	sm4_cbc_sm3_chunks(key, iv, in, out, digest, sm3_in, nchunks, 1);
+}
+
+void sm4_cbc_decrypt_sm3_compress(const SM4_KEY *key, uint8_t iv[16],
+	const uint8_t *in, uint8_t *out,
+	uint32_t digest[8], const uint8_t *sm3_in,
+	size_t nchunks)
+{
+	sm4_cbc_sm3_chunks(key, iv, in, out, digest, sm3_in, nchunks, 0);
+}
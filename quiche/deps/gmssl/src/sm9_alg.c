@@ -13,6 +13,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <pthread.h>
 #include <gmssl/hex.h>
 #include <gmssl/mem.h>
 #include <gmssl/sm9.h>
@@ -798,6 +799,12 @@ void sm9_fp4_dbl(sm9_fp4_t r, const sm9_fp4_t a)
 	sm9_fp2_dbl(r[1], a[1]);
 }
 
+void sm9_fp4_tri(sm9_fp4_t r, const sm9_fp4_t a)
+{
+	sm9_fp2_tri(r[0], a[0]);
+	sm9_fp2_tri(r[1], a[1]);
+}
+
 void sm9_fp4_sub(sm9_fp4_t r, const sm9_fp4_t a, const sm9_fp4_t b)
 {
 	sm9_fp2_sub(r[0], a[0], b[0]);
@@ -1197,6 +1204,110 @@ void sm9_fp12_pow(sm9_fp12_t r, const sm9_fp12_t a, const sm9_bn_t k)
 	sm9_fp12_copy(r, t);
 }
 
+/*
+ * Granger-Scott squaring, only valid for a in the cyclotomic subgroup, i.e.
+ * a^(p^6 + 1) = 1 and a^(p^4 - p^2 + 1) = 1 after the easy part of the final
+ * exponentiation. With a = A + B*w + C*w^2:
+ *	A' = 3*A^2 - 2*conj(A)
+ *	B' = 3*v*C^2 + 2*conj(B)
+ *	C' = 3*B^2 - 2*conj(C)
+ */
+void sm9_fp12_cyclotomic_sqr(sm9_fp12_t r, const sm9_fp12_t a)
+{
+	sm9_fp4_t r0, r1, r2, t;
+
+	sm9_fp4_sqr(r0, a[0]);
+	sm9_fp4_tri(r0, r0);
+	sm9_fp4_conjugate(t, a[0]);
+	sm9_fp4_dbl(t, t);
+	sm9_fp4_sub(r0, r0, t);
+
+	sm9_fp4_sqr_v(r1, a[2]);
+	sm9_fp4_tri(r1, r1);
+	sm9_fp4_conjugate(t, a[1]);
+	sm9_fp4_dbl(t, t);
+	sm9_fp4_add(r1, r1, t);
+
+	sm9_fp4_sqr(r2, a[1]);
+	sm9_fp4_tri(r2, r2);
+	sm9_fp4_conjugate(t, a[2]);
+	sm9_fp4_dbl(t, t);
+	sm9_fp4_sub(r2, r2, t);
+
+	sm9_fp4_copy(r[0], r0);
+	sm9_fp4_copy(r[1], r1);
+	sm9_fp4_copy(r[2], r2);
+}
+
+// r = a^k for a in the cyclotomic subgroup, such as any pairing value
+void sm9_fp12_cyclotomic_pow(sm9_fp12_t r, const sm9_fp12_t a, const sm9_bn_t k)
+{
+	sm9_fp12_t t;
+	int i;
+
+	for (i = 255; i >= 0; i--) {
+		if ((k[i/32] >> (i % 32)) & 1) {
+			break;
+		}
+	}
+	if (i < 0) {
+		sm9_fp12_set_one(r);
+		return;
+	}
+	sm9_fp12_copy(t, a);
+	for (i--; i >= 0; i--) {
+		sm9_fp12_cyclotomic_sqr(t, t);
+		if ((k[i/32] >> (i % 32)) & 1) {
+			sm9_fp12_mul(t, t, a);
+		}
+	}
+	sm9_fp12_copy(r, t);
+}
+
+/*
+ * Fixed-base comb for a in the cyclotomic subgroup, one tooth per 64 bits of
+ * the exponent: table[i] = prod a^(2^(64*b)) over the bits b set in i.
+ */
+void sm9_fp12_table_init(SM9_FP12_TABLE *table, const sm9_fp12_t a)
+{
+	sm9_fp12_t base[SM9_FP12_TABLE_TEETH];
+	int b, i;
+
+	sm9_fp12_copy(base[0], a);
+	for (b = 1; b < SM9_FP12_TABLE_TEETH; b++) {
+		sm9_fp12_copy(base[b], base[b - 1]);
+		for (i = 0; i < 64; i++) {
+			sm9_fp12_cyclotomic_sqr(base[b], base[b]);
+		}
+	}
+
+	sm9_fp12_set_one(table->powers[0]);
+	for (i = 1; i < SM9_FP12_TABLE_SIZE; i++) {
+		int low = i & -i;
+		for (b = 0; (1 << b) != low; b++);
+		sm9_fp12_mul(table->powers[i], table->powers[i ^ low], base[b]);
+	}
+}
+
+void sm9_fp12_pow_table(sm9_fp12_t r, const sm9_bn_t k, const SM9_FP12_TABLE *table)
+{
+	sm9_fp12_t t;
+	int b, j;
+
+	sm9_fp12_set_one(t);
+	for (j = 63; j >= 0; j--) {
+		int idx = 0;
+		sm9_fp12_cyclotomic_sqr(t, t);
+		for (b = 0; b < SM9_FP12_TABLE_TEETH; b++) {
+			idx |= ((k[2*b + j/32] >> (j % 32)) & 1) << b;
+		}
+		if (idx) {
+			sm9_fp12_mul(t, t, table->powers[idx]);
+		}
+	}
+	sm9_fp12_copy(r, t);
+}
+
 void sm9_fp2_conjugate(sm9_fp2_t r, const sm9_fp2_t a)
 {
 	sm9_fp_copy(r[0], a[0]);
@@ -1372,7 +1483,9 @@ void sm9_point_get_xy(const SM9_POINT *P, sm9_fp_t x, sm9_fp_t y)
 
 	if (sm9_fp_is_one(P->Z)) {
 		sm9_fp_copy(x, P->X);
-		sm9_fp_copy(y, P->Y);
+		if (y)
+			sm9_fp_copy(y, P->Y);
+		return;
 	}
 
 	sm9_fp_inv(z_inv, P->Z);
@@ -1533,22 +1646,123 @@ void sm9_point_mul(SM9_POINT *R, const sm9_bn_t k, const SM9_POINT *P)
 {
 	char kbits[257];
 	SM9_POINT _Q, *Q = &_Q;
+	SM9_POINT _A, *A = &_A;
 	int i;
 
+	if (sm9_point_is_at_infinity(P)) {
+		sm9_point_set_infinity(R);
+		return;
+	}
+	// sm9_point_add() wants an affine Q, normalize P only once
+	sm9_point_get_xy(P, A->X, A->Y);
+	sm9_fp_set_one(A->Z);
+
 	sm9_bn_to_bits(k, kbits);
 	sm9_point_set_infinity(Q);
 	for (i = 0; i < 256; i++) {
 		sm9_point_dbl(Q, Q);
 		if (kbits[i] == '1') {
-			sm9_point_add(Q, Q, P);
+			sm9_point_add(Q, Q, A);
 		}
 	}
 	sm9_point_copy(R, Q);
 }
 
+/*
+ * Fixed-base comb, one tooth per 32-bit limb of k:
+ *	table[i] = sum of 2^(32*b) * P over the bits b set in i
+ * in affine form, so k*P takes 32 doublings and at most 32 mixed additions.
+ */
+void sm9_point_table_init(SM9_POINT_TABLE *table, const SM9_POINT *P)
+{
+	SM9_POINT *T = table->points;
+	SM9_POINT base[SM9_POINT_TABLE_TEETH];
+	sm9_fp_t acc[SM9_POINT_TABLE_SIZE];
+	sm9_fp_t inv, t;
+	int b, i;
+
+	sm9_point_copy(&base[0], P);
+	for (b = 1; b < SM9_POINT_TABLE_TEETH; b++) {
+		sm9_point_copy(&base[b], &base[b - 1]);
+		for (i = 0; i < 32; i++) {
+			sm9_point_dbl(&base[b], &base[b]);
+		}
+	}
+	for (b = 0; b < SM9_POINT_TABLE_TEETH; b++) {
+		sm9_point_get_xy(&base[b], base[b].X, base[b].Y);
+		sm9_fp_set_one(base[b].Z);
+	}
+
+	sm9_point_set_infinity(&T[0]);
+	for (i = 1; i < SM9_POINT_TABLE_SIZE; i++) {
+		int low = i & -i;
+		for (b = 0; (1 << b) != low; b++);
+		sm9_point_add(&T[i], &T[i ^ low], &base[b]);
+	}
+
+	// batch inversion of all the Z coordinates
+	sm9_fp_set_one(acc[0]);
+	for (i = 1; i < SM9_POINT_TABLE_SIZE; i++) {
+		if (i == 1) {
+			sm9_fp_copy(acc[i], T[i].Z);
+		} else {
+			sm9_fp_mul(acc[i], acc[i - 1], T[i].Z);
+		}
+	}
+	sm9_fp_inv(inv, acc[SM9_POINT_TABLE_SIZE - 1]);
+	for (i = SM9_POINT_TABLE_SIZE - 1; i >= 1; i--) {
+		sm9_fp_t z_inv;
+		if (i > 1) {
+			sm9_fp_mul(z_inv, inv, acc[i - 1]);
+			sm9_fp_mul(inv, inv, T[i].Z);
+		} else {
+			sm9_fp_copy(z_inv, inv);
+		}
+		sm9_fp_sqr(t, z_inv);
+		sm9_fp_mul(T[i].X, T[i].X, t);
+		sm9_fp_mul(t, t, z_inv);
+		sm9_fp_mul(T[i].Y, T[i].Y, t);
+		sm9_fp_set_one(T[i].Z);
+	}
+}
+
+void sm9_point_mul_table(SM9_POINT *R, const sm9_bn_t k, const SM9_POINT_TABLE *table)
+{
+	SM9_POINT _Q, *Q = &_Q;
+	int b, j;
+
+	sm9_point_set_infinity(Q);
+	for (j = 31; j >= 0; j--) {
+		int idx = 0;
+		sm9_point_dbl(Q, Q);
+		for (b = 0; b < SM9_POINT_TABLE_TEETH; b++) {
+			idx |= ((k[b] >> j) & 1) << b;
+		}
+		if (idx) {
+			sm9_point_add(Q, Q, &table->points[idx]);
+		}
+	}
+	sm9_point_copy(R, Q);
+}
+
+static SM9_POINT_TABLE sm9_p1_table;
+static SM9_TWIST_POINT sm9_p2_table[16];
+static SM9_PAIRING_TABLE sm9_p2_pairing_table;
+static pthread_once_t sm9_generator_tables_once = PTHREAD_ONCE_INIT;
+
+static void sm9_twist_point_table_init(SM9_TWIST_POINT table[16], const SM9_TWIST_POINT *P);
+
+static void sm9_generator_tables_init(void)
+{
+	sm9_point_table_init(&sm9_p1_table, SM9_P1);
+	sm9_twist_point_table_init(sm9_p2_table, SM9_P2);
+	sm9_pairing_table_init(&sm9_p2_pairing_table, SM9_P2);
+}
+
 void sm9_point_mul_generator(SM9_POINT *R, const sm9_bn_t k)
 {
-	sm9_point_mul(R, k, SM9_P1);
+	pthread_once(&sm9_generator_tables_once, sm9_generator_tables_init);
+	sm9_point_mul_table(R, k, &sm9_p1_table);
 }
 
 
@@ -1595,7 +1809,9 @@ void sm9_twist_point_get_xy(const SM9_TWIST_POINT *P, sm9_fp2_t x, sm9_fp2_t y)
 
 	if (sm9_fp2_is_one(P->Z)) {
 		sm9_fp2_copy(x, P->X);
-		sm9_fp2_copy(y, P->Y);
+		if (y)
+			sm9_fp2_copy(y, P->Y);
+		return;
 	}
 
 	sm9_fp2_inv(z_inv, P->Z);
@@ -1820,9 +2036,56 @@ void sm9_twist_point_mul(SM9_TWIST_POINT *R, const sm9_bn_t k, const SM9_TWIST_P
 	sm9_twist_point_copy(R, Q);
 }
 
+/*
+ * Fixed-base comb for the twist generator, one tooth per 64 bits of k:
+ * 16 affine points, 64 doublings and at most 64 mixed additions.
+ */
+static void sm9_twist_point_table_init(SM9_TWIST_POINT table[16], const SM9_TWIST_POINT *P)
+{
+	SM9_TWIST_POINT base[4];
+	int b, i;
+
+	sm9_twist_point_copy(&base[0], P);
+	for (b = 1; b < 4; b++) {
+		sm9_twist_point_copy(&base[b], &base[b - 1]);
+		for (i = 0; i < 64; i++) {
+			sm9_twist_point_dbl(&base[b], &base[b]);
+		}
+	}
+	for (b = 0; b < 4; b++) {
+		sm9_twist_point_get_xy(&base[b], base[b].X, base[b].Y);
+		sm9_fp2_set_one(base[b].Z);
+	}
+
+	sm9_twist_point_set_infinity(&table[0]);
+	for (i = 1; i < 16; i++) {
+		int low = i & -i;
+		for (b = 0; (1 << b) != low; b++);
+		sm9_twist_point_add(&table[i], &table[i ^ low], &base[b]);
+		sm9_twist_point_get_xy(&table[i], table[i].X, table[i].Y);
+		sm9_fp2_set_one(table[i].Z);
+	}
+}
+
 void sm9_twist_point_mul_generator(SM9_TWIST_POINT *R, const sm9_bn_t k)
 {
-	sm9_twist_point_mul(R, k, SM9_P2);
+	SM9_TWIST_POINT _Q, *Q = &_Q;
+	int b, j;
+
+	pthread_once(&sm9_generator_tables_once, sm9_generator_tables_init);
+
+	sm9_twist_point_set_infinity(Q);
+	for (j = 63; j >= 0; j--) {
+		int idx = 0;
+		sm9_twist_point_dbl(Q, Q);
+		for (b = 0; b < 4; b++) {
+			idx |= ((k[2*b + j/32] >> (j % 32)) & 1) << b;
+		}
+		if (idx) {
+			sm9_twist_point_add(Q, Q, &sm9_p2_table[idx]);
+		}
+	}
+	sm9_twist_point_copy(R, Q);
 }
 
 void sm9_eval_g_tangent(sm9_fp12_t num, sm9_fp12_t den, const SM9_TWIST_POINT *P, const SM9_POINT *Q)
@@ -1962,6 +2225,7 @@ void sm9_twist_point_neg_pi2(SM9_TWIST_POINT *R, const SM9_TWIST_POINT *P)
 }
 
 
+// f must be in the cyclotomic subgroup, i.e. the output of the easy part
 void sm9_final_exponent_hard_part(sm9_fp12_t r, const sm9_fp12_t f)
 {
 	// a2 = 0xd8000000019062ed0000b98b0cb27659
@@ -1971,26 +2235,26 @@ void sm9_final_exponent_hard_part(sm9_fp12_t r, const sm9_fp12_t f)
 	const sm9_bn_t nine = {9,0,0,0,0,0,0,0};
 	sm9_fp12_t t0, t1, t2, t3;
 
-	sm9_fp12_pow(t0, f, a3);
-	sm9_fp12_inv(t0, t0);
+	sm9_fp12_cyclotomic_pow(t0, f, a3);
+	sm9_fp12_frobenius6(t0, t0); // inverse of a unitary element
 	sm9_fp12_frobenius(t1, t0);
 	sm9_fp12_mul(t1, t0, t1);
 
 	sm9_fp12_mul(t0, t0, t1);
 	sm9_fp12_frobenius(t2, f);
 	sm9_fp12_mul(t3, t2, f);
-	sm9_fp12_pow(t3, t3, nine);
+	sm9_fp12_cyclotomic_pow(t3, t3, nine);
 
 	sm9_fp12_mul(t0, t0, t3);
-	sm9_fp12_sqr(t3, f);
-	sm9_fp12_sqr(t3, t3);
+	sm9_fp12_cyclotomic_sqr(t3, f);
+	sm9_fp12_cyclotomic_sqr(t3, t3);
 	sm9_fp12_mul(t0, t0, t3);
-	sm9_fp12_sqr(t2, t2);
+	sm9_fp12_cyclotomic_sqr(t2, t2);
 	sm9_fp12_mul(t2, t2, t1);
 	sm9_fp12_frobenius2(t1, f);
 	sm9_fp12_mul(t1, t1, t2);
 
-	sm9_fp12_pow(t2, t1, a2);
+	sm9_fp12_cyclotomic_pow(t2, t1, a2);
 	sm9_fp12_mul(t0, t2, t0);
 	sm9_fp12_frobenius3(t1, f);
 	sm9_fp12_mul(t1, t1, t0);
@@ -2013,61 +2277,287 @@ void sm9_final_exponent(sm9_fp12_t r, const sm9_fp12_t f)
 	sm9_fp12_copy(r, t0);
 }
 
-void sm9_pairing(sm9_fp12_t r, const SM9_TWIST_POINT *Q, const SM9_POINT *P) {
-	const char *abits = "00100000000000000000000000000000000000010000101011101100100111110";
+/*
+ * Miller loop lines
+ *
+ * A line through twist points evaluated at P = (xP, yP) has the form
+ *	l = (a0 + a1*v) + a4*w^2,	a0, a1, a4 in Fp2
+ * Its denominator (and any scaling of l) lies in Fp4, which is killed by the
+ * (p^6 - 1)(p^2 + 1) easy part of the final exponentiation, so the lines are
+ * computed without the denominator and f is updated by a sparse product.
+ *
+ * a0 depends only on the twist points, a1 and a4 are Fp2 constants times yP
+ * and xP. A line is kept as {a0, a1/yP, a4/xP}, so the lines of a fixed Q can
+ * be computed once (SM9_PAIRING_TABLE) and evaluated at any P.
+ */
+
+// r = a * u = -2*a1 + a0*u
+static void sm9_fp2_mul_by_u(sm9_fp2_t r, const sm9_fp2_t a)
+{
+	sm9_fp_t r0;
+
+	sm9_fp_dbl(r0, a[1]);
+	sm9_fp_neg(r0, r0);
+	sm9_fp_copy(r[1], a[0]);
+	sm9_fp_copy(r[0], r0);
+}
+
+// r = a * ((l0 + l1*yP*v) + l4*xP*w^2)
+static void sm9_fp12_mul_line(sm9_fp12_t r, const sm9_fp12_t a,
+	const sm9_fp2_t line[3], const sm9_fp_t xP, const sm9_fp_t yP)
+{
+	sm9_fp4_t l, r0, r1, r2, t;
+	sm9_fp2_t l4;
 
-	SM9_TWIST_POINT _T, *T = &_T;
-	SM9_TWIST_POINT _Q1, *Q1 = &_Q1;
-	SM9_TWIST_POINT _Q2, *Q2 = &_Q2;
+	sm9_fp2_copy(l[0], line[0]);
+	sm9_fp2_mul_fp(l[1], line[1], yP);
+	sm9_fp2_mul_fp(l4, line[2], xP);
 
-	sm9_fp12_t f_num;
-	sm9_fp12_t f_den;
-	sm9_fp12_t g_num;
-	sm9_fp12_t g_den;
+	// t*v = (t[1]*u) + t[0]*v
+	sm9_fp4_mul_fp2(t, a[1], l4);
+	sm9_fp4_mul(r0, a[0], l);
+	sm9_fp2_add(r0[1], r0[1], t[0]);
+	sm9_fp2_mul_by_u(t[0], t[1]);
+	sm9_fp2_add(r0[0], r0[0], t[0]);
+
+	sm9_fp4_mul_fp2(t, a[2], l4);
+	sm9_fp4_mul(r1, a[1], l);
+	sm9_fp2_add(r1[1], r1[1], t[0]);
+	sm9_fp2_mul_by_u(t[0], t[1]);
+	sm9_fp2_add(r1[0], r1[0], t[0]);
+
+	sm9_fp4_mul_fp2(t, a[0], l4);
+	sm9_fp4_mul(r2, a[2], l);
+	sm9_fp4_add(r2, r2, t);
+
+	sm9_fp4_copy(r[0], r0);
+	sm9_fp4_copy(r[1], r1);
+	sm9_fp4_copy(r[2], r2);
+}
+
+/*
+ * T = 2T in Jacobian coordinates, and the tangent at T:
+ *	a0 = 2*Y^2 - 3*X^3, a1 = -2*Y*Z^3 * yP, a4 = 3*X^2*Z^2 * xP
+ */
+static void sm9_miller_dbl_step(sm9_fp2_t line[3], SM9_TWIST_POINT *T)
+{
+	sm9_fp2_t XX, YY, ZZ, M, S, t;
+
+	sm9_fp2_sqr(XX, T->X);
+	sm9_fp2_sqr(YY, T->Y);
+	sm9_fp2_sqr(ZZ, T->Z);
+	sm9_fp2_tri(M, XX);
+	sm9_fp2_dbl(YY, YY);
+
+	sm9_fp2_mul(t, M, T->X);
+	sm9_fp2_sub(line[0], YY, t);
+	sm9_fp2_mul(line[2], M, ZZ);
+
+	// Z3 = 2*Y*Z
+	sm9_fp2_mul(T->Z, T->Y, T->Z);
+	sm9_fp2_dbl(T->Z, T->Z);
+	sm9_fp2_mul(t, T->Z, ZZ);
+	sm9_fp2_neg(line[1], t);
+
+	// S = 4*X*Y^2, X3 = M^2 - 2*S, Y3 = M*(S - X3) - 8*Y^4
+	sm9_fp2_mul(S, YY, T->X);
+	sm9_fp2_dbl(S, S);
+	sm9_fp2_sqr(T->X, M);
+	sm9_fp2_sub(T->X, T->X, S);
+	sm9_fp2_sub(T->X, T->X, S);
+	sm9_fp2_sqr(YY, YY);
+	sm9_fp2_dbl(YY, YY);
+	sm9_fp2_sub(S, S, T->X);
+	sm9_fp2_mul(T->Y, M, S);
+	sm9_fp2_sub(T->Y, T->Y, YY);
+}
+
+/*
+ * T = T + Q with Q = (xQ, yQ) affine, and the line through T and Q. With
+ * H = xQ*Z^2 - X, R = yQ*Z^3 - Y and Z3 = Z*H:
+ *	a0 = Z3*yQ - R*xQ, a1 = -Z3 * yP, a4 = R * xP
+ */
+static void sm9_miller_add_step(sm9_fp2_t line[3], SM9_TWIST_POINT *T,
+	const sm9_fp2_t xQ, const sm9_fp2_t yQ)
+{
+	sm9_fp2_t H, R, HH, HHH, t;
+
+	sm9_fp2_sqr(t, T->Z);
+	sm9_fp2_mul(H, t, xQ);
+	sm9_fp2_sub(H, H, T->X);
+	sm9_fp2_mul(t, t, T->Z);
+	sm9_fp2_mul(R, t, yQ);
+	sm9_fp2_sub(R, R, T->Y);
+
+	sm9_fp2_mul(T->Z, T->Z, H);
+
+	sm9_fp2_mul(line[0], T->Z, yQ);
+	sm9_fp2_mul(t, R, xQ);
+	sm9_fp2_sub(line[0], line[0], t);
+	sm9_fp2_neg(line[1], T->Z);
+	sm9_fp2_copy(line[2], R);
+
+	// X3 = R^2 - 2*X*H^2 - H^3, Y3 = R*(X*H^2 - X3) - Y*H^3
+	sm9_fp2_sqr(HH, H);
+	sm9_fp2_mul(HHH, HH, H);
+	sm9_fp2_mul(HH, HH, T->X);
+	sm9_fp2_sqr(T->X, R);
+	sm9_fp2_sub(T->X, T->X, HH);
+	sm9_fp2_sub(T->X, T->X, HH);
+	sm9_fp2_sub(T->X, T->X, HHH);
+	sm9_fp2_sub(HH, HH, T->X);
+	sm9_fp2_mul(HH, HH, R);
+	sm9_fp2_mul(HHH, HHH, T->Y);
+	sm9_fp2_sub(T->Y, HH, HHH);
+}
+
+/*
+ * R-ate pairing, a = 6t + 2 = 0x2400000000215d93e
+ *
+ *	f = f_{a,Q}(P) * l_{aQ,pi1(Q)}(P) * l_{aQ+pi1(Q),-pi2(Q)}(P)
+ *	r = f^((p^12 - 1)/n)
+ *
+ * Q is converted to affine once so that every addition step is a mixed
+ * addition, pi1(Q) and -pi2(Q) are taken directly in affine form. The top
+ * bit of a is consumed by T = Q, the remaining 65 bits give 65 doublings and
+ * 15 additions, plus the two Frobenius additions: SM9_PAIRING_LINES lines.
+ */
+static const sm9_bn_t SM9_LOOP_COUNT = {0x0215d93e, 0x40000000, 0x2, 0, 0, 0, 0, 0};
+#define SM9_LOOP_BITS	66
+
+// 1/c^2 and 1/c^3 for the Z scale c of sm9_twist_point_pi1()
+static const sm9_fp_t SM9_PI1_X = {
+	0x676af24a, 0x0f738991, 0xcaef75e7, 0xa9f02115,
+	0xf2eb2052, 0xe303ab4f, 0x02a3a6f0, 0xb6400000,
+};
+static const sm9_fp_t SM9_PI1_Y = {
+	0x092c756c, 0xefbd7b54, 0x139e9d63, 0x82555233,
+	0x0783182f, 0xe0a8debc, 0x269967c4, 0x49db721a,
+};
+// 1/c^2 for the Z scale c of sm9_twist_point_neg_pi2(), 1/c^3 = -1
+static const sm9_fp_t SM9_PI2_X = {
+	0x676af249, 0x0f738991, 0xcaef75e7, 0xa9f02115,
+	0xf2eb2052, 0xe303ab4f, 0x02a3a6f0, 0xb6400000,
+};
+
+void sm9_pairing_table_init(SM9_PAIRING_TABLE *table, const SM9_TWIST_POINT *Q)
+{
+	SM9_TWIST_POINT _T, *T = &_T;
+	sm9_fp2_t xQ, yQ, x1, y1;
+	size_t n = 0;
 	int i;
 
-	sm9_twist_point_copy(T, Q);
+	if (sm9_twist_point_is_at_infinity(Q)) {
+		table->infinity = 1;
+		return;
+	}
+	table->infinity = 0;
 
-	sm9_fp12_set_one(f_num);
-	sm9_fp12_set_one(f_den);
+	sm9_twist_point_get_xy(Q, xQ, yQ);
+	sm9_fp2_copy(T->X, xQ);
+	sm9_fp2_copy(T->Y, yQ);
+	sm9_fp2_set_one(T->Z);
 
-	for (i = 0; i < strlen(abits); i++) {
+	sm9_miller_dbl_step(table->lines[n++], T);
+	for (i = SM9_LOOP_BITS - 3; i >= 0; i--) {
+		sm9_miller_dbl_step(table->lines[n++], T);
+		if ((SM9_LOOP_COUNT[i/32] >> (i % 32)) & 1) {
+			sm9_miller_add_step(table->lines[n++], T, xQ, yQ);
+		}
+	}
 
-		sm9_fp12_sqr(f_num, f_num);
-		sm9_fp12_sqr(f_den, f_den);
-		sm9_eval_g_tangent(g_num, g_den, T, P);
-		sm9_fp12_mul(f_num, f_num, g_num);
-		sm9_fp12_mul(f_den, f_den, g_den);
+	// Q1 = pi1(Q)
+	sm9_fp2_conjugate(x1, xQ);
+	sm9_fp2_mul_fp(x1, x1, SM9_PI1_X);
+	sm9_fp2_conjugate(y1, yQ);
+	sm9_fp2_mul_fp(y1, y1, SM9_PI1_Y);
+	sm9_miller_add_step(table->lines[n++], T, x1, y1);
 
-		sm9_twist_point_dbl(T, T);
+	// Q2 = -pi2(Q)
+	sm9_fp2_mul_fp(x1, xQ, SM9_PI2_X);
+	sm9_miller_add_step(table->lines[n++], T, x1, yQ);
 
-		if (abits[i] == '1') {
-			sm9_eval_g_line(g_num, g_den, T, Q, P);
-			sm9_fp12_mul(f_num, f_num, g_num);
-			sm9_fp12_mul(f_den, f_den, g_den);
-			sm9_twist_point_add_full(T, T, Q);
+	assert(n == SM9_PAIRING_LINES);
+}
+
+// f = prod f_i, the Miller values of (tables[i], points[i]) sharing the squarings
+static void sm9_miller_loop(sm9_fp12_t f, const SM9_PAIRING_TABLE *tables[], const SM9_POINT *points[], size_t cnt)
+{
+	sm9_fp_t xP[2], yP[2];
+	const SM9_PAIRING_TABLE *tbl[2];
+	size_t n, j, k = 0;
+	int i;
+
+	assert(cnt <= 2);
+	for (j = 0; j < cnt; j++) {
+		if (tables[j]->infinity || sm9_point_is_at_infinity(points[j])) {
+			continue;
+		}
+		tbl[k] = tables[j];
+		sm9_point_get_xy(points[j], xP[k], yP[k]);
+		k++;
+	}
+
+	sm9_fp12_set_one(f);
+	for (j = 0; j < k; j++) {
+		sm9_fp12_mul_line(f, f, tbl[j]->lines[0], xP[j], yP[j]);
+	}
+	n = 1;
+	for (i = SM9_LOOP_BITS - 3; i >= 0; i--) {
+		int add = (SM9_LOOP_COUNT[i/32] >> (i % 32)) & 1;
+
+		sm9_fp12_sqr(f, f);
+		for (j = 0; j < k; j++) {
+			sm9_fp12_mul_line(f, f, tbl[j]->lines[n], xP[j], yP[j]);
+			if (add) {
+				sm9_fp12_mul_line(f, f, tbl[j]->lines[n + 1], xP[j], yP[j]);
+			}
+		}
+		n += 1 + add;
+	}
+	for (; n < SM9_PAIRING_LINES; n++) {
+		for (j = 0; j < k; j++) {
+			sm9_fp12_mul_line(f, f, tbl[j]->lines[n], xP[j], yP[j]);
 		}
 	}
+}
 
-	sm9_twist_point_pi1(Q1, Q);
-	sm9_twist_point_neg_pi2(Q2, Q);
+void sm9_pairing_with_table(sm9_fp12_t r, const SM9_PAIRING_TABLE *table, const SM9_POINT *P)
+{
+	sm9_fp12_t f;
 
-	sm9_eval_g_line(g_num, g_den, T, Q1, P);
-	sm9_fp12_mul(f_num, f_num, g_num);
-	sm9_fp12_mul(f_den, f_den, g_den);
-	sm9_twist_point_add_full(T, T, Q1);
+	sm9_miller_loop(f, &table, &P, 1);
+	sm9_final_exponent(r, f);
+}
 
-	sm9_eval_g_line(g_num, g_den, T, Q2, P);
-	sm9_fp12_mul(f_num, f_num, g_num);
-	sm9_fp12_mul(f_den, f_den, g_den);
-	sm9_twist_point_add_full(T, T, Q2);
+// r = e(P1, Q1) * e(P2, Q2) with a single final exponentiation
+void sm9_pairing2_with_tables(sm9_fp12_t r,
+	const SM9_PAIRING_TABLE *table1, const SM9_POINT *P1,
+	const SM9_PAIRING_TABLE *table2, const SM9_POINT *P2)
+{
+	const SM9_PAIRING_TABLE *tables[2] = { table1, table2 };
+	const SM9_POINT *points[2] = { P1, P2 };
+	sm9_fp12_t f;
 
-	sm9_fp12_inv(f_den, f_den);
-	sm9_fp12_mul(r, f_num, f_den);
+	sm9_miller_loop(f, tables, points, 2);
+	sm9_final_exponent(r, f);
+}
 
-	sm9_final_exponent(r, r);
+void sm9_pairing(sm9_fp12_t r, const SM9_TWIST_POINT *Q, const SM9_POINT *P)
+{
+	SM9_PAIRING_TABLE table;
+
+	sm9_pairing_table_init(&table, Q);
+	sm9_pairing_with_table(r, &table, P);
 }
 
+const SM9_PAIRING_TABLE *sm9_p2_pairing_table_get(void)
+{
+	pthread_once(&sm9_generator_tables_once, sm9_generator_tables_init);
+	return &sm9_p2_pairing_table;
+}
+
+
 void sm9_fn_add(sm9_fn_t r, const sm9_fn_t a, const sm9_fn_t b)
 {
 	sm9_bn_add(r, a, b);
@@ -83,35 +83,29 @@ int sm9_sign_update(SM9_SIGN_CTX *ctx, const uint8_t *data, size_t datalen)
 	return 1;
 }
 
-int sm9_sign_finish(SM9_SIGN_CTX *ctx, const SM9_SIGN_KEY *key, uint8_t *sig, size_t *siglen)
-{
-	SM9_SIGNATURE signature;
-
-	if (sm9_do_sign(key, &ctx->sm3_ctx, &signature) != 1) {
-		error_print();
-		return -1;
-	}
-	*siglen = 0;
-	if (sm9_signature_to_der(&signature, &sig, siglen) != 1) {
-		error_print();
-		return -1;
-	}
-	return 1;
-}
-
-int sm9_do_sign(const SM9_SIGN_KEY *key, const SM3_CTX *sm3_ctx, SM9_SIGNATURE *sig)
+static int sm9_do_sign_ex(const SM9_SIGN_KEY *key, const SM9_MASTER_PRECOMP *pre,
+	const SM3_CTX *sm3_ctx, SM9_SIGNATURE *sig)
 {
 	sm9_fn_t r;
 	sm9_fp12_t g;
+	sm9_fp12_t w;
 	uint8_t wbuf[32 * 12];
-	SM3_CTX ctx = *sm3_ctx;
+	SM3_CTX ctx;
 	SM3_CTX tmp_ctx;
 	uint8_t ct1[4] = {0,0,0,1};
 	uint8_t ct2[4] = {0,0,0,2};
 	uint8_t Ha[64];
 
-	// A1: g = e(P1, Ppubs)
-	sm9_pairing(g, &key->Ppubs, SM9_P1);
+	if (pre) {
+		if (pre->hid != SM9_HID_SIGN
+			|| sm9_twist_point_equ(&pre->Ppubs, &key->Ppubs) != 1) {
+			error_print();
+			return -1;
+		}
+	} else {
+		// A1: g = e(P1, Ppubs)
+		sm9_pairing(g, &key->Ppubs, SM9_P1);
+	}
 
 	do {
 		// A2: rand r in [1, N-1]
@@ -122,10 +116,15 @@ int sm9_do_sign(const SM9_SIGN_KEY *key, const SM3_CTX *sm3_ctx, SM9_SIGNATURE *
 		//sm9_fn_from_hex(r, "00033C8616B06704813203DFD00965022ED15975C662337AED648835DC4B1CBE"); // for testing
 
 		// A3: w = g^r
-		sm9_fp12_pow(g, g, r);
-		sm9_fp12_to_bytes(g, wbuf);
+		if (pre) {
+			sm9_fp12_pow_table(w, r, &pre->g_table);
+		} else {
+			sm9_fp12_cyclotomic_pow(w, g, r);
+		}
+		sm9_fp12_to_bytes(w, wbuf);
 
 		// A4: h = H2(M || w, N)
+		ctx = *sm3_ctx;
 		sm3_update(&ctx, wbuf, sizeof(wbuf));
 		tmp_ctx = ctx;
 		sm3_update(&ctx, ct1, sizeof(ct1));
@@ -143,49 +142,78 @@ int sm9_do_sign(const SM9_SIGN_KEY *key, const SM3_CTX *sm3_ctx, SM9_SIGNATURE *
 	sm9_point_mul(&sig->S, r, &key->ds);
 
 	gmssl_secure_clear(&r, sizeof(r));
-	gmssl_secure_clear(&g, sizeof(g));
+	gmssl_secure_clear(&w, sizeof(w));
 	gmssl_secure_clear(wbuf, sizeof(wbuf));
+	gmssl_secure_clear(&ctx, sizeof(ctx));
 	gmssl_secure_clear(&tmp_ctx, sizeof(tmp_ctx));
 	gmssl_secure_clear(Ha, sizeof(Ha));
 
 	return 1;
 }
 
-int sm9_verify_init(SM9_SIGN_CTX *ctx)
+int sm9_do_sign(const SM9_SIGN_KEY *key, const SM3_CTX *sm3_ctx, SM9_SIGNATURE *sig)
 {
-	const uint8_t prefix[1] = { SM9_HASH2_PREFIX };
-	sm3_init(&ctx->sm3_ctx);
-	sm3_update(&ctx->sm3_ctx, prefix, sizeof(prefix));
-	return 1;
+	return sm9_do_sign_ex(key, NULL, sm3_ctx, sig);
 }
 
-int sm9_verify_update(SM9_SIGN_CTX *ctx, const uint8_t *data, size_t datalen)
+int sm9_do_sign_precomp(const SM9_SIGN_KEY *key, const SM9_MASTER_PRECOMP *pre,
+	const SM3_CTX *sm3_ctx, SM9_SIGNATURE *sig)
 {
-	sm3_update(&ctx->sm3_ctx, data, datalen);
-	return 1;
+	if (!pre) {
+		error_print();
+		return -1;
+	}
+	return sm9_do_sign_ex(key, pre, sm3_ctx, sig);
 }
 
-int sm9_verify_finish(SM9_SIGN_CTX *ctx, const uint8_t *sig, size_t siglen,
-	const SM9_SIGN_MASTER_KEY *mpk, const char *id, size_t idlen)
+static int sm9_sign_finish_ex(SM9_SIGN_CTX *ctx, const SM9_SIGN_KEY *key,
+	const SM9_MASTER_PRECOMP *pre, uint8_t *sig, size_t *siglen)
 {
-	int ret;
 	SM9_SIGNATURE signature;
 
-	if (sm9_signature_from_der(&signature, &sig, &siglen) != 1
-		|| asn1_length_is_zero(siglen) != 1) {
+	if (sm9_do_sign_ex(key, pre, &ctx->sm3_ctx, &signature) != 1) {
+		error_print();
+		return -1;
+	}
+	*siglen = 0;
+	if (sm9_signature_to_der(&signature, &sig, siglen) != 1) {
 		error_print();
 		return -1;
 	}
+	return 1;
+}
+
+int sm9_sign_finish(SM9_SIGN_CTX *ctx, const SM9_SIGN_KEY *key, uint8_t *sig, size_t *siglen)
+{
+	return sm9_sign_finish_ex(ctx, key, NULL, sig, siglen);
+}
 
-	if ((ret = sm9_do_verify(mpk, id, idlen, &ctx->sm3_ctx, &signature)) < 0) {
+int sm9_sign_finish_precomp(SM9_SIGN_CTX *ctx, const SM9_SIGN_KEY *key,
+	const SM9_MASTER_PRECOMP *pre, uint8_t *sig, size_t *siglen)
+{
+	if (!pre) {
 		error_print();
 		return -1;
 	}
-	return ret;
+	return sm9_sign_finish_ex(ctx, key, pre, sig, siglen);
 }
 
-int sm9_do_verify(const SM9_SIGN_MASTER_KEY *mpk, const char *id, size_t idlen,
-	const SM3_CTX *sm3_ctx, const SM9_SIGNATURE *sig)
+int sm9_verify_init(SM9_SIGN_CTX *ctx)
+{
+	const uint8_t prefix[1] = { SM9_HASH2_PREFIX };
+	sm3_init(&ctx->sm3_ctx);
+	sm3_update(&ctx->sm3_ctx, prefix, sizeof(prefix));
+	return 1;
+}
+
+int sm9_verify_update(SM9_SIGN_CTX *ctx, const uint8_t *data, size_t datalen)
+{
+	sm3_update(&ctx->sm3_ctx, data, datalen);
+	return 1;
+}
+
+static int sm9_do_verify_ex(const SM9_TWIST_POINT *Ppubs, const SM9_MASTER_PRECOMP *pre,
+	const char *id, size_t idlen, const SM3_CTX *sm3_ctx, const SM9_SIGNATURE *sig)
 {
 	sm9_fn_t h1;
 	sm9_fn_t h2;
@@ -194,6 +222,7 @@ int sm9_do_verify(const SM9_SIGN_MASTER_KEY *mpk, const char *id, size_t idlen,
 	sm9_fp12_t u;
 	sm9_fp12_t w;
 	SM9_TWIST_POINT P;
+	SM9_POINT S;
 	uint8_t wbuf[32 * 12];
 	SM3_CTX ctx = *sm3_ctx;
 	SM3_CTX tmp_ctx;
@@ -205,21 +234,37 @@ int sm9_do_verify(const SM9_SIGN_MASTER_KEY *mpk, const char *id, size_t idlen,
 
 	// B2: check S in G1
 
-	// B3: g = e(P1, Ppubs)
-	sm9_pairing(g, &mpk->Ppubs, SM9_P1);
-
-	// B4: t = g^h
-	sm9_fp12_pow(t, g, sig->h);
+	if (pre) {
+		if (pre->hid != SM9_HID_SIGN) {
+			error_print();
+			return -1;
+		}
+		// B3, B4: t = g^h, g = e(P1, Ppubs)
+		sm9_fp12_pow_table(t, sig->h, &pre->g_table);
+	} else {
+		// B3: g = e(P1, Ppubs)
+		sm9_pairing(g, Ppubs, SM9_P1);
+
+		// B4: t = g^h
+		sm9_fp12_cyclotomic_pow(t, g, sig->h);
+	}
 
 	// B5: h1 = H1(ID || hid, N)
 	sm9_hash1(h1, id, idlen, SM9_HID_SIGN);
 
-	// B6: P = h1 * P2 + Ppubs
-	sm9_twist_point_mul_generator(&P, h1);
-	sm9_twist_point_add_full(&P, &P, &mpk->Ppubs);
-
-	// B7: u = e(S, P)
-	sm9_pairing(u, &P, &sig->S);
+	if (pre) {
+		// B6, B7: u = e(S, h1 * P2 + Ppubs) = e(h1 * S, P2) * e(S, Ppubs)
+		sm9_point_mul(&S, h1, &sig->S);
+		sm9_pairing2_with_tables(u, sm9_p2_pairing_table_get(), &S,
+			&pre->Ppubs_lines, &sig->S);
+	} else {
+		// B6: P = h1 * P2 + Ppubs
+		sm9_twist_point_mul_generator(&P, h1);
+		sm9_twist_point_add_full(&P, &P, Ppubs);
+
+		// B7: u = e(S, P)
+		sm9_pairing(u, &P, &sig->S);
+	}
 
 	// B8: w = u * t
 	sm9_fp12_mul(w, u, t);
@@ -240,19 +285,85 @@ int sm9_do_verify(const SM9_SIGN_MASTER_KEY *mpk, const char *id, size_t idlen,
 	return 1;
 }
 
-int sm9_kem_encrypt(const SM9_ENC_MASTER_KEY *mpk, const char *id, size_t idlen,
-	size_t klen, uint8_t *kbuf, SM9_POINT *C)
+int sm9_do_verify(const SM9_SIGN_MASTER_KEY *mpk, const char *id, size_t idlen,
+	const SM3_CTX *sm3_ctx, const SM9_SIGNATURE *sig)
+{
+	return sm9_do_verify_ex(&mpk->Ppubs, NULL, id, idlen, sm3_ctx, sig);
+}
+
+int sm9_do_verify_precomp(const SM9_MASTER_PRECOMP *pre, const char *id, size_t idlen,
+	const SM3_CTX *sm3_ctx, const SM9_SIGNATURE *sig)
+{
+	if (!pre) {
+		error_print();
+		return -1;
+	}
+	return sm9_do_verify_ex(&pre->Ppubs, pre, id, idlen, sm3_ctx, sig);
+}
+
+static int sm9_verify_finish_ex(SM9_SIGN_CTX *ctx, const uint8_t *sig, size_t siglen,
+	const SM9_TWIST_POINT *Ppubs, const SM9_MASTER_PRECOMP *pre, const char *id, size_t idlen)
+{
+	int ret;
+	SM9_SIGNATURE signature;
+
+	if (sm9_signature_from_der(&signature, &sig, &siglen) != 1
+		|| asn1_length_is_zero(siglen) != 1) {
+		error_print();
+		return -1;
+	}
+
+	if ((ret = sm9_do_verify_ex(Ppubs, pre, id, idlen, &ctx->sm3_ctx, &signature)) < 0) {
+		error_print();
+		return -1;
+	}
+	return ret;
+}
+
+int sm9_verify_finish(SM9_SIGN_CTX *ctx, const uint8_t *sig, size_t siglen,
+	const SM9_SIGN_MASTER_KEY *mpk, const char *id, size_t idlen)
+{
+	return sm9_verify_finish_ex(ctx, sig, siglen, &mpk->Ppubs, NULL, id, idlen);
+}
+
+int sm9_verify_finish_precomp(SM9_SIGN_CTX *ctx, const uint8_t *sig, size_t siglen,
+	const SM9_MASTER_PRECOMP *pre, const char *id, size_t idlen)
 {
+	if (!pre) {
+		error_print();
+		return -1;
+	}
+	return sm9_verify_finish_ex(ctx, sig, siglen, &pre->Ppubs, pre, id, idlen);
+}
+
+static int sm9_kem_encrypt_ex(const SM9_POINT *Ppube, const SM9_MASTER_PRECOMP *pre,
+	const char *id, size_t idlen, size_t klen, uint8_t *kbuf, SM9_POINT *C)
+{
+	sm9_fn_t h1;
 	sm9_fn_t r;
+	sm9_fn_t t;
+	sm9_fp12_t g;
 	sm9_fp12_t w;
+	SM9_POINT Q;
+	SM9_POINT T;
 	uint8_t wbuf[32 * 12];
 	uint8_t cbuf[65];
 	SM3_KDF_CTX kdf_ctx;
 
+	if (pre && pre->hid != SM9_HID_ENC) {
+		error_print();
+		return -1;
+	}
+
 	// A1: Q = H1(ID||hid,N) * P1 + Ppube
-	sm9_hash1(r, id, idlen, SM9_HID_ENC);
-	sm9_point_mul(C, r, SM9_P1);
-	sm9_point_add(C, C, &mpk->Ppube);
+	sm9_hash1(h1, id, idlen, SM9_HID_ENC);
+	if (!pre) {
+		sm9_point_mul_generator(&Q, h1);
+		sm9_point_add(&Q, &Q, Ppube);
+
+		// A4: g = e(Ppube, P2)
+		sm9_pairing(g, SM9_P2, Ppube);
+	}
 
 	do {
 		// A2: rand r in [1, N-1]
@@ -262,14 +373,23 @@ int sm9_kem_encrypt(const SM9_ENC_MASTER_KEY *mpk, const char *id, size_t idlen,
 		}
 
 		// A3: C1 = r * Q
-		sm9_point_mul(C, r, C);
+		if (pre) {
+			// r * Q = (r * h1) * P1 + r * Ppube, both fixed-base
+			sm9_fn_mul(t, r, h1);
+			sm9_point_mul_generator(C, t);
+			sm9_point_mul_table(&T, r, &pre->Ppube_table);
+			sm9_point_add(C, C, &T);
+		} else {
+			sm9_point_mul(C, r, &Q);
+		}
 		sm9_point_to_uncompressed_octets(C, cbuf);
 
-		// A4: g = e(Ppube, P2)
-		sm9_pairing(w, SM9_P2, &mpk->Ppube);
-
 		// A5: w = g^r
-		sm9_fp12_pow(w, w, r);
+		if (pre) {
+			sm9_fp12_pow_table(w, r, &pre->g_table);
+		} else {
+			sm9_fp12_cyclotomic_pow(w, g, r);
+		}
 		sm9_fp12_to_bytes(w, wbuf);
 
 		// A6: K = KDF(C || w || ID_B, klen), if K == 0, goto A2
@@ -282,6 +402,7 @@ int sm9_kem_encrypt(const SM9_ENC_MASTER_KEY *mpk, const char *id, size_t idlen,
 	} while (mem_is_zero(kbuf, klen) == 1);
 
 	gmssl_secure_clear(&r, sizeof(r));
+	gmssl_secure_clear(&t, sizeof(t));
 	gmssl_secure_clear(&w, sizeof(w));
 	gmssl_secure_clear(wbuf, sizeof(wbuf));
 	gmssl_secure_clear(&kdf_ctx, sizeof(kdf_ctx));
@@ -290,6 +411,22 @@ int sm9_kem_encrypt(const SM9_ENC_MASTER_KEY *mpk, const char *id, size_t idlen,
 	return 1;
 }
 
+int sm9_kem_encrypt(const SM9_ENC_MASTER_KEY *mpk, const char *id, size_t idlen,
+	size_t klen, uint8_t *kbuf, SM9_POINT *C)
+{
+	return sm9_kem_encrypt_ex(&mpk->Ppube, NULL, id, idlen, klen, kbuf, C);
+}
+
+int sm9_kem_encrypt_precomp(const SM9_MASTER_PRECOMP *pre, const char *id, size_t idlen,
+	size_t klen, uint8_t *kbuf, SM9_POINT *C)
+{
+	if (!pre) {
+		error_print();
+		return -1;
+	}
+	return sm9_kem_encrypt_ex(&pre->Ppube, pre, id, idlen, klen, kbuf, C);
+}
+
 int sm9_kem_decrypt(const SM9_ENC_KEY *key, const char *id, size_t idlen, const SM9_POINT *C,
 	size_t klen, uint8_t *kbuf)
 {
@@ -325,14 +462,14 @@ int sm9_kem_decrypt(const SM9_ENC_KEY *key, const char *id, size_t idlen, const
 	return 1;
 }
 
-int sm9_do_encrypt(const SM9_ENC_MASTER_KEY *mpk, const char *id, size_t idlen,
-	const uint8_t *in, size_t inlen,
+static int sm9_do_encrypt_ex(const SM9_POINT *Ppube, const SM9_MASTER_PRECOMP *pre,
+	const char *id, size_t idlen, const uint8_t *in, size_t inlen,
 	SM9_POINT *C1, uint8_t *c2, uint8_t c3[SM3_HMAC_SIZE])
 {
 	SM3_HMAC_CTX hmac_ctx;
 	uint8_t K[SM9_MAX_PLAINTEXT_SIZE + 32];
 
-	if (sm9_kem_encrypt(mpk, id, idlen, sizeof(K), K, C1) != 1) {
+	if (sm9_kem_encrypt_ex(Ppube, pre, id, idlen, sizeof(K), K, C1) != 1) {
 		error_print();
 		return -1;
 	}
@@ -343,9 +480,17 @@ int sm9_do_encrypt(const SM9_ENC_MASTER_KEY *mpk, const char *id, size_t idlen,
 	sm3_hmac_update(&hmac_ctx, c2, inlen);
 	sm3_hmac_finish(&hmac_ctx, c3);
 	gmssl_secure_clear(&hmac_ctx, sizeof(hmac_ctx));
+	gmssl_secure_clear(K, sizeof(K));
 	return 1;
 }
 
+int sm9_do_encrypt(const SM9_ENC_MASTER_KEY *mpk, const char *id, size_t idlen,
+	const uint8_t *in, size_t inlen,
+	SM9_POINT *C1, uint8_t *c2, uint8_t c3[SM3_HMAC_SIZE])
+{
+	return sm9_do_encrypt_ex(&mpk->Ppube, NULL, id, idlen, in, inlen, C1, c2, c3);
+}
+
 int sm9_do_decrypt(const SM9_ENC_KEY *key, const char *id, size_t idlen,
 	const SM9_POINT *C1, const uint8_t *c2, size_t c2len, const uint8_t c3[SM3_HMAC_SIZE],
 	uint8_t *out)
@@ -459,8 +604,8 @@ int sm9_ciphertext_from_der(SM9_POINT *C1, const uint8_t **c2, size_t *c2len,
 	return 1;
 }
 
-int sm9_encrypt(const SM9_ENC_MASTER_KEY *mpk, const char *id, size_t idlen,
-	const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen)
+static int sm9_encrypt_ex(const SM9_POINT *Ppube, const SM9_MASTER_PRECOMP *pre,
+	const char *id, size_t idlen, const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen)
 {
 	SM9_POINT C1;
 	uint8_t c2[SM9_MAX_PLAINTEXT_SIZE];
@@ -471,7 +616,7 @@ int sm9_encrypt(const SM9_ENC_MASTER_KEY *mpk, const char *id, size_t idlen,
 		return -1;
 	}
 
-	if (sm9_do_encrypt(mpk, id, idlen, in, inlen, &C1, c2, c3) != 1) {
+	if (sm9_do_encrypt_ex(Ppube, pre, id, idlen, in, inlen, &C1, c2, c3) != 1) {
 		error_print();
 		return -1;
 	}
@@ -483,6 +628,22 @@ int sm9_encrypt(const SM9_ENC_MASTER_KEY *mpk, const char *id, size_t idlen,
 	return 1;
 }
 
+int sm9_encrypt(const SM9_ENC_MASTER_KEY *mpk, const char *id, size_t idlen,
+	const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen)
+{
+	return sm9_encrypt_ex(&mpk->Ppube, NULL, id, idlen, in, inlen, out, outlen);
+}
+
+int sm9_encrypt_precomp(const SM9_MASTER_PRECOMP *pre, const char *id, size_t idlen,
+	const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen)
+{
+	if (!pre) {
+		error_print();
+		return -1;
+	}
+	return sm9_encrypt_ex(&pre->Ppube, pre, id, idlen, in, inlen, out, outlen);
+}
+
 int sm9_decrypt(const SM9_ENC_KEY *key, const char *id, size_t idlen,
 	const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen)
 {
@@ -506,3 +667,37 @@ int sm9_decrypt(const SM9_ENC_KEY *key, const char *id, size_t idlen,
 	}
 	return 1;
 }
+
+int sm9_sign_master_precomp_init(SM9_MASTER_PRECOMP *pre, const SM9_SIGN_MASTER_KEY *mpk)
+{
+	if (!pre || !mpk) {
+		error_print();
+		return -1;
+	}
+	memset(pre, 0, sizeof(*pre));
+	pre->hid = SM9_HID_SIGN;
+	sm9_twist_point_copy(&pre->Ppubs, &mpk->Ppubs);
+
+	// g = e(P1, Ppubs), the Miller lines of Ppubs are kept for verification
+	sm9_pairing_table_init(&pre->Ppubs_lines, &mpk->Ppubs);
+	sm9_pairing_with_table(pre->g, &pre->Ppubs_lines, SM9_P1);
+	sm9_fp12_table_init(&pre->g_table, pre->g);
+	return 1;
+}
+
+int sm9_enc_master_precomp_init(SM9_MASTER_PRECOMP *pre, const SM9_ENC_MASTER_KEY *mpk)
+{
+	if (!pre || !mpk) {
+		error_print();
+		return -1;
+	}
+	memset(pre, 0, sizeof(*pre));
+	pre->hid = SM9_HID_ENC;
+	sm9_point_copy(&pre->Ppube, &mpk->Ppube);
+	sm9_point_table_init(&pre->Ppube_table, &mpk->Ppube);
+
+	// g = e(Ppube, P2)
+	sm9_pairing_with_table(pre->g, sm9_p2_pairing_table_get(), &mpk->Ppube);
+	sm9_fp12_table_init(&pre->g_table, pre->g);
+	return 1;
+}
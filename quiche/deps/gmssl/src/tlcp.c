@@ -265,12 +265,18 @@ int tlcp_do_connect(TLS_CONNECT *conn)
 	if (conn->ca_certs_len) {
 		// 只有提供了CA证书才验证服务器证书链
 		// FIXME: 逻辑需要再检查
-		if (x509_certs_verify_tlcp(conn->server_certs, conn->server_certs_len,
-			conn->ca_certs, conn->ca_certs_len, depth, &verify_result) != 1) {
+		if (x509_store_verify_tlcp(conn->store, conn->server_certs, conn->server_certs_len,
+			depth, &verify_result) != 1) {
 			error_print();
 			tls_send_alert(conn, alert);
 			goto end;
 		}
+		if (x509_certs_check_revocation(conn->server_certs, conn->server_certs_len,
+			conn->crls, conn->crls_cnt) != 1) {
+			error_print();
+			tls_send_alert(conn, TLS_alert_certificate_revoked);
+			goto end;
+		}
 	}
 
 	// recv ServerKeyExchange
@@ -444,7 +450,7 @@ int tlcp_do_connect(TLS_CONNECT *conn)
 	if (conn->client_certs_len) {
 		tls_trace("send CertificateVerify\n");
 		uint8_t sigbuf[SM2_MAX_SIGNATURE_SIZE];
-		if (sm2_sign_finish(&sign_ctx, sigbuf, &siglen) != 1
+		if (tls_sm2_sign_finish(&sign_ctx, conn->sign_offload, sigbuf, &siglen) != 1
 			|| tls_record_set_handshake_certificate_verify(record, &recordlen, sigbuf, siglen) != 1) {
 			error_print();
 			tls_send_alert(conn, TLS_alert_internal_error);
@@ -737,7 +743,7 @@ int tlcp_do_accept(TLS_CONNECT *conn)
 		|| sm2_sign_update(&sign_ctx, server_random, 32) != 1
 		|| sm2_sign_update(&sign_ctx, server_enc_cert_lenbuf, 3) != 1
 		|| sm2_sign_update(&sign_ctx, server_enc_cert, server_enc_cert_len) != 1
-		|| sm2_sign_finish(&sign_ctx, sigbuf, &siglen) != 1) {
+		|| tls_sm2_sign_finish(&sign_ctx, conn->sign_offload, sigbuf, &siglen) != 1) {
 		error_print();
 		tls_send_alert(conn, TLS_alert_internal_error);
 		goto end;
@@ -810,12 +816,18 @@ int tlcp_do_accept(TLS_CONNECT *conn)
 			tls_send_alert(conn, TLS_alert_unexpected_message);
 			goto end;
 		}
-		if (x509_certs_verify(conn->client_certs, conn->client_certs_len,
-			conn->ca_certs, conn->ca_certs_len, verify_depth, &verify_result) != 1) {
+		if (x509_store_verify(conn->store, conn->client_certs, conn->client_certs_len,
+			verify_depth, &verify_result) != 1) {
 			error_print();
 			tls_send_alert(conn, TLS_alert_bad_certificate);
 			goto end;
 		}
+		if (x509_certs_check_revocation(conn->client_certs, conn->client_certs_len,
+			conn->crls, conn->crls_cnt) != 1) {
+			error_print();
+			tls_send_alert(conn, TLS_alert_certificate_revoked);
+			goto end;
+		}
 		sm3_update(&sm3_ctx, record + 5, recordlen - 5);
 		tls_client_verify_update(&client_verify_ctx, record + 5, recordlen - 5);
 	}
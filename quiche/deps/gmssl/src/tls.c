@@ -34,6 +34,7 @@
 #include <gmssl/sm2.h>
 #include <gmssl/sm3.h>
 #include <gmssl/sm4.h>
+#include <gmssl/sm4_cbc_sm3_hmac.h>
 #include <gmssl/pem.h>
 #include <gmssl/tls.h>
 
@@ -283,7 +284,9 @@ int tls_cbc_encrypt(const SM3_HMAC_CTX *inited_hmac_ctx, const SM4_KEY *enc_key,
 {
 	SM3_HMAC_CTX hmac_ctx;
 	uint8_t last_blocks[32 + 16] = {0};
-	uint8_t *mac, *padding, *iv;
+	uint8_t iv[16];
+	uint8_t *mac, *padding;
+	size_t lead, nchunks = 0, done;
 	int rem, padding_len;
 	int i;
 
@@ -300,14 +303,39 @@ int tls_cbc_encrypt(const SM3_HMAC_CTX *inited_hmac_ctx, const SM4_KEY *enc_key,
 		return -1;
 	}
 
-	rem = (inlen + 32) % 16;
-	memcpy(last_blocks, in + inlen - rem, rem);
-	mac = last_blocks + rem;
+	if (rand_bytes(out, 16) != 1) {
+		error_print();
+		return -1;
+	}
+	memcpy(iv, out, 16);
+	out += 16;
 
 	memcpy(&hmac_ctx, inited_hmac_ctx, sizeof(SM3_HMAC_CTX));
 	sm3_hmac_update(&hmac_ctx, seq_num, 8);
 	sm3_hmac_update(&hmac_ctx, header, 5);
-	sm3_hmac_update(&hmac_ctx, in, inlen);
+
+	// Fill the pending SM3 block so that the rest of the data can be MACed
+	// in the same pass as it is CBC encrypted. The CBC stream runs `lead`
+	// bytes behind the SM3 stream, both stay inside `in`.
+	lead = (SM3_BLOCK_SIZE - hmac_ctx.sm3_ctx.num) % SM3_BLOCK_SIZE;
+	if (lead > inlen) {
+		lead = inlen;
+	}
+	sm3_hmac_update(&hmac_ctx, in, lead);
+	if (hmac_ctx.sm3_ctx.num == 0) {
+		nchunks = (inlen - lead) / SM4_CBC_SM3_CHUNK_SIZE;
+	}
+	if (nchunks) {
+		sm4_cbc_encrypt_sm3_compress(enc_key, iv, in, out,
+			hmac_ctx.sm3_ctx.digest, in + lead, nchunks);
+		hmac_ctx.sm3_ctx.nblocks += nchunks;
+	}
+	done = nchunks * SM4_CBC_SM3_CHUNK_SIZE;
+	sm3_hmac_update(&hmac_ctx, in + lead + done, inlen - lead - done);
+
+	rem = (inlen + 32) % 16;
+	memcpy(last_blocks, in + inlen - rem, rem);
+	mac = last_blocks + rem;
 	sm3_hmac_finish(&hmac_ctx, mac);
 
 	padding = mac + 32;
@@ -316,35 +344,44 @@ int tls_cbc_encrypt(const SM3_HMAC_CTX *inited_hmac_ctx, const SM4_KEY *enc_key,
 		padding[i] = padding_len;
 	}
 
-	iv = out;
-	if (rand_bytes(iv, 16) != 1) {
-		error_print();
-		return -1;
-	}
-	out += 16;
-
-	if (inlen >= 16) {
-		sm4_cbc_encrypt(enc_key, iv, in, inlen/16, out);
-		out += inlen - rem;
-		iv = out - 16;
+	if (inlen - rem > done) {
+		sm4_cbc_encrypt(enc_key, iv, in + done, (inlen - rem - done)/16, out + done);
+		memcpy(iv, out + inlen - rem - 16, 16);
 	}
-	sm4_cbc_encrypt(enc_key, iv, last_blocks, sizeof(last_blocks)/16, out);
+	sm4_cbc_encrypt(enc_key, iv, last_blocks, sizeof(last_blocks)/16, out + inlen - rem);
 	*outlen = 16 + inlen - rem + sizeof(last_blocks);
 	return 1;
 }
 
+// all-ones if a < b, operands must be less than 2^(bits-1)
+static unsigned int tls_ct_lt(size_t a, size_t b)
+{
+	return 0 - (unsigned int)((a - b) >> (sizeof(size_t) * 8 - 1));
+}
+
+// all-ones if a == b
+static unsigned int tls_ct_eq(size_t a, size_t b)
+{
+	size_t x = a ^ b;
+	return 0 - (unsigned int)((~x & (x - 1)) >> (sizeof(size_t) * 8 - 1));
+}
+
+// MAC and the longest padding: 32 + 256 bytes
+#define TLS_CBC_MAX_TAIL_SIZE	288
+
 int tls_cbc_decrypt(const SM3_HMAC_CTX *inited_hmac_ctx, const SM4_KEY *dec_key,
 	const uint8_t seq_num[8], const uint8_t enced_header[5],
 	const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen)
 {
 	SM3_HMAC_CTX hmac_ctx;
-	const uint8_t *iv;
-	const uint8_t *padding;
-	const uint8_t *mac;
+	uint8_t iv[16];
 	uint8_t header[5];
-	int padding_len;
 	uint8_t hmac[32];
-	int i;
+	size_t tail, head, len;
+	size_t lead, lag, pre = 0, nchunks = 0, nblocks, done;
+	size_t padding_len;
+	unsigned int good;
+	size_t i;
 
 	if (!inited_hmac_ctx || !dec_key || !seq_num || !enced_header || !in || !inlen || !out || !outlen) {
 		error_print();
@@ -357,43 +394,81 @@ int tls_cbc_decrypt(const SM3_HMAC_CTX *inited_hmac_ctx, const SM4_KEY *dec_key,
 		return -1;
 	}
 
-	iv = in;
+	memcpy(iv, in, 16);
 	in += 16;
 	inlen -= 16;
 
-	sm4_cbc_decrypt(dec_key, iv, in, inlen/16, out);
+	// The data length is only known from the padding, so the blocks that may
+	// hold the MAC and the padding are decrypted first.
+	tail = inlen < TLS_CBC_MAX_TAIL_SIZE ? inlen : TLS_CBC_MAX_TAIL_SIZE;
+	head = inlen - tail;
+	sm4_cbc_decrypt(dec_key, head ? in + head - 16 : iv, in + head, tail/16, out + head);
 
+	// Padding check without data-dependent branches or early exit. A bad
+	// padding is treated as empty padding and reported with the MAC failure.
 	padding_len = out[inlen - 1];
-	padding = out + inlen - padding_len - 1;
-	if (padding < out + 32) {
-		error_print();
-		return -1;
-	}
-	for (i = 0; i < padding_len; i++) {
-		if (padding[i] != padding_len) {
-			error_puts("tls ciphertext cbc-padding check failure");
-			return -1;
-		}
+	good = ~tls_ct_lt(inlen, padding_len + 1 + 32);
+	for (i = 1; i < tail && i < 256; i++) {
+		unsigned int in_padding = tls_ct_lt(i, padding_len + 1);
+		good &= ~in_padding | tls_ct_eq(out[inlen - 1 - i], padding_len);
 	}
-
-	*outlen = inlen - 32 - padding_len - 1;
+	padding_len &= (size_t)good;
+	len = inlen - 32 - padding_len - 1;
 
 	header[0] = enced_header[0];
 	header[1] = enced_header[1];
 	header[2] = enced_header[2];
-	header[3] = (*outlen) >> 8;
-	header[4] = (*outlen);
-	mac = padding - 32;
+	header[3] = len >> 8;
+	header[4] = len;
 
 	memcpy(&hmac_ctx, inited_hmac_ctx, sizeof(SM3_HMAC_CTX));
 	sm3_hmac_update(&hmac_ctx, seq_num, 8);
 	sm3_hmac_update(&hmac_ctx, header, 5);
-	sm3_hmac_update(&hmac_ctx, out, *outlen);
+
+	// Decrypt the head chunk by chunk and MAC the plaintext of an earlier
+	// chunk in the same pass. SM3 lags `lag` chunks behind so that its input
+	// block is fully decrypted before it is compressed.
+	lead = (SM3_BLOCK_SIZE - hmac_ctx.sm3_ctx.num) % SM3_BLOCK_SIZE;
+	lag = 1 + (lead + SM3_BLOCK_SIZE - 1) / SM3_BLOCK_SIZE;
+	nblocks = len >= lead ? (len - lead) / SM3_BLOCK_SIZE : 0;
+	if (head / SM4_CBC_SM3_CHUNK_SIZE > lag && nblocks) {
+		pre = lag;
+		nchunks = head / SM4_CBC_SM3_CHUNK_SIZE - lag;
+		if (nchunks > nblocks) {
+			nchunks = nblocks;
+		}
+	}
+
+	done = pre * SM4_CBC_SM3_CHUNK_SIZE;
+	if (done) {
+		sm4_cbc_decrypt(dec_key, iv, in, done/16, out);
+		memcpy(iv, in + done - 16, 16);
+		sm3_hmac_update(&hmac_ctx, out, lead);
+	}
+	if (nchunks) {
+		sm4_cbc_decrypt_sm3_compress(dec_key, iv, in + done, out + done,
+			hmac_ctx.sm3_ctx.digest, out + lead, nchunks);
+		hmac_ctx.sm3_ctx.nblocks += nchunks;
+		done += nchunks * SM4_CBC_SM3_CHUNK_SIZE;
+	}
+	if (head > done) {
+		sm4_cbc_decrypt(dec_key, iv, in + done, (head - done)/16, out + done);
+	}
+	if (pre) {
+		done = lead + nchunks * SM3_BLOCK_SIZE;
+		sm3_hmac_update(&hmac_ctx, out + done, len - done);
+	} else {
+		sm3_hmac_update(&hmac_ctx, out, len);
+	}
 	sm3_hmac_finish(&hmac_ctx, hmac);
-	if (gmssl_secure_memcmp(mac, hmac, sizeof(hmac)) != 0) {
-		error_puts("tls ciphertext mac check failure\n");
+
+	good &= tls_ct_eq(gmssl_secure_memcmp(out + len, hmac, sizeof(hmac)), 0);
+	gmssl_secure_clear(hmac, sizeof(hmac));
+	if (!good) {
+		error_puts("tls ciphertext cbc-padding or mac check failure\n");
 		return -1;
 	}
+	*outlen = len;
 	return 1;
 }
 
@@ -546,8 +621,31 @@ int tls_cert_type_from_oid(int oid)
 	return 0;
 }
 
+int tls_sm2_sign_finish(SM2_SIGN_CTX *ctx, SDF_ASYNC *sign_offload, uint8_t *sig, size_t *siglen)
+{
+	uint8_t dgst[SM3_DIGEST_SIZE];
+
+	if (!sign_offload) {
+		return sm2_sign_finish(ctx, sig, siglen);
+	}
+	sm3_finish(&ctx->sm3_ctx, dgst);
+	if (sdf_async_sign(sign_offload, dgst, sig, siglen) != 1) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
 // 这两个函数没有对应的TLCP版本
-int tls_sign_server_ecdh_params(const SM2_KEY *server_sign_key,
+int tls_ecdhe_key_generate(SM2_KEY_POOL *ecdhe_pool, SM2_KEY *key)
+{
+	if (ecdhe_pool) {
+		return sm2_key_pool_get(ecdhe_pool, key);
+	}
+	return sm2_key_generate(key);
+}
+
+int tls_sign_server_ecdh_params(const SM2_KEY *server_sign_key, SDF_ASYNC *sign_offload,
 	const uint8_t client_random[32], const uint8_t server_random[32],
 	int curve, const SM2_POINT *point, uint8_t *sig, size_t *siglen)
 {
@@ -569,8 +667,10 @@ int tls_sign_server_ecdh_params(const SM2_KEY *server_sign_key,
 	sm2_sign_update(&sign_ctx, client_random, 32);
 	sm2_sign_update(&sign_ctx, server_random, 32);
 	sm2_sign_update(&sign_ctx, server_ecdh_params, 69);
-	sm2_sign_finish(&sign_ctx, sig, siglen);
-
+	if (tls_sm2_sign_finish(&sign_ctx, sign_offload, sig, siglen) != 1) {
+		error_print();
+		return -1;
+	}
 	return 1;
 }
 
@@ -2016,6 +2116,10 @@ void tls_ctx_cleanup(TLS_CTX *ctx)
 		gmssl_secure_clear(&ctx->kenckey, sizeof(SM2_KEY));
 		if (ctx->certs) free(ctx->certs);
 		if (ctx->cacerts) free(ctx->cacerts);
+		if (ctx->store) {
+			x509_store_cleanup(ctx->store);
+			free(ctx->store);
+		}
 		memset(ctx, 0, sizeof(TLS_CTX));
 	}
 }
@@ -2093,11 +2197,36 @@ int tls_ctx_set_ca_certificates(TLS_CTX *ctx, const char *cacertsfile, int depth
 		error_print();
 		return -1;
 	}
+	if (!(ctx->store = (X509_STORE *)malloc(sizeof(X509_STORE)))) {
+		error_print();
+		return -1;
+	}
+	if (x509_store_init(ctx->store) != 1) {
+		error_print();
+		free(ctx->store);
+		ctx->store = NULL;
+		return -1;
+	}
+	if (x509_store_add_certs(ctx->store, ctx->cacerts, ctx->cacertslen, 1) != 1) {
+		error_print();
+		return -1;
+	}
 
 	ctx->verify_depth = depth;
 	return 1;
 }
 
+int tls_ctx_set_crl_indexes(TLS_CTX *ctx, const X509_CRL_INDEX *crls, size_t crls_cnt)
+{
+	if (!ctx || (!crls && crls_cnt)) {
+		error_print();
+		return -1;
+	}
+	ctx->crls = crls;
+	ctx->crls_cnt = crls_cnt;
+	return 1;
+}
+
 int tls_ctx_set_certificate_and_key(TLS_CTX *ctx, const char *chainfile,
 	const char *keyfile, const char *keypass)
 {
@@ -2157,6 +2286,55 @@ end:
 	return ret;
 }
 
+int tls_ctx_set_certificate_and_offload_key(TLS_CTX *ctx, const char *chainfile, SDF_ASYNC *offload)
+{
+	uint8_t *certs = NULL;
+	size_t certslen;
+	const uint8_t *cert;
+	size_t certlen;
+	SM2_KEY public_key;
+
+	if (!ctx || !chainfile || !offload) {
+		error_print();
+		return -1;
+	}
+	if (!tls_protocol_name(ctx->protocol)) {
+		error_print();
+		return -1;
+	}
+	if (ctx->certs || offload->sign_key_index < 0) {
+		error_print();
+		return -1;
+	}
+
+	if (x509_certs_new_from_file(&certs, &certslen, chainfile) != 1) {
+		error_print();
+		return -1;
+	}
+	if (x509_certs_get_cert_by_index(certs, certslen, 0, &cert, &certlen) != 1
+		|| x509_cert_get_subject_public_key(cert, certlen, &public_key) != 1
+		|| sm2_public_key_equ(&offload->public_key, &public_key) != 1) {
+		error_print();
+		free(certs);
+		return -1;
+	}
+	ctx->certs = certs;
+	ctx->certslen = certslen;
+	ctx->signkey = public_key;
+	ctx->sign_offload = offload;
+	return 1;
+}
+
+int tls_ctx_set_ecdhe_key_pool(TLS_CTX *ctx, SM2_KEY_POOL *pool)
+{
+	if (!ctx || !pool) {
+		error_print();
+		return -1;
+	}
+	ctx->ecdhe_pool = pool;
+	return 1;
+}
+
 int tls_ctx_set_tlcp_server_certificate_and_keys(TLS_CTX *ctx, const char *chainfile,
 	const char *signkeyfile, const char *signkeypass,
 	const char *kenckeyfile, const char *kenckeypass)
@@ -2268,9 +2446,14 @@ int tls_init(TLS_CONNECT *conn, const TLS_CTX *ctx)
 	}
 	memcpy(conn->ca_certs, ctx->cacerts, ctx->cacertslen);
 	conn->ca_certs_len = ctx->cacertslen;
+	conn->store = ctx->store;
+	conn->crls = ctx->crls;
+	conn->crls_cnt = ctx->crls_cnt;
 
 	conn->sign_key = ctx->signkey;
 	conn->kenc_key = ctx->kenckey;
+	conn->sign_offload = ctx->sign_offload;
+	conn->ecdhe_pool = ctx->ecdhe_pool;
 
 	return 1;
 }
@@ -358,12 +358,18 @@ int tls12_do_connect(TLS_CONNECT *conn)
 		sm2_sign_update(&sign_ctx, record + 5, recordlen - 5);
 
 	// verify ServerCertificate
-	if (x509_certs_verify(conn->server_certs, conn->server_certs_len,
-		conn->ca_certs, conn->ca_certs_len, depth, &verify_result) != 1) {
+	if (x509_store_verify(conn->store, conn->server_certs, conn->server_certs_len,
+		depth, &verify_result) != 1) {
 		error_print();
 		tls_send_alert(conn, alert);
 		goto end;
 	}
+	if (x509_certs_check_revocation(conn->server_certs, conn->server_certs_len,
+		conn->crls, conn->crls_cnt) != 1) {
+		error_print();
+		tls_send_alert(conn, TLS_alert_certificate_revoked);
+		goto end;
+	}
 
 	// recv ServerKeyExchange
 	tls_trace("recv ServerKeyExchange\n");
@@ -485,7 +491,7 @@ int tls12_do_connect(TLS_CONNECT *conn)
 	// generate MASTER_SECRET
 	tls_trace("generate secrets\n");
 	SM2_KEY client_ecdh;
-	sm2_key_generate(&client_ecdh);
+	tls_ecdhe_key_generate(conn->ecdhe_pool, &client_ecdh);
 	sm2_ecdh(&client_ecdh, &server_ecdhe_public, &server_ecdhe_public);
 	memcpy(pre_master_secret, &server_ecdhe_public, 32); // 这个做法很不优雅
 	// ECDHE和ECC的PMS结构是不一样的吗？
@@ -533,7 +539,7 @@ int tls12_do_connect(TLS_CONNECT *conn)
 	if (conn->client_certs_len) {
 		tls_trace("send CertificateVerify\n");
 		uint8_t sigbuf[SM2_MAX_SIGNATURE_SIZE];
-		if (sm2_sign_finish(&sign_ctx, sigbuf, &siglen) != 1
+		if (tls_sm2_sign_finish(&sign_ctx, conn->sign_offload, sigbuf, &siglen) != 1
 			|| tls_record_set_handshake_certificate_verify(record, &recordlen, sigbuf, siglen) != 1) {
 			error_print();
 			tls_send_alert(conn, TLS_alert_internal_error);
@@ -821,8 +827,8 @@ int tls12_do_accept(TLS_CONNECT *conn)
 
 	// send ServerKeyExchange
 	tls_trace("send ServerKeyExchange\n");
-	sm2_key_generate(&server_ecdhe_key);
-	if (tls_sign_server_ecdh_params(&conn->sign_key,
+	tls_ecdhe_key_generate(conn->ecdhe_pool, &server_ecdhe_key);
+	if (tls_sign_server_ecdh_params(&conn->sign_key, conn->sign_offload,
 		client_random, server_random, TLS_curve_sm2p256v1, &server_ecdhe_key.public_key,
 		sigbuf, &siglen) != 1) {
 		error_print();
@@ -898,12 +904,18 @@ int tls12_do_accept(TLS_CONNECT *conn)
 			tls_send_alert(conn, TLS_alert_unexpected_message);
 			goto end;
 		}
-		if (x509_certs_verify(conn->client_certs, conn->client_certs_len,
-			conn->ca_certs, conn->ca_certs_len, verify_depth, &verify_result) != 1) {
+		if (x509_store_verify(conn->store, conn->client_certs, conn->client_certs_len,
+			verify_depth, &verify_result) != 1) {
 			error_print();
 			tls_send_alert(conn, TLS_alert_bad_certificate);
 			goto end;
 		}
+		if (x509_certs_check_revocation(conn->client_certs, conn->client_certs_len,
+			conn->crls, conn->crls_cnt) != 1) {
+			error_print();
+			tls_send_alert(conn, TLS_alert_certificate_revoked);
+			goto end;
+		}
 		sm3_update(&sm3_ctx, record + 5, recordlen - 5);
 		tls_client_verify_update(&client_verify_ctx, record + 5, recordlen - 5);
 	}
@@ -444,7 +444,7 @@ static size_t TLS13_client_context_str_and_zero_size = sizeof(TLS13_client_conte
 static size_t TLS13_server_context_str_and_zero_size = sizeof(TLS13_server_context_str_and_zero);
 
 int tls13_sign_certificate_verify(int tls_mode,
-	const SM2_KEY *key, const char *signer_id, size_t signer_id_len,
+	const SM2_KEY *key, SDF_ASYNC *sign_offload, const char *signer_id, size_t signer_id_len,
 	const DIGEST_CTX *tbs_dgst_ctx,
 	uint8_t *sig, size_t *siglen)
 {
@@ -479,7 +479,11 @@ int tls13_sign_certificate_verify(int tls_mode,
 	sm2_sign_update(&sign_ctx, prefix, 64);
 	sm2_sign_update(&sign_ctx, context_str_and_zero, context_str_and_zero_len);
 	sm2_sign_update(&sign_ctx, dgst, dgstlen);
-	sm2_sign_finish(&sign_ctx, sig, siglen);
+	if (tls_sm2_sign_finish(&sign_ctx, sign_offload, sig, siglen) != 1) {
+		gmssl_secure_clear(&sign_ctx, sizeof(sign_ctx));
+		error_print();
+		return -1;
+	}
 
 	gmssl_secure_clear(&sign_ctx, sizeof(sign_ctx));
 	return 1;
@@ -1512,7 +1516,7 @@ int tls13_do_connect(TLS_CONNECT *conn)
 	tls_trace("send ClientHello\n");
 	tls_record_set_protocol(record, TLS_protocol_tls1);
 	rand_bytes(client_random, 32); // TLS 1.3 Random 不再包含 UNIX Time
-	sm2_key_generate(&client_ecdhe);
+	tls_ecdhe_key_generate(conn->ecdhe_pool, &client_ecdhe);
 	tls13_client_hello_exts_set(client_exts, &client_exts_len, sizeof(client_exts), &(client_ecdhe.public_key));
 	tls_record_set_handshake_client_hello(record, &recordlen,
 		TLS_protocol_tls12, client_random, NULL, 0,
@@ -1815,8 +1819,9 @@ int tls13_do_connect(TLS_CONNECT *conn)
 		// send {CertificateVerify*}
 		tls_trace("send {CertificateVerify*}\n");
 		client_sign_algor = TLS_sig_sm2sig_sm3; // FIXME: 应该放在conn里面
-		tls13_sign_certificate_verify(TLS_client_mode, &conn->sign_key, TLS13_SM2_ID, TLS13_SM2_ID_LENGTH, &dgst_ctx, sig, &siglen);
-		if (tls13_record_set_handshake_certificate_verify(record, &recordlen,
+		if (tls13_sign_certificate_verify(TLS_client_mode, &conn->sign_key, conn->sign_offload,
+				TLS13_SM2_ID, TLS13_SM2_ID_LENGTH, &dgst_ctx, sig, &siglen) != 1
+			|| tls13_record_set_handshake_certificate_verify(record, &recordlen,
 			client_sign_algor, sig, siglen) != 1) {
 			error_print();
 			tls_send_alert(conn, TLS_alert_internal_error);
@@ -2009,7 +2014,7 @@ int tls13_do_accept(TLS_CONNECT *conn)
 	// 2. Send ServerHello
 	tls_trace("send ServerHello\n");
 	rand_bytes(server_random, 32);
-	sm2_key_generate(&server_ecdhe);
+	tls_ecdhe_key_generate(conn->ecdhe_pool, &server_ecdhe);
 	if (tls13_process_client_hello_exts(client_exts, client_exts_len,
 		&server_ecdhe, &client_ecdhe_public,
 		server_exts, &server_exts_len, sizeof(server_exts)) != 1) {
@@ -2137,8 +2142,9 @@ int tls13_do_accept(TLS_CONNECT *conn)
 
 	// send Server {CertificateVerify}
 	tls_trace("send {CertificateVerify}\n");
-	tls13_sign_certificate_verify(TLS_server_mode, &conn->sign_key, TLS13_SM2_ID, TLS13_SM2_ID_LENGTH, &dgst_ctx, sig, &siglen);
-	if (tls13_record_set_handshake_certificate_verify(record, &recordlen,
+	if (tls13_sign_certificate_verify(TLS_server_mode, &conn->sign_key, conn->sign_offload,
+			TLS13_SM2_ID, TLS13_SM2_ID_LENGTH, &dgst_ctx, sig, &siglen) != 1
+		|| tls13_record_set_handshake_certificate_verify(record, &recordlen,
 		TLS_sig_sm2sig_sm3, sig, siglen) != 1) {
 		error_print();
 		tls_send_alert(conn, TLS_alert_internal_error);
@@ -765,6 +765,10 @@ int x509_explicit_exts_from_der(int index, const uint8_t **d, size_t *dlen, cons
 
 	if ((ret = asn1_explicit_from_der(index, &p, &len, in, inlen)) != 1) {
 		if (ret < 0) error_print();
+		else {
+			*d = NULL;
+			*dlen = 0;
+		}
 		return ret;
 	}
 	if (asn1_sequence_from_der(d, dlen, &p, &len) != 1
@@ -791,7 +795,20 @@ int x509_exts_get_ext_by_index(const uint8_t *d, size_t dlen, int index,
 int x509_exts_get_ext_by_oid(const uint8_t *d, size_t dlen, int oid,
 	int *critical, const uint8_t **val, size_t *vlen)
 {
-	return -1;
+	int ext_id;
+	uint32_t nodes[32];
+	size_t nodes_cnt;
+
+	while (dlen) {
+		if (x509_ext_from_der(&ext_id, nodes, &nodes_cnt, critical, val, vlen, &d, &dlen) != 1) {
+			error_print();
+			return -1;
+		}
+		if (ext_id == oid) {
+			return 1;
+		}
+	}
+	return 0;
 }
 
 int x509_exts_print(FILE *fp, int fmt, int ind, const char *label, const uint8_t *d, size_t dlen)
@@ -1683,28 +1700,9 @@ end:
 
 int x509_certs_new_from_file(uint8_t **out, size_t *outlen, const char *file)
 {
-	int ret = -1;
-	FILE *fp = NULL;
-	struct stat st;
-	uint8_t *buf = NULL;
-	size_t buflen;
-
-	if (!(fp = fopen(file, "r"))
-		|| fstat(fileno(fp), &st) < 0
-		|| (buflen = (st.st_size * 3)/4 + 1) < 0
-		|| (buf = malloc((st.st_size * 3)/4 + 1)) == NULL) {
+	if (pem_read_bundle(file, "CERTIFICATE", out, outlen) != 1) {
 		error_print();
-		goto end;
-	}
-	if (x509_certs_from_pem(buf, outlen, buflen, fp) != 1) {
-		error_print();
-		goto end;
+		return -1;
 	}
-	*out = buf;
-	buf = NULL;
-	ret = 1;
-end:
-	if (fp) fclose(fp);
-	if (buf) free(buf);
-	return ret;
+	return 1;
 }
@@ -401,14 +401,28 @@ int x509_crl_ext_id_from_name(const char *name)
 int x509_crl_ext_id_to_der(int oid, uint8_t **out, size_t *outlen)
 {
 	const ASN1_OID_INFO *info;
-	size_t len = 0;
 	if (!(info = asn1_oid_info_from_oid(x509_crl_exts, x509_crl_exts_count, oid))) {
 		error_print();
 		return -1;
 	}
-	if (asn1_object_identifier_to_der(info->nodes, info->nodes_cnt, NULL, &len) != 1
+	if (asn1_object_identifier_to_der(info->nodes, info->nodes_cnt, out,  outlen) != 1) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+// x509_ext_to_der() only knows certificate extensions, CRLNumber and DeltaCRLIndicator are not
+static int x509_crl_ext_to_der(int oid, int critical, const uint8_t *val, size_t vlen, uint8_t **out, size_t *outlen)
+{
+	size_t len = 0;
+	if (x509_crl_ext_id_to_der(oid, NULL, &len) != 1
+		|| asn1_boolean_to_der(critical, NULL, &len) < 0
+		|| asn1_octet_string_to_der(val, vlen, NULL, &len) != 1
 		|| asn1_sequence_header_to_der(len, out, outlen) != 1
-		|| asn1_object_identifier_to_der(info->nodes, info->nodes_cnt, out,  outlen) != 1) {
+		|| x509_crl_ext_id_to_der(oid, out, outlen) != 1
+		|| asn1_boolean_to_der(critical, out, outlen) < 0
+		|| asn1_octet_string_to_der(val, vlen, out, outlen) != 1) {
 		error_print();
 		return -1;
 	}
@@ -473,9 +487,9 @@ int x509_crl_exts_add_crl_number(
 
 	exts += *extslen;
 	if (asn1_int_to_der(num, &p, &vlen) != 1
-		|| x509_ext_to_der(oid, critical, val, vlen, NULL, &curlen) != 1
+		|| x509_crl_ext_to_der(oid, critical, val, vlen, NULL, &curlen) != 1
 		|| asn1_length_le(curlen, maxlen) != 1
-		|| x509_ext_to_der(oid, critical, val, vlen, &exts, extslen) != 1) {
+		|| x509_crl_ext_to_der(oid, critical, val, vlen, &exts, extslen) != 1) {
 		error_print();
 		return -1;
 	}
@@ -495,9 +509,9 @@ int x509_crl_exts_add_delta_crl_indicator(
 
 	exts += *extslen;
 	if (asn1_int_to_der(num, &p, &vlen) != 1
-		|| x509_ext_to_der(oid, critical, val, vlen, NULL, &curlen) != 1
+		|| x509_crl_ext_to_der(oid, critical, val, vlen, NULL, &curlen) != 1
 		|| asn1_length_le(curlen, maxlen) != 1
-		|| x509_ext_to_der(oid, critical, val, vlen, &exts, extslen) != 1) {
+		|| x509_crl_ext_to_der(oid, critical, val, vlen, &exts, extslen) != 1) {
 		error_print();
 		return -1;
 	}
@@ -714,7 +728,7 @@ int x509_tbs_crl_to_der(
 		|| x509_time_to_der(this_update, NULL, &len) != 1
 		|| x509_time_to_der(next_update, NULL, &len) < 0
 		|| asn1_sequence_to_der(revoked_certs, revoked_certs_len, NULL, &len) < 0
-		|| asn1_sequence_to_der(exts, exts_len, NULL, &len) < 0
+		|| x509_explicit_exts_to_der(0, exts, exts_len, NULL, &len) < 0
 		|| asn1_sequence_header_to_der(len, out, outlen) != 1
 		|| asn1_int_to_der(version, out, outlen) < 0
 		|| x509_signature_algor_to_der(signature_algor, out, outlen) != 1
@@ -722,7 +736,7 @@ int x509_tbs_crl_to_der(
 		|| x509_time_to_der(this_update, out, outlen) != 1
 		|| x509_time_to_der(next_update, out, outlen) < 0
 		|| asn1_sequence_to_der(revoked_certs, revoked_certs_len, out, outlen) < 0
-		|| asn1_sequence_to_der(exts, exts_len, out, outlen) < 0) {
+		|| x509_explicit_exts_to_der(0, exts, exts_len, out, outlen) < 0) {
 		error_print();
 		return -1;
 	}
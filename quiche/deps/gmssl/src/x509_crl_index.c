@@ -0,0 +1,519 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <gmssl/asn1.h>
+#include <gmssl/x509.h>
+#include <gmssl/x509_crl.h>
+#include <gmssl/error.h>
+
+
+static const uint32_t oid_ce_crl_reasons[] = { 2,5,29,21 };
+static const uint32_t oid_ce_crl_number[] = { 2,5,29,20 };
+static const uint32_t oid_ce_delta_crl_indicator[] = { 2,5,29,27 };
+#define OID_CE_CNT 4
+
+/*
+ * On-disk form, all fields in host byte order:
+ *
+ *	X509_CRL_INDEX_FILE_HEADER
+ *	issuer Name, padded to a multiple of 8 bytes
+ *	X509_CRL_ENTRY[entries_cnt], sorted
+ */
+#define X509_CRL_INDEX_MAGIC		"GMCRLIX1"
+#define X509_CRL_INDEX_BYTE_ORDER	0x01020304
+
+typedef struct {
+	char magic[8];
+	uint32_t byte_order;
+	uint32_t entry_size;
+	int64_t this_update;
+	int64_t next_update;
+	int32_t crl_number;
+	uint32_t issuer_len;
+	uint64_t entries_cnt;
+} X509_CRL_INDEX_FILE_HEADER;
+
+#define X509_CRL_INDEX_PAD8(len)	(((len) + 7) & ~(size_t)7)
+
+
+static int x509_crl_entry_cmp(const uint8_t *serial, size_t serial_len, const X509_CRL_ENTRY *entry)
+{
+	// serial numbers are minimally encoded positive integers, shorter is smaller
+	if (serial_len != entry->serial_len) {
+		return serial_len < entry->serial_len ? -1 : 1;
+	}
+	return memcmp(serial, entry->serial, serial_len);
+}
+
+static int x509_crl_entry_qsort_cmp(const void *a, const void *b)
+{
+	const X509_CRL_ENTRY *x = (const X509_CRL_ENTRY *)a;
+	return x509_crl_entry_cmp(x->serial, x->serial_len, (const X509_CRL_ENTRY *)b);
+}
+
+// returns 1 with the int value of a CRLNumber or DeltaCRLIndicator extension, 0 if absent
+static int x509_crl_exts_get_int(const uint8_t *exts, size_t exts_len, const uint32_t *ext_oid, int *val)
+{
+	while (exts_len) {
+		const uint8_t *ext;
+		size_t ext_len;
+		uint32_t nodes[32];
+		size_t nodes_cnt;
+		int critical;
+		const uint8_t *v;
+		size_t vlen;
+
+		if (asn1_sequence_from_der(&ext, &ext_len, &exts, &exts_len) != 1
+			|| asn1_object_identifier_from_der(nodes, &nodes_cnt, &ext, &ext_len) != 1
+			|| asn1_boolean_from_der(&critical, &ext, &ext_len) < 0
+			|| asn1_octet_string_from_der(&v, &vlen, &ext, &ext_len) != 1
+			|| asn1_length_is_zero(ext_len) != 1) {
+			error_print();
+			return -1;
+		}
+		if (asn1_object_identifier_equ(nodes, nodes_cnt, ext_oid, OID_CE_CNT)) {
+			if (asn1_int_from_der(val, &v, &vlen) != 1
+				|| asn1_length_is_zero(vlen) != 1) {
+				error_print();
+				return -1;
+			}
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int x509_crl_entry_exts_get_reason(const uint8_t *exts, size_t exts_len, int *reason)
+{
+	*reason = X509_CRL_INDEX_NO_REASON;
+
+	while (exts_len) {
+		const uint8_t *ext;
+		size_t ext_len;
+		uint32_t nodes[32];
+		size_t nodes_cnt;
+		int critical;
+		const uint8_t *v;
+		size_t vlen;
+
+		if (asn1_sequence_from_der(&ext, &ext_len, &exts, &exts_len) != 1
+			|| asn1_object_identifier_from_der(nodes, &nodes_cnt, &ext, &ext_len) != 1
+			|| asn1_boolean_from_der(&critical, &ext, &ext_len) < 0
+			|| asn1_octet_string_from_der(&v, &vlen, &ext, &ext_len) != 1
+			|| asn1_length_is_zero(ext_len) != 1) {
+			error_print();
+			return -1;
+		}
+		if (asn1_object_identifier_equ(nodes, nodes_cnt, oid_ce_crl_reasons, OID_CE_CNT)) {
+			if (x509_crl_reason_from_der(reason, &v, &vlen) != 1
+				|| asn1_length_is_zero(vlen) != 1) {
+				error_print();
+				return -1;
+			}
+		}
+	}
+	return 1;
+}
+
+typedef struct {
+	const uint8_t *issuer;
+	size_t issuer_len;
+	time_t this_update;
+	time_t next_update;
+	int crl_number;
+	int delta_base; // -1 if not a delta CRL
+	X509_CRL_ENTRY *entries;
+	size_t entries_cnt;
+} X509_CRL_PARSED;
+
+// Decode the revoked certificates once into a sorted array
+static int x509_crl_parse_entries(X509_CRL_PARSED *crl, const uint8_t *a, size_t alen)
+{
+	const uint8_t *revoked;
+	size_t revoked_len;
+	const uint8_t *exts;
+	size_t exts_len;
+	const uint8_t *p;
+	size_t len;
+	size_t cnt = 0;
+	int ret;
+
+	memset(crl, 0, sizeof(*crl));
+
+	if (x509_crl_get_details(a, alen,
+		NULL, // version
+		&crl->issuer, &crl->issuer_len,
+		&crl->this_update, &crl->next_update,
+		&revoked, &revoked_len,
+		&exts, &exts_len,
+		NULL, // signature_algor
+		NULL, NULL // sig, siglen
+		) != 1) {
+		error_print();
+		return -1;
+	}
+	if ((ret = x509_crl_exts_get_int(exts, exts_len, oid_ce_crl_number, &crl->crl_number)) < 0) {
+		error_print();
+		return -1;
+	}
+	if (!ret) crl->crl_number = -1;
+	if ((ret = x509_crl_exts_get_int(exts, exts_len, oid_ce_delta_crl_indicator, &crl->delta_base)) < 0) {
+		error_print();
+		return -1;
+	}
+	if (!ret) crl->delta_base = -1;
+
+	// count the entries first to allocate the array once
+	p = revoked;
+	len = revoked_len;
+	while (len) {
+		const uint8_t *d;
+		size_t dlen;
+		if (asn1_sequence_from_der(&d, &dlen, &p, &len) != 1) {
+			error_print();
+			return -1;
+		}
+		cnt++;
+	}
+	if (cnt && !(crl->entries = (X509_CRL_ENTRY *)calloc(cnt, sizeof(X509_CRL_ENTRY)))) {
+		error_print();
+		return -1;
+	}
+
+	while (revoked_len) {
+		X509_CRL_ENTRY *entry = &crl->entries[crl->entries_cnt];
+		const uint8_t *serial;
+		size_t serial_len;
+		time_t revoke_date;
+		const uint8_t *entry_exts;
+		size_t entry_exts_len;
+		int reason;
+
+		if (x509_revoked_cert_from_der(&serial, &serial_len, &revoke_date,
+			&entry_exts, &entry_exts_len, &revoked, &revoked_len) != 1
+			|| x509_crl_entry_exts_get_reason(entry_exts, entry_exts_len, &reason) != 1) {
+			error_print();
+			goto err;
+		}
+		if (!serial_len || serial_len > X509_SERIAL_NUMBER_MAX_LEN) {
+			error_print();
+			goto err;
+		}
+		memcpy(entry->serial, serial, serial_len);
+		entry->serial_len = (uint8_t)serial_len;
+		entry->reason = (uint8_t)reason;
+		entry->revoke_date = (int64_t)revoke_date;
+		crl->entries_cnt++;
+	}
+
+	qsort(crl->entries, crl->entries_cnt, sizeof(X509_CRL_ENTRY), x509_crl_entry_qsort_cmp);
+	return 1;
+err:
+	free(crl->entries);
+	crl->entries = NULL;
+	return -1;
+}
+
+int x509_crl_index_init(X509_CRL_INDEX *idx, const uint8_t *crl, size_t crl_len)
+{
+	X509_CRL_PARSED parsed;
+
+	if (!idx || !crl || !crl_len) {
+		error_print();
+		return -1;
+	}
+	memset(idx, 0, sizeof(*idx));
+
+	if (x509_crl_parse_entries(&parsed, crl, crl_len) != 1) {
+		error_print();
+		return -1;
+	}
+	if (parsed.delta_base >= 0) {
+		// a delta CRL is only meaningful on top of its base
+		error_print();
+		free(parsed.entries);
+		return -1;
+	}
+	if (!(idx->issuer = (uint8_t *)malloc(parsed.issuer_len))) {
+		error_print();
+		free(parsed.entries);
+		return -1;
+	}
+	memcpy(idx->issuer, parsed.issuer, parsed.issuer_len);
+	idx->issuer_len = parsed.issuer_len;
+	idx->this_update = parsed.this_update;
+	idx->next_update = parsed.next_update;
+	idx->crl_number = parsed.crl_number;
+	idx->entries = parsed.entries;
+	idx->entries_cnt = parsed.entries_cnt;
+	return 1;
+}
+
+// A mapped index is read-only, copy it to the heap before modifying it
+static int x509_crl_index_unmap(X509_CRL_INDEX *idx)
+{
+	uint8_t *issuer;
+	X509_CRL_ENTRY *entries = NULL;
+
+	if (!idx->map) {
+		return 1;
+	}
+	if (!(issuer = (uint8_t *)malloc(idx->issuer_len))) {
+		error_print();
+		return -1;
+	}
+	if (idx->entries_cnt
+		&& !(entries = (X509_CRL_ENTRY *)malloc(idx->entries_cnt * sizeof(X509_CRL_ENTRY)))) {
+		error_print();
+		free(issuer);
+		return -1;
+	}
+	memcpy(issuer, idx->issuer, idx->issuer_len);
+	if (entries) {
+		memcpy(entries, idx->entries, idx->entries_cnt * sizeof(X509_CRL_ENTRY));
+	}
+	munmap(idx->map, idx->map_len);
+	idx->map = NULL;
+	idx->map_len = 0;
+	idx->issuer = issuer;
+	idx->entries = entries;
+	return 1;
+}
+
+int x509_crl_index_apply_delta(X509_CRL_INDEX *idx, const uint8_t *delta_crl, size_t delta_crl_len)
+{
+	X509_CRL_PARSED delta;
+	X509_CRL_ENTRY *merged = NULL;
+	size_t cnt = 0;
+	size_t i = 0, j = 0;
+
+	if (!idx || !delta_crl || !delta_crl_len) {
+		error_print();
+		return -1;
+	}
+	if (x509_crl_parse_entries(&delta, delta_crl, delta_crl_len) != 1) {
+		error_print();
+		return -1;
+	}
+
+	// RFC 5280 5.2.4: the delta applies to any complete CRL numbered at
+	// least its BaseCRLNumber, and must be newer than that CRL
+	if (delta.delta_base < 0
+		|| delta.issuer_len != idx->issuer_len
+		|| memcmp(delta.issuer, idx->issuer, idx->issuer_len) != 0
+		|| idx->crl_number < 0
+		|| idx->crl_number < delta.delta_base
+		|| delta.crl_number <= idx->crl_number) {
+		error_print();
+		goto err;
+	}
+	if (x509_crl_index_unmap(idx) != 1) {
+		error_print();
+		goto err;
+	}
+
+	if (idx->entries_cnt + delta.entries_cnt
+		&& !(merged = (X509_CRL_ENTRY *)malloc((idx->entries_cnt + delta.entries_cnt) * sizeof(X509_CRL_ENTRY)))) {
+		error_print();
+		goto err;
+	}
+	while (i < idx->entries_cnt || j < delta.entries_cnt) {
+		int c;
+		if (i == idx->entries_cnt) {
+			c = 1;
+		} else if (j == delta.entries_cnt) {
+			c = -1;
+		} else {
+			c = x509_crl_entry_cmp(idx->entries[i].serial, idx->entries[i].serial_len, &delta.entries[j]);
+		}
+		if (c < 0) {
+			merged[cnt++] = idx->entries[i++];
+		} else {
+			// the delta entry replaces the base entry, removeFromCRL drops both
+			if (c == 0) {
+				i++;
+			}
+			if (delta.entries[j].reason != X509_cr_remove_from_crl) {
+				merged[cnt++] = delta.entries[j];
+			}
+			j++;
+		}
+	}
+
+	free(idx->entries);
+	idx->entries = merged;
+	idx->entries_cnt = cnt;
+	idx->this_update = delta.this_update;
+	idx->next_update = delta.next_update;
+	idx->crl_number = delta.crl_number;
+	free(delta.entries);
+	return 1;
+err:
+	free(delta.entries);
+	return -1;
+}
+
+int x509_crl_index_find_revoked(const X509_CRL_INDEX *idx,
+	const uint8_t *serial, size_t serial_len, const X509_CRL_ENTRY **entry)
+{
+	size_t lo = 0, hi;
+
+	if (!idx || !serial || !serial_len) {
+		error_print();
+		return -1;
+	}
+	hi = idx->entries_cnt;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo)/2;
+		int c = x509_crl_entry_cmp(serial, serial_len, &idx->entries[mid]);
+		if (c == 0) {
+			if (entry) *entry = &idx->entries[mid];
+			return 1;
+		}
+		if (c < 0) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	return 0;
+}
+
+int x509_crl_index_save(const X509_CRL_INDEX *idx, FILE *fp)
+{
+	X509_CRL_INDEX_FILE_HEADER header;
+	uint8_t pad[8] = {0};
+	size_t padlen = X509_CRL_INDEX_PAD8(idx->issuer_len) - idx->issuer_len;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, X509_CRL_INDEX_MAGIC, sizeof(header.magic));
+	header.byte_order = X509_CRL_INDEX_BYTE_ORDER;
+	header.entry_size = sizeof(X509_CRL_ENTRY);
+	header.this_update = (int64_t)idx->this_update;
+	header.next_update = (int64_t)idx->next_update;
+	header.crl_number = idx->crl_number;
+	header.issuer_len = (uint32_t)idx->issuer_len;
+	header.entries_cnt = idx->entries_cnt;
+
+	if (fwrite(&header, 1, sizeof(header), fp) != sizeof(header)
+		|| fwrite(idx->issuer, 1, idx->issuer_len, fp) != idx->issuer_len
+		|| fwrite(pad, 1, padlen, fp) != padlen
+		|| fwrite(idx->entries, sizeof(X509_CRL_ENTRY), idx->entries_cnt, fp) != idx->entries_cnt) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+int x509_crl_index_map(X509_CRL_INDEX *idx, const char *file)
+{
+	const X509_CRL_INDEX_FILE_HEADER *header;
+	struct stat st;
+	uint8_t *map;
+	size_t offset;
+	int fd;
+
+	if (!idx || !file) {
+		error_print();
+		return -1;
+	}
+	memset(idx, 0, sizeof(*idx));
+
+	if ((fd = open(file, O_RDONLY)) < 0) {
+		error_print();
+		return -1;
+	}
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(X509_CRL_INDEX_FILE_HEADER)) {
+		error_print();
+		close(fd);
+		return -1;
+	}
+	map = (uint8_t *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		error_print();
+		return -1;
+	}
+
+	header = (const X509_CRL_INDEX_FILE_HEADER *)map;
+	offset = sizeof(X509_CRL_INDEX_FILE_HEADER) + X509_CRL_INDEX_PAD8((size_t)header->issuer_len);
+	if (memcmp(header->magic, X509_CRL_INDEX_MAGIC, sizeof(header->magic)) != 0
+		|| header->byte_order != X509_CRL_INDEX_BYTE_ORDER
+		|| header->entry_size != sizeof(X509_CRL_ENTRY)
+		|| !header->issuer_len
+		|| offset > (size_t)st.st_size
+		|| header->entries_cnt != ((size_t)st.st_size - offset)/sizeof(X509_CRL_ENTRY)
+		|| ((size_t)st.st_size - offset) % sizeof(X509_CRL_ENTRY)) {
+		error_print();
+		munmap(map, st.st_size);
+		return -1;
+	}
+
+	idx->issuer = map + sizeof(X509_CRL_INDEX_FILE_HEADER);
+	idx->issuer_len = header->issuer_len;
+	idx->this_update = (time_t)header->this_update;
+	idx->next_update = (time_t)header->next_update;
+	idx->crl_number = header->crl_number;
+	idx->entries = (X509_CRL_ENTRY *)(map + offset);
+	idx->entries_cnt = header->entries_cnt;
+	idx->map = map;
+	idx->map_len = st.st_size;
+	return 1;
+}
+
+void x509_crl_index_cleanup(X509_CRL_INDEX *idx)
+{
+	if (idx) {
+		if (idx->map) {
+			munmap(idx->map, idx->map_len);
+		} else {
+			free(idx->issuer);
+			free(idx->entries);
+		}
+		memset(idx, 0, sizeof(*idx));
+	}
+}
+
+int x509_certs_check_revocation(const uint8_t *certs, size_t certslen,
+	const X509_CRL_INDEX *crls, size_t crls_cnt)
+{
+	while (certslen) {
+		const uint8_t *cert;
+		size_t certlen;
+		const uint8_t *issuer;
+		size_t issuer_len;
+		const uint8_t *serial;
+		size_t serial_len;
+		size_t i;
+
+		if (x509_cert_from_der(&cert, &certlen, &certs, &certslen) != 1
+			|| x509_cert_get_issuer_and_serial_number(cert, certlen,
+				&issuer, &issuer_len, &serial, &serial_len) != 1) {
+			error_print();
+			return -1;
+		}
+		for (i = 0; i < crls_cnt; i++) {
+			if (crls[i].issuer_len == issuer_len
+				&& memcmp(crls[i].issuer, issuer, issuer_len) == 0
+				&& x509_crl_index_find_revoked(&crls[i], serial, serial_len, NULL) == 1) {
+				error_print();
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
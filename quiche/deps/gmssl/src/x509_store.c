@@ -0,0 +1,514 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#include <time.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <gmssl/sm2.h>
+#include <gmssl/sm3.h>
+#include <gmssl/asn1.h>
+#include <gmssl/x509.h>
+#include <gmssl/x509_ext.h>
+#include <gmssl/x509_store.h>
+#include <gmssl/error.h>
+
+
+// FNV-1a, only used to spread the index buckets
+static uint32_t x509_store_bucket(const uint8_t *d, size_t dlen)
+{
+	uint32_t h = 2166136261U;
+	while (dlen--) {
+		h ^= *d++;
+		h *= 16777619U;
+	}
+	return h % X509_STORE_BUCKETS;
+}
+
+static int x509_cert_info_parse(X509_CERT_INFO *info, const uint8_t *cert, size_t certlen)
+{
+	const uint8_t *p = cert;
+	size_t len = certlen;
+	const uint8_t *tbs;
+	size_t tbs_len;
+	const uint8_t *sig;
+	size_t sig_len;
+	const uint8_t *issuer;
+	size_t issuer_len;
+	const uint8_t *subject;
+	size_t subject_len;
+	const uint8_t *exts;
+	size_t exts_len;
+	int critical;
+	const uint8_t *val;
+	size_t vlen;
+	int ret;
+
+	memset(info, 0, sizeof(*info));
+	sm3_digest(cert, certlen, info->hash);
+	info->certlen = certlen;
+
+	if (x509_certificate_from_der(&tbs, &tbs_len, &info->signature_algor, &sig, &sig_len, &p, &len) != 1
+		|| asn1_length_is_zero(len) != 1
+		|| x509_cert_get_details(cert, certlen,
+			NULL, // version
+			NULL, NULL, // serial
+			NULL, // signature_algor
+			&issuer, &issuer_len,
+			&info->not_before, &info->not_after,
+			&subject, &subject_len,
+			&info->public_key,
+			NULL, NULL, // issuer_unique_id
+			NULL, NULL, // subject_unique_id
+			&exts, &exts_len,
+			NULL, // signature_algor
+			NULL, NULL) != 1) {
+		error_print();
+		return -1;
+	}
+	info->tbs_offset = tbs - cert;
+	info->tbs_len = tbs_len;
+	info->sig_offset = sig - cert;
+	info->sig_len = sig_len;
+	info->issuer_offset = issuer - cert;
+	info->issuer_len = issuer_len;
+	info->subject_offset = subject - cert;
+	info->subject_len = subject_len;
+
+	if ((ret = x509_exts_get_ext_by_oid(exts, exts_len, OID_ce_subject_key_identifier,
+		&critical, &val, &vlen)) < 0) {
+		error_print();
+		return -1;
+	}
+	if (ret) {
+		const uint8_t *ski;
+		size_t ski_len;
+		if (asn1_octet_string_from_der(&ski, &ski_len, &val, &vlen) != 1
+			|| asn1_length_is_zero(vlen) != 1) {
+			error_print();
+			return -1;
+		}
+		info->ski_offset = ski - cert;
+		info->ski_len = ski_len;
+	}
+	if ((ret = x509_exts_get_ext_by_oid(exts, exts_len, OID_ce_authority_key_identifier,
+		&critical, &val, &vlen)) < 0) {
+		error_print();
+		return -1;
+	}
+	if (ret) {
+		const uint8_t *keyid;
+		size_t keyid_len;
+		const uint8_t *akid_issuer;
+		size_t akid_issuer_len;
+		const uint8_t *akid_serial;
+		size_t akid_serial_len;
+		if (x509_authority_key_identifier_from_der(&keyid, &keyid_len,
+			&akid_issuer, &akid_issuer_len, &akid_serial, &akid_serial_len, &val, &vlen) != 1
+			|| asn1_length_is_zero(vlen) != 1) {
+			error_print();
+			return -1;
+		}
+		if (keyid) {
+			info->akid_offset = keyid - cert;
+			info->akid_len = keyid_len;
+		}
+	}
+
+	if (sm2_compute_z(info->z, &info->public_key.public_key, SM2_DEFAULT_ID, SM2_DEFAULT_ID_LENGTH) != 1) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+static int x509_cert_info_check_validity(const X509_CERT_INFO *info, time_t now)
+{
+	if (info->not_before >= info->not_after) {
+		error_print();
+		return -1;
+	}
+	if (now < info->not_before) {
+		error_print();
+		return X509_verify_err_cert_not_yet_valid;
+	}
+	if (info->not_after < now) {
+		error_print();
+		return X509_verify_err_cert_has_expired;
+	}
+	return 1;
+}
+
+// Parsed form of a chain certificate, from the cache if it was seen before
+static int x509_store_get_cert_info(X509_STORE *store, const uint8_t *cert, size_t certlen,
+	X509_CERT_INFO *info)
+{
+	uint8_t hash[SM3_DIGEST_SIZE];
+	X509_CERT_INFO *slot;
+
+	sm3_digest(cert, certlen, hash);
+	slot = &store->cert_cache[(hash[0] | (hash[1] << 8)) % X509_STORE_CERT_CACHE_SIZE];
+
+	pthread_mutex_lock(&store->lock);
+	if (slot->certlen == certlen && memcmp(slot->hash, hash, sizeof(hash)) == 0) {
+		*info = *slot;
+		pthread_mutex_unlock(&store->lock);
+		return 1;
+	}
+	pthread_mutex_unlock(&store->lock);
+
+	if (x509_cert_info_parse(info, cert, certlen) != 1) {
+		error_print();
+		return -1;
+	}
+
+	pthread_mutex_lock(&store->lock);
+	*slot = *info;
+	pthread_mutex_unlock(&store->lock);
+	return 1;
+}
+
+static X509_STORE_LINK *x509_store_link_slot(X509_STORE *store,
+	const X509_CERT_INFO *info, const X509_CERT_INFO *cainfo)
+{
+	size_t i = (info->hash[0] | (info->hash[1] << 8)) ^ (cainfo->hash[0] | (cainfo->hash[1] << 8));
+	return &store->link_cache[i % X509_STORE_LINK_CACHE_SIZE];
+}
+
+/*
+ * Returns 1 if cacert issued cert, 0 if the names, key identifiers or the
+ * signature do not match.
+ */
+static int x509_store_verify_link(X509_STORE *store,
+	const uint8_t *cert, const X509_CERT_INFO *info,
+	const uint8_t *cacert, const X509_CERT_INFO *cainfo, time_t now)
+{
+	X509_STORE_LINK *slot;
+	SM2_SIGN_CTX verify_ctx;
+	time_t not_before;
+	time_t not_after;
+	int ret;
+
+	if (info->issuer_len != cainfo->subject_len
+		|| memcmp(cert + info->issuer_offset, cacert + cainfo->subject_offset, info->issuer_len) != 0) {
+		return 0;
+	}
+	if (info->akid_len && cainfo->ski_len
+		&& (info->akid_len != cainfo->ski_len
+			|| memcmp(cert + info->akid_offset, cacert + cainfo->ski_offset, info->akid_len) != 0)) {
+		return 0;
+	}
+
+	slot = x509_store_link_slot(store, info, cainfo);
+	pthread_mutex_lock(&store->lock);
+	if (memcmp(slot->cert_hash, info->hash, SM3_DIGEST_SIZE) == 0
+		&& memcmp(slot->issuer_hash, cainfo->hash, SM3_DIGEST_SIZE) == 0
+		&& slot->not_before <= now && now <= slot->not_after) {
+		pthread_mutex_unlock(&store->lock);
+		return 1;
+	}
+	pthread_mutex_unlock(&store->lock);
+
+	if (info->signature_algor != OID_sm2sign_with_sm3) {
+		error_print();
+		return 0;
+	}
+	// the Z value of the issuer key is precomputed, the id is not passed again
+	if (sm2_verify_init(&verify_ctx, &cainfo->public_key, NULL, 0) != 1) {
+		error_print();
+		return -1;
+	}
+	sm3_update(&verify_ctx.sm3_ctx, cainfo->z, sizeof(cainfo->z));
+	if (sm2_verify_update(&verify_ctx, cert + info->tbs_offset, info->tbs_len) != 1
+		|| (ret = sm2_verify_finish(&verify_ctx, cert + info->sig_offset, info->sig_len)) < 0) {
+		error_print();
+		return -1;
+	}
+	if (!ret) {
+		error_print();
+		return 0;
+	}
+
+	not_before = info->not_before > cainfo->not_before ? info->not_before : cainfo->not_before;
+	not_after = info->not_after < cainfo->not_after ? info->not_after : cainfo->not_after;
+	if (not_before <= now && now <= not_after) {
+		pthread_mutex_lock(&store->lock);
+		memcpy(slot->cert_hash, info->hash, SM3_DIGEST_SIZE);
+		memcpy(slot->issuer_hash, cainfo->hash, SM3_DIGEST_SIZE);
+		slot->not_before = not_before;
+		slot->not_after = not_after;
+		pthread_mutex_unlock(&store->lock);
+	}
+	return 1;
+}
+
+// Look up the issuer of cert by AuthorityKeyIdentifier first, then by issuer name
+static int x509_store_find_issuer(X509_STORE *store,
+	const uint8_t *cert, const X509_CERT_INFO *info, time_t now,
+	const X509_STORE_ENTRY **issuer)
+{
+	const X509_STORE_ENTRY *entry;
+	int ret;
+
+	if (info->akid_len) {
+		entry = store->by_ski[x509_store_bucket(cert + info->akid_offset, info->akid_len)];
+		for (; entry; entry = entry->next_by_ski) {
+			if ((ret = x509_store_verify_link(store, cert, info, entry->cert, &entry->info, now)) < 0) {
+				error_print();
+				return -1;
+			}
+			if (ret) {
+				*issuer = entry;
+				return 1;
+			}
+		}
+	}
+	entry = store->by_subject[x509_store_bucket(cert + info->issuer_offset, info->issuer_len)];
+	for (; entry; entry = entry->next_by_subject) {
+		if ((ret = x509_store_verify_link(store, cert, info, entry->cert, &entry->info, now)) < 0) {
+			error_print();
+			return -1;
+		}
+		if (ret) {
+			*issuer = entry;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int x509_store_init(X509_STORE *store)
+{
+	if (!store) {
+		error_print();
+		return -1;
+	}
+	memset(store, 0, sizeof(X509_STORE));
+	if (pthread_mutex_init(&store->lock, NULL) != 0) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+int x509_store_add_cert(X509_STORE *store, const uint8_t *cert, size_t certlen, int trusted)
+{
+	X509_STORE_ENTRY *entry;
+	const X509_STORE_ENTRY *p;
+	uint32_t h;
+
+	if (!store || !cert || !certlen) {
+		error_print();
+		return -1;
+	}
+	if (!(entry = (X509_STORE_ENTRY *)malloc(sizeof(X509_STORE_ENTRY)))) {
+		error_print();
+		return -1;
+	}
+	memset(entry, 0, sizeof(X509_STORE_ENTRY));
+	if (!(entry->cert = (uint8_t *)malloc(certlen))) {
+		error_print();
+		free(entry);
+		return -1;
+	}
+	memcpy(entry->cert, cert, certlen);
+	if (x509_cert_info_parse(&entry->info, entry->cert, certlen) != 1) {
+		error_print();
+		free(entry->cert);
+		free(entry);
+		return -1;
+	}
+
+	h = x509_store_bucket(cert + entry->info.subject_offset, entry->info.subject_len);
+	for (p = store->by_subject[h]; p; p = p->next_by_subject) {
+		if (memcmp(p->info.hash, entry->info.hash, SM3_DIGEST_SIZE) == 0) {
+			// already in the store, a trust anchor stays trusted
+			free(entry->cert);
+			free(entry);
+			return 1;
+		}
+	}
+	entry->trusted = trusted;
+	entry->next = store->entries;
+	store->entries = entry;
+	entry->next_by_subject = store->by_subject[h];
+	store->by_subject[h] = entry;
+	if (entry->info.ski_len) {
+		h = x509_store_bucket(cert + entry->info.ski_offset, entry->info.ski_len);
+		entry->next_by_ski = store->by_ski[h];
+		store->by_ski[h] = entry;
+	}
+	store->entries_cnt++;
+	return 1;
+}
+
+int x509_store_add_certs(X509_STORE *store, const uint8_t *certs, size_t certslen, int trusted)
+{
+	const uint8_t *cert;
+	size_t certlen;
+
+	while (certslen) {
+		if (x509_cert_from_der(&cert, &certlen, &certs, &certslen) != 1
+			|| x509_store_add_cert(store, cert, certlen, trusted) != 1) {
+			error_print();
+			return -1;
+		}
+	}
+	return 1;
+}
+
+/*
+ * Verify the path from chain[start] to a trust anchor. The peer chain is
+ * followed first, then the store supplies the missing intermediates and the
+ * anchor. The issuer of chain[start] is returned for the TLCP signing
+ * certificate check.
+ */
+static int x509_store_verify_path(X509_STORE *store,
+	const uint8_t **chain, X509_CERT_INFO *infos, size_t n, size_t start,
+	int depth, time_t now, int *verify_result,
+	const uint8_t **first_issuer, const X509_CERT_INFO **first_issuer_info)
+{
+	const X509_STORE_ENTRY *entry;
+	const uint8_t *cert;
+	const X509_CERT_INFO *info;
+	size_t max_path = depth > 0 ? (size_t)depth : X509_STORE_MAX_CHAIN;
+	size_t path_len = n - start;
+	size_t i;
+	int ret;
+
+	*first_issuer = NULL;
+	for (i = start; i + 1 < n; i++) {
+		if (x509_store_verify_link(store, chain[i], &infos[i], chain[i + 1], &infos[i + 1], now) != 1) {
+			error_print();
+			return -1;
+		}
+		if (i == start) {
+			*first_issuer = chain[i + 1];
+			*first_issuer_info = &infos[i + 1];
+		}
+	}
+
+	cert = chain[n - 1];
+	info = &infos[n - 1];
+	for (;;) {
+		if (path_len > max_path) {
+			*verify_result = X509_verify_err_cert_chain_too_long;
+			error_print();
+			return -1;
+		}
+		if ((ret = x509_store_find_issuer(store, cert, info, now, &entry)) != 1) {
+			// no issuer in the store, the chain does not lead to a trust anchor
+			error_print();
+			return -1;
+		}
+		if (!*first_issuer) {
+			*first_issuer = entry->cert;
+			*first_issuer_info = &entry->info;
+		}
+		if (entry->trusted) {
+			break;
+		}
+		if ((*verify_result = x509_cert_info_check_validity(&entry->info, now)) != 1) {
+			error_print();
+			return -1;
+		}
+		cert = entry->cert;
+		info = &entry->info;
+		path_len++;
+	}
+	return 1;
+}
+
+static int x509_store_verify_chain(X509_STORE *store, const uint8_t *certs, size_t certslen,
+	int depth, int tlcp, int *verify_result)
+{
+	const uint8_t *chain[X509_STORE_MAX_CHAIN];
+	size_t chain_len[X509_STORE_MAX_CHAIN];
+	X509_CERT_INFO infos[X509_STORE_MAX_CHAIN];
+	const uint8_t *issuer;
+	const X509_CERT_INFO *issuer_info;
+	size_t n = 0;
+	time_t now;
+
+	if (!store || !certs || !certslen || !verify_result) {
+		error_print();
+		return -1;
+	}
+	*verify_result = -1;
+	time(&now);
+
+	while (certslen) {
+		if (n == X509_STORE_MAX_CHAIN) {
+			*verify_result = X509_verify_err_cert_chain_too_long;
+			error_print();
+			return -1;
+		}
+		if (x509_cert_from_der(&chain[n], &chain_len[n], &certs, &certslen) != 1
+			|| x509_store_get_cert_info(store, chain[n], chain_len[n], &infos[n]) != 1) {
+			error_print();
+			return -1;
+		}
+		if ((*verify_result = x509_cert_info_check_validity(&infos[n], now)) != 1) {
+			error_print();
+			return -1;
+		}
+		n++;
+	}
+
+	if (!tlcp) {
+		if (x509_store_verify_path(store, chain, infos, n, 0,
+			depth, now, verify_result, &issuer, &issuer_info) != 1) {
+			error_print();
+			return -1;
+		}
+	} else {
+		// the signing and the encryption certificates share the issuer
+		if (n < 2) {
+			error_print();
+			return -1;
+		}
+		if (x509_store_verify_path(store, chain, infos, n, 1,
+			depth, now, verify_result, &issuer, &issuer_info) != 1
+			|| x509_store_verify_link(store, chain[0], &infos[0], issuer, issuer_info, now) != 1) {
+			error_print();
+			return -1;
+		}
+	}
+	*verify_result = 1;
+	return 1;
+}
+
+int x509_store_verify(X509_STORE *store, const uint8_t *certs, size_t certslen,
+	int depth, int *verify_result)
+{
+	return x509_store_verify_chain(store, certs, certslen, depth, 0, verify_result);
+}
+
+int x509_store_verify_tlcp(X509_STORE *store, const uint8_t *certs, size_t certslen,
+	int depth, int *verify_result)
+{
+	return x509_store_verify_chain(store, certs, certslen, depth, 1, verify_result);
+}
+
+void x509_store_cleanup(X509_STORE *store)
+{
+	X509_STORE_ENTRY *entry;
+
+	if (!store) {
+		return;
+	}
+	while ((entry = store->entries) != NULL) {
+		store->entries = entry->next;
+		free(entry->cert);
+		free(entry);
+	}
+	pthread_mutex_destroy(&store->lock);
+	memset(store, 0, sizeof(X509_STORE));
+}
@@ -13,6 +13,7 @@
 #include <gmssl/zuc.h>
 #include <gmssl/mem.h>
 #include <gmssl/endian.h>
+#include "zuc_lcl.h"
 
 
 static const ZUC_UINT15 KD[16] = {
@@ -146,17 +147,22 @@ static const uint8_t S1[256] = {
 	(X0 ^ R1) + R2;					\
 	F_(X1, X2)
 
-void zuc_init(ZUC_STATE *state, const uint8_t *user_key, const uint8_t *iv)
+void zuc_set_lfsr(ZUC_UINT31 LFSR[16], const uint8_t *user_key, const uint8_t *iv)
 {
-	ZUC_UINT31 *LFSR = state->LFSR;
-	uint32_t R1, R2;
-	uint32_t X0, X1, X2;
-	uint32_t W, W1, W2, U, V;
 	int i;
 
 	for (i = 0; i < 16; i++) {
 		LFSR[i] = MAKEU31(user_key[i], KD[i], iv[i]);
 	}
+}
+
+void zuc_init_rounds(ZUC_STATE *state)
+{
+	ZUC_UINT31 *LFSR = state->LFSR;
+	uint32_t R1, R2;
+	uint32_t X0, X1, X2;
+	uint32_t W, W1, W2, U, V;
+	int i;
 
 	R1 = 0;
 	R2 = 0;
@@ -175,6 +181,12 @@ void zuc_init(ZUC_STATE *state, const uint8_t *user_key, const uint8_t *iv)
 	state->R2 = R2;
 }
 
+void zuc_init(ZUC_STATE *state, const uint8_t *user_key, const uint8_t *iv)
+{
+	zuc_set_lfsr(state->LFSR, user_key, iv);
+	zuc_init_rounds(state);
+}
+
 uint32_t zuc_generate_keyword(ZUC_STATE *state)
 {
 	ZUC_UINT31 *LFSR = state->LFSR;
@@ -411,15 +423,10 @@ static const ZUC_UINT7 ZUC256_D[][16] = {
 	  (uint32_t)(d))
 
 
-static void zuc256_set_mac_key(ZUC_STATE *key, const uint8_t K[32],
+void zuc256_set_lfsr(ZUC_UINT31 LFSR[16], const uint8_t K[32],
 	const uint8_t IV[23], int macbits)
 {
-	ZUC_UINT31 *LFSR = key->LFSR;
-	uint32_t R1, R2;
-	uint32_t X0, X1, X2;
-	uint32_t W, W1, W2, U, V;
 	const ZUC_UINT7 *D;
-	int i;
 
 	ZUC_UINT6 IV17 = IV[17] >> 2;
 	ZUC_UINT6 IV18 = ((IV[17] & 0x3) << 4) | (IV[18] >> 4);
@@ -447,22 +454,13 @@ static void zuc256_set_mac_key(ZUC_STATE *key, const uint8_t K[32],
 	LFSR[13] = ZUC256_MAKEU31(K[13], D[13], IV[15], IV[8]);
 	LFSR[14] = ZUC256_MAKEU31(K[14], (D[14] | (K[31] >> 4)), IV[16], IV[9]);
 	LFSR[15] = ZUC256_MAKEU31(K[15], (D[15] | (K[31] & 0x0F)), K[30], K[29]);
+}
 
-	R1 = 0;
-	R2 = 0;
-
-	for (i = 0; i < 32; i++) {
-		BitReconstruction3(X0, X1, X2);
-		W = F(X0, X1, X2);
-		LFSRWithInitialisationMode(W >> 1);
-	}
-
-	BitReconstruction2(X1, X2);
-	F_(X1, X2);
-	LFSRWithWorkMode();
-
-	key->R1 = R1;
-	key->R2 = R2;
+static void zuc256_set_mac_key(ZUC_STATE *key, const uint8_t K[32],
+	const uint8_t IV[23], int macbits)
+{
+	zuc256_set_lfsr(key->LFSR, K, IV, macbits);
+	zuc_init_rounds(key);
 }
 
 void zuc256_init(ZUC_STATE *key, const uint8_t K[32],
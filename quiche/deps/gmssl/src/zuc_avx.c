@@ -0,0 +1,336 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#include <string.h>
+#include <immintrin.h>
+#include <gmssl/zuc.h>
+#include <gmssl/mem.h>
+#include "zuc_lcl.h"
+
+/*
+ * Multi-lane ZUC keystream, 8 lanes with AVX2 and 16 lanes with AVX-512,
+ * and a PCLMULQDQ version of the EIA3 accumulation.
+ * Each vector element is one independent ZUC state. The LFSR is a ring of
+ * 16 vectors, the rounds are unrolled 16 times so every index is a constant
+ * and no words are moved. The S-boxes are gathered from 32-bit copies of
+ * S0 and S1. The kernels are compiled with target attributes and chosen at
+ * run time, the library still runs on CPUs without AVX2.
+ */
+
+static const uint32_t ZUC_S0_32[256] = {
+	0x3e, 0x72, 0x5b, 0x47, 0xca, 0xe0, 0x00, 0x33,
+	0x04, 0xd1, 0x54, 0x98, 0x09, 0xb9, 0x6d, 0xcb,
+	0x7b, 0x1b, 0xf9, 0x32, 0xaf, 0x9d, 0x6a, 0xa5,
+	0xb8, 0x2d, 0xfc, 0x1d, 0x08, 0x53, 0x03, 0x90,
+	0x4d, 0x4e, 0x84, 0x99, 0xe4, 0xce, 0xd9, 0x91,
+	0xdd, 0xb6, 0x85, 0x48, 0x8b, 0x29, 0x6e, 0xac,
+	0xcd, 0xc1, 0xf8, 0x1e, 0x73, 0x43, 0x69, 0xc6,
+	0xb5, 0xbd, 0xfd, 0x39, 0x63, 0x20, 0xd4, 0x38,
+	0x76, 0x7d, 0xb2, 0xa7, 0xcf, 0xed, 0x57, 0xc5,
+	0xf3, 0x2c, 0xbb, 0x14, 0x21, 0x06, 0x55, 0x9b,
+	0xe3, 0xef, 0x5e, 0x31, 0x4f, 0x7f, 0x5a, 0xa4,
+	0x0d, 0x82, 0x51, 0x49, 0x5f, 0xba, 0x58, 0x1c,
+	0x4a, 0x16, 0xd5, 0x17, 0xa8, 0x92, 0x24, 0x1f,
+	0x8c, 0xff, 0xd8, 0xae, 0x2e, 0x01, 0xd3, 0xad,
+	0x3b, 0x4b, 0xda, 0x46, 0xeb, 0xc9, 0xde, 0x9a,
+	0x8f, 0x87, 0xd7, 0x3a, 0x80, 0x6f, 0x2f, 0xc8,
+	0xb1, 0xb4, 0x37, 0xf7, 0x0a, 0x22, 0x13, 0x28,
+	0x7c, 0xcc, 0x3c, 0x89, 0xc7, 0xc3, 0x96, 0x56,
+	0x07, 0xbf, 0x7e, 0xf0, 0x0b, 0x2b, 0x97, 0x52,
+	0x35, 0x41, 0x79, 0x61, 0xa6, 0x4c, 0x10, 0xfe,
+	0xbc, 0x26, 0x95, 0x88, 0x8a, 0xb0, 0xa3, 0xfb,
+	0xc0, 0x18, 0x94, 0xf2, 0xe1, 0xe5, 0xe9, 0x5d,
+	0xd0, 0xdc, 0x11, 0x66, 0x64, 0x5c, 0xec, 0x59,
+	0x42, 0x75, 0x12, 0xf5, 0x74, 0x9c, 0xaa, 0x23,
+	0x0e, 0x86, 0xab, 0xbe, 0x2a, 0x02, 0xe7, 0x67,
+	0xe6, 0x44, 0xa2, 0x6c, 0xc2, 0x93, 0x9f, 0xf1,
+	0xf6, 0xfa, 0x36, 0xd2, 0x50, 0x68, 0x9e, 0x62,
+	0x71, 0x15, 0x3d, 0xd6, 0x40, 0xc4, 0xe2, 0x0f,
+	0x8e, 0x83, 0x77, 0x6b, 0x25, 0x05, 0x3f, 0x0c,
+	0x30, 0xea, 0x70, 0xb7, 0xa1, 0xe8, 0xa9, 0x65,
+	0x8d, 0x27, 0x1a, 0xdb, 0x81, 0xb3, 0xa0, 0xf4,
+	0x45, 0x7a, 0x19, 0xdf, 0xee, 0x78, 0x34, 0x60,
+};
+
+static const uint32_t ZUC_S1_32[256] = {
+	0x55, 0xc2, 0x63, 0x71, 0x3b, 0xc8, 0x47, 0x86,
+	0x9f, 0x3c, 0xda, 0x5b, 0x29, 0xaa, 0xfd, 0x77,
+	0x8c, 0xc5, 0x94, 0x0c, 0xa6, 0x1a, 0x13, 0x00,
+	0xe3, 0xa8, 0x16, 0x72, 0x40, 0xf9, 0xf8, 0x42,
+	0x44, 0x26, 0x68, 0x96, 0x81, 0xd9, 0x45, 0x3e,
+	0x10, 0x76, 0xc6, 0xa7, 0x8b, 0x39, 0x43, 0xe1,
+	0x3a, 0xb5, 0x56, 0x2a, 0xc0, 0x6d, 0xb3, 0x05,
+	0x22, 0x66, 0xbf, 0xdc, 0x0b, 0xfa, 0x62, 0x48,
+	0xdd, 0x20, 0x11, 0x06, 0x36, 0xc9, 0xc1, 0xcf,
+	0xf6, 0x27, 0x52, 0xbb, 0x69, 0xf5, 0xd4, 0x87,
+	0x7f, 0x84, 0x4c, 0xd2, 0x9c, 0x57, 0xa4, 0xbc,
+	0x4f, 0x9a, 0xdf, 0xfe, 0xd6, 0x8d, 0x7a, 0xeb,
+	0x2b, 0x53, 0xd8, 0x5c, 0xa1, 0x14, 0x17, 0xfb,
+	0x23, 0xd5, 0x7d, 0x30, 0x67, 0x73, 0x08, 0x09,
+	0xee, 0xb7, 0x70, 0x3f, 0x61, 0xb2, 0x19, 0x8e,
+	0x4e, 0xe5, 0x4b, 0x93, 0x8f, 0x5d, 0xdb, 0xa9,
+	0xad, 0xf1, 0xae, 0x2e, 0xcb, 0x0d, 0xfc, 0xf4,
+	0x2d, 0x46, 0x6e, 0x1d, 0x97, 0xe8, 0xd1, 0xe9,
+	0x4d, 0x37, 0xa5, 0x75, 0x5e, 0x83, 0x9e, 0xab,
+	0x82, 0x9d, 0xb9, 0x1c, 0xe0, 0xcd, 0x49, 0x89,
+	0x01, 0xb6, 0xbd, 0x58, 0x24, 0xa2, 0x5f, 0x38,
+	0x78, 0x99, 0x15, 0x90, 0x50, 0xb8, 0x95, 0xe4,
+	0xd0, 0x91, 0xc7, 0xce, 0xed, 0x0f, 0xb4, 0x6f,
+	0xa0, 0xcc, 0xf0, 0x02, 0x4a, 0x79, 0xc3, 0xde,
+	0xa3, 0xef, 0xea, 0x51, 0xe6, 0x6b, 0x18, 0xec,
+	0x1b, 0x2c, 0x80, 0xf7, 0x74, 0xe7, 0xff, 0x21,
+	0x5a, 0x6a, 0x54, 0x1e, 0x41, 0x31, 0x92, 0x35,
+	0xc4, 0x33, 0x07, 0x0a, 0xba, 0x7e, 0x0e, 0x34,
+	0x88, 0xb1, 0x98, 0x7c, 0xf3, 0x3d, 0x60, 0x6c,
+	0x7b, 0xca, 0xd3, 0x1f, 0x32, 0x65, 0x04, 0x28,
+	0x64, 0xbe, 0x85, 0x9b, 0x2f, 0x59, 0x8a, 0xd7,
+	0xb0, 0x25, 0xac, 0xaf, 0x12, 0x03, 0xe2, 0xf2,
+};
+
+/*
+ * The rounds are written once against the VADD/VXOR/... primitives below,
+ * which are defined for __m256i before the AVX2 kernel and for __m512i
+ * before the AVX-512 kernel.
+ */
+
+#define ADD31(a,b)					\
+	a = VADD(a, b);					\
+	a = VADD(VAND(a, m31), VSRL(a, 31))
+
+#define ROT31(a,k)	VAND(VOR(VSLL(a, k), VSRL(a, 31 - (k))), m31)
+
+#define L1(X)						\
+	VXOR(VXOR(VXOR(X, VROL(X, 2)), VXOR(VROL(X, 10), VROL(X, 18))), VROL(X, 24))
+
+#define L2(X)						\
+	VXOR(VXOR(VXOR(X, VROL(X, 8)), VXOR(VROL(X, 14), VROL(X, 22))), VROL(X, 30))
+
+#define SBOX(X)						\
+	VOR(VOR(VSLL(VGATHER(ZUC_S0_32, VSRL(X, 24)), 24),			\
+		VSLL(VGATHER(ZUC_S1_32, VAND(VSRL(X, 16), m8)), 16)),		\
+	    VOR(VSLL(VGATHER(ZUC_S0_32, VAND(VSRL(X, 8), m8)), 8),		\
+		VGATHER(ZUC_S1_32, VAND(X, m8))))
+
+// logical LFSR word j in round k of a 16-round block
+#define S(k,j)	s[((k) + (j)) & 15]
+
+#define ROUND_F(k)							\
+	X0 = VOR(VSLL(VAND(S(k,15), mhi), 1), VAND(S(k,14), m16));	\
+	X1 = VOR(VSLL(S(k,11), 16), VSRL(S(k,9), 15));			\
+	X2 = VOR(VSLL(S(k,7), 16), VSRL(S(k,5), 15));			\
+	W = VADD(VXOR(X0, R1), R2);					\
+	W1 = VADD(R1, X1);						\
+	W2 = VXOR(R2, X2);						\
+	U = L1(VOR(VSLL(W1, 16), VSRL(W2, 16)));			\
+	V = L2(VOR(VSLL(W2, 16), VSRL(W1, 16)));			\
+	R1 = SBOX(U);							\
+	R2 = SBOX(V)
+
+#define ROUND_LFSR(k)							\
+	V = S(k,0);							\
+	ADD31(V, ROT31(S(k,0), 8));					\
+	ADD31(V, ROT31(S(k,4), 20));					\
+	ADD31(V, ROT31(S(k,10), 21));					\
+	ADD31(V, ROT31(S(k,13), 17));					\
+	ADD31(V, ROT31(S(k,15), 15))
+
+#define INIT_ROUND(k)							\
+	ROUND_F(k);							\
+	ROUND_LFSR(k);							\
+	ADD31(V, VSRL(W, 1));						\
+	S(k,0) = V
+
+#define WORK_ROUND(k)							\
+	X3 = VOR(VSLL(S(k,2), 16), VSRL(S(k,0), 15));			\
+	ROUND_F(k);							\
+	VSTORE(buf[k], VXOR(X3, W));					\
+	ROUND_LFSR(k);							\
+	S(k,0) = V
+
+#define ROUNDS16(ROUND)							\
+	ROUND(0); ROUND(1); ROUND(2); ROUND(3);				\
+	ROUND(4); ROUND(5); ROUND(6); ROUND(7);				\
+	ROUND(8); ROUND(9); ROUND(10); ROUND(11);			\
+	ROUND(12); ROUND(13); ROUND(14); ROUND(15)
+
+/*
+ * Body shared by both kernels, LANES and VEC are defined by the caller.
+ * After the 32 initialisation rounds one work round is run and its output
+ * dropped, then the ring is rotated back so that every block starts at 0.
+ */
+#define ZUC_KEYSTREAM_LANES()						\
+	VEC s[16], R1, R2, X0, X1, X2, X3, W, W1, W2, U, V;		\
+	uint32_t buf[16][LANES];					\
+	size_t nwords = 0;						\
+	size_t i;							\
+	int j, l;							\
+									\
+	for (j = 0; j < 16; j++) {					\
+		for (l = 0; l < LANES; l++) {				\
+			buf[0][l] = lanes[l]->LFSR[j];			\
+		}							\
+		s[j] = VLOAD(buf[0]);					\
+	}								\
+	for (l = 0; l < LANES; l++) {					\
+		if (lanes[l]->nwords > nwords) {			\
+			nwords = lanes[l]->nwords;			\
+		}							\
+	}								\
+	R1 = VZERO();							\
+	R2 = VZERO();							\
+									\
+	ROUNDS16(INIT_ROUND);						\
+	ROUNDS16(INIT_ROUND);						\
+	WORK_ROUND(0);							\
+	V = s[0];							\
+	for (j = 0; j < 15; j++) {					\
+		s[j] = s[j + 1];					\
+	}								\
+	s[15] = V;							\
+									\
+	for (i = 0; i < nwords; i += 16) {				\
+		ROUNDS16(WORK_ROUND);					\
+		for (l = 0; l < LANES; l++) {				\
+			ZUC_LANE *lane = lanes[l];			\
+			for (j = 0; j < 16 && i + j < lane->nwords; j++) { \
+				lane->keystream[i + j] = buf[j][l];	\
+			}						\
+		}							\
+	}								\
+	gmssl_secure_clear(buf, sizeof(buf))
+
+
+#define VEC		__m256i
+#define LANES		8
+#define VZERO()		_mm256_setzero_si256()
+#define VSET1(a)	_mm256_set1_epi32(a)
+#define VLOAD(p)	_mm256_loadu_si256((const __m256i *)(p))
+#define VSTORE(p,a)	_mm256_storeu_si256((__m256i *)(p), a)
+#define VADD(a,b)	_mm256_add_epi32(a, b)
+#define VAND(a,b)	_mm256_and_si256(a, b)
+#define VOR(a,b)	_mm256_or_si256(a, b)
+#define VXOR(a,b)	_mm256_xor_si256(a, b)
+#define VSLL(a,k)	_mm256_slli_epi32(a, k)
+#define VSRL(a,k)	_mm256_srli_epi32(a, k)
+#define VROL(a,k)	VOR(VSLL(a, k), VSRL(a, 32 - (k)))
+#define VGATHER(t,i)	_mm256_i32gather_epi32((const int *)(t), i, 4)
+
+__attribute__((target("avx2")))
+void zuc_keystream_x8_avx2(ZUC_LANE *lanes[8])
+{
+	const __m256i m31 = VSET1(0x7fffffff);
+	const __m256i mhi = VSET1(0x7fff8000);
+	const __m256i m16 = VSET1(0xffff);
+	const __m256i m8 = VSET1(0xff);
+
+	ZUC_KEYSTREAM_LANES();
+}
+
+#undef VEC
+#undef LANES
+#undef VZERO
+#undef VSET1
+#undef VLOAD
+#undef VSTORE
+#undef VADD
+#undef VAND
+#undef VOR
+#undef VXOR
+#undef VSLL
+#undef VSRL
+#undef VROL
+#undef VGATHER
+
+#define VEC		__m512i
+#define LANES		16
+#define VZERO()		_mm512_setzero_si512()
+#define VSET1(a)	_mm512_set1_epi32(a)
+#define VLOAD(p)	_mm512_loadu_si512((const void *)(p))
+#define VSTORE(p,a)	_mm512_storeu_si512((void *)(p), a)
+#define VADD(a,b)	_mm512_add_epi32(a, b)
+#define VAND(a,b)	_mm512_and_si512(a, b)
+#define VOR(a,b)	_mm512_or_si512(a, b)
+#define VXOR(a,b)	_mm512_xor_si512(a, b)
+#define VSLL(a,k)	_mm512_slli_epi32(a, k)
+#define VSRL(a,k)	_mm512_srli_epi32(a, k)
+#define VROL(a,k)	_mm512_rol_epi32(a, k)
+#define VGATHER(t,i)	_mm512_i32gather_epi32(i, (const void *)(t), 4)
+
+__attribute__((target("avx512f")))
+void zuc_keystream_x16_avx512(ZUC_LANE *lanes[16])
+{
+	const __m512i m31 = VSET1(0x7fffffff);
+	const __m512i mhi = VSET1(0x7fff8000);
+	const __m512i m16 = VSET1(0xffff);
+	const __m512i m8 = VSET1(0xff);
+
+	ZUC_KEYSTREAM_LANES();
+}
+
+/*
+ * EIA3 over whole words. Bit j of a message word selects bits j..j+31 of the
+ * 64-bit keystream window K = z[i]:z[i+1], so the word contributes bits
+ * 32..63 of the carry-less product of K and the bit reversed word.
+ */
+__attribute__((target("pclmul,sse2")))
+uint32_t zuc_eia_words_pclmul(const uint8_t *data, size_t nwords, const uint32_t *z)
+{
+	__m128i T = _mm_setzero_si128();
+	uint32_t M;
+	uint64_t K;
+	size_t i;
+
+	for (i = 0; i < nwords; i++) {
+		M = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16)
+			| ((uint32_t)data[2] << 8) | data[3];
+		M = ((M >> 1) & 0x55555555) | ((M & 0x55555555) << 1);
+		M = ((M >> 2) & 0x33333333) | ((M & 0x33333333) << 2);
+		M = ((M >> 4) & 0x0f0f0f0f) | ((M & 0x0f0f0f0f) << 4);
+		M = __builtin_bswap32(M);
+		K = ((uint64_t)z[i] << 32) | z[i + 1];
+
+		T = _mm_xor_si128(T, _mm_clmulepi64_si128(
+			_mm_cvtsi64_si128((long long)K), _mm_cvtsi32_si128((int)M), 0x00));
+		data += 4;
+	}
+	return (uint32_t)((uint64_t)_mm_cvtsi128_si64(T) >> 32);
+}
+
+static int zuc_cpu_lanes = -1;
+static int zuc_cpu_pclmul = -1;
+
+static void zuc_cpu_init(void)
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		zuc_cpu_lanes = 16;
+	} else if (__builtin_cpu_supports("avx2")) {
+		zuc_cpu_lanes = 8;
+	} else {
+		zuc_cpu_lanes = 0;
+	}
+	zuc_cpu_pclmul = __builtin_cpu_supports("pclmul") ? 1 : 0;
+}
+
+int zuc_avx_lanes(void)
+{
+	if (zuc_cpu_lanes < 0) {
+		zuc_cpu_init();
+	}
+	return zuc_cpu_lanes;
+}
+
+int zuc_pclmul_supported(void)
+{
+	if (zuc_cpu_pclmul < 0) {
+		zuc_cpu_init();
+	}
+	return zuc_cpu_pclmul;
+}
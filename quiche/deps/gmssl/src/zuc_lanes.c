@@ -0,0 +1,98 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#include <string.h>
+#include <gmssl/zuc.h>
+#include <gmssl/mem.h>
+#include "zuc_lcl.h"
+
+
+/*
+ * Without a SIMD kernel the lanes are run one after the other. Interleaving
+ * a few scalar states was tried and does not beat this, the S-box lookups
+ * and the general purpose registers are the limit, not the dependency chain.
+ */
+static void zuc_keystream_x1(ZUC_LANE *lane)
+{
+	ZUC_STATE state;
+
+	memcpy(state.LFSR, lane->LFSR, sizeof(state.LFSR));
+	zuc_init_rounds(&state);
+	zuc_generate_keystream(&state, lane->nwords, lane->keystream);
+	gmssl_secure_clear(&state, sizeof(state));
+}
+
+void zuc_lanes_generate_keystream(ZUC_LANE *lanes, size_t nlanes)
+{
+#ifdef ENABLE_ZUC_AVX
+	ZUC_LANE pad;
+	ZUC_LANE *group[ZUC_MAX_LANES];
+	size_t width = zuc_avx_lanes();
+	size_t n, i;
+
+	memset(&pad, 0, sizeof(pad));
+
+	while (width && nlanes > 2) {
+		// a short tail goes to a narrower kernel rather than idle lanes
+		while (width > 8 && nlanes <= width/2) {
+			width /= 2;
+		}
+		n = nlanes < width ? nlanes : width;
+		for (i = 0; i < width; i++) {
+			group[i] = i < n ? &lanes[i] : &pad;
+		}
+		if (width == 16) {
+			zuc_keystream_x16_avx512(group);
+		} else {
+			zuc_keystream_x8_avx2(group);
+		}
+		lanes += n;
+		nlanes -= n;
+	}
+#endif
+	while (nlanes) {
+		zuc_keystream_x1(lanes);
+		lanes++;
+		nlanes--;
+	}
+}
+
+static void zuc_keystream_batch(const ZUC_KEYSTREAM_JOB *jobs, size_t njobs, int zuc256)
+{
+	ZUC_LANE lanes[ZUC_MAX_LANES];
+	size_t n, i;
+
+	while (njobs) {
+		n = njobs < ZUC_MAX_LANES ? njobs : ZUC_MAX_LANES;
+		for (i = 0; i < n; i++) {
+			if (zuc256) {
+				zuc256_set_lfsr(lanes[i].LFSR, jobs[i].key, jobs[i].iv, 0);
+			} else {
+				zuc_set_lfsr(lanes[i].LFSR, jobs[i].key, jobs[i].iv);
+			}
+			lanes[i].keystream = jobs[i].keystream;
+			lanes[i].nwords = jobs[i].nwords;
+		}
+		zuc_lanes_generate_keystream(lanes, n);
+		jobs += n;
+		njobs -= n;
+	}
+	gmssl_secure_clear(lanes, sizeof(lanes));
+}
+
+void zuc_generate_keystream_batch(const ZUC_KEYSTREAM_JOB *jobs, size_t njobs)
+{
+	zuc_keystream_batch(jobs, njobs, 0);
+}
+
+void zuc256_generate_keystream_batch(const ZUC_KEYSTREAM_JOB *jobs, size_t njobs)
+{
+	zuc_keystream_batch(jobs, njobs, 1);
+}
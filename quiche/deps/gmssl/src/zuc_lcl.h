@@ -0,0 +1,48 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#ifndef GMSSL_ZUC_LCL_H
+#define GMSSL_ZUC_LCL_H
+
+#include <gmssl/zuc.h>
+
+// Load key and iv into the LFSR, before the initialisation rounds
+void zuc_set_lfsr(ZUC_UINT31 LFSR[16], const uint8_t key[ZUC_KEY_SIZE], const uint8_t iv[ZUC_IV_SIZE]);
+void zuc256_set_lfsr(ZUC_UINT31 LFSR[16], const uint8_t key[ZUC256_KEY_SIZE],
+	const uint8_t iv[ZUC256_IV_SIZE], int macbits);
+// Initialisation rounds on a loaded LFSR, the state is then ready for output
+void zuc_init_rounds(ZUC_STATE *state);
+
+/*
+ * One independent keystream of a multi-lane run. The LFSR is loaded by
+ * zuc_set_lfsr() or zuc256_set_lfsr(), the kernel runs the initialisation
+ * and writes `nwords` keystream words. All lanes of a group are clocked
+ * until the longest one is done, lanes of similar length batch best.
+ */
+typedef struct {
+	ZUC_UINT31 LFSR[16];
+	ZUC_UINT32 *keystream;
+	size_t nwords;
+} ZUC_LANE;
+
+#define ZUC_MAX_LANES	16 // widest kernel, the batch APIs hand over this many jobs at a time
+
+void zuc_lanes_generate_keystream(ZUC_LANE *lanes, size_t nlanes);
+
+#ifdef ENABLE_ZUC_AVX
+int zuc_avx_lanes(void); // 16 with AVX-512, 8 with AVX2, 0 otherwise
+void zuc_keystream_x8_avx2(ZUC_LANE *lanes[8]);
+void zuc_keystream_x16_avx512(ZUC_LANE *lanes[16]);
+int zuc_pclmul_supported(void);
+// EIA3 tag accumulator over `nwords` whole message words, z holds nwords + 1 keystream words
+uint32_t zuc_eia_words_pclmul(const uint8_t *data, size_t nwords, const uint32_t *z);
+#endif
+
+#endif
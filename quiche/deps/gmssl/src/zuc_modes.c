@@ -13,8 +13,10 @@
 #include <string.h>
 #include <stdlib.h>
 #include <gmssl/zuc.h>
+#include <gmssl/mem.h>
 #include <gmssl/error.h>
 #include <gmssl/endian.h>
+#include "zuc_lcl.h"
 
 
 static void zuc_set_eea_key(ZUC_STATE *key, const uint8_t user_key[16],
@@ -44,10 +46,47 @@ void zuc_eea_encrypt(const ZUC_UINT32 *in, ZUC_UINT32 *out, size_t nbits,
 	}
 
 	if (nbits % 32 != 0) {
-		out[nwords - 1] |= (0xffffffff << (32 - (nbits%32)));
+		out[nwords - 1] &= (0xffffffff << (32 - (nbits%32)));
 	}
 }
 
+void zuc_eea_encrypt_batch(const ZUC_EEA_JOB *jobs, size_t njobs)
+{
+	ZUC_LANE lanes[ZUC_MAX_LANES];
+	uint8_t iv[16] = {0};
+	size_t n, i, j;
+
+	while (njobs) {
+		n = njobs < ZUC_MAX_LANES ? njobs : ZUC_MAX_LANES;
+		for (i = 0; i < n; i++) {
+			const ZUC_EEA_JOB *job = &jobs[i];
+			iv[0] = iv[8] = job->count >> 24;
+			iv[1] = iv[9] = job->count >> 16;
+			iv[2] = iv[10] = job->count >> 8;
+			iv[3] = iv[11] = job->count;
+			iv[4] = iv[12] = ((job->bearer << 1) | (job->direction & 1)) << 2;
+			zuc_set_lfsr(lanes[i].LFSR, job->key, iv);
+			lanes[i].keystream = job->out;
+			lanes[i].nwords = (job->nbits + 31)/32;
+		}
+		zuc_lanes_generate_keystream(lanes, n);
+
+		for (i = 0; i < n; i++) {
+			const ZUC_EEA_JOB *job = &jobs[i];
+			size_t nwords = lanes[i].nwords;
+			for (j = 0; j < nwords; j++) {
+				job->out[j] ^= job->in[j];
+			}
+			if (job->nbits % 32 != 0) {
+				job->out[nwords - 1] &= (0xffffffff << (32 - (job->nbits%32)));
+			}
+		}
+		jobs += n;
+		njobs -= n;
+	}
+	gmssl_secure_clear(lanes, sizeof(lanes));
+}
+
 static void zuc_set_eia_iv(uint8_t iv[16], ZUC_UINT32 count, ZUC_UINT5 bearer,
 	ZUC_BIT direction)
 {
@@ -74,6 +113,103 @@ ZUC_UINT32 zuc_eia_generate_mac(const ZUC_UINT32 *data, size_t nbits,
 	return GETU32(mac);
 }
 
+/*
+ * EIA3 over a precomputed keystream z of (nbits + 31)/32 + 2 words, the same
+ * bit order as zuc_mac_update(): data is read as big-endian bytes and bit i
+ * selects the keystream window starting at bit i.
+ */
+static ZUC_UINT32 zuc_eia_keystream_mac(const uint8_t *data, size_t nbits, const ZUC_UINT32 *z)
+{
+	size_t nwords = (nbits + 31)/32;
+	ZUC_UINT32 T = 0;
+	ZUC_UINT32 K0, K1, M;
+	size_t i = 0, j, n;
+
+#ifdef ENABLE_ZUC_AVX
+	if (zuc_pclmul_supported()) {
+		T = zuc_eia_words_pclmul(data, nbits/32, z);
+		i = nbits/32;
+	}
+#endif
+	for (; i < nwords; i++) {
+		uint8_t block[4] = {0};
+
+		n = nbits - i * 32 < 32 ? nbits - i * 32 : 32;
+		memcpy(block, data + i * 4, (n + 7)/8);
+		M = GETU32(block);
+		K0 = z[i];
+		K1 = z[i + 1];
+
+		for (j = 0; j < n; j++) {
+			T ^= K0 & (0 - (M >> 31));
+			M <<= 1;
+			K0 = (K0 << 1) | (K1 >> 31);
+			K1 <<= 1;
+		}
+	}
+
+	if (nbits % 32) {
+		T ^= (z[nbits/32] << (nbits % 32)) | (z[nbits/32 + 1] >> (32 - nbits % 32));
+	} else {
+		T ^= z[nbits/32];
+	}
+	T ^= z[nwords + 1];
+	return T;
+}
+
+int zuc_eia_generate_mac_batch(ZUC_EIA_JOB *jobs, size_t njobs)
+{
+	ZUC_LANE lanes[ZUC_MAX_LANES];
+	ZUC_UINT32 *keystream = NULL;
+	size_t keystream_nwords = 0;
+	uint8_t iv[16];
+	size_t n, i, total;
+
+	while (njobs) {
+		n = njobs < ZUC_MAX_LANES ? njobs : ZUC_MAX_LANES;
+
+		total = 0;
+		for (i = 0; i < n; i++) {
+			total += (jobs[i].nbits + 31)/32 + 2;
+		}
+		if (total > keystream_nwords) {
+			if (keystream) {
+				gmssl_secure_clear(keystream, keystream_nwords * sizeof(ZUC_UINT32));
+				free(keystream);
+			}
+			if (!(keystream = malloc(total * sizeof(ZUC_UINT32)))) {
+				error_print();
+				return -1;
+			}
+			keystream_nwords = total;
+		}
+
+		total = 0;
+		for (i = 0; i < n; i++) {
+			zuc_set_eia_iv(iv, jobs[i].count, jobs[i].bearer, jobs[i].direction);
+			zuc_set_lfsr(lanes[i].LFSR, jobs[i].key, iv);
+			lanes[i].keystream = keystream + total;
+			lanes[i].nwords = (jobs[i].nbits + 31)/32 + 2;
+			total += lanes[i].nwords;
+		}
+		zuc_lanes_generate_keystream(lanes, n);
+
+		for (i = 0; i < n; i++) {
+			jobs[i].mac = zuc_eia_keystream_mac((const uint8_t *)jobs[i].data,
+				jobs[i].nbits, lanes[i].keystream);
+		}
+		jobs += n;
+		njobs -= n;
+	}
+
+	if (keystream) {
+		gmssl_secure_clear(keystream, keystream_nwords * sizeof(ZUC_UINT32));
+		free(keystream);
+	}
+	gmssl_secure_clear(lanes, sizeof(lanes));
+	return 1;
+}
+
 #define ZUC_BLOCK_SIZE 4
 
 int zuc_encrypt_init(ZUC_CTX *ctx, const uint8_t key[ZUC_KEY_SIZE], const uint8_t iv[ZUC_IV_SIZE])
@@ -13,6 +13,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <gmssl/base64.h>
+#include <gmssl/rand.h>
 #include <gmssl/error.h>
 
 
@@ -61,9 +62,113 @@ static int test_base64(void)
 	return 1;
 }
 
+// one-shot codec against the BASE64_CTX one, all tail lengths and both vector widths
+static int test_base64_encode_decode(void)
+{
+	uint8_t bin[1000];
+	uint8_t b64[BASE64_ENCODE_LENGTH(1000)];
+	uint8_t raw[BASE64_ENCODE_RAW_LENGTH(1000)];
+	uint8_t buf[1000];
+	BASE64_CTX ctx;
+	size_t inlen, rawlen, outlen;
+	size_t i, j;
+	int len, n;
+
+	if (rand_bytes(bin, sizeof(bin)) != 1) {
+		error_print();
+		return -1;
+	}
+	for (inlen = 0; inlen <= sizeof(bin); inlen += (inlen < 100 ? 1 : 37)) {
+		base64_encode_init(&ctx);
+		base64_encode_update(&ctx, bin, (int)inlen, b64, &len);
+		base64_encode_finish(&ctx, b64 + len, &n);
+		len += n;
+
+		if (base64_encode(bin, inlen, raw, &rawlen) != 1
+			|| rawlen != BASE64_ENCODE_RAW_LENGTH(inlen)) {
+			error_print();
+			return -1;
+		}
+		// the same characters, without line breaks
+		for (i = j = 0; i < (size_t)len; i++) {
+			if (b64[i] == '\n') continue;
+			if (j >= rawlen || b64[i] != raw[j++]) {
+				error_print();
+				return -1;
+			}
+		}
+		if (j != rawlen) {
+			error_print();
+			return -1;
+		}
+
+		if (base64_decode(b64, len, buf, &outlen) != 1
+			|| outlen != inlen
+			|| memcmp(buf, bin, inlen) != 0
+			|| base64_decode(raw, rawlen, buf, &outlen) != 1
+			|| outlen != inlen
+			|| memcmp(buf, bin, inlen) != 0) {
+			error_print();
+			return -1;
+		}
+	}
+
+	// 76-column CRLF lines
+	base64_encode(bin, 570, raw, &rawlen);
+	for (i = j = 0; i < rawlen; i++) {
+		b64[j++] = raw[i];
+		if (i % 76 == 75) {
+			b64[j++] = '\r';
+			b64[j++] = '\n';
+		}
+	}
+	if (base64_decode(b64, j, buf, &outlen) != 1
+		|| outlen != 570
+		|| memcmp(buf, bin, 570) != 0) {
+		error_print();
+		return -1;
+	}
+
+	printf("%s() ok\n", __FUNCTION__);
+	return 1;
+}
+
+static int test_base64_decode_errors(void)
+{
+	char *bad[] = {
+		"QUJD=",
+		"QUI",
+		"QU=D",
+		"Q===",
+		"QUI=QUJD",
+		"QUJDRA==\nQQ==",
+		"QUJD-UJD",
+		"QUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJDQUJD\x80UJD",
+	};
+	uint8_t buf[64];
+	size_t outlen;
+	size_t i;
+
+	for (i = 0; i < sizeof(bad)/sizeof(bad[0]); i++) {
+		if (base64_decode((uint8_t *)bad[i], strlen(bad[i]), buf, &outlen) != -1) {
+			fprintf(stderr, "%s: '%s' accepted\n", __FUNCTION__, bad[i]);
+			return -1;
+		}
+	}
+	if (base64_decode((uint8_t *)"QUI=\r\n", 6, buf, &outlen) != 1
+		|| outlen != 2 || memcmp(buf, "AB", 2) != 0) {
+		error_print();
+		return -1;
+	}
+	printf("%s() ok\n", __FUNCTION__);
+	return 1;
+}
+
 int main(void)
 {
 	if (test_base64() != 1) goto err;
+	if (test_base64_encode_decode() != 1) goto err;
+	if (test_base64_decode_errors() != 1) goto err;
 	printf("%s all tests passed\n", __FILE__);
 	return 0;
 err:
@@ -1019,6 +1019,304 @@ static int test_cms_key_agreement_info(void)
 	return 1;
 }
 
+static int test_cms_stream_cert(SM2_KEY *sm2_key, uint8_t *cert, size_t *certlen, size_t maxlen)
+{
+	uint8_t serial[20];
+	uint8_t name[256];
+	size_t namelen = 0;
+	time_t not_before, not_after;
+
+	if (sm2_key_generate(sm2_key) != 1
+		|| rand_bytes(serial, sizeof(serial)) != 1
+		|| x509_name_set(name, &namelen, sizeof(name), "CN", "Beijing", "Haidian", "PKU", "CS", "Alice") != 1
+		|| time(&not_before) == -1
+		|| x509_validity_add_days(&not_after, not_before, 365) != 1
+		|| x509_cert_sign(
+			cert, certlen, maxlen,
+			X509_version_v3,
+			serial, sizeof(serial),
+			OID_sm2sign_with_sm3,
+			name, namelen,
+			not_before, not_after,
+			name, namelen,
+			sm2_key, NULL, 0, NULL, 0, NULL, 0,
+			sm2_key, SM2_DEFAULT_ID, SM2_DEFAULT_ID_LENGTH) != 1) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+static int test_cms_stream_sign(const CMS_CERTS_AND_KEY *signers, size_t content_len,
+	const uint8_t *data, size_t datalen, size_t chunk, uint8_t *cms, size_t *cmslen, size_t maxlen)
+{
+	CMS_SIGN_CTX ctx;
+	size_t off = 0;
+	size_t len;
+
+	if (cms_sign_init(&ctx, signers, 1, NULL, 0, content_len, cms, &len, maxlen) != 1) {
+		error_print();
+		return -1;
+	}
+	*cmslen = len;
+	while (off < datalen) {
+		size_t n = datalen - off < chunk ? datalen - off : chunk;
+		if (*cmslen + n + CMS_STREAM_UPDATE_OVERHEAD > maxlen
+			|| cms_sign_update(&ctx, data + off, n, cms + *cmslen, &len) != 1) {
+			error_print();
+			return -1;
+		}
+		*cmslen += len;
+		off += n;
+	}
+	if (cms_sign_finish(&ctx, cms + *cmslen, &len, maxlen - *cmslen) != 1) {
+		error_print();
+		return -1;
+	}
+	*cmslen += len;
+	return 1;
+}
+
+static int test_cms_stream_verify(const uint8_t *cms, size_t cmslen, size_t chunk,
+	uint8_t *content, size_t *content_len)
+{
+	CMS_VERIFY_CTX ctx;
+	size_t off = 0;
+	size_t len;
+	int ret = -1;
+
+	*content_len = 0;
+	if (cms_verify_init(&ctx) != 1) {
+		error_print();
+		return -1;
+	}
+	while (off < cmslen) {
+		size_t n = cmslen - off < chunk ? cmslen - off : chunk;
+		if (cms_verify_update(&ctx, cms + off, n, content + *content_len, &len) != 1) {
+			goto end;
+		}
+		*content_len += len;
+		off += n;
+	}
+	if (cms_verify_finish(&ctx) != 1) {
+		goto end;
+	}
+	ret = 1;
+end:
+	cms_verify_cleanup(&ctx);
+	return ret;
+}
+
+static int test_cms_sign_stream(void)
+{
+	SM2_KEY sm2_key;
+	uint8_t cert[1024];
+	size_t certlen;
+	CMS_CERTS_AND_KEY signers[1];
+	uint8_t data[10000];
+	uint8_t cms[16384];
+	size_t cmslen;
+	uint8_t buf[16384];
+	size_t buflen;
+	uint8_t content[10000 + 256];
+	size_t content_len;
+	int content_type;
+	const uint8_t *d, *octets;
+	size_t dlen, octets_len;
+	const uint8_t *certs, *crls, *signer_infos;
+	size_t certs_len, crls_len, signer_infos_len;
+
+	if (test_cms_stream_cert(&sm2_key, cert, &certlen, sizeof(cert)) != 1
+		|| rand_bytes(data, sizeof(data)) != 1) {
+		error_print();
+		return -1;
+	}
+	signers[0].certs = cert;
+	signers[0].certs_len = certlen;
+	signers[0].sign_key = &sm2_key;
+
+	// known length, same encoding as cms_sign()
+	if (test_cms_stream_sign(signers, sizeof(data), data, sizeof(data), 1000, cms, &cmslen, sizeof(cms)) != 1
+		|| cms_sign(buf, &buflen, signers, 1, OID_cms_data, data, sizeof(data), NULL, 0) != 1
+		|| buflen != cmslen
+		|| cms_verify(cms, cmslen, NULL, 0, NULL, 0,
+			&content_type, &d, &dlen,
+			&certs, &certs_len, &crls, &crls_len,
+			&signer_infos, &signer_infos_len) != 1
+		|| content_type != OID_cms_data
+		|| asn1_octet_string_from_der(&octets, &octets_len, &d, &dlen) != 1
+		|| asn1_length_is_zero(dlen) != 1
+		|| octets_len != sizeof(data)
+		|| memcmp(octets, data, octets_len) != 0) {
+		error_print();
+		return -1;
+	}
+	if (test_cms_stream_verify(buf, buflen, 7, content, &content_len) != 1
+		|| content_len != sizeof(data)
+		|| memcmp(content, data, sizeof(data)) != 0) {
+		error_print();
+		return -1;
+	}
+
+	// tampered content
+	cms[cmslen/2] ^= 1;
+	if (test_cms_stream_verify(cms, cmslen, 4096, content, &content_len) == 1) {
+		error_print();
+		return -1;
+	}
+
+	// unknown length, indefinite-length BER
+	if (test_cms_stream_sign(signers, CMS_CONTENT_LEN_UNKNOWN, data, sizeof(data), 3000, cms, &cmslen, sizeof(cms)) != 1
+		|| test_cms_stream_verify(cms, cmslen, 13, content, &content_len) != 1
+		|| content_len != sizeof(data)
+		|| memcmp(content, data, sizeof(data)) != 0) {
+		error_print();
+		return -1;
+	}
+
+	// empty content
+	if (test_cms_stream_sign(signers, CMS_CONTENT_LEN_UNKNOWN, data, 0, 1, cms, &cmslen, sizeof(cms)) != 1
+		|| test_cms_stream_verify(cms, cmslen, 100, content, &content_len) != 1
+		|| content_len != 0) {
+		error_print();
+		return -1;
+	}
+
+	printf("%s() ok\n", __FUNCTION__);
+	return 1;
+}
+
+static int test_cms_stream_envelop(const uint8_t *cert, size_t certlen, size_t content_len,
+	const uint8_t *data, size_t datalen, size_t chunk, uint8_t *cms, size_t *cmslen, size_t maxlen)
+{
+	CMS_ENVELOP_CTX ctx;
+	uint8_t key[16];
+	uint8_t iv[16];
+	size_t off = 0;
+	size_t len;
+
+	if (rand_bytes(key, sizeof(key)) != 1
+		|| rand_bytes(iv, sizeof(iv)) != 1
+		|| cms_envelop_init(&ctx, cert, certlen, OID_sm4_cbc, key, sizeof(key), iv, sizeof(iv),
+			content_len, NULL, 0, NULL, 0, cms, &len, maxlen) != 1) {
+		error_print();
+		return -1;
+	}
+	*cmslen = len;
+	while (off < datalen) {
+		size_t n = datalen - off < chunk ? datalen - off : chunk;
+		if (*cmslen + n + CMS_STREAM_UPDATE_OVERHEAD > maxlen
+			|| cms_envelop_update(&ctx, data + off, n, cms + *cmslen, &len) != 1) {
+			error_print();
+			return -1;
+		}
+		*cmslen += len;
+		off += n;
+	}
+	if (cms_envelop_finish(&ctx, cms + *cmslen, &len, maxlen - *cmslen) != 1) {
+		error_print();
+		return -1;
+	}
+	*cmslen += len;
+	return 1;
+}
+
+static int test_cms_stream_deenvelop(const SM2_KEY *sm2_key, const uint8_t *cert, size_t certlen,
+	const uint8_t *cms, size_t cmslen, size_t chunk, uint8_t *content, size_t *content_len)
+{
+	CMS_DEENVELOP_CTX ctx;
+	size_t off = 0;
+	size_t len;
+	int ret = -1;
+
+	*content_len = 0;
+	if (cms_deenvelop_init(&ctx, sm2_key, cert, certlen) != 1) {
+		error_print();
+		return -1;
+	}
+	while (off < cmslen) {
+		size_t n = cmslen - off < chunk ? cmslen - off : chunk;
+		if (cms_deenvelop_update(&ctx, cms + off, n, content + *content_len, &len) != 1) {
+			goto end;
+		}
+		*content_len += len;
+		off += n;
+	}
+	if (cms_deenvelop_finish(&ctx, content + *content_len, &len) != 1) {
+		goto end;
+	}
+	*content_len += len;
+	ret = 1;
+end:
+	cms_deenvelop_cleanup(&ctx);
+	return ret;
+}
+
+static int test_cms_envelop_stream(void)
+{
+	SM2_KEY sm2_key;
+	uint8_t cert[1024];
+	size_t certlen;
+	uint8_t data[5000];
+	uint8_t cms[8192];
+	size_t cmslen;
+	uint8_t content[5000 + 256];
+	size_t content_len;
+	int content_type;
+	const uint8_t *rcpt_infos, *shared_info1, *shared_info2;
+	size_t rcpt_infos_len, shared_info1_len, shared_info2_len;
+	size_t lens[] = { 0, 15, 16, 17, sizeof(data) };
+	size_t i;
+
+	if (test_cms_stream_cert(&sm2_key, cert, &certlen, sizeof(cert)) != 1
+		|| rand_bytes(data, sizeof(data)) != 1) {
+		error_print();
+		return -1;
+	}
+
+	for (i = 0; i < sizeof(lens)/sizeof(lens[0]); i++) {
+		size_t datalen = lens[i];
+
+		// known length, readable by cms_deenvelop()
+		if (test_cms_stream_envelop(cert, certlen, datalen, data, datalen, 100, cms, &cmslen, sizeof(cms)) != 1
+			|| cms_deenvelop(cms, cmslen, &sm2_key, cert, certlen,
+				&content_type, content, &content_len,
+				&rcpt_infos, &rcpt_infos_len,
+				&shared_info1, &shared_info1_len,
+				&shared_info2, &shared_info2_len) != 1
+			|| content_type != OID_cms_data
+			|| content_len != datalen
+			|| memcmp(content, data, datalen) != 0) {
+			error_print();
+			return -1;
+		}
+		if (test_cms_stream_deenvelop(&sm2_key, cert, certlen, cms, cmslen, 5, content, &content_len) != 1
+			|| content_len != datalen
+			|| memcmp(content, data, datalen) != 0) {
+			error_print();
+			return -1;
+		}
+
+		// unknown length
+		if (test_cms_stream_envelop(cert, certlen, CMS_CONTENT_LEN_UNKNOWN, data, datalen, 33, cms, &cmslen, sizeof(cms)) != 1
+			|| test_cms_stream_deenvelop(&sm2_key, cert, certlen, cms, cmslen, 11, content, &content_len) != 1
+			|| content_len != datalen
+			|| memcmp(content, data, datalen) != 0) {
+			error_print();
+			return -1;
+		}
+	}
+
+	// truncated message
+	if (test_cms_stream_deenvelop(&sm2_key, cert, certlen, cms, cmslen - 2, 64, content, &content_len) == 1) {
+		error_print();
+		return -1;
+	}
+
+	printf("%s() ok\n", __FUNCTION__);
+	return 1;
+}
+
 int main(int argc, char **argv)
 {
 	if (test_cms_content_type() != 1) goto err;
@@ -1034,6 +1332,8 @@ int main(int argc, char **argv)
 	if (test_cms_recipient_info() != 1) goto err;
 	if (test_cms_enveloped_data() != 1) goto err;
 	if (test_cms_key_agreement_info() != 1) goto err;
+	if (test_cms_sign_stream() != 1) goto err;
+	if (test_cms_envelop_stream() != 1) goto err;
 
 	printf("%s all tests passed\n", __FILE__);
 	return 0;
@@ -13,7 +13,10 @@
 #include <string.h>
 #include <stdlib.h>
 #include <gmssl/hex.h>
+#include <sys/time.h>
 #include <gmssl/pbkdf2.h>
+#include <gmssl/digest.h>
+#include <gmssl/rand.h>
 #include <gmssl/error.h>
 
 
@@ -130,9 +133,167 @@ static int test_pbkdf2_genkey(void)
 	return 0;
 }
 
+// the lane implementation against the generic HMAC one
+static int test_pbkdf2_hmac_sm3_genkey(void)
+{
+	char pass[100];
+	uint8_t salt[16];
+	struct {
+		size_t passlen;
+		size_t count;
+		size_t outlen;
+	} tests[] = {
+		{ 8, 1, 32 },
+		{ 8, 2, 16 },
+		{ 1, 10, 32 },
+		{ 64, 100, 100 },
+		{ 100, 1000, 33 },
+		{ 20, 3, 300 },
+	};
+	uint8_t key[300];
+	uint8_t buf[300];
+	size_t i;
+
+	if (rand_bytes((uint8_t *)pass, sizeof(pass)) != 1
+		|| rand_bytes(salt, sizeof(salt)) != 1) {
+		error_print();
+		return -1;
+	}
+	for (i = 0; i < sizeof(tests)/sizeof(tests[0]); i++) {
+		if (pbkdf2_hmac_sm3_genkey(pass, tests[i].passlen, salt, sizeof(salt),
+				tests[i].count, tests[i].outlen, key) != 1
+			|| pbkdf2_genkey(DIGEST_sm3(), pass, tests[i].passlen, salt, sizeof(salt),
+				tests[i].count, tests[i].outlen, buf) != 1) {
+			error_print();
+			return -1;
+		}
+		if (memcmp(key, buf, tests[i].outlen) != 0) {
+			fprintf(stderr, "%s: test %zu failed\n", __FUNCTION__, i);
+			return -1;
+		}
+	}
+	printf("%s() ok\n", __FUNCTION__);
+	return 1;
+}
+
+static int test_pbkdf2_hmac_sm3_batch(void)
+{
+	char pass[11][16];
+	uint8_t salt[11][8];
+	uint8_t keys[11][40];
+	uint8_t buf[40];
+	PBKDF2_SM3_JOB jobs[11];
+	int results[11];
+	size_t i;
+
+	if (rand_bytes((uint8_t *)pass, sizeof(pass)) != 1
+		|| rand_bytes((uint8_t *)salt, sizeof(salt)) != 1) {
+		error_print();
+		return -1;
+	}
+	// different counts and lengths, more jobs than lanes
+	for (i = 0; i < 11; i++) {
+		jobs[i].pass = pass[i];
+		jobs[i].passlen = 4 + i;
+		jobs[i].salt = salt[i];
+		jobs[i].saltlen = sizeof(salt[i]);
+		jobs[i].count = 50 + (i % 3) * 25;
+		jobs[i].outlen = i == 5 ? 40 : 16;
+		jobs[i].out = keys[i];
+	}
+	if (pbkdf2_hmac_sm3_genkey_batch(jobs, 11) != 1) {
+		error_print();
+		return -1;
+	}
+	for (i = 0; i < 11; i++) {
+		if (pbkdf2_genkey(DIGEST_sm3(), jobs[i].pass, jobs[i].passlen, jobs[i].salt, jobs[i].saltlen,
+				jobs[i].count, jobs[i].outlen, buf) != 1
+			|| memcmp(buf, keys[i], jobs[i].outlen) != 0) {
+			fprintf(stderr, "%s: job %zu failed\n", __FUNCTION__, i);
+			return -1;
+		}
+	}
+
+	keys[7][3] ^= 1;
+	if (pbkdf2_hmac_sm3_verify_batch(jobs, 11, results) != 1) {
+		error_print();
+		return -1;
+	}
+	for (i = 0; i < 11; i++) {
+		if (results[i] != (i == 7 ? 0 : 1)) {
+			error_print();
+			return -1;
+		}
+	}
+	printf("%s() ok\n", __FUNCTION__);
+	return 1;
+}
+
+static long getMicrotime(void)
+{
+	struct timeval currentTime;
+	gettimeofday(&currentTime, NULL);
+	return currentTime.tv_sec * (int)1e6 + currentTime.tv_usec;
+}
+
+static int speed_pbkdf2_hmac_sm3(void)
+{
+	char pass[8][12];
+	uint8_t salt[8];
+	uint8_t keys[8][32];
+	PBKDF2_SM3_JOB jobs[8];
+	int results[8];
+	long pre, cost_genkey, cost_batch;
+	int i;
+
+	if (rand_bytes((uint8_t *)pass, sizeof(pass)) != 1
+		|| rand_bytes(salt, sizeof(salt)) != 1) {
+		error_print();
+		return -1;
+	}
+	for (i = 0; i < 8; i++) {
+		jobs[i].pass = pass[i];
+		jobs[i].passlen = sizeof(pass[i]);
+		jobs[i].salt = salt;
+		jobs[i].saltlen = sizeof(salt);
+		jobs[i].count = PBKDF2_MIN_ITER;
+		jobs[i].outlen = sizeof(keys[i]);
+		jobs[i].out = keys[i];
+	}
+
+	pre = getMicrotime();
+	for (i = 0; i < 8; i++) {
+		if (pbkdf2_genkey(DIGEST_sm3(), pass[i], sizeof(pass[i]), salt, sizeof(salt),
+			PBKDF2_MIN_ITER, sizeof(keys[i]), keys[i]) != 1) {
+			error_print();
+			return -1;
+		}
+	}
+	cost_genkey = getMicrotime() - pre;
+
+	pre = getMicrotime();
+	if (pbkdf2_hmac_sm3_verify_batch(jobs, 8, results) != 1) {
+		error_print();
+		return -1;
+	}
+	cost_batch = getMicrotime() - pre;
+	for (i = 0; i < 8; i++) {
+		if (results[i] != 1) {
+			error_print();
+			return -1;
+		}
+	}
+	printf("8 passwords, %d iterations: pbkdf2_genkey %ld us, pbkdf2_hmac_sm3_verify_batch %ld us\n",
+		PBKDF2_MIN_ITER, cost_genkey, cost_batch);
+	return 1;
+}
+
 int main(int argc, char **argv)
 {
 	int err = 0;
 	err += test_pbkdf2_genkey();
+	if (test_pbkdf2_hmac_sm3_genkey() != 1) err++;
+	if (test_pbkdf2_hmac_sm3_batch() != 1) err++;
+	if (speed_pbkdf2_hmac_sm3() != 1) err++;
 	return err;
 }
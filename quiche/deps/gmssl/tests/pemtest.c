@@ -11,9 +11,152 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/time.h>
 #include <gmssl/pem.h>
+#include <gmssl/rand.h>
+#include <gmssl/error.h>
+
+
+#define TEST_BUNDLE_FILE	"pemtest_bundle.pem"
+
+static int test_pem_read_bundle(void)
+{
+	uint8_t data[3][700];
+	size_t datalen[3] = { 1, 500, 700 };
+	uint8_t *buf = NULL;
+	size_t buflen;
+	size_t i, off;
+	FILE *fp;
+
+	if (rand_bytes(data[0], sizeof(data)) != 1
+		|| !(fp = fopen(TEST_BUNDLE_FILE, "w"))) {
+		error_print();
+		return -1;
+	}
+	// comments and other blocks between the certificates are skipped
+	fprintf(fp, "# CA bundle\n\n");
+	pem_write(fp, "CERTIFICATE", data[0], datalen[0]);
+	pem_write(fp, "PRIVATE KEY", data[1], datalen[1]);
+	fprintf(fp, "# Issuer: CN=Test\n");
+	pem_write(fp, "CERTIFICATE", data[1], datalen[1]);
+	pem_write(fp, "CERTIFICATE", data[2], datalen[2]);
+	fclose(fp);
+
+	if (pem_read_bundle(TEST_BUNDLE_FILE, "CERTIFICATE", &buf, &buflen) != 1
+		|| buflen != datalen[0] + datalen[1] + datalen[2]) {
+		error_print();
+		goto err;
+	}
+	for (i = off = 0; i < 3; i++) {
+		if (memcmp(buf + off, data[i], datalen[i]) != 0) {
+			error_print();
+			goto err;
+		}
+		off += datalen[i];
+	}
+	free(buf);
+	buf = NULL;
+
+	if (pem_read_bundle(TEST_BUNDLE_FILE, "X509 CRL", &buf, &buflen) != 0) {
+		error_print();
+		goto err;
+	}
+
+	// truncated last block
+	if (!(fp = fopen(TEST_BUNDLE_FILE, "w"))) {
+		error_print();
+		goto err;
+	}
+	pem_write(fp, "CERTIFICATE", data[0], datalen[0]);
+	fprintf(fp, "-----BEGIN CERTIFICATE-----\nAAAA\n");
+	fclose(fp);
+	if (pem_read_bundle(TEST_BUNDLE_FILE, "CERTIFICATE", &buf, &buflen) != -1) {
+		error_print();
+		goto err;
+	}
+
+	remove(TEST_BUNDLE_FILE);
+	printf("%s() ok\n", __FUNCTION__);
+	return 1;
+err:
+	if (buf) free(buf);
+	remove(TEST_BUNDLE_FILE);
+	return -1;
+}
+
+static long getMicrotime(void)
+{
+	struct timeval currentTime;
+	gettimeofday(&currentTime, NULL);
+	return currentTime.tv_sec * (int)1e6 + currentTime.tv_usec;
+}
+
+// a 5000-certificate trust bundle, read with pem_read() and with pem_read_bundle()
+static int speed_pem_read_bundle(void)
+{
+	int count = 5000;
+	uint8_t cert[800];
+	uint8_t *buf = NULL;
+	size_t buflen, len, total = 0;
+	long pre, cost_read, cost_bundle;
+	FILE *fp;
+	int i;
+
+	if (rand_bytes(cert, sizeof(cert)) != 1
+		|| !(fp = fopen(TEST_BUNDLE_FILE, "w"))) {
+		error_print();
+		return -1;
+	}
+	for (i = 0; i < count; i++) {
+		pem_write(fp, "CERTIFICATE", cert, sizeof(cert));
+	}
+	fclose(fp);
+
+	// pem_read() may write up to 2 bytes of padding past the data
+	if (!(buf = malloc(sizeof(cert) * count + 2))
+		|| !(fp = fopen(TEST_BUNDLE_FILE, "r"))) {
+		error_print();
+		goto err;
+	}
+	pre = getMicrotime();
+	while (pem_read(fp, "CERTIFICATE", buf + total, &len, sizeof(cert) * count + 2 - total) == 1) {
+		total += len;
+	}
+	cost_read = getMicrotime() - pre;
+	fclose(fp);
+	free(buf);
+	buf = NULL;
+
+	pre = getMicrotime();
+	if (pem_read_bundle(TEST_BUNDLE_FILE, "CERTIFICATE", &buf, &buflen) != 1) {
+		error_print();
+		goto err;
+	}
+	cost_bundle = getMicrotime() - pre;
+
+	if (total != sizeof(cert) * count || buflen != total) {
+		error_print();
+		goto err;
+	}
+	printf("load %d PEM certificates: pem_read %ld us, pem_read_bundle %ld us\n",
+		count, cost_read, cost_bundle);
+
+	free(buf);
+	remove(TEST_BUNDLE_FILE);
+	return 1;
+err:
+	if (buf) free(buf);
+	remove(TEST_BUNDLE_FILE);
+	return -1;
+}
 
 int main(void)
 {
+	if (test_pem_read_bundle() != 1) goto err;
+	if (speed_pem_read_bundle() != 1) goto err;
+	printf("%s all tests passed\n", __FILE__);
 	return 0;
+err:
+	error_print();
+	return 1;
 }
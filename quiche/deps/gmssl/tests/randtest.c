@@ -0,0 +1,142 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <gmssl/rand.h>
+#include <gmssl/error.h>
+
+
+static int test_rand_bytes(void)
+{
+	uint8_t buf1[32];
+	uint8_t buf2[32];
+	size_t big_len = 1 << 20;
+	uint8_t *big;
+
+	if (rand_bytes(buf1, sizeof(buf1)) != 1
+		|| rand_bytes(buf2, sizeof(buf2)) != 1) {
+		error_print();
+		return -1;
+	}
+	if (memcmp(buf1, buf2, sizeof(buf1)) == 0) {
+		error_print();
+		return -1;
+	}
+
+	// requests are no longer limited to 4096 bytes
+	if (!(big = malloc(big_len))) {
+		error_print();
+		return -1;
+	}
+	memset(big, 0, big_len);
+	if (rand_bytes(big, big_len) != 1
+		|| memcmp(big + big_len - sizeof(buf1), big, sizeof(buf1)) == 0) {
+		error_print();
+		free(big);
+		return -1;
+	}
+	free(big);
+
+	printf("%s() ok\n", __FUNCTION__);
+	return 1;
+}
+
+static int test_rand_bytes_fork(void)
+{
+	uint8_t parent[32];
+	uint8_t child[32];
+	int fds[2];
+	pid_t pid;
+	int status;
+
+	// make sure the parent state is seeded before forking
+	if (rand_bytes(parent, sizeof(parent)) != 1) {
+		error_print();
+		return -1;
+	}
+	if (pipe(fds) != 0) {
+		error_print();
+		return -1;
+	}
+	if ((pid = fork()) < 0) {
+		error_print();
+		return -1;
+	}
+	if (pid == 0) {
+		close(fds[0]);
+		if (rand_bytes(child, sizeof(child)) != 1
+			|| write(fds[1], child, sizeof(child)) != sizeof(child)) {
+			_exit(1);
+		}
+		_exit(0);
+	}
+	close(fds[1]);
+	if (rand_bytes(parent, sizeof(parent)) != 1
+		|| read(fds[0], child, sizeof(child)) != sizeof(child)
+		|| waitpid(pid, &status, 0) != pid
+		|| !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		error_print();
+		close(fds[0]);
+		return -1;
+	}
+	close(fds[0]);
+
+	if (memcmp(parent, child, sizeof(parent)) == 0) {
+		error_print();
+		return -1;
+	}
+
+	printf("%s() ok\n", __FUNCTION__);
+	return 1;
+}
+
+static long getMicrotime(void)
+{
+	struct timeval currentTime;
+	gettimeofday(&currentTime, NULL);
+	return currentTime.tv_sec * (int)1e6 + currentTime.tv_usec;
+}
+
+static int speed_rand_bytes(void)
+{
+	uint8_t buf[32];
+	int count = 100000;
+	long pre, cost;
+	int i;
+
+	pre = getMicrotime();
+	for (i = 0; i < count; i++) {
+		if (rand_bytes(buf, sizeof(buf)) != 1) {
+			error_print();
+			return -1;
+		}
+	}
+	cost = getMicrotime() - pre;
+
+	printf("rand_bytes: %.1f ns per 32-byte draw\n", (double)cost * 1000 / count);
+	return 1;
+}
+
+int main(void)
+{
+	if (test_rand_bytes() != 1) goto err;
+	if (test_rand_bytes_fork() != 1) goto err;
+	if (speed_rand_bytes() != 1) goto err;
+	printf("%s all tests passed\n", __FILE__);
+	return 0;
+err:
+	error_print();
+	return 1;
+}
@@ -0,0 +1,263 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <gmssl/sm2.h>
+#include <gmssl/sm3.h>
+#include <gmssl/sdf.h>
+#include <gmssl/tls.h>
+#include <gmssl/rand.h>
+#include <gmssl/error.h>
+
+
+#define SDF_TEST_KEY_INDEX	1
+#define SDF_TEST_PASS		"12345678"
+#define SDF_TEST_JOBS		64
+
+static SDF_DEVICE dev;
+
+static pthread_mutex_t callback_lock = PTHREAD_MUTEX_INITIALIZER;
+static int callback_cnt;
+
+static void test_callback(SDF_JOB *job, void *arg)
+{
+	pthread_mutex_lock(&callback_lock);
+	callback_cnt += (arg == (void *)job) ? 1 : 0;
+	pthread_mutex_unlock(&callback_lock);
+}
+
+// The dummy device returns r = s = dgst
+static int test_check_dummy_sig(const uint8_t dgst[32], const uint8_t *sig, size_t siglen)
+{
+	SM2_SIGNATURE sm2_sig;
+
+	if (sm2_signature_from_der(&sm2_sig, &sig, &siglen) != 1
+		|| siglen != 0
+		|| memcmp(sm2_sig.r, dgst, 32) != 0) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+static int test_sdf_async(void)
+{
+	SDF_ASYNC async;
+	SDF_JOB jobs[SDF_TEST_JOBS];
+	uint8_t dgst[32];
+	uint8_t rand_bufs[SDF_TEST_JOBS][600];
+	uint8_t in[SDF_TEST_JOBS][32];
+	uint8_t out[SDF_TEST_JOBS][32];
+	uint8_t wrapped_key[2][16] = {{0}, {1}};
+	uint8_t iv[16] = {0};
+	uint8_t sig[SM2_MAX_SIGNATURE_SIZE];
+	size_t siglen;
+	int i;
+
+	if (sdf_async_init(&async, &dev, SDF_TEST_KEY_INDEX, SDF_TEST_PASS, 4) != 1) {
+		error_print();
+		return -1;
+	}
+
+	// sign jobs, completed through the callback
+	callback_cnt = 0;
+	for (i = 0; i < SDF_TEST_JOBS; i++) {
+		memset(dgst, i, sizeof(dgst));
+		sdf_job_init_sign(&jobs[i], dgst);
+		if (sdf_async_submit(&async, &jobs[i], test_callback, &jobs[i]) != 1) {
+			error_print();
+			goto err;
+		}
+	}
+	for (i = 0; i < SDF_TEST_JOBS; i++) {
+		if (sdf_async_wait(&async, &jobs[i]) != 1
+			|| sdf_async_poll(&async, &jobs[i]) != 1
+			|| test_check_dummy_sig(jobs[i].dgst, jobs[i].sig, jobs[i].siglen) != 1) {
+			error_print();
+			goto err;
+		}
+	}
+	if (callback_cnt != SDF_TEST_JOBS) {
+		error_print();
+		goto err;
+	}
+
+	// random requests of a batch share one device call, the larger ones are served alone
+	for (i = 0; i < SDF_TEST_JOBS; i++) {
+		sdf_job_init_rand_bytes(&jobs[i], rand_bufs[i], (i % 3 == 0) ? sizeof(rand_bufs[i]) : 100);
+		if (sdf_async_submit(&async, &jobs[i], NULL, NULL) != 1) {
+			error_print();
+			goto err;
+		}
+	}
+	for (i = 0; i < SDF_TEST_JOBS; i++) {
+		if (sdf_async_wait(&async, &jobs[i]) != 1) {
+			error_print();
+			goto err;
+		}
+	}
+
+	// encrypt jobs with two session keys, the dummy device does not encrypt
+	for (i = 0; i < SDF_TEST_JOBS; i++) {
+		memset(in[i], i, sizeof(in[i]));
+		if (sdf_job_init_encrypt(&jobs[i], 1, wrapped_key[(i/4) % 2], sizeof(wrapped_key[0]),
+				0x00000402, iv, in[i], sizeof(in[i]), out[i]) != 1
+			|| sdf_async_submit(&async, &jobs[i], NULL, NULL) != 1) {
+			error_print();
+			goto err;
+		}
+	}
+	for (i = 0; i < SDF_TEST_JOBS; i++) {
+		if (sdf_async_wait(&async, &jobs[i]) != 1
+			|| jobs[i].outlen != sizeof(in[i])
+			|| memcmp(out[i], in[i], sizeof(in[i])) != 0) {
+			error_print();
+			goto err;
+		}
+	}
+
+	memset(dgst, 0xab, sizeof(dgst));
+	if (sdf_async_sign(&async, dgst, sig, &siglen) != 1
+		|| test_check_dummy_sig(dgst, sig, siglen) != 1) {
+		error_print();
+		goto err;
+	}
+
+	sdf_async_cleanup(&async);
+	printf("%s() ok\n", __FUNCTION__);
+	return 1;
+err:
+	sdf_async_cleanup(&async);
+	return -1;
+}
+
+static int test_tls_sign_offload(void)
+{
+	SDF_ASYNC async;
+	SM2_SIGN_CTX sign_ctx;
+	SM3_CTX sm3_ctx;
+	uint8_t msg[100] = {1, 2, 3};
+	uint8_t dgst[32];
+	uint8_t sig[SM2_MAX_SIGNATURE_SIZE];
+	size_t siglen;
+
+	if (sdf_async_init(&async, &dev, SDF_TEST_KEY_INDEX, SDF_TEST_PASS, 1) != 1) {
+		error_print();
+		return -1;
+	}
+	// the private key is not known, the message is hashed with the Z of the device key
+	if (sm2_sign_init(&sign_ctx, &async.public_key, SM2_DEFAULT_ID, SM2_DEFAULT_ID_LENGTH) != 1
+		|| sm2_sign_update(&sign_ctx, msg, sizeof(msg)) != 1) {
+		error_print();
+		goto err;
+	}
+	sm3_ctx = sign_ctx.sm3_ctx;
+	sm3_finish(&sm3_ctx, dgst);
+	if (tls_sm2_sign_finish(&sign_ctx, &async, sig, &siglen) != 1
+		|| test_check_dummy_sig(dgst, sig, siglen) != 1) {
+		error_print();
+		goto err;
+	}
+
+	sdf_async_cleanup(&async);
+	printf("%s() ok\n", __FUNCTION__);
+	return 1;
+err:
+	sdf_async_cleanup(&async);
+	return -1;
+}
+
+static long getMicrotime(void)
+{
+	struct timeval currentTime;
+	gettimeofday(&currentTime, NULL);
+	return currentTime.tv_sec * (int)1e6 + currentTime.tv_usec;
+}
+
+static int speed_sdf_async_sign(void)
+{
+	SDF_KEY key;
+	SDF_ASYNC async;
+	SDF_JOB jobs[SDF_TEST_JOBS];
+	uint8_t dgst[32] = {0};
+	uint8_t sig[SM2_MAX_SIGNATURE_SIZE];
+	size_t siglen;
+	long pre, cost_sync, cost_async;
+	int i;
+
+	// 1ms per device call
+	setenv("SDF_DUMMY_LATENCY_US", "1000", 1);
+
+	if (sdf_load_sign_key(&dev, &key, SDF_TEST_KEY_INDEX, SDF_TEST_PASS) != 1) {
+		error_print();
+		return -1;
+	}
+	pre = getMicrotime();
+	for (i = 0; i < SDF_TEST_JOBS; i++) {
+		if (sdf_sign(&key, dgst, sig, &siglen) != 1) {
+			error_print();
+			sdf_release_key(&key);
+			return -1;
+		}
+	}
+	cost_sync = getMicrotime() - pre;
+	sdf_release_key(&key);
+
+	if (sdf_async_init(&async, &dev, SDF_TEST_KEY_INDEX, SDF_TEST_PASS, 8) != 1) {
+		error_print();
+		return -1;
+	}
+	pre = getMicrotime();
+	for (i = 0; i < SDF_TEST_JOBS; i++) {
+		sdf_job_init_sign(&jobs[i], dgst);
+		if (sdf_async_submit(&async, &jobs[i], NULL, NULL) != 1) {
+			error_print();
+			goto err;
+		}
+	}
+	for (i = 0; i < SDF_TEST_JOBS; i++) {
+		if (sdf_async_wait(&async, &jobs[i]) != 1) {
+			error_print();
+			goto err;
+		}
+	}
+	cost_async = getMicrotime() - pre;
+	sdf_async_cleanup(&async);
+	unsetenv("SDF_DUMMY_LATENCY_US");
+
+	printf("%d signs with 1ms device latency: sdf_sign %ld us, SDF_ASYNC with 8 workers %ld us\n",
+		SDF_TEST_JOBS, cost_sync, cost_async);
+	return 1;
+err:
+	sdf_async_cleanup(&async);
+	return -1;
+}
+
+int main(void)
+{
+	if (sdf_load_library(SDF_DUMMY_LIBRARY, NULL) != 1
+		|| sdf_open_device(&dev) != 1) {
+		goto err;
+	}
+	if (test_sdf_async() != 1) goto err;
+	if (test_tls_sign_offload() != 1) goto err;
+	if (speed_sdf_async_sign() != 1) goto err;
+	sdf_close_device(&dev);
+	sdf_unload_library();
+	printf("%s all tests passed\n", __FILE__);
+	return 0;
+err:
+	error_print();
+	return 1;
+}
@@ -0,0 +1,302 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <gmssl/sm2_key_pool.h>
+#include <gmssl/error.h>
+
+
+static int wait_full(SM2_KEY_POOL *pool)
+{
+	int i;
+
+	for (i = 0; i < 1000; i++) {
+		if (sm2_key_pool_count(pool) == pool->size) {
+			return 1;
+		}
+		usleep(10000);
+	}
+	error_print();
+	return -1;
+}
+
+static int check_key(const SM2_KEY *key)
+{
+	uint8_t dgst[32] = { 1, 2, 3 };
+	SM2_SIGNATURE sig;
+
+	if (sm2_do_sign(key, dgst, &sig) != 1
+		|| sm2_do_verify(key, dgst, &sig) != 1) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+static int cmp_key(const void *a, const void *b)
+{
+	return memcmp(((const SM2_KEY *)a)->private_key, ((const SM2_KEY *)b)->private_key, 32);
+}
+
+static int test_sm2_key_pool(void)
+{
+	SM2_KEY_POOL pool;
+	SM2_KEY keys[17];
+	uint64_t hits, misses;
+	size_t i;
+
+	if (sm2_key_pool_init(&pool, 12, 16) != -1) { // low_water not below the rounded size
+		error_print();
+		return -1;
+	}
+	if (sm2_key_pool_init(&pool, 12, 4) != 1) {
+		error_print();
+		return -1;
+	}
+	if (pool.size != 16 || wait_full(&pool) != 1) {
+		error_print();
+		goto err;
+	}
+
+	for (i = 0; i < 16; i++) {
+		if (sm2_key_pool_get(&pool, &keys[i]) != 1
+			|| check_key(&keys[i]) != 1) {
+			error_print();
+			goto err;
+		}
+	}
+	sm2_key_pool_get_stats(&pool, &hits, &misses);
+	if (hits != 16 || misses != 0) {
+		error_print();
+		goto err;
+	}
+
+	// below the low-water mark the ring is filled again
+	if (wait_full(&pool) != 1
+		|| sm2_key_pool_get(&pool, &keys[16]) != 1
+		|| check_key(&keys[16]) != 1) {
+		error_print();
+		goto err;
+	}
+	qsort(keys, 17, sizeof(SM2_KEY), cmp_key);
+	for (i = 1; i < 17; i++) {
+		if (cmp_key(&keys[i - 1], &keys[i]) == 0) {
+			error_print();
+			goto err;
+		}
+	}
+
+	sm2_key_pool_cleanup(&pool);
+	printf("%s() ok\n", __FUNCTION__);
+	return 1;
+err:
+	sm2_key_pool_cleanup(&pool);
+	return -1;
+}
+
+#define TAKERS		4
+#define TAKES		100
+
+static SM2_KEY taken[TAKERS][TAKES];
+
+typedef struct {
+	SM2_KEY_POOL *pool;
+	SM2_KEY *keys;
+	int ret;
+} TAKER_ARG;
+
+static void *taker_thread(void *p)
+{
+	TAKER_ARG *arg = (TAKER_ARG *)p;
+	int i;
+
+	arg->ret = -1;
+	for (i = 0; i < TAKES; i++) {
+		if (sm2_key_pool_get(arg->pool, &arg->keys[i]) != 1) {
+			error_print();
+			return NULL;
+		}
+	}
+	arg->ret = 1;
+	return NULL;
+}
+
+static int test_sm2_key_pool_threads(void)
+{
+	SM2_KEY_POOL pool;
+	pthread_t threads[TAKERS];
+	TAKER_ARG args[TAKERS];
+	uint64_t hits, misses;
+	size_t i;
+
+	if (sm2_key_pool_init(&pool, 64, 16) != 1) {
+		error_print();
+		return -1;
+	}
+	if (wait_full(&pool) != 1) {
+		goto err;
+	}
+	for (i = 0; i < TAKERS; i++) {
+		args[i].pool = &pool;
+		args[i].keys = taken[i];
+		if (pthread_create(&threads[i], NULL, taker_thread, &args[i]) != 0) {
+			error_print();
+			goto err;
+		}
+	}
+	for (i = 0; i < TAKERS; i++) {
+		pthread_join(threads[i], NULL);
+		if (args[i].ret != 1) {
+			error_print();
+			goto err;
+		}
+	}
+
+	// every key handed out once, whether from the ring or generated on a miss
+	sm2_key_pool_get_stats(&pool, &hits, &misses);
+	if (hits + misses != TAKERS * TAKES || hits < 64) {
+		error_print();
+		goto err;
+	}
+	qsort(taken, TAKERS * TAKES, sizeof(SM2_KEY), cmp_key);
+	for (i = 1; i < TAKERS * TAKES; i++) {
+		if (cmp_key(&taken[0][i - 1], &taken[0][i]) == 0) {
+			error_print();
+			goto err;
+		}
+	}
+
+	sm2_key_pool_cleanup(&pool);
+	printf("%s() ok\n", __FUNCTION__);
+	return 1;
+err:
+	sm2_key_pool_cleanup(&pool);
+	return -1;
+}
+
+static int test_sm2_key_pool_fork(void)
+{
+	SM2_KEY_POOL pool;
+	SM2_KEY key;
+	uint64_t hits, misses;
+	pid_t pid;
+	int status;
+
+	if (sm2_key_pool_init(&pool, 8, 2) != 1) {
+		error_print();
+		return -1;
+	}
+	if (wait_full(&pool) != 1) {
+		goto err;
+	}
+
+	if ((pid = fork()) < 0) {
+		error_print();
+		goto err;
+	}
+	if (pid == 0) {
+		// keys generated before the fork must not be served in the child
+		if (sm2_key_pool_get(&pool, &key) != 1) {
+			_exit(1);
+		}
+		sm2_key_pool_get_stats(&pool, &hits, &misses);
+		if (hits != 0 || misses != 1 || sm2_key_pool_count(&pool) != 8) {
+			_exit(1);
+		}
+		sm2_key_pool_cleanup(&pool);
+		_exit(0);
+	}
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		error_print();
+		goto err;
+	}
+
+	if (sm2_key_pool_get(&pool, &key) != 1) {
+		error_print();
+		goto err;
+	}
+	sm2_key_pool_get_stats(&pool, &hits, &misses);
+	if (hits != 1 || misses != 0) {
+		error_print();
+		goto err;
+	}
+
+	sm2_key_pool_cleanup(&pool);
+	printf("%s() ok\n", __FUNCTION__);
+	return 1;
+err:
+	sm2_key_pool_cleanup(&pool);
+	return -1;
+}
+
+static long getMicrotime(void)
+{
+	struct timeval currentTime;
+	gettimeofday(&currentTime, NULL);
+	return currentTime.tv_sec * (int)1e6 + currentTime.tv_usec;
+}
+
+// cost of the ephemeral key on the connection setup path
+static int speed_sm2_key_pool(void)
+{
+	SM2_KEY_POOL pool;
+	SM2_KEY key;
+	int count = 256;
+	long pre, cost_generate, cost_pool;
+	int i;
+
+	if (sm2_key_pool_init(&pool, count, count / 4) != 1) {
+		error_print();
+		return -1;
+	}
+	if (wait_full(&pool) != 1) {
+		goto err;
+	}
+
+	pre = getMicrotime();
+	for (i = 0; i < count; i++) {
+		sm2_key_generate(&key);
+	}
+	cost_generate = getMicrotime() - pre;
+
+	pre = getMicrotime();
+	for (i = 0; i < count; i++) {
+		sm2_key_pool_get(&pool, &key);
+	}
+	cost_pool = getMicrotime() - pre;
+
+	printf("%d SM2 keys: sm2_key_generate %ld us, sm2_key_pool_get %ld us\n",
+		count, cost_generate, cost_pool);
+
+	sm2_key_pool_cleanup(&pool);
+	return 1;
+err:
+	sm2_key_pool_cleanup(&pool);
+	return -1;
+}
+
+int main(void)
+{
+	if (test_sm2_key_pool() != 1) goto err;
+	if (test_sm2_key_pool_threads() != 1) goto err;
+	if (test_sm2_key_pool_fork() != 1) goto err;
+	if (speed_sm2_key_pool() != 1) goto err;
+	printf("%s all tests passed\n", __FILE__);
+	return 0;
+err:
+	error_print();
+	return 1;
+}
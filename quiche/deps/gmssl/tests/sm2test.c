@@ -707,6 +707,183 @@ float dec=(float)(decTime)/1000000;
 
 
 
+static int test_sm2_point_mul_ct(void)
+{
+	SM2_JACOBIAN_POINT _P, *P = &_P;
+	SM2_JACOBIAN_POINT _R, *R = &_R;
+	SM2_JACOBIAN_POINT _L, *L = &_L;
+	SM2_BN k;
+	uint8_t a[64], b[64];
+	int i;
+
+	// a random point rather than G, which is affine
+	sm2_fn_rand(k);
+	sm2_jacobian_point_mul_generator(P, k);
+
+	for (i = 0; i < 36; i++) {
+		if (i < 4) {
+			// the scalars next to 0 and n
+			sm2_bn_set_word(k, (uint32_t)(i % 2 + 1));
+			if (i >= 2) {
+				sm2_bn_sub(k, SM2_N, k);
+			}
+		} else {
+			sm2_fn_rand(k);
+		}
+		sm2_jacobian_point_mul(R, k, P);
+		sm2_jacobian_point_mul_ladder(L, k, P);
+		sm2_jacobian_point_to_bytes(R, a);
+		sm2_jacobian_point_to_bytes(L, b);
+		if (memcmp(a, b, sizeof(a)) != 0) {
+			error_print();
+			return -1;
+		}
+		sm2_jacobian_point_mul_generator(R, k);
+		sm2_jacobian_point_to_bytes(R, a);
+		sm2_jacobian_point_mul_ladder(L, k, SM2_G);
+		sm2_jacobian_point_to_bytes(L, b);
+		if (memcmp(a, b, sizeof(a)) != 0) {
+			error_print();
+			return -1;
+		}
+		sm2_jacobian_point_mul_generator_table(L, k);
+		sm2_jacobian_point_to_bytes(L, b);
+		if (memcmp(a, b, sizeof(a)) != 0) {
+			error_print();
+			return -1;
+		}
+	}
+
+	printf("%s() ok\n", __FUNCTION__);
+	return 1;
+}
+
+static int test_sm2_encrypt_raw(void)
+{
+	SM2_KEY sm2_key;
+	SM2_KEY other_key;
+	uint8_t msg[SM2_MAX_PLAINTEXT_SIZE];
+	uint8_t cbuf[SM2_MAX_RAW_CIPHERTEXT_SIZE];
+	uint8_t mbuf[SM2_MAX_PLAINTEXT_SIZE];
+	uint8_t der[SM2_MAX_CIPHERTEXT_SIZE];
+	size_t lens[] = {
+		1,
+		32,
+		33,
+		SM2_MAX_PLAINTEXT_SIZE,
+	};
+	size_t clen, mlen, derlen;
+	size_t offsets[] = { 1, 65, 97 }; // C1, C3, C2
+	int i;
+
+	if (sm2_key_generate(&sm2_key) != 1
+		|| sm2_key_generate(&other_key) != 1) {
+		error_print();
+		return -1;
+	}
+	for (i = 0; i < sizeof(msg); i++) {
+		msg[i] = (uint8_t)i;
+	}
+
+	for (i = 0; i < sizeof(lens)/sizeof(lens[0]); i++) {
+		clen = SM2_RAW_CIPHERTEXT_SIZE(lens[i]);
+		if (sm2_encrypt_raw(&sm2_key.public_key, msg, lens[i], cbuf) != 1
+			|| sm2_decrypt_raw(&sm2_key, cbuf, clen, mbuf, &mlen) != 1) {
+			error_print();
+			return -1;
+		}
+		if (mlen != lens[i] || memcmp(mbuf, msg, lens[i]) != 0) {
+			error_print();
+			return -1;
+		}
+	}
+
+	// same C1, C3 and C2 as the DER form
+	if (sm2_encrypt_raw(&sm2_key.public_key, msg, 32, cbuf) != 1) {
+		error_print();
+		return -1;
+	}
+	{
+		SM2_CIPHERTEXT C;
+		uint8_t *p = der;
+
+		memcpy(&C.point, cbuf + 1, 64);
+		memcpy(C.hash, cbuf + 65, 32);
+		memcpy(C.ciphertext, cbuf + 97, 32);
+		C.ciphertext_size = 32;
+		derlen = 0;
+		if (sm2_ciphertext_to_der(&C, &p, &derlen) != 1
+			|| sm2_decrypt(&sm2_key, der, derlen, mbuf, &mlen) != 1
+			|| mlen != 32
+			|| memcmp(mbuf, msg, 32) != 0) {
+			error_print();
+			return -1;
+		}
+	}
+
+	// every part is authenticated, and the key must match
+	clen = SM2_RAW_CIPHERTEXT_SIZE(32);
+	for (i = 0; i < sizeof(offsets)/sizeof(offsets[0]); i++) {
+		cbuf[offsets[i]] ^= 0x01;
+		if (sm2_decrypt_raw(&sm2_key, cbuf, clen, mbuf, &mlen) != -1) {
+			error_print();
+			return -1;
+		}
+		cbuf[offsets[i]] ^= 0x01;
+	}
+	if (sm2_decrypt_raw(&other_key, cbuf, clen, mbuf, &mlen) != -1
+		|| sm2_decrypt_raw(&sm2_key, cbuf, SM2_RAW_CIPHERTEXT_SIZE(0), mbuf, &mlen) != -1
+		|| sm2_decrypt_raw(&sm2_key, cbuf, clen, mbuf, &mlen) != 1) {
+		error_print();
+		return -1;
+	}
+
+	printf("%s() ok\n", __FUNCTION__);
+	return 1;
+}
+
+// key transport of a 16-byte key and 16-byte IV, as on the gm handshake
+static int speed_sm2_key_transport(void)
+{
+	SM2_KEY sm2_key;
+	uint8_t msg[32] = {0};
+	uint8_t cbuf[SM2_MAX_CIPHERTEXT_SIZE];
+	uint8_t mbuf[SM2_MAX_CIPHERTEXT_SIZE];
+	size_t clen, mlen;
+	int count = 20;
+	long pre, cost_der, cost_raw;
+	int i;
+
+	if (sm2_key_generate(&sm2_key) != 1) {
+		error_print();
+		return -1;
+	}
+
+	pre = getMicrotime();
+	for (i = 0; i < count; i++) {
+		if (sm2_pub_encrypt((uint8_t *)&sm2_key.public_key, msg, sizeof(msg), cbuf, &clen) != 1
+			|| sm2_decrypt(&sm2_key, cbuf, clen, mbuf, &mlen) != 1) {
+			error_print();
+			return -1;
+		}
+	}
+	cost_der = getMicrotime() - pre;
+
+	pre = getMicrotime();
+	for (i = 0; i < count; i++) {
+		if (sm2_encrypt_raw(&sm2_key.public_key, msg, sizeof(msg), cbuf) != 1
+			|| sm2_decrypt_raw(&sm2_key, cbuf, SM2_RAW_CIPHERTEXT_SIZE(sizeof(msg)), mbuf, &mlen) != 1) {
+			error_print();
+			return -1;
+		}
+	}
+	cost_raw = getMicrotime() - pre;
+
+	printf("SM2 key transport of %zu bytes: DER %.1f ops/s, raw %.1f ops/s\n", sizeof(msg),
+		count * 1e6 / (cost_der ? cost_der : 1), count * 1e6 / (cost_raw ? cost_raw : 1));
+	return 1;
+}
+
 static int test_sm2_private_key(void)
 {
 	SM2_KEY sm2_key;
@@ -880,6 +1057,9 @@ int main(void)
 	//if (test_sm2_ciphertext() != 1) goto err; // 需要正确的Ciphertext数据
 	//if (test_sm2_do_encrypt() != 1) goto err;
 	if (test_sm2_encrypt() != 1) goto err;
+	if (test_sm2_point_mul_ct() != 1) goto err;
+	if (test_sm2_encrypt_raw() != 1) goto err;
+	if (speed_sm2_key_transport() != 1) goto err;
 	printf("%s all tests passed\n", __FILE__);
 	
 	return 0;
@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/time.h>
 #include <gmssl/sm9.h>
 #include <gmssl/error.h>
 #include <gmssl/rand.h>
@@ -507,6 +508,13 @@ int test_sm9_pairing() {
 	sm9_bn_from_hex(k, rB); sm9_point_from_hex(&q, hex_Ppube);
 	sm9_pairing(r, SM9_P2, &q); sm9_fp12_pow(r, r, k); sm9_fp12_from_hex(s, hex_pairing3); if (!sm9_fp12_equ(r, s)) goto err; ++j;
 
+	// pairing values are in the cyclotomic subgroup
+	sm9_pairing(r, SM9_P2, &q); sm9_fp12_cyclotomic_pow(r, r, k); if (!sm9_fp12_equ(r, s)) goto err; ++j;
+	sm9_fp12_sqr(s, r); sm9_fp12_cyclotomic_sqr(r, r); if (!sm9_fp12_equ(r, s)) goto err; ++j;
+
+	// e(P, Q) with P or Q at infinity is one
+	sm9_point_set_infinity(&q); sm9_pairing(r, SM9_P2, &q); if (!sm9_fp12_is_one(r)) goto err; ++j;
+
 	printf("%s() ok\n", __FUNCTION__);
 	return 1;
 err:
@@ -606,7 +614,226 @@ err:
 	return -1;
 }
 
-int main(void) {
+int test_sm9_precomp() {
+	SM9_SIGN_MASTER_KEY sign_msk;
+	SM9_SIGN_KEY sign_key;
+	SM9_ENC_MASTER_KEY enc_msk;
+	SM9_ENC_KEY enc_key;
+	SM9_MASTER_PRECOMP *pre = NULL;
+	SM9_POINT_TABLE *table = NULL;
+	SM9_FP12_TABLE fp12_table;
+	SM9_SIGN_CTX ctx;
+	SM9_POINT p, q;
+	SM9_TWIST_POINT tp, tq;
+	sm9_fp12_t r, s;
+	sm9_bn_t k;
+	uint8_t data[20] = {1, 2, 3};
+	uint8_t sig[SM9_SIGNATURE_SIZE];
+	uint8_t out[256];
+	uint8_t dec[20];
+	size_t siglen, outlen, declen = sizeof(dec);
+	const char *id = "Alice";
+	int j = 1;
+
+	if (!(pre = malloc(sizeof(*pre))) || !(table = malloc(sizeof(*table)))) goto err; ++j;
+
+	// fixed-base tables against the generic algorithms
+	sm9_fn_rand(k);
+	sm9_point_mul(&p, k, SM9_P1); sm9_point_mul_generator(&q, k); if (!sm9_point_equ(&p, &q)) goto err; ++j;
+	sm9_point_table_init(table, &p);
+	sm9_point_mul(&q, k, &p); sm9_point_mul_table(&p, k, table); if (!sm9_point_equ(&p, &q)) goto err; ++j;
+	sm9_twist_point_mul(&tp, k, SM9_P2); sm9_twist_point_mul_generator(&tq, k); if (!sm9_twist_point_equ(&tp, &tq)) goto err; ++j;
+	sm9_pairing(r, SM9_Ppubs, SM9_P1); sm9_fp12_table_init(&fp12_table, r);
+	sm9_fp12_pow(s, r, k); sm9_fp12_pow_table(r, k, &fp12_table); if (!sm9_fp12_equ(r, s)) goto err; ++j;
+
+	// e(P1, Q1) * e(P2, Q2)
+	sm9_pairing(r, SM9_Ppubs, &q); sm9_pairing(s, SM9_P2, SM9_P1); sm9_fp12_mul(s, s, r);
+	sm9_pairing_table_init(&pre->Ppubs_lines, SM9_Ppubs);
+	sm9_pairing2_with_tables(r, sm9_p2_pairing_table_get(), SM9_P1, &pre->Ppubs_lines, &q);
+	if (!sm9_fp12_equ(r, s)) goto err; ++j;
+
+	// signatures are interchangeable with and without the precomputation
+	if (sm9_sign_master_key_generate(&sign_msk) != 1
+		|| sm9_sign_master_key_extract_key(&sign_msk, id, strlen(id), &sign_key) != 1
+		|| sm9_sign_master_precomp_init(pre, &sign_msk) != 1) goto err; ++j;
+	sm9_sign_init(&ctx);
+	sm9_sign_update(&ctx, data, sizeof(data));
+	if (sm9_sign_finish_precomp(&ctx, &sign_key, pre, sig, &siglen) != 1) goto err; ++j;
+	sm9_verify_init(&ctx);
+	sm9_verify_update(&ctx, data, sizeof(data));
+	if (sm9_verify_finish(&ctx, sig, siglen, &sign_msk, id, strlen(id)) != 1) goto err; ++j;
+	sm9_sign_init(&ctx);
+	sm9_sign_update(&ctx, data, sizeof(data));
+	if (sm9_sign_finish(&ctx, &sign_key, sig, &siglen) != 1) goto err; ++j;
+	sm9_verify_init(&ctx);
+	sm9_verify_update(&ctx, data, sizeof(data));
+	if (sm9_verify_finish_precomp(&ctx, sig, siglen, pre, id, strlen(id)) != 1) goto err; ++j;
+	sm9_verify_init(&ctx);
+	sm9_verify_update(&ctx, data, sizeof(data));
+	if (sm9_verify_finish_precomp(&ctx, sig, siglen, pre, "Bob", 3) != 0) goto err; ++j;
+
+	if (sm9_enc_master_key_generate(&enc_msk) != 1
+		|| sm9_enc_master_key_extract_key(&enc_msk, id, strlen(id), &enc_key) != 1
+		|| sm9_enc_master_precomp_init(pre, &enc_msk) != 1) goto err; ++j;
+	if (sm9_encrypt_precomp(pre, id, strlen(id), data, sizeof(data), out, &outlen) != 1) goto err; ++j;
+	if (sm9_decrypt(&enc_key, id, strlen(id), out, outlen, dec, &declen) != 1) goto err; ++j;
+	if (declen != sizeof(data) || memcmp(dec, data, sizeof(data)) != 0) goto err; ++j;
+
+	// a precomputation is bound to its key type
+	if (sm9_sign_finish_precomp(&ctx, &sign_key, pre, sig, &siglen) == 1) goto err; ++j;
+
+	free(pre);
+	free(table);
+	printf("%s() ok\n", __FUNCTION__);
+	return 1;
+err:
+	free(pre);
+	free(table);
+	printf("%s test %d failed\n", __FUNCTION__, j);
+	error_print();
+	return -1;
+}
+
+static long getMicrotime(void)
+{
+	struct timeval currentTime;
+	gettimeofday(&currentTime, NULL);
+	return currentTime.tv_sec * (int)1e6 + currentTime.tv_usec;
+}
+
+// sm9test speed
+static int speed_sm9(void)
+{
+	SM9_SIGN_MASTER_KEY sign_msk;
+	SM9_SIGN_KEY sign_key;
+	SM9_SIGN_CTX ctx;
+	SM9_ENC_MASTER_KEY enc_msk;
+	SM9_ENC_KEY enc_key;
+	sm9_fp12_t r;
+	uint8_t data[20] = {0};
+	uint8_t sig[SM9_SIGNATURE_SIZE];
+	uint8_t out[256];
+	uint8_t dec[20];
+	size_t siglen, outlen, declen;
+	const char *id = "Alice";
+	SM9_MASTER_PRECOMP *pre = NULL;
+	int count = 20;
+	long pre_time, cost;
+	int ret = -1;
+	int i;
+
+	if (sm9_sign_master_key_generate(&sign_msk) != 1
+		|| sm9_sign_master_key_extract_key(&sign_msk, id, strlen(id), &sign_key) != 1
+		|| sm9_enc_master_key_generate(&enc_msk) != 1
+		|| sm9_enc_master_key_extract_key(&enc_msk, id, strlen(id), &enc_key) != 1) {
+		error_print();
+		return -1;
+	}
+
+	pre_time = getMicrotime();
+	for (i = 0; i < count; i++) {
+		sm9_pairing(r, SM9_Ppubs, SM9_P1);
+	}
+	cost = getMicrotime() - pre_time;
+	printf("sm9_pairing: %.2f ops/s\n", count * 1e6 / cost);
+
+	pre_time = getMicrotime();
+	for (i = 0; i < count; i++) {
+		sm9_sign_init(&ctx);
+		sm9_sign_update(&ctx, data, sizeof(data));
+		if (sm9_sign_finish(&ctx, &sign_key, sig, &siglen) != 1) {
+			error_print();
+			return -1;
+		}
+	}
+	cost = getMicrotime() - pre_time;
+	printf("sm9_sign: %.2f ops/s\n", count * 1e6 / cost);
+
+	pre_time = getMicrotime();
+	for (i = 0; i < count; i++) {
+		sm9_verify_init(&ctx);
+		sm9_verify_update(&ctx, data, sizeof(data));
+		if (sm9_verify_finish(&ctx, sig, siglen, &sign_msk, id, strlen(id)) != 1) {
+			error_print();
+			return -1;
+		}
+	}
+	cost = getMicrotime() - pre_time;
+	printf("sm9_verify: %.2f ops/s\n", count * 1e6 / cost);
+
+	pre_time = getMicrotime();
+	for (i = 0; i < count; i++) {
+		if (sm9_encrypt(&enc_msk, id, strlen(id), data, sizeof(data), out, &outlen) != 1) {
+			error_print();
+			return -1;
+		}
+	}
+	cost = getMicrotime() - pre_time;
+	printf("sm9_encrypt: %.2f ops/s\n", count * 1e6 / cost);
+
+	pre_time = getMicrotime();
+	for (i = 0; i < count; i++) {
+		declen = sizeof(dec);
+		if (sm9_decrypt(&enc_key, id, strlen(id), out, outlen, dec, &declen) != 1) {
+			error_print();
+			return -1;
+		}
+	}
+	cost = getMicrotime() - pre_time;
+	printf("sm9_decrypt: %.2f ops/s\n", count * 1e6 / cost);
+
+	if (!(pre = malloc(sizeof(*pre)))) {
+		error_print();
+		return -1;
+	}
+	sm9_sign_master_precomp_init(pre, &sign_msk);
+
+	pre_time = getMicrotime();
+	for (i = 0; i < count; i++) {
+		sm9_sign_init(&ctx);
+		sm9_sign_update(&ctx, data, sizeof(data));
+		if (sm9_sign_finish_precomp(&ctx, &sign_key, pre, sig, &siglen) != 1) {
+			error_print();
+			goto end;
+		}
+	}
+	cost = getMicrotime() - pre_time;
+	printf("sm9_sign_finish_precomp: %.2f ops/s\n", count * 1e6 / cost);
+
+	pre_time = getMicrotime();
+	for (i = 0; i < count; i++) {
+		sm9_verify_init(&ctx);
+		sm9_verify_update(&ctx, data, sizeof(data));
+		if (sm9_verify_finish_precomp(&ctx, sig, siglen, pre, id, strlen(id)) != 1) {
+			error_print();
+			goto end;
+		}
+	}
+	cost = getMicrotime() - pre_time;
+	printf("sm9_verify_finish_precomp: %.2f ops/s\n", count * 1e6 / cost);
+
+	sm9_enc_master_precomp_init(pre, &enc_msk);
+	pre_time = getMicrotime();
+	for (i = 0; i < count; i++) {
+		if (sm9_encrypt_precomp(pre, id, strlen(id), data, sizeof(data), out, &outlen) != 1) {
+			error_print();
+			goto end;
+		}
+	}
+	cost = getMicrotime() - pre_time;
+	printf("sm9_encrypt_precomp: %.2f ops/s\n", count * 1e6 / cost);
+
+	ret = 1;
+end:
+	free(pre);
+	return ret;
+}
+
+int main(int argc, char **argv) {
+	if (argc > 1 && strcmp(argv[1], "speed") == 0) {
+		return speed_sm9() == 1 ? 0 : 1;
+	}
+
 	if (test_sm9_fp() != 1) goto err;
 	if (test_sm9_fn() != 1) goto err;
 	if (test_sm9_fp2() != 1) goto err;
@@ -618,6 +845,7 @@ int main(void) {
 	if (test_sm9_sign() != 1) goto err;
 	if (test_sm9_ciphertext() != 1) goto err;
 	if (test_sm9_encrypt() != 1) goto err;
+	if (test_sm9_precomp() != 1) goto err;
 
 	printf("%s all tests passed\n", __FILE__);
 	return 0;
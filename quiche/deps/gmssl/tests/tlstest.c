@@ -18,6 +18,7 @@
 #include <gmssl/tls.h>
 #include <gmssl/sm3.h>
 #include <gmssl/sm4.h>
+#include <sys/time.h>
 
 static int test_tls_encode(void)
 {
@@ -95,6 +96,163 @@ static int test_tls_cbc(void)
 	return 1;
 }
 
+// two-pass MAC-then-encrypt reference with a given IV
+static void tls_cbc_encrypt_ref(const SM3_HMAC_CTX *inited_hmac_ctx, const SM4_KEY *enc_key,
+	const uint8_t seq_num[8], const uint8_t header[5], const uint8_t iv[16],
+	const uint8_t *in, size_t inlen, uint8_t *out, size_t *outlen)
+{
+	SM3_HMAC_CTX hmac_ctx;
+	uint8_t block[16 + 32 + 256];
+	size_t rem = inlen % 16;
+	size_t padding_len = 16 - (inlen + 32) % 16 - 1;
+	size_t i;
+
+	memcpy(&hmac_ctx, inited_hmac_ctx, sizeof(SM3_HMAC_CTX));
+	sm3_hmac_update(&hmac_ctx, seq_num, 8);
+	sm3_hmac_update(&hmac_ctx, header, 5);
+	sm3_hmac_update(&hmac_ctx, in, inlen);
+	memcpy(block, in + inlen - rem, rem);
+	sm3_hmac_finish(&hmac_ctx, block + rem);
+	for (i = 0; i <= padding_len; i++) {
+		block[rem + 32 + i] = (uint8_t)padding_len;
+	}
+
+	memcpy(out, iv, 16);
+	sm4_cbc_encrypt(enc_key, iv, in, inlen/16, out + 16);
+	sm4_cbc_encrypt(enc_key, inlen >= 16 ? out + inlen - rem : iv,
+		block, (rem + 32 + padding_len + 1)/16, out + 16 + inlen - rem);
+	*outlen = 16 + inlen - rem + rem + 32 + padding_len + 1;
+}
+
+static int test_tls_cbc_stitched(void)
+{
+	uint8_t key[32];
+	SM3_HMAC_CTX hmac_ctx;
+	SM4_KEY enc_key;
+	SM4_KEY dec_key;
+	uint8_t seq_num[8] = { 0,0,0,0,0,0,0,1 };
+	uint8_t header[5];
+	size_t lens[] = { 0, 1, 15, 16, 50, 51, 63, 64, 115, 128, 255, 300, 1000, 1024, 4097, 16384 };
+	static uint8_t in[16384];
+	static uint8_t out[16384 + 16 + 32 + 16];
+	static uint8_t ref[16384 + 16 + 32 + 16];
+	static uint8_t buf[16384 + 16 + 32 + 16];
+	size_t outlen, reflen, buflen;
+	size_t i;
+
+	rand_bytes(key, sizeof(key));
+	rand_bytes(in, sizeof(in));
+	sm3_hmac_init(&hmac_ctx, key, 32);
+	sm4_set_encrypt_key(&enc_key, key);
+	sm4_set_decrypt_key(&dec_key, key);
+
+	header[0] = TLS_record_application_data;
+	header[1] = TLS_protocol_tls12 >> 8;
+	header[2] = TLS_protocol_tls12 & 0xff;
+
+	for (i = 0; i < sizeof(lens)/sizeof(lens[0]); i++) {
+		header[3] = lens[i] >> 8;
+		header[4] = lens[i] & 0xff;
+
+		if (tls_cbc_encrypt(&hmac_ctx, &enc_key, seq_num, header, in, lens[i], out, &outlen) != 1) {
+			error_print();
+			return -1;
+		}
+		tls_cbc_encrypt_ref(&hmac_ctx, &enc_key, seq_num, header, out, in, lens[i], ref, &reflen);
+		if (outlen != reflen || memcmp(out, ref, outlen) != 0) {
+			error_print();
+			return -1;
+		}
+
+		if (tls_cbc_decrypt(&hmac_ctx, &dec_key, seq_num, header, out, outlen, buf, &buflen) != 1
+			|| buflen != lens[i]
+			|| memcmp(buf, in, buflen) != 0) {
+			error_print();
+			return -1;
+		}
+
+		// any modified ciphertext block must be rejected
+		out[outlen - 1] ^= 1;
+		if (tls_cbc_decrypt(&hmac_ctx, &dec_key, seq_num, header, out, outlen, buf, &buflen) == 1) {
+			error_print();
+			return -1;
+		}
+		out[outlen - 1] ^= 1;
+		out[16] ^= 1;
+		if (tls_cbc_decrypt(&hmac_ctx, &dec_key, seq_num, header, out, outlen, buf, &buflen) == 1) {
+			error_print();
+			return -1;
+		}
+	}
+
+	printf("%s() ok\n", __FUNCTION__);
+	return 1;
+}
+
+static long getMicrotime(void)
+{
+	struct timeval currentTime;
+	gettimeofday(&currentTime, NULL);
+	return currentTime.tv_sec * (int)1e6 + currentTime.tv_usec;
+}
+
+static int speed_tls_cbc(void)
+{
+	uint8_t key[32] = {0};
+	SM3_HMAC_CTX hmac_ctx;
+	SM4_KEY enc_key;
+	SM4_KEY dec_key;
+	uint8_t seq_num[8] = {0};
+	uint8_t header[5];
+	uint8_t iv[16] = {0};
+	size_t lens[] = { 1024, 16384 };
+	static uint8_t in[16384];
+	static uint8_t out[16384 + 16 + 32 + 16];
+	static uint8_t buf[16384 + 16 + 32 + 16];
+	size_t outlen, buflen;
+	size_t i;
+	int j, count;
+	long pre, ref_time, enc_time, dec_time;
+
+	sm3_hmac_init(&hmac_ctx, key, 32);
+	sm4_set_encrypt_key(&enc_key, key);
+	sm4_set_decrypt_key(&dec_key, key);
+	header[0] = TLS_record_application_data;
+	header[1] = TLS_protocol_tls12 >> 8;
+	header[2] = TLS_protocol_tls12 & 0xff;
+
+	for (i = 0; i < sizeof(lens)/sizeof(lens[0]); i++) {
+		header[3] = lens[i] >> 8;
+		header[4] = lens[i] & 0xff;
+		count = (int)((4 << 20) / lens[i]);
+
+		pre = getMicrotime();
+		for (j = 0; j < count; j++) {
+			tls_cbc_encrypt_ref(&hmac_ctx, &enc_key, seq_num, header, iv, in, lens[i], out, &outlen);
+		}
+		ref_time = getMicrotime() - pre;
+
+		pre = getMicrotime();
+		for (j = 0; j < count; j++) {
+			tls_cbc_encrypt(&hmac_ctx, &enc_key, seq_num, header, in, lens[i], out, &outlen);
+		}
+		enc_time = getMicrotime() - pre;
+
+		pre = getMicrotime();
+		for (j = 0; j < count; j++) {
+			if (tls_cbc_decrypt(&hmac_ctx, &dec_key, seq_num, header, out, outlen, buf, &buflen) != 1) {
+				error_print();
+				return -1;
+			}
+		}
+		dec_time = getMicrotime() - pre;
+
+		printf("tls cbc %5zu-byte record: two-pass encrypt %.2f us, stitched encrypt %.2f us, decrypt %.2f us\n",
+			lens[i], (double)ref_time/count, (double)enc_time/count, (double)dec_time/count);
+	}
+	return 1;
+}
+
 static int test_tls_random(void)
 {
 	uint8_t random[32];
@@ -328,6 +486,7 @@ int main(void)
 {
 	if (test_tls_encode() != 1) goto err;
 	if (test_tls_cbc() != 1) goto err;
+	if (test_tls_cbc_stitched() != 1) goto err;
 	if (test_tls_random() != 1) goto err;
 	if (test_tls_client_hello() != 1) goto err;
 	if (test_tls_server_hello() != 1) goto err;
@@ -338,6 +497,7 @@ int main(void)
 	if (test_tls_alert() != 1) goto err;
 	if (test_tls_change_cipher_spec() != 1) goto err;
 	if (test_tls_application_data() != 1) goto err;
+	if (speed_tls_cbc() != 1) goto err;
 	printf("%s all tests passed\n", __FILE__);
 	return 0;
 err:
@@ -11,12 +11,15 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
 #include <gmssl/oid.h>
 #include <gmssl/x509_alg.h>
 #include <gmssl/x509_oid.h>
 #include <gmssl/x509_crl.h>
 #include <gmssl/x509.h>
 #include <gmssl/rand.h>
+#include <gmssl/asn1.h>
 #include <gmssl/error.h>
 
 
@@ -138,12 +141,265 @@ static int test_x509_revoked_cert(void)
 }
 
 
+#define TEST_CRL_ENTRIES 1000
+#define TEST_CRL_MAXLEN (64 * 1024)
+
+static void test_crl_serial(uint8_t serial[3], int i)
+{
+	serial[0] = 0x10;
+	serial[1] = (uint8_t)(i >> 8);
+	serial[2] = (uint8_t)i;
+}
+
+/*
+ * Unsigned CRL with the given serial numbers, a dummy signature is enough for
+ * the index, which does not verify the CRL. A reason < 0 omits the extension.
+ */
+static int test_crl_build(const uint8_t *issuer, size_t issuer_len,
+	const int *serials, const int *reasons, size_t cnt,
+	int crl_number, int delta_base, uint8_t *crl, size_t *crllen)
+{
+	uint8_t *revoked;
+	size_t revoked_len = 0;
+	uint8_t *tbs;
+	size_t tbs_len = 0;
+	uint8_t exts[64];
+	size_t exts_len = 0;
+	uint8_t sig[64] = {0};
+	const uint8_t *d;
+	size_t dlen;
+	const uint8_t *cp;
+	uint8_t *p;
+	time_t now = time(NULL);
+	size_t i;
+	int ret = -1;
+
+	revoked = malloc(TEST_CRL_MAXLEN);
+	tbs = malloc(TEST_CRL_MAXLEN);
+	if (!revoked || !tbs) {
+		error_print();
+		goto end;
+	}
+	p = revoked;
+	for (i = 0; i < cnt; i++) {
+		uint8_t serial[3];
+		uint8_t entry_exts[32];
+		size_t entry_exts_len = 0;
+
+		test_crl_serial(serial, serials[i]);
+		if (reasons[i] >= 0
+			&& x509_crl_entry_exts_add_reason(entry_exts, &entry_exts_len, sizeof(entry_exts), 0, reasons[i]) != 1) {
+			error_print();
+			goto end;
+		}
+		if (x509_revoked_cert_to_der(serial, sizeof(serial), now,
+			entry_exts_len ? entry_exts : NULL, entry_exts_len, &p, &revoked_len) != 1) {
+			error_print();
+			goto end;
+		}
+	}
+	if (x509_crl_exts_add_crl_number(exts, &exts_len, sizeof(exts), 0, crl_number) != 1
+		|| (delta_base >= 0
+			&& x509_crl_exts_add_delta_crl_indicator(exts, &exts_len, sizeof(exts), 1, delta_base) != 1)) {
+		error_print();
+		goto end;
+	}
+	p = tbs;
+	if (x509_tbs_crl_to_der(X509_version_v2, OID_sm2sign_with_sm3, issuer, issuer_len,
+		now, now + 86400, revoked, revoked_len, exts, exts_len, &p, &tbs_len) != 1) {
+		error_print();
+		goto end;
+	}
+	cp = tbs;
+	p = crl;
+	*crllen = 0;
+	if (asn1_sequence_from_der(&d, &dlen, &cp, &tbs_len) != 1
+		|| x509_cert_list_to_der(d, dlen, OID_sm2sign_with_sm3, sig, sizeof(sig), &p, crllen) != 1) {
+		error_print();
+		goto end;
+	}
+	ret = 1;
+end:
+	free(revoked);
+	free(tbs);
+	return ret;
+}
+
+static long getMicrotime(void)
+{
+	struct timeval currentTime;
+	gettimeofday(&currentTime, NULL);
+	return currentTime.tv_sec * (int)1e6 + currentTime.tv_usec;
+}
+
+static int test_x509_crl_index(void)
+{
+	uint8_t issuer[256];
+	size_t issuer_len;
+	int serials[TEST_CRL_ENTRIES];
+	int reasons[TEST_CRL_ENTRIES];
+	uint8_t *crl = NULL;
+	size_t crllen;
+	uint8_t *delta = NULL;
+	size_t delta_len;
+	X509_CRL_INDEX idx;
+	X509_CRL_INDEX mapped;
+	const X509_CRL_ENTRY *entry;
+	uint8_t serial[3];
+	char file[] = "/tmp/x509_crltest_XXXXXX";
+	FILE *fp;
+	int fd;
+	time_t revoke_date;
+	const uint8_t *entry_exts;
+	size_t entry_exts_len;
+	long pre, cost_linear, cost_index;
+	int i;
+	int ret = -1;
+
+	memset(&idx, 0, sizeof(idx));
+	memset(&mapped, 0, sizeof(mapped));
+
+	if (x509_name_set(issuer, &issuer_len, sizeof(issuer),
+		"CN", "Beijing", "Haidian", "PKU", "CS", "CA") != 1) {
+		error_print();
+		return -1;
+	}
+	if (!(crl = malloc(TEST_CRL_MAXLEN)) || !(delta = malloc(TEST_CRL_MAXLEN))) {
+		error_print();
+		goto end;
+	}
+
+	// base CRL #5 revokes the even serial numbers, in reverse order
+	for (i = 0; i < TEST_CRL_ENTRIES; i++) {
+		serials[i] = (TEST_CRL_ENTRIES - 1 - i) * 2;
+		reasons[i] = i % 3 ? X509_cr_superseded : -1;
+	}
+	if (test_crl_build(issuer, issuer_len, serials, reasons, TEST_CRL_ENTRIES, 5, -1, crl, &crllen) != 1
+		|| x509_crl_index_init(&idx, crl, crllen) != 1) {
+		error_print();
+		goto end;
+	}
+	if (idx.entries_cnt != TEST_CRL_ENTRIES || idx.crl_number != 5) {
+		error_print();
+		goto end;
+	}
+	for (i = 0; i < TEST_CRL_ENTRIES * 2; i++) {
+		test_crl_serial(serial, i);
+		if (x509_crl_index_find_revoked(&idx, serial, sizeof(serial), &entry) != !(i % 2)) {
+			error_print();
+			goto end;
+		}
+	}
+
+	// delta CRL #6 on base #5: revoke 1, re-reason 2, drop 0
+	serials[0] = 1; reasons[0] = X509_cr_key_compromise;
+	serials[1] = 2; reasons[1] = X509_cr_ca_compromise;
+	serials[2] = 0; reasons[2] = X509_cr_remove_from_crl;
+	if (test_crl_build(issuer, issuer_len, serials, reasons, 3, 6, 5, delta, &delta_len) != 1) {
+		error_print();
+		goto end;
+	}
+	if (x509_crl_index_init(&mapped, delta, delta_len) != -1) {
+		error_print();
+		goto end;
+	}
+	if (x509_crl_index_apply_delta(&idx, delta, delta_len) != 1
+		|| idx.crl_number != 6
+		|| idx.entries_cnt != TEST_CRL_ENTRIES) {
+		error_print();
+		goto end;
+	}
+	// already applied
+	if (x509_crl_index_apply_delta(&idx, delta, delta_len) != -1) {
+		error_print();
+		goto end;
+	}
+	test_crl_serial(serial, 0);
+	if (x509_crl_index_find_revoked(&idx, serial, sizeof(serial), NULL) != 0) {
+		error_print();
+		goto end;
+	}
+	test_crl_serial(serial, 1);
+	if (x509_crl_index_find_revoked(&idx, serial, sizeof(serial), &entry) != 1
+		|| entry->reason != X509_cr_key_compromise) {
+		error_print();
+		goto end;
+	}
+	test_crl_serial(serial, 2);
+	if (x509_crl_index_find_revoked(&idx, serial, sizeof(serial), &entry) != 1
+		|| entry->reason != X509_cr_ca_compromise) {
+		error_print();
+		goto end;
+	}
+
+	// the saved index maps back to the same lookups
+	if ((fd = mkstemp(file)) < 0 || !(fp = fdopen(fd, "wb"))) {
+		error_print();
+		goto end;
+	}
+	if (x509_crl_index_save(&idx, fp) != 1) {
+		error_print();
+		fclose(fp);
+		goto end;
+	}
+	fclose(fp);
+	if (x509_crl_index_map(&mapped, file) != 1
+		|| mapped.entries_cnt != idx.entries_cnt
+		|| mapped.crl_number != idx.crl_number
+		|| mapped.issuer_len != issuer_len
+		|| memcmp(mapped.issuer, issuer, issuer_len) != 0) {
+		error_print();
+		goto end;
+	}
+	for (i = 0; i < TEST_CRL_ENTRIES * 2; i++) {
+		test_crl_serial(serial, i);
+		if (x509_crl_index_find_revoked(&mapped, serial, sizeof(serial), NULL)
+			!= x509_crl_index_find_revoked(&idx, serial, sizeof(serial), NULL)) {
+			error_print();
+			goto end;
+		}
+	}
+
+	// a not revoked serial number costs a full scan of the DER CRL
+	test_crl_serial(serial, 1);
+	pre = getMicrotime();
+	for (i = 0; i < 1000; i++) {
+		if (x509_crl_find_revoked_cert_by_serial_number(crl, crllen, serial, sizeof(serial),
+			&revoke_date, &entry_exts, &entry_exts_len) != 0) {
+			error_print();
+			goto end;
+		}
+	}
+	cost_linear = getMicrotime() - pre;
+	pre = getMicrotime();
+	for (i = 0; i < 1000; i++) {
+		if (x509_crl_index_find_revoked(&idx, serial, sizeof(serial), NULL) != 1) {
+			error_print();
+			goto end;
+		}
+	}
+	cost_index = getMicrotime() - pre;
+	printf("%d entries CRL lookup: scan %.2f us, index %.3f us\n", TEST_CRL_ENTRIES,
+		(double)cost_linear / 1000, (double)cost_index / 1000);
+
+	printf("%s() ok\n", __FUNCTION__);
+	ret = 1;
+end:
+	x509_crl_index_cleanup(&idx);
+	x509_crl_index_cleanup(&mapped);
+	unlink(file);
+	free(crl);
+	free(delta);
+	return ret;
+}
+
 int main(void)
 {
 	if (test_x509_crl_reason() != 1) goto err;
 	if (test_x509_crl_entry_ext() != 1) goto err;
 	if (test_x509_crl_entry_exts() != 1) goto err;
 	if (test_x509_revoked_cert() != 1) goto err;
+	if (test_x509_crl_index() != 1) goto err;
 	printf("%s all tests passed\n", __FILE__);
 	return 0;
 err:
@@ -0,0 +1,282 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <gmssl/oid.h>
+#include <gmssl/x509.h>
+#include <gmssl/x509_ext.h>
+#include <gmssl/x509_store.h>
+#include <gmssl/rand.h>
+#include <gmssl/error.h>
+
+
+static SM2_KEY root_key;
+static SM2_KEY ca_key;
+static SM2_KEY leaf_key;
+static uint8_t root_cert[1024];
+static size_t root_cert_len;
+static uint8_t ca_cert[1024];
+static size_t ca_cert_len;
+
+// leaf, CA
+static uint8_t chain[2048];
+static size_t chain_len;
+
+static int test_cert_sign(uint8_t *cert, size_t *certlen, const char *subject_cn, const char *issuer_cn,
+	const SM2_KEY *subject_key, const SM2_KEY *issuer_key, time_t not_before, int days)
+{
+	uint8_t serial[12];
+	uint8_t subject[256];
+	size_t subject_len;
+	uint8_t issuer[256];
+	size_t issuer_len;
+	uint8_t exts[256];
+	size_t exts_len = 0;
+	uint8_t ski[32];
+	uint8_t akid[32];
+	time_t not_after;
+
+	if (rand_bytes(serial, sizeof(serial)) != 1
+		|| x509_validity_add_days(&not_after, not_before, days) != 1
+		|| x509_name_set(subject, &subject_len, sizeof(subject), "CN", "Beijing", "Haidian", "PKU", "CS", subject_cn) != 1
+		|| x509_name_set(issuer, &issuer_len, sizeof(issuer), "CN", "Beijing", "Haidian", "PKU", "CS", issuer_cn) != 1
+		|| sm2_public_key_digest(subject_key, ski) != 1
+		|| sm2_public_key_digest(issuer_key, akid) != 1
+		|| x509_exts_add_subject_key_identifier(exts, &exts_len, sizeof(exts), 0, ski, 20) != 1
+		|| x509_exts_add_authority_key_identifier(exts, &exts_len, sizeof(exts), 0, akid, 20, NULL, 0, NULL, 0) != 1
+		|| x509_cert_sign(cert, certlen, 1024,
+			X509_version_v3,
+			serial, sizeof(serial),
+			OID_sm2sign_with_sm3,
+			issuer, issuer_len,
+			not_before, not_after,
+			subject, subject_len,
+			subject_key, NULL, 0, NULL, 0,
+			exts, exts_len,
+			issuer_key, SM2_DEFAULT_ID, SM2_DEFAULT_ID_LENGTH) != 1) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+static int test_setup(void)
+{
+	time_t now = time(NULL);
+	size_t len;
+
+	if (sm2_key_generate(&root_key) != 1
+		|| sm2_key_generate(&ca_key) != 1
+		|| sm2_key_generate(&leaf_key) != 1
+		|| test_cert_sign(root_cert, &root_cert_len, "Root", "Root", &root_key, &root_key, now - 60, 3650) != 1
+		|| test_cert_sign(ca_cert, &ca_cert_len, "CA", "Root", &ca_key, &root_key, now - 60, 365) != 1
+		|| test_cert_sign(chain, &len, "Alice", "CA", &leaf_key, &ca_key, now - 60, 30) != 1) {
+		error_print();
+		return -1;
+	}
+	memcpy(chain + len, ca_cert, ca_cert_len);
+	chain_len = len + ca_cert_len;
+	return 1;
+}
+
+static int test_x509_store_verify(void)
+{
+	X509_STORE *store;
+	int verify_result;
+	size_t leaf_len;
+	uint8_t cert[1024];
+	size_t certlen;
+	uint8_t certs[3072];
+
+	if (!(store = (X509_STORE *)malloc(sizeof(X509_STORE)))) {
+		error_print();
+		return -1;
+	}
+	if (x509_store_init(store) != 1
+		|| x509_store_add_cert(store, root_cert, root_cert_len, 1) != 1
+		|| x509_store_add_cert(store, root_cert, root_cert_len, 1) != 1
+		|| store->entries_cnt != 1) {
+		error_print();
+		goto err;
+	}
+
+	// verified twice, the second time from the link cache
+	if (x509_store_verify(store, chain, chain_len, 4, &verify_result) != 1 || verify_result != 1
+		|| x509_store_verify(store, chain, chain_len, 4, &verify_result) != 1 || verify_result != 1) {
+		error_print();
+		goto err;
+	}
+	if (x509_certs_verify(chain, chain_len, root_cert, root_cert_len, 4, &verify_result) != 1) {
+		error_print();
+		goto err;
+	}
+
+	// the leaf and the CA are on the path
+	if (x509_store_verify(store, chain, chain_len, 1, &verify_result) != -1
+		|| verify_result != X509_verify_err_cert_chain_too_long) {
+		error_print();
+		goto err;
+	}
+
+	// the leaf alone needs the CA from the store
+	leaf_len = chain_len - ca_cert_len;
+	if (x509_store_verify(store, chain, leaf_len, 4, &verify_result) != -1) {
+		error_print();
+		goto err;
+	}
+	if (x509_store_add_cert(store, ca_cert, ca_cert_len, 0) != 1
+		|| x509_store_verify(store, chain, leaf_len, 4, &verify_result) != 1) {
+		error_print();
+		goto err;
+	}
+
+	// the CA certificate is known but not trusted
+	x509_store_cleanup(store);
+	if (x509_store_init(store) != 1
+		|| x509_store_add_cert(store, ca_cert, ca_cert_len, 0) != 1
+		|| x509_store_verify(store, chain, chain_len, 4, &verify_result) != -1) {
+		error_print();
+		goto err;
+	}
+	x509_store_cleanup(store);
+	if (x509_store_init(store) != 1
+		|| x509_store_add_cert(store, root_cert, root_cert_len, 1) != 1) {
+		error_print();
+		goto err;
+	}
+
+	// same names, signed by another key
+	if (test_cert_sign(cert, &certlen, "Alice", "CA", &leaf_key, &leaf_key, time(NULL) - 60, 30) != 1) {
+		error_print();
+		goto err;
+	}
+	memcpy(certs, cert, certlen);
+	memcpy(certs + certlen, ca_cert, ca_cert_len);
+	if (x509_store_verify(store, certs, certlen + ca_cert_len, 4, &verify_result) != -1) {
+		error_print();
+		goto err;
+	}
+
+	// expired leaf
+	if (test_cert_sign(cert, &certlen, "Alice", "CA", &leaf_key, &ca_key, time(NULL) - 86400 * 10, 1) != 1) {
+		error_print();
+		goto err;
+	}
+	memcpy(certs, cert, certlen);
+	memcpy(certs + certlen, ca_cert, ca_cert_len);
+	if (x509_store_verify(store, certs, certlen + ca_cert_len, 4, &verify_result) != -1
+		|| verify_result != X509_verify_err_cert_has_expired) {
+		error_print();
+		goto err;
+	}
+
+	// TLCP: signing and encryption certificates from the same CA
+	if (test_cert_sign(cert, &certlen, "Alice", "CA", &leaf_key, &ca_key, time(NULL) - 60, 30) != 1) {
+		error_print();
+		goto err;
+	}
+	memcpy(certs, chain, leaf_len);
+	memcpy(certs + leaf_len, cert, certlen);
+	memcpy(certs + leaf_len + certlen, ca_cert, ca_cert_len);
+	if (x509_store_verify_tlcp(store, certs, leaf_len + certlen + ca_cert_len, 4, &verify_result) != 1) {
+		error_print();
+		goto err;
+	}
+	// encryption certificate not issued by the CA
+	if (test_cert_sign(cert, &certlen, "Alice", "CA", &leaf_key, &leaf_key, time(NULL) - 60, 30) != 1) {
+		error_print();
+		goto err;
+	}
+	memcpy(certs + leaf_len, cert, certlen);
+	memcpy(certs + leaf_len + certlen, ca_cert, ca_cert_len);
+	if (x509_store_verify_tlcp(store, certs, leaf_len + certlen + ca_cert_len, 4, &verify_result) != -1) {
+		error_print();
+		goto err;
+	}
+
+	x509_store_cleanup(store);
+	free(store);
+	printf("%s() ok\n", __FUNCTION__);
+	return 1;
+err:
+	x509_store_cleanup(store);
+	free(store);
+	return -1;
+}
+
+static long getMicrotime(void)
+{
+	struct timeval currentTime;
+	gettimeofday(&currentTime, NULL);
+	return currentTime.tv_sec * (int)1e6 + currentTime.tv_usec;
+}
+
+static int speed_x509_store_verify(void)
+{
+	X509_STORE *store;
+	int verify_result;
+	int count = 100;
+	long pre, cost_certs, cost_store;
+	int i;
+
+	if (!(store = (X509_STORE *)malloc(sizeof(X509_STORE)))) {
+		error_print();
+		return -1;
+	}
+	if (x509_store_init(store) != 1
+		|| x509_store_add_cert(store, root_cert, root_cert_len, 1) != 1) {
+		error_print();
+		goto err;
+	}
+
+	pre = getMicrotime();
+	for (i = 0; i < count; i++) {
+		if (x509_certs_verify(chain, chain_len, root_cert, root_cert_len, 4, &verify_result) != 1) {
+			error_print();
+			goto err;
+		}
+	}
+	cost_certs = getMicrotime() - pre;
+
+	pre = getMicrotime();
+	for (i = 0; i < count; i++) {
+		if (x509_store_verify(store, chain, chain_len, 4, &verify_result) != 1) {
+			error_print();
+			goto err;
+		}
+	}
+	cost_store = getMicrotime() - pre;
+
+	printf("verify 2-certificate chain: x509_certs_verify %.1f us, x509_store_verify %.1f us\n",
+		(double)cost_certs/count, (double)cost_store/count);
+
+	x509_store_cleanup(store);
+	free(store);
+	return 1;
+err:
+	x509_store_cleanup(store);
+	free(store);
+	return -1;
+}
+
+int main(void)
+{
+	if (test_setup() != 1) goto err;
+	if (test_x509_store_verify() != 1) goto err;
+	if (speed_x509_store_verify() != 1) goto err;
+	printf("%s all tests passed\n", __FILE__);
+	return 0;
+err:
+	error_print();
+	return 1;
+}
@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <sys/time.h>
 #include <gmssl/zuc.h>
 
 
@@ -178,7 +179,7 @@ static int zuc_eea_test(void)
 
 	for (i = 0; i < sizeof(key)/sizeof(key[i]); i++) {
 		zuc_eea_encrypt(ibs[i], buf, bits[i], key[i], count[i], bearer[i], direction[i]);
-		if (memcmp(buf, obs[i], (bits[i] + 31)/32) != 0) {
+		if (memcmp(buf, obs[i], (bits[i] + 31)/32 * 4) != 0) {
 			printf("zuc eea test %zu failed\n", i);
 			err++;
 		} else {
@@ -471,6 +472,226 @@ int zuc256_mac_test(void)
 	return err;
 }
 
+static void rand_buf(void *buf, size_t len)
+{
+	uint8_t *p = buf;
+	size_t i;
+	for (i = 0; i < len; i++) {
+		p[i] = rand();
+	}
+}
+
+// full and partial groups of 8 and 16 lanes, and single jobs that take the scalar path
+static const size_t batch_sizes[] = {1, 3, 7, 23, 37};
+#define BATCH_MAX_JOBS	37
+#define BATCH_MAX_WORDS	130
+
+static size_t batch_nbits(size_t i)
+{
+	static const size_t nbits[] = {0, 1, 31, 32, 33, 0xc1, 0x320, 0xfb3, BATCH_MAX_WORDS * 32};
+	return nbits[i % (sizeof(nbits)/sizeof(nbits[0]))];
+}
+
+static int zuc_eea_batch_test(void)
+{
+	int err = 0;
+	uint8_t key[BATCH_MAX_JOBS][16];
+	ZUC_UINT32 in[BATCH_MAX_JOBS][BATCH_MAX_WORDS];
+	ZUC_UINT32 out[BATCH_MAX_JOBS][BATCH_MAX_WORDS];
+	ZUC_UINT32 buf[BATCH_MAX_WORDS];
+	ZUC_EEA_JOB jobs[BATCH_MAX_JOBS];
+	size_t k, i;
+
+	for (k = 0; k < sizeof(batch_sizes)/sizeof(batch_sizes[0]); k++) {
+		size_t njobs = batch_sizes[k];
+
+		for (i = 0; i < njobs; i++) {
+			rand_buf(key[i], sizeof(key[i]));
+			rand_buf(in[i], sizeof(in[i]));
+			jobs[i].key = key[i];
+			jobs[i].count = rand();
+			jobs[i].bearer = rand() & 0x1f;
+			jobs[i].direction = rand() & 1;
+			jobs[i].in = in[i];
+			jobs[i].out = out[i];
+			jobs[i].nbits = batch_nbits(i + k);
+		}
+		zuc_eea_encrypt_batch(jobs, njobs);
+
+		for (i = 0; i < njobs; i++) {
+			zuc_eea_encrypt(in[i], buf, jobs[i].nbits, key[i],
+				jobs[i].count, jobs[i].bearer, jobs[i].direction);
+			if (memcmp(buf, out[i], (jobs[i].nbits + 31)/32 * 4) != 0) {
+				printf("zuc eea batch test %zu/%zu failed\n", i, njobs);
+				err++;
+			}
+		}
+	}
+	if (!err) {
+		printf("zuc eea batch test ok\n");
+	}
+	return err;
+}
+
+static int zuc_eia_batch_test(void)
+{
+	int err = 0;
+	uint8_t key[BATCH_MAX_JOBS][16];
+	ZUC_UINT32 data[BATCH_MAX_JOBS][BATCH_MAX_WORDS];
+	ZUC_EIA_JOB jobs[BATCH_MAX_JOBS];
+	size_t k, i;
+
+	for (k = 0; k < sizeof(batch_sizes)/sizeof(batch_sizes[0]); k++) {
+		size_t njobs = batch_sizes[k];
+
+		for (i = 0; i < njobs; i++) {
+			rand_buf(key[i], sizeof(key[i]));
+			rand_buf(data[i], sizeof(data[i]));
+			jobs[i].key = key[i];
+			jobs[i].count = rand();
+			jobs[i].bearer = rand() & 0x1f;
+			jobs[i].direction = rand() & 1;
+			jobs[i].data = data[i];
+			jobs[i].nbits = batch_nbits(i + k);
+		}
+		if (zuc_eia_generate_mac_batch(jobs, njobs) != 1) {
+			printf("zuc eia batch test failed\n");
+			return err + 1;
+		}
+
+		for (i = 0; i < njobs; i++) {
+			ZUC_UINT32 T = zuc_eia_generate_mac(data[i], jobs[i].nbits, key[i],
+				jobs[i].count, jobs[i].bearer, jobs[i].direction);
+			if (T != jobs[i].mac) {
+				printf("zuc eia batch test %zu/%zu failed\n", i, njobs);
+				err++;
+			}
+		}
+	}
+	if (!err) {
+		printf("zuc eia batch test ok\n");
+	}
+	return err;
+}
+
+static int zuc_keystream_batch_test(void)
+{
+	int err = 0;
+	uint8_t key[BATCH_MAX_JOBS][ZUC256_KEY_SIZE];
+	uint8_t iv[BATCH_MAX_JOBS][ZUC256_IV_SIZE];
+	ZUC_UINT32 keystream[BATCH_MAX_JOBS][BATCH_MAX_WORDS];
+	ZUC_UINT32 buf[BATCH_MAX_WORDS];
+	ZUC_KEYSTREAM_JOB jobs[BATCH_MAX_JOBS];
+	ZUC_STATE state;
+	size_t njobs = BATCH_MAX_JOBS;
+	size_t i;
+
+	rand_buf(key, sizeof(key));
+	rand_buf(iv, sizeof(iv));
+	for (i = 0; i < njobs; i++) {
+		jobs[i].key = key[i];
+		jobs[i].iv = iv[i];
+		jobs[i].keystream = keystream[i];
+		jobs[i].nwords = (batch_nbits(i) + 31)/32;
+	}
+
+	zuc_generate_keystream_batch(jobs, njobs);
+	for (i = 0; i < njobs; i++) {
+		zuc_init(&state, key[i], iv[i]);
+		zuc_generate_keystream(&state, jobs[i].nwords, buf);
+		if (memcmp(buf, keystream[i], jobs[i].nwords * 4) != 0) {
+			printf("zuc keystream batch test %zu failed\n", i);
+			err++;
+		}
+	}
+
+	zuc256_generate_keystream_batch(jobs, njobs);
+	for (i = 0; i < njobs; i++) {
+		zuc256_init(&state, key[i], iv[i]);
+		zuc256_generate_keystream(&state, jobs[i].nwords, buf);
+		if (memcmp(buf, keystream[i], jobs[i].nwords * 4) != 0) {
+			printf("zuc256 keystream batch test %zu failed\n", i);
+			err++;
+		}
+	}
+
+	if (!err) {
+		printf("zuc keystream batch test ok\n");
+	}
+	return err;
+}
+
+static long getMicrotime(void)
+{
+	struct timeval currentTime;
+	gettimeofday(&currentTime, NULL);
+	return currentTime.tv_sec * (int)1e6 + currentTime.tv_usec;
+}
+
+// EEA3/EIA3 over 64 bearers of 1500-byte PDUs, one at a time and batched
+static int zuc_batch_speed(void)
+{
+	enum { NJOBS = 64, PDU_WORDS = 375, ROUNDS = 20 };
+	static ZUC_UINT32 in[NJOBS][PDU_WORDS];
+	static ZUC_UINT32 out[NJOBS][PDU_WORDS];
+	uint8_t key[NJOBS][16];
+	ZUC_EEA_JOB eea[NJOBS];
+	ZUC_EIA_JOB eia[NJOBS];
+	double mbytes = (double)NJOBS * PDU_WORDS * 4 * ROUNDS / (1 << 20);
+	long pre, cost;
+	size_t r, i;
+
+	rand_buf(key, sizeof(key));
+	rand_buf(in, sizeof(in));
+	for (i = 0; i < NJOBS; i++) {
+		eea[i].key = eia[i].key = key[i];
+		eea[i].count = eia[i].count = (ZUC_UINT32)i;
+		eea[i].bearer = eia[i].bearer = i & 0x1f;
+		eea[i].direction = eia[i].direction = i & 1;
+		eea[i].in = eia[i].data = in[i];
+		eea[i].out = out[i];
+		eea[i].nbits = eia[i].nbits = PDU_WORDS * 32;
+	}
+
+	pre = getMicrotime();
+	for (r = 0; r < ROUNDS; r++) {
+		for (i = 0; i < NJOBS; i++) {
+			zuc_eea_encrypt(in[i], out[i], PDU_WORDS * 32, key[i],
+				eea[i].count, eea[i].bearer, eea[i].direction);
+		}
+	}
+	cost = getMicrotime() - pre;
+	printf("zuc_eea_encrypt: %.1f MiB/s\n", mbytes * 1e6 / cost);
+
+	pre = getMicrotime();
+	for (r = 0; r < ROUNDS; r++) {
+		zuc_eea_encrypt_batch(eea, NJOBS);
+	}
+	cost = getMicrotime() - pre;
+	printf("zuc_eea_encrypt_batch: %.1f MiB/s\n", mbytes * 1e6 / cost);
+
+	pre = getMicrotime();
+	for (r = 0; r < ROUNDS; r++) {
+		for (i = 0; i < NJOBS; i++) {
+			eia[i].mac = zuc_eia_generate_mac(in[i], PDU_WORDS * 32, key[i],
+				eia[i].count, eia[i].bearer, eia[i].direction);
+		}
+	}
+	cost = getMicrotime() - pre;
+	printf("zuc_eia_generate_mac: %.1f MiB/s\n", mbytes * 1e6 / cost);
+
+	pre = getMicrotime();
+	for (r = 0; r < ROUNDS; r++) {
+		if (zuc_eia_generate_mac_batch(eia, NJOBS) != 1) {
+			return 1;
+		}
+	}
+	cost = getMicrotime() - pre;
+	printf("zuc_eia_generate_mac_batch: %.1f MiB/s\n", mbytes * 1e6 / cost);
+
+	return 0;
+}
+
 int main(void)
 {
 	int err = 0;
@@ -479,5 +700,9 @@ int main(void)
 	err += zuc_eia_test();
 	err += zuc256_test();
 	err += zuc256_mac_test();
+	err += zuc_eea_batch_test();
+	err += zuc_eia_batch_test();
+	err += zuc_keystream_batch_test();
+	err += zuc_batch_speed();
 	return err;
 }
@@ -24,7 +24,10 @@ int certverify_main(int argc, char **argv)
 	char *infile = NULL;
 	char *cacertfile = NULL;
 	FILE *infp = stdin;
-	FILE *cacertfp = NULL;
+	uint8_t *cacerts = NULL;
+	size_t cacertslen;
+	const uint8_t *ca;
+	size_t calen;
 	uint8_t cert[1024];
 	size_t certlen;
 	uint8_t cacert[1024];
@@ -64,10 +67,6 @@ int certverify_main(int argc, char **argv)
 		} else if (!strcmp(*argv, "-cacert")) {
 			if (--argc < 1) goto bad;
 			cacertfile = *(++argv);
-			if (!(cacertfp = fopen(cacertfile, "r"))) {
-				fprintf(stderr, "%s: open '%s' failure : %s\n", prog, cacertfile, strerror(errno));
-				goto end;
-			}
 		} else {
 			fprintf(stderr, "%s: illegal option '%s'\n", prog, *argv);
 			goto end;
@@ -89,6 +88,11 @@ bad:
 		fprintf(stderr, "%s: '-cacert' option required\n", prog);
 		goto end;
 	}
+	// the CA file may be a large bundle, load and decode it in one pass
+	if (x509_certs_new_from_file(&cacerts, &cacertslen, cacertfile) != 1) {
+		fprintf(stderr, "%s: load CA certificates from '%s' failure\n", prog, cacertfile);
+		goto end;
+	}
 
 	if (x509_cert_from_pem(cert, &certlen, sizeof(cert), infp) != 1
 		|| x509_cert_get_subject(cert, certlen, &subject, &subject_len) != 1) {
@@ -148,11 +152,11 @@ final:
 		fprintf(stderr, "%s: parse certificate error\n", prog);
 		goto end;
 	}
-	if (x509_cert_from_pem_by_subject(cacert, &cacertlen, sizeof(cacert), subject, subject_len, cacertfp) != 1) {
+	if (x509_certs_get_cert_by_subject(cacerts, cacertslen, subject, subject_len, &ca, &calen) != 1) {
 		fprintf(stderr, "%s: load CA certificate failure\n", prog);
 		goto end;
 	}
-	if ((rv = x509_cert_verify_by_ca_cert(cert, certlen, cacert, cacertlen, SM2_DEFAULT_ID, strlen(SM2_DEFAULT_ID))) < 0) {
+	if ((rv = x509_cert_verify_by_ca_cert(cert, certlen, ca, calen, SM2_DEFAULT_ID, strlen(SM2_DEFAULT_ID))) < 0) {
 		fprintf(stderr, "%s: inner error\n", prog);
 		goto end;
 	}
@@ -160,7 +164,7 @@ final:
 	x509_name_print(stdout, 0, 0, "Signed by", subject, subject_len);
 
 	if (double_certs) {
-		if ((rv = x509_cert_verify_by_ca_cert(enc_cert, enc_cert_len, cacert, cacertlen, SM2_DEFAULT_ID, strlen(SM2_DEFAULT_ID))) < 0) {
+		if ((rv = x509_cert_verify_by_ca_cert(enc_cert, enc_cert_len, ca, calen, SM2_DEFAULT_ID, strlen(SM2_DEFAULT_ID))) < 0) {
 			fprintf(stderr, "%s: inner error\n", prog);
 			goto end;
 		}
@@ -170,6 +174,6 @@ final:
 	ret = 0;
 end:
 	if (infile && infp) fclose(infp);
-	if (cacertfp) fclose(cacertfp);
+	if (cacerts) free(cacerts);
 	return ret;
 }
@@ -15,11 +15,14 @@
 #include <sys/stat.h>
 #include <gmssl/x509.h>
 #include <gmssl/cms.h>
+#include <gmssl/pem.h>
 
 
 
 static const char *options = "-key file -pass str -cert file -in file [-out file]";
 
+#define CMS_TOOL_BUF_SIZE	65536
+
 int cmsdecrypt_main(int argc, char **argv)
 {
 	int ret = 1;
@@ -35,18 +38,16 @@ int cmsdecrypt_main(int argc, char **argv)
 	FILE *outfp = stdout;
 	uint8_t cert[1024];
 	size_t certlen;
-	struct stat st;
-	uint8_t *cms = NULL;
-	size_t cmslen, cms_maxlen;
 	SM2_KEY key;
-	int content_type;
+	uint8_t *pem = NULL;
+	size_t pemlen;
 	uint8_t *content = NULL;
 	size_t content_len;
-	const uint8_t *rcpt_infos;
-	size_t rcpt_infos_len;
-	const uint8_t *shared_info1;
-	const uint8_t *shared_info2;
-	size_t shared_info1_len, shared_info2_len;
+	PEM_CTX pem_ctx;
+	CMS_DEENVELOP_CTX deenvelop_ctx;
+	int rv;
+
+	memset(&deenvelop_ctx, 0, sizeof(deenvelop_ctx));
 
 	argc--;
 	argv++;
@@ -130,37 +131,40 @@ bad:
 		goto end;
 	}
 
-	fstat(fileno(infp), &st);
-	cms_maxlen = (st.st_size * 3)/4 + 1;
-	if (!(cms = malloc(cms_maxlen))) {
+	if (!(pem = malloc(CMS_TOOL_BUF_SIZE))
+		|| !(content = malloc(CMS_TOOL_BUF_SIZE + CMS_STREAM_UPDATE_OVERHEAD))) {
 		fprintf(stderr, "%s: malloc failure\n", prog);
 		goto end;
 	}
-	if (cms_from_pem(cms, &cmslen, cms_maxlen, infp) != 1) {
+
+	// the plaintext is written out as it is decrypted, the output file is removed on failure
+	if (pem_read_init(&pem_ctx, infp, PEM_CMS) != 1
+		|| cms_deenvelop_init(&deenvelop_ctx, &key, cert, certlen) != 1) {
 		fprintf(stderr, "%s: read CMS failure\n", prog);
 		goto end;
 	}
-
-	if (!(content = malloc(cmslen))) {
-		fprintf(stderr, "%s: malloc failure\n", prog);
-		goto end;
+	for (;;) {
+		if ((rv = pem_read_update(&pem_ctx, pem, &pemlen, CMS_TOOL_BUF_SIZE)) < 0) {
+			fprintf(stderr, "%s: read CMS failure\n", prog);
+			goto end;
+		}
+		if (!rv) {
+			break;
+		}
+		if (cms_deenvelop_update(&deenvelop_ctx, pem, pemlen, content, &content_len) != 1) {
+			fprintf(stderr, "%s: decryption failure\n", prog);
+			goto end;
+		}
+		if (content_len && fwrite(content, 1, content_len, outfp) != content_len) {
+			fprintf(stderr, "%s: output failure : %s\n", prog, strerror(errno));
+			goto end;
+		}
 	}
-
-	if (cms_deenvelop(cms, cmslen,
-		&key, cert, certlen,
-		&content_type, content, &content_len,
-		&rcpt_infos, &rcpt_infos_len,
-		&shared_info1, &shared_info1_len,
-		&shared_info2, &shared_info2_len) != 1) {
+	if (cms_deenvelop_finish(&deenvelop_ctx, content, &content_len) != 1) {
 		fprintf(stderr, "%s: decryption failure\n", prog);
 		goto end;
 	}
-	if (content_type != OID_cms_data) {
-		fprintf(stderr, "%s: invalid CMS content type: %s\n", prog, cms_content_type_name(content_type));
-		goto end;
-	}
-
-	if (fwrite(content, 1, content_len, outfp) != content_len) {
+	if (content_len && fwrite(content, 1, content_len, outfp) != content_len) {
 		fprintf(stderr, "%s: output failure : %s\n", prog, strerror(errno));
 		goto end;
 	}
@@ -169,9 +173,15 @@ bad:
 
 end:
 	if (infile && infp) fclose(infp);
-	if (outfile && outfp) fclose(outfp);
+	if (outfile && outfp) {
+		fclose(outfp);
+		if (ret) remove(outfile);
+	}
 	if (keyfile && keyfp) fclose(keyfp);
-	if (cms) free(cms);
+	if (certfile && certfp) fclose(certfp);
+	cms_deenvelop_cleanup(&deenvelop_ctx);
+	memset(&key, 0, sizeof(key));
+	if (pem) free(pem);
 	if (content) free(content);
 	return ret;
 }
@@ -16,6 +16,7 @@
 #include <gmssl/cms.h>
 #include <gmssl/x509.h>
 #include <gmssl/rand.h>
+#include <gmssl/pem.h>
 
 
 /*
@@ -52,6 +53,8 @@ encrypt
 
 static const char *options = "-encrypt (-rcptcert pem)* -in file -out file";
 
+#define CMS_TOOL_BUF_SIZE	65536
+
 
 static int get_files_size(int argc, char **argv, const char *option, size_t *len)
 {
@@ -105,9 +108,13 @@ int cmsencrypt_main(int argc, char **argv)
 	uint8_t iv[16];
 	uint8_t *inbuf = NULL;
 	size_t inlen;
+	struct stat st;
+	size_t content_len;
 	uint8_t *cms = NULL;
-	size_t cmslen;
+	size_t cmslen, cms_maxlen;
 	uint8_t *cert;
+	CMS_ENVELOP_CTX envelop_ctx;
+	PEM_CTX pem_ctx;
 
 	if (argc < 2) {
 		fprintf(stderr, "usage: %s %s\n", prog, options);
@@ -129,18 +136,6 @@ int cmsencrypt_main(int argc, char **argv)
 	}
 	cert = rcpt_certs;
 
-	if (get_files_size(argc, argv, "-in", &inlen) != 1) {
-		goto end;
-	}
-	if (inlen <= 0) {
-		fprintf(stderr, "%s: invalid input length\n", prog);
-		goto end;
-	}
-	if (!(inbuf = malloc(inlen))) {
-		fprintf(stderr, "%s: %s\n", prog, strerror(errno));
-		goto end;
-	}
-
 	argc--;
 	argv++;
 
@@ -173,10 +168,6 @@ int cmsencrypt_main(int argc, char **argv)
 				fprintf(stderr, "%s: open '%s' failure : %s\n", prog, infile, strerror(errno));
 				goto end;
 			}
-			if ((inlen = fread(inbuf, 1, inlen, infp)) <= 0) {
-				fprintf(stderr, "%s: read data error: %s\n", prog, strerror(errno));
-				goto end;
-			}
 		} else if (!strcmp(*argv, "-out")) {
 			if (--argc < 1) goto bad;
 			outfile = *(++argv);
@@ -198,25 +189,49 @@ bad:
 
 	rcpt_certs_len = cert - rcpt_certs;
 
+	if (!infile) {
+		fprintf(stderr, "%s: '-in' option required\n", prog);
+		goto end;
+	}
+	if (fstat(fileno(infp), &st) < 0) {
+		fprintf(stderr, "%s: access file error : %s\n", prog, strerror(errno));
+		goto end;
+	}
+	content_len = S_ISREG(st.st_mode) ? (size_t)st.st_size : CMS_CONTENT_LEN_UNKNOWN;
+
+	// the header carries a RecipientInfo per certificate
+	cms_maxlen = CMS_TOOL_BUF_SIZE + rcpt_certs_len * 2;
+	if (!(inbuf = malloc(CMS_TOOL_BUF_SIZE))
+		|| !(cms = malloc(cms_maxlen))) {
+		fprintf(stderr, "%s: malloc failure\n", prog);
+		goto end;
+	}
+
 	if (rand_bytes(key, sizeof(key)) != 1
 		|| rand_bytes(iv, sizeof(iv)) != 1
-		|| cms_envelop(NULL, &cmslen, rcpt_certs, rcpt_certs_len,
+		|| cms_envelop_init(&envelop_ctx, rcpt_certs, rcpt_certs_len,
 			OID_sm4_cbc, key, sizeof(key), iv, sizeof(iv),
-			OID_cms_data, inbuf, inlen, NULL, 0, NULL, 0) != 1) {
+			content_len, NULL, 0, NULL, 0,
+			cms, &cmslen, cms_maxlen) != 1
+		|| pem_write_init(&pem_ctx, outfp, PEM_CMS) != 1
+		|| pem_write_update(&pem_ctx, cms, cmslen) != 1) {
 		fprintf(stderr, "%s: inner error\n", prog);
 		goto end;
 	}
-	if (!(cms = malloc(cmslen))) {
-		fprintf(stderr, "%s: malloc failure\n", prog);
-		goto end;
+	while ((inlen = fread(inbuf, 1, CMS_TOOL_BUF_SIZE, infp)) > 0) {
+		if (cms_envelop_update(&envelop_ctx, inbuf, inlen, cms, &cmslen) != 1
+			|| pem_write_update(&pem_ctx, cms, cmslen) != 1) {
+			fprintf(stderr, "%s: inner error\n", prog);
+			goto end;
+		}
 	}
-	if (cms_envelop(cms, &cmslen, rcpt_certs, rcpt_certs_len,
-		OID_sm4_cbc, key, sizeof(key), iv, sizeof(iv),
-		OID_cms_data, inbuf, inlen, NULL, 0, NULL, 0) != 1) {
-		fprintf(stderr, "%s: inner error\n", prog);
+	if (ferror(infp)) {
+		fprintf(stderr, "%s: read data error: %s\n", prog, strerror(errno));
 		goto end;
 	}
-	if (cms_to_pem(cms, cmslen, outfp) != 1) {
+	if (cms_envelop_finish(&envelop_ctx, cms, &cmslen, cms_maxlen) != 1
+		|| pem_write_update(&pem_ctx, cms, cmslen) != 1
+		|| pem_write_finish(&pem_ctx) != 1) {
 		fprintf(stderr, "%s: output CMS failure\n", prog);
 		goto end;
 	}
@@ -227,6 +242,8 @@ end:
 	if (infile && infp) fclose(infp);
 	if (outfile && outfp) fclose(outfp);
 	if (rcpt_certs) free(rcpt_certs);
+	if (inbuf) free(inbuf);
 	if (cms) free(cms);
+	memset(key, 0, sizeof(key));
 	return ret;
 }
@@ -15,6 +15,7 @@
 #include <sys/stat.h>
 #include <gmssl/x509.h>
 #include <gmssl/cms.h>
+#include <gmssl/pem.h>
 #include <gmssl/error.h>
 
 
@@ -33,6 +34,8 @@
 
 static const char *options = "-key file -pass str -cert file -in file [-out file]";
 
+#define CMS_TOOL_BUF_SIZE	65536
+
 int cmssign_main(int argc, char **argv)
 {
 	int ret = 1;
@@ -53,19 +56,12 @@ int cmssign_main(int argc, char **argv)
 	uint8_t *in = NULL;
 	size_t inlen;
 	uint8_t *cms = NULL;
-	size_t cmslen, cms_maxlen;
+	size_t cmslen;
 	CMS_CERTS_AND_KEY cert_and_key;
-
-	int content_type;
-	uint8_t *content = NULL;
+	CMS_SIGN_CTX sign_ctx;
+	PEM_CTX pem_ctx;
 	size_t content_len;
 
-	const uint8_t *rcpt_infos;
-	size_t rcpt_infos_len;
-	const uint8_t *shared_info1;
-	const uint8_t *shared_info2;
-	size_t shared_info1_len, shared_info2_len;
-
 	argc--;
 	argv++;
 
@@ -167,32 +163,36 @@ bad:
 		fprintf(stderr, "%s: access file error : %s\n", prog, strerror(errno));
 		goto end;
 	}
-	if ((inlen = st.st_size) <= 0) {
-		fprintf(stderr, "%s: invalid input length\n", prog);
-		goto end;
-	}
-	if (!(in = malloc(inlen))) {
-		fprintf(stderr, "%s: malloc failure\n", prog);
-		goto end;
-	}
-	if (fread(in, 1, inlen, infp) != inlen) {
-		fprintf(stderr, "%s: read file error : %s\n",  prog, strerror(errno));
-		goto end;
-	}
+	content_len = S_ISREG(st.st_mode) ? (size_t)st.st_size : CMS_CONTENT_LEN_UNKNOWN;
 
-	cms_maxlen = (inlen * 4)/3 + 4096; // 主要由SignerInfos，其中的DN长度决定
-	if (!(cms = malloc(cms_maxlen))) {
+	if (!(in = malloc(CMS_TOOL_BUF_SIZE))
+		|| !(cms = malloc(CMS_TOOL_BUF_SIZE + CMS_STREAM_UPDATE_OVERHEAD))) {
 		fprintf(stderr, "%s: malloc failure\n", prog);
 		goto end;
 	}
 
-	if (cms_sign(cms, &cmslen, &cert_and_key, 1, OID_cms_data, in, inlen, NULL, 0) != 1) {
+	if (cms_sign_init(&sign_ctx, &cert_and_key, 1, NULL, 0, content_len,
+			cms, &cmslen, CMS_TOOL_BUF_SIZE) != 1
+		|| pem_write_init(&pem_ctx, outfp, PEM_CMS) != 1
+		|| pem_write_update(&pem_ctx, cms, cmslen) != 1) {
 		fprintf(stderr, "%s: sign failure\n", prog);
 		goto end;
 	}
-
-	if (cms_to_pem(cms, cmslen, outfp) != 1) {
-		fprintf(stderr, "%s: output failure\n", prog);
+	while ((inlen = fread(in, 1, CMS_TOOL_BUF_SIZE, infp)) > 0) {
+		if (cms_sign_update(&sign_ctx, in, inlen, cms, &cmslen) != 1
+			|| pem_write_update(&pem_ctx, cms, cmslen) != 1) {
+			fprintf(stderr, "%s: sign failure\n", prog);
+			goto end;
+		}
+	}
+	if (ferror(infp)) {
+		fprintf(stderr, "%s: read file error : %s\n",  prog, strerror(errno));
+		goto end;
+	}
+	if (cms_sign_finish(&sign_ctx, cms, &cmslen, CMS_TOOL_BUF_SIZE) != 1
+		|| pem_write_update(&pem_ctx, cms, cmslen) != 1
+		|| pem_write_finish(&pem_ctx) != 1) {
+		fprintf(stderr, "%s: sign failure\n", prog);
 		goto end;
 	}
 
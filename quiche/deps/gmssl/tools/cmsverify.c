@@ -14,6 +14,7 @@
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <gmssl/cms.h>
+#include <gmssl/pem.h>
 #include <gmssl/x509.h>
 #include <gmssl/rand.h>
 
@@ -21,6 +22,8 @@
 
 static const char *options = "-in file [-out file]";
 
+#define CMS_TOOL_BUF_SIZE	65536
+
 int cmsverify_main(int argc, char **argv)
 {
 	int ret = 1;
@@ -29,21 +32,16 @@ int cmsverify_main(int argc, char **argv)
 	char *outfile = NULL;
 	FILE *infp = NULL;
 	FILE *outfp = NULL;
-	struct stat st;
-	uint8_t *cms = NULL;
-	size_t cmslen, cms_maxlen;
-
-	int content_type;
-	const uint8_t *content;
+	uint8_t *pem = NULL;
+	size_t pemlen;
+	uint8_t *content = NULL;
 	size_t content_len;
-	const uint8_t *certs;
-	size_t certslen;
-	const uint8_t *crls;
-	size_t crlslen;
-	const uint8_t *signer_infos;
-	size_t signer_infos_len;
+	PEM_CTX pem_ctx;
+	CMS_VERIFY_CTX verify_ctx;
 	int rv;
 
+	memset(&verify_ctx, 0, sizeof(verify_ctx));
+
 	argc--;
 	argv++;
 
@@ -87,53 +85,49 @@ bad:
 		fprintf(stderr, "%s: '-in' option required\n", prog);
 		goto end;
 	}
-	fstat(fileno(infp), &st);
-	cms_maxlen = (st.st_size * 3)/4 + 1;
-	if (!(cms = malloc(cms_maxlen))) {
+	if (!(pem = malloc(CMS_TOOL_BUF_SIZE))
+		|| !(content = malloc(CMS_TOOL_BUF_SIZE + CMS_STREAM_UPDATE_OVERHEAD))) {
 		fprintf(stderr, "%s: malloc failure\n", prog);
 		goto end;
 	}
-	if (cms_from_pem(cms, &cmslen, cms_maxlen, infp) != 1) {
-		fprintf(stderr, "%s: read CMS failure\n", prog);
-		goto end;
-	}
 
-	if ((rv = cms_verify(cms, cmslen, NULL, 0, NULL, 0,
-		&content_type, &content, &content_len,
-		&certs, &certslen, &crls, &crlslen,
-		&signer_infos, &signer_infos_len)) < 0) {
-		fprintf(stderr, "%s: verify error\n", prog);
+	// the content is written out as it arrives, the output file is removed if verification fails
+	if (pem_read_init(&pem_ctx, infp, PEM_CMS) != 1
+		|| cms_verify_init(&verify_ctx) != 1) {
+		fprintf(stderr, "%s: read CMS failure\n", prog);
 		goto end;
 	}
-	printf("verify %s\n", rv ? "success" : "failure");
-	ret = rv ? 0 : 1;
-
-	if (outfile) {
-		const uint8_t *p;
-		size_t len;
-
-		if (content_type == OID_cms_data) {
-			if (asn1_octet_string_from_der(&p, &len, &content, &content_len) != 1
-				|| asn1_length_is_zero(content_len) != 1) {
-				fprintf(stderr, "%s: invalid CMS\n", prog);
-				goto end;
-			}
-			if (len != fwrite(p, 1, len, outfp)) {
-				fprintf(stderr, "%s: output error : %s\n", prog, strerror(errno));
-				goto end;
-			}
-		} else {
-			fprintf(stderr, "%s: error\n", prog);
+	for (;;) {
+		if ((rv = pem_read_update(&pem_ctx, pem, &pemlen, CMS_TOOL_BUF_SIZE)) < 0) {
+			fprintf(stderr, "%s: read CMS failure\n", prog);
+			goto end;
+		}
+		if (!rv) {
+			break;
+		}
+		if (cms_verify_update(&verify_ctx, pem, pemlen, outfile ? content : NULL, &content_len) != 1) {
+			fprintf(stderr, "%s: verify error\n", prog);
+			goto end;
+		}
+		if (content_len && fwrite(content, 1, content_len, outfp) != content_len) {
+			fprintf(stderr, "%s: output error : %s\n", prog, strerror(errno));
 			goto end;
 		}
-
 	}
-
-
+	rv = cms_verify_finish(&verify_ctx);
+	printf("verify %s\n", rv == 1 ? "success" : "failure");
+	if (rv == 1) {
+		ret = 0;
+	}
 
 end:
 	if (infile && infp) fclose(infp);
-	if (outfile && outfp) fclose(outfp);
-	if (cms) free(cms);
+	if (outfile && outfp) {
+		fclose(outfp);
+		if (ret) remove(outfile);
+	}
+	cms_verify_cleanup(&verify_ctx);
+	if (pem) free(pem);
+	if (content) free(content);
 	return ret;
 }
@@ -17,7 +17,60 @@
 #include <gmssl/x509_crl.h>
 
 
-static const char *options = "-in file -cacert file\n";
+static const char *options = "{-in file -cacert file | -index file} [-delta file] [-cert file] [-index_out file]\n";
+
+// Read a DER CRL file into *buf and verify it with the issuer certificate from cacertfp
+static int read_and_verify_crl(const char *prog, FILE *fp, FILE *cacertfp,
+	uint8_t **buf, const uint8_t **crl, size_t *crllen)
+{
+	struct stat st;
+	size_t inlen;
+	const uint8_t *pin;
+	const uint8_t *subject;
+	size_t subject_len;
+	uint8_t cacert[1024];
+	size_t cacertlen;
+	int rv;
+
+	if (fstat(fileno(fp), &st) < 0) {
+		fprintf(stderr, "%s: access file error : %s\n", prog, strerror(errno));
+		return -1;
+	}
+	if ((inlen = st.st_size) <= 0) {
+		fprintf(stderr, "%s: invalid input length\n", prog);
+		return -1;
+	}
+	if (!(*buf = malloc(inlen))) {
+		fprintf(stderr, "%s: malloc failure\n", prog);
+		return -1;
+	}
+	if (fread(*buf, 1, inlen, fp) != inlen) {
+		fprintf(stderr, "%s: read file error : %s\n",  prog, strerror(errno));
+		return -1;
+	}
+	pin = *buf;
+	if (x509_crl_from_der(crl, crllen, &pin, &inlen) != 1
+		|| asn1_length_is_zero(inlen) != 1) {
+		fprintf(stderr, "%s: read CRL failure\n", prog);
+		return -1;
+	}
+
+	if (x509_crl_get_issuer(*crl, *crllen, &subject, &subject_len) != 1) {
+		fprintf(stderr, "%s: inner error\n", prog);
+		return -1;
+	}
+	rewind(cacertfp);
+	if (x509_cert_from_pem_by_subject(cacert, &cacertlen, sizeof(cacert), subject, subject_len, cacertfp) != 1) {
+		fprintf(stderr, "%s: read certificate failure\n", prog);
+		return -1;
+	}
+	if ((rv = x509_crl_verify_by_ca_cert(*crl, *crllen, cacert, cacertlen, SM2_DEFAULT_ID, strlen(SM2_DEFAULT_ID))) < 0) {
+		fprintf(stderr, "%s: verification inner error\n", prog);
+		return -1;
+	}
+	printf("Verification %s\n", rv ? "success" : "failure");
+	return rv;
+}
 
 int crlverify_main(int argc, char **argv)
 {
@@ -25,18 +78,29 @@ int crlverify_main(int argc, char **argv)
 	char *prog = argv[0];
 	char *infile = NULL;
 	char *cacertfile = NULL;
+	char *indexfile = NULL;
+	char *deltafile = NULL;
+	char *certfile = NULL;
+	char *indexoutfile = NULL;
 	FILE *infp = NULL;
 	FILE *cacertfp = NULL;
+	FILE *deltafp = NULL;
+	FILE *certfp = NULL;
+	FILE *indexoutfp = NULL;
 	uint8_t *in = NULL;
-	size_t inlen;
-	struct stat st;
-	const uint8_t *pin;
+	uint8_t *delta = NULL;
 	const uint8_t *crl = NULL;
 	size_t crllen;
-	const uint8_t *subject;
-	size_t subject_len;
-	uint8_t cacert[1024];
-	size_t cacertlen;
+	const uint8_t *delta_crl;
+	size_t delta_crl_len;
+	uint8_t cert[1024];
+	size_t certlen;
+	const uint8_t *issuer;
+	size_t issuer_len;
+	const uint8_t *serial;
+	size_t serial_len;
+	X509_CRL_INDEX crl_index;
+	int index_inited = 0;
 	int rv;
 
 	argc--;
@@ -66,6 +130,30 @@ int crlverify_main(int argc, char **argv)
 				fprintf(stderr, "%s: open '%s' failure : %s\n", prog, cacertfile, strerror(errno));
 				goto end;
 			}
+		} else if (!strcmp(*argv, "-index")) {
+			if (--argc < 1) goto bad;
+			indexfile = *(++argv);
+		} else if (!strcmp(*argv, "-delta")) {
+			if (--argc < 1) goto bad;
+			deltafile = *(++argv);
+			if (!(deltafp = fopen(deltafile, "rb"))) {
+				fprintf(stderr, "%s: open '%s' failure : %s\n", prog, deltafile, strerror(errno));
+				goto end;
+			}
+		} else if (!strcmp(*argv, "-cert")) {
+			if (--argc < 1) goto bad;
+			certfile = *(++argv);
+			if (!(certfp = fopen(certfile, "r"))) {
+				fprintf(stderr, "%s: open '%s' failure : %s\n", prog, certfile, strerror(errno));
+				goto end;
+			}
+		} else if (!strcmp(*argv, "-index_out")) {
+			if (--argc < 1) goto bad;
+			indexoutfile = *(++argv);
+			if (!(indexoutfp = fopen(indexoutfile, "wb"))) {
+				fprintf(stderr, "%s: open '%s' failure : %s\n", prog, indexoutfile, strerror(errno));
+				goto end;
+			}
 		} else {
 			fprintf(stderr, "%s: illegal option '%s'\n", prog, *argv);
 			goto end;
@@ -78,59 +166,82 @@ bad:
 		argv++;
 	}
 
-	if (!infile) {
-		fprintf(stderr, "%s: '-in' option required\n", prog);
+	if (!infile == !indexfile) {
+		fprintf(stderr, "%s: one of '-in' or '-index' option required\n", prog);
 		goto end;
 	}
-	if (!cacertfile) {
+	if ((infile || deltafile) && !cacertfile) {
 		fprintf(stderr, "%s: '-cacert' option required\n", prog);
 		goto end;
 	}
 
-
-	if (fstat(fileno(infp), &st) < 0) {
-		fprintf(stderr, "%s: access file error : %s\n", prog, strerror(errno));
-		goto end;
-	}
-	if ((inlen = st.st_size) <= 0) {
-		fprintf(stderr, "%s: invalid input length\n", prog);
-		goto end;
-	}
-	if (!(in = malloc(inlen))) {
-		fprintf(stderr, "%s: malloc failure\n", prog);
-		goto end;
-	}
-	if (fread(in, 1, inlen, infp) != inlen) {
-		fprintf(stderr, "%s: read file error : %s\n",  prog, strerror(errno));
-		goto end;
-	}
-	pin = in;
-	if (x509_crl_from_der(&crl, &crllen, &pin, &inlen) != 1
-		|| asn1_length_is_zero(inlen) != 1) {
-		fprintf(stderr, "%s: read CRL failure\n", prog);
-		goto end;
+	if (infile) {
+		if ((rv = read_and_verify_crl(prog, infp, cacertfp, &in, &crl, &crllen)) != 1) {
+			goto end;
+		}
+		if (!deltafile && !certfile && !indexoutfile) {
+			ret = 0;
+			goto end;
+		}
+		if (x509_crl_index_init(&crl_index, crl, crllen) != 1) {
+			fprintf(stderr, "%s: build CRL index failure\n", prog);
+			goto end;
+		}
+	} else {
+		if (x509_crl_index_map(&crl_index, indexfile) != 1) {
+			fprintf(stderr, "%s: load CRL index '%s' failure\n", prog, indexfile);
+			goto end;
+		}
 	}
+	index_inited = 1;
 
-	if (x509_crl_get_issuer(crl, crllen, &subject, &subject_len) != 1) {
-		fprintf(stderr, "%s: inner error\n", prog);
-		goto end;
-	}
-	if (x509_cert_from_pem_by_subject(cacert, &cacertlen, sizeof(cacert), subject, subject_len, cacertfp) != 1) {
-		fprintf(stderr, "%s: read certificate failure\n", prog);
-		goto end;
+	if (deltafile) {
+		if ((rv = read_and_verify_crl(prog, deltafp, cacertfp, &delta, &delta_crl, &delta_crl_len)) != 1) {
+			goto end;
+		}
+		if (x509_crl_index_apply_delta(&crl_index, delta_crl, delta_crl_len) != 1) {
+			fprintf(stderr, "%s: delta CRL does not apply to the CRL\n", prog);
+			goto end;
+		}
 	}
-	if ((rv = x509_crl_verify_by_ca_cert(crl, crllen, cacert, cacertlen, SM2_DEFAULT_ID, strlen(SM2_DEFAULT_ID))) < 0) {
-		fprintf(stderr, "%s: verification inner error\n", prog);
-		goto end;
+
+	if (indexoutfile) {
+		if (x509_crl_index_save(&crl_index, indexoutfp) != 1) {
+			fprintf(stderr, "%s: write CRL index failure\n", prog);
+			goto end;
+		}
 	}
 
-	printf("Verification %s\n", rv ? "success" : "failure");
-	if (rv == 1) ret = 0;
+	if (certfile) {
+		if (x509_cert_from_pem(cert, &certlen, sizeof(cert), certfp) != 1
+			|| x509_cert_get_issuer_and_serial_number(cert, certlen,
+				&issuer, &issuer_len, &serial, &serial_len) != 1) {
+			fprintf(stderr, "%s: read certificate failure\n", prog);
+			goto end;
+		}
+		if (issuer_len != crl_index.issuer_len
+			|| memcmp(issuer, crl_index.issuer, issuer_len) != 0) {
+			fprintf(stderr, "%s: certificate not issued by the CRL issuer\n", prog);
+			goto end;
+		}
+		if ((rv = x509_crl_index_find_revoked(&crl_index, serial, serial_len, NULL)) < 0) {
+			fprintf(stderr, "%s: inner error\n", prog);
+			goto end;
+		}
+		printf("Certificate %s\n", rv ? "revoked" : "not revoked");
+		if (rv) goto end;
+	}
+	ret = 0;
 
 end:
 	if (infile && infp) fclose(infp);
 	if (cacertfp) fclose(cacertfp);
+	if (deltafp) fclose(deltafp);
+	if (certfp) fclose(certfp);
+	if (indexoutfp) fclose(indexoutfp);
 	if (in) free(in);
+	if (delta) free(delta);
+	if (index_inited) x509_crl_index_cleanup(&crl_index);
 	return ret;
 }
 
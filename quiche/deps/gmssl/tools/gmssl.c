@@ -52,6 +52,7 @@ extern int tls13_client_main(int argc, char **argv);
 extern int tls13_server_main(int argc, char **argv);
 extern int sdfutil_main(int argc, char **argv);
 extern int skfutil_main(int argc, char **argv);
+extern int speed_main(int argc, char **argv);
 
 
 static const char *options =
@@ -92,6 +93,7 @@ static const char *options =
 	"  cmsverify       Verify CMS SignedData\n"
 	"  sdfutil         SDF crypto device utility\n"
 	"  skfutil         SKF crypto device utility\n"
+	"  speed           Measure algorithm performance\n"
 	"  tlcp_client     TLCP client\n"
 	"  tlcp_server     TLCP server\n"
 	"  tls12_client    TLS 1.2 client\n"
@@ -197,6 +199,8 @@ int main(int argc, char **argv)
 			return sdfutil_main(argc, argv);
 		} else if (!strcmp(*argv, "skfutil")) {
 			return skfutil_main(argc, argv);
+		} else if (!strcmp(*argv, "speed")) {
+			return speed_main(argc, argv);
 #endif
 		} else {
 			fprintf(stderr, "%s: illegal option '%s'\n", prog, *argv);
@@ -0,0 +1,680 @@
+/*
+ *  Copyright 2014-2022 The GmSSL Project. All Rights Reserved.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the License); you may
+ *  not use this file except in compliance with the License.
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <gmssl/sm2.h>
+#include <gmssl/sm3.h>
+#include <gmssl/sm4.h>
+#include <gmssl/zuc.h>
+#include <gmssl/sm9.h>
+#include <gmssl/tls.h>
+#include <gmssl/rand.h>
+#include <gmssl/version.h>
+#include <gmssl/mem.h>
+#include <gmssl/error.h>
+
+
+static const char *options = "[-seconds num] [-multi num] [-json] [algor ...]";
+
+static const char *help =
+"Options\n"
+"\n"
+"    -seconds num        Seconds to run each test, default 1\n"
+"    -multi num          Run each test in num threads, default 1\n"
+"    -json               Print results in JSON\n"
+"    algor               Only run tests whose name starts with algor\n"
+"\n"
+"Algorithms\n"
+"\n"
+"    sm2-keygen sm2-sign sm2-verify sm2-encrypt sm2-decrypt\n"
+"    sm2-encrypt-raw sm2-decrypt-raw sm2-key-transport\n"
+"    sm3 sm3-hmac sm4-ecb sm4-cbc sm4-ctr sm4-gcm zuc-eea3\n"
+"    sm9-sign sm9-sign-precomp sm9-verify sm9-encrypt sm9-encrypt-precomp sm9-decrypt\n"
+"    tls12-seal tls12-open tls13-seal tls13-open\n"
+"\n"
+"Examples\n"
+"\n"
+"    gmssl speed\n"
+"    gmssl speed -seconds 3 -multi 8 sm2 sm4-gcm\n"
+"    gmssl speed -json tls13 > speed.json\n"
+"\n";
+
+#define SPEED_MAX_THREADS	256
+#define SPEED_MAX_SIZE		16384
+
+static const size_t speed_sizes[] = { 16, 64, 256, 1024, 8192, 16384 };
+#define SPEED_SIZES_CNT		(sizeof(speed_sizes)/sizeof(speed_sizes[0]))
+
+#define SPEED_SM9_ID		"Alice"
+#define SPEED_SM9_IDLEN		(sizeof(SPEED_SM9_ID) - 1)
+
+typedef struct {
+	size_t size;
+	uint8_t in[TLS_MAX_RECORD_SIZE];
+	uint8_t out[TLS_MAX_RECORD_SIZE];
+	uint8_t record[TLS_MAX_RECORD_SIZE];
+	size_t recordlen;
+	uint8_t dgst[32];
+	uint8_t sig[SM9_SIGNATURE_SIZE > SM2_MAX_SIGNATURE_SIZE ? SM9_SIGNATURE_SIZE : SM2_MAX_SIGNATURE_SIZE];
+	size_t siglen;
+	uint8_t ciphertext[SM9_MAX_CIPHERTEXT_SIZE > SM2_MAX_CIPHERTEXT_SIZE ? SM9_MAX_CIPHERTEXT_SIZE : SM2_MAX_CIPHERTEXT_SIZE];
+	size_t ciphertext_len;
+	uint8_t seq_num[8];
+
+	SM2_KEY sm2_key;
+	SM4_KEY sm4_key;
+	SM4_KEY sm4_dec_key;
+	SM3_HMAC_CTX hmac_ctx;
+	BLOCK_CIPHER_KEY block_cipher_key;
+	uint8_t key[16];
+	uint8_t iv[16];
+	SM9_SIGN_MASTER_KEY sm9_sign_msk;
+	SM9_SIGN_KEY sm9_sign_key;
+	SM9_ENC_MASTER_KEY sm9_enc_msk;
+	SM9_ENC_KEY sm9_enc_key;
+	SM9_MASTER_PRECOMP *sm9_precomp;
+} SPEED_CTX;
+
+static int speed_sm2_setup(SPEED_CTX *ctx)
+{
+	if (sm2_key_generate(&ctx->sm2_key) != 1
+		|| rand_bytes(ctx->dgst, sizeof(ctx->dgst)) != 1
+		|| sm2_sign(&ctx->sm2_key, ctx->dgst, ctx->sig, &ctx->siglen) != 1
+		|| sm2_encrypt(&ctx->sm2_key, ctx->dgst, sizeof(ctx->dgst), ctx->ciphertext, &ctx->ciphertext_len) != 1
+		|| sm2_encrypt_raw(&ctx->sm2_key.public_key, ctx->dgst, sizeof(ctx->dgst), ctx->record) != 1) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+static int speed_sm2_keygen(SPEED_CTX *ctx)
+{
+	SM2_KEY key;
+	return sm2_key_generate(&key);
+}
+
+static int speed_sm2_sign(SPEED_CTX *ctx)
+{
+	uint8_t sig[SM2_MAX_SIGNATURE_SIZE];
+	size_t siglen;
+	return sm2_sign(&ctx->sm2_key, ctx->dgst, sig, &siglen);
+}
+
+static int speed_sm2_verify(SPEED_CTX *ctx)
+{
+	return sm2_verify(&ctx->sm2_key, ctx->dgst, ctx->sig, ctx->siglen);
+}
+
+static int speed_sm2_encrypt(SPEED_CTX *ctx)
+{
+	size_t outlen;
+	return sm2_encrypt(&ctx->sm2_key, ctx->dgst, sizeof(ctx->dgst), ctx->out, &outlen);
+}
+
+static int speed_sm2_decrypt(SPEED_CTX *ctx)
+{
+	size_t outlen;
+	return sm2_decrypt(&ctx->sm2_key, ctx->ciphertext, ctx->ciphertext_len, ctx->out, &outlen);
+}
+
+static int speed_sm2_encrypt_raw(SPEED_CTX *ctx)
+{
+	return sm2_encrypt_raw(&ctx->sm2_key.public_key, ctx->dgst, sizeof(ctx->dgst), ctx->out);
+}
+
+static int speed_sm2_decrypt_raw(SPEED_CTX *ctx)
+{
+	size_t outlen;
+	return sm2_decrypt_raw(&ctx->sm2_key, ctx->record, SM2_RAW_CIPHERTEXT_SIZE(sizeof(ctx->dgst)), ctx->out, &outlen);
+}
+
+// one 32-byte key sent and received, as in the gm handshake
+static int speed_sm2_key_transport(SPEED_CTX *ctx)
+{
+	uint8_t key[32];
+	size_t keylen;
+
+	if (sm2_encrypt_raw(&ctx->sm2_key.public_key, ctx->dgst, sizeof(ctx->dgst), ctx->out) != 1
+		|| sm2_decrypt_raw(&ctx->sm2_key, ctx->out, SM2_RAW_CIPHERTEXT_SIZE(sizeof(ctx->dgst)), key, &keylen) != 1) {
+		return -1;
+	}
+	return 1;
+}
+
+static int speed_sym_setup(SPEED_CTX *ctx)
+{
+	if (rand_bytes(ctx->key, sizeof(ctx->key)) != 1
+		|| rand_bytes(ctx->iv, sizeof(ctx->iv)) != 1
+		|| rand_bytes(ctx->in, ctx->size) != 1) {
+		error_print();
+		return -1;
+	}
+	sm4_set_encrypt_key(&ctx->sm4_key, ctx->key);
+	sm4_set_decrypt_key(&ctx->sm4_dec_key, ctx->key);
+	sm3_hmac_init(&ctx->hmac_ctx, ctx->key, sizeof(ctx->key));
+	if (block_cipher_set_encrypt_key(&ctx->block_cipher_key, BLOCK_CIPHER_sm4(), ctx->key) != 1) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+static int speed_sm3(SPEED_CTX *ctx)
+{
+	sm3_digest(ctx->in, ctx->size, ctx->dgst);
+	return 1;
+}
+
+static int speed_sm3_hmac(SPEED_CTX *ctx)
+{
+	sm3_hmac(ctx->key, sizeof(ctx->key), ctx->in, ctx->size, ctx->dgst);
+	return 1;
+}
+
+static int speed_sm4_ecb(SPEED_CTX *ctx)
+{
+	size_t i;
+	for (i = 0; i < ctx->size; i += SM4_BLOCK_SIZE) {
+		sm4_encrypt(&ctx->sm4_key, ctx->in + i, ctx->out + i);
+	}
+	return 1;
+}
+
+static int speed_sm4_cbc(SPEED_CTX *ctx)
+{
+	sm4_cbc_encrypt(&ctx->sm4_key, ctx->iv, ctx->in, ctx->size/SM4_BLOCK_SIZE, ctx->out);
+	return 1;
+}
+
+static int speed_sm4_ctr(SPEED_CTX *ctx)
+{
+	sm4_ctr_encrypt(&ctx->sm4_key, ctx->iv, ctx->in, ctx->size, ctx->out);
+	return 1;
+}
+
+static int speed_sm4_gcm(SPEED_CTX *ctx)
+{
+	uint8_t tag[16];
+	return sm4_gcm_encrypt(&ctx->sm4_key, ctx->iv, 12, NULL, 0, ctx->in, ctx->size, ctx->out, sizeof(tag), tag);
+}
+
+static int speed_zuc_eea(SPEED_CTX *ctx)
+{
+	zuc_eea_encrypt((ZUC_UINT32 *)ctx->in, (ZUC_UINT32 *)ctx->out, ctx->size * 8, ctx->key, 0x12345678, 0x15, 1);
+	return 1;
+}
+
+static int speed_sm9_sign_setup(SPEED_CTX *ctx)
+{
+	SM9_SIGN_CTX sign_ctx;
+
+	if (rand_bytes(ctx->dgst, sizeof(ctx->dgst)) != 1
+		|| sm9_sign_master_key_generate(&ctx->sm9_sign_msk) != 1
+		|| sm9_sign_master_key_extract_key(&ctx->sm9_sign_msk, SPEED_SM9_ID, SPEED_SM9_IDLEN, &ctx->sm9_sign_key) != 1) {
+		error_print();
+		return -1;
+	}
+	if (!(ctx->sm9_precomp = (SM9_MASTER_PRECOMP *)malloc(sizeof(SM9_MASTER_PRECOMP)))) {
+		error_print();
+		return -1;
+	}
+	if (sm9_sign_master_precomp_init(ctx->sm9_precomp, &ctx->sm9_sign_msk) != 1
+		|| sm9_sign_init(&sign_ctx) != 1
+		|| sm9_sign_update(&sign_ctx, ctx->dgst, sizeof(ctx->dgst)) != 1
+		|| sm9_sign_finish(&sign_ctx, &ctx->sm9_sign_key, ctx->sig, &ctx->siglen) != 1) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+static int speed_sm9_sign(SPEED_CTX *ctx)
+{
+	SM9_SIGN_CTX sign_ctx;
+	uint8_t sig[SM9_SIGNATURE_SIZE];
+	size_t siglen;
+
+	if (sm9_sign_init(&sign_ctx) != 1
+		|| sm9_sign_update(&sign_ctx, ctx->dgst, sizeof(ctx->dgst)) != 1
+		|| sm9_sign_finish(&sign_ctx, &ctx->sm9_sign_key, sig, &siglen) != 1) {
+		return -1;
+	}
+	return 1;
+}
+
+static int speed_sm9_sign_precomp(SPEED_CTX *ctx)
+{
+	SM9_SIGN_CTX sign_ctx;
+	uint8_t sig[SM9_SIGNATURE_SIZE];
+	size_t siglen;
+
+	if (sm9_sign_init(&sign_ctx) != 1
+		|| sm9_sign_update(&sign_ctx, ctx->dgst, sizeof(ctx->dgst)) != 1
+		|| sm9_sign_finish_precomp(&sign_ctx, &ctx->sm9_sign_key, ctx->sm9_precomp, sig, &siglen) != 1) {
+		return -1;
+	}
+	return 1;
+}
+
+static int speed_sm9_verify(SPEED_CTX *ctx)
+{
+	SM9_SIGN_CTX verify_ctx;
+
+	if (sm9_verify_init(&verify_ctx) != 1
+		|| sm9_verify_update(&verify_ctx, ctx->dgst, sizeof(ctx->dgst)) != 1
+		|| sm9_verify_finish(&verify_ctx, ctx->sig, ctx->siglen,
+			&ctx->sm9_sign_msk, SPEED_SM9_ID, SPEED_SM9_IDLEN) != 1) {
+		return -1;
+	}
+	return 1;
+}
+
+static int speed_sm9_enc_setup(SPEED_CTX *ctx)
+{
+	if (rand_bytes(ctx->dgst, sizeof(ctx->dgst)) != 1
+		|| sm9_enc_master_key_generate(&ctx->sm9_enc_msk) != 1
+		|| sm9_enc_master_key_extract_key(&ctx->sm9_enc_msk, SPEED_SM9_ID, SPEED_SM9_IDLEN, &ctx->sm9_enc_key) != 1) {
+		error_print();
+		return -1;
+	}
+	if (!(ctx->sm9_precomp = (SM9_MASTER_PRECOMP *)malloc(sizeof(SM9_MASTER_PRECOMP)))) {
+		error_print();
+		return -1;
+	}
+	if (sm9_enc_master_precomp_init(ctx->sm9_precomp, &ctx->sm9_enc_msk) != 1
+		|| sm9_encrypt(&ctx->sm9_enc_msk, SPEED_SM9_ID, SPEED_SM9_IDLEN,
+			ctx->dgst, sizeof(ctx->dgst), ctx->ciphertext, &ctx->ciphertext_len) != 1) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+static int speed_sm9_encrypt(SPEED_CTX *ctx)
+{
+	size_t outlen;
+	return sm9_encrypt(&ctx->sm9_enc_msk, SPEED_SM9_ID, SPEED_SM9_IDLEN,
+		ctx->dgst, sizeof(ctx->dgst), ctx->out, &outlen);
+}
+
+static int speed_sm9_encrypt_precomp(SPEED_CTX *ctx)
+{
+	size_t outlen;
+	return sm9_encrypt_precomp(ctx->sm9_precomp, SPEED_SM9_ID, SPEED_SM9_IDLEN,
+		ctx->dgst, sizeof(ctx->dgst), ctx->out, &outlen);
+}
+
+static int speed_sm9_decrypt(SPEED_CTX *ctx)
+{
+	size_t outlen;
+	return sm9_decrypt(&ctx->sm9_enc_key, SPEED_SM9_ID, SPEED_SM9_IDLEN,
+		ctx->ciphertext, ctx->ciphertext_len, ctx->out, &outlen);
+}
+
+// TLS 1.2 ECC_SM4_CBC_SM3 and TLS 1.3 TLS_SM4_GCM_SM3 application data records
+static int speed_tls12_setup(SPEED_CTX *ctx)
+{
+	if (speed_sym_setup(ctx) != 1) {
+		error_print();
+		return -1;
+	}
+	ctx->in[0] = TLS_record_application_data;
+	ctx->in[1] = 0x03;
+	ctx->in[2] = 0x03;
+	ctx->in[3] = (uint8_t)(ctx->size >> 8);
+	ctx->in[4] = (uint8_t)ctx->size;
+	if (rand_bytes(ctx->in + 5, ctx->size) != 1
+		|| tls_record_encrypt(&ctx->hmac_ctx, &ctx->sm4_key, ctx->seq_num,
+			ctx->in, 5 + ctx->size, ctx->record, &ctx->recordlen) != 1) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+static int speed_tls12_seal(SPEED_CTX *ctx)
+{
+	size_t outlen;
+	return tls_record_encrypt(&ctx->hmac_ctx, &ctx->sm4_key, ctx->seq_num,
+		ctx->in, 5 + ctx->size, ctx->out, &outlen);
+}
+
+static int speed_tls12_open(SPEED_CTX *ctx)
+{
+	size_t outlen;
+	return tls_record_decrypt(&ctx->hmac_ctx, &ctx->sm4_dec_key, ctx->seq_num,
+		ctx->record, ctx->recordlen, ctx->out, &outlen);
+}
+
+static int speed_tls13_setup(SPEED_CTX *ctx)
+{
+	if (speed_sym_setup(ctx) != 1) {
+		error_print();
+		return -1;
+	}
+	if (tls13_gcm_encrypt(&ctx->block_cipher_key, ctx->iv, ctx->seq_num,
+		TLS_record_application_data, ctx->in, ctx->size, 0,
+		ctx->record, &ctx->recordlen) != 1) {
+		error_print();
+		return -1;
+	}
+	return 1;
+}
+
+static int speed_tls13_seal(SPEED_CTX *ctx)
+{
+	size_t outlen;
+	return tls13_gcm_encrypt(&ctx->block_cipher_key, ctx->iv, ctx->seq_num,
+		TLS_record_application_data, ctx->in, ctx->size, 0, ctx->out, &outlen);
+}
+
+static int speed_tls13_open(SPEED_CTX *ctx)
+{
+	int record_type;
+	size_t outlen;
+	return tls13_gcm_decrypt(&ctx->block_cipher_key, ctx->iv, ctx->seq_num,
+		ctx->record, ctx->recordlen, &record_type, ctx->out, &outlen);
+}
+
+typedef struct {
+	const char *name;
+	int with_sizes; // bulk algorithms are measured with every speed_sizes[] input length
+	int (*setup)(SPEED_CTX *ctx);
+	int (*run)(SPEED_CTX *ctx);
+} SPEED_ALGOR;
+
+static const SPEED_ALGOR speed_algors[] = {
+	{ "sm2-keygen", 0, speed_sm2_setup, speed_sm2_keygen },
+	{ "sm2-sign", 0, speed_sm2_setup, speed_sm2_sign },
+	{ "sm2-verify", 0, speed_sm2_setup, speed_sm2_verify },
+	{ "sm2-encrypt", 0, speed_sm2_setup, speed_sm2_encrypt },
+	{ "sm2-decrypt", 0, speed_sm2_setup, speed_sm2_decrypt },
+	{ "sm2-encrypt-raw", 0, speed_sm2_setup, speed_sm2_encrypt_raw },
+	{ "sm2-decrypt-raw", 0, speed_sm2_setup, speed_sm2_decrypt_raw },
+	{ "sm2-key-transport", 0, speed_sm2_setup, speed_sm2_key_transport },
+	{ "sm3", 1, speed_sym_setup, speed_sm3 },
+	{ "sm3-hmac", 1, speed_sym_setup, speed_sm3_hmac },
+	{ "sm4-ecb", 1, speed_sym_setup, speed_sm4_ecb },
+	{ "sm4-cbc", 1, speed_sym_setup, speed_sm4_cbc },
+	{ "sm4-ctr", 1, speed_sym_setup, speed_sm4_ctr },
+	{ "sm4-gcm", 1, speed_sym_setup, speed_sm4_gcm },
+	{ "zuc-eea3", 1, speed_sym_setup, speed_zuc_eea },
+	{ "sm9-sign", 0, speed_sm9_sign_setup, speed_sm9_sign },
+	{ "sm9-sign-precomp", 0, speed_sm9_sign_setup, speed_sm9_sign_precomp },
+	{ "sm9-verify", 0, speed_sm9_sign_setup, speed_sm9_verify },
+	{ "sm9-encrypt", 0, speed_sm9_enc_setup, speed_sm9_encrypt },
+	{ "sm9-encrypt-precomp", 0, speed_sm9_enc_setup, speed_sm9_encrypt_precomp },
+	{ "sm9-decrypt", 0, speed_sm9_enc_setup, speed_sm9_decrypt },
+	{ "tls12-seal", 1, speed_tls12_setup, speed_tls12_seal },
+	{ "tls12-open", 1, speed_tls12_setup, speed_tls12_open },
+	{ "tls13-seal", 1, speed_tls13_setup, speed_tls13_seal },
+	{ "tls13-open", 1, speed_tls13_setup, speed_tls13_open },
+};
+
+#define SPEED_ALGORS_CNT	(sizeof(speed_algors)/sizeof(speed_algors[0]))
+
+typedef struct {
+	const SPEED_ALGOR *algor;
+	SPEED_CTX *ctx;
+	uint64_t ops;
+	int failed;
+} SPEED_THREAD;
+
+static volatile int speed_stop;
+
+static void *speed_thread(void *arg)
+{
+	SPEED_THREAD *t = (SPEED_THREAD *)arg;
+
+	while (!speed_stop) {
+		if (t->algor->run(t->ctx) != 1) {
+			t->failed = 1;
+			break;
+		}
+		t->ops++;
+	}
+	return NULL;
+}
+
+static double speed_now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec/1e6;
+}
+
+static void speed_ctx_cleanup(SPEED_CTX *ctx)
+{
+	if (ctx->sm9_precomp) free(ctx->sm9_precomp);
+	gmssl_secure_clear(ctx, sizeof(SPEED_CTX));
+	free(ctx);
+}
+
+// run every thread until the deadline, return the total number of operations
+static int speed_run(const SPEED_ALGOR *algor, size_t size, int threads, double seconds,
+	uint64_t *ops, double *elapsed)
+{
+	int ret = -1;
+	SPEED_THREAD t[SPEED_MAX_THREADS];
+	pthread_t tid[SPEED_MAX_THREADS];
+	int started = 0;
+	double start;
+	int i;
+
+	memset(t, 0, sizeof(t));
+	for (i = 0; i < threads; i++) {
+		t[i].algor = algor;
+		if (!(t[i].ctx = (SPEED_CTX *)calloc(1, sizeof(SPEED_CTX)))) {
+			error_print();
+			goto end;
+		}
+		t[i].ctx->size = size;
+		if (algor->setup(t[i].ctx) != 1) {
+			error_print();
+			goto end;
+		}
+	}
+
+	speed_stop = 0;
+	start = speed_now();
+	for (started = 0; started < threads; started++) {
+		if (pthread_create(&tid[started], NULL, speed_thread, &t[started]) != 0) {
+			error_print();
+			speed_stop = 1;
+			goto end;
+		}
+	}
+	usleep((useconds_t)(seconds * 1000000));
+	speed_stop = 1;
+	for (i = 0; i < started; i++) {
+		pthread_join(tid[i], NULL);
+	}
+	started = 0;
+	*elapsed = speed_now() - start;
+
+	*ops = 0;
+	for (i = 0; i < threads; i++) {
+		if (t[i].failed) {
+			error_print();
+			goto end;
+		}
+		*ops += t[i].ops;
+	}
+	ret = 1;
+
+end:
+	for (i = 0; i < started; i++) {
+		pthread_join(tid[i], NULL);
+	}
+	for (i = 0; i < threads; i++) {
+		if (t[i].ctx) speed_ctx_cleanup(t[i].ctx);
+	}
+	return ret;
+}
+
+static int speed_selected(const char *name, char **algors, int algors_cnt)
+{
+	int i;
+
+	if (!algors_cnt) {
+		return 1;
+	}
+	for (i = 0; i < algors_cnt; i++) {
+		if (!strncmp(name, algors[i], strlen(algors[i]))) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int speed_main(int argc, char **argv)
+{
+	int ret = 1;
+	char *prog = argv[0];
+	double seconds = 1;
+	int threads = 1;
+	int json = 0;
+	char **algors = NULL;
+	int algors_cnt = 0;
+	int results_cnt = 0;
+	size_t i, j;
+
+	argc--;
+	argv++;
+
+	while (argc > 0) {
+		if (!strcmp(*argv, "-help")) {
+			printf("usage: %s %s\n\n", prog, options);
+			printf("%s\n", help);
+			ret = 0;
+			goto end;
+		} else if (!strcmp(*argv, "-seconds")) {
+			if (--argc < 1) goto bad;
+			seconds = atof(*(++argv));
+			if (seconds <= 0 || seconds > 3600) {
+				fprintf(stderr, "%s: invalid seconds '%s'\n", prog, *argv);
+				goto end;
+			}
+		} else if (!strcmp(*argv, "-multi")) {
+			if (--argc < 1) goto bad;
+			threads = atoi(*(++argv));
+			if (threads < 1 || threads > SPEED_MAX_THREADS) {
+				fprintf(stderr, "%s: invalid thread number '%s'\n", prog, *argv);
+				goto end;
+			}
+		} else if (!strcmp(*argv, "-json")) {
+			json = 1;
+		} else if (**argv == '-') {
+			fprintf(stderr, "%s: illegal option '%s'\n", prog, *argv);
+			goto end;
+bad:
+			fprintf(stderr, "%s: '%s' option value missing\n", prog, *argv);
+			goto end;
+		} else {
+			// the remaining arguments are algorithm name prefixes
+			algors = argv;
+			algors_cnt = argc;
+			break;
+		}
+
+		argc--;
+		argv++;
+	}
+
+	for (i = 0; i < SPEED_ALGORS_CNT; i++) {
+		if (speed_selected(speed_algors[i].name, algors, algors_cnt)) {
+			break;
+		}
+	}
+	if (i == SPEED_ALGORS_CNT) {
+		fprintf(stderr, "%s: no algorithm matches\n", prog);
+		goto end;
+	}
+
+	if (json) {
+		printf("{\n");
+		printf("  \"version\": \"%s\",\n", gmssl_version_str());
+		printf("  \"build\": {\"sm3_avx_bmi2\": %s, \"sm4_aesni_avx\": %s, \"zuc_avx\": %s},\n",
+#ifdef ENABLE_SM3_AVX_BMI2
+			"true",
+#else
+			"false",
+#endif
+#ifdef ENABLE_SM4_AESNI_AVX
+			"true",
+#else
+			"false",
+#endif
+#ifdef ENABLE_ZUC_AVX
+			"true"
+#else
+			"false"
+#endif
+			);
+		printf("  \"threads\": %d,\n", threads);
+		printf("  \"seconds\": %g,\n", seconds);
+		printf("  \"results\": [");
+	} else {
+		printf("%s, %d thread%s, %g second%s per test\n", gmssl_version_str(),
+			threads, threads > 1 ? "s" : "", seconds, seconds != 1 ? "s" : "");
+	}
+	fflush(stdout);
+
+	for (i = 0; i < SPEED_ALGORS_CNT; i++) {
+		const SPEED_ALGOR *algor = &speed_algors[i];
+		size_t sizes_cnt = algor->with_sizes ? SPEED_SIZES_CNT : 1;
+
+		if (!speed_selected(algor->name, algors, algors_cnt)) {
+			continue;
+		}
+		for (j = 0; j < sizes_cnt; j++) {
+			size_t size = algor->with_sizes ? speed_sizes[j] : 0;
+			uint64_t ops;
+			double elapsed;
+			double ops_per_sec;
+
+			if (speed_run(algor, size, threads, seconds, &ops, &elapsed) != 1) {
+				fprintf(stderr, "%s: %s failed\n", prog, algor->name);
+				goto end;
+			}
+			ops_per_sec = ops/elapsed;
+
+			if (json) {
+				printf("%s\n    {\"algorithm\": \"%s\", \"size\": %zu, \"ops\": %llu, \"ops_per_sec\": %.1f",
+					results_cnt ? "," : "", algor->name, size, (unsigned long long)ops, ops_per_sec);
+				if (size) {
+					printf(", \"bytes_per_sec\": %.0f", ops_per_sec * size);
+				}
+				printf("}");
+			} else if (size) {
+				printf("%-20s %6zu bytes %10llu ops in %.2fs %12.2f MB/s\n",
+					algor->name, size, (unsigned long long)ops, elapsed, ops_per_sec * size/1000000);
+			} else {
+				printf("%-20s %12s %10llu ops in %.2fs %12.1f ops/s\n",
+					algor->name, "", (unsigned long long)ops, elapsed, ops_per_sec);
+			}
+			fflush(stdout);
+			results_cnt++;
+		}
+	}
+	if (json) {
+		printf("\n  ]\n}\n");
+	}
+	ret = 0;
+
+end:
+	return ret;
+}
@@ -24,10 +24,11 @@
 #include <gmssl/mem.h>
 #include <gmssl/sm2.h>
 #include <gmssl/tls.h>
+#include <gmssl/sdf.h>
 #include <gmssl/error.h>
 
 
-static const char *options = "[-port num] -cert file -key file -pass str [-cacert file]";
+static const char *options = "[-port num] -cert file (-key file | -sdf lib -key_index num) -pass str [-cacert file]";
 
 int tls13_server_main(int argc , char **argv)
 {
@@ -36,6 +37,8 @@ int tls13_server_main(int argc , char **argv)
 	int port = 443;
 	char *certfile = NULL;
 	char *keyfile = NULL;
+	char *sdf_lib = NULL;
+	int key_index = -1;
 	char *pass = NULL;
 	char *cacertfile = NULL;
 
@@ -57,6 +60,10 @@ int tls13_server_main(int argc , char **argv)
 #endif
 	int conn_sock;
 
+	SDF_DEVICE sdf_dev;
+	SDF_ASYNC sign_offload;
+	int sdf_opened = 0;
+
 
 	argc--;
 	argv++;
@@ -79,6 +86,12 @@ int tls13_server_main(int argc , char **argv)
 		} else if (!strcmp(*argv, "-key")) {
 			if (--argc < 1) goto bad;
 			keyfile = *(++argv);
+		} else if (!strcmp(*argv, "-sdf")) {
+			if (--argc < 1) goto bad;
+			sdf_lib = *(++argv);
+		} else if (!strcmp(*argv, "-key_index")) {
+			if (--argc < 1) goto bad;
+			key_index = atoi(*(++argv));
 		} else if (!strcmp(*argv, "-pass")) {
 			if (--argc < 1) goto bad;
 			pass = *(++argv);
@@ -99,8 +112,12 @@ bad:
 		fprintf(stderr, "%s: '-cert' option required\n", prog);
 		return 1;
 	}
-	if (!keyfile) {
-		fprintf(stderr, "%s: '-key' option required\n", prog);
+	if (!keyfile && !sdf_lib) {
+		fprintf(stderr, "%s: '-key' or '-sdf' option required\n", prog);
+		return 1;
+	}
+	if (sdf_lib && key_index < 0) {
+		fprintf(stderr, "%s: '-key_index' option required\n", prog);
 		return 1;
 	}
 	if (!pass) {
@@ -110,10 +127,27 @@ bad:
 
 	memset(&ctx, 0, sizeof(ctx));
 	memset(&conn, 0, sizeof(conn));
+	memset(&sign_offload, 0, sizeof(sign_offload));
 
 	if (tls_ctx_init(&ctx, TLS_protocol_tls13, TLS_server_mode) != 1
-		|| tls_ctx_set_cipher_suites(&ctx, server_ciphers, sizeof(server_ciphers)/sizeof(int)) != 1
-		|| tls_ctx_set_certificate_and_key(&ctx, certfile, keyfile, pass) != 1) {
+		|| tls_ctx_set_cipher_suites(&ctx, server_ciphers, sizeof(server_ciphers)/sizeof(int)) != 1) {
+		error_print();
+		return -1;
+	}
+	if (sdf_lib) {
+		// the ServerKeyExchange or CertificateVerify is signed by the device
+		if (sdf_load_library(sdf_lib, NULL) != 1
+			|| sdf_open_device(&sdf_dev) != 1) {
+			fprintf(stderr, "%s: open SDF device failure\n", prog);
+			return 1;
+		}
+		sdf_opened = 1;
+		if (sdf_async_init(&sign_offload, &sdf_dev, key_index, pass, 1) != 1
+			|| tls_ctx_set_certificate_and_offload_key(&ctx, certfile, &sign_offload) != 1) {
+			error_print();
+			goto end;
+		}
+	} else if (tls_ctx_set_certificate_and_key(&ctx, certfile, keyfile, pass) != 1) {
 		error_print();
 		return -1;
 	}
@@ -188,5 +222,10 @@ restart:
 
 
 end:
+	if (sdf_opened) {
+		sdf_async_cleanup(&sign_offload);
+		sdf_close_device(&sdf_dev);
+		sdf_unload_library();
+	}
 	return ret;
 }
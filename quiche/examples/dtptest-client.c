@@ -111,7 +111,9 @@ static struct argp argp = {options, parse_opt, args_doc, doc};
 
 #define LOCAL_CONN_ID_LEN 16
 
-#define MAX_DATAGRAM_SIZE 1350
+// The largest datagram size, found with path MTU discovery. This fits in the
+// 9000-byte MTU of jumbo frames with IPv6 and UDP headers.
+#define MAX_DATAGRAM_SIZE 8952
 
 #define MAX_BLOCK_SIZE 10000000
 
@@ -155,6 +157,33 @@ void set_tos(int ai_family, int sock, int tos) {
   }
 }
 
+// Keeps the kernel from fragmenting datagrams, so that path MTU discovery
+// probes that are too large for the path are dropped instead.
+void set_pmtudisc(int ai_family, int sock) {
+#if defined(IP_MTU_DISCOVER) && defined(IPV6_MTU_DISCOVER)
+  int ip_val = IP_PMTUDISC_PROBE;
+  int ipv6_val = IPV6_PMTUDISC_PROBE;
+
+  switch (ai_family) {
+  case AF_INET:
+    if (setsockopt(sock, IPPROTO_IP, IP_MTU_DISCOVER, &ip_val,
+                   sizeof(ip_val)) < 0) {
+      log_error("failed to set IP_MTU_DISCOVER %s", strerror(errno));
+    }
+    break;
+  case AF_INET6:
+    if (setsockopt(sock, IPPROTO_IPV6, IPV6_MTU_DISCOVER, &ipv6_val,
+                   sizeof(ipv6_val)) < 0) {
+      log_error("failed to set IPV6_MTU_DISCOVER %s", strerror(errno));
+    }
+    break;
+
+  default:
+    break;
+  }
+#endif
+}
+
 /***** callbacks *****/
 
 static void flush_egress(struct ev_loop *loop, struct conn_io *conn_io) {
@@ -176,10 +205,18 @@ static void flush_egress(struct ev_loop *loop, struct conn_io *conn_io) {
       return;
     }
 
-    set_tos(conn_io->ai_family, conn_io->sock, send_info.diffserv << 2);
+    set_tos(conn_io->ai_family, conn_io->sock,
+            send_info.diffserv << 2 | send_info.ecn);
     ssize_t sent = sendto(conn_io->sock, out, written, 0,
                           (struct sockaddr *)&send_info.to, send_info.to_len);
 
+    // Probes larger than the MTU of the interface are lost like the ones
+    // larger than the path MTU.
+    if (sent < 0 && errno == EMSGSIZE) {
+      log_debug("dropped %zd bytes datagram", written);
+      continue;
+    }
+
     if (sent != written) {
       log_error("failed to send %s", strerror(errno));
       return;
@@ -381,6 +418,8 @@ int main(int argc, char *argv[]) {
     return -1;
   }
 
+  set_pmtudisc(server->ai_family, sock);
+
   quiche_config *config = quiche_config_new(0xbabababa);
   if (config == NULL) {
     log_error("failed to create config");
@@ -394,6 +433,7 @@ int main(int argc, char *argv[]) {
   quiche_config_set_max_idle_timeout(config, 5000);
   quiche_config_set_max_recv_udp_payload_size(config, MAX_DATAGRAM_SIZE);
   quiche_config_set_max_send_udp_payload_size(config, MAX_DATAGRAM_SIZE);
+  quiche_config_discover_pmtu(config, true);
   quiche_config_set_initial_max_data(config, 1000000000);
   quiche_config_set_initial_max_stream_data_bidi_local(config, 10000000);
   quiche_config_set_initial_max_stream_data_bidi_remote(config, 10000000);
@@ -114,7 +114,9 @@ static struct argp argp = {options, parse_opt, args_doc, doc};
 
 #define LOCAL_CONN_ID_LEN 16
 
-#define MAX_DATAGRAM_SIZE 1350
+// The largest datagram size, found with path MTU discovery. This fits in the
+// 9000-byte MTU of jumbo frames with IPv6 and UDP headers.
+#define MAX_DATAGRAM_SIZE 8952
 
 #define MAX_BLOCK_SIZE 10000000
 
@@ -233,6 +235,33 @@ void set_tos(int ai_family, int sock, int tos) {
   }
 }
 
+// Keeps the kernel from fragmenting datagrams, so that path MTU discovery
+// probes that are too large for the path are dropped instead.
+void set_pmtudisc(int ai_family, int sock) {
+#if defined(IP_MTU_DISCOVER) && defined(IPV6_MTU_DISCOVER)
+  int ip_val = IP_PMTUDISC_PROBE;
+  int ipv6_val = IPV6_PMTUDISC_PROBE;
+
+  switch (ai_family) {
+  case AF_INET:
+    if (setsockopt(sock, IPPROTO_IP, IP_MTU_DISCOVER, &ip_val,
+                   sizeof(ip_val)) < 0) {
+      log_error("failed to set IP_MTU_DISCOVER %s", strerror(errno));
+    }
+    break;
+  case AF_INET6:
+    if (setsockopt(sock, IPPROTO_IPV6, IPV6_MTU_DISCOVER, &ipv6_val,
+                   sizeof(ipv6_val)) < 0) {
+      log_error("failed to set IPV6_MTU_DISCOVER %s", strerror(errno));
+    }
+    break;
+
+  default:
+    break;
+  }
+#endif
+}
+
 /***** callbacks *****/
 
 static void timeout_cb(struct ev_loop *loop, ev_timer *w, int revents);
@@ -314,10 +343,17 @@ static void flush_egress(struct ev_loop *loop, struct conn_io *conn_io) {
     }
 
     set_tos(conn_io->peer_addr.ss_family, conn_io->sock,
-            send_info.diffserv << 2);
+            send_info.diffserv << 2 | send_info.ecn);
     ssize_t sent = sendto(conn_io->sock, out, written, 0,
                           (struct sockaddr *)&send_info.to, send_info.to_len);
 
+    // Probes larger than the MTU of the interface are lost like the ones
+    // larger than the path MTU.
+    if (sent < 0 && errno == EMSGSIZE) {
+      log_debug("dropped %zd bytes datagram", written);
+      continue;
+    }
+
     if (sent != written) {
       log_error("failed to send %s", strerror(errno));
       return;
@@ -362,12 +398,14 @@ static void sender_cb(struct ev_loop *loop, ev_timer *w, int revents) {
     int stream_id = 4 * (conn_io->send_round + 1) + 1;
     log_info("send stream %d", stream_id);
     ssize_t sent = 0;
+    // buf is static, so it can be handed to the stream without a copy and
+    // without a release callback.
     if (QUIC_ENABLE) {
-      sent = quiche_conn_stream_send(conn_io->conn, stream_id, buf,
-                                             block.size, true);
+      sent = quiche_conn_stream_send_zc(conn_io->conn, stream_id, buf,
+                                        block.size, true, NULL, NULL);
     } else {
-      sent = quiche_conn_block_send(conn_io->conn, stream_id, buf,
-                                            block.size, true, &block);
+      sent = quiche_conn_block_send_zc(conn_io->conn, stream_id, buf,
+                                       block.size, true, &block, NULL, NULL);
     }
 
     if (sent != block.size) {
@@ -522,6 +560,19 @@ static void recv_cb(struct ev_loop *loop, ev_io *w, int revents) {
 
     log_debug("recv %zd bytes", done);
 
+    // The client may have moved to another address, e.g. after a NAT
+    // rebinding, the connection and its DTP blocks carry on there.
+    struct sockaddr_storage new_addr;
+    socklen_t new_addr_len = quiche_conn_peer_addr(conn_io->conn, &new_addr);
+
+    if (new_addr_len != conn_io->peer_addr_len ||
+        memcmp(&new_addr, &conn_io->peer_addr, new_addr_len) != 0) {
+      log_info("peer migrated");
+
+      memcpy(&conn_io->peer_addr, &new_addr, new_addr_len);
+      conn_io->peer_addr_len = new_addr_len;
+    }
+
     if (quiche_conn_is_established(conn_io->conn)) {
       if (conn_io->send_round == -1) {
         conn_io->send_round = 0;
@@ -633,6 +684,8 @@ int main(int argc, char *argv[]) {
     return -1;
   }
 
+  set_pmtudisc(server->ai_family, sock);
+
   if (bind(sock, server->ai_addr, server->ai_addrlen) < 0) {
     log_error("bind %s", strerror(errno));
     return -1;
@@ -654,6 +707,7 @@ int main(int argc, char *argv[]) {
   quiche_config_set_max_idle_timeout(config, 5000);
   quiche_config_set_max_recv_udp_payload_size(config, MAX_DATAGRAM_SIZE);
   quiche_config_set_max_send_udp_payload_size(config, MAX_DATAGRAM_SIZE);
+  quiche_config_discover_pmtu(config, true);
   quiche_config_set_initial_max_data(config, 1000000000);
   quiche_config_set_initial_max_stream_data_uni(config, 10000000);
   quiche_config_set_initial_max_streams_uni(config, 40000);
@@ -369,6 +369,10 @@ static void recv_cb(EV_P_ ev_io *w, int revents) {
 
         fprintf(stderr, "recv %zd bytes\n", done);
 
+        // The client may have moved to another address.
+        conn_io->peer_addr_len = quiche_conn_peer_addr(conn_io->conn,
+                                                       &conn_io->peer_addr);
+
         if (quiche_conn_is_established(conn_io->conn)) {
             quiche_h3_event *ev;
 
@@ -115,6 +115,12 @@ enum quiche_error {
 
     // Error in congestion control.
     QUICHE_ERR_CONGESTION_CONTROL = -14,
+
+    // The peer provided more connection IDs than the local limit allows.
+    QUICHE_ERR_ID_LIMIT = -17,
+
+    // The peer didn't provide a spare connection ID to migrate with.
+    QUICHE_ERR_OUT_OF_IDENTIFIERS = -18,
 };
 
 // Returns a human readable string with the quiche version number.
@@ -203,6 +209,7 @@ void quiche_config_set_disable_active_migration(quiche_config *config, bool v);
 enum quiche_cc_algorithm {
     QUICHE_CC_RENO = 0,
     QUICHE_CC_CUBIC = 1,
+    QUICHE_CC_BBR2 = 2,
 };
 
 // Sets the congestion control algorithm used.
@@ -211,6 +218,18 @@ void quiche_config_set_cc_algorithm(quiche_config *config, enum quiche_cc_algori
 // Configures whether to use HyStart++.
 void quiche_config_enable_hystart(quiche_config *config, bool v);
 
+// Configures whether to use Explicit Congestion Notification.
+void quiche_config_enable_ecn(quiche_config *config, bool v);
+
+// Configures whether to use L4S marking and scalable congestion response.
+void quiche_config_enable_l4s(quiche_config *config, bool v);
+
+// Configures whether to discover the path MTU.
+void quiche_config_discover_pmtu(quiche_config *config, bool v);
+
+// Configures whether the DTP block deadlines scale the BBRv2 pacing gain.
+void quiche_config_enable_dtp_pacing_gain(quiche_config *config, bool v);
+
 // Configures whether to enable receiving DATAGRAM frames.
 void quiche_config_enable_dgram(quiche_config *config, bool enabled,
                                 size_t recv_queue_len,
@@ -228,6 +247,16 @@ void quiche_config_free(quiche_config *config);
 //sets the 'gmssl' crypto.
 void quiche_config_set_gmssl(quiche_config *config,uint64_t v);
 
+// Takes the SM2 keypairs of the gm key transport from a pool of |size|
+// keypairs, refilled in the background when at most |low_water| are left.
+int quiche_config_enable_gm_key_pool(quiche_config *config, size_t size,
+                                     size_t low_water);
+
+// Returns the number of keypairs taken from the pool and generated inline,
+// or false if the pool is not enabled.
+bool quiche_config_gm_key_pool_stats(const quiche_config *config,
+                                     uint64_t *hits, uint64_t *misses);
+
 // Extracts version, type, source / destination connection ID and address
 // verification token from the packet in |buf|.
 int quiche_header_info(const uint8_t *buf, size_t buf_len, size_t dcil,
@@ -292,6 +321,9 @@ int quiche_conn_set_session(quiche_conn *conn, const uint8_t *buf, size_t buf_le
 typedef struct {
     struct sockaddr *from;
     socklen_t from_len;
+
+    // The ECN codepoint the packet was received with, or 0 if not known.
+    uint8_t ecn;
 } quiche_recv_info;
 
 // Processes QUIC packets received from the peer.
@@ -306,6 +338,9 @@ typedef struct {
     // The time to send the packet out.
     struct timespec at;
 
+    // The ECN codepoint the packet should be sent with.
+    uint8_t ecn;
+
     uint8_t diffserv;
 } quiche_send_info;
 
@@ -320,6 +355,17 @@ size_t quiche_conn_send_quantum(quiche_conn *conn);
 ssize_t quiche_conn_stream_recv(quiche_conn *conn, uint64_t stream_id,
                                 uint8_t *out, size_t buf_len, bool *fin);
 
+// Borrows contiguous data from a stream, without copying it. The data stays
+// valid until the next call on the connection, and is only marked as read by
+// quiche_conn_stream_recv_consume().
+ssize_t quiche_conn_stream_recv_slice(quiche_conn *conn, uint64_t stream_id,
+                                      const uint8_t **out, bool *fin);
+
+// Marks len bytes of the data returned by quiche_conn_stream_recv_slice()
+// as read.
+int quiche_conn_stream_recv_consume(quiche_conn *conn, uint64_t stream_id,
+                                    size_t len);
+
 // Writes data to a stream.
 ssize_t quiche_conn_stream_send(quiche_conn *conn, uint64_t stream_id,
                                 const uint8_t *buf, size_t buf_len, bool fin);
@@ -338,6 +384,25 @@ ssize_t quiche_conn_block_send(quiche_conn *conn, uint64_t stream_id,
                                const uint8_t *buf, size_t buf_len, bool fin,
                                quiche_block *block);
 
+// Writes data to a stream without copying it.
+//
+// The memory pointed to by buf is referenced by the stream until all the
+// data written from it has been acked by the peer, and must not be modified
+// or freed until then. If release is not NULL, release(ctx) is called
+// exactly once for every call to this function, when the memory isn't
+// referenced anymore. This can happen before the function returns, for
+// example when no data was written.
+ssize_t quiche_conn_stream_send_zc(quiche_conn *conn, uint64_t stream_id,
+                                   const uint8_t *buf, size_t buf_len, bool fin,
+                                   void (*release)(void *ctx), void *ctx);
+
+// Writes DTP block to a stream without copying it, see
+// quiche_conn_stream_send_zc().
+ssize_t quiche_conn_block_send_zc(quiche_conn *conn, uint64_t stream_id,
+                                  const uint8_t *buf, size_t buf_len, bool fin,
+                                  quiche_block *block,
+                                  void (*release)(void *ctx), void *ctx);
+
 // Get DTP block info
 void quiche_conn_block_info(quiche_conn *conn, uint64_t stream_id,
                             quiche_block *block);
@@ -398,6 +463,26 @@ void quiche_conn_source_id(quiche_conn *conn, const uint8_t **out, size_t *out_l
 // Returns the destination connection ID.
 void quiche_conn_destination_id(quiche_conn *conn, const uint8_t **out, size_t *out_len);
 
+// Writes the current address of the peer to |out| and returns its length.
+// On the server it changes when the client moves to another address.
+socklen_t quiche_conn_peer_addr(quiche_conn *conn, struct sockaddr_storage *out);
+
+// Returns true if the peer is known to receive packets at its current address.
+bool quiche_conn_is_path_validated(quiche_conn *conn);
+
+// Issues a new source connection ID to the peer, with the given 16 bytes
+// stateless reset token. Returns its sequence number.
+ssize_t quiche_conn_new_scid(quiche_conn *conn, const uint8_t *scid,
+                             size_t scid_len, const uint8_t *reset_token);
+
+// Writes to |out| a source connection ID retired by the peer and returns its
+// length. |out| must be at least QUICHE_MAX_CONN_ID_LEN bytes.
+ssize_t quiche_conn_retired_scid_next(quiche_conn *conn, uint8_t *out,
+                                      size_t out_len);
+
+// Migrates the client to a new local address.
+int quiche_conn_migrate(quiche_conn *conn);
+
 // Returns the negotiated ALPN protocol.
 void quiche_conn_application_proto(quiche_conn *conn, const uint8_t **out,
                                    size_t *out_len);
@@ -584,6 +669,38 @@ void quiche_conn_dgram_purge_outgoing(quiche_conn *conn,
 // Frees the connection object.
 void quiche_conn_free(quiche_conn *conn);
 
+// Table routing connection IDs to connections, safe to use from multiple
+// threads at once.
+typedef struct quiche_cid_table quiche_cid_table;
+
+// Creates a table split into the given number of shards, or a default number
+// of shards if 0.
+quiche_cid_table *quiche_cid_table_new(size_t shards);
+
+// Maps a connection ID to a connection, returning the connection it was
+// previously mapped to, or NULL. Connection IDs longer than
+// QUICHE_MAX_CONN_ID_LEN are ignored.
+void *quiche_cid_table_insert(quiche_cid_table *table, const uint8_t *cid,
+                              size_t cid_len, void *conn);
+
+// Returns the connection a connection ID is mapped to, or NULL.
+void *quiche_cid_table_get(quiche_cid_table *table, const uint8_t *cid,
+                           size_t cid_len);
+
+// Removes the mapping of a connection ID, returning the connection it was
+// mapped to, or NULL.
+void *quiche_cid_table_remove(quiche_cid_table *table, const uint8_t *cid,
+                              size_t cid_len);
+
+// Removes all the connection IDs mapped to the given connection.
+void quiche_cid_table_remove_conn(quiche_cid_table *table, void *conn);
+
+// Returns the number of connection IDs in the table.
+size_t quiche_cid_table_len(quiche_cid_table *table);
+
+// Frees the table.
+void quiche_cid_table_free(quiche_cid_table *table);
+
 
 // HTTP/3 API
 //
@@ -709,6 +826,12 @@ enum quiche_h3_error {
 
     // See QUICHE_ERR_CONGESTION_CONTROL.
     QUICHE_H3_TRANSPORT_ERR_CONGESTION_CONTROL = QUICHE_ERR_CONGESTION_CONTROL - 1000,
+
+    // See QUICHE_ERR_ID_LIMIT.
+    QUICHE_H3_TRANSPORT_ERR_ID_LIMIT = QUICHE_ERR_ID_LIMIT - 1000,
+
+    // See QUICHE_ERR_OUT_OF_IDENTIFIERS.
+    QUICHE_H3_TRANSPORT_ERR_OUT_OF_IDENTIFIERS = QUICHE_ERR_OUT_OF_IDENTIFIERS - 1000,
 };
 
 // Stores configuration shared between multiple connections.
@@ -0,0 +1,345 @@
+// Copyright (C) 2022, Cloudflare, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//! Connection IDs issued with NEW_CONNECTION_ID frames ([RFC 9000 §5.1]).
+//!
+//! Each end issues spare connection IDs to its peer, so that the peer can
+//! switch to one nobody saw before when it moves to another path, and the
+//! packets sent on the two paths can't be linked to each other by observers.
+//!
+//! [RFC 9000 §5.1]: https://www.rfc-editor.org/rfc/rfc9000.html#section-5.1
+
+use std::collections::VecDeque;
+
+use crate::Error;
+use crate::Result;
+
+use crate::packet::ConnectionId;
+
+#[derive(Default)]
+pub struct ConnectionIds {
+    /// Sequence number of the destination connection ID in use.
+    dcid_seq: u64,
+
+    /// Destination connection IDs issued by the peer that weren't used yet.
+    spare_dcids: VecDeque<(u64, ConnectionId<'static>)>,
+
+    /// Largest Retire Prior To field received from the peer.
+    retire_prior_to: u64,
+
+    /// Sequence numbers of the destination connection IDs to retire with
+    /// RETIRE_CONNECTION_ID frames.
+    retire_dcids: VecDeque<u64>,
+
+    /// Source connection IDs issued to the peer and not retired, with their
+    /// stateless reset tokens.
+    scids: VecDeque<(u64, ConnectionId<'static>, [u8; 16])>,
+
+    /// Sequence number of the next source connection ID.
+    next_scid_seq: u64,
+
+    /// Sequence numbers of the source connection IDs to advertise with
+    /// NEW_CONNECTION_ID frames.
+    new_scids: VecDeque<u64>,
+
+    /// Source connection IDs retired by the peer, until the application
+    /// stops routing them to the connection.
+    retired_scids: VecDeque<ConnectionId<'static>>,
+}
+
+impl ConnectionIds {
+    /// Creates the connection IDs of a connection whose initial source
+    /// connection ID is `scid`.
+    pub fn new(scid: &ConnectionId) -> Self {
+        let mut scids = VecDeque::new();
+        scids.push_back((0, scid.to_vec().into(), [0; 16]));
+
+        ConnectionIds {
+            scids,
+            next_scid_seq: 1,
+            ..Default::default()
+        }
+    }
+
+    /// Processes a NEW_CONNECTION_ID frame.
+    ///
+    /// When the frame retires the destination connection ID in use, the one
+    /// to replace it with is returned.
+    pub fn on_new_dcid(
+        &mut self, seq: u64, retire_prior_to: u64, cid: ConnectionId<'static>,
+        limit: u64,
+    ) -> Result<Option<ConnectionId<'static>>> {
+        if retire_prior_to > seq {
+            return Err(Error::InvalidFrame);
+        }
+
+        let known = seq == self.dcid_seq ||
+            self.spare_dcids.iter().any(|(s, _)| *s == seq);
+
+        if seq < self.retire_prior_to {
+            // Already retired, only acknowledge it.
+            if !self.retire_dcids.contains(&seq) {
+                self.retire_dcids.push_back(seq);
+            }
+        } else if !known {
+            self.spare_dcids.push_back((seq, cid));
+        }
+
+        let mut replacement = None;
+
+        if retire_prior_to > self.retire_prior_to {
+            self.retire_prior_to = retire_prior_to;
+
+            let retire_dcids = &mut self.retire_dcids;
+
+            self.spare_dcids.retain(|(s, _)| {
+                if *s < retire_prior_to {
+                    retire_dcids.push_back(*s);
+                    return false;
+                }
+
+                true
+            });
+
+            if self.dcid_seq < retire_prior_to {
+                // At least the connection ID of this frame is left.
+                replacement = self.rotate_dcid();
+            }
+        }
+
+        if self.spare_dcids.len() as u64 + 1 > limit {
+            return Err(Error::IdLimit);
+        }
+
+        Ok(replacement)
+    }
+
+    /// Retires the destination connection ID in use and returns a spare one
+    /// to replace it with, if any.
+    pub fn rotate_dcid(&mut self) -> Option<ConnectionId<'static>> {
+        let (seq, cid) = self.spare_dcids.pop_front()?;
+
+        self.retire_dcids.push_back(self.dcid_seq);
+        self.dcid_seq = seq;
+
+        Some(cid)
+    }
+
+    pub fn has_spare_dcid(&self) -> bool {
+        !self.spare_dcids.is_empty()
+    }
+
+    /// Returns the sequence number of the next destination connection ID to
+    /// retire with a RETIRE_CONNECTION_ID frame.
+    pub fn retire_dcid_pending(&self) -> Option<u64> {
+        self.retire_dcids.front().copied()
+    }
+
+    pub fn on_retire_dcid_sent(&mut self) {
+        self.retire_dcids.pop_front();
+    }
+
+    pub fn on_retire_dcid_lost(&mut self, seq: u64) {
+        self.retire_dcids.push_back(seq);
+    }
+
+    /// Issues a new source connection ID, returning its sequence number.
+    ///
+    /// The peer can't be given more than `limit` active connection IDs.
+    pub fn new_scid(
+        &mut self, cid: ConnectionId<'static>, reset_token: [u8; 16], limit: u64,
+    ) -> Result<u64> {
+        if self.scids.iter().any(|(_, c, _)| *c == cid) {
+            return Err(Error::InvalidState);
+        }
+
+        if self.scids.len() as u64 >= limit {
+            return Err(Error::IdLimit);
+        }
+
+        let seq = self.next_scid_seq;
+
+        self.scids.push_back((seq, cid, reset_token));
+        self.new_scids.push_back(seq);
+
+        self.next_scid_seq += 1;
+
+        Ok(seq)
+    }
+
+    /// Returns the next source connection ID to advertise with a
+    /// NEW_CONNECTION_ID frame.
+    pub fn new_scid_pending(
+        &self,
+    ) -> Option<(u64, &ConnectionId<'static>, [u8; 16])> {
+        let seq = *self.new_scids.front()?;
+
+        self.scids
+            .iter()
+            .find(|(s, ..)| *s == seq)
+            .map(|(s, cid, token)| (*s, cid, *token))
+    }
+
+    pub fn on_new_scid_sent(&mut self) {
+        self.new_scids.pop_front();
+    }
+
+    pub fn on_new_scid_lost(&mut self, seq: u64) {
+        if self.scids.iter().any(|(s, ..)| *s == seq) {
+            self.new_scids.push_back(seq);
+        }
+    }
+
+    /// Processes a RETIRE_CONNECTION_ID frame.
+    pub fn on_retire_scid(&mut self, seq: u64) -> Result<()> {
+        if seq >= self.next_scid_seq {
+            return Err(Error::InvalidFrame);
+        }
+
+        if let Some(i) = self.scids.iter().position(|(s, ..)| *s == seq) {
+            let (_, cid, _) = self.scids.remove(i).unwrap();
+
+            self.retired_scids.push_back(cid);
+            self.new_scids.retain(|s| *s != seq);
+        }
+
+        Ok(())
+    }
+
+    pub fn retired_scid_next(&mut self) -> Option<ConnectionId<'static>> {
+        self.retired_scids.pop_front()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn cid(v: u8) -> ConnectionId<'static> {
+        vec![v; 8].into()
+    }
+
+    #[test]
+    fn spare_dcids() {
+        let mut ids = ConnectionIds::new(&cid(0));
+
+        assert_eq!(ids.rotate_dcid(), None);
+        assert_eq!(ids.retire_dcid_pending(), None);
+
+        assert_eq!(ids.on_new_dcid(1, 0, cid(1), 3), Ok(None));
+        assert_eq!(ids.on_new_dcid(2, 0, cid(2), 3), Ok(None));
+
+        // Duplicate.
+        assert_eq!(ids.on_new_dcid(2, 0, cid(2), 3), Ok(None));
+
+        assert_eq!(ids.on_new_dcid(3, 0, cid(3), 3), Err(Error::IdLimit));
+
+        let mut ids = ConnectionIds::new(&cid(0));
+
+        assert_eq!(ids.on_new_dcid(1, 0, cid(1), 2), Ok(None));
+        assert!(ids.has_spare_dcid());
+
+        // Migration.
+        assert_eq!(ids.rotate_dcid(), Some(cid(1)));
+        assert!(!ids.has_spare_dcid());
+
+        assert_eq!(ids.retire_dcid_pending(), Some(0));
+        ids.on_retire_dcid_sent();
+        assert_eq!(ids.retire_dcid_pending(), None);
+
+        ids.on_retire_dcid_lost(0);
+        assert_eq!(ids.retire_dcid_pending(), Some(0));
+    }
+
+    #[test]
+    fn retire_prior_to() {
+        let mut ids = ConnectionIds::new(&cid(0));
+
+        assert_eq!(ids.on_new_dcid(1, 2, cid(1), 4), Err(Error::InvalidFrame));
+
+        assert_eq!(ids.on_new_dcid(1, 0, cid(1), 4), Ok(None));
+        assert_eq!(ids.on_new_dcid(2, 0, cid(2), 4), Ok(None));
+
+        // Both the connection ID in use and the first spare are retired.
+        assert_eq!(ids.on_new_dcid(3, 2, cid(3), 4), Ok(Some(cid(2))));
+
+        let mut retired = Vec::new();
+        while let Some(seq) = ids.retire_dcid_pending() {
+            retired.push(seq);
+            ids.on_retire_dcid_sent();
+        }
+
+        retired.sort_unstable();
+        assert_eq!(retired, vec![0, 1]);
+
+        // A connection ID already retired is retired right away.
+        assert_eq!(ids.on_new_dcid(1, 0, cid(1), 4), Ok(None));
+        assert_eq!(ids.retire_dcid_pending(), Some(1));
+
+        assert_eq!(ids.rotate_dcid(), Some(cid(3)));
+    }
+
+    #[test]
+    fn scids() {
+        let mut ids = ConnectionIds::new(&cid(0));
+        assert_eq!(ids.scids.len(), 1);
+        assert_eq!(ids.new_scid_pending(), None);
+
+        assert_eq!(ids.new_scid(cid(0), [0; 16], 3), Err(Error::InvalidState));
+
+        assert_eq!(ids.new_scid(cid(1), [1; 16], 3), Ok(1));
+        assert_eq!(ids.new_scid(cid(2), [2; 16], 3), Ok(2));
+        assert_eq!(ids.new_scid(cid(3), [3; 16], 3), Err(Error::IdLimit));
+
+        assert_eq!(ids.new_scid_pending(), Some((1, &cid(1), [1; 16])));
+        ids.on_new_scid_sent();
+        assert_eq!(ids.new_scid_pending(), Some((2, &cid(2), [2; 16])));
+        ids.on_new_scid_sent();
+        assert_eq!(ids.new_scid_pending(), None);
+
+        ids.on_new_scid_lost(1);
+        assert_eq!(ids.new_scid_pending(), Some((1, &cid(1), [1; 16])));
+
+        assert_eq!(ids.on_retire_scid(3), Err(Error::InvalidFrame));
+
+        // Retiring the connection ID drops its pending NEW_CONNECTION_ID.
+        assert_eq!(ids.on_retire_scid(1), Ok(()));
+        assert_eq!(ids.new_scid_pending(), None);
+        assert_eq!(ids.scids.len(), 2);
+
+        ids.on_new_scid_lost(1);
+        assert_eq!(ids.new_scid_pending(), None);
+
+        assert_eq!(ids.retired_scid_next(), Some(cid(1)));
+        assert_eq!(ids.retired_scid_next(), None);
+
+        // Retired twice.
+        assert_eq!(ids.on_retire_scid(1), Ok(()));
+        assert_eq!(ids.retired_scid_next(), None);
+
+        assert_eq!(ids.new_scid(cid(3), [3; 16], 3), Ok(3));
+    }
+}
@@ -0,0 +1,375 @@
+// Copyright (C) 2022, Cloudflare, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//! Concurrent routing table from connection IDs to connections.
+
+use std::collections::hash_map::RandomState;
+use std::collections::HashMap;
+
+use std::hash::BuildHasher;
+use std::hash::BuildHasherDefault;
+use std::hash::Hash;
+use std::hash::Hasher;
+
+use std::sync::RwLock;
+
+use crate::MAX_CONN_ID_LEN;
+
+/// The default number of shards of a table.
+const DEFAULT_SHARDS: usize = 64;
+
+/// The maximum number of shards of a table.
+const MAX_SHARDS: usize = 1 << 16;
+
+/// A connection ID stored inline, along with its hash.
+#[derive(Clone, Copy)]
+struct Key {
+    hash: u64,
+
+    len: u8,
+
+    cid: [u8; MAX_CONN_ID_LEN],
+}
+
+impl PartialEq for Key {
+    fn eq(&self, other: &Key) -> bool {
+        self.hash == other.hash &&
+            self.cid[..self.len as usize] == other.cid[..other.len as usize]
+    }
+}
+
+impl Eq for Key {}
+
+impl Hash for Key {
+    fn hash<H: Hasher>(&self, state: &mut H) {
+        state.write_u64(self.hash);
+    }
+}
+
+/// Hasher for keys whose hash is already computed.
+#[derive(Default)]
+struct KeyHasher(u64);
+
+impl Hasher for KeyHasher {
+    fn write(&mut self, _: &[u8]) {
+        unreachable!();
+    }
+
+    fn write_u64(&mut self, v: u64) {
+        self.0 = v;
+    }
+
+    fn finish(&self) -> u64 {
+        self.0
+    }
+}
+
+type Shard<T> = RwLock<HashMap<Key, T, BuildHasherDefault<KeyHasher>>>;
+
+/// A table mapping connection IDs to the connections they belong to, that can
+/// be shared between the threads of a server.
+///
+/// The table is split into shards, each protected by its own read-write lock,
+/// and connection IDs are spread over the shards with a keyed hash, so
+/// lookups of different connections rarely contend with each other, and
+/// lookups of the same one never block each other.
+///
+/// A connection can be reached through any number of connection IDs: each
+/// connection ID the server issues (e.g. in NEW_CONNECTION_ID frames) is
+/// inserted with the same value, typically an index or a reference-counted
+/// handle to the connection, and removed when it is retired.
+///
+/// Connection IDs are stored inline instead of in separate allocations, so a
+/// lookup touches a single bucket of a single shard. Connection IDs longer
+/// than [`MAX_CONN_ID_LEN`] can't be inserted.
+///
+/// [`MAX_CONN_ID_LEN`]: constant.MAX_CONN_ID_LEN.html
+///
+/// ## Examples:
+///
+/// ```
+/// let table = quiche::ConnectionIdTable::new();
+///
+/// table.insert(&[0xba; 16], 1);
+/// table.insert(&[0xbb; 16], 1);
+///
+/// assert_eq!(table.get(&[0xbb; 16]), Some(1));
+///
+/// table.remove(&[0xba; 16]);
+/// assert_eq!(table.get(&[0xba; 16]), None);
+/// ```
+pub struct ConnectionIdTable<T> {
+    shards: Vec<Shard<T>>,
+
+    /// Hashes connection IDs, with a key unknown to peers.
+    hasher: RandomState,
+}
+
+impl<T: Clone> ConnectionIdTable<T> {
+    /// Creates an empty table.
+    pub fn new() -> ConnectionIdTable<T> {
+        ConnectionIdTable::with_shards(DEFAULT_SHARDS)
+    }
+
+    /// Creates an empty table split into `shards` shards, rounded up to a
+    /// power of two and capped to 65536.
+    ///
+    /// More shards reduce contention between threads updating the table.
+    pub fn with_shards(shards: usize) -> ConnectionIdTable<T> {
+        let shards = shards.max(1).min(MAX_SHARDS).next_power_of_two();
+
+        ConnectionIdTable {
+            shards: (0..shards)
+                .map(|_| RwLock::new(HashMap::default()))
+                .collect(),
+            hasher: RandomState::new(),
+        }
+    }
+
+    /// Maps `cid` to `value`, returning the value it was previously mapped
+    /// to, if any.
+    ///
+    /// ## Panics:
+    ///
+    /// Panics if `cid` is longer than [`MAX_CONN_ID_LEN`].
+    ///
+    /// [`MAX_CONN_ID_LEN`]: constant.MAX_CONN_ID_LEN.html
+    pub fn insert(&self, cid: &[u8], value: T) -> Option<T> {
+        let key = self.key(cid).expect("connection ID too long");
+
+        self.shard(&key).write().unwrap().insert(key, value)
+    }
+
+    /// Returns the value `cid` is mapped to, if any.
+    pub fn get(&self, cid: &[u8]) -> Option<T> {
+        let key = self.key(cid)?;
+
+        self.shard(&key).read().unwrap().get(&key).cloned()
+    }
+
+    /// Removes the mapping of `cid`, returning the value it was mapped to, if
+    /// any.
+    pub fn remove(&self, cid: &[u8]) -> Option<T> {
+        let key = self.key(cid)?;
+
+        self.shard(&key).write().unwrap().remove(&key)
+    }
+
+    /// Keeps only the mappings for which `f` returns `true`.
+    ///
+    /// This can be used to remove all the connection IDs of a connection at
+    /// once when it is closed. Each shard is locked in turn, so lookups can
+    /// proceed concurrently.
+    pub fn retain<F>(&self, mut f: F)
+    where
+        F: FnMut(&[u8], &T) -> bool,
+    {
+        for shard in &self.shards {
+            shard
+                .write()
+                .unwrap()
+                .retain(|k, v| f(&k.cid[..k.len as usize], v));
+        }
+    }
+
+    /// Returns the number of connection IDs in the table.
+    pub fn len(&self) -> usize {
+        self.shards.iter().map(|s| s.read().unwrap().len()).sum()
+    }
+
+    /// Returns true if the table contains no connection IDs.
+    pub fn is_empty(&self) -> bool {
+        self.shards.iter().all(|s| s.read().unwrap().is_empty())
+    }
+
+    fn key(&self, cid: &[u8]) -> Option<Key> {
+        if cid.len() > MAX_CONN_ID_LEN {
+            return None;
+        }
+
+        let mut h = self.hasher.build_hasher();
+        h.write(cid);
+
+        let mut key = Key {
+            hash: h.finish(),
+            len: cid.len() as u8,
+            cid: [0; MAX_CONN_ID_LEN],
+        };
+
+        key.cid[..cid.len()].copy_from_slice(cid);
+
+        Some(key)
+    }
+
+    fn shard(&self, key: &Key) -> &Shard<T> {
+        // The hash map of a shard picks the bucket from the bottom bits of the
+        // hash and tags it with the top 7 bits, use bits from the middle so
+        // that keys in the same shard don't share either.
+        let i = (key.hash >> 32) as usize & (self.shards.len() - 1);
+
+        &self.shards[i]
+    }
+}
+
+impl<T: Clone> Default for ConnectionIdTable<T> {
+    fn default() -> Self {
+        ConnectionIdTable::new()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use std::sync::Arc;
+
+    use std::time::Instant;
+
+    #[test]
+    fn multiple_cids() {
+        let table = ConnectionIdTable::with_shards(4);
+        assert!(table.is_empty());
+
+        assert_eq!(table.insert(b"aaaa", 1), None);
+        assert_eq!(table.insert(b"bbbb", 1), None);
+        assert_eq!(table.insert(b"cccc", 2), None);
+        assert_eq!(table.len(), 3);
+
+        assert_eq!(table.get(b"aaaa"), Some(1));
+        assert_eq!(table.get(b"bbbb"), Some(1));
+        assert_eq!(table.get(b"cccc"), Some(2));
+        assert_eq!(table.get(b"dddd"), None);
+
+        // Retire a connection ID.
+        assert_eq!(table.remove(b"aaaa"), Some(1));
+        assert_eq!(table.get(b"aaaa"), None);
+        assert_eq!(table.remove(b"aaaa"), None);
+
+        assert_eq!(table.insert(b"cccc", 3), Some(2));
+
+        // Close connection 3.
+        table.retain(|_, v| *v != 3);
+        assert_eq!(table.len(), 1);
+        assert_eq!(table.get(b"bbbb"), Some(1));
+    }
+
+    #[test]
+    fn concurrent() {
+        let table = Arc::new(ConnectionIdTable::with_shards(8));
+
+        let threads: Vec<_> = (0..4u32)
+            .map(|t| {
+                let table = table.clone();
+
+                std::thread::spawn(move || {
+                    for i in 0..1000u32 {
+                        let cid = [t.to_be_bytes(), i.to_be_bytes()].concat();
+
+                        table.insert(&cid, (t, i));
+                        assert_eq!(table.get(&cid), Some((t, i)));
+
+                        if i % 2 == 0 {
+                            table.remove(&cid);
+                        }
+                    }
+                })
+            })
+            .collect();
+
+        for t in threads {
+            t.join().unwrap();
+        }
+
+        assert_eq!(table.len(), 2000);
+    }
+
+    // Measures the cost of finding the connection of a packet among 1M
+    // connections, with 2 connection IDs each, from several threads.
+    //
+    // Run with `cargo test --release -- --ignored --nocapture demux_1m_conns`.
+    #[test]
+    #[ignore]
+    fn demux_1m_conns() {
+        const CONNS: u64 = 1_000_000;
+        const LOOKUPS: u64 = 4_000_000;
+
+        let table = Arc::new(ConnectionIdTable::new());
+
+        let cid = |conn: u64, seq: u64| {
+            let mut cid = [0; 16];
+
+            // Spread the connection IDs like random ones would be.
+            let x = (conn * 2 + seq).wrapping_mul(0x9e37_79b9_7f4a_7c15);
+            cid[..8].copy_from_slice(&x.to_be_bytes());
+            cid[8..].copy_from_slice(&conn.to_be_bytes());
+
+            cid
+        };
+
+        for conn in 0..CONNS {
+            table.insert(&cid(conn, 0), conn);
+            table.insert(&cid(conn, 1), conn);
+        }
+
+        for readers in &[1, 2, 4] {
+            let start = Instant::now();
+
+            let threads: Vec<_> = (0..*readers)
+                .map(|r| {
+                    let table = table.clone();
+
+                    std::thread::spawn(move || {
+                        let mut x = r as u64 + 1;
+
+                        for _ in 0..LOOKUPS / readers {
+                            x = x
+                                .wrapping_mul(6364136223846793005)
+                                .wrapping_add(1);
+
+                            let conn = (x >> 33) % CONNS;
+
+                            assert_eq!(table.get(&cid(conn, x & 1)), Some(conn));
+                        }
+                    })
+                })
+                .collect();
+
+            for t in threads {
+                t.join().unwrap();
+            }
+
+            let elapsed = start.elapsed();
+
+            println!(
+                "{} readers: {} lookups in {:?} ({:.1} Mlookups/s)",
+                readers,
+                LOOKUPS,
+                elapsed,
+                LOOKUPS as f64 / elapsed.as_secs_f64() / 1e6
+            );
+        }
+    }
+}
@@ -572,6 +572,55 @@ pub struct SM2_KEY {
     pub(crate)  private_key: [u8; 32],
 }
 
+#[allow(non_camel_case_types)]
+#[repr(transparent)]
+struct SM2_KEY_POOL(c_void);
+
+/// A GmSSL `SM2_KEY_POOL`: SM2 keypairs generated ahead of time by a
+/// background thread, shared by the connections of a `Config`.
+pub struct Sm2KeyPool(*mut SM2_KEY_POOL);
+
+impl Sm2KeyPool {
+    pub fn new(size: usize, low_water: usize) -> Result<Sm2KeyPool> {
+        let pool = unsafe { sm2_key_pool_new(size, low_water) };
+
+        if pool.is_null() {
+            return Err(Error::CryptoFail);
+        }
+
+        Ok(Sm2KeyPool(pool))
+    }
+
+    /// Takes a keypair from the pool, or generates it inline if the pool is
+    /// empty.
+    pub fn generate(&self, key: &mut SM2_KEY) -> Result<()> {
+        match unsafe { sm2_key_pool_get(self.0, key) } {
+            1 => Ok(()),
+            _ => Err(Error::CryptoFail),
+        }
+    }
+
+    /// Returns the number of keypairs taken from the pool and generated
+    /// inline.
+    pub fn stats(&self) -> (u64, u64) {
+        let mut hits = 0;
+        let mut misses = 0;
+
+        unsafe { sm2_key_pool_get_stats(self.0, &mut hits, &mut misses) };
+
+        (hits, misses)
+    }
+}
+
+unsafe impl std::marker::Send for Sm2KeyPool {}
+unsafe impl std::marker::Sync for Sm2KeyPool {}
+
+impl Drop for Sm2KeyPool {
+    fn drop(&mut self) {
+        unsafe { sm2_key_pool_free(self.0) }
+    }
+}
+
 extern {
     // EVP_AEAD
     fn EVP_aead_aes_128_gcm() -> *const EVP_AEAD;
@@ -625,7 +674,7 @@ extern {
         outbuf:*mut u8,
         outlen:*mut usize,
 
-    );
+    ) -> c_int;
 
 
     pub fn sm2_decrypt(
@@ -634,7 +683,18 @@ extern {
         inlen:usize,
         outbuf:*mut u8,
         outlen:*mut usize,
+    ) -> c_int;
+
+    // SM2_KEY_POOL
+    fn sm2_key_pool_new(size: usize, low_water: usize) -> *mut SM2_KEY_POOL;
+
+    fn sm2_key_pool_get(pool: *mut SM2_KEY_POOL, key: *mut SM2_KEY) -> c_int;
+
+    fn sm2_key_pool_get_stats(
+        pool: *const SM2_KEY_POOL, hits: *mut u64, misses: *mut u64,
     );
+
+    fn sm2_key_pool_free(pool: *mut SM2_KEY_POOL);
 }
 
 #[cfg(test)]
@@ -24,6 +24,7 @@
 // NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
 // SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
+use std::convert::TryInto;
 use std::ffi;
 use std::ptr;
 use std::slice;
@@ -327,6 +328,27 @@ pub extern fn quiche_config_enable_hystart(config: &mut Config, v: bool) {
     config.enable_hystart(v);
 }
 
+#[no_mangle]
+pub extern fn quiche_config_enable_ecn(config: &mut Config, v: bool) {
+    config.enable_ecn(v);
+}
+
+#[no_mangle]
+pub extern fn quiche_config_enable_l4s(config: &mut Config, v: bool) {
+    config.enable_l4s(v);
+}
+
+#[no_mangle]
+pub extern fn quiche_config_discover_pmtu(config: &mut Config, v: bool) {
+    config.discover_pmtu(v);
+}
+
+#[cfg(feature = "dtp")]
+#[no_mangle]
+pub extern fn quiche_config_enable_dtp_pacing_gain(config: &mut Config, v: bool) {
+    config.enable_dtp_pacing_gain(v);
+}
+
 #[no_mangle]
 pub extern fn quiche_config_enable_dgram(
     config: &mut Config, enabled: bool, recv_queue_len: size_t,
@@ -655,12 +677,15 @@ pub extern fn quiche_conn_set_session(
 pub struct RecvInfo<'a> {
     from: &'a sockaddr,
     from_len: socklen_t,
+
+    ecn: u8,
 }
 
 impl<'a> From<&RecvInfo<'a>> for crate::RecvInfo {
     fn from(info: &RecvInfo) -> crate::RecvInfo {
         crate::RecvInfo {
             from: std_addr_from_c(info.from, info.from_len),
+            ecn: info.ecn,
         }
     }
 }
@@ -689,6 +714,8 @@ pub struct SendInfo {
 
     at: timespec,
 
+    ecn: u8,
+
     #[cfg(feature = "diffserv")]
     diffserv: u8,
 }
@@ -709,6 +736,8 @@ pub extern fn quiche_conn_send(
 
             std_time_to_c(&info.at, &mut out_info.at);
 
+            out_info.ecn = info.ecn;
+
             #[cfg(feature = "diffserv")]
             {
                 out_info.diffserv = info.diffserv;
@@ -727,6 +756,33 @@ pub extern fn quiche_config_set_gmssl(config: &mut Config, v: u64) {
     config.set_gmssl(v);
 }
 
+#[no_mangle]
+pub extern fn quiche_config_enable_gm_key_pool(
+    config: &mut Config, size: size_t, low_water: size_t,
+) -> c_int {
+    match config.enable_gm_key_pool(size, low_water) {
+        Ok(_) => 0,
+
+        Err(e) => e.to_c() as c_int,
+    }
+}
+
+#[no_mangle]
+pub extern fn quiche_config_gm_key_pool_stats(
+    config: &Config, hits: &mut u64, misses: &mut u64,
+) -> bool {
+    match config.gm_key_pool_stats() {
+        Some((h, m)) => {
+            *hits = h;
+            *misses = m;
+
+            true
+        },
+
+        None => false,
+    }
+}
+
 #[no_mangle]
 pub extern fn quiche_conn_stream_recv(
     conn: &mut Connection, stream_id: u64, out: *mut u8, out_len: size_t,
@@ -749,6 +805,33 @@ pub extern fn quiche_conn_stream_recv(
     out_len as ssize_t
 }
 
+#[no_mangle]
+pub extern fn quiche_conn_stream_recv_slice(
+    conn: &mut Connection, stream_id: u64, out: &mut *const u8, fin: &mut bool,
+) -> ssize_t {
+    let (data, data_fin) = match conn.stream_recv_slice(stream_id) {
+        Ok(v) => v,
+
+        Err(e) => return e.to_c(),
+    };
+
+    *out = data.as_ptr();
+    *fin = data_fin;
+
+    data.len() as ssize_t
+}
+
+#[no_mangle]
+pub extern fn quiche_conn_stream_recv_consume(
+    conn: &mut Connection, stream_id: u64, len: size_t,
+) -> c_int {
+    match conn.stream_recv_consume(stream_id, len) {
+        Ok(_) => 0,
+
+        Err(e) => e.to_c() as c_int,
+    }
+}
+
 #[no_mangle]
 pub extern fn quiche_conn_stream_send(
     conn: &mut Connection, stream_id: u64, buf: *const u8, buf_len: size_t,
@@ -787,6 +870,79 @@ pub extern fn quiche_conn_block_send(
     }
 }
 
+/// Application memory passed to the `_zc` send functions, released through
+/// the application's callback once quiche doesn't reference it anymore.
+struct ForeignBuf {
+    ptr: *const u8,
+    len: usize,
+    release: Option<extern fn(ctx: *mut c_void)>,
+    ctx: *mut c_void,
+}
+
+unsafe impl Send for ForeignBuf {}
+unsafe impl Sync for ForeignBuf {}
+
+impl AsRef<[u8]> for ForeignBuf {
+    fn as_ref(&self) -> &[u8] {
+        unsafe { slice::from_raw_parts(self.ptr, self.len) }
+    }
+}
+
+impl Drop for ForeignBuf {
+    fn drop(&mut self) {
+        if let Some(release) = self.release {
+            release(self.ctx);
+        }
+    }
+}
+
+fn foreign_buf(
+    buf: *const u8, buf_len: size_t, release: Option<extern fn(*mut c_void)>,
+    ctx: *mut c_void,
+) -> ZeroCopyBuf {
+    if buf_len > <ssize_t>::max_value() as usize {
+        panic!("The provided buffer is too large");
+    }
+
+    ZeroCopyBuf::new(ForeignBuf {
+        ptr: buf,
+        len: buf_len,
+        release,
+        ctx,
+    })
+}
+
+#[no_mangle]
+pub extern fn quiche_conn_stream_send_zc(
+    conn: &mut Connection, stream_id: u64, buf: *const u8, buf_len: size_t,
+    fin: bool, release: Option<extern fn(ctx: *mut c_void)>, ctx: *mut c_void,
+) -> ssize_t {
+    let buf = foreign_buf(buf, buf_len, release, ctx);
+
+    match conn.stream_send_zc(stream_id, &buf, fin) {
+        Ok(v) => v as ssize_t,
+
+        Err(e) => e.to_c(),
+    }
+}
+
+#[cfg(feature = "dtp")]
+#[no_mangle]
+pub extern fn quiche_conn_block_send_zc(
+    conn: &mut Connection, stream_id: u64, buf: *const u8, buf_len: size_t,
+    fin: bool, block: &stream::Block,
+    release: Option<extern fn(ctx: *mut c_void)>, ctx: *mut c_void,
+) -> ssize_t {
+    let buf = foreign_buf(buf, buf_len, release, ctx);
+    let block = Arc::new(block.to_owned());
+
+    match conn.block_send_zc(stream_id, &buf, fin, block) {
+        Ok(v) => v as ssize_t,
+
+        Err(e) => e.to_c(),
+    }
+}
+
 #[cfg(feature = "dtp")]
 #[no_mangle]
 pub extern fn quiche_conn_block_info(
@@ -868,7 +1024,8 @@ pub extern fn quiche_conn_is_readable(conn: &Connection) -> bool {
     conn.is_readable()
 }
 
-struct AppData(*mut c_void);
+#[derive(Clone, Copy)]
+pub(crate) struct AppData(*mut c_void);
 unsafe impl Send for AppData {}
 unsafe impl Sync for AppData {}
 
@@ -962,6 +1119,66 @@ pub extern fn quiche_conn_destination_id(
     *out_len = id.len();
 }
 
+#[no_mangle]
+pub extern fn quiche_conn_peer_addr(
+    conn: &mut Connection, out: &mut sockaddr_storage,
+) -> socklen_t {
+    std_addr_to_c(&conn.peer_addr(), out)
+}
+
+#[no_mangle]
+pub extern fn quiche_conn_is_path_validated(conn: &mut Connection) -> bool {
+    conn.is_path_validated()
+}
+
+#[no_mangle]
+pub extern fn quiche_conn_new_scid(
+    conn: &mut Connection, scid: *const u8, scid_len: size_t,
+    reset_token: *const u8,
+) -> ssize_t {
+    let scid = unsafe { slice::from_raw_parts(scid, scid_len) };
+    let scid = ConnectionId::from_ref(scid);
+
+    let reset_token = unsafe { slice::from_raw_parts(reset_token, 16) };
+    let reset_token = u128::from_be_bytes(reset_token.try_into().unwrap());
+
+    match conn.new_scid(&scid, reset_token) {
+        Ok(v) => v as ssize_t,
+
+        Err(e) => e.to_c(),
+    }
+}
+
+#[no_mangle]
+pub extern fn quiche_conn_retired_scid_next(
+    conn: &mut Connection, out: *mut u8, out_len: size_t,
+) -> ssize_t {
+    if out_len < MAX_CONN_ID_LEN {
+        return Error::BufferTooShort.to_c();
+    }
+
+    let out = unsafe { slice::from_raw_parts_mut(out, out_len) };
+
+    match conn.retired_scid_next() {
+        Some(cid) => {
+            out[..cid.len()].copy_from_slice(&cid);
+
+            cid.len() as ssize_t
+        },
+
+        None => Error::Done.to_c(),
+    }
+}
+
+#[no_mangle]
+pub extern fn quiche_conn_migrate(conn: &mut Connection) -> c_int {
+    match conn.migrate() {
+        Ok(_) => 0,
+
+        Err(e) => e.to_c() as c_int,
+    }
+}
+
 #[no_mangle]
 pub extern fn quiche_conn_application_proto(
     conn: &mut Connection, out: &mut *const u8, out_len: &mut size_t,
@@ -1241,6 +1458,80 @@ pub extern fn quiche_conn_free(conn: *mut Connection) {
     unsafe { Box::from_raw(conn) };
 }
 
+#[no_mangle]
+pub extern fn quiche_cid_table_new(
+    shards: size_t,
+) -> *mut ConnectionIdTable<AppData> {
+    let table = if shards == 0 {
+        ConnectionIdTable::new()
+    } else {
+        ConnectionIdTable::with_shards(shards)
+    };
+
+    Box::into_raw(Box::new(table))
+}
+
+#[no_mangle]
+pub extern fn quiche_cid_table_insert(
+    table: &ConnectionIdTable<AppData>, cid: *const u8, cid_len: size_t,
+    conn: *mut c_void,
+) -> *mut c_void {
+    if cid_len > MAX_CONN_ID_LEN {
+        return ptr::null_mut();
+    }
+
+    let cid = unsafe { slice::from_raw_parts(cid, cid_len) };
+
+    match table.insert(cid, AppData(conn)) {
+        Some(v) => v.0,
+
+        None => ptr::null_mut(),
+    }
+}
+
+#[no_mangle]
+pub extern fn quiche_cid_table_get(
+    table: &ConnectionIdTable<AppData>, cid: *const u8, cid_len: size_t,
+) -> *mut c_void {
+    let cid = unsafe { slice::from_raw_parts(cid, cid_len) };
+
+    match table.get(cid) {
+        Some(v) => v.0,
+
+        None => ptr::null_mut(),
+    }
+}
+
+#[no_mangle]
+pub extern fn quiche_cid_table_remove(
+    table: &ConnectionIdTable<AppData>, cid: *const u8, cid_len: size_t,
+) -> *mut c_void {
+    let cid = unsafe { slice::from_raw_parts(cid, cid_len) };
+
+    match table.remove(cid) {
+        Some(v) => v.0,
+
+        None => ptr::null_mut(),
+    }
+}
+
+#[no_mangle]
+pub extern fn quiche_cid_table_remove_conn(
+    table: &ConnectionIdTable<AppData>, conn: *mut c_void,
+) {
+    table.retain(|_, v| v.0 != conn);
+}
+
+#[no_mangle]
+pub extern fn quiche_cid_table_len(table: &ConnectionIdTable<AppData>) -> size_t {
+    table.len()
+}
+
+#[no_mangle]
+pub extern fn quiche_cid_table_free(table: *mut ConnectionIdTable<AppData>) {
+    unsafe { Box::from_raw(table) };
+}
+
 #[no_mangle]
 pub extern fn quiche_conn_peer_streams_left_bidi(conn: &mut Connection) -> u64 {
     conn.peer_streams_left_bidi()
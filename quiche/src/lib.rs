@@ -88,7 +88,7 @@
 //! loop {
 //!     let (read, from) = socket.recv_from(&mut buf).unwrap();
 //!
-//!     let recv_info = quiche::RecvInfo { from };
+//!     let recv_info = quiche::RecvInfo { from, ecn: 0 };
 //!
 //!     let read = match conn.recv(&mut buf[..read], recv_info) {
 //!         Ok(v) => v,
@@ -355,7 +355,6 @@ use qlog::events::EventType;
 use qlog::events::RawInfo;
 
 use std::cmp;
-#[cfg(feature = "dtp")]
 use std::sync::Arc;
 use std::time;
 
@@ -434,6 +433,21 @@ const MAX_CONNECTION_WINDOW: u64 = 24 * 1024 * 1024;
 // the stream flow control window.
 const CONNECTION_WINDOW_FACTOR: f64 = 1.5;
 
+// Private transport parameter advertising that the endpoint derives the gm
+// SM4 packet keys from the TLS exporter (empty value).
+const GM_SM4_TRANSPORT_PARAM: u64 = 0x474d;
+
+// TLS exporter label for the gm SM4 key and counter block.
+const GM_SM4_EXPORTER_LABEL: &[u8] = b"EXPORTER-quiche gm sm4";
+
+// Upper bound of the DER SM2 ciphertext of the legacy gm key transport
+// (SM2_MAX_CIPHERTEXT_SIZE), peers without the transport parameter expect DER.
+const GM_SM2_MAX_CIPHERTEXT_SIZE: usize = 366;
+
+// Largest plaintext sm2_decrypt may write (SM2_MAX_PLAINTEXT_SIZE), the DER
+// ciphertext does not bind the C2 length to the 32 bytes of key and iv.
+const GM_SM2_MAX_PLAINTEXT_SIZE: usize = 255;
+
 /// A specialized [`Result`] type for quiche operations.
 ///
 /// This type is used throughout quiche's public API for any operation that
@@ -503,6 +517,12 @@ pub enum Error {
 
     /// Error in congestion control.
     CongestionControl,
+
+    /// The peer provided more connection IDs than the local limit allows.
+    IdLimit,
+
+    /// The peer didn't provide a spare connection ID to migrate with.
+    OutOfIdentifiers,
 }
 
 impl Error {
@@ -515,6 +535,7 @@ impl Error {
             Error::FlowControl => 0x3,
             Error::StreamLimit => 0x4,
             Error::FinalSize => 0x6,
+            Error::IdLimit => 0x9,
             _ => 0xa,
         }
     }
@@ -538,6 +559,8 @@ impl Error {
             Error::CongestionControl => -14,
             Error::StreamStopped { .. } => -15,
             Error::StreamReset { .. } => -16,
+            Error::IdLimit => -17,
+            Error::OutOfIdentifiers => -18,
         }
     }
 }
@@ -565,6 +588,11 @@ impl std::convert::From<octets::BufferTooShortError> for Error {
 pub struct RecvInfo {
     /// The address the packet was received from.
     pub from: SocketAddr,
+
+    /// The ECN codepoint the packet was received with, from the two least
+    /// significant bits of the IP TOS or Traffic Class field, or `0` if it
+    /// is not known.
+    pub ecn: u8,
 }
 
 /// Ancillary information about outgoing packets.
@@ -580,6 +608,14 @@ pub struct SendInfo {
     /// [Pacing]: index.html#pacing
     pub at: time::Instant,
 
+    /// The ECN codepoint the packet should be sent with, in the two least
+    /// significant bits of the IP TOS or Traffic Class field.
+    ///
+    /// See [`enable_ecn()`] for more details.
+    ///
+    /// [`enable_ecn()`]: struct.Config.html#method.enable_ecn
+    pub ecn: u8,
+
     /// The diffserv field the packet should be sent with.
     ///
     /// Need to left shift 2 when used in the IP header.
@@ -645,6 +681,15 @@ pub struct Config {
 
     hystart: bool,
 
+    ecn: bool,
+
+    l4s: bool,
+
+    pmtud: bool,
+
+    #[cfg(feature = "dtp")]
+    dtp_pacing_gain: bool,
+
     dgram_recv_max_queue_len: usize,
     dgram_send_max_queue_len: usize,
 
@@ -655,6 +700,8 @@ pub struct Config {
 
     ///gmssl state default:0
     gm_on:u64,
+
+    gm_key_pool: Option<Arc<crypto::Sm2KeyPool>>,
 }
 
 // See https://quicwg.org/base-drafts/rfc9000.html#section-15
@@ -702,6 +749,12 @@ impl Config {
             grease: true,
             cc_algorithm: CongestionControlAlgorithm::CUBIC,
             hystart: true,
+            ecn: false,
+            l4s: false,
+            pmtud: false,
+
+            #[cfg(feature = "dtp")]
+            dtp_pacing_gain: false,
 
             dgram_recv_max_queue_len: DEFAULT_MAX_DGRAM_QUEUE_LEN,
             dgram_send_max_queue_len: DEFAULT_MAX_DGRAM_QUEUE_LEN,
@@ -711,6 +764,7 @@ impl Config {
             max_connection_window: MAX_CONNECTION_WINDOW,
             max_stream_window: stream::MAX_STREAM_WINDOW,
             gm_on:0,//default gmssl close.
+            gm_key_pool: None,
         })
     }
 
@@ -875,7 +929,12 @@ impl Config {
 
     /// Sets the maximum outgoing UDP payload size.
     ///
+    /// When path MTU discovery is enabled with [`discover_pmtu()`], this is
+    /// the largest size that is probed.
+    ///
     /// The default and minimum value is `1200`.
+    ///
+    /// [`discover_pmtu()`]: struct.Config.html#method.discover_pmtu
     pub fn set_max_send_udp_payload_size(&mut self, v: usize) {
         self.max_send_udp_payload_size = cmp::max(v, MAX_SEND_UDP_PAYLOAD_SIZE);
     }
@@ -908,7 +967,9 @@ impl Config {
 
         /// Sets the gmssl 
     /// 
-    /// The default value is '1' On.
+    /// When set to '1' the SM4 packet keys are derived from the TLS exporter
+    /// if the peer advertises it as well, and transported with SM2 after the
+    /// handshake otherwise. The default value is '0' Off.
     pub fn set_gmssl(&mut self, v: u64) {
         if v==1 {
             println!("国密开启");
@@ -917,6 +978,30 @@ impl Config {
             println!("国密关闭");
         }
         self.gm_on = v;
+        self.local_transport_params.gm_sm4 = v == 1;
+    }
+
+    /// Takes the SM2 keypairs of the gm key transport from a pool of `size`
+    /// keypairs, refilled by a background thread whenever no more than
+    /// `low_water` are left.
+    ///
+    /// Without the pool, a server generates the keypair when it sends the
+    /// first packets of each connection, stalling the other connections
+    /// handled by the same thread. The pool is shared by all connections
+    /// created with this config.
+    pub fn enable_gm_key_pool(
+        &mut self, size: usize, low_water: usize,
+    ) -> Result<()> {
+        self.gm_key_pool =
+            Some(Arc::new(crypto::Sm2KeyPool::new(size, low_water)?));
+
+        Ok(())
+    }
+
+    /// Returns the number of gm keypairs taken from the pool and generated
+    /// inline because the pool was empty, if the pool is enabled.
+    pub fn gm_key_pool_stats(&self) -> Option<(u64, u64)> {
+        self.gm_key_pool.as_ref().map(|pool| pool.stats())
     }
     
     
@@ -1033,6 +1118,77 @@ impl Config {
         self.hystart = v;
     }
 
+    /// Configures whether to use Explicit Congestion Notification.
+    ///
+    /// When enabled, outgoing packets are marked as ECN-capable through
+    /// [`SendInfo`] for as long as the path is found to deliver the marks,
+    /// and packets the peer reports as CE-marked cause the congestion window
+    /// to be reduced like a loss would.
+    ///
+    /// Received marks are reported to the peer regardless of this setting,
+    /// as long as the application passes them in [`RecvInfo`].
+    ///
+    /// The default value is `false`.
+    ///
+    /// [`SendInfo`]: struct.SendInfo.html
+    /// [`RecvInfo`]: struct.RecvInfo.html
+    pub fn enable_ecn(&mut self, v: bool) {
+        self.ecn = v;
+    }
+
+    /// Configures whether to use the L4S variant of Explicit Congestion
+    /// Notification.
+    ///
+    /// When enabled, packets are marked with ECT(1) instead of ECT(0), and
+    /// the congestion window is reduced in proportion to the fraction of
+    /// packets that are CE-marked instead of like on a loss, as specified in
+    /// [RFC 9331]. This has no effect unless ECN is enabled with
+    /// [`enable_ecn()`], and is only meant for paths with L4S-aware
+    /// bottlenecks.
+    ///
+    /// The default value is `false`.
+    ///
+    /// [RFC 9331]: https://www.rfc-editor.org/rfc/rfc9331.html
+    /// [`enable_ecn()`]: struct.Config.html#method.enable_ecn
+    pub fn enable_l4s(&mut self, v: bool) {
+        self.l4s = v;
+    }
+
+    /// Configures whether to discover the path MTU.
+    ///
+    /// When enabled, packets are sent with the minimum size of 1200 bytes
+    /// until larger sizes, up to the one configured with
+    /// [`set_max_send_udp_payload_size()`], are found to get through, using
+    /// Datagram Packetization Layer Path MTU Discovery ([RFC 8899]). The size
+    /// falls back to the minimum if larger packets stop getting through.
+    ///
+    /// Probes can't be larger than the buffers passed to [`send()`], and the
+    /// application should make sure that the datagrams it sends are not
+    /// fragmented, e.g. with the `IP_MTU_DISCOVER` socket option on Linux.
+    ///
+    /// The default value is `false`.
+    ///
+    /// [`set_max_send_udp_payload_size()`]:
+    ///     struct.Config.html#method.set_max_send_udp_payload_size
+    /// [RFC 8899]: https://www.rfc-editor.org/rfc/rfc8899.html
+    /// [`send()`]: struct.Connection.html#method.send
+    pub fn discover_pmtu(&mut self, v: bool) {
+        self.pmtud = v;
+    }
+
+    /// Configures whether the DTP block deadlines scale the pacing gain.
+    ///
+    /// When enabled, the urgency of the most pressing DTP block is passed to
+    /// the congestion controller before each packet is sent. Only BBRv2 acts
+    /// on it, by raising its pacing gain by up to a quarter outside of the
+    /// drain and probing down phases.
+    ///
+    /// The default value is `false`.
+    #[cfg(feature = "dtp")]
+    pub fn enable_dtp_pacing_gain(&mut self, v: bool) {
+        self.dtp_pacing_gain = v;
+    }
+
     /// Configures whether to enable receiving DATAGRAM frames.
     ///
     /// When enabled, the `max_datagram_frame_size` transport parameter is set
@@ -1077,6 +1233,9 @@ pub struct Connection {
     /// Local connection ID.
     scid: ConnectionId<'static>,
 
+    /// Spare connection IDs issued by each end.
+    ids: cid::ConnectionIds,
+
     /// Unique opaque ID for the connection that can be used for logging.
     trace_id: String,
 
@@ -1101,7 +1260,12 @@ pub struct Connection {
     /// Loss recovery and congestion control state.
     recovery: recovery::Recovery,
 
-    peer_addr: SocketAddr,
+    /// The path to the peer's current address.
+    path: path::Path,
+
+    /// The last validated path, to fall back to if the peer moved to a path
+    /// that fails validation.
+    prev_path: Option<path::Path>,
 
     /// List of supported application protocols.
     application_protos: Vec<Vec<u8>>,
@@ -1253,6 +1417,10 @@ pub struct Connection {
     /// Whether to emit DATAGRAM frames in the next packet.
     emit_dgram: bool,
 
+    /// Whether to pass the DTP block urgency to the congestion controller.
+    #[cfg(feature = "dtp")]
+    dtp_pacing_gain: bool,
+
 
     /// Gmssl
     gm_on: u64,
@@ -1264,6 +1432,15 @@ pub struct Connection {
 
     gm_readoffset:Option<u64>,
    // gmpkey:
+
+    /// Whether the gm keys come from the TLS exporter, in which case gm
+    /// protected packets are marked with the key phase bit. `gm_sm4key` and
+    /// `gm_iv` then protect sent packets and the peer keys received ones.
+    gm_exported: bool,
+    gm_peer_sm4key: Option<crypto::SM4_KEY>,
+    gm_peer_iv: Option<[u8; 16]>,
+
+    gm_key_pool: Option<Arc<crypto::Sm2KeyPool>>,
 }
 
 /// Creates a new server-side connection.
@@ -1546,6 +1723,8 @@ impl Connection {
             dcid: ConnectionId::default(),
             scid: scid.to_vec().into(),
 
+            ids: cid::ConnectionIds::new(scid),
+
             trace_id: scid_as_hex.join(""),
 
             pkt_num_spaces: [
@@ -1564,7 +1743,11 @@ impl Connection {
 
             recovery: recovery::Recovery::new(config),
 
-            peer_addr: peer,
+            // The handshake validates the address the connection starts
+            // with.
+            path: path::Path::new(peer, true),
+
+            prev_path: None,
 
             application_protos: config.application_protos.clone(),
 
@@ -1668,6 +1851,9 @@ impl Connection {
 
             emit_dgram: true,
 
+            #[cfg(feature = "dtp")]
+            dtp_pacing_gain: config.dtp_pacing_gain,
+
 
              //gmssl
 
@@ -1678,6 +1864,10 @@ impl Connection {
              gm_sm4key:None,
              gm_iv:None,
              gm_readoffset:None,
+             gm_exported: false,
+             gm_peer_sm4key: None,
+             gm_peer_iv: None,
+             gm_key_pool: config.gm_key_pool.clone(),
 
         };
 
@@ -1880,7 +2070,7 @@ impl Connection {
     /// loop {
     ///     let (read, from) = socket.recv_from(&mut buf).unwrap();
     ///
-    ///     let recv_info = quiche::RecvInfo { from };
+    ///     let recv_info = quiche::RecvInfo { from, ecn: 0 };
     ///
     ///     let read = match conn.recv(&mut buf[..read], recv_info) {
     ///         Ok(v) => v,
@@ -1894,6 +2084,15 @@ impl Connection {
     /// # Ok::<(), quiche::Error>(())
     /// ```
     pub fn recv(&mut self, buf: &mut [u8], info: RecvInfo) -> Result<usize> {
+        self.recv_at(buf, info, time::Instant::now())
+    }
+
+    /// Like [`recv()`], with `now` as the current time.
+    ///
+    /// [`recv()`]: struct.Connection.html#method.recv
+    pub(crate) fn recv_at(
+        &mut self, buf: &mut [u8], info: RecvInfo, now: time::Instant,
+    ) -> Result<usize> {
         let len = buf.len();
 
         if len == 0 {
@@ -1950,23 +2149,31 @@ impl Connection {
 
         // Process coalesced packets.
         while left > 0 {
-            let read = match self.recv_single(&mut buf[len - left..len], &info) {
-                Ok(v) => v,
+            let read =
+                match self.recv_single(&mut buf[len - left..len], &info, now) {
+                    Ok(v) => v,
 
-                Err(Error::Done) => left,
+                    Err(Error::Done) => left,
 
-                Err(e) => {
-                    // In case of error processing the incoming packet, close
-                    // the connection.
-                    self.close(false, e.to_wire(), b"").ok();
-                    return Err(e);
-                },
-            };
+                    Err(e) => {
+                        // In case of error processing the incoming packet,
+                        // close the connection.
+                        self.close(false, e.to_wire(), b"").ok();
+                        return Err(e);
+                    },
+                };
 
             done += read;
             left -= read;
         }
 
+        // Datagrams from other addresses don't allow sending more on the
+        // current path, unless one of their packets just moved the
+        // connection to their address.
+        if info.from == self.path.peer_addr() {
+            self.path.on_recv(len);
+        }
+
         // Process previously undecryptable 0-RTT packets if the decryption key
         // is now available.
         if self.pkt_num_spaces[packet::EPOCH_APPLICATION]
@@ -1975,7 +2182,7 @@ impl Connection {
         {
             while let Some((mut pkt, info)) = self.undecryptable_pkts.pop_front()
             {
-                if let Err(e) = self.recv(&mut pkt, info) {
+                if let Err(e) = self.recv_at(&mut pkt, info, now) {
                     self.undecryptable_pkts.clear();
 
                     // Even though the packet was previously "accepted", it
@@ -1998,9 +2205,9 @@ impl Connection {
     /// On error, an error other than [`Done`] is returned.
     ///
     /// [`Done`]: enum.Error.html#variant.Done
-    fn recv_single(&mut self, buf: &mut [u8], info: &RecvInfo) -> Result<usize> {
-        let now = time::Instant::now();
-
+    fn recv_single(
+        &mut self, buf: &mut [u8], info: &RecvInfo, now: time::Instant,
+    ) -> Result<usize> {
         if buf.is_empty() {
             return Err(Error::Done);
         }
@@ -2304,7 +2511,23 @@ impl Connection {
 
         let mut payload:octets::Octets;
     
-        if self.gm_on==6 &&self.is_established() {
+        if self.gm_exported && hdr.ty == packet::Type::Short && hdr.key_phase {
+            payload = packet::decrypt_pktgm(
+                &mut b,
+                pn,
+                pn_len,
+                payload_len,
+                aead,
+                self.gm_on,
+                self.is_established(),
+                &Connection::gm_pkt_ctr(self.gm_peer_iv.as_ref().unwrap(), pn),
+                self.gm_peer_sm4key.as_ref().unwrap(),
+            )
+            .map_err(|e| {
+                drop_pkt_on_err(e, self.recv_count, self.is_server, &self.trace_id)
+            })?;
+        }
+        else if self.gm_on==6 &&self.is_established() && !self.gm_exported {
             if self.gm_readoffset.is_some(){
                 self.gm_readoffset=None;
                 payload = packet::decrypt_pkt(
@@ -2397,6 +2620,15 @@ impl Connection {
         // ACK and PADDING.
         let mut ack_elicited = false;
 
+        // Packets that only carry probing frames don't move the connection to
+        // the address they come from.
+        let mut probing = true;
+
+        // A PATH_CHALLENGE frame received from another address must be
+        // responded to on the path it came from, which is only possible if
+        // the connection moves to that path.
+        let challenge = self.challenge;
+
         // Process packet payload. If a frame cannot be processed, store the
         // error and stop further packet processing.
         let mut frame_processing_err = None;
@@ -2412,6 +2644,10 @@ impl Connection {
                 ack_elicited = true;
             }
 
+            if !frame.probing() {
+                probing = false;
+            }
+
             if let Err(e) = self.process_frame(frame, epoch, now) {
                 frame_processing_err = Some(e);
                 break;
@@ -2462,6 +2698,23 @@ impl Connection {
             return Err(e);
         }
 
+        // The server follows the client to a new address when it receives a
+        // non-probing packet from it, unless the packet was reordered with
+        // one sent later from another address (RFC 9000 §9.3).
+        if info.from != self.path.peer_addr() {
+            if self.is_server &&
+                self.handshake_confirmed &&
+                hdr.ty == packet::Type::Short &&
+                !probing &&
+                pn >= self.pkt_num_spaces[epoch].largest_rx_pkt_num &&
+                !self.local_transport_params.disable_active_migration
+            {
+                self.on_peer_migrated(info.from, now);
+            } else {
+                self.challenge = challenge;
+            }
+        }
+
         // Only log the remote transport parameters once the connection is
         // established (i.e. after frames have been fully parsed) and only
         // once per connection.
@@ -2559,6 +2812,18 @@ impl Connection {
 
         self.pkt_num_spaces[epoch].recv_pkt_num.insert(pn);
 
+        let ecn_counts = &mut self.pkt_num_spaces[epoch].ecn_counts;
+
+        match info.ecn & 0x03 {
+            recovery::ecn::ECT0 => ecn_counts.ect0_count += 1,
+
+            recovery::ecn::ECT1 => ecn_counts.ect1_count += 1,
+
+            recovery::ecn::CE => ecn_counts.ecn_ce_count += 1,
+
+            _ => (),
+        }
+
         self.pkt_num_spaces[epoch].recv_pkt_need_ack.push_item(pn);
 
         self.pkt_num_spaces[epoch].ack_elicited =
@@ -2657,6 +2922,15 @@ impl Connection {
     /// # Ok::<(), quiche::Error>(())
     /// ```
     pub fn send(&mut self, out: &mut [u8]) -> Result<(usize, SendInfo)> {
+        self.send_at(out, time::Instant::now())
+    }
+
+    /// Like [`send()`], with `now` as the current time.
+    ///
+    /// [`send()`]: struct.Connection.html#method.send
+    pub(crate) fn send_at(
+        &mut self, out: &mut [u8], now: time::Instant,
+    ) -> Result<(usize, SendInfo)> {
         if out.is_empty() {
             return Err(Error::BufferTooShort);
         }
@@ -2677,7 +2951,7 @@ impl Connection {
         {
             while let Some((mut pkt, info)) = self.undecryptable_pkts.pop_front()
             {
-                if self.recv(&mut pkt, info).is_err() {
+                if self.recv_at(&mut pkt, info, now).is_err() {
                     self.undecryptable_pkts.clear();
 
                     // Forwarding the error value here could confuse
@@ -2708,18 +2982,33 @@ impl Connection {
         // maximum UDP payload size limit.
         let mut left = cmp::min(out.len(), self.max_send_udp_payload_size());
 
+        // Unless the datagram is a PMTU probe, which is sent on its own.
+        let pmtu_probe = self.pmtu_probe_size(out.len(), now);
+
+        if let Some(size) = pmtu_probe {
+            left = size;
+        }
+
         // Limit data sent by the server based on the amount of data received
         // from the client before its address is validated.
         if !self.verified_peer_address && self.is_server {
             left = cmp::min(left, self.max_send_bytes);
         }
 
+        // Same for a new address of the client, until it is validated.
+        if self.is_server {
+            left = cmp::min(left, self.path.max_send_bytes());
+        }
+
         // Generate coalesced packets.
         while left > 0 {
             #[cfg(not(feature = "diffserv"))]
-            let (ty, written) = match self
-                .send_single(&mut out[done..done + left], has_initial)
-            {
+            let (ty, written) = match self.send_single(
+                &mut out[done..done + left],
+                has_initial,
+                pmtu_probe.is_some(),
+                now,
+            ) {
                 Ok(v) => v,
 
                 Err(Error::BufferTooShort) | Err(Error::Done) => break,
@@ -2731,6 +3020,8 @@ impl Connection {
             let (ty, written) = match self.send_single(
                 &mut out[done..done + left],
                 has_initial,
+                pmtu_probe.is_some(),
+                now,
                 &mut diffserv,
             ) {
                 Ok(v) => v,
@@ -2778,11 +3069,20 @@ impl Connection {
             done += pad_len;
         }
 
+        // All the packets coalesced in the datagram were marked with the
+        // same codepoint.
+        let ecn = self.recovery.ecn.codepoint();
+        self.recovery.ecn.on_datagram_sent();
+
+        self.path.on_sent(done);
+
         let info = SendInfo {
-            to: self.peer_addr,
+            to: self.path.peer_addr(),
 
             at: self.recovery.get_packet_send_time(),
 
+            ecn,
+
             #[cfg(feature = "diffserv")]
             diffserv,
         };
@@ -2791,11 +3091,9 @@ impl Connection {
     }
 
     fn send_single(
-        &mut self, out: &mut [u8], has_initial: bool,
-        #[cfg(feature = "diffserv")] diffserv: &mut u8,
+        &mut self, out: &mut [u8], has_initial: bool, pmtu_probe: bool,
+        now: time::Instant, #[cfg(feature = "diffserv")] diffserv: &mut u8,
     ) -> Result<(packet::Type, usize)> {
-        let now = time::Instant::now();
-
         if out.is_empty() {
             return Err(Error::BufferTooShort);
         }
@@ -2913,6 +3211,18 @@ impl Connection {
                     self.almost_full = true;
                 },
 
+                frame::Frame::NewConnectionId { seq_num, .. } => {
+                    self.ids.on_new_scid_lost(seq_num);
+                },
+
+                frame::Frame::RetireConnectionId { seq_num } => {
+                    self.ids.on_retire_dcid_lost(seq_num);
+                },
+
+                frame::Frame::PathChallenge { data } => {
+                    self.path.on_challenge_lost(data);
+                },
+
                 #[cfg(feature = "dtp")]
                 frame::Frame::BlockInfo { stream_id, .. } => {
                     error!("BlockInfo frame lost");
@@ -2962,7 +3272,11 @@ impl Connection {
             },
 
             versions: None,
-            key_phase: false,
+
+            // Key updates are not supported, with exporter derived gm keys the
+            // key phase bit marks the packets protected with SM4 instead, so
+            // that the peer can tell them from 0.5-RTT packets still in flight.
+            key_phase: self.gm_exported && pkt_type == packet::Type::Short,
         };
 
         hdr.to_bytes(&mut b)?;
@@ -2999,11 +3313,12 @@ impl Connection {
             return Err(Error::Done);
         }
 
-        let mut frames: Vec<frame::Frame> = Vec::new();
+        let mut frames = self.recovery.frames_buf();
 
         let mut ack_eliciting = false;
         let mut in_flight = false;
         let mut has_data = false;
+        let mut path_probe = false;
 
         let header_offset = b.off();
 
@@ -3019,6 +3334,22 @@ impl Connection {
 
         let payload_offset = b.off();
 
+        // A PMTU probe only carries a PING frame padded to the probed size,
+        // so that losing it delays nothing. Other frames don't fit in it and
+        // wait for the next packet.
+        if pmtu_probe {
+            let frame = frame::Frame::Ping;
+
+            if push_frame_to_pkt!(b, frames, frame, left) {
+                ack_eliciting = true;
+                in_flight = true;
+            }
+
+            let frame = frame::Frame::Padding { len: left };
+
+            push_frame_to_pkt!(b, frames, frame, left);
+        }
+
         // Create ACK frame.
         if self.pkt_num_spaces[epoch].recv_pkt_need_ack.len() > 0 &&
             (self.pkt_num_spaces[epoch].ack_elicited ||
@@ -3048,7 +3379,9 @@ impl Connection {
                 timestamp,
                 ack_delay,
                 ranges: self.pkt_num_spaces[epoch].recv_pkt_need_ack.clone(),
-                ecn_counts: None, // sending ECN is not supported at this time
+                // Only report ECN counts once marked packets were received.
+                ecn_counts: Some(self.pkt_num_spaces[epoch].ecn_counts.clone())
+                    .filter(|c| *c != frame::EcnCounts::default()),
             };
 
             if push_frame_to_pkt!(b, frames, frame, left) {
@@ -3308,6 +3641,68 @@ impl Connection {
                     }
                 }
             }
+
+            // Create NEW_CONNECTION_ID frames as needed.
+            while let Some((seq_num, cid, reset_token)) =
+                self.ids.new_scid_pending()
+            {
+                let frame = frame::Frame::NewConnectionId {
+                    seq_num,
+                    retire_prior_to: 0,
+                    conn_id: cid.to_vec(),
+                    reset_token,
+                };
+
+                if !push_frame_to_pkt!(b, frames, frame, left) {
+                    break;
+                }
+
+                self.ids.on_new_scid_sent();
+
+                ack_eliciting = true;
+                in_flight = true;
+            }
+
+            // Create RETIRE_CONNECTION_ID frames as needed.
+            while let Some(seq_num) = self.ids.retire_dcid_pending() {
+                let frame = frame::Frame::RetireConnectionId { seq_num };
+
+                if !push_frame_to_pkt!(b, frames, frame, left) {
+                    break;
+                }
+
+                self.ids.on_retire_dcid_sent();
+
+                ack_eliciting = true;
+                in_flight = true;
+            }
+
+            // Create PATH_CHALLENGE frame, along with a PING frame so that the
+            // packet isn't a probing one, and a client that is migrating moves
+            // the server to the new path with it.
+            if self.path.should_send_challenge() {
+                let mut data = [0; 8];
+                rand::rand_bytes(&mut data);
+
+                let frame = frame::Frame::PathChallenge { data };
+
+                if push_frame_to_pkt!(b, frames, frame, left) {
+                    self.path.on_challenge_sent(data);
+
+                    let frame = frame::Frame::Ping;
+                    push_frame_to_pkt!(b, frames, frame, left);
+
+                    path_probe = true;
+
+                    ack_eliciting = true;
+                    in_flight = true;
+
+                    #[cfg(feature = "diffserv")]
+                    if *diffserv < 4 << 3 {
+                        *diffserv = 4 << 3;
+                    }
+                }
+            }
         }
 
         // Create CONNECTION_CLOSE frame.
@@ -3362,6 +3757,8 @@ impl Connection {
             if push_frame_to_pkt!(b, frames, frame, left) {
                 self.challenge = None;
 
+                path_probe = true;
+
                 ack_eliciting = true;
                 in_flight = true;
 
@@ -3449,7 +3846,11 @@ impl Connection {
         //it wont affect the crypto stream,since it carries gm imformation in the type crypto.
         // if it is server and gmssl is 1,then general the sm2 key and push to crypto frame
  
-        if self.gm_on==1 && self.is_server
+        // Peers advertising the gm transport parameter derive the keys from
+        // the TLS exporter instead, see gm_derive_keys().
+        if self.gm_on==1 && self.is_server &&
+            self.parsed_peer_transport_params &&
+            !self.peer_transport_params.gm_sm4
         {   
             //let (ctx,pk,sk) =signature::getSm2key();
             let mut sm2key=crypto::SM2_KEY{
@@ -3458,9 +3859,13 @@ impl Connection {
                 private_key:[0;32],
             };
 
-            unsafe {
-                crypto::sm2_key_generate(&mut sm2key);
-            }; 
+            match self.gm_key_pool {
+                Some(ref pool) => pool.generate(&mut sm2key)?,
+
+                None => unsafe {
+                    crypto::sm2_key_generate(&mut sm2key);
+                },
+            };
             let mut pubkey:[u8;64]=[0;64];
             //extract pubkey
             for  index in 0..32 {
@@ -3494,7 +3899,6 @@ impl Connection {
         //client and have recieve pubkey,general key and encrypt it with pub,and sent.
         else if self.gm_on==3 && !self.is_server{
             const keylen:usize=16;
-            const sm2extend:usize=200;
             let mut key:[u8;16]=[0;16];
             rand::rand_bytes(&mut key);
           //  let key = signature::rand_block();
@@ -3528,14 +3932,22 @@ impl Connection {
                 pubkey[i]=sm2key.x[i];
                 pubkey[i+32]=sm2key.y[i];
             }
-            let mut sm2cipher:[u8;keylen*2+sm2extend]=[0;keylen*2+sm2extend];
-           let mut sm2cipherlen:usize=0;
-           unsafe{
-            crypto::sm2_pub_encrypt(pubkey.as_ptr(), plain_text[..].as_ptr(), 
-            32, sm2cipher.as_mut_ptr(), 
-            &mut sm2cipherlen)
+            let mut sm2cipher = [0; GM_SM2_MAX_CIPHERTEXT_SIZE];
+            let mut sm2cipherlen: usize = 0;
+            let rc = unsafe {
+                crypto::sm2_pub_encrypt(
+                    pubkey.as_ptr(),
+                    plain_text.as_ptr(),
+                    plain_text.len(),
+                    sm2cipher.as_mut_ptr(),
+                    &mut sm2cipherlen,
+                )
             };
 
+            if rc != 1 || sm2cipherlen > sm2cipher.len() {
+                return Err(Error::TlsFail);
+            }
+
            //let mut cipher_text: Vec<u8> = ectx.encrypt(&plain_text[..]);
            let mut cipher_text=sm2cipher[0..sm2cipherlen].to_vec();
        
@@ -3891,6 +4303,22 @@ impl Connection {
             }
         }
 
+        // Packets carrying PATH_CHALLENGE or PATH_RESPONSE frames are expanded
+        // to check that the path carries full-sized datagrams, as far as the
+        // anti-amplification limit allows.
+        if path_probe && pkt_type == packet::Type::Short {
+            let len = cmp::min(
+                left,
+                MIN_CLIENT_INITIAL_LEN.saturating_sub(b.off() + crypto_overhead),
+            );
+
+            if len > 0 {
+                let frame = frame::Frame::Padding { len };
+
+                push_frame_to_pkt!(b, frames, frame, left);
+            }
+        }
+
         // Pad payload so that it's always at least 4 bytes.
         if b.off() - payload_offset < PAYLOAD_MIN_LEN {
             let payload_len = b.off() - payload_offset;
@@ -3976,7 +4404,22 @@ impl Connection {
         };
    
         let mut written=0;
-        if self.gm_on==6 && self.is_established(){
+        if hdr.key_phase {
+            written = packet::encrypt_pktgm(
+                &mut b,
+                pn,
+                pn_len,
+                payload_len,
+                payload_offset,
+                None,
+                aead,
+                self.gm_on,
+                self.is_established(),
+                &Connection::gm_pkt_ctr(self.gm_iv.as_ref().unwrap(), pn),
+                self.gm_sm4key.as_ref().unwrap(),
+            )?;
+        }
+        else if self.gm_on==6 && self.is_established() && !self.gm_exported {
              written = packet::encrypt_pktgm(
                 &mut b,
                 pn,
@@ -4016,12 +4459,29 @@ impl Connection {
             first_sent_time: now,
             is_app_limited: false,
             has_data,
+            ecn_marked: self.recovery.ecn.codepoint() != recovery::ecn::NOT_ECT,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
+        if pmtu_probe {
+            self.recovery.pmtud.on_probe_sent(pn, written);
+        }
+
         if in_flight && self.delivery_rate_check_if_app_limited() {
             self.recovery.delivery_rate_update_app_limited(true);
         }
 
+        #[cfg(feature = "dtp")]
+        if self.dtp_pacing_gain {
+            let urgency = self.streams.dtp_urgency((
+                (self.recovery.pacing_rate() >> 10),
+                (self.recovery.rtt().as_millis() >> 1) as u64,
+            ));
+
+            self.recovery.set_dtp_urgency(urgency);
+        }
+
         self.recovery.on_packet_sent(
             sent_pkt,
             epoch,
@@ -4137,9 +4597,6 @@ impl Connection {
 
         let local = stream.local;
 
-        #[cfg(feature = "qlog")]
-        let offset = stream.recv.off_front();
-
         let (read, fin) = match stream.recv.emit(out) {
             Ok(v) => v,
 
@@ -4157,49 +4614,176 @@ impl Connection {
             },
         };
 
-        self.flow_control.add_consumed(read as u64);
-
-        let readable = stream.is_readable();
-
-        let complete = stream.is_complete();
-
-        if stream.recv.almost_full() {
-            self.streams.mark_almost_full(stream_id, true);
-        }
-
-        if !readable {
-            self.streams.mark_readable(stream_id, false);
-        }
-
-        if complete {
-            self.streams.collect(stream_id, local);
-        }
-
-        qlog_with_type!(QLOG_DATA_MV, self.qlog, q, {
-            let ev_data = EventData::DataMoved(qlog::events::quic::DataMoved {
-                stream_id: Some(stream_id),
-                offset: Some(offset),
-                length: Some(read as u64),
-                from: Some(DataRecipient::Transport),
-                to: Some(DataRecipient::Application),
-                data: None,
-            });
-
-            let now = time::Instant::now();
-            q.add_event_data_with_instant(ev_data, now).ok();
-        });
-
-        if self.should_update_max_data() {
-            self.almost_full = true;
-        }
+        self.on_stream_read(stream_id, read);
 
         Ok((read, fin))
     }
 
-    /// Writes data to a stream.
+    /// Borrows contiguous data from a stream, without copying it.
     ///
-    /// On success the number of bytes written is returned, or [`Done`] if no
-    /// data was written (e.g. because the stream has no capacity).
+    /// On success the data and a flag indicating whether it reaches the end
+    /// of the stream are returned as a tuple, or [`Done`] if there is no data
+    /// to read. The data stays buffered until the application marks how much
+    /// of it was used with [`stream_recv_consume()`], the next call returns the
+    /// same data until then. When the received data wraps around the stream's
+    /// receive buffer, only the data up to the wrap is returned.
+    ///
+    /// [`Done`]: enum.Error.html#variant.Done
+    /// [`stream_recv_consume()`]: struct.Connection.html#method.stream_recv_consume
+    ///
+    /// ## Examples:
+    ///
+    /// ```no_run
+    /// # let socket = std::net::UdpSocket::bind("127.0.0.1:0").unwrap();
+    /// # let mut config = quiche::Config::new(quiche::PROTOCOL_VERSION)?;
+    /// # let scid = quiche::ConnectionId::from_ref(&[0xba; 16]);
+    /// # let from = "127.0.0.1:1234".parse().unwrap();
+    /// # let mut conn = quiche::accept(&scid, None, from, &mut config)?;
+    /// # let stream_id = 0;
+    /// while let Ok((data, fin)) = conn.stream_recv_slice(stream_id) {
+    ///     let read = data.len();
+    ///     println!("Got {} bytes on stream {}", read, stream_id);
+    ///
+    ///     conn.stream_recv_consume(stream_id, read)?;
+    /// }
+    /// # Ok::<(), quiche::Error>(())
+    /// ```
+    pub fn stream_recv_slice(&mut self, stream_id: u64) -> Result<(&[u8], bool)> {
+        // We can't read on our own unidirectional streams.
+        if !stream::is_bidi(stream_id) &&
+            stream::is_local(stream_id, self.is_server)
+        {
+            return Err(Error::InvalidStreamState(stream_id));
+        }
+
+        let stream = self
+            .streams
+            .get_mut(stream_id)
+            .ok_or(Error::InvalidStreamState(stream_id))?;
+
+        if !stream.is_readable() {
+            return Err(Error::Done);
+        }
+
+        let local = stream.local;
+
+        if let Err(e) = stream.recv.peek().map(|_| ()) {
+            // Collect the stream if it is now complete, as in `stream_recv()`.
+            if stream.is_complete() {
+                self.streams.collect(stream_id, local);
+            }
+
+            self.streams.mark_readable(stream_id, false);
+            return Err(e);
+        }
+
+        match self.streams.get(stream_id) {
+            Some(stream) => stream.recv.peek(),
+
+            None => Err(Error::InvalidStreamState(stream_id)),
+        }
+    }
+
+    /// Marks data borrowed with [`stream_recv_slice()`] as read.
+    ///
+    /// `len` is the number of bytes used from the start of the data, it can't
+    /// be larger than the length of the data. Once all of the data reaching
+    /// the end of the stream is consumed, the stream is complete.
+    ///
+    /// Like reading with [`stream_recv()`], this may trigger queueing of
+    /// control messages (e.g. MAX_STREAM_DATA). [`send()`] should be called
+    /// after consuming data.
+    ///
+    /// [`stream_recv_slice()`]: struct.Connection.html#method.stream_recv_slice
+    /// [`stream_recv()`]: struct.Connection.html#method.stream_recv
+    /// [`send()`]: struct.Connection.html#method.send
+    pub fn stream_recv_consume(
+        &mut self, stream_id: u64, len: usize,
+    ) -> Result<()> {
+        // We can't read on our own unidirectional streams.
+        if !stream::is_bidi(stream_id) &&
+            stream::is_local(stream_id, self.is_server)
+        {
+            return Err(Error::InvalidStreamState(stream_id));
+        }
+
+        let stream = self
+            .streams
+            .get_mut(stream_id)
+            .ok_or(Error::InvalidStreamState(stream_id))?;
+
+        let available = match stream.recv.peek() {
+            Ok((data, _)) => data.len(),
+
+            Err(e) => return Err(e),
+        };
+
+        if len > available {
+            return Err(Error::InvalidStreamState(stream_id));
+        }
+
+        stream.recv.consume(len);
+
+        self.on_stream_read(stream_id, len);
+
+        Ok(())
+    }
+
+    /// Updates the flow control and stream state after the application read
+    /// `read` bytes from a stream.
+    fn on_stream_read(&mut self, stream_id: u64, read: usize) {
+        self.flow_control.add_consumed(read as u64);
+
+        let stream = match self.streams.get_mut(stream_id) {
+            Some(v) => v,
+
+            None => return,
+        };
+
+        let local = stream.local;
+
+        #[cfg(feature = "qlog")]
+        let offset = stream.recv.off_front() - read as u64;
+
+        let readable = stream.is_readable();
+
+        let complete = stream.is_complete();
+
+        if stream.recv.almost_full() {
+            self.streams.mark_almost_full(stream_id, true);
+        }
+
+        if !readable {
+            self.streams.mark_readable(stream_id, false);
+        }
+
+        if complete {
+            self.streams.collect(stream_id, local);
+        }
+
+        qlog_with_type!(QLOG_DATA_MV, self.qlog, q, {
+            let ev_data = EventData::DataMoved(qlog::events::quic::DataMoved {
+                stream_id: Some(stream_id),
+                offset: Some(offset),
+                length: Some(read as u64),
+                from: Some(DataRecipient::Transport),
+                to: Some(DataRecipient::Application),
+                data: None,
+            });
+
+            let now = time::Instant::now();
+            q.add_event_data_with_instant(ev_data, now).ok();
+        });
+
+        if self.should_update_max_data() {
+            self.almost_full = true;
+        }
+    }
+
+    /// Writes data to a stream.
+    ///
+    /// On success the number of bytes written is returned, or [`Done`] if no
+    /// data was written (e.g. because the stream has no capacity).
     ///
     /// Applications can provide a 0-length buffer with the fin flag set to
     /// true. This will lead to a 0-length FIN STREAM frame being sent at the
@@ -4244,6 +4828,51 @@ impl Connection {
     /// ```
     pub fn stream_send(
         &mut self, stream_id: u64, buf: &[u8], fin: bool,
+    ) -> Result<usize> {
+        self.stream_send_data(stream_id, stream::SendData::Copy(buf), fin)
+    }
+
+    /// Writes application-owned data to a stream without copying it.
+    ///
+    /// This behaves like [`stream_send()`], except that the data is not
+    /// copied into the stream's send buffer: the stream keeps a reference to
+    /// it until it has all been acked by the peer, and it is only copied when
+    /// written into outgoing packets.
+    ///
+    /// On partial writes the application can skip the bytes that were written
+    /// with [`ZeroCopyBuf::advance()`] and retry later with the same buffer.
+    ///
+    /// [`stream_send()`]: struct.Connection.html#method.stream_send
+    /// [`ZeroCopyBuf::advance()`]: struct.ZeroCopyBuf.html#method.advance
+    ///
+    /// ## Examples:
+    ///
+    /// ```no_run
+    /// # let mut buf = [0; 512];
+    /// # let socket = std::net::UdpSocket::bind("127.0.0.1:0").unwrap();
+    /// # let mut config = quiche::Config::new(quiche::PROTOCOL_VERSION)?;
+    /// # let scid = quiche::ConnectionId::from_ref(&[0xba; 16]);
+    /// # let from = "127.0.0.1:1234".parse().unwrap();
+    /// # let mut conn = quiche::accept(&scid, None, from, &mut config)?;
+    /// # let stream_id = 0;
+    /// let mut data = quiche::ZeroCopyBuf::new(vec![0; 10_000_000]);
+    ///
+    /// let written = conn.stream_send_zc(stream_id, &data, true)?;
+    /// data.advance(written);
+    /// # Ok::<(), quiche::Error>(())
+    /// ```
+    pub fn stream_send_zc(
+        &mut self, stream_id: u64, buf: &ZeroCopyBuf, fin: bool,
+    ) -> Result<usize> {
+        self.stream_send_data(
+            stream_id,
+            stream::SendData::Shared(buf.clone()),
+            fin,
+        )
+    }
+
+    fn stream_send_data(
+        &mut self, stream_id: u64, buf: stream::SendData, fin: bool,
     ) -> Result<usize> {
         // We can't write on the peer's unidirectional streams.
         if !stream::is_bidi(stream_id) &&
@@ -4271,12 +4900,18 @@ impl Connection {
         //     return Err(Error::Done);
         // }
 
-        let (unblocked_buf, unblocked_fin) = if cap < buf.len() {
-            (&buf[..cap], false)
+        let buf_len = buf.len();
+
+        let (unblocked_buf, blocked_buf, unblocked_fin) = if cap < buf_len {
+            let (unblocked_buf, blocked_buf) = buf.split_at(cap);
+
+            (unblocked_buf, Some(blocked_buf), false)
         } else {
-            (buf, fin)
+            (buf, None, fin)
         };
 
+        let empty_fin = unblocked_buf.is_empty() && fin;
+
         // Get existing stream or create a new one.
         let stream = self.get_or_create_stream(stream_id, true)?;
 
@@ -4285,7 +4920,7 @@ impl Connection {
 
         let was_flushable = stream.is_flushable();
 
-        let mut sent = match stream.send.write(unblocked_buf, unblocked_fin) {
+        let sent = match stream.send.write_data(unblocked_buf, unblocked_fin) {
             Ok(v) => v,
 
             Err(e) => {
@@ -4294,15 +4929,15 @@ impl Connection {
             },
         };
 
-        if cap < buf.len() {
-            match stream.send.write(&buf[cap..], fin) {
-            Ok(v) => v,
+        if let Some(blocked_buf) = blocked_buf {
+            match stream.send.write_data(blocked_buf, fin) {
+                Ok(v) => v,
 
-            Err(e) => {
-                self.streams.mark_writable(stream_id, false);
-                return Err(e);
-            },
-        };
+                Err(e) => {
+                    self.streams.mark_writable(stream_id, false);
+                    return Err(e);
+                },
+            };
         }
 
         let urgency = stream.urgency;
@@ -4312,9 +4947,7 @@ impl Connection {
 
         let writable = stream.is_writable();
 
-        let empty_fin = unblocked_buf.is_empty() && fin;
-
-        if sent < buf.len() {
+        if sent < buf_len {
             let max_off = stream.send.max_off();
 
             if stream.send.blocked_at() != Some(max_off) {
@@ -4366,11 +4999,11 @@ impl Connection {
             q.add_event_data_with_instant(ev_data, now).ok();
         });
 
-        if sent == 0 && !buf.is_empty() {
+        if sent == 0 && buf_len != 0 {
             return Err(Error::Done);
         }
 
-        Ok(buf.len())
+        Ok(buf_len)
     }
 
     /// Writes data to a DTP block.
@@ -4422,6 +5055,34 @@ impl Connection {
     #[cfg(feature = "dtp")]
     pub fn block_send(
         &mut self, stream_id: u64, buf: &[u8], fin: bool, block: Arc<Block>,
+    ) -> Result<usize> {
+        self.block_send_data(stream_id, stream::SendData::Copy(buf), fin, block)
+    }
+
+    /// Writes application-owned data to a DTP block without copying it.
+    ///
+    /// This behaves like [`block_send()`], with the data handled like in
+    /// [`stream_send_zc()`].
+    ///
+    /// [`block_send()`]: struct.Connection.html#method.block_send
+    /// [`stream_send_zc()`]: struct.Connection.html#method.stream_send_zc
+    #[cfg(feature = "dtp")]
+    pub fn block_send_zc(
+        &mut self, stream_id: u64, buf: &ZeroCopyBuf, fin: bool,
+        block: Arc<Block>,
+    ) -> Result<usize> {
+        self.block_send_data(
+            stream_id,
+            stream::SendData::Shared(buf.clone()),
+            fin,
+            block,
+        )
+    }
+
+    #[cfg(feature = "dtp")]
+    fn block_send_data(
+        &mut self, stream_id: u64, buf: stream::SendData, fin: bool,
+        block: Arc<Block>,
     ) -> Result<usize> {
         // We can't write on the peer's unidirectional streams.
         if !stream::is_bidi(stream_id) &&
@@ -4449,12 +5110,20 @@ impl Connection {
         //     return Err(Error::Done);
         // }
 
-        let (unblocked_buf, unblocked_fin) = if cap < buf.len() {
-            (&buf[..cap], false)
+        let buf_len = buf.len();
+
+        let (unblocked_buf, blocked_buf, unblocked_fin) = if cap < buf_len {
+            let (unblocked_buf, blocked_buf) = buf.split_at(cap);
+
+            (unblocked_buf, Some(blocked_buf), false)
         } else {
-            (buf, fin)
+            (buf, None, fin)
         };
 
+        let empty_fin = unblocked_buf.is_empty() && fin;
+
+        let unblocked_empty = unblocked_buf.is_empty();
+
         // Get existing stream or create a new one.
         let stream = self.get_or_create_block(stream_id, true, Some(block))?;
 
@@ -4463,7 +5132,7 @@ impl Connection {
 
         let was_flushable = stream.is_flushable();
 
-        let sent = match stream.send.write(unblocked_buf, unblocked_fin) {
+        let sent = match stream.send.write_data(unblocked_buf, unblocked_fin) {
             Ok(v) => v,
 
             Err(e) => {
@@ -4472,8 +5141,8 @@ impl Connection {
             },
         };
 
-        if cap < buf.len() {
-            match stream.send.write(&buf[cap..], fin) {
+        if let Some(blocked_buf) = blocked_buf {
+            match stream.send.write_data(blocked_buf, fin) {
                 Ok(v) => v,
 
                 Err(e) => {
@@ -4490,9 +5159,7 @@ impl Connection {
 
         let writable = stream.is_writable();
 
-        let empty_fin = unblocked_buf.is_empty() && fin;
-
-        if sent < buf.len() {
+        if sent < buf_len {
             let max_off = stream.send.max_off();
 
             if stream.send.blocked_at() != Some(max_off) {
@@ -4543,7 +5210,7 @@ impl Connection {
             q.add_event_data_with_instant(ev_data, now).ok();
         });
 
-        if sent == 0 && !unblocked_buf.is_empty() {
+        if sent == 0 && !unblocked_empty {
             return Err(Error::Done);
         }
 
@@ -5187,7 +5854,11 @@ impl Connection {
             // detection timers. If they are both unset (i.e. `None`) then the
             // result is `None`, but if at least one of them is set then a
             // `Some(...)` value is returned.
-            let timers = [self.idle_timer, self.recovery.loss_detection_timer()];
+            let timers = [
+                self.idle_timer,
+                self.recovery.loss_detection_timer(),
+                self.path.validation_timer(),
+            ];
 
             timers.iter().filter_map(|&x| x).min()
         };
@@ -5209,8 +5880,13 @@ impl Connection {
     ///
     /// If no timeout has occurred it does nothing.
     pub fn on_timeout(&mut self) {
-        let now = time::Instant::now();
+        self.on_timeout_at(time::Instant::now());
+    }
 
+    /// Like [`on_timeout()`], with `now` as the current time.
+    ///
+    /// [`on_timeout()`]: struct.Connection.html#method.on_timeout
+    pub(crate) fn on_timeout_at(&mut self, now: time::Instant) {
         if let Some(draining_timer) = self.draining_timer {
             if draining_timer <= now {
                 trace!("{} draining timeout expired", self.trace_id);
@@ -5242,6 +5918,23 @@ impl Connection {
             }
         }
 
+        if self.path.on_validation_timeout(now) {
+            trace!("{} path validation failed {:?}", self.trace_id, self.path);
+
+            // The peer might not have moved by itself, e.g. if an attacker
+            // replayed its packets from another address.
+            if let Some(prev) = self.prev_path.take() {
+                let ip_changed =
+                    prev.peer_addr().ip() != self.path.peer_addr().ip();
+
+                self.path = prev;
+
+                if ip_changed {
+                    self.recovery.on_path_change(&self.trace_id);
+                }
+            }
+        }
+
         if let Some(timer) = self.recovery.loss_detection_timer() {
             if timer <= now {
                 trace!("{} loss detection timeout expired", self.trace_id);
@@ -5360,6 +6053,116 @@ impl Connection {
         ConnectionId::from_ref(self.dcid.as_ref())
     }
 
+    /// Returns the address of the peer.
+    ///
+    /// On the server, it changes when the client moves to another address,
+    /// for example after a NAT rebinding or when it switches networks. The
+    /// `to` field of [`SendInfo`] always carries the current address.
+    ///
+    /// [`SendInfo`]: struct.SendInfo.html
+    #[inline]
+    pub fn peer_addr(&self) -> SocketAddr {
+        self.path.peer_addr()
+    }
+
+    /// Returns true if the peer is known to receive the packets sent to its
+    /// current address.
+    ///
+    /// Until the new address of a client that migrated is validated, the
+    /// server sends it at most three times the amount of data it received
+    /// from it.
+    #[inline]
+    pub fn is_path_validated(&self) -> bool {
+        self.path.is_validated()
+    }
+
+    /// Issues a new source connection ID to the peer, returning its sequence
+    /// number.
+    ///
+    /// The peer switches to a connection ID it didn't use before when either
+    /// end moves to another address, so that the packets sent on the two
+    /// paths can't be linked to each other. The application must route the
+    /// packets using the new connection ID to the connection, until it is
+    /// returned by [`retired_scid_next()`].
+    ///
+    /// The connection ID must be as long as the one the connection was
+    /// created with, otherwise [`InvalidState`] is returned. [`IdLimit`] is
+    /// returned if the peer already has as many connection IDs as it allows.
+    ///
+    /// [`retired_scid_next()`]: struct.Connection.html#method.retired_scid_next
+    /// [`InvalidState`]: enum.Error.html#variant.InvalidState
+    /// [`IdLimit`]: enum.Error.html#variant.IdLimit
+    pub fn new_scid(
+        &mut self, scid: &ConnectionId, reset_token: u128,
+    ) -> Result<u64> {
+        // Short header packets are parsed assuming that length.
+        if scid.is_empty() || scid.len() != self.scid.len() {
+            return Err(Error::InvalidState);
+        }
+
+        self.ids.new_scid(
+            scid.to_vec().into(),
+            reset_token.to_be_bytes(),
+            self.peer_transport_params.active_conn_id_limit,
+        )
+    }
+
+    /// Returns a source connection ID the peer retired, that can be removed
+    /// from the routing of the application.
+    #[inline]
+    pub fn retired_scid_next(&mut self) -> Option<ConnectionId<'static>> {
+        self.ids.retired_scid_next()
+    }
+
+    /// Migrates the client to a new local address.
+    ///
+    /// The application calls this when it starts sending the packets of the
+    /// connection from another address, e.g. after switching from Wi-Fi to a
+    /// cellular network. The packets then use a connection ID the server
+    /// didn't see before, and the new path is validated. Congestion control
+    /// and RTT estimation start over. If validation fails, the connection
+    /// falls back to the path it used before.
+    ///
+    /// [`InvalidState`] is returned on the server, before the handshake is
+    /// confirmed or if the server disabled active migration, and
+    /// [`OutOfIdentifiers`] if the server didn't issue a spare connection ID.
+    ///
+    /// [`InvalidState`]: enum.Error.html#variant.InvalidState
+    /// [`OutOfIdentifiers`]: enum.Error.html#variant.OutOfIdentifiers
+    pub fn migrate(&mut self) -> Result<()> {
+        if self.is_server ||
+            !self.handshake_confirmed ||
+            self.peer_transport_params.disable_active_migration
+        {
+            return Err(Error::InvalidState);
+        }
+
+        if !self.ids.has_spare_dcid() {
+            return Err(Error::OutOfIdentifiers);
+        }
+
+        let path = path::Path::new(self.path.peer_addr(), false);
+        let old = std::mem::replace(&mut self.path, path);
+
+        // Fall back to the last validated path if the new one can't be
+        // validated.
+        if old.is_validated() {
+            self.prev_path = Some(old);
+        }
+
+        if let Some(dcid) = self.ids.rotate_dcid() {
+            self.dcid = dcid;
+        }
+
+        self.recovery.on_path_change(&self.trace_id);
+
+        let now = time::Instant::now();
+
+        self.path.request_validation(now + self.recovery.pto() * 3);
+
+        Ok(())
+    }
+
     /// Returns true if the connection handshake is complete.
     #[inline]
     pub fn is_established(&self) -> bool {
@@ -5662,6 +6465,14 @@ impl Connection {
             self.undecryptable_pkts.clear();
         }
 
+        if self.handshake_completed &&
+            self.gm_on == 1 &&
+            self.local_transport_params.gm_sm4 &&
+            self.peer_transport_params.gm_sm4
+        {
+            self.gm_derive_keys()?;
+        }
+
         trace!("{} connection established: proto={:?} cipher={:?} curve={:?} sigalg={:?} resumed={} {:?}",
                &self.trace_id,
                std::str::from_utf8(self.application_proto()),
@@ -5674,21 +6485,173 @@ impl Connection {
         Ok(())
     }
 
-    /// Selects the packet type for the next outgoing packet.
-    fn write_pkt_type(&self) -> Result<packet::Type> {
-        // On error send packet in the latest epoch available, but only send
-        // 1-RTT ones when the handshake is completed.
-        if self
-            .local_error
-            .as_ref()
-            .map_or(false, |conn_err| !conn_err.is_app)
-        {
-            let epoch = match self.handshake.write_level() {
-                crypto::Level::Initial => packet::EPOCH_INITIAL,
-                crypto::Level::ZeroRTT => unreachable!(),
-                crypto::Level::Handshake => packet::EPOCH_HANDSHAKE,
-                crypto::Level::OneRTT => packet::EPOCH_APPLICATION,
-            };
+    /// Derives the gm SM4 packet keys from the TLS exporter.
+    ///
+    /// Both endpoints advertised the gm transport parameter, so instead of
+    /// transporting a key with SM2 after the handshake each side exports a
+    /// key and a counter block per direction, and protects 1-RTT packets with
+    /// SM4 from the first one sent after the handshake is completed.
+    fn gm_derive_keys(&mut self) -> Result<()> {
+        let mut material = [0; 64];
+
+        self.handshake.export_keying_material(
+            GM_SM4_EXPORTER_LABEL,
+            &[],
+            &mut material,
+        )?;
+
+        // The client's key and counter block come first.
+        let (local, peer) = if self.is_server {
+            (32, 0)
+        } else {
+            (0, 32)
+        };
+
+        let mut sm4key = crypto::SM4_KEY { rk: [0; 32] };
+        let mut peer_sm4key = crypto::SM4_KEY { rk: [0; 32] };
+
+        unsafe {
+            crypto::sm4_set_encrypt_key(
+                &mut sm4key,
+                material[local..].as_mut_ptr(),
+            );
+            crypto::sm4_set_encrypt_key(
+                &mut peer_sm4key,
+                material[peer..].as_mut_ptr(),
+            );
+        };
+
+        let mut iv = [0; 16];
+        let mut peer_iv = [0; 16];
+
+        iv.copy_from_slice(&material[local + 16..local + 32]);
+        peer_iv.copy_from_slice(&material[peer + 16..peer + 32]);
+
+        for v in material.iter_mut() {
+            *v = 0;
+        }
+
+        self.gm_sm4key = Some(sm4key);
+        self.gm_iv = Some(iv);
+        self.gm_peer_sm4key = Some(peer_sm4key);
+        self.gm_peer_iv = Some(peer_iv);
+        self.gm_exported = true;
+        self.gm_on = 6;
+
+        trace!("{} gm keys derived from TLS exporter", self.trace_id);
+
+        Ok(())
+    }
+
+    /// Returns the SM4-CTR counter block of packet `pn`: the packet number is
+    /// mixed into the middle of the exported block and the low 32 bits count
+    /// the blocks of the packet, so no two packets share keystream.
+    fn gm_pkt_ctr(iv: &[u8; 16], pn: u64) -> [u8; 16] {
+        let mut ctr = *iv;
+
+        for (c, p) in ctr[4..12].iter_mut().zip(pn.to_be_bytes().iter()) {
+            *c ^= p;
+        }
+
+        ctr[12..].copy_from_slice(&[0; 4]);
+
+        ctr
+    }
+
+    /// Returns the size of the PMTU probe to send next, if one is due and
+    /// fits in a buffer of `out_len` bytes.
+    fn pmtu_probe_size(
+        &mut self, out_len: usize, now: time::Instant,
+    ) -> Option<usize> {
+        // Probes are only sent once the handshake is confirmed and the path
+        // validated, when nothing is left to send at other encryption levels,
+        // and not in place of PTO probes.
+        if !self.recovery.pmtud.enabled() ||
+            !self.handshake_confirmed ||
+            !self.path.is_validated() ||
+            self.local_error.is_some() ||
+            self.recovery.loss_probes.iter().any(|&v| v > 0) ||
+            self.write_pkt_type().ok() != Some(packet::Type::Short)
+        {
+            return None;
+        }
+
+        // Like other packets, probes are capped to 16KB or so.
+        let size = self
+            .recovery
+            .pmtud
+            .probe_size(cmp::min(out_len, 16383), now)?;
+
+        if size > self.recovery.cwnd_available() {
+            return None;
+        }
+
+        Some(size)
+    }
+
+    /// Moves the connection to the client's new address.
+    fn on_peer_migrated(&mut self, peer_addr: SocketAddr, now: time::Instant) {
+        let old_addr = self.path.peer_addr();
+        let old_pto = self.recovery.pto();
+
+        // Going back to the previous path doesn't need validating it again.
+        let path = match self.prev_path.take() {
+            Some(prev) if prev.peer_addr() == peer_addr => prev,
+
+            prev => {
+                self.prev_path = prev;
+                path::Path::new(peer_addr, false)
+            },
+        };
+
+        let old = std::mem::replace(&mut self.path, path);
+
+        // Keep the last validated path to fall back to.
+        if old.is_validated() {
+            self.prev_path = Some(old);
+        }
+
+        // A NAT rebinding usually only changes the port, the rest of the path
+        // and its capacity stay the same (RFC 9000 §9.4).
+        if peer_addr.ip() != old_addr.ip() {
+            self.recovery.on_path_change(&self.trace_id);
+        }
+
+        if !self.path.is_validated() {
+            let pto = cmp::max(old_pto, self.recovery.pto());
+
+            self.path.request_validation(now + pto * 3);
+        }
+
+        // Packets sent to the new address can't be linked to the ones sent to
+        // the old one if they use another connection ID.
+        if let Some(dcid) = self.ids.rotate_dcid() {
+            self.dcid = dcid;
+        }
+
+        trace!(
+            "{} peer migrated from {} to {:?}",
+            self.trace_id,
+            old_addr,
+            self.path
+        );
+    }
+
+    /// Selects the packet type for the next outgoing packet.
+    fn write_pkt_type(&self) -> Result<packet::Type> {
+        // On error send packet in the latest epoch available, but only send
+        // 1-RTT ones when the handshake is completed.
+        if self
+            .local_error
+            .as_ref()
+            .map_or(false, |conn_err| !conn_err.is_app)
+        {
+            let epoch = match self.handshake.write_level() {
+                crypto::Level::Initial => packet::EPOCH_INITIAL,
+                crypto::Level::ZeroRTT => unreachable!(),
+                crypto::Level::Handshake => packet::EPOCH_HANDSHAKE,
+                crypto::Level::OneRTT => packet::EPOCH_APPLICATION,
+            };
 
             if epoch == packet::EPOCH_APPLICATION && !self.is_established() {
                 // Downgrade the epoch to handshake as the handshake is not
@@ -5823,7 +6786,10 @@ impl Connection {
             frame::Frame::Ping => (),
 
             frame::Frame::ACK {
-                ranges, ack_delay, ..
+                ranges,
+                ack_delay,
+                ecn_counts,
+                ..
             } => {
                 let ack_delay = ack_delay
                     .checked_mul(2_u64.pow(
@@ -5850,6 +6816,7 @@ impl Connection {
                 self.recovery.on_ack_received(
                     &ranges,
                     ack_delay,
+                    ecn_counts.as_ref(),
                     epoch,
                     self.handshake_status(),
                     now,
@@ -5971,14 +6938,30 @@ impl Connection {
                       //  let sm2=self.gm_skey.clone().unwrap();
                         
                         //let plain_text=DecryptCtx::new(klen, sk).decrypt(&enc_sm4key);
-                        let mut plain_text:[u8;32]=[0;32];
+                        let mut plain_text = [0; GM_SM2_MAX_PLAINTEXT_SIZE];
                         let mut inrag:usize=0;
-                        unsafe{
 
-                            crypto::sm2_decrypt(self.gm_sm2key.as_ref().unwrap(), enc_sm4key[..].as_ptr(),
-                            enc_sm4key.len(), plain_text.as_mut_ptr(), &mut inrag)
+                        // sm2_decrypt writes the whole C2 of the peer, so the
+                        // buffer holds any plaintext it accepts and the
+                        // length is checked against the key and iv below.
+                        if enc_sm4key.len() > GM_SM2_MAX_CIPHERTEXT_SIZE {
+                            return Err(Error::TlsFail);
+                        }
+
+                        let rc = unsafe {
+                            crypto::sm2_decrypt(
+                                self.gm_sm2key.as_ref().unwrap(),
+                                enc_sm4key.as_ptr(),
+                                enc_sm4key.len(),
+                                plain_text.as_mut_ptr(),
+                                &mut inrag,
+                            )
                         };
 
+                        if rc != 1 || inrag != klen {
+                            return Err(Error::TlsFail);
+                        }
+
            
 
                         let mut sm4keyvec=plain_text[0..16].to_vec();
@@ -6191,17 +7174,47 @@ impl Connection {
                     return Err(Error::InvalidFrame);
                 },
 
-            // TODO: implement connection migration
-            frame::Frame::NewConnectionId { .. } => (),
+            frame::Frame::NewConnectionId {
+                seq_num,
+                retire_prior_to,
+                conn_id,
+                ..
+            } => {
+                // A peer using a zero-length connection ID can't change it.
+                if self.dcid.is_empty() ||
+                    conn_id.is_empty() ||
+                    conn_id.len() > MAX_CONN_ID_LEN
+                {
+                    return Err(Error::InvalidFrame);
+                }
+
+                let dcid = self.ids.on_new_dcid(
+                    seq_num,
+                    retire_prior_to,
+                    conn_id.into(),
+                    self.local_transport_params.active_conn_id_limit,
+                )?;
+
+                if let Some(dcid) = dcid {
+                    self.dcid = dcid;
+                }
+            },
 
-            // TODO: implement connection migration
-            frame::Frame::RetireConnectionId { .. } => (),
+            frame::Frame::RetireConnectionId { seq_num } => {
+                self.ids.on_retire_scid(seq_num)?;
+            },
 
             frame::Frame::PathChallenge { data } => {
                 self.challenge = Some(data);
             },
 
-            frame::Frame::PathResponse { .. } => (),
+            frame::Frame::PathResponse { data } => {
+                if self.path.on_response(data) {
+                    trace!("{} path validated {:?}", self.trace_id, self.path);
+
+                    self.prev_path = None;
+                }
+            },
 
             frame::Frame::ConnectionClose {
                 error_code, reason, ..
@@ -6498,6 +7511,10 @@ pub struct Stats {
     pub stream_retrans_bytes: u64,
 
     /// The current PMTU for the connection.
+    ///
+    /// This is the largest size of the UDP payloads sent, which grows as
+    /// larger sizes are found to get through when path MTU discovery is
+    /// enabled.
     pub pmtu: usize,
 
     /// The most recent data delivery rate estimate in bytes/s.
@@ -6647,6 +7664,7 @@ struct TransportParams {
     pub initial_source_connection_id: Option<ConnectionId<'static>>,
     pub retry_source_connection_id: Option<ConnectionId<'static>>,
     pub max_datagram_frame_size: Option<u64>,
+    pub gm_sm4: bool,
 }
 
 impl Default for TransportParams {
@@ -6669,6 +7687,7 @@ impl Default for TransportParams {
             initial_source_connection_id: None,
             retry_source_connection_id: None,
             max_datagram_frame_size: None,
+            gm_sm4: false,
         }
     }
 }
@@ -6810,6 +7829,10 @@ impl TransportParams {
                     tp.max_datagram_frame_size = Some(val.get_varint()?);
                 },
 
+                GM_SM4_TRANSPORT_PARAM => {
+                    tp.gm_sm4 = true;
+                },
+
                 // Ignore unknown parameters.
                 _ => (),
             }
@@ -6972,6 +7995,10 @@ impl TransportParams {
             b.put_varint(max_datagram_frame_size)?;
         }
 
+        if tp.gm_sm4 {
+            TransportParams::encode_param(&mut b, GM_SM4_TRANSPORT_PARAM, 0)?;
+        }
+
         let out_len = b.off();
 
         Ok(&mut out[..out_len])
@@ -7185,9 +8212,39 @@ pub mod testing {
             Ok(())
         }
 
+        /// Like `advance()`, but the client's packets go through `up` and the
+        /// server's through `down`.
+        ///
+        /// Time is simulated: it starts at `now` and jumps to when the next
+        /// packet comes out of a link. The time the links drained is returned,
+        /// to start from on the next call.
+        #[cfg(test)]
+        pub fn advance_over(
+            &mut self, up: &mut Link, down: &mut Link, mut now: time::Instant,
+        ) -> Result<time::Instant> {
+            loop {
+                up.deliver(&mut self.server, now)?;
+                down.deliver(&mut self.client, now)?;
+
+                up.send(&mut self.client, now)?;
+                down.send(&mut self.server, now)?;
+
+                now = match (up.next_delivery(), down.next_delivery()) {
+                    (Some(a), Some(b)) => cmp::min(a, b),
+
+                    (Some(v), None) | (None, Some(v)) => v,
+
+                    (None, None) => break,
+                };
+            }
+
+            Ok(now)
+        }
+
         pub fn client_recv(&mut self, buf: &mut [u8]) -> Result<usize> {
             let info = RecvInfo {
-                from: self.client.peer_addr,
+                from: self.client.peer_addr(),
+                ecn: 0,
             };
 
             self.client.recv(buf, info)
@@ -7195,7 +8252,8 @@ pub mod testing {
 
         pub fn server_recv(&mut self, buf: &mut [u8]) -> Result<usize> {
             let info = RecvInfo {
-                from: self.server.peer_addr,
+                from: self.server.peer_addr(),
+                ecn: 0,
             };
 
             self.server.recv(buf, info)
@@ -7214,7 +8272,8 @@ pub mod testing {
         conn: &mut Connection, buf: &mut [u8], len: usize,
     ) -> Result<usize> {
         let info = RecvInfo {
-            from: conn.peer_addr,
+            from: conn.peer_addr(),
+            ecn: 0,
         };
 
         conn.recv(&mut buf[..len], info)?;
@@ -7233,11 +8292,12 @@ pub mod testing {
     }
 
     pub fn process_flight(
-        conn: &mut Connection, flight: Vec<Vec<u8>>,
+        conn: &mut Connection, flight: Vec<(Vec<u8>, SendInfo)>,
     ) -> Result<()> {
-        for mut pkt in flight {
+        for (mut pkt, si) in flight {
             let info = RecvInfo {
-                from: conn.peer_addr,
+                from: conn.peer_addr(),
+                ecn: si.ecn,
             };
 
             conn.recv(&mut pkt, info)?;
@@ -7246,21 +8306,26 @@ pub mod testing {
         Ok(())
     }
 
-    pub fn emit_flight(conn: &mut Connection) -> Result<Vec<Vec<u8>>> {
+    pub fn emit_flight(
+        conn: &mut Connection,
+    ) -> Result<Vec<(Vec<u8>, SendInfo)>> {
         let mut flight = Vec::new();
 
         loop {
             let mut out = vec![0u8; 65535];
 
-            match conn.send(&mut out) {
-                Ok((written, _)) => out.truncate(written),
+            let info = match conn.send(&mut out) {
+                Ok((written, info)) => {
+                    out.truncate(written);
+                    info
+                },
 
                 Err(Error::Done) => break,
 
                 Err(e) => return Err(e),
             };
 
-            flight.push(out);
+            flight.push((out, info));
         }
 
         if flight.is_empty() {
@@ -7369,6 +8434,131 @@ pub mod testing {
 
         Ok(frames)
     }
+
+    /// A one-way link that holds packets back for a fixed delay, like
+    /// `tc qdisc add ... netem delay`, optionally behind a bottleneck of
+    /// `rate` bytes per second with an unbounded buffer.
+    #[cfg(test)]
+    pub struct Link {
+        delay: time::Duration,
+
+        rate: Option<u64>,
+
+        /// When the bottleneck is done with the packets queued so far.
+        busy_until: Option<time::Instant>,
+
+        /// The longest time a packet waited in the bottleneck's buffer.
+        pub max_queue_delay: time::Duration,
+
+        queue: VecDeque<(time::Instant, Vec<u8>, SendInfo)>,
+    }
+
+    #[cfg(test)]
+    impl Link {
+        pub fn new(delay: time::Duration) -> Link {
+            Link {
+                delay,
+
+                rate: None,
+
+                busy_until: None,
+
+                max_queue_delay: time::Duration::ZERO,
+
+                queue: VecDeque::new(),
+            }
+        }
+
+        pub fn with_rate(delay: time::Duration, rate: u64) -> Link {
+            Link {
+                rate: Some(rate),
+
+                ..Link::new(delay)
+            }
+        }
+
+        /// Puts in the link all the packets `conn` has to send at `now`.
+        ///
+        /// Packets enter the link at the time the sender's pacing set for
+        /// them.
+        pub fn send(
+            &mut self, conn: &mut Connection, now: time::Instant,
+        ) -> Result<()> {
+            loop {
+                let mut out = vec![0u8; 65535];
+
+                let si = match conn.send_at(&mut out, now) {
+                    Ok((written, si)) => {
+                        out.truncate(written);
+                        si
+                    },
+
+                    Err(Error::Done) => break,
+
+                    Err(e) => return Err(e),
+                };
+
+                let mut at = cmp::max(now, si.at);
+
+                if let Some(rate) = self.rate {
+                    let start = match self.busy_until {
+                        Some(t) if t > at => t,
+
+                        _ => at,
+                    };
+
+                    self.max_queue_delay =
+                        cmp::max(self.max_queue_delay, start - at);
+
+                    at = start +
+                        time::Duration::from_secs_f64(
+                            out.len() as f64 / rate as f64,
+                        );
+
+                    self.busy_until = Some(at);
+                }
+
+                at += self.delay;
+
+                // Packets don't overtake each other.
+                if let Some((last, ..)) = self.queue.back() {
+                    at = cmp::max(at, *last);
+                }
+
+                self.queue.push_back((at, out, si));
+            }
+
+            Ok(())
+        }
+
+        /// Returns when the next packet comes out of the link.
+        pub fn next_delivery(&self) -> Option<time::Instant> {
+            self.queue.front().map(|(at, ..)| *at)
+        }
+
+        /// Passes to `conn` the packets that spent the delay in the link by
+        /// `now`.
+        pub fn deliver(
+            &mut self, conn: &mut Connection, now: time::Instant,
+        ) -> Result<()> {
+            while let Some((at, ..)) = self.queue.front() {
+                if *at > now {
+                    break;
+                }
+
+                let (_, mut pkt, si) = self.queue.pop_front().unwrap();
+
+                let info = RecvInfo {
+                    from: conn.peer_addr(),
+                    ecn: si.ecn,
+                };
+
+                conn.recv_at(&mut pkt, info, now)?;
+            }
+
+            Ok(())
+        }
+    }
 }
 
 #[cfg(test)]
@@ -7396,6 +8586,7 @@ mod tests {
             initial_source_connection_id: Some(b"woot woot".to_vec().into()),
             retry_source_connection_id: Some(b"retry".to_vec().into()),
             max_datagram_frame_size: Some(32),
+            gm_sm4: false,
         };
 
         let mut raw_params = [42; 256];
@@ -7426,12 +8617,13 @@ mod tests {
             initial_source_connection_id: Some(b"woot woot".to_vec().into()),
             retry_source_connection_id: None,
             max_datagram_frame_size: Some(32),
+            gm_sm4: true,
         };
 
         let mut raw_params = [42; 256];
         let raw_params =
             TransportParams::encode(&tp, false, &mut raw_params).unwrap();
-        assert_eq!(raw_params.len(), 69);
+        assert_eq!(raw_params.len(), 74);
 
         let new_tp = TransportParams::decode(&raw_params, true).unwrap();
 
@@ -7943,11 +9135,11 @@ mod tests {
         let mut pipe = testing::Pipe::with_server_config(&mut config).unwrap();
 
         let flight = testing::emit_flight(&mut pipe.client).unwrap();
-        let client_sent = flight.iter().fold(0, |out, p| out + p.len());
+        let client_sent = flight.iter().fold(0, |out, p| out + p.0.len());
         testing::process_flight(&mut pipe.server, flight).unwrap();
 
         let flight = testing::emit_flight(&mut pipe.server).unwrap();
-        let server_sent = flight.iter().fold(0, |out, p| out + p.len());
+        let server_sent = flight.iter().fold(0, |out, p| out + p.0.len());
 
         assert_eq!(server_sent, client_sent * MAX_AMPLIFICATION_FACTOR);
     }
@@ -7973,6 +9165,82 @@ mod tests {
         assert!(pipe.server.stream_finished(4));
     }
 
+    #[test]
+    fn gm_exporter_keys() {
+        let mut config = Config::new(crate::PROTOCOL_VERSION).unwrap();
+        config
+            .load_cert_chain_from_pem_file("examples/cert.crt")
+            .unwrap();
+        config
+            .load_priv_key_from_pem_file("examples/cert.key")
+            .unwrap();
+        config
+            .set_application_protos(b"\x06proto1\x06proto2")
+            .unwrap();
+        config.set_initial_max_data(30);
+        config.set_initial_max_stream_data_bidi_local(15);
+        config.set_initial_max_stream_data_bidi_remote(15);
+        config.set_initial_max_streams_bidi(3);
+        config.verify_peer(false);
+        config.set_gmssl(1);
+
+        let mut pipe = testing::Pipe::with_config(&mut config).unwrap();
+        assert_eq!(pipe.handshake(), Ok(()));
+
+        // Keys are derived on both sides without any SM2 key transport.
+        assert_eq!(pipe.client.gm_on, 6);
+        assert_eq!(pipe.server.gm_on, 6);
+        assert!(pipe.client.gm_exported && pipe.server.gm_exported);
+        assert!(pipe.server.gm_sm2key.is_none());
+        assert_eq!(pipe.client.gm_iv, pipe.server.gm_peer_iv);
+        assert_eq!(pipe.server.gm_iv, pipe.client.gm_peer_iv);
+        assert_ne!(pipe.client.gm_iv, pipe.client.gm_peer_iv);
+
+        assert_eq!(pipe.client.stream_send(4, b"hello, world", true), Ok(12));
+        assert_eq!(pipe.advance(), Ok(()));
+
+        let mut b = [0; 15];
+        assert_eq!(pipe.server.stream_recv(4, &mut b), Ok((12, true)));
+        assert_eq!(&b[..12], b"hello, world");
+
+        assert_eq!(pipe.server.stream_send(4, b"hello", true), Ok(5));
+        assert_eq!(pipe.advance(), Ok(()));
+
+        assert_eq!(pipe.client.stream_recv(4, &mut b), Ok((5, true)));
+        assert_eq!(&b[..5], b"hello");
+    }
+
+    #[test]
+    fn gm_key_pool() {
+        let mut config = Config::new(crate::PROTOCOL_VERSION).unwrap();
+        config
+            .load_cert_chain_from_pem_file("examples/cert.crt")
+            .unwrap();
+        config
+            .load_priv_key_from_pem_file("examples/cert.key")
+            .unwrap();
+        config
+            .set_application_protos(b"\x06proto1\x06proto2")
+            .unwrap();
+        config.verify_peer(false);
+        config.set_gmssl(1);
+        assert_eq!(config.gm_key_pool_stats(), None);
+        assert!(config.enable_gm_key_pool(8, 2).is_ok());
+
+        // Peers that don't advertise the exporter keys use the SM2 key
+        // transport, the server takes its keypair from the pool.
+        config.local_transport_params.gm_sm4 = false;
+
+        let mut pipe = testing::Pipe::with_config(&mut config).unwrap();
+        assert_eq!(pipe.handshake(), Ok(()));
+
+        assert!(pipe.server.gm_sm2key.is_some());
+        assert!(!pipe.server.gm_exported);
+
+        let (hits, misses) = config.gm_key_pool_stats().unwrap();
+        assert_eq!(hits + misses, 1);
+    }
+
     #[test]
     fn zero_rtt() {
         let mut buf = [0; 65535];
@@ -8065,6 +9333,75 @@ mod tests {
         assert!(!pipe.server.stream_finished(4));
     }
 
+    #[test]
+    fn stream_send_zero_copy() {
+        struct AppData(Arc<Vec<u8>>);
+
+        impl AsRef<[u8]> for AppData {
+            fn as_ref(&self) -> &[u8] {
+                &self.0
+            }
+        }
+
+        let mut b = [0; 15];
+
+        let mut pipe = testing::Pipe::default().unwrap();
+        assert_eq!(pipe.handshake(), Ok(()));
+
+        let data = Arc::new(b"hello, world".to_vec());
+        let zc = ZeroCopyBuf::new(AppData(data.clone()));
+
+        assert_eq!(pipe.client.stream_send_zc(4, &zc, true), Ok(12));
+        drop(zc);
+
+        // The stream holds on to the application's data until it's acked.
+        assert_eq!(Arc::strong_count(&data), 2);
+
+        assert_eq!(pipe.advance(), Ok(()));
+
+        assert_eq!(pipe.server.stream_recv(4, &mut b), Ok((12, true)));
+        assert_eq!(&b[..12], b"hello, world");
+
+        assert_eq!(Arc::strong_count(&data), 1);
+    }
+
+    #[test]
+    fn stream_recv_slice() {
+        let mut pipe = testing::Pipe::default().unwrap();
+        assert_eq!(pipe.handshake(), Ok(()));
+
+        assert_eq!(pipe.client.stream_send(4, b"hello, world", true), Ok(12));
+        assert_eq!(pipe.advance(), Ok(()));
+
+        assert_eq!(
+            pipe.server.stream_recv_slice(4),
+            Ok((&b"hello, world"[..], true))
+        );
+
+        assert_eq!(
+            pipe.server.stream_recv_consume(4, 13),
+            Err(Error::InvalidStreamState(4))
+        );
+        assert_eq!(pipe.server.stream_recv_consume(4, 7), Ok(()));
+
+        assert_eq!(pipe.server.stream_recv_slice(4), Ok((&b"world"[..], true)));
+        assert_eq!(pipe.server.stream_recv_consume(4, 5), Ok(()));
+
+        assert!(pipe.server.stream_finished(4));
+
+        // We can't read on our own unidirectional streams.
+        assert_eq!(pipe.client.stream_send(2, b"hello", false), Ok(5));
+
+        assert_eq!(
+            pipe.client.stream_recv_slice(2),
+            Err(Error::InvalidStreamState(2))
+        );
+        assert_eq!(
+            pipe.client.stream_recv_consume(2, 0),
+            Err(Error::InvalidStreamState(2))
+        );
+    }
+
     #[test]
     fn empty_stream_frame() {
         let mut buf = [0; 65535];
@@ -8811,117 +10148,435 @@ mod tests {
         let pkt_type = packet::Type::Short;
         assert_eq!(pipe.send_pkt_to_server(pkt_type, &frames, &mut buf), Ok(39));
 
-        // Server is notified of stream readability, due to reset.
-        let mut r = pipe.server.readable();
-        assert_eq!(r.next(), Some(4));
-        assert_eq!(r.next(), None);
+        // Server is notified of stream readability, due to reset.
+        let mut r = pipe.server.readable();
+        assert_eq!(r.next(), Some(4));
+        assert_eq!(r.next(), None);
+
+        assert_eq!(
+            pipe.server.stream_recv(4, &mut b),
+            Err(Error::StreamReset(42))
+        );
+
+        assert!(pipe.server.stream_finished(4));
+
+        // Sending RESET_STREAM again shouldn't make stream readable again.
+        assert_eq!(pipe.send_pkt_to_server(pkt_type, &frames, &mut buf), Ok(39));
+
+        let mut r = pipe.server.readable();
+        assert_eq!(r.next(), None);
+    }
+
+    #[test]
+    /// Tests that RESET_STREAM frames exceeding the connection-level flow
+    /// control limit cause an error.
+    fn reset_stream_flow_control() {
+        let mut buf = [0; 65535];
+
+        let mut pipe = testing::Pipe::default().unwrap();
+        assert_eq!(pipe.handshake(), Ok(()));
+
+        let frames = [
+            frame::Frame::Stream {
+                stream_id: 4,
+                data: stream::RangeBuf::from(b"aaaaaaaaaaaaaaa", 0, false),
+            },
+            frame::Frame::Stream {
+                stream_id: 8,
+                data: stream::RangeBuf::from(b"a", 0, false),
+            },
+            frame::Frame::ResetStream {
+                stream_id: 8,
+                error_code: 0,
+                final_size: 15,
+            },
+            frame::Frame::Stream {
+                stream_id: 12,
+                data: stream::RangeBuf::from(b"a", 0, false),
+            },
+        ];
+
+        let pkt_type = packet::Type::Short;
+        assert_eq!(
+            pipe.send_pkt_to_server(pkt_type, &frames, &mut buf),
+            Err(Error::FlowControl),
+        );
+    }
+
+    #[test]
+    /// Tests that RESET_STREAM frames exceeding the stream-level flow control
+    /// limit cause an error.
+    fn reset_stream_flow_control_stream() {
+        let mut buf = [0; 65535];
+
+        let mut pipe = testing::Pipe::default().unwrap();
+        assert_eq!(pipe.handshake(), Ok(()));
+
+        let frames = [
+            frame::Frame::Stream {
+                stream_id: 4,
+                data: stream::RangeBuf::from(b"a", 0, false),
+            },
+            frame::Frame::ResetStream {
+                stream_id: 4,
+                error_code: 0,
+                final_size: 16, // Past stream's flow control limit.
+            },
+        ];
+
+        let pkt_type = packet::Type::Short;
+        assert_eq!(
+            pipe.send_pkt_to_server(pkt_type, &frames, &mut buf),
+            Err(Error::FlowControl),
+        );
+    }
+
+    #[test]
+    fn path_challenge() {
+        let mut buf = [0; 65535];
+
+        let mut pipe = testing::Pipe::default().unwrap();
+        assert_eq!(pipe.handshake(), Ok(()));
+
+        let frames = [frame::Frame::PathChallenge { data: [0xba; 8] }];
+
+        let pkt_type = packet::Type::Short;
+
+        let len = pipe
+            .send_pkt_to_server(pkt_type, &frames, &mut buf)
+            .unwrap();
+
+        assert!(len > 0);
+
+        let frames =
+            testing::decode_pkt(&mut pipe.client, &mut buf, len).unwrap();
+        let mut iter = frames.iter();
+
+        // Ignore ACK.
+        iter.next().unwrap();
+
+        assert_eq!(
+            iter.next(),
+            Some(&frame::Frame::PathResponse { data: [0xba; 8] })
+        );
+    }
+
+    #[test]
+    fn server_follows_migrated_client() {
+        let mut pipe = testing::Pipe::default().unwrap();
+        assert_eq!(pipe.handshake(), Ok(()));
+        assert_eq!(pipe.advance(), Ok(()));
+
+        let old_addr = pipe.server.peer_addr();
+        let new_addr: SocketAddr = "127.0.0.2:1234".parse().unwrap();
+
+        assert_eq!(pipe.client.stream_send(4, b"hello", false), Ok(5));
+
+        let mut recv_len = 0;
+
+        let flight = testing::emit_flight(&mut pipe.client).unwrap();
+        for (mut pkt, _) in flight {
+            let info = RecvInfo {
+                from: new_addr,
+                ecn: 0,
+            };
+
+            recv_len += pkt.len();
+            assert_eq!(pipe.server.recv(&mut pkt, info), Ok(pkt.len()));
+        }
+
+        assert_eq!(pipe.server.peer_addr(), new_addr);
+        assert!(!pipe.server.is_path_validated());
+
+        // Until the client answers, the server is limited to three times what
+        // it received from the new address.
+        let flight = testing::emit_flight(&mut pipe.server).unwrap();
+        let sent: usize = flight.iter().map(|(pkt, _)| pkt.len()).sum();
+
+        assert!(sent <= recv_len * MAX_AMPLIFICATION_FACTOR);
+        assert!(flight.iter().all(|(_, info)| info.to == new_addr));
+
+        testing::process_flight(&mut pipe.client, flight).unwrap();
+        assert_eq!(pipe.advance(), Ok(()));
+
+        assert!(pipe.server.is_path_validated());
+        assert_ne!(pipe.server.peer_addr(), old_addr);
+    }
+
+    #[test]
+    fn probing_packet_does_not_migrate() {
+        let mut buf = [0; 65535];
+
+        let mut pipe = testing::Pipe::default().unwrap();
+        assert_eq!(pipe.handshake(), Ok(()));
+        assert_eq!(pipe.advance(), Ok(()));
+
+        let old_addr = pipe.server.peer_addr();
+
+        let frames = [
+            frame::Frame::PathChallenge { data: [0xba; 8] },
+            frame::Frame::Padding { len: 10 },
+        ];
+
+        let len = testing::encode_pkt(
+            &mut pipe.client,
+            packet::Type::Short,
+            &frames,
+            &mut buf,
+        )
+        .unwrap();
+
+        let info = RecvInfo {
+            from: "127.0.0.2:1234".parse().unwrap(),
+            ecn: 0,
+        };
+
+        assert_eq!(pipe.server.recv(&mut buf[..len], info), Ok(len));
+
+        assert_eq!(pipe.server.peer_addr(), old_addr);
+        assert!(pipe.server.is_path_validated());
+    }
+
+    #[test]
+    fn nat_rebinding_keeps_recovery_state() {
+        let mut pipe = testing::Pipe::default().unwrap();
+        assert_eq!(pipe.handshake(), Ok(()));
+        assert_eq!(pipe.advance(), Ok(()));
+
+        let rtt = pipe.server.recovery.rtt();
+        let cwnd = pipe.server.recovery.cwnd();
+
+        // Only the port changes.
+        let new_addr: SocketAddr = "127.0.0.1:5678".parse().unwrap();
+
+        assert_eq!(pipe.client.stream_send(4, b"hello", false), Ok(5));
+
+        let flight = testing::emit_flight(&mut pipe.client).unwrap();
+        for (mut pkt, _) in flight {
+            let info = RecvInfo {
+                from: new_addr,
+                ecn: 0,
+            };
+
+            assert_eq!(pipe.server.recv(&mut pkt, info), Ok(pkt.len()));
+        }
+
+        assert_eq!(pipe.server.peer_addr(), new_addr);
+        assert!(!pipe.server.is_path_validated());
+
+        assert_eq!(pipe.server.recovery.rtt(), rtt);
+        assert_eq!(pipe.server.recovery.cwnd(), cwnd);
+
+        assert_eq!(pipe.advance(), Ok(()));
+        assert!(pipe.server.is_path_validated());
+    }
+
+    #[test]
+    fn client_migration() {
+        let mut pipe = testing::Pipe::default().unwrap();
+        assert_eq!(pipe.handshake(), Ok(()));
+        assert_eq!(pipe.advance(), Ok(()));
+
+        // No spare connection ID.
+        assert_eq!(pipe.client.migrate(), Err(Error::OutOfIdentifiers));
+
+        assert_eq!(pipe.server.migrate(), Err(Error::InvalidState));
+
+        let old_scid = pipe.server.source_id().into_owned();
+
+        // Connection IDs must have the length of the original one.
+        assert_eq!(
+            pipe.server.new_scid(&ConnectionId::from_ref(&[0xab; 8]), 1),
+            Err(Error::InvalidState)
+        );
+
+        let new_scid = ConnectionId::from_ref(&[0xab; 16]);
+        assert_eq!(pipe.server.new_scid(&new_scid, 1), Ok(1));
+
+        // The client only accepts one spare connection ID.
+        let scid = ConnectionId::from_ref(&[0xcd; 16]);
+        assert_eq!(pipe.server.new_scid(&scid, 2), Err(Error::IdLimit));
+
+        assert_eq!(pipe.advance(), Ok(()));
+
+        assert_eq!(pipe.client.migrate(), Ok(()));
+        assert_eq!(pipe.client.destination_id(), new_scid);
+        assert!(!pipe.client.is_path_validated());
+
+        assert_eq!(pipe.advance(), Ok(()));
+
+        assert!(pipe.client.is_path_validated());
+
+        // The client retired the connection ID it used before.
+        assert_eq!(pipe.server.retired_scid_next(), Some(old_scid));
+        assert_eq!(pipe.server.retired_scid_next(), None);
+    }
+
+    #[test]
+    fn client_migration_timeout() {
+        let mut pipe = testing::Pipe::default().unwrap();
+        assert_eq!(pipe.handshake(), Ok(()));
+        assert_eq!(pipe.advance(), Ok(()));
+
+        let scid = ConnectionId::from_ref(&[0xab; 16]);
+        assert_eq!(pipe.server.new_scid(&scid, 1), Ok(1));
+        assert_eq!(pipe.advance(), Ok(()));
+
+        assert_eq!(pipe.client.migrate(), Ok(()));
+        assert!(!pipe.client.is_path_validated());
+
+        // The PATH_CHALLENGE never makes it to the server.
+        testing::emit_flight(&mut pipe.client).unwrap();
+
+        let timer = pipe.client.path.validation_timer().unwrap();
+
+        pipe.client.on_timeout_at(timer);
+
+        // The client is back on the path it used before, and can still
+        // validate a new one.
+        assert!(pipe.client.is_path_validated());
+        assert_eq!(pipe.client.path.validation_timer(), None);
+        assert_eq!(pipe.client.migrate(), Err(Error::OutOfIdentifiers));
+
+        assert_eq!(pipe.client.stream_send(4, b"hello", true), Ok(5));
+        assert_eq!(pipe.advance(), Ok(()));
+
+        let mut b = [0; 15];
+        assert_eq!(pipe.server.stream_recv(4, &mut b), Ok((5, true)));
+    }
+
+    #[cfg(feature = "dtp")]
+    #[test]
+    fn multipath_block_scheduling() {
+        let mut buf = [0; 65535];
+
+        let mut config = Config::new(crate::PROTOCOL_VERSION).unwrap();
+        config
+            .load_cert_chain_from_pem_file("examples/cert.crt")
+            .unwrap();
+        config
+            .load_priv_key_from_pem_file("examples/cert.key")
+            .unwrap();
+        config
+            .set_application_protos(b"\x06proto1\x06proto2")
+            .unwrap();
+        config.set_initial_max_data(1_000_000);
+        config.set_initial_max_stream_data_bidi_local(1_000_000);
+        config.set_initial_max_stream_data_bidi_remote(1_000_000);
+        config.set_initial_max_streams_bidi(3);
+        config.verify_peer(false);
+
+        let server_addr = "127.0.0.1:4321".parse().unwrap();
+
+        // One connection per client address, over links with different
+        // delays.
+        let links = [("127.0.0.1:1234", 5), ("127.0.0.2:1234", 25)];
+
+        let start = time::Instant::now();
+        let mut paths = Vec::new();
+
+        for &(client_addr, delay) in links.iter() {
+            let mut scid = [0; 16];
+
+            rand::rand_bytes(&mut scid[..]);
+            let client = connect(
+                Some("quic.tech"),
+                &ConnectionId::from_ref(&scid),
+                server_addr,
+                &mut config,
+            )
+            .unwrap();
+
+            rand::rand_bytes(&mut scid[..]);
+            let server = accept(
+                &ConnectionId::from_ref(&scid),
+                None,
+                client_addr.parse().unwrap(),
+                &mut config,
+            )
+            .unwrap();
+
+            let mut pipe = testing::Pipe { client, server };
 
-        assert_eq!(
-            pipe.server.stream_recv(4, &mut b),
-            Err(Error::StreamReset(42))
-        );
+            let delay = time::Duration::from_millis(delay);
+            let mut up = testing::Link::new(delay);
+            let mut down = testing::Link::new(delay);
 
-        assert!(pipe.server.stream_finished(4));
+            let now = pipe.advance_over(&mut up, &mut down, start).unwrap();
+            assert!(pipe.client.is_established());
 
-        // Sending RESET_STREAM again shouldn't make stream readable again.
-        assert_eq!(pipe.send_pkt_to_server(pkt_type, &frames, &mut buf), Ok(39));
+            paths.push((pipe, up, down, now));
+        }
 
-        let mut r = pipe.server.readable();
-        assert_eq!(r.next(), None);
-    }
+        let info: Vec<PathInfo> = paths
+            .iter()
+            .map(|(pipe, ..)| PathInfo::from(&pipe.client.stats()))
+            .collect();
 
-    #[test]
-    /// Tests that RESET_STREAM frames exceeding the connection-level flow
-    /// control limit cause an error.
-    fn reset_stream_flow_control() {
-        let mut buf = [0; 65535];
+        // The links' delays add up to at least 10ms and 50ms of RTT.
+        assert!(info[0].rtt >= time::Duration::from_millis(10));
+        assert!(info[1].rtt >= time::Duration::from_millis(50));
+        assert!(info[0].rtt < info[1].rtt);
 
-        let mut pipe = testing::Pipe::default().unwrap();
-        assert_eq!(pipe.handshake(), Ok(()));
+        let urgent = Block {
+            size: 1000,
+            priority: 0,
+            deadline: 50,
+        };
 
-        let frames = [
-            frame::Frame::Stream {
-                stream_id: 4,
-                data: stream::RangeBuf::from(b"aaaaaaaaaaaaaaa", 0, false),
-            },
-            frame::Frame::Stream {
-                stream_id: 8,
-                data: stream::RangeBuf::from(b"a", 0, false),
-            },
-            frame::Frame::ResetStream {
-                stream_id: 8,
-                error_code: 0,
-                final_size: 15,
-            },
-            frame::Frame::Stream {
-                stream_id: 12,
-                data: stream::RangeBuf::from(b"a", 0, false),
-            },
-        ];
+        assert_eq!(
+            BlockScheduler::default().schedule(&urgent, &info),
+            Some(Placement::Duplicate(vec![0, 1]))
+        );
 
-        let pkt_type = packet::Type::Short;
         assert_eq!(
-            pipe.send_pkt_to_server(pkt_type, &frames, &mut buf),
-            Err(Error::FlowControl),
+            BlockScheduler::new(false).schedule(&urgent, &info),
+            Some(Placement::Split(vec![(0, 1000)]))
         );
-    }
 
-    #[test]
-    /// Tests that RESET_STREAM frames exceeding the stream-level flow control
-    /// limit cause an error.
-    fn reset_stream_flow_control_stream() {
-        let mut buf = [0; 65535];
+        let bulk = Block {
+            size: 100_000,
+            priority: 5,
+            deadline: 1000,
+        };
 
-        let mut pipe = testing::Pipe::default().unwrap();
-        assert_eq!(pipe.handshake(), Ok(()));
+        let parts = match BlockScheduler::default().schedule(&bulk, &info) {
+            Some(Placement::Split(parts)) => parts,
 
-        let frames = [
-            frame::Frame::Stream {
-                stream_id: 4,
-                data: stream::RangeBuf::from(b"a", 0, false),
-            },
-            frame::Frame::ResetStream {
-                stream_id: 4,
-                error_code: 0,
-                final_size: 16, // Past stream's flow control limit.
-            },
-        ];
+            p => panic!("unexpected placement {:?}", p),
+        };
 
-        let pkt_type = packet::Type::Short;
-        assert_eq!(
-            pipe.send_pkt_to_server(pkt_type, &frames, &mut buf),
-            Err(Error::FlowControl),
-        );
-    }
+        assert_eq!(parts.iter().map(|(_, len)| len).sum::<u64>(), bulk.size);
 
-    #[test]
-    fn path_challenge() {
-        let mut buf = [0; 65535];
+        let data = vec![0xab; bulk.size as usize];
+        let mut off = 0;
 
-        let mut pipe = testing::Pipe::default().unwrap();
-        assert_eq!(pipe.handshake(), Ok(()));
+        for &(i, len) in parts.iter() {
+            let len = len as usize;
 
-        let frames = [frame::Frame::PathChallenge { data: [0xba; 8] }];
+            let block = Arc::new(Block {
+                size: len as u64,
+                ..bulk.clone()
+            });
 
-        let pkt_type = packet::Type::Short;
+            let (pipe, ..) = &mut paths[i];
+            let part = &data[off..off + len];
+            assert_eq!(pipe.client.block_send(0, part, true, block), Ok(len));
 
-        let len = pipe
-            .send_pkt_to_server(pkt_type, &frames, &mut buf)
-            .unwrap();
+            off += len;
+        }
 
-        assert!(len > 0);
+        let mut recv = 0;
 
-        let frames =
-            testing::decode_pkt(&mut pipe.client, &mut buf, len).unwrap();
-        let mut iter = frames.iter();
+        for (pipe, up, down, now) in paths.iter_mut() {
+            assert!(pipe.advance_over(up, down, *now).is_ok());
 
-        // Ignore ACK.
-        iter.next().unwrap();
+            while let Ok((len, _)) = pipe.server.stream_recv(0, &mut buf) {
+                recv += len;
+            }
+        }
 
-        assert_eq!(
-            iter.next(),
-            Some(&frame::Frame::PathResponse { data: [0xba; 8] })
-        );
+        assert_eq!(recv, data.len());
     }
 
     #[test]
@@ -10289,6 +11944,7 @@ mod tests {
         let mut config = Config::new(PROTOCOL_VERSION).unwrap();
 
         assert_eq!(config.set_cc_algorithm_name("reno"), Ok(()));
+        assert_eq!(config.set_cc_algorithm_name("bbr2"), Ok(()));
 
         // Unknown name.
         assert_eq!(
@@ -10834,6 +12490,204 @@ mod tests {
         assert_eq!(pipe.server.recovery.app_limited(), false);
     }
 
+    #[test]
+    fn ecn_validation() {
+        let mut config = Config::new(PROTOCOL_VERSION).unwrap();
+        config
+            .load_cert_chain_from_pem_file("examples/cert.crt")
+            .unwrap();
+        config
+            .load_priv_key_from_pem_file("examples/cert.key")
+            .unwrap();
+        config
+            .set_application_protos(b"\x06proto1\x06proto2")
+            .unwrap();
+        config.set_initial_max_data(30);
+        config.set_initial_max_stream_data_bidi_local(15);
+        config.set_initial_max_stream_data_bidi_remote(15);
+        config.set_initial_max_streams_bidi(3);
+        config.verify_peer(false);
+        config.enable_ecn(true);
+
+        let mut pipe = testing::Pipe::with_config(&mut config).unwrap();
+        assert_eq!(pipe.handshake(), Ok(()));
+
+        // The marks of the handshake packets were reported back.
+        assert!(pipe.client.recovery.ecn.is_capable());
+        assert!(pipe.server.recovery.ecn.is_capable());
+
+        assert_eq!(pipe.client.stream_send(0, b"a", true), Ok(1));
+
+        let flight = testing::emit_flight(&mut pipe.client).unwrap();
+        assert!(flight
+            .iter()
+            .all(|(_, info)| info.ecn == recovery::ecn::ECT0));
+
+        // The path clears the ECN field.
+        let mut pipe = testing::Pipe::with_config(&mut config).unwrap();
+
+        while !pipe.client.is_established() || !pipe.server.is_established() {
+            let mut flight = testing::emit_flight(&mut pipe.client).unwrap();
+            flight.iter_mut().for_each(|(_, info)| info.ecn = 0);
+            testing::process_flight(&mut pipe.server, flight).unwrap();
+
+            let mut flight = testing::emit_flight(&mut pipe.server).unwrap();
+            flight.iter_mut().for_each(|(_, info)| info.ecn = 0);
+            testing::process_flight(&mut pipe.client, flight).unwrap();
+        }
+
+        assert!(pipe.client.recovery.ecn.is_failed());
+        assert!(pipe.server.recovery.ecn.is_failed());
+
+        // Packets are not marked anymore.
+        assert_eq!(pipe.client.stream_send(0, b"a", true), Ok(1));
+
+        let flight = testing::emit_flight(&mut pipe.client).unwrap();
+        assert!(flight.iter().all(|(_, info)| info.ecn == 0));
+    }
+
+    #[test]
+    fn ecn_marking_bottleneck() {
+        for l4s in &[false, true] {
+            let mut config = Config::new(PROTOCOL_VERSION).unwrap();
+            config
+                .load_cert_chain_from_pem_file("examples/cert.crt")
+                .unwrap();
+            config
+                .load_priv_key_from_pem_file("examples/cert.key")
+                .unwrap();
+            config
+                .set_application_protos(b"\x06proto1\x06proto2")
+                .unwrap();
+            config.set_initial_max_data(1_000_000);
+            config.set_initial_max_stream_data_bidi_local(1_000_000);
+            config.set_initial_max_stream_data_bidi_remote(1_000_000);
+            config.set_initial_max_streams_bidi(3);
+            config.verify_peer(false);
+            config.set_cc_algorithm(CongestionControlAlgorithm::Reno);
+            config.enable_ecn(true);
+            config.enable_l4s(*l4s);
+
+            let codepoint = if *l4s {
+                recovery::ecn::ECT1
+            } else {
+                recovery::ecn::ECT0
+            };
+
+            let mut pipe = testing::Pipe::with_config(&mut config).unwrap();
+            assert_eq!(pipe.handshake(), Ok(()));
+
+            // Client fills its congestion window.
+            let cwnd = pipe.client.recovery.cwnd();
+            assert!(pipe.client.stream_send(0, &[0; 100_000], false).is_ok());
+
+            let mut flight = testing::emit_flight(&mut pipe.client).unwrap();
+            assert!(flight.len() > 4);
+
+            // A bottleneck with a shallow marking threshold marks the packets
+            // that find 4 packets queued ahead of them, instead of dropping
+            // them.
+            for (_, info) in flight.iter_mut().skip(4) {
+                assert_eq!(info.ecn, codepoint);
+                info.ecn = recovery::ecn::CE;
+            }
+
+            let marked = flight.len() as u64 - 4;
+
+            testing::process_flight(&mut pipe.server, flight).unwrap();
+
+            assert_eq!(
+                pipe.server.pkt_num_spaces[packet::EPOCH_APPLICATION]
+                    .ecn_counts
+                    .ecn_ce_count,
+                marked
+            );
+
+            // Server acknowledges the flight and reports the marks.
+            let flight = testing::emit_flight(&mut pipe.server).unwrap();
+            testing::process_flight(&mut pipe.client, flight).unwrap();
+
+            // The window is reduced although no packet was lost, by half
+            // like on a loss, or by half the estimated fraction of marked
+            // packets for L4S.
+            let expected = if *l4s {
+                let alpha = pipe.client.recovery.ecn.alpha();
+                (cwnd as f64 * (1.0 - alpha / 2.0)) as usize
+            } else {
+                cwnd / 2
+            };
+
+            assert_eq!(pipe.client.recovery.cwnd(), expected);
+            assert_eq!(pipe.client.stats().lost, 0);
+
+            assert_eq!(pipe.advance(), Ok(()));
+        }
+    }
+
+    #[test]
+    /// Sends a bulk transfer through a bottleneck with a deep buffer. BBR2
+    /// keeps the link busy with a fraction of the queue that Reno, without
+    /// HyStart++, builds until the transfer ends.
+    fn bbr2_bottleneck_queue() {
+        let mut buf = [0; 65535];
+
+        // 1MB/s with 40ms of RTT.
+        let rate = 1_000_000;
+        let delay = time::Duration::from_millis(20);
+
+        let data = vec![0xab; 1_000_000];
+
+        let mut queue_delay = Vec::new();
+
+        for algo in &[
+            CongestionControlAlgorithm::BBR2,
+            CongestionControlAlgorithm::Reno,
+        ] {
+            let mut config = Config::new(PROTOCOL_VERSION).unwrap();
+            config
+                .load_cert_chain_from_pem_file("examples/cert.crt")
+                .unwrap();
+            config
+                .load_priv_key_from_pem_file("examples/cert.key")
+                .unwrap();
+            config
+                .set_application_protos(b"\x06proto1\x06proto2")
+                .unwrap();
+            config.set_initial_max_data(10_000_000);
+            config.set_initial_max_stream_data_bidi_local(10_000_000);
+            config.set_initial_max_stream_data_bidi_remote(10_000_000);
+            config.set_initial_max_streams_bidi(3);
+            config.verify_peer(false);
+            config.set_cc_algorithm(*algo);
+            config.enable_hystart(false);
+
+            let mut pipe = testing::Pipe::with_config(&mut config).unwrap();
+
+            let mut up = testing::Link::with_rate(delay, rate);
+            let mut down = testing::Link::new(delay);
+
+            let now = time::Instant::now();
+            let now = pipe.advance_over(&mut up, &mut down, now).unwrap();
+            assert!(pipe.client.is_established());
+
+            assert_eq!(pipe.client.stream_send(4, &data, true), Ok(data.len()));
+            assert!(pipe.advance_over(&mut up, &mut down, now).is_ok());
+
+            let mut recv = 0;
+
+            while let Ok((len, _)) = pipe.server.stream_recv(4, &mut buf) {
+                recv += len;
+            }
+
+            assert_eq!(recv, data.len());
+            assert_eq!(pipe.client.stats().lost, 0);
+
+            queue_delay.push(up.max_queue_delay);
+        }
+
+        assert!(queue_delay[0] * 2 < queue_delay[1]);
+    }
+
     #[test]
     fn app_limited_not_changed_on_no_new_frames() {
         let mut config = Config::new(PROTOCOL_VERSION).unwrap();
@@ -11592,13 +13446,22 @@ mod tests {
 
         // Client sends Initial packet with ACK.
         #[cfg(not(feature = "diffserv"))]
-        let (ty, len) = pipe.client.send_single(&mut buf, false).unwrap();
+        let (ty, len) = pipe
+            .client
+            .send_single(&mut buf, false, false, time::Instant::now())
+            .unwrap();
         #[cfg(feature = "diffserv")]
         let mut diffserv = 0;
         #[cfg(feature = "diffserv")]
         let (ty, len) = pipe
             .client
-            .send_single(&mut buf, true, &mut diffserv)
+            .send_single(
+                &mut buf,
+                true,
+                false,
+                time::Instant::now(),
+                &mut diffserv,
+            )
             .unwrap();
 
         assert_eq!(ty, Type::Initial);
@@ -11609,13 +13472,22 @@ mod tests {
 
         // Client sends Handshake packet.
         #[cfg(not(feature = "diffserv"))]
-        let (ty, len) = pipe.client.send_single(&mut buf, false).unwrap();
+        let (ty, len) = pipe
+            .client
+            .send_single(&mut buf, false, false, time::Instant::now())
+            .unwrap();
         #[cfg(feature = "diffserv")]
         let mut diffserv = 0;
         #[cfg(feature = "diffserv")]
         let (ty, len) = pipe
             .client
-            .send_single(&mut buf, true, &mut diffserv)
+            .send_single(
+                &mut buf,
+                true,
+                false,
+                time::Instant::now(),
+                &mut diffserv,
+            )
             .unwrap();
 
         assert_eq!(ty, Type::Handshake);
@@ -12200,6 +14072,88 @@ mod tests {
         assert_eq!(pipe.server.recovery.cwnd(), 12000);
     }
 
+    #[test]
+    fn pmtud() {
+        let mut config = Config::new(PROTOCOL_VERSION).unwrap();
+        config
+            .load_cert_chain_from_pem_file("examples/cert.crt")
+            .unwrap();
+        config
+            .load_priv_key_from_pem_file("examples/cert.key")
+            .unwrap();
+        config
+            .set_application_protos(b"\x06proto1\x06proto2")
+            .unwrap();
+        config.set_initial_max_data(100000);
+        config.set_initial_max_stream_data_bidi_local(100000);
+        config.set_initial_max_stream_data_bidi_remote(100000);
+        config.set_initial_max_streams_bidi(3);
+        config.verify_peer(false);
+        config.set_max_send_udp_payload_size(9000);
+        config.discover_pmtu(true);
+
+        let mut pipe = testing::Pipe::with_config(&mut config).unwrap();
+        assert_eq!(pipe.handshake(), Ok(()));
+
+        assert_eq!(pipe.client.stats().pmtu, 1200);
+
+        // Probes are sent once the handshake is confirmed.
+        assert_eq!(pipe.advance(), Ok(()));
+
+        assert_eq!(pipe.client.stats().pmtu, 9000);
+        assert_eq!(pipe.server.stats().pmtu, 9000);
+
+        assert_eq!(pipe.client.stream_send(0, &[0; 20000], true), Ok(20000));
+
+        // Data is sent in larger datagrams.
+        let flight = testing::emit_flight(&mut pipe.client).unwrap();
+        assert!(flight[0].0.len() > 8000);
+        assert!(flight.iter().all(|(pkt, _)| pkt.len() <= 9000));
+    }
+
+    #[test]
+    fn pmtud_search() {
+        let mut config = Config::new(PROTOCOL_VERSION).unwrap();
+        config
+            .load_cert_chain_from_pem_file("examples/cert.crt")
+            .unwrap();
+        config
+            .load_priv_key_from_pem_file("examples/cert.key")
+            .unwrap();
+        config
+            .set_application_protos(b"\x06proto1\x06proto2")
+            .unwrap();
+        config.set_initial_max_data(10_000_000);
+        config.set_initial_max_stream_data_bidi_local(10_000_000);
+        config.set_initial_max_stream_data_bidi_remote(10_000_000);
+        config.set_initial_max_streams_bidi(3);
+        config.verify_peer(false);
+        config.set_max_send_udp_payload_size(9000);
+        config.discover_pmtu(true);
+
+        let mut pipe = testing::Pipe::with_config(&mut config).unwrap();
+        assert_eq!(pipe.handshake(), Ok(()));
+
+        // The path drops datagrams larger than 1500 bytes.
+        for _ in 0..100 {
+            assert!(pipe.client.stream_send(0, &[0; 5000], false).is_ok());
+
+            let mut flight = testing::emit_flight(&mut pipe.client).unwrap();
+            flight.retain(|(pkt, _)| pkt.len() <= 1500);
+            testing::process_flight(&mut pipe.server, flight).unwrap();
+
+            let mut flight = testing::emit_flight(&mut pipe.server).unwrap();
+            flight.retain(|(pkt, _)| pkt.len() <= 1500);
+            testing::process_flight(&mut pipe.client, flight).unwrap();
+        }
+
+        let pmtu = pipe.client.stats().pmtu;
+        assert!(pmtu > 1400 && pmtu <= 1500);
+
+        // Lost probes are not counted as lost packets.
+        assert_eq!(pipe.client.stats().lost, 0);
+    }
+
     #[test]
     /// Tests that connection-level send capacity decreases as more stream data
     /// is buffered.
@@ -12392,6 +14346,8 @@ mod tests {
     }
 }
 
+pub use crate::cidtable::ConnectionIdTable;
+
 pub use crate::packet::ConnectionId;
 pub use crate::packet::Header;
 pub use crate::packet::Type;
@@ -12401,10 +14357,20 @@ pub use crate::packet::Type;
 pub use crate::recovery::CongestionControlAlgorithm;
 
 pub use crate::stream::StreamIter;
+pub use crate::stream::ZeroCopyBuf;
 
 #[cfg(feature = "dtp")]
 pub use crate::stream::Block;
 
+#[cfg(feature = "dtp")]
+pub use crate::multipath::BlockScheduler;
+#[cfg(feature = "dtp")]
+pub use crate::multipath::PathInfo;
+#[cfg(feature = "dtp")]
+pub use crate::multipath::Placement;
+
+mod cid;
+mod cidtable;
 mod crypto;
 mod dgram;
 #[cfg(feature = "ffi")]
@@ -12413,7 +14379,10 @@ mod flowcontrol;
 mod frame;
 pub mod h3;
 mod minmax;
+#[cfg(feature = "dtp")]
+mod multipath;
 mod packet;
+mod path;
 mod rand;
 mod ranges;
 mod recovery;
@@ -0,0 +1,355 @@
+// Copyright (C) 2022, Cloudflare, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//! Scheduling of DTP blocks across several paths.
+//!
+//! [`BlockScheduler`] only decides how a block is placed across a set of
+//! paths, described by their [`PathInfo`]:
+//!
+//! * Urgent blocks are duplicated on every path, so the first copy to arrive
+//!   wins, or with duplication disabled they go on the path that delivers them
+//!   first, which for small blocks is the lowest-RTT one.
+//!
+//! * Other blocks are split so that every part is estimated to complete at the
+//!   same time, using each path's RTT, delivery rate and the data already
+//!   queued on it.
+//!
+//! Multipath QUIC itself is not implemented: a connection still sends on a
+//! single path, with one set of packet number spaces and one recovery, and
+//! there is no PATH_ABANDON frame. Applications that want to aggregate links
+//! today can open one connection per local address, build a [`PathInfo`]
+//! from the [`Stats`] of each and send the parts of a block on them.
+
+use std::cmp;
+
+use std::time::Duration;
+
+use crate::stream::Block;
+use crate::Stats;
+
+/// Blocks with a deadline up to this many milliseconds are urgent.
+///
+/// This is the top class of the DiffServ mapping of blocks.
+const URGENT_DEADLINE: u64 = 100;
+
+/// The state of a path used to place blocks.
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct PathInfo {
+    /// The estimated round-trip time of the path.
+    pub rtt: Duration,
+
+    /// The estimated delivery rate of the path in bytes per second.
+    pub delivery_rate: u64,
+
+    /// The congestion window of the path in bytes.
+    pub cwnd: usize,
+
+    /// The bytes already queued on the path and not yet sent.
+    pub queued: u64,
+}
+
+impl PathInfo {
+    /// Returns the rate used to estimate completion times, in bytes per
+    /// second.
+    ///
+    /// Before the first rate sample, one congestion window per RTT is
+    /// assumed.
+    fn rate(&self) -> f64 {
+        if self.delivery_rate > 0 {
+            return self.delivery_rate as f64;
+        }
+
+        let rtt = self.rtt.max(Duration::from_millis(1));
+
+        self.cwnd.max(1) as f64 / rtt.as_secs_f64()
+    }
+
+    fn one_way_delay(&self) -> Duration {
+        (self.rtt / 2).max(Duration::from_millis(1))
+    }
+
+    /// Returns when, in seconds, the data already queued on the path and
+    /// `len` more bytes will be delivered.
+    fn completion_time(&self, len: u64) -> f64 {
+        self.one_way_delay().as_secs_f64() +
+            (self.queued + len) as f64 / self.rate()
+    }
+}
+
+impl From<&Stats> for PathInfo {
+    fn from(stats: &Stats) -> Self {
+        PathInfo {
+            rtt: stats.rtt,
+            delivery_rate: stats.delivery_rate,
+            cwnd: stats.cwnd,
+            queued: 0,
+        }
+    }
+}
+
+/// Where the data of a block is sent.
+#[derive(Clone, Debug, PartialEq, Eq)]
+pub enum Placement {
+    /// The whole block is sent on each of the paths.
+    Duplicate(Vec<usize>),
+
+    /// The block is cut in consecutive parts, each sent on a path along with
+    /// its length.
+    Split(Vec<(usize, u64)>),
+}
+
+/// Places DTP blocks on paths.
+///
+/// Paths are referred to by their index in the slice passed to
+/// [`schedule()`].
+///
+/// [`schedule()`]: struct.BlockScheduler.html#method.schedule
+#[derive(Clone, Copy, Debug)]
+pub struct BlockScheduler {
+    duplicate_urgent: bool,
+}
+
+impl Default for BlockScheduler {
+    fn default() -> Self {
+        BlockScheduler::new(true)
+    }
+}
+
+impl BlockScheduler {
+    /// Creates a scheduler that duplicates urgent blocks on all paths if
+    /// `duplicate_urgent` is set.
+    pub fn new(duplicate_urgent: bool) -> Self {
+        BlockScheduler { duplicate_urgent }
+    }
+
+    /// Returns true if the block is urgent, i.e. it has the highest priority
+    /// or a deadline of at most 100 milliseconds.
+    pub fn is_urgent(block: &Block) -> bool {
+        block.priority == 0 || block.deadline <= URGENT_DEADLINE
+    }
+
+    /// Returns where to send `block`, or `None` if there is no path.
+    pub fn schedule(
+        &self, block: &Block, paths: &[PathInfo],
+    ) -> Option<Placement> {
+        if paths.is_empty() {
+            return None;
+        }
+
+        if BlockScheduler::is_urgent(block) {
+            if self.duplicate_urgent && paths.len() > 1 {
+                return Some(Placement::Duplicate((0..paths.len()).collect()));
+            }
+
+            let fastest = (0..paths.len()).min_by(|&a, &b| {
+                let a = paths[a].completion_time(block.size);
+                let b = paths[b].completion_time(block.size);
+
+                a.partial_cmp(&b).unwrap_or(cmp::Ordering::Equal)
+            })?;
+
+            return Some(Placement::Split(vec![(fastest, block.size)]));
+        }
+
+        Some(Placement::Split(split(block.size, paths)))
+    }
+}
+
+/// Splits `size` bytes over the paths so that all parts are estimated to
+/// complete at the same time.
+///
+/// With `T` that time, path `i` gets `(T - base_i) * rate_i` bytes, where
+/// `base_i` is when the data already queued on it is delivered. Paths whose
+/// `base_i` is after `T` get nothing.
+fn split(size: u64, paths: &[PathInfo]) -> Vec<(usize, u64)> {
+    let mut order: Vec<usize> = (0..paths.len()).collect();
+    order.sort_by(|&a, &b| {
+        let a = paths[a].completion_time(0);
+        let b = paths[b].completion_time(0);
+
+        a.partial_cmp(&b).unwrap_or(cmp::Ordering::Equal)
+    });
+
+    // Add paths from the earliest available one, as long as the next one
+    // is available before the block would complete on the previous ones.
+    let mut used = 0;
+    let mut rate_sum = 0.0;
+    let mut weighted_base = 0.0;
+    let mut finish = 0.0;
+
+    for &i in &order {
+        let base = paths[i].completion_time(0);
+
+        if used > 0 && base >= finish {
+            break;
+        }
+
+        rate_sum += paths[i].rate();
+        weighted_base += base * paths[i].rate();
+        finish = (size as f64 + weighted_base) / rate_sum;
+        used += 1;
+    }
+
+    let mut parts = Vec::with_capacity(used);
+    let mut left = size;
+
+    for (n, &i) in order[..used].iter().enumerate() {
+        let len = if n == used - 1 {
+            left
+        } else {
+            let base = paths[i].completion_time(0);
+            let len = ((finish - base) * paths[i].rate()).round() as u64;
+
+            len.min(left)
+        };
+
+        if len > 0 {
+            parts.push((i, len));
+        }
+
+        left -= len;
+    }
+
+    parts
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn block(size: u64, priority: u64, deadline: u64) -> Block {
+        Block {
+            size,
+            priority,
+            deadline,
+        }
+    }
+
+    fn path(rtt_ms: u64, delivery_rate: u64, queued: u64) -> PathInfo {
+        PathInfo {
+            rtt: Duration::from_millis(rtt_ms),
+            delivery_rate,
+            cwnd: 12_000,
+            queued,
+        }
+    }
+
+    #[test]
+    fn urgent() {
+        let paths = [path(50, 1_000_000, 0), path(10, 1_000_000, 0)];
+
+        let b = block(1000, 0, 1000);
+        assert!(BlockScheduler::is_urgent(&b));
+        assert!(BlockScheduler::is_urgent(&block(1000, 5, 100)));
+        assert!(!BlockScheduler::is_urgent(&block(1000, 5, 200)));
+
+        assert_eq!(
+            BlockScheduler::new(true).schedule(&b, &paths),
+            Some(Placement::Duplicate(vec![0, 1]))
+        );
+
+        // The lowest-RTT path.
+        assert_eq!(
+            BlockScheduler::new(false).schedule(&b, &paths),
+            Some(Placement::Split(vec![(1, 1000)]))
+        );
+
+        // Unless it has a long queue.
+        let paths = [path(50, 1_000_000, 0), path(10, 1_000_000, 100_000)];
+
+        assert_eq!(
+            BlockScheduler::new(false).schedule(&b, &paths),
+            Some(Placement::Split(vec![(0, 1000)]))
+        );
+
+        // A single path.
+        assert_eq!(
+            BlockScheduler::new(true).schedule(&b, &paths[..1]),
+            Some(Placement::Split(vec![(0, 1000)]))
+        );
+
+        assert_eq!(BlockScheduler::new(true).schedule(&b, &[]), None);
+    }
+
+    #[test]
+    fn split_by_completion_time() {
+        let s = BlockScheduler::default();
+
+        // Same delay, the second path is three times as fast.
+        let paths = [path(20, 1_000_000, 0), path(20, 3_000_000, 0)];
+
+        assert_eq!(
+            s.schedule(&block(400_000, 5, 1000), &paths),
+            Some(Placement::Split(vec![(0, 100_000), (1, 300_000)]))
+        );
+
+        // Same rate, the first path is 20ms further: it gets 20ms worth of
+        // data less.
+        let paths = [path(60, 1_000_000, 0), path(20, 1_000_000, 0)];
+
+        match s.schedule(&block(100_000, 5, 1000), &paths) {
+            Some(Placement::Split(parts)) => {
+                assert_eq!(parts.len(), 2);
+                assert_eq!(parts[0].0, 1);
+                assert_eq!(parts[1].0, 0);
+
+                assert_eq!(parts[0].1 + parts[1].1, 100_000);
+                assert!((parts[0].1 as i64 - 60_000).abs() <= 1);
+            },
+
+            p => panic!("unexpected placement {:?}", p),
+        }
+
+        // A small block doesn't wait for the slower path.
+        assert_eq!(
+            s.schedule(&block(5_000, 5, 1000), &paths),
+            Some(Placement::Split(vec![(1, 5_000)]))
+        );
+
+        // Queued data delays a path.
+        let paths = [path(20, 1_000_000, 60_000), path(20, 1_000_000, 0)];
+
+        assert_eq!(
+            s.schedule(&block(50_000, 5, 1000), &paths),
+            Some(Placement::Split(vec![(1, 50_000)]))
+        );
+    }
+
+    #[test]
+    fn no_rate_sample() {
+        let s = BlockScheduler::default();
+
+        // One congestion window per RTT.
+        let paths = [path(100, 0, 0), path(100, 0, 0)];
+
+        assert_eq!(paths[0].rate() as u64, 120_000);
+
+        assert_eq!(
+            s.schedule(&block(20_000, 5, 1000), &paths),
+            Some(Placement::Split(vec![(0, 10_000), (1, 10_000)]))
+        );
+    }
+}
@@ -32,6 +32,7 @@ use crate::Error;
 use crate::Result;
 
 use crate::crypto;
+use crate::frame;
 use crate::rand;
 use crate::ranges;
 use crate::stream;
@@ -925,6 +926,8 @@ pub struct PktNumSpace {
 
     pub ack_elicited: bool,
 
+    pub ecn_counts: frame::EcnCounts,
+
     pub crypto_open: Option<crypto::Open>,
     pub crypto_seal: Option<crypto::Seal>,
 
@@ -949,6 +952,8 @@ impl PktNumSpace {
 
             ack_elicited: false,
 
+            ecn_counts: frame::EcnCounts::default(),
+
             crypto_open: None,
             crypto_seal: None,
 
@@ -0,0 +1,305 @@
+// Copyright (C) 2022, Cloudflare, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//! Path validation ([RFC 9000 §8.2]).
+//!
+//! When the peer shows up at a new address, the new path is only trusted
+//! once the peer echoed the data of a PATH_CHALLENGE frame sent on it. Until
+//! then at most three times the bytes received on the path can be sent on
+//! it, so that a spoofed address can't be used to amplify an attack.
+//!
+//! [RFC 9000 §8.2]: https://www.rfc-editor.org/rfc/rfc9000.html#section-8.2
+
+use std::net::SocketAddr;
+
+use std::time::Instant;
+
+use crate::MAX_AMPLIFICATION_FACTOR;
+
+/// The maximum number of PATH_CHALLENGE frames sent on a path that can wait
+/// for a response.
+const MAX_CHALLENGES: usize = 8;
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum PathState {
+    /// A PATH_CHALLENGE was sent on the path but no response came back yet.
+    Validating,
+
+    /// The peer is known to receive the packets sent on the path.
+    Validated,
+
+    /// No response came back before the validation timer expired.
+    Failed,
+}
+
+pub struct Path {
+    peer_addr: SocketAddr,
+
+    state: PathState,
+
+    /// Data of the PATH_CHALLENGE frames sent on the path that weren't
+    /// responded to.
+    challenges: Vec<[u8; 8]>,
+
+    /// Whether a new PATH_CHALLENGE frame needs to be sent.
+    challenge_pending: bool,
+
+    /// When validation fails if no response came back.
+    validation_timer: Option<Instant>,
+
+    /// Bytes received on the path, for the anti-amplification limit.
+    recv_bytes: usize,
+
+    /// Bytes sent on the path, for the anti-amplification limit.
+    sent_bytes: usize,
+}
+
+impl Path {
+    /// Creates a path to `peer_addr`, which was already validated (e.g. by
+    /// the handshake) if `validated` is set.
+    pub fn new(peer_addr: SocketAddr, validated: bool) -> Self {
+        Path {
+            peer_addr,
+
+            state: if validated {
+                PathState::Validated
+            } else {
+                PathState::Validating
+            },
+
+            challenges: Vec::new(),
+
+            challenge_pending: false,
+
+            validation_timer: None,
+
+            recv_bytes: 0,
+
+            sent_bytes: 0,
+        }
+    }
+
+    pub fn peer_addr(&self) -> SocketAddr {
+        self.peer_addr
+    }
+
+    pub fn is_validated(&self) -> bool {
+        self.state == PathState::Validated
+    }
+
+    pub fn on_recv(&mut self, len: usize) {
+        self.recv_bytes = self.recv_bytes.saturating_add(len);
+    }
+
+    pub fn on_sent(&mut self, len: usize) {
+        self.sent_bytes = self.sent_bytes.saturating_add(len);
+    }
+
+    /// Returns how many bytes can be sent on the path before more are
+    /// received on it.
+    pub fn max_send_bytes(&self) -> usize {
+        if self.is_validated() {
+            return usize::MAX;
+        }
+
+        self.recv_bytes
+            .saturating_mul(MAX_AMPLIFICATION_FACTOR)
+            .saturating_sub(self.sent_bytes)
+    }
+
+    /// Starts validating the path, which fails at `deadline` unless the peer
+    /// responds before.
+    pub fn request_validation(&mut self, deadline: Instant) {
+        self.state = PathState::Validating;
+        self.challenge_pending = true;
+        self.validation_timer = Some(deadline);
+    }
+
+    pub fn should_send_challenge(&self) -> bool {
+        self.challenge_pending && self.state == PathState::Validating
+    }
+
+    pub fn on_challenge_sent(&mut self, data: [u8; 8]) {
+        if self.challenges.len() == MAX_CHALLENGES {
+            self.challenges.remove(0);
+        }
+
+        self.challenges.push(data);
+        self.challenge_pending = false;
+    }
+
+    /// Sends a new challenge if the one lost is still waiting for a
+    /// response.
+    ///
+    /// The data of the lost challenge is still accepted in a response, in
+    /// case it was only delayed.
+    pub fn on_challenge_lost(&mut self, data: [u8; 8]) {
+        if self.state == PathState::Validating && self.challenges.contains(&data)
+        {
+            self.challenge_pending = true;
+        }
+    }
+
+    /// Returns true if `data` is the data of a challenge sent on the path,
+    /// which is then validated.
+    pub fn on_response(&mut self, data: [u8; 8]) -> bool {
+        if self.state != PathState::Validating || !self.challenges.contains(&data)
+        {
+            return false;
+        }
+
+        self.state = PathState::Validated;
+        self.challenges.clear();
+        self.challenge_pending = false;
+        self.validation_timer = None;
+
+        true
+    }
+
+    pub fn validation_timer(&self) -> Option<Instant> {
+        self.validation_timer
+    }
+
+    /// Returns true if validation just failed.
+    pub fn on_validation_timeout(&mut self, now: Instant) -> bool {
+        match self.validation_timer {
+            Some(timer) if timer <= now => (),
+
+            _ => return false,
+        }
+
+        self.state = PathState::Failed;
+        self.challenge_pending = false;
+        self.validation_timer = None;
+
+        true
+    }
+}
+
+impl std::fmt::Debug for Path {
+    fn fmt(&self, f: &mut std::fmt::Formatter) -> std::fmt::Result {
+        write!(f, "peer_addr={} ", self.peer_addr)?;
+        write!(f, "state={:?} ", self.state)?;
+        write!(f, "recv_bytes={} ", self.recv_bytes)?;
+        write!(f, "sent_bytes={}", self.sent_bytes)?;
+
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use std::time::Duration;
+
+    fn addr() -> SocketAddr {
+        "127.0.0.1:1234".parse().unwrap()
+    }
+
+    #[test]
+    fn amplification_limit() {
+        let mut p = Path::new(addr(), false);
+        assert_eq!(p.max_send_bytes(), 0);
+
+        p.on_recv(100);
+        assert_eq!(p.max_send_bytes(), 300);
+
+        p.on_sent(250);
+        assert_eq!(p.max_send_bytes(), 50);
+
+        p.on_sent(100);
+        assert_eq!(p.max_send_bytes(), 0);
+
+        p.on_recv(100);
+        assert_eq!(p.max_send_bytes(), 250);
+
+        let now = Instant::now();
+
+        p.request_validation(now + Duration::from_secs(1));
+        p.on_challenge_sent([1; 8]);
+        assert!(p.on_response([1; 8]));
+
+        assert_eq!(p.max_send_bytes(), usize::MAX);
+
+        assert_eq!(Path::new(addr(), true).max_send_bytes(), usize::MAX);
+    }
+
+    #[test]
+    fn validation() {
+        let now = Instant::now();
+
+        let mut p = Path::new(addr(), false);
+        assert!(!p.should_send_challenge());
+
+        p.request_validation(now + Duration::from_secs(1));
+        assert_eq!(p.state, PathState::Validating);
+        assert!(p.should_send_challenge());
+
+        p.on_challenge_sent([1; 8]);
+        assert!(!p.should_send_challenge());
+
+        // Unknown data.
+        assert!(!p.on_response([2; 8]));
+        assert_eq!(p.state, PathState::Validating);
+
+        // The first challenge is lost, a new one is sent.
+        p.on_challenge_lost([1; 8]);
+        assert!(p.should_send_challenge());
+
+        p.on_challenge_sent([2; 8]);
+
+        // The response to the challenge thought lost still counts.
+        assert!(p.on_response([1; 8]));
+        assert!(p.is_validated());
+        assert_eq!(p.validation_timer(), None);
+
+        // Late responses and losses are ignored.
+        assert!(!p.on_response([2; 8]));
+        p.on_challenge_lost([2; 8]);
+        assert!(!p.should_send_challenge());
+    }
+
+    #[test]
+    fn validation_timeout() {
+        let now = Instant::now();
+
+        let mut p = Path::new(addr(), false);
+
+        p.request_validation(now + Duration::from_secs(1));
+        p.on_challenge_sent([1; 8]);
+
+        assert!(!p.on_validation_timeout(now));
+        assert_eq!(p.state, PathState::Validating);
+
+        assert!(p.on_validation_timeout(now + Duration::from_secs(1)));
+        assert_eq!(p.state, PathState::Failed);
+        assert_eq!(p.validation_timer(), None);
+
+        assert!(!p.on_response([1; 8]));
+        assert!(!p.on_validation_timeout(now + Duration::from_secs(2)));
+    }
+}
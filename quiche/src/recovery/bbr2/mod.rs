@@ -0,0 +1,921 @@
+// Copyright (C) 2022, Cloudflare, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//! BBR v2 Congestion Control
+//!
+//! This implementation is based on the following draft:
+//! <https://tools.ietf.org/html/draft-cardwell-iccrg-bbr-congestion-control-02>
+//!
+//! On top of the draft, the pacing gain can be scaled by the urgency of the
+//! DTP block at the head of the send queue, see `pacing::bbr2_dtp_gain()`.
+
+use std::time::Duration;
+use std::time::Instant;
+
+use crate::packet;
+
+use crate::recovery::Acked;
+use crate::recovery::CongestionControlOps;
+use crate::recovery::Recovery;
+use crate::recovery::Sent;
+
+pub static BBR2: CongestionControlOps = CongestionControlOps {
+    on_init,
+    on_packet_sent,
+    on_packets_acked,
+    on_packets_lost,
+    congestion_event,
+    ecn_congestion_event,
+    collapse_cwnd,
+    checkpoint,
+    rollback,
+    has_custom_pacing,
+    debug_fmt,
+};
+
+/// BBR2 Constants.
+///
+/// These are the values recommended in the draft unless noted otherwise.
+
+/// Pace at 1% below the estimated bandwidth to drain the bottleneck queue.
+const PACING_MARGIN_PERCENT: f64 = 0.01;
+
+/// 4 * ln(2), the gain that doubles the sending rate every round.
+const STARTUP_PACING_GAIN: f64 = 2.77;
+
+const STARTUP_CWND_GAIN: f64 = 2.0;
+
+const DRAIN_PACING_GAIN: f64 = 0.35;
+
+const DEFAULT_CWND_GAIN: f64 = 2.0;
+
+const PROBE_BW_DOWN_PACING_GAIN: f64 = 0.9;
+
+const PROBE_BW_UP_PACING_GAIN: f64 = 1.25;
+
+const PROBE_BW_UP_CWND_GAIN: f64 = 2.25;
+
+const PROBE_RTT_CWND_GAIN: f64 = 0.5;
+
+/// The maximum tolerated loss rate per round trip.
+const LOSS_THRESH: f64 = 0.02;
+
+/// The multiplicative decrease of the lower bounds on loss.
+const BETA: f64 = 0.7;
+
+/// The share of inflight_hi left unused to leave room for other flows.
+const HEADROOM: f64 = 0.15;
+
+const MIN_PIPE_CWND_PKTS: usize = 4;
+
+const MIN_RTT_FILTER_LEN: Duration = Duration::from_secs(10);
+
+const PROBE_RTT_INTERVAL: Duration = Duration::from_secs(5);
+
+const PROBE_RTT_DURATION: Duration = Duration::from_millis(200);
+
+/// The extra_acked filter covers 10 rounds, kept in two windows.
+const EXTRA_ACKED_WIN_ROUNDS: u64 = 5;
+
+/// Startup exits when the bandwidth grows by less than 25% for 3 rounds.
+const FULL_BW_THRESH: f64 = 1.25;
+
+const FULL_BW_COUNT: usize = 3;
+
+/// Startup exits when this many packets are lost in a round with a loss rate
+/// above LOSS_THRESH.
+const FULL_LOSS_COUNT: usize = 6;
+
+/// ProbeBW waits between 2 and 3 seconds before probing again.
+const PROBE_BW_MIN_WAIT: Duration = Duration::from_secs(2);
+
+const PROBE_BW_WAIT_RANGE_MS: u64 = 1000;
+
+const MAX_PROBE_UP_ROUNDS: u32 = 30;
+
+/// Probe at least as often as Reno would grow cwnd by one BDP.
+const RENO_MAX_PROBE_ROUNDS: usize = 63;
+
+/// 1.2 Mbps in bytes per second.
+const SEND_QUANTUM_THRESHOLD_PACING_RATE: u64 = 1_200_000 / 8;
+
+const MAX_SEND_QUANTUM: usize = 64 * 1024;
+
+/// The pacing gain is raised by up to 25% for urgent DTP blocks (not part of
+/// the draft).
+const DTP_URGENCY_GAIN: f64 = 0.25;
+
+#[derive(Debug, PartialEq, Eq, Copy, Clone)]
+enum BBR2StateMachine {
+    Startup,
+    Drain,
+    ProbeBWDown,
+    ProbeBWCruise,
+    ProbeBWRefill,
+    ProbeBWUp,
+    ProbeRTT,
+}
+
+#[derive(Debug, PartialEq, Eq, Copy, Clone)]
+enum BBR2AckPhase {
+    Init,
+    ProbeFeedback,
+    ProbeStarting,
+    ProbeStopping,
+    Refilling,
+}
+
+/// The rate sample of the current ACK, as used by BBR2.
+#[derive(Debug, Default)]
+struct RateSample {
+    delivery_rate: u64,
+
+    delivered: usize,
+
+    prior_delivered: usize,
+
+    // Bytes in flight and bytes lost since the newest acked (or the lost)
+    // packet was sent.
+    tx_in_flight: usize,
+
+    lost: usize,
+
+    is_app_limited: bool,
+
+    rtt: Duration,
+
+    newly_acked_bytes: usize,
+
+    newly_lost_bytes: usize,
+}
+
+/// BBR2 State Variables.
+pub struct State {
+    state: BBR2StateMachine,
+
+    pacing_gain: f64,
+
+    cwnd_gain: f64,
+
+    // Path model.
+    bw: u64,
+
+    max_bw: u64,
+
+    // Max filter of the delivery rate over the last two ProbeBW cycles.
+    max_bw_filter: [u64; 2],
+
+    cycle_count: u64,
+
+    bw_lo: u64,
+
+    bw_latest: u64,
+
+    min_rtt: Duration,
+
+    min_rtt_stamp: Instant,
+
+    probe_rtt_min_delay: Duration,
+
+    probe_rtt_min_stamp: Instant,
+
+    probe_rtt_expired: bool,
+
+    extra_acked: usize,
+
+    extra_acked_filter: [usize; 2],
+
+    extra_acked_win_rounds: u64,
+
+    extra_acked_win_idx: usize,
+
+    extra_acked_interval_start: Instant,
+
+    extra_acked_delivered: usize,
+
+    inflight_hi: usize,
+
+    inflight_lo: usize,
+
+    inflight_latest: usize,
+
+    // Round counting.
+    next_round_delivered: usize,
+
+    round_start: bool,
+
+    round_count: u64,
+
+    // Startup.
+    filled_pipe: bool,
+
+    full_bw: u64,
+
+    full_bw_count: usize,
+
+    // Congestion signals.
+    loss_round_start: bool,
+
+    loss_round_delivered: usize,
+
+    loss_in_round: bool,
+
+    loss_events_in_round: usize,
+
+    // ProbeBW.
+    ack_phase: BBR2AckPhase,
+
+    bw_probe_samples: bool,
+
+    bw_probe_up_rounds: u32,
+
+    bw_probe_up_acks: usize,
+
+    probe_up_cnt: usize,
+
+    bw_probe_wait: Duration,
+
+    rounds_since_bw_probe: usize,
+
+    cycle_stamp: Instant,
+
+    // ProbeRTT.
+    probe_rtt_done_stamp: Option<Instant>,
+
+    probe_rtt_round_done: bool,
+
+    prior_cwnd: usize,
+
+    idle_restart: bool,
+
+    // Loss recovery.
+    in_recovery: bool,
+
+    packet_conservation: bool,
+
+    rs: RateSample,
+
+    // Urgency of the most urgent queued DTP block, 0.0 when not in use.
+    dtp_urgency: f64,
+}
+
+impl State {
+    pub fn new() -> Self {
+        let now = Instant::now();
+
+        State {
+            state: BBR2StateMachine::Startup,
+
+            pacing_gain: STARTUP_PACING_GAIN,
+
+            cwnd_gain: STARTUP_CWND_GAIN,
+
+            bw: 0,
+
+            max_bw: 0,
+
+            max_bw_filter: [0; 2],
+
+            cycle_count: 0,
+
+            bw_lo: u64::MAX,
+
+            bw_latest: 0,
+
+            min_rtt: Duration::MAX,
+
+            min_rtt_stamp: now,
+
+            probe_rtt_min_delay: Duration::MAX,
+
+            probe_rtt_min_stamp: now,
+
+            probe_rtt_expired: false,
+
+            extra_acked: 0,
+
+            extra_acked_filter: [0; 2],
+
+            extra_acked_win_rounds: 0,
+
+            extra_acked_win_idx: 0,
+
+            extra_acked_interval_start: now,
+
+            extra_acked_delivered: 0,
+
+            inflight_hi: usize::MAX,
+
+            inflight_lo: usize::MAX,
+
+            inflight_latest: 0,
+
+            next_round_delivered: 0,
+
+            round_start: false,
+
+            round_count: 0,
+
+            filled_pipe: false,
+
+            full_bw: 0,
+
+            full_bw_count: 0,
+
+            loss_round_start: false,
+
+            loss_round_delivered: 0,
+
+            loss_in_round: false,
+
+            loss_events_in_round: 0,
+
+            ack_phase: BBR2AckPhase::Init,
+
+            bw_probe_samples: false,
+
+            bw_probe_up_rounds: 0,
+
+            bw_probe_up_acks: 0,
+
+            probe_up_cnt: usize::MAX,
+
+            bw_probe_wait: Duration::ZERO,
+
+            rounds_since_bw_probe: 0,
+
+            cycle_stamp: now,
+
+            probe_rtt_done_stamp: None,
+
+            probe_rtt_round_done: false,
+
+            prior_cwnd: 0,
+
+            idle_restart: false,
+
+            in_recovery: false,
+
+            packet_conservation: false,
+
+            rs: RateSample::default(),
+
+            dtp_urgency: 0.0,
+        }
+    }
+
+    #[cfg(feature = "dtp")]
+    pub fn set_dtp_urgency(&mut self, urgency: f64) {
+        self.dtp_urgency = urgency.max(0.0).min(1.0);
+    }
+}
+
+fn on_init(r: &mut Recovery) {
+    init::bbr2_init(r);
+}
+
+fn on_packet_sent(r: &mut Recovery, sent_bytes: usize, now: Instant) {
+    per_transmit::bbr2_on_transmit(r, now);
+
+    r.bytes_in_flight += sent_bytes;
+}
+
+fn on_packets_acked(
+    r: &mut Recovery, packets: &[Acked], _epoch: packet::Epoch, now: Instant,
+) {
+    let mut recovery_done = false;
+
+    r.bbr2_state.rs.newly_acked_bytes = 0;
+
+    for pkt in packets {
+        r.bytes_in_flight = r.bytes_in_flight.saturating_sub(pkt.size);
+
+        r.bbr2_state.rs.newly_acked_bytes += pkt.size;
+
+        // An ACK for a packet sent after the loss ends the recovery.
+        if r.bbr2_state.in_recovery && !r.in_congestion_recovery(pkt.time_sent) {
+            recovery_done = true;
+        }
+    }
+
+    per_ack::bbr2_update_rate_sample(r);
+
+    if recovery_done {
+        per_loss::bbr2_exit_recovery(r);
+    }
+
+    per_ack::bbr2_update_model_and_state(r, now);
+
+    // Packet conservation only lasts for the first round of the recovery.
+    if r.bbr2_state.packet_conservation && r.bbr2_state.round_start {
+        r.bbr2_state.packet_conservation = false;
+    }
+
+    per_ack::bbr2_update_control_parameters(r, now);
+
+    r.bbr2_state.rs.newly_lost_bytes = 0;
+}
+
+fn on_packets_lost(
+    r: &mut Recovery, lost_bytes: usize, largest_lost_pkt: &Sent, now: Instant,
+) {
+    per_loss::bbr2_update_on_loss(r, lost_bytes, largest_lost_pkt, now);
+}
+
+fn congestion_event(
+    r: &mut Recovery, _lost_bytes: usize, time_sent: Instant,
+    _epoch: packet::Epoch, now: Instant,
+) {
+    // Start a new recovery if the packet was sent after the start of the
+    // previous one.
+    if !r.in_congestion_recovery(time_sent) {
+        r.congestion_recovery_start_time = Some(now);
+
+        per_loss::bbr2_enter_recovery(r);
+    }
+}
+
+fn ecn_congestion_event(
+    r: &mut Recovery, _alpha: Option<f64>, time_sent: Instant,
+    epoch: packet::Epoch, now: Instant,
+) {
+    // BBRv2 doesn't use the extent of the marks yet, enter recovery like on
+    // a loss.
+    congestion_event(r, 0, time_sent, epoch, now);
+}
+
+fn collapse_cwnd(r: &mut Recovery) {
+    r.bbr2_state.prior_cwnd = per_ack::bbr2_save_cwnd(r);
+
+    r.congestion_window = r.max_datagram_size * MIN_PIPE_CWND_PKTS;
+}
+
+fn checkpoint(_r: &mut Recovery) {}
+
+fn rollback(r: &mut Recovery) -> bool {
+    // The loss was spurious, undo the recovery.
+    if r.bbr2_state.in_recovery {
+        per_loss::bbr2_exit_recovery(r);
+
+        r.congestion_recovery_start_time = None;
+    }
+
+    true
+}
+
+fn has_custom_pacing() -> bool {
+    true
+}
+
+fn debug_fmt(r: &Recovery, f: &mut std::fmt::Formatter) -> std::fmt::Result {
+    let s = &r.bbr2_state;
+
+    write!(f, "bbr2={{ ")?;
+    write!(f, "state={:?} ", s.state)?;
+    write!(f, "in_recovery={} ", s.in_recovery)?;
+    write!(f, "pacing_gain={} ", s.pacing_gain)?;
+    write!(f, "cwnd_gain={} ", s.cwnd_gain)?;
+    write!(f, "bw={} ", s.bw)?;
+    write!(f, "max_bw={} ", s.max_bw)?;
+    write!(f, "bw_lo={} ", s.bw_lo)?;
+    write!(f, "min_rtt={:?} ", s.min_rtt)?;
+    write!(f, "inflight_hi={} ", s.inflight_hi)?;
+    write!(f, "inflight_lo={} ", s.inflight_lo)?;
+    write!(f, "extra_acked={} ", s.extra_acked)?;
+    write!(f, "filled_pipe={} ", s.filled_pipe)?;
+    write!(f, "round_count={} ", s.round_count)?;
+    write!(f, "ack_phase={:?} ", s.ack_phase)?;
+    write!(f, "dtp_urgency={} ", s.dtp_urgency)?;
+    write!(f, "}}")
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use std::collections::VecDeque;
+
+    use crate::ranges;
+    use crate::recovery;
+    use crate::recovery::HandshakeStatus;
+
+    // A single bottleneck link with a drop-tail buffer. Packets leave the
+    // buffer at `rate` and their ACK reaches the sender one `rtt` later.
+    struct Bottleneck {
+        rate: u64,
+
+        rtt: Duration,
+
+        buffer: usize,
+
+        last_departure: Option<Instant>,
+
+        // Departure times of the packets in the buffer.
+        queue: VecDeque<Instant>,
+
+        acks: VecDeque<(u64, Instant)>,
+
+        dropped: usize,
+    }
+
+    impl Bottleneck {
+        fn new(rate: u64, rtt: Duration, buffer: usize) -> Self {
+            Bottleneck {
+                rate,
+                rtt,
+                buffer,
+                last_departure: None,
+                queue: VecDeque::new(),
+                acks: VecDeque::new(),
+                dropped: 0,
+            }
+        }
+
+        fn bdp(&self) -> usize {
+            (self.rate as f64 * self.rtt.as_secs_f64()) as usize
+        }
+
+        fn enqueue(&mut self, pkt_num: u64, size: usize, at: Instant) {
+            while let Some(&t) = self.queue.front() {
+                if t > at {
+                    break;
+                }
+
+                self.queue.pop_front();
+            }
+
+            if (self.queue.len() + 1) * size > self.buffer {
+                self.dropped += 1;
+                return;
+            }
+
+            let start = match self.last_departure {
+                Some(t) if t > at => t,
+
+                _ => at,
+            };
+
+            let departure =
+                start + Duration::from_secs_f64(size as f64 / self.rate as f64);
+
+            self.last_departure = Some(departure);
+            self.queue.push_back(departure);
+            self.acks.push_back((pkt_num, departure + self.rtt));
+        }
+    }
+
+    #[derive(Default)]
+    struct Stats {
+        acked: usize,
+
+        // RTT samples of the second half of the run.
+        rtt_sum: Duration,
+
+        rtt_count: u32,
+
+        states: Vec<BBR2StateMachine>,
+    }
+
+    // Runs a bulk sender, always limited by cwnd or pacing, over `link`.
+    fn simulate(
+        r: &mut Recovery, link: &mut Bottleneck, start: Instant,
+        duration: Duration,
+    ) -> Stats {
+        let mss = r.max_datagram_size();
+        let end = start + duration;
+        let half = start + duration / 2;
+        let epoch = packet::EPOCH_APPLICATION;
+
+        let mut stats = Stats::default();
+        let mut now = start;
+        let mut pkt_num = 0;
+
+        while now < end {
+            let mut acked = ranges::RangeSet::default();
+
+            while let Some(&(pn, t)) = link.acks.front() {
+                if t > now {
+                    break;
+                }
+
+                acked.push_item(pn);
+                link.acks.pop_front();
+
+                stats.acked += mss;
+            }
+
+            if acked.len() > 0 {
+                r.on_ack_received(
+                    &acked,
+                    0,
+                    None,
+                    epoch,
+                    HandshakeStatus::default(),
+                    now,
+                    "",
+                )
+                .unwrap();
+
+                if now > half {
+                    stats.rtt_sum += r.latest_rtt;
+                    stats.rtt_count += 1;
+                }
+            }
+
+            if let Some(timer) = r.loss_detection_timer() {
+                if timer <= now {
+                    r.on_loss_detection_timeout(
+                        HandshakeStatus::default(),
+                        now,
+                        "",
+                    );
+                }
+            }
+
+            while r.cwnd_available() >= mss && r.get_packet_send_time() <= now {
+                let pkt = Sent {
+                    pkt_num,
+                    frames: vec![],
+                    time_sent: now,
+                    time_acked: None,
+                    time_lost: None,
+                    size: mss,
+                    ack_eliciting: true,
+                    in_flight: true,
+                    delivered: 0,
+                    delivered_time: now,
+                    first_sent_time: now,
+                    is_app_limited: false,
+                    has_data: false,
+                    ecn_marked: false,
+                    tx_in_flight: 0,
+                    lost: 0,
+                };
+
+                r.on_packet_sent(pkt, epoch, HandshakeStatus::default(), now, "");
+
+                let time_sent = r.get_packet_send_time();
+
+                link.enqueue(pkt_num, mss, time_sent);
+
+                pkt_num += 1;
+            }
+
+            if stats.states.last() != Some(&r.bbr2_state.state) {
+                stats.states.push(r.bbr2_state.state);
+            }
+
+            // Move to the next event.
+            let mut next = end;
+
+            if let Some(&(_, t)) = link.acks.front() {
+                next = next.min(t);
+            }
+
+            if r.cwnd_available() >= mss {
+                next = next.min(r.get_packet_send_time());
+            }
+
+            if let Some(timer) = r.loss_detection_timer() {
+                next = next.min(timer);
+            }
+
+            now = next.max(now + Duration::from_micros(10));
+        }
+
+        stats
+    }
+
+    fn new_recovery(algo: recovery::CongestionControlAlgorithm) -> Recovery {
+        let mut cfg = crate::Config::new(crate::PROTOCOL_VERSION).unwrap();
+        cfg.set_cc_algorithm(algo);
+
+        let mut r = Recovery::new(&cfg);
+        r.on_init();
+
+        r
+    }
+
+    #[test]
+    fn bbr2_init() {
+        let r = new_recovery(recovery::CongestionControlAlgorithm::BBR2);
+
+        assert_eq!(
+            r.cwnd(),
+            r.max_datagram_size * recovery::INITIAL_WINDOW_PACKETS
+        );
+        assert_eq!(r.bytes_in_flight, 0);
+        assert_eq!(r.bbr2_state.state, BBR2StateMachine::Startup);
+
+        // Initial cwnd over 1ms at the Startup gain.
+        assert_eq!(
+            r.pacing_rate(),
+            (STARTUP_PACING_GAIN * r.cwnd() as f64 * 1000.0) as u64
+        );
+    }
+
+    #[test]
+    fn bbr2_send() {
+        let mut r = new_recovery(recovery::CongestionControlAlgorithm::BBR2);
+        let now = Instant::now();
+
+        r.on_packet_sent_cc(1000, now);
+
+        assert_eq!(r.bytes_in_flight, 1000);
+    }
+
+    #[test]
+    fn bbr2_startup_bottleneck() {
+        let mut r = new_recovery(recovery::CongestionControlAlgorithm::BBR2);
+        let rate = 1_250_000;
+        let rtt = Duration::from_millis(40);
+        let mut link = Bottleneck::new(rate, rtt, 2 * rate as usize / 25);
+
+        let stats =
+            simulate(&mut r, &mut link, Instant::now(), Duration::from_secs(2));
+
+        // Startup finds the bottleneck rate and drains the queue it built.
+        assert!(r.bbr2_state.filled_pipe);
+        assert_eq!(&stats.states[..2], &[
+            BBR2StateMachine::Startup,
+            BBR2StateMachine::Drain
+        ]);
+        assert!(per_ack::bbr2_is_in_a_probe_bw_state(&r));
+
+        assert!(r.bbr2_state.max_bw > rate * 9 / 10);
+        assert!(r.bbr2_state.max_bw < rate * 11 / 10);
+
+        assert!(r.bbr2_state.min_rtt >= rtt);
+        assert!(r.bbr2_state.min_rtt < rtt + Duration::from_millis(5));
+    }
+
+    #[test]
+    fn bbr2_probe_rtt() {
+        let mut r = new_recovery(recovery::CongestionControlAlgorithm::BBR2);
+        let rate = 1_250_000;
+        let rtt = Duration::from_millis(40);
+        let mut link = Bottleneck::new(rate, rtt, 2 * rate as usize / 25);
+
+        let stats =
+            simulate(&mut r, &mut link, Instant::now(), Duration::from_secs(8));
+
+        // Without a lower RTT sample for 5 seconds, BBR2 drains the queue and
+        // returns to ProbeBW.
+        let probe_rtt = stats
+            .states
+            .iter()
+            .position(|s| *s == BBR2StateMachine::ProbeRTT)
+            .unwrap();
+
+        assert_eq!(stats.states[probe_rtt + 1], BBR2StateMachine::ProbeBWCruise);
+        assert!(r.cwnd() > bbr2_probe_rtt_cwnd_for_test(&r));
+    }
+
+    fn bbr2_probe_rtt_cwnd_for_test(r: &Recovery) -> usize {
+        let bdp = r.bbr2_state.bw as f64 * r.bbr2_state.min_rtt.as_secs_f64();
+
+        (PROBE_RTT_CWND_GAIN * bdp) as usize
+    }
+
+    // BBR2 keeps the link busy with a small queue where Reno fills the
+    // buffer before it backs off.
+    #[test]
+    fn bbr2_bounded_queue() {
+        let rate = 1_250_000;
+        let rtt = Duration::from_millis(40);
+        let duration = Duration::from_secs(10);
+
+        let mut bbr2 = new_recovery(recovery::CongestionControlAlgorithm::BBR2);
+        let mut link = Bottleneck::new(rate, rtt, 4 * rate as usize / 25);
+        let bbr2_stats = simulate(&mut bbr2, &mut link, Instant::now(), duration);
+
+        let mut reno = new_recovery(recovery::CongestionControlAlgorithm::Reno);
+        let mut link = Bottleneck::new(rate, rtt, 4 * rate as usize / 25);
+        let reno_stats = simulate(&mut reno, &mut link, Instant::now(), duration);
+
+        let goodput = bbr2_stats.acked as f64 / duration.as_secs_f64();
+        assert!(goodput > rate as f64 * 0.9);
+
+        let bbr2_rtt = bbr2_stats.rtt_sum / bbr2_stats.rtt_count;
+        let reno_rtt = reno_stats.rtt_sum / reno_stats.rtt_count;
+
+        assert!(bbr2_rtt < rtt.mul_f64(1.5));
+        assert!(bbr2_rtt < reno_rtt);
+    }
+
+    // With a buffer smaller than the BDP, bandwidth probes end in loss and
+    // inflight_hi caps the probes that follow.
+    #[test]
+    fn bbr2_shallow_buffer() {
+        let mut r = new_recovery(recovery::CongestionControlAlgorithm::BBR2);
+        let rate = 1_250_000;
+        let rtt = Duration::from_millis(40);
+        let mut link = Bottleneck::new(rate, rtt, rate as usize / 100);
+        let duration = Duration::from_secs(10);
+
+        let stats = simulate(&mut r, &mut link, Instant::now(), duration);
+
+        assert!(r.bbr2_state.inflight_hi < usize::MAX);
+        assert!(r.bbr2_state.inflight_hi < 2 * link.bdp());
+
+        let goodput = stats.acked as f64 / duration.as_secs_f64();
+        assert!(goodput > rate as f64 * 0.8);
+
+        // Lose less than 5% of the packets, Startup included.
+        let sent = stats.acked / r.max_datagram_size + link.dropped;
+        assert!(link.dropped * 20 < sent);
+    }
+
+    #[test]
+    fn bbr2_dtp_pacing_gain() {
+        let mut r = new_recovery(recovery::CongestionControlAlgorithm::BBR2);
+
+        r.bbr2_state.filled_pipe = true;
+        r.bbr2_state.bw = 1_000_000;
+
+        per_ack::bbr2_start_probe_bw_cruise(&mut r);
+        pacing::bbr2_set_pacing_rate(&mut r);
+        let base = r.pacing_rate();
+
+        assert_eq!(base, (1_000_000.0 * (1.0 - PACING_MARGIN_PERCENT)) as u64);
+
+        // An urgent block raises the rate in Cruise.
+        r.bbr2_state.dtp_urgency = 1.0;
+        pacing::bbr2_set_pacing_rate(&mut r);
+
+        assert_eq!(
+            r.pacing_rate(),
+            (base as f64 * (1.0 + DTP_URGENCY_GAIN)) as u64
+        );
+
+        r.bbr2_state.dtp_urgency = 0.5;
+        pacing::bbr2_set_pacing_rate(&mut r);
+
+        assert_eq!(
+            r.pacing_rate(),
+            (base as f64 * (1.0 + DTP_URGENCY_GAIN / 2.0)) as u64
+        );
+
+        // But not while draining the queue.
+        r.bbr2_state.dtp_urgency = 1.0;
+        r.bbr2_state.state = BBR2StateMachine::ProbeBWDown;
+        r.bbr2_state.pacing_gain = PROBE_BW_DOWN_PACING_GAIN;
+        pacing::bbr2_set_pacing_rate(&mut r);
+
+        assert_eq!(
+            r.pacing_rate(),
+            (PROBE_BW_DOWN_PACING_GAIN * base as f64) as u64
+        );
+    }
+
+    #[test]
+    fn bbr2_dtp_urgency_bottleneck() {
+        let rate = 1_250_000;
+        let rtt = Duration::from_millis(40);
+        let duration = Duration::from_secs(6);
+
+        let mut r = new_recovery(recovery::CongestionControlAlgorithm::BBR2);
+        let mut link = Bottleneck::new(rate, rtt, 4 * rate as usize / 25);
+        let plain = simulate(&mut r, &mut link, Instant::now(), duration);
+
+        let mut r = new_recovery(recovery::CongestionControlAlgorithm::BBR2);
+        r.bbr2_state.dtp_urgency = 1.0;
+        let mut link = Bottleneck::new(rate, rtt, 4 * rate as usize / 25);
+        let urgent = simulate(&mut r, &mut link, Instant::now(), duration);
+
+        // The raised gain cannot beat the bottleneck, it only queues a bit
+        // more, and the bandwidth estimate is not inflated by it.
+        assert!(urgent.acked >= plain.acked * 95 / 100);
+        assert!(r.bbr2_state.max_bw < rate * 11 / 10);
+        assert!(link.dropped * 100 < urgent.acked / r.max_datagram_size);
+    }
+}
+
+mod init;
+mod pacing;
+mod per_ack;
+mod per_loss;
+mod per_transmit;
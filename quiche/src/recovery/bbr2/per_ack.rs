@@ -0,0 +1,910 @@
+// Copyright (C) 2022, Cloudflare, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+use super::*;
+
+use std::cmp;
+
+use crate::rand;
+use crate::recovery;
+
+use crate::recovery::bbr2::init;
+use crate::recovery::bbr2::pacing;
+
+// BBR2 Functions on every ACK received.
+//
+
+// Copies the rate sample of this ACK from the delivery rate estimator.
+pub fn bbr2_update_rate_sample(r: &mut Recovery) {
+    let lost = r
+        .bytes_lost
+        .saturating_sub(r.delivery_rate.sample_prior_lost());
+
+    let rs = &mut r.bbr2_state.rs;
+
+    rs.delivery_rate = r.delivery_rate.sample_delivery_rate();
+    rs.delivered = r.delivery_rate.sample_delivered();
+    rs.prior_delivered = r.delivery_rate.sample_prior_delivered();
+    rs.tx_in_flight = r.delivery_rate.sample_tx_in_flight();
+    rs.lost = lost as usize;
+    rs.is_app_limited = r.delivery_rate.sample_is_app_limited();
+    rs.rtt = r.delivery_rate.sample_rtt();
+}
+
+// 4.2.3.  Per-ACK Steps
+pub fn bbr2_update_model_and_state(r: &mut Recovery, now: Instant) {
+    bbr2_update_latest_delivery_signals(r);
+    bbr2_update_congestion_signals(r);
+    bbr2_update_ack_aggregation(r, now);
+    bbr2_check_startup_done(r);
+    bbr2_check_drain(r, now);
+    bbr2_update_probe_bw_cycle_phase(r, now);
+    bbr2_update_min_rtt(r, now);
+    bbr2_check_probe_rtt(r, now);
+    bbr2_advance_latest_delivery_signals(r);
+    bbr2_bound_bw_for_model(r);
+}
+
+pub fn bbr2_update_control_parameters(r: &mut Recovery, _now: Instant) {
+    pacing::bbr2_set_pacing_rate(r);
+    bbr2_set_send_quantum(r);
+    bbr2_set_cwnd(r);
+}
+
+// 4.3.1.1.  Exiting Startup Based on Bandwidth Plateau
+fn bbr2_check_startup_full_bandwidth(r: &mut Recovery) {
+    let bbr = &mut r.bbr2_state;
+
+    if bbr.filled_pipe || !bbr.round_start || bbr.rs.is_app_limited {
+        // No need to check for a full pipe now.
+        return;
+    }
+
+    // Still growing?
+    if bbr.max_bw as f64 >= bbr.full_bw as f64 * FULL_BW_THRESH {
+        // Record new baseline level.
+        bbr.full_bw = bbr.max_bw;
+        bbr.full_bw_count = 0;
+        return;
+    }
+
+    // Another round w/o much growth.
+    bbr.full_bw_count += 1;
+
+    if bbr.full_bw_count >= FULL_BW_COUNT {
+        bbr.filled_pipe = true;
+    }
+}
+
+// 4.3.1.2.  Exiting Startup Based on Packet Loss
+fn bbr2_check_startup_high_loss(r: &mut Recovery) {
+    if r.bbr2_state.state != BBR2StateMachine::Startup || r.bbr2_state.filled_pipe
+    {
+        return;
+    }
+
+    if r.bbr2_state.loss_in_round &&
+        r.bbr2_state.loss_events_in_round >= FULL_LOSS_COUNT &&
+        bbr2_is_inflight_too_high(r)
+    {
+        let bdp = bbr2_bdp_multiple(r, r.bbr2_state.max_bw, 1.0);
+
+        r.bbr2_state.inflight_hi = cmp::max(bdp, r.bbr2_state.inflight_latest);
+        r.bbr2_state.filled_pipe = true;
+    }
+}
+
+fn bbr2_check_startup_done(r: &mut Recovery) {
+    bbr2_check_startup_full_bandwidth(r);
+
+    if r.bbr2_state.state == BBR2StateMachine::Startup && r.bbr2_state.filled_pipe
+    {
+        bbr2_enter_drain(r);
+    }
+}
+
+// 4.3.2.  Drain
+fn bbr2_enter_drain(r: &mut Recovery) {
+    let bbr = &mut r.bbr2_state;
+
+    bbr.state = BBR2StateMachine::Drain;
+
+    // Slow down to drain the queue built in Startup.
+    bbr.pacing_gain = DRAIN_PACING_GAIN;
+
+    // Maintain cwnd gain.
+    bbr.cwnd_gain = STARTUP_CWND_GAIN;
+}
+
+fn bbr2_check_drain(r: &mut Recovery, now: Instant) {
+    if r.bbr2_state.state == BBR2StateMachine::Drain &&
+        r.bytes_in_flight <= bbr2_inflight(r, r.bbr2_state.max_bw, 1.0)
+    {
+        // BBR estimates the queue was drained.
+        bbr2_enter_probe_bw(r, now);
+    }
+}
+
+// 4.3.3.  ProbeBW
+fn bbr2_enter_probe_bw(r: &mut Recovery, now: Instant) {
+    bbr2_start_probe_bw_down(r, now);
+}
+
+pub fn bbr2_start_probe_bw_down(r: &mut Recovery, now: Instant) {
+    init::bbr2_reset_congestion_signals(r);
+
+    // Not growing inflight_hi.
+    r.bbr2_state.probe_up_cnt = usize::MAX;
+
+    bbr2_pick_probe_wait(r);
+
+    // Start wall clock.
+    r.bbr2_state.cycle_stamp = now;
+    r.bbr2_state.ack_phase = BBR2AckPhase::ProbeStopping;
+
+    bbr2_start_round(r);
+
+    r.bbr2_state.state = BBR2StateMachine::ProbeBWDown;
+    r.bbr2_state.pacing_gain = PROBE_BW_DOWN_PACING_GAIN;
+    r.bbr2_state.cwnd_gain = DEFAULT_CWND_GAIN;
+}
+
+pub fn bbr2_start_probe_bw_cruise(r: &mut Recovery) {
+    r.bbr2_state.state = BBR2StateMachine::ProbeBWCruise;
+    r.bbr2_state.pacing_gain = 1.0;
+    r.bbr2_state.cwnd_gain = DEFAULT_CWND_GAIN;
+}
+
+fn bbr2_start_probe_bw_refill(r: &mut Recovery) {
+    init::bbr2_reset_lower_bounds(r);
+
+    r.bbr2_state.bw_probe_up_rounds = 0;
+    r.bbr2_state.bw_probe_up_acks = 0;
+    r.bbr2_state.ack_phase = BBR2AckPhase::Refilling;
+
+    bbr2_start_round(r);
+
+    r.bbr2_state.state = BBR2StateMachine::ProbeBWRefill;
+    r.bbr2_state.pacing_gain = 1.0;
+    r.bbr2_state.cwnd_gain = DEFAULT_CWND_GAIN;
+}
+
+fn bbr2_start_probe_bw_up(r: &mut Recovery, now: Instant) {
+    r.bbr2_state.ack_phase = BBR2AckPhase::ProbeStarting;
+
+    bbr2_start_round(r);
+
+    // Start wall clock.
+    r.bbr2_state.cycle_stamp = now;
+    r.bbr2_state.state = BBR2StateMachine::ProbeBWUp;
+    r.bbr2_state.pacing_gain = PROBE_BW_UP_PACING_GAIN;
+    r.bbr2_state.cwnd_gain = PROBE_BW_UP_CWND_GAIN;
+
+    bbr2_raise_inflight_hi_slope(r);
+}
+
+// 4.3.3.6.  ProbeBW Algorithm Details
+//
+// The core state machine logic for ProbeBW.
+fn bbr2_update_probe_bw_cycle_phase(r: &mut Recovery, now: Instant) {
+    if !r.bbr2_state.filled_pipe {
+        // Only handling steady-state behavior here.
+        return;
+    }
+
+    bbr2_adapt_upper_bounds(r, now);
+
+    if !bbr2_is_in_a_probe_bw_state(r) {
+        // Only handling ProbeBW states here.
+        return;
+    }
+
+    match r.bbr2_state.state {
+        BBR2StateMachine::ProbeBWDown => {
+            if bbr2_check_time_to_probe_bw(r, now) {
+                // Already decided state transition.
+                return;
+            }
+
+            if bbr2_check_time_to_cruise(r) {
+                bbr2_start_probe_bw_cruise(r);
+            }
+        },
+
+        BBR2StateMachine::ProbeBWCruise => {
+            bbr2_check_time_to_probe_bw(r, now);
+        },
+
+        BBR2StateMachine::ProbeBWRefill => {
+            // After one round of REFILL, start UP.
+            if r.bbr2_state.round_start {
+                r.bbr2_state.bw_probe_samples = true;
+
+                bbr2_start_probe_bw_up(r, now);
+            }
+        },
+
+        BBR2StateMachine::ProbeBWUp => {
+            if bbr2_has_elapsed_in_phase(r, r.bbr2_state.min_rtt, now) &&
+                r.bytes_in_flight >
+                    bbr2_inflight(
+                        r,
+                        r.bbr2_state.max_bw,
+                        PROBE_BW_UP_PACING_GAIN,
+                    )
+            {
+                bbr2_start_probe_bw_down(r, now);
+            }
+        },
+
+        _ => (),
+    }
+}
+
+pub fn bbr2_is_in_a_probe_bw_state(r: &Recovery) -> bool {
+    matches!(
+        r.bbr2_state.state,
+        BBR2StateMachine::ProbeBWDown |
+            BBR2StateMachine::ProbeBWCruise |
+            BBR2StateMachine::ProbeBWRefill |
+            BBR2StateMachine::ProbeBWUp
+    )
+}
+
+fn bbr2_check_time_to_cruise(r: &mut Recovery) -> bool {
+    if r.bytes_in_flight > bbr2_inflight_with_headroom(r) {
+        // Not enough headroom.
+        return false;
+    }
+
+    if r.bytes_in_flight <= bbr2_inflight(r, r.bbr2_state.max_bw, 1.0) {
+        // inflight <= estimated BDP.
+        return true;
+    }
+
+    false
+}
+
+fn bbr2_has_elapsed_in_phase(
+    r: &Recovery, interval: Duration, now: Instant,
+) -> bool {
+    now.saturating_duration_since(r.bbr2_state.cycle_stamp) > interval
+}
+
+// Randomized decision about how long to wait until probing for bandwidth,
+// using round count and wall clock.
+fn bbr2_pick_probe_wait(r: &mut Recovery) {
+    let bbr = &mut r.bbr2_state;
+
+    // Decide random round-trip bound for wait.
+    bbr.rounds_since_bw_probe = (rand::rand_u8() % 2) as usize;
+
+    // Decide the random wall clock bound for wait.
+    bbr.bw_probe_wait = PROBE_BW_MIN_WAIT +
+        Duration::from_millis(rand::rand_u64_uniform(PROBE_BW_WAIT_RANGE_MS));
+}
+
+fn bbr2_is_reno_coexistence_probe_time(r: &Recovery) -> bool {
+    let reno_rounds = bbr2_target_inflight(r) / r.max_datagram_size;
+    let rounds = cmp::min(reno_rounds, RENO_MAX_PROBE_ROUNDS);
+
+    r.bbr2_state.rounds_since_bw_probe >= rounds
+}
+
+// Is it time to transition from DOWN or CRUISE to REFILL?
+fn bbr2_check_time_to_probe_bw(r: &mut Recovery, now: Instant) -> bool {
+    if bbr2_has_elapsed_in_phase(r, r.bbr2_state.bw_probe_wait, now) ||
+        bbr2_is_reno_coexistence_probe_time(r)
+    {
+        bbr2_start_probe_bw_refill(r);
+
+        return true;
+    }
+
+    false
+}
+
+// 4.5.1.  BBR.round_count: Tracking Packet-Timed Round Trips
+pub fn bbr2_start_round(r: &mut Recovery) {
+    r.bbr2_state.next_round_delivered = r.delivery_rate.delivered();
+}
+
+fn bbr2_update_round(r: &mut Recovery) {
+    let bbr = &mut r.bbr2_state;
+
+    if bbr.rs.prior_delivered >= bbr.next_round_delivered {
+        bbr.next_round_delivered = r.delivery_rate.delivered();
+        bbr.round_count += 1;
+        bbr.rounds_since_bw_probe += 1;
+        bbr.round_start = true;
+    } else {
+        bbr.round_start = false;
+    }
+}
+
+// 4.5.2.4.  Updating the BBR.max_bw Max Filter
+fn bbr2_update_max_bw(r: &mut Recovery) {
+    bbr2_update_round(r);
+
+    let bbr = &mut r.bbr2_state;
+
+    if bbr.rs.delivery_rate >= bbr.max_bw || !bbr.rs.is_app_limited {
+        bbr.max_bw_filter[1] =
+            cmp::max(bbr.max_bw_filter[1], bbr.rs.delivery_rate);
+        bbr.max_bw = cmp::max(bbr.max_bw_filter[0], bbr.max_bw_filter[1]);
+    }
+}
+
+// 4.5.2.5.  Tracking Time for the BBR.max_bw Max Filter
+fn bbr2_advance_max_bw_filter(r: &mut Recovery) {
+    let bbr = &mut r.bbr2_state;
+
+    bbr.cycle_count += 1;
+
+    // Keep the samples of the previous cycle only.
+    bbr.max_bw_filter[0] = bbr.max_bw_filter[1];
+    bbr.max_bw_filter[1] = 0;
+}
+
+// 4.5.5.  BBR.offload_budget
+fn bbr2_update_offload_budget(r: &Recovery) -> usize {
+    3 * r.send_quantum
+}
+
+// 4.5.6.  BBR.extra_acked
+fn bbr2_update_ack_aggregation(r: &mut Recovery, now: Instant) {
+    let cwnd = r.congestion_window;
+    let bbr = &mut r.bbr2_state;
+
+    // Find excess ACKed beyond expected amount over this interval.
+    let interval = now.saturating_duration_since(bbr.extra_acked_interval_start);
+    let mut expected_delivered =
+        (bbr.bw as f64 * interval.as_secs_f64()) as usize;
+
+    // Reset interval if ACK rate is below expected rate.
+    if bbr.extra_acked_delivered <= expected_delivered {
+        bbr.extra_acked_delivered = 0;
+        bbr.extra_acked_interval_start = now;
+        expected_delivered = 0;
+    }
+
+    bbr.extra_acked_delivered += bbr.rs.newly_acked_bytes;
+
+    let extra = bbr.extra_acked_delivered.saturating_sub(expected_delivered);
+    let extra = cmp::min(extra, cwnd);
+
+    if bbr.round_start {
+        bbr.extra_acked_win_rounds += 1;
+
+        if bbr.extra_acked_win_rounds >= EXTRA_ACKED_WIN_ROUNDS {
+            bbr.extra_acked_win_rounds = 0;
+            bbr.extra_acked_win_idx ^= 1;
+            bbr.extra_acked_filter[bbr.extra_acked_win_idx] = 0;
+        }
+    }
+
+    let idx = bbr.extra_acked_win_idx;
+
+    bbr.extra_acked_filter[idx] = cmp::max(bbr.extra_acked_filter[idx], extra);
+    bbr.extra_acked =
+        cmp::max(bbr.extra_acked_filter[0], bbr.extra_acked_filter[1]);
+}
+
+// 4.5.8.  Updating the Model Upon Packet Loss
+pub fn bbr2_is_inflight_too_high(r: &Recovery) -> bool {
+    let rs = &r.bbr2_state.rs;
+
+    rs.lost as f64 > rs.tx_in_flight as f64 * LOSS_THRESH
+}
+
+pub fn bbr2_handle_inflight_too_high(r: &mut Recovery, now: Instant) {
+    // Only react once per bw probe.
+    r.bbr2_state.bw_probe_samples = false;
+
+    if !r.bbr2_state.rs.is_app_limited {
+        let target = (bbr2_target_inflight(r) as f64 * BETA) as usize;
+
+        r.bbr2_state.inflight_hi = cmp::max(r.bbr2_state.rs.tx_in_flight, target);
+    }
+
+    if r.bbr2_state.state == BBR2StateMachine::ProbeBWUp {
+        bbr2_start_probe_bw_down(r, now);
+    }
+}
+
+// 4.5.10.  BBR.inflight_hi and BBR.inflight_lo
+fn bbr2_update_latest_delivery_signals(r: &mut Recovery) {
+    let bbr = &mut r.bbr2_state;
+
+    // Near start of ACK processing.
+    bbr.loss_round_start = false;
+    bbr.bw_latest = cmp::max(bbr.bw_latest, bbr.rs.delivery_rate);
+    bbr.inflight_latest = cmp::max(bbr.inflight_latest, bbr.rs.delivered);
+
+    if bbr.rs.prior_delivered >= bbr.loss_round_delivered {
+        bbr.loss_round_delivered = r.delivery_rate.delivered();
+        bbr.loss_round_start = true;
+    }
+}
+
+fn bbr2_advance_latest_delivery_signals(r: &mut Recovery) {
+    let bbr = &mut r.bbr2_state;
+
+    // Near end of ACK processing.
+    if bbr.loss_round_start {
+        bbr.bw_latest = bbr.rs.delivery_rate;
+        bbr.inflight_latest = bbr.rs.delivered;
+    }
+}
+
+fn bbr2_update_congestion_signals(r: &mut Recovery) {
+    // Update congestion state on every ACK.
+    bbr2_update_max_bw(r);
+
+    if r.bbr2_state.rs.lost > 0 {
+        r.bbr2_state.loss_in_round = true;
+    }
+
+    if !r.bbr2_state.loss_round_start {
+        // Wait until end of round trip.
+        return;
+    }
+
+    bbr2_check_startup_high_loss(r);
+    bbr2_adapt_lower_bounds_from_congestion(r);
+
+    r.bbr2_state.loss_in_round = false;
+    r.bbr2_state.loss_events_in_round = 0;
+}
+
+fn bbr2_adapt_lower_bounds_from_congestion(r: &mut Recovery) {
+    // Once we enter ProbeBW, we probe for bandwidth instead.
+    if bbr2_is_probing_bw(r) {
+        return;
+    }
+
+    if r.bbr2_state.loss_in_round {
+        bbr2_init_lower_bounds(r);
+        bbr2_loss_lower_bounds(r);
+    }
+}
+
+fn bbr2_init_lower_bounds(r: &mut Recovery) {
+    let cwnd = r.congestion_window;
+    let bbr = &mut r.bbr2_state;
+
+    if bbr.bw_lo == u64::MAX {
+        bbr.bw_lo = bbr.max_bw;
+    }
+
+    if bbr.inflight_lo == usize::MAX {
+        bbr.inflight_lo = cwnd;
+    }
+}
+
+fn bbr2_loss_lower_bounds(r: &mut Recovery) {
+    let bbr = &mut r.bbr2_state;
+
+    bbr.bw_lo = cmp::max(bbr.bw_latest, (BETA * bbr.bw_lo as f64) as u64);
+    bbr.inflight_lo = cmp::max(
+        bbr.inflight_latest,
+        (BETA * bbr.inflight_lo as f64) as usize,
+    );
+}
+
+fn bbr2_is_probing_bw(r: &Recovery) -> bool {
+    matches!(
+        r.bbr2_state.state,
+        BBR2StateMachine::Startup |
+            BBR2StateMachine::ProbeBWRefill |
+            BBR2StateMachine::ProbeBWUp
+    )
+}
+
+fn bbr2_bound_bw_for_model(r: &mut Recovery) {
+    let bbr = &mut r.bbr2_state;
+
+    bbr.bw = cmp::min(bbr.max_bw, bbr.bw_lo);
+}
+
+// 4.5.10.2.  Probing for Bandwidth In ProbeBW
+fn bbr2_adapt_upper_bounds(r: &mut Recovery, now: Instant) {
+    // Update BBR.inflight_hi.
+    if r.bbr2_state.ack_phase == BBR2AckPhase::ProbeStarting &&
+        r.bbr2_state.round_start
+    {
+        // Starting to get bw probing samples.
+        r.bbr2_state.ack_phase = BBR2AckPhase::ProbeFeedback;
+    }
+
+    if r.bbr2_state.ack_phase == BBR2AckPhase::ProbeStopping &&
+        r.bbr2_state.round_start
+    {
+        // End of samples from bw probing phase.
+        r.bbr2_state.bw_probe_samples = false;
+        r.bbr2_state.ack_phase = BBR2AckPhase::Init;
+
+        // The best time to forget the samples of the previous cycle.
+        if bbr2_is_in_a_probe_bw_state(r) && !r.bbr2_state.rs.is_app_limited {
+            bbr2_advance_max_bw_filter(r);
+        }
+    }
+
+    if !bbr2_check_inflight_too_high(r, now) {
+        // Loss rate is safe. Adjust upper bounds upward.
+        if r.bbr2_state.inflight_hi == usize::MAX {
+            // No upper bounds to raise.
+            return;
+        }
+
+        if r.bbr2_state.rs.tx_in_flight > r.bbr2_state.inflight_hi {
+            r.bbr2_state.inflight_hi = r.bbr2_state.rs.tx_in_flight;
+        }
+
+        if r.bbr2_state.state == BBR2StateMachine::ProbeBWUp {
+            bbr2_probe_inflight_hi_upward(r);
+        }
+    }
+}
+
+fn bbr2_check_inflight_too_high(r: &mut Recovery, now: Instant) -> bool {
+    if bbr2_is_inflight_too_high(r) {
+        if r.bbr2_state.bw_probe_samples {
+            bbr2_handle_inflight_too_high(r, now);
+        }
+
+        // inflight_hi was bounded.
+        return true;
+    }
+
+    false
+}
+
+fn bbr2_raise_inflight_hi_slope(r: &mut Recovery) {
+    let cwnd = r.congestion_window;
+    let bbr = &mut r.bbr2_state;
+
+    // Grow inflight_hi by 1, 2, 4... packets per round. probe_up_cnt is the
+    // number of bytes to be acked for each packet of growth.
+    let growth_this_round = 1 << bbr.bw_probe_up_rounds;
+
+    bbr.bw_probe_up_rounds =
+        cmp::min(bbr.bw_probe_up_rounds + 1, MAX_PROBE_UP_ROUNDS);
+    bbr.probe_up_cnt = cmp::max(cwnd / growth_this_round, 1);
+}
+
+// Increase inflight_hi if appropriate.
+fn bbr2_probe_inflight_hi_upward(r: &mut Recovery) {
+    if r.app_limited || r.congestion_window < r.bbr2_state.inflight_hi {
+        // Not fully using inflight_hi, so don't grow it.
+        return;
+    }
+
+    let mss = r.max_datagram_size;
+    let bbr = &mut r.bbr2_state;
+
+    // bw_probe_up_acks is a packet count in the draft.
+    bbr.bw_probe_up_acks += bbr.rs.newly_acked_bytes;
+
+    if bbr.bw_probe_up_acks >= bbr.probe_up_cnt {
+        let delta = bbr.bw_probe_up_acks / bbr.probe_up_cnt;
+
+        bbr.bw_probe_up_acks -= delta * bbr.probe_up_cnt;
+        bbr.inflight_hi += delta * mss;
+    }
+
+    if bbr.round_start {
+        bbr2_raise_inflight_hi_slope(r);
+    }
+}
+
+// 4.6.2.  Pacing Rate: BBR.pacing_rate
+//
+// 4.6.3.  Send Quantum: BBR.send_quantum
+pub fn bbr2_set_send_quantum(r: &mut Recovery) {
+    let mss = r.max_datagram_size;
+
+    let floor = if r.pacing_rate < SEND_QUANTUM_THRESHOLD_PACING_RATE {
+        mss
+    } else {
+        2 * mss
+    };
+
+    let send_quantum =
+        cmp::min((r.pacing_rate / 1000) as usize, MAX_SEND_QUANTUM);
+
+    r.send_quantum = cmp::max(send_quantum, floor);
+}
+
+// 4.6.4.2.  Computing BBR.max_inflight
+fn bbr2_bdp_multiple(r: &Recovery, bw: u64, gain: f64) -> usize {
+    let bbr = &r.bbr2_state;
+
+    if bbr.min_rtt == Duration::MAX {
+        // No valid RTT samples yet.
+        return r.max_datagram_size * recovery::INITIAL_WINDOW_PACKETS;
+    }
+
+    let bdp = bw as f64 * bbr.min_rtt.as_secs_f64();
+
+    (gain * bdp) as usize
+}
+
+fn bbr2_quantization_budget(r: &Recovery, inflight: usize) -> usize {
+    let offload_budget = bbr2_update_offload_budget(r);
+
+    let mut inflight = cmp::max(inflight, offload_budget);
+    inflight = cmp::max(inflight, bbr2_min_pipe_cwnd(r));
+
+    if r.bbr2_state.state == BBR2StateMachine::ProbeBWUp {
+        inflight += 2 * r.max_datagram_size;
+    }
+
+    inflight
+}
+
+fn bbr2_inflight(r: &Recovery, bw: u64, gain: f64) -> usize {
+    let inflight = bbr2_bdp_multiple(r, bw, gain);
+
+    bbr2_quantization_budget(r, inflight)
+}
+
+fn bbr2_update_max_inflight(r: &Recovery) -> usize {
+    let inflight = bbr2_bdp_multiple(r, r.bbr2_state.bw, r.bbr2_state.cwnd_gain);
+    let inflight = inflight + r.bbr2_state.extra_acked;
+
+    bbr2_quantization_budget(r, inflight)
+}
+
+// 4.6.4.3.  Minimum cwnd for Pipelining
+fn bbr2_min_pipe_cwnd(r: &Recovery) -> usize {
+    MIN_PIPE_CWND_PKTS * r.max_datagram_size
+}
+
+// 4.6.4.4.  Modulating cwnd in Loss Recovery
+pub fn bbr2_save_cwnd(r: &Recovery) -> usize {
+    if !r.bbr2_state.in_recovery &&
+        r.bbr2_state.state != BBR2StateMachine::ProbeRTT
+    {
+        r.congestion_window
+    } else {
+        cmp::max(r.bbr2_state.prior_cwnd, r.congestion_window)
+    }
+}
+
+pub fn bbr2_restore_cwnd(r: &mut Recovery) {
+    r.congestion_window = cmp::max(r.congestion_window, r.bbr2_state.prior_cwnd);
+}
+
+fn bbr2_modulate_cwnd_for_recovery(r: &mut Recovery) {
+    let newly_lost = r.bbr2_state.rs.newly_lost_bytes;
+
+    if newly_lost > 0 {
+        r.congestion_window = cmp::max(
+            r.congestion_window.saturating_sub(newly_lost),
+            r.max_datagram_size,
+        );
+    }
+
+    if r.bbr2_state.packet_conservation {
+        r.congestion_window = cmp::max(
+            r.congestion_window,
+            r.bytes_in_flight + r.bbr2_state.rs.newly_acked_bytes,
+        );
+    }
+}
+
+// 4.6.4.5.  Modulating cwnd in ProbeRTT
+fn bbr2_probe_rtt_cwnd(r: &Recovery) -> usize {
+    let probe_rtt_cwnd =
+        bbr2_bdp_multiple(r, r.bbr2_state.bw, PROBE_RTT_CWND_GAIN);
+
+    cmp::max(probe_rtt_cwnd, bbr2_min_pipe_cwnd(r))
+}
+
+fn bbr2_bound_cwnd_for_probe_rtt(r: &mut Recovery) {
+    if r.bbr2_state.state == BBR2StateMachine::ProbeRTT {
+        r.congestion_window =
+            cmp::min(r.congestion_window, bbr2_probe_rtt_cwnd(r));
+    }
+}
+
+// 4.6.4.6.  Core cwnd Adjustment Mechanism
+fn bbr2_set_cwnd(r: &mut Recovery) {
+    let max_inflight = bbr2_update_max_inflight(r);
+    let newly_acked = r.bbr2_state.rs.newly_acked_bytes;
+
+    bbr2_modulate_cwnd_for_recovery(r);
+
+    if !r.bbr2_state.packet_conservation {
+        if r.bbr2_state.filled_pipe {
+            r.congestion_window =
+                cmp::min(r.congestion_window + newly_acked, max_inflight);
+        } else if r.congestion_window < max_inflight ||
+            r.delivery_rate.delivered() <
+                r.max_datagram_size * recovery::INITIAL_WINDOW_PACKETS
+        {
+            r.congestion_window += newly_acked;
+        }
+
+        r.congestion_window =
+            cmp::max(r.congestion_window, bbr2_min_pipe_cwnd(r));
+    }
+
+    bbr2_bound_cwnd_for_probe_rtt(r);
+    bbr2_bound_cwnd_for_model(r);
+}
+
+// 4.6.4.7.  Bounding cwnd Based on Recent Congestion
+fn bbr2_bound_cwnd_for_model(r: &mut Recovery) {
+    let mut cap = usize::MAX;
+
+    if bbr2_is_in_a_probe_bw_state(r) &&
+        r.bbr2_state.state != BBR2StateMachine::ProbeBWCruise
+    {
+        cap = r.bbr2_state.inflight_hi;
+    } else if r.bbr2_state.state == BBR2StateMachine::ProbeRTT ||
+        r.bbr2_state.state == BBR2StateMachine::ProbeBWCruise
+    {
+        cap = bbr2_inflight_with_headroom(r);
+    }
+
+    // Apply inflight_lo (possibly infinite).
+    cap = cmp::min(cap, r.bbr2_state.inflight_lo);
+    cap = cmp::max(cap, bbr2_min_pipe_cwnd(r));
+
+    r.congestion_window = cmp::min(r.congestion_window, cap);
+}
+
+// Return a volume of data that tries to leave free headroom in the bottleneck
+// buffer or link for other flows, for fairness convergence and lower RTTs and
+// loss.
+fn bbr2_inflight_with_headroom(r: &Recovery) -> usize {
+    let bbr = &r.bbr2_state;
+
+    if bbr.inflight_hi == usize::MAX {
+        return usize::MAX;
+    }
+
+    let headroom = cmp::max(
+        r.max_datagram_size,
+        (HEADROOM * bbr.inflight_hi as f64) as usize,
+    );
+
+    cmp::max(
+        bbr.inflight_hi.saturating_sub(headroom),
+        bbr2_min_pipe_cwnd(r),
+    )
+}
+
+fn bbr2_target_inflight(r: &Recovery) -> usize {
+    let bdp = bbr2_inflight(r, r.bbr2_state.bw, 1.0);
+
+    cmp::min(bdp, r.congestion_window)
+}
+
+// 4.3.4.  ProbeRTT
+fn bbr2_update_min_rtt(r: &mut Recovery, now: Instant) {
+    let bbr = &mut r.bbr2_state;
+
+    bbr.probe_rtt_expired = now
+        .saturating_duration_since(bbr.probe_rtt_min_stamp) >
+        PROBE_RTT_INTERVAL;
+
+    let rs_rtt = bbr.rs.rtt;
+
+    if !rs_rtt.is_zero() &&
+        (rs_rtt < bbr.probe_rtt_min_delay || bbr.probe_rtt_expired)
+    {
+        bbr.probe_rtt_min_delay = rs_rtt;
+        bbr.probe_rtt_min_stamp = now;
+    }
+
+    let min_rtt_expired =
+        now.saturating_duration_since(bbr.min_rtt_stamp) > MIN_RTT_FILTER_LEN;
+
+    if bbr.probe_rtt_min_delay < bbr.min_rtt || min_rtt_expired {
+        bbr.min_rtt = bbr.probe_rtt_min_delay;
+        bbr.min_rtt_stamp = bbr.probe_rtt_min_stamp;
+    }
+}
+
+fn bbr2_check_probe_rtt(r: &mut Recovery, now: Instant) {
+    if r.bbr2_state.state != BBR2StateMachine::ProbeRTT &&
+        r.bbr2_state.probe_rtt_expired &&
+        !r.bbr2_state.idle_restart
+    {
+        bbr2_enter_probe_rtt(r);
+
+        r.bbr2_state.prior_cwnd = bbr2_save_cwnd(r);
+        r.bbr2_state.probe_rtt_done_stamp = None;
+        r.bbr2_state.ack_phase = BBR2AckPhase::ProbeStopping;
+
+        bbr2_start_round(r);
+    }
+
+    if r.bbr2_state.state == BBR2StateMachine::ProbeRTT {
+        bbr2_handle_probe_rtt(r, now);
+    }
+
+    if r.bbr2_state.rs.delivered > 0 {
+        r.bbr2_state.idle_restart = false;
+    }
+}
+
+fn bbr2_enter_probe_rtt(r: &mut Recovery) {
+    let bbr = &mut r.bbr2_state;
+
+    bbr.state = BBR2StateMachine::ProbeRTT;
+    bbr.pacing_gain = 1.0;
+    bbr.cwnd_gain = PROBE_RTT_CWND_GAIN;
+}
+
+fn bbr2_handle_probe_rtt(r: &mut Recovery, now: Instant) {
+    // Ignore low rate samples during ProbeRTT.
+    r.delivery_rate.update_app_limited(true);
+
+    if let Some(probe_rtt_done_stamp) = r.bbr2_state.probe_rtt_done_stamp {
+        if r.bbr2_state.round_start {
+            r.bbr2_state.probe_rtt_round_done = true;
+        }
+
+        if r.bbr2_state.probe_rtt_round_done && now > probe_rtt_done_stamp {
+            bbr2_check_probe_rtt_done(r, now);
+        }
+    } else if r.bytes_in_flight <= bbr2_probe_rtt_cwnd(r) {
+        // Wait for at least ProbeRTTDuration to elapse.
+        r.bbr2_state.probe_rtt_done_stamp = Some(now + PROBE_RTT_DURATION);
+
+        // Wait for at least one round to elapse.
+        r.bbr2_state.probe_rtt_round_done = false;
+
+        bbr2_start_round(r);
+    }
+}
+
+pub fn bbr2_check_probe_rtt_done(r: &mut Recovery, now: Instant) {
+    if let Some(probe_rtt_done_stamp) = r.bbr2_state.probe_rtt_done_stamp {
+        if now > probe_rtt_done_stamp {
+            // Schedule next ProbeRTT.
+            r.bbr2_state.probe_rtt_min_stamp = now;
+
+            bbr2_restore_cwnd(r);
+            bbr2_exit_probe_rtt(r, now);
+        }
+    }
+}
+
+fn bbr2_exit_probe_rtt(r: &mut Recovery, now: Instant) {
+    init::bbr2_reset_lower_bounds(r);
+
+    if r.bbr2_state.filled_pipe {
+        bbr2_start_probe_bw_down(r, now);
+        bbr2_start_probe_bw_cruise(r);
+    } else {
+        init::bbr2_enter_startup(r);
+    }
+}
@@ -0,0 +1,103 @@
+// Copyright (C) 2022, Cloudflare, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+use super::*;
+
+use crate::recovery::bbr2::per_ack;
+
+// BBR2 Functions when a packet is lost.
+//
+
+// 4.2.4.  Per-Loss Steps
+pub fn bbr2_update_on_loss(
+    r: &mut Recovery, lost_bytes: usize, packet: &Sent, now: Instant,
+) {
+    let mss = r.max_datagram_size;
+
+    r.bbr2_state.rs.newly_lost_bytes += lost_bytes;
+    r.bbr2_state.loss_events_in_round += (lost_bytes + mss - 1) / mss;
+
+    bbr2_handle_lost_packet(r, packet, now);
+}
+
+// 4.5.10.2.  Probing for Bandwidth In ProbeBW
+fn bbr2_handle_lost_packet(r: &mut Recovery, packet: &Sent, now: Instant) {
+    if !r.bbr2_state.bw_probe_samples {
+        return;
+    }
+
+    // bytes_lost already counts this packet.
+    let lost = r.bytes_lost.saturating_sub(packet.lost) as usize;
+
+    let bbr = &mut r.bbr2_state;
+
+    bbr.rs.tx_in_flight = packet.tx_in_flight;
+    bbr.rs.lost = lost;
+    bbr.rs.is_app_limited = packet.is_app_limited;
+
+    if per_ack::bbr2_is_inflight_too_high(r) {
+        r.bbr2_state.rs.tx_in_flight =
+            bbr2_inflight_hi_from_lost_packet(r, packet);
+
+        per_ack::bbr2_handle_inflight_too_high(r, now);
+    }
+}
+
+// Estimates the in-flight bytes at which the loss rate crossed LOSS_THRESH,
+// assuming the losses before this packet were evenly spread.
+fn bbr2_inflight_hi_from_lost_packet(r: &Recovery, packet: &Sent) -> usize {
+    let rs = &r.bbr2_state.rs;
+    let size = packet.size;
+
+    let inflight_prev = rs.tx_in_flight.saturating_sub(size);
+    let lost_prev = rs.lost.saturating_sub(size);
+
+    let lost_prefix = (LOSS_THRESH * inflight_prev as f64 - lost_prev as f64) /
+        (1.0 - LOSS_THRESH);
+
+    inflight_prev + lost_prefix.max(0.0) as usize
+}
+
+// 4.6.4.4.  Modulating cwnd in Loss Recovery
+pub fn bbr2_enter_recovery(r: &mut Recovery) {
+    r.bbr2_state.prior_cwnd = per_ack::bbr2_save_cwnd(r);
+
+    r.congestion_window = r.bytes_in_flight +
+        r.bbr2_state.rs.newly_acked_bytes.max(r.max_datagram_size);
+
+    r.bbr2_state.in_recovery = true;
+    r.bbr2_state.packet_conservation = true;
+
+    // Packet conservation lasts until a packet sent from now on is acked.
+    per_ack::bbr2_start_round(r);
+}
+
+pub fn bbr2_exit_recovery(r: &mut Recovery) {
+    r.bbr2_state.in_recovery = false;
+    r.bbr2_state.packet_conservation = false;
+
+    per_ack::bbr2_restore_cwnd(r);
+}
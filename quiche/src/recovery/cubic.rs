@@ -43,12 +43,15 @@ use crate::recovery::reno;
 use crate::recovery::Acked;
 use crate::recovery::CongestionControlOps;
 use crate::recovery::Recovery;
+use crate::recovery::Sent;
 
 pub static CUBIC: CongestionControlOps = CongestionControlOps {
     on_init,
     on_packet_sent,
     on_packets_acked,
+    on_packets_lost,
     congestion_event,
+    ecn_congestion_event,
     collapse_cwnd,
     checkpoint,
     rollback,
@@ -341,6 +344,12 @@ fn on_packet_acked(
     }
 }
 
+fn on_packets_lost(
+    _r: &mut Recovery, _lost_bytes: usize, _largest_lost_pkt: &Sent,
+    _now: Instant,
+) {
+}
+
 fn congestion_event(
     r: &mut Recovery, _lost_bytes: usize, time_sent: Instant,
     epoch: packet::Epoch, now: Instant,
@@ -388,6 +397,35 @@ fn congestion_event(
     }
 }
 
+fn ecn_congestion_event(
+    r: &mut Recovery, alpha: Option<f64>, time_sent: Instant,
+    epoch: packet::Epoch, now: Instant,
+) {
+    match alpha {
+        Some(alpha) => {
+            if reno::scalable_reduction(r, alpha, time_sent, epoch, now) {
+                // Restart the cubic curve from the reduced window, growing
+                // like Reno until it is reached again.
+                r.cubic_state.w_max = r.congestion_window as f64;
+                r.cubic_state.k = 0.0;
+
+                r.cubic_state.w_est = r.congestion_window as f64;
+                r.cubic_state.alpha_aimd = 1.0;
+
+                r.cubic_state.cwnd_inc = 0;
+
+                r.prr.congestion_event(r.bytes_in_flight);
+            }
+        },
+
+        None => congestion_event(r, 0, time_sent, epoch, now),
+    }
+
+    // Reductions caused by CE marks are never spurious, so make sure that
+    // the rollback that follows spurious losses doesn't undo them.
+    checkpoint(r);
+}
+
 fn checkpoint(r: &mut Recovery) {
     r.cubic_state.prior.congestion_window = r.congestion_window;
     r.cubic_state.prior.ssthresh = r.ssthresh;
@@ -478,6 +516,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         // Send initcwnd full MSS packets to become no longer app limited
@@ -495,6 +536,8 @@ mod tests {
             delivered_time: now,
             first_sent_time: now,
             is_app_limited: false,
+            tx_in_flight: 0,
+            lost: 0,
             rtt: Duration::ZERO,
         }];
 
@@ -526,6 +569,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         // Send initcwnd full MSS packets to become no longer app limited
@@ -544,6 +590,8 @@ mod tests {
                 delivered_time: now,
                 first_sent_time: now,
                 is_app_limited: false,
+                tx_in_flight: 0,
+                lost: 0,
                 rtt: Duration::ZERO,
             },
             Acked {
@@ -554,6 +602,8 @@ mod tests {
                 delivered_time: now,
                 first_sent_time: now,
                 is_app_limited: false,
+                tx_in_flight: 0,
+                lost: 0,
                 rtt: Duration::ZERO,
             },
             Acked {
@@ -564,6 +614,8 @@ mod tests {
                 delivered_time: now,
                 first_sent_time: now,
                 is_app_limited: false,
+                tx_in_flight: 0,
+                lost: 0,
                 rtt: Duration::ZERO,
             },
         ];
@@ -643,6 +695,8 @@ mod tests {
                 delivered_time: now,
                 first_sent_time: now,
                 is_app_limited: false,
+                tx_in_flight: 0,
+                lost: 0,
                 rtt: Duration::ZERO,
             }];
 
@@ -688,6 +742,8 @@ mod tests {
             delivered_time: now,
             first_sent_time: now,
             is_app_limited: false,
+            tx_in_flight: 0,
+            lost: 0,
             rtt: Duration::ZERO,
         }];
 
@@ -724,6 +780,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         // 1st round.
@@ -754,6 +813,8 @@ mod tests {
                 delivered_time: now,
                 first_sent_time: now,
                 is_app_limited: false,
+                tx_in_flight: 0,
+                lost: 0,
                 rtt: Duration::ZERO,
             }];
 
@@ -791,6 +852,8 @@ mod tests {
                 delivered_time: now,
                 first_sent_time: now,
                 is_app_limited: false,
+                tx_in_flight: 0,
+                lost: 0,
                 rtt: Duration::ZERO,
             }];
 
@@ -831,6 +894,8 @@ mod tests {
                 delivered_time: now,
                 first_sent_time: now,
                 is_app_limited: false,
+                tx_in_flight: 0,
+                lost: 0,
                 rtt: Duration::ZERO,
             }];
 
@@ -872,6 +937,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         // 1st round.
@@ -902,6 +970,8 @@ mod tests {
                 delivered_time: now,
                 first_sent_time: now,
                 is_app_limited: false,
+                tx_in_flight: 0,
+                lost: 0,
                 rtt: Duration::ZERO,
             }];
 
@@ -939,6 +1009,8 @@ mod tests {
                 delivered_time: now,
                 first_sent_time: now,
                 is_app_limited: false,
+                tx_in_flight: 0,
+                lost: 0,
                 rtt: Duration::ZERO,
             }];
 
@@ -977,6 +1049,8 @@ mod tests {
                     delivered_time: now,
                     first_sent_time: now,
                     is_app_limited: false,
+                    tx_in_flight: 0,
+                    lost: 0,
                     rtt: Duration::ZERO,
                 }];
 
@@ -1026,6 +1100,8 @@ mod tests {
             delivered_time: now,
             first_sent_time: now,
             is_app_limited: false,
+            tx_in_flight: 0,
+            lost: 0,
             rtt: Duration::ZERO,
         }];
 
@@ -1068,6 +1144,8 @@ mod tests {
             delivered_time: now,
             first_sent_time: now,
             is_app_limited: false,
+            tx_in_flight: 0,
+            lost: 0,
             rtt: Duration::ZERO,
         }];
 
@@ -1085,6 +1163,74 @@ mod tests {
         assert_eq!(r.cwnd(), prev_cwnd);
     }
 
+    #[test]
+    fn cubic_ecn_congestion_event() {
+        let mut cfg = crate::Config::new(crate::PROTOCOL_VERSION).unwrap();
+        cfg.set_cc_algorithm(recovery::CongestionControlAlgorithm::CUBIC);
+
+        let mut r = Recovery::new(&cfg);
+        let now = Instant::now();
+        let prev_cwnd = r.cwnd();
+
+        // Send initcwnd full MSS packets to become no longer app limited
+        for _ in 0..recovery::INITIAL_WINDOW_PACKETS {
+            r.on_packet_sent_cc(r.max_datagram_size, now);
+        }
+
+        // Packets are reported as CE-marked.
+        ecn_congestion_event(&mut r, None, now, packet::EPOCH_APPLICATION, now);
+
+        // The window is reduced like on a loss.
+        let cur_cwnd = (prev_cwnd as f64 * BETA_CUBIC) as usize;
+        assert_eq!(r.cwnd(), cur_cwnd);
+
+        let rtt = Duration::from_millis(100);
+
+        let acked = vec![Acked {
+            pkt_num: 0,
+            // To exit from recovery
+            time_sent: now + rtt,
+            size: r.max_datagram_size,
+            delivered: 0,
+            delivered_time: now,
+            first_sent_time: now,
+            is_app_limited: false,
+            tx_in_flight: 0,
+            lost: 0,
+            rtt: Duration::ZERO,
+        }];
+
+        r.update_rtt(rtt, Duration::from_millis(0), now);
+
+        // No packet was lost, but the reduction isn't undone as spurious.
+        r.on_packets_acked(
+            acked,
+            packet::EPOCH_APPLICATION,
+            now + rtt + Duration::from_millis(5),
+        );
+
+        assert!(r.cwnd() >= cur_cwnd);
+        assert!(r.cwnd() < prev_cwnd);
+
+        // Scalable response, the window is reduced by half the fraction of
+        // marked packets and the cubic curve restarts from there.
+        let now = now + rtt * 2;
+        let prev_cwnd = r.cwnd();
+
+        ecn_congestion_event(
+            &mut r,
+            Some(0.2),
+            now,
+            packet::EPOCH_APPLICATION,
+            now,
+        );
+
+        let cur_cwnd = (prev_cwnd as f64 * 0.9) as usize;
+        assert_eq!(r.cwnd(), cur_cwnd);
+        assert_eq!(r.cubic_state.w_max, cur_cwnd as f64);
+        assert_eq!(r.cubic_state.k, 0.0);
+    }
+
     #[test]
     fn cubic_fast_convergence() {
         let mut cfg = crate::Config::new(crate::PROTOCOL_VERSION).unwrap();
@@ -1132,6 +1278,8 @@ mod tests {
                 delivered_time: now,
                 first_sent_time: now,
                 is_app_limited: false,
+                tx_in_flight: 0,
+                lost: 0,
                 rtt: Duration::ZERO,
             }];
 
@@ -102,9 +102,10 @@ impl Rate {
         self.delivered_time = now;
 
         // Update info using the newest packet. If rate_sample is not yet
-        // initialized, initialize with the first packet.
+        // initialized, initialize with the first packet. Packets sent in the
+        // same flight share the delivered count, the later one is newer.
         if self.rate_sample.prior_time.is_none() ||
-            pkt.delivered > self.rate_sample.prior_delivered
+            pkt.delivered >= self.rate_sample.prior_delivered
         {
             self.rate_sample.prior_delivered = pkt.delivered;
             self.rate_sample.prior_time = Some(pkt.delivered_time);
@@ -112,6 +113,8 @@ impl Rate {
             self.rate_sample.send_elapsed =
                 pkt.time_sent.saturating_duration_since(pkt.first_sent_time);
             self.rate_sample.rtt = pkt.rtt;
+            self.rate_sample.tx_in_flight = pkt.tx_in_flight;
+            self.rate_sample.prior_lost = pkt.lost;
             self.rate_sample.ack_elapsed = self
                 .delivered_time
                 .saturating_duration_since(pkt.delivered_time);
@@ -162,7 +165,7 @@ impl Rate {
         self.end_of_app_limited != 0
     }
 
-    pub fn _delivered(&self) -> usize {
+    pub fn delivered(&self) -> usize {
         self.delivered
     }
 
@@ -170,13 +173,29 @@ impl Rate {
         self.rate_sample.delivery_rate
     }
 
-    pub fn _sample_rtt(&self) -> Duration {
+    pub fn sample_rtt(&self) -> Duration {
         self.rate_sample.rtt
     }
 
-    pub fn _sample_is_app_limited(&self) -> bool {
+    pub fn sample_is_app_limited(&self) -> bool {
         self.rate_sample.is_app_limited
     }
+
+    pub fn sample_delivered(&self) -> usize {
+        self.rate_sample.delivered
+    }
+
+    pub fn sample_prior_delivered(&self) -> usize {
+        self.rate_sample.prior_delivered
+    }
+
+    pub fn sample_tx_in_flight(&self) -> usize {
+        self.rate_sample.tx_in_flight
+    }
+
+    pub fn sample_prior_lost(&self) -> u64 {
+        self.rate_sample.prior_lost
+    }
 }
 
 #[derive(Default, Debug)]
@@ -198,6 +217,11 @@ struct RateSample {
     ack_elapsed: Duration,
 
     rtt: Duration,
+
+    // Bytes in flight and bytes lost when the newest acked packet was sent.
+    tx_in_flight: usize,
+
+    prior_lost: u64,
 }
 
 #[cfg(test)]
@@ -230,6 +254,9 @@ mod tests {
                 first_sent_time: now,
                 is_app_limited: false,
                 has_data: false,
+                ecn_marked: false,
+                tx_in_flight: 0,
+                lost: 0,
             };
 
             r.on_packet_sent(
@@ -255,6 +282,8 @@ mod tests {
                 delivered_time: now,
                 first_sent_time: now - rtt,
                 is_app_limited: false,
+                tx_in_flight: 0,
+                lost: 0,
             };
 
             r.delivery_rate.update_rate_sample(&acked, now);
@@ -264,7 +293,7 @@ mod tests {
         r.delivery_rate.generate_rate_sample(rtt);
 
         // Bytes acked so far.
-        assert_eq!(r.delivery_rate._delivered(), 2400);
+        assert_eq!(r.delivery_rate.delivered(), 2400);
 
         // Estimated delivery rate = (1200 x 2) / 0.05s = 48000.
         assert_eq!(r.delivery_rate(), 48000);
@@ -294,6 +323,9 @@ mod tests {
                 first_sent_time: now,
                 is_app_limited: false,
                 has_data: false,
+                ecn_marked: false,
+                tx_in_flight: 0,
+                lost: 0,
             };
 
             r.on_packet_sent(
@@ -306,7 +338,7 @@ mod tests {
         }
 
         assert_eq!(r.app_limited(), false);
-        assert_eq!(r.delivery_rate._sample_is_app_limited(), false);
+        assert_eq!(r.delivery_rate.sample_is_app_limited(), false);
     }
 
     #[test]
@@ -333,6 +365,9 @@ mod tests {
                 first_sent_time: now,
                 is_app_limited: false,
                 has_data: false,
+                ecn_marked: false,
+                tx_in_flight: 0,
+                lost: 0,
             };
 
             r.on_packet_sent(
@@ -354,6 +389,7 @@ mod tests {
             r.on_ack_received(
                 &acked,
                 25,
+                None,
                 packet::EPOCH_APPLICATION,
                 HandshakeStatus::default(),
                 now,
@@ -365,7 +401,7 @@ mod tests {
         assert_eq!(r.app_limited(), true);
 
         // Rate sample is not app limited (all acked).
-        assert_eq!(r.delivery_rate._sample_is_app_limited(), false);
-        assert_eq!(r.delivery_rate._sample_rtt(), rtt);
+        assert_eq!(r.delivery_rate.sample_is_app_limited(), false);
+        assert_eq!(r.delivery_rate.sample_rtt(), rtt);
     }
 }
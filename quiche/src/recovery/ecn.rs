@@ -0,0 +1,465 @@
+// Copyright (C) 2022, Cloudflare, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//! Explicit Congestion Notification.
+//!
+//! Packets are marked as ECN-capable only as long as the path is found to
+//! deliver the marks, following the validation described in RFC 9000 section
+//! 13.4.2. Packets the peer reports as CE-marked are then a congestion
+//! signal, either handled like a loss (RFC 9002 section 7.1) or, in scalable
+//! mode, used to estimate the extent of congestion as in DCTCP (RFC 8257),
+//! which L4S senders (RFC 9331) reduce their window in proportion to.
+
+use crate::frame;
+use crate::packet;
+
+/// Not ECN-Capable Transport.
+pub const NOT_ECT: u8 = 0b00;
+
+/// ECN-Capable Transport(1), used by L4S senders.
+pub const ECT1: u8 = 0b01;
+
+/// ECN-Capable Transport(0).
+pub const ECT0: u8 = 0b10;
+
+/// Congestion Experienced.
+pub const CE: u8 = 0b11;
+
+/// Number of datagrams marked before waiting for the path to be validated.
+const TESTING_DATAGRAMS: usize = 10;
+
+/// Weight given to the latest fraction of marked packets in the estimate of
+/// the extent of congestion (`g` in RFC 8257).
+const ALPHA_GAIN: f64 = 1.0 / 16.0;
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+enum State {
+    /// Packets are not marked.
+    Disabled,
+
+    /// The first datagrams are marked to test the path.
+    Testing,
+
+    /// Testing is over, packets are not marked until the marks sent so far
+    /// are acknowledged.
+    Unknown,
+
+    /// The path delivers the marks.
+    Capable,
+
+    /// The path or the peer loses or mangles the marks, packets are not
+    /// marked anymore.
+    Failed,
+}
+
+pub struct Ecn {
+    state: State,
+
+    /// The codepoint packets are marked with.
+    codepoint: u8,
+
+    /// Whether to respond to CE marks in proportion to their extent.
+    scalable: bool,
+
+    /// Number of datagrams marked while testing the path.
+    testing_sent: usize,
+
+    /// Number of marked packets sent in each packet number space.
+    marked_sent: [u64; packet::EPOCH_COUNT],
+
+    /// Number of marked packets declared lost.
+    marked_lost: u64,
+
+    /// Latest ECN counts reported by the peer in each packet number space.
+    counts: [frame::EcnCounts; packet::EPOCH_COUNT],
+
+    /// Estimate of the fraction of packets that are CE-marked.
+    alpha: f64,
+
+    /// The end of the current observation window, as the largest packet
+    /// number sent when it started.
+    window_end: Option<u64>,
+
+    /// Packets acknowledged during the current observation window.
+    window_acked: u64,
+
+    /// Packets reported as CE-marked during the current observation window.
+    window_marked: u64,
+}
+
+impl Ecn {
+    pub fn new(enabled: bool, scalable: bool) -> Self {
+        Ecn {
+            state: if enabled {
+                State::Testing
+            } else {
+                State::Disabled
+            },
+
+            codepoint: if scalable { ECT1 } else { ECT0 },
+
+            scalable,
+
+            testing_sent: 0,
+
+            marked_sent: [0; packet::EPOCH_COUNT],
+
+            marked_lost: 0,
+
+            counts: Default::default(),
+
+            // Start from the most conservative estimate, like DCTCP.
+            alpha: 1.0,
+
+            window_end: None,
+
+            window_acked: 0,
+
+            window_marked: 0,
+        }
+    }
+
+    /// Returns the codepoint the next datagram should be sent with.
+    pub fn codepoint(&self) -> u8 {
+        match self.state {
+            State::Testing | State::Capable => self.codepoint,
+
+            _ => NOT_ECT,
+        }
+    }
+
+    /// Returns whether the path was validated as delivering the marks.
+    #[cfg(test)]
+    pub fn is_capable(&self) -> bool {
+        self.state == State::Capable
+    }
+
+    /// Returns whether validation failed and marking was given up.
+    #[cfg(test)]
+    pub fn is_failed(&self) -> bool {
+        self.state == State::Failed
+    }
+
+    pub fn is_scalable(&self) -> bool {
+        self.scalable
+    }
+
+    pub fn alpha(&self) -> f64 {
+        self.alpha
+    }
+
+    /// Called after a datagram was sent with the codepoint returned by
+    /// `codepoint()`.
+    ///
+    /// All the packets coalesced in a datagram share its codepoint, so
+    /// testing is counted in datagrams rather than packets.
+    pub fn on_datagram_sent(&mut self) {
+        if self.state == State::Testing {
+            self.testing_sent += 1;
+
+            if self.testing_sent >= TESTING_DATAGRAMS {
+                self.state = State::Unknown;
+            }
+        }
+    }
+
+    pub fn on_marked_packet_sent(&mut self, epoch: packet::Epoch) {
+        self.marked_sent[epoch] += 1;
+    }
+
+    pub fn on_marked_packets_lost(&mut self, lost: u64) {
+        self.marked_lost += lost;
+
+        // All the packets sent while testing were lost, which could be
+        // because of the marks.
+        if self.state == State::Unknown &&
+            self.marked_lost >= self.marked_sent.iter().sum::<u64>()
+        {
+            self.state = State::Failed;
+        }
+    }
+
+    /// Processes the ECN counts of an ACK frame that newly acknowledged
+    /// `acked` packets, `marked` of which were sent with a codepoint, and
+    /// advanced the largest acknowledged packet number to `largest_acked`.
+    ///
+    /// Returns the number of packets newly reported as CE-marked, which is
+    /// always 0 when the path doesn't validate.
+    pub fn on_ack_received(
+        &mut self, counts: Option<&frame::EcnCounts>, acked: u64, marked: u64,
+        largest_acked: u64, largest_sent: u64, epoch: packet::Epoch,
+    ) -> u64 {
+        if !matches!(self.state, State::Testing | State::Unknown | State::Capable)
+        {
+            return 0;
+        }
+
+        let counts = match counts {
+            Some(v) => v,
+
+            // The marks were removed on the way.
+            None if marked > 0 => {
+                self.state = State::Failed;
+                return 0;
+            },
+
+            None => return 0,
+        };
+
+        let prev = &self.counts[epoch];
+
+        if counts.ect0_count < prev.ect0_count ||
+            counts.ect1_count < prev.ect1_count ||
+            counts.ecn_ce_count < prev.ecn_ce_count
+        {
+            self.state = State::Failed;
+            return 0;
+        }
+
+        let (count, prev_count, other_count) = if self.codepoint == ECT0 {
+            (counts.ect0_count, prev.ect0_count, counts.ect1_count)
+        } else {
+            (counts.ect1_count, prev.ect1_count, counts.ect0_count)
+        };
+
+        let ce = counts.ecn_ce_count - prev.ecn_ce_count;
+
+        // Marks were removed, or the peer reports more marked packets than
+        // were sent, or packets with a codepoint that was never sent.
+        if count - prev_count + ce < marked ||
+            count + counts.ecn_ce_count > self.marked_sent[epoch] ||
+            other_count > 0
+        {
+            self.state = State::Failed;
+            return 0;
+        }
+
+        self.counts[epoch] = counts.clone();
+
+        if marked > 0 && self.state != State::Capable {
+            self.state = State::Capable;
+        }
+
+        if epoch == packet::EPOCH_APPLICATION {
+            self.update_alpha(acked, ce, largest_acked, largest_sent);
+        }
+
+        ce
+    }
+
+    /// Updates the estimate of the fraction of CE-marked packets once per
+    /// observation window of about one round trip.
+    fn update_alpha(
+        &mut self, acked: u64, marked: u64, largest_acked: u64, largest_sent: u64,
+    ) {
+        self.window_acked += acked;
+        self.window_marked += marked;
+
+        let window_end = *self.window_end.get_or_insert(largest_sent);
+
+        if largest_acked < window_end || self.window_acked == 0 {
+            return;
+        }
+
+        let fraction =
+            f64::min(self.window_marked as f64 / self.window_acked as f64, 1.0);
+
+        self.alpha = (1.0 - ALPHA_GAIN) * self.alpha + ALPHA_GAIN * fraction;
+
+        self.window_end = Some(largest_sent);
+        self.window_acked = 0;
+        self.window_marked = 0;
+    }
+}
+
+impl std::fmt::Debug for Ecn {
+    fn fmt(&self, f: &mut std::fmt::Formatter) -> std::fmt::Result {
+        write!(f, "ecn={:?}", self.state)?;
+
+        if self.scalable {
+            write!(f, " ecn_alpha={:.3}", self.alpha)?;
+        }
+
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn counts(
+        ect0_count: u64, ect1_count: u64, ecn_ce_count: u64,
+    ) -> frame::EcnCounts {
+        frame::EcnCounts {
+            ect0_count,
+            ect1_count,
+            ecn_ce_count,
+        }
+    }
+
+    fn send(ecn: &mut Ecn, pkts: u64) {
+        for _ in 0..pkts {
+            if ecn.codepoint() != NOT_ECT {
+                ecn.on_marked_packet_sent(packet::EPOCH_APPLICATION);
+            }
+
+            ecn.on_datagram_sent();
+        }
+    }
+
+    #[test]
+    fn disabled() {
+        let mut ecn = Ecn::new(false, false);
+        assert_eq!(ecn.codepoint(), NOT_ECT);
+
+        send(&mut ecn, 5);
+
+        let c = counts(0, 0, 5);
+        assert_eq!(
+            ecn.on_ack_received(Some(&c), 5, 0, 4, 4, packet::EPOCH_APPLICATION),
+            0
+        );
+    }
+
+    #[test]
+    fn validation() {
+        let mut ecn = Ecn::new(true, false);
+        assert_eq!(ecn.codepoint(), ECT0);
+
+        send(&mut ecn, TESTING_DATAGRAMS as u64);
+
+        // Stop marking until the testing packets are acknowledged.
+        assert_eq!(ecn.codepoint(), NOT_ECT);
+        send(&mut ecn, 2);
+
+        let c = counts(4, 0, 1);
+        assert_eq!(
+            ecn.on_ack_received(Some(&c), 5, 5, 4, 11, packet::EPOCH_APPLICATION),
+            1
+        );
+        assert!(ecn.is_capable());
+        assert_eq!(ecn.codepoint(), ECT0);
+    }
+
+    #[test]
+    fn validation_bleached() {
+        let mut ecn = Ecn::new(true, false);
+
+        send(&mut ecn, 3);
+
+        // The marks were cleared on the path.
+        let c = counts(0, 0, 0);
+        ecn.on_ack_received(Some(&c), 3, 3, 2, 2, packet::EPOCH_APPLICATION);
+        assert!(ecn.is_failed());
+        assert_eq!(ecn.codepoint(), NOT_ECT);
+
+        let mut ecn = Ecn::new(true, false);
+
+        send(&mut ecn, 3);
+
+        // The peer doesn't report counts.
+        ecn.on_ack_received(None, 3, 3, 2, 2, packet::EPOCH_APPLICATION);
+        assert!(ecn.is_failed());
+    }
+
+    #[test]
+    fn validation_remarked() {
+        let mut ecn = Ecn::new(true, false);
+
+        send(&mut ecn, 3);
+
+        // ECT(0) was changed to ECT(1) on the path.
+        let c = counts(0, 3, 0);
+        ecn.on_ack_received(Some(&c), 3, 3, 2, 2, packet::EPOCH_APPLICATION);
+        assert!(ecn.is_failed());
+    }
+
+    #[test]
+    fn validation_testing_lost() {
+        let mut ecn = Ecn::new(true, false);
+
+        send(&mut ecn, TESTING_DATAGRAMS as u64);
+
+        ecn.on_marked_packets_lost(TESTING_DATAGRAMS as u64 - 1);
+        assert!(!ecn.is_failed());
+
+        ecn.on_marked_packets_lost(1);
+        assert!(ecn.is_failed());
+    }
+
+    #[test]
+    fn scalable_alpha() {
+        let mut ecn = Ecn::new(true, true);
+        assert_eq!(ecn.codepoint(), ECT1);
+
+        let mut sent = 0;
+        let mut reported = counts(0, 0, 0);
+
+        // No marks, alpha decays from 1.
+        for _ in 0..50 {
+            send(&mut ecn, 10);
+            sent += 10;
+
+            reported.ect1_count += 10;
+
+            ecn.on_ack_received(
+                Some(&reported),
+                10,
+                10,
+                sent - 1,
+                sent - 1,
+                packet::EPOCH_APPLICATION,
+            );
+        }
+
+        assert!(ecn.is_capable());
+        assert!(ecn.alpha() < 0.1);
+
+        // A quarter of the packets are marked, alpha converges to 0.25.
+        for _ in 0..200 {
+            send(&mut ecn, 8);
+            sent += 8;
+
+            reported.ect1_count += 6;
+            reported.ecn_ce_count += 2;
+
+            assert_eq!(
+                ecn.on_ack_received(
+                    Some(&reported),
+                    8,
+                    8,
+                    sent - 1,
+                    sent - 1,
+                    packet::EPOCH_APPLICATION,
+                ),
+                2
+            );
+        }
+
+        assert!((ecn.alpha() - 0.25).abs() < 0.01);
+    }
+}
@@ -0,0 +1,319 @@
+// Copyright (C) 2022, Cloudflare, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//! Ledger of the sent packets of a packet number space.
+//!
+//! Packets are kept in packet number order in a ring, so that the packet
+//! acknowledged by an ACK range is found from its number instead of by
+//! walking the ring from its start. The frames carried by the packets are
+//! moved out of them into a second ring shared by the whole packet number
+//! space, so that the packet metadata walked by ACK processing and loss
+//! detection stays small and no allocation is made per sent packet.
+
+use std::collections::VecDeque;
+
+use crate::frame;
+
+use crate::recovery::Sent;
+
+/// The position of the frames of a packet in the frames ring.
+#[derive(Clone, Copy, Default)]
+struct FrameSpan {
+    /// Sequence number of the first frame of the packet.
+    start: u64,
+
+    /// Number of frames not yet taken out of the ring.
+    len: usize,
+}
+
+#[derive(Default)]
+pub struct SentLedger {
+    /// Packets in packet number order, without their frames.
+    packets: VecDeque<Sent>,
+
+    /// Where the frames of each packet in `packets` are.
+    spans: VecDeque<FrameSpan>,
+
+    /// Frames of all the packets, in the order they were sent.
+    frames: VecDeque<frame::Frame>,
+
+    /// Sequence number of the frame at the front of `frames`.
+    frames_base: u64,
+
+    /// Index of a packet before which all packets are acked or lost.
+    settled: usize,
+}
+
+impl SentLedger {
+    /// Appends a packet, which must have a larger packet number than the
+    /// packets already in the ledger.
+    ///
+    /// The frames of the packet are moved into the ledger and the emptied
+    /// vector is returned, so that its allocation can be reused.
+    pub fn push(&mut self, mut pkt: Sent) -> Vec<frame::Frame> {
+        let start = self.frames_base + self.frames.len() as u64;
+        let len = pkt.frames.len();
+
+        self.frames.extend(pkt.frames.drain(..));
+
+        let frames = std::mem::take(&mut pkt.frames);
+
+        self.spans.push_back(FrameSpan { start, len });
+        self.packets.push_back(pkt);
+
+        frames
+    }
+
+    pub fn len(&self) -> usize {
+        self.packets.len()
+    }
+
+    pub fn get_mut(&mut self, i: usize) -> Option<&mut Sent> {
+        self.packets.get_mut(i)
+    }
+
+    pub fn iter(&self) -> impl Iterator<Item = &Sent> {
+        self.packets.iter()
+    }
+
+    /// Returns the index of the first packet with a packet number not lower
+    /// than `pkt_num`, or the number of packets if there is none.
+    ///
+    /// Packet numbers are usually contiguous, in which case the index is the
+    /// distance from the first packet number. Otherwise it is searched for.
+    pub fn lower_bound(&self, pkt_num: u64) -> usize {
+        let first = match self.packets.front() {
+            Some(v) => v.pkt_num,
+
+            None => return 0,
+        };
+
+        let i = pkt_num.saturating_sub(first) as usize;
+
+        match self.packets.get(i) {
+            Some(p) if p.pkt_num == pkt_num => i,
+
+            _ => self.packets.partition_point(|p| p.pkt_num < pkt_num),
+        }
+    }
+
+    /// Returns the index of the first packet that is neither acked nor lost,
+    /// or the number of packets if there is none.
+    ///
+    /// Lost packets are kept for a while after being declared lost, this lets
+    /// loss detection skip them instead of walking them at every ACK.
+    pub fn first_unsettled(&mut self) -> usize {
+        while let Some(p) = self.packets.get(self.settled) {
+            if p.time_acked.is_none() && p.time_lost.is_none() {
+                break;
+            }
+
+            self.settled += 1;
+        }
+
+        self.settled
+    }
+
+    /// Returns the frames of the `i`-th packet that were not taken yet.
+    pub fn frames(&self, i: usize) -> impl Iterator<Item = &frame::Frame> {
+        let span = self.spans[i];
+        let off = (span.start - self.frames_base) as usize;
+
+        self.frames.range(off..off + span.len)
+    }
+
+    /// Moves the frames of the `i`-th packet to `out`.
+    pub fn take_frames(&mut self, i: usize, out: &mut Vec<frame::Frame>) {
+        let span = &mut self.spans[i];
+        let off = (span.start - self.frames_base) as usize;
+
+        // The slots are released when the packet is drained, leave a frame
+        // that doesn't own any memory in their place.
+        out.extend(
+            self.frames
+                .range_mut(off..off + span.len)
+                .map(|f| std::mem::replace(f, frame::Frame::Padding { len: 0 })),
+        );
+
+        span.len = 0;
+    }
+
+    /// Removes the first `n` packets and their frames.
+    pub fn drain_front(&mut self, n: usize) {
+        if n == 0 {
+            return;
+        }
+
+        let frames_end = match self.spans.get(n) {
+            Some(span) => span.start,
+
+            None => self.frames_base + self.frames.len() as u64,
+        };
+
+        self.frames
+            .drain(..(frames_end - self.frames_base) as usize);
+        self.frames_base = frames_end;
+
+        self.spans.drain(..n);
+        self.packets.drain(..n);
+
+        self.settled = self.settled.saturating_sub(n);
+    }
+
+    pub fn clear(&mut self) {
+        self.frames_base += self.frames.len() as u64;
+
+        self.frames.clear();
+        self.spans.clear();
+        self.packets.clear();
+
+        self.settled = 0;
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    use std::time::Instant;
+
+    fn sent(pkt_num: u64, frames: Vec<frame::Frame>) -> Sent {
+        let now = Instant::now();
+
+        Sent {
+            pkt_num,
+            frames,
+            time_sent: now,
+            time_acked: None,
+            time_lost: None,
+            size: 1000,
+            ack_eliciting: true,
+            in_flight: true,
+            delivered: 0,
+            delivered_time: now,
+            first_sent_time: now,
+            is_app_limited: false,
+            has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
+        }
+    }
+
+    #[test]
+    fn lookup() {
+        let mut l = SentLedger::default();
+
+        assert_eq!(l.lower_bound(0), 0);
+
+        for pn in 5..10 {
+            l.push(sent(pn, vec![]));
+        }
+
+        // Gap in the packet numbers.
+        for pn in 20..25 {
+            l.push(sent(pn, vec![]));
+        }
+
+        assert_eq!(l.lower_bound(0), 0);
+        assert_eq!(l.lower_bound(5), 0);
+        assert_eq!(l.lower_bound(8), 3);
+        assert_eq!(l.lower_bound(10), 5);
+        assert_eq!(l.lower_bound(15), 5);
+        assert_eq!(l.lower_bound(22), 7);
+        assert_eq!(l.lower_bound(30), 10);
+
+        assert_eq!(l.iter().nth(l.lower_bound(22)).unwrap().pkt_num, 22);
+    }
+
+    #[test]
+    fn first_unsettled() {
+        let mut l = SentLedger::default();
+
+        for pn in 0..5 {
+            l.push(sent(pn, vec![]));
+        }
+
+        assert_eq!(l.first_unsettled(), 0);
+
+        l.get_mut(0).unwrap().time_acked = Some(Instant::now());
+        l.get_mut(1).unwrap().time_lost = Some(Instant::now());
+        l.get_mut(3).unwrap().time_acked = Some(Instant::now());
+
+        assert_eq!(l.first_unsettled(), 2);
+
+        l.get_mut(2).unwrap().time_acked = Some(Instant::now());
+
+        assert_eq!(l.first_unsettled(), 4);
+
+        l.drain_front(3);
+        assert_eq!(l.first_unsettled(), 1);
+
+        l.drain_front(2);
+        assert_eq!(l.first_unsettled(), 0);
+    }
+
+    #[test]
+    fn frames() {
+        let mut l = SentLedger::default();
+
+        let mut buf = l.push(sent(0, vec![frame::Frame::Ping]));
+        assert!(buf.is_empty());
+
+        buf.push(frame::Frame::Padding { len: 1 });
+        buf.push(frame::Frame::Padding { len: 2 });
+        l.push(sent(1, buf));
+
+        l.push(sent(2, vec![frame::Frame::HandshakeDone]));
+
+        assert_eq!(l.frames(1).count(), 2);
+        assert!(l.iter().all(|p| p.frames.is_empty()));
+
+        let mut out = Vec::new();
+        l.take_frames(1, &mut out);
+        assert_eq!(out, vec![
+            frame::Frame::Padding { len: 1 },
+            frame::Frame::Padding { len: 2 }
+        ]);
+        assert_eq!(l.frames(1).count(), 0);
+
+        // Draining a packet whose frames were taken.
+        l.drain_front(2);
+        assert_eq!(l.len(), 1);
+        assert_eq!(l.frames(0).collect::<Vec<_>>(), vec![
+            &frame::Frame::HandshakeDone
+        ]);
+
+        l.push(sent(3, vec![frame::Frame::Ping]));
+        assert_eq!(l.frames(1).collect::<Vec<_>>(), vec![&frame::Frame::Ping]);
+
+        l.clear();
+        assert_eq!(l.len(), 0);
+
+        l.push(sent(4, vec![frame::Frame::Ping]));
+        assert_eq!(l.frames(0).count(), 1);
+    }
+}
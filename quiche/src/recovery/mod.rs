@@ -31,8 +31,6 @@ use std::str::FromStr;
 use std::time::Duration;
 use std::time::Instant;
 
-use std::collections::VecDeque;
-
 use crate::Config;
 use crate::Error;
 use crate::Result;
@@ -82,6 +80,10 @@ pub struct Recovery {
 
     largest_sent_pkt: [u64; packet::EPOCH_COUNT],
 
+    /// First packet number of the application epoch sent on the current
+    /// path.
+    path_start: u64,
+
     latest_rtt: Duration,
 
     smoothed_rtt: Option<Duration>,
@@ -96,7 +98,9 @@ pub struct Recovery {
 
     loss_time: [Option<Instant>; packet::EPOCH_COUNT],
 
-    sent: [VecDeque<Sent>; packet::EPOCH_COUNT],
+    sent: [ledger::SentLedger; packet::EPOCH_COUNT],
+
+    frames_buf: Vec<frame::Frame>,
 
     pub lost: [Vec<frame::Frame>; packet::EPOCH_COUNT],
 
@@ -141,9 +145,18 @@ pub struct Recovery {
 
     cubic_state: cubic::State,
 
+    // BBRv2.
+    bbr2_state: bbr2::State,
+
     // HyStart++.
     hystart: hystart::Hystart,
 
+    // ECN.
+    pub ecn: ecn::Ecn,
+
+    // DPLPMTUD.
+    pub pmtud: pmtud::Pmtud,
+
     // Pacing.
     pacing_rate: u64,
 
@@ -162,6 +175,14 @@ pub struct Recovery {
 
 impl Recovery {
     pub fn new(config: &Config) -> Self {
+        // With path MTU discovery the configured size is only used once the
+        // path is found to carry it.
+        let max_datagram_size = if config.pmtud {
+            cmp::min(config.max_send_udp_payload_size, pmtud::BASE_PLPMTU)
+        } else {
+            config.max_send_udp_payload_size
+        };
+
         Recovery {
             loss_detection_timer: None,
 
@@ -173,6 +194,8 @@ impl Recovery {
 
             largest_sent_pkt: [0; packet::EPOCH_COUNT],
 
+            path_start: 0,
+
             latest_rtt: Duration::ZERO,
 
             // This field should be initialized to `INITIAL_RTT` for the initial
@@ -191,7 +214,9 @@ impl Recovery {
 
             loss_time: [None; packet::EPOCH_COUNT],
 
-            sent: [VecDeque::new(), VecDeque::new(), VecDeque::new()],
+            sent: Default::default(),
+
+            frames_buf: Vec::new(),
 
             lost: [Vec::new(), Vec::new(), Vec::new()],
 
@@ -204,8 +229,7 @@ impl Recovery {
 
             in_flight_count: [0; packet::EPOCH_COUNT],
 
-            congestion_window: config.max_send_udp_payload_size *
-                INITIAL_WINDOW_PACKETS,
+            congestion_window: max_datagram_size * INITIAL_WINDOW_PACKETS,
 
             pkt_thresh: INITIAL_PACKET_THRESHOLD,
 
@@ -225,7 +249,7 @@ impl Recovery {
 
             congestion_recovery_start_time: None,
 
-            max_datagram_size: config.max_send_udp_payload_size,
+            max_datagram_size,
 
             cc_ops: config.cc_algorithm.into(),
 
@@ -233,18 +257,26 @@ impl Recovery {
 
             cubic_state: cubic::State::default(),
 
+            bbr2_state: bbr2::State::new(),
+
             app_limited: false,
 
             hystart: hystart::Hystart::new(config.hystart),
 
+            ecn: ecn::Ecn::new(config.ecn, config.l4s),
+
+            pmtud: pmtud::Pmtud::new(
+                config.pmtud,
+                config.max_send_udp_payload_size,
+            ),
+
             pacing_rate: 0,
 
             last_packet_scheduled_time: Instant::now(),
 
             prr: prr::PRR::default(),
 
-            send_quantum: config.max_send_udp_payload_size *
-                INITIAL_WINDOW_PACKETS,
+            send_quantum: max_datagram_size * INITIAL_WINDOW_PACKETS,
 
             #[cfg(feature = "qlog")]
             qlog_metrics: QlogMetrics::default(),
@@ -267,6 +299,10 @@ impl Recovery {
         self.largest_sent_pkt[epoch] =
             cmp::max(self.largest_sent_pkt[epoch], pkt_num);
 
+        if pkt.ecn_marked {
+            self.ecn.on_marked_packet_sent(epoch);
+        }
+
         self.delivery_rate
             .on_packet_sent(&mut pkt, self.bytes_in_flight, now);
 
@@ -277,6 +313,9 @@ impl Recovery {
 
             self.in_flight_count[epoch] += 1;
 
+            pkt.tx_in_flight = self.bytes_in_flight + sent_bytes;
+            pkt.lost = self.bytes_lost;
+
             self.update_app_limited(
                 (self.bytes_in_flight + sent_bytes) < self.congestion_window,
             );
@@ -309,12 +348,24 @@ impl Recovery {
 
         pkt.time_sent = self.get_packet_send_time();
 
-        self.sent[epoch].push_back(pkt);
+        let frames_buf = self.sent[epoch].push(pkt);
+
+        if frames_buf.capacity() > self.frames_buf.capacity() {
+            self.frames_buf = frames_buf;
+        }
 
         self.bytes_sent += sent_bytes;
         trace!("{} {:?}", trace_id, self);
     }
 
+    /// Returns an empty vector to collect the frames of the next packet in.
+    ///
+    /// The vector is one that carried the frames of an earlier packet, whose
+    /// allocation is reused.
+    pub fn frames_buf(&mut self) -> Vec<frame::Frame> {
+        std::mem::take(&mut self.frames_buf)
+    }
+
     fn on_packet_sent_cc(&mut self, sent_bytes: usize, now: Instant) {
         (self.cc_ops.on_packet_sent)(self, sent_bytes, now);
     }
@@ -356,8 +407,8 @@ impl Recovery {
 
     pub fn on_ack_received(
         &mut self, ranges: &ranges::RangeSet, ack_delay: u64,
-        epoch: packet::Epoch, handshake_status: HandshakeStatus, now: Instant,
-        trace_id: &str,
+        ecn_counts: Option<&frame::EcnCounts>, epoch: packet::Epoch,
+        handshake_status: HandshakeStatus, now: Instant, trace_id: &str,
     ) -> Result<()> {
         let largest_acked = ranges.last().unwrap();
 
@@ -372,6 +423,12 @@ impl Recovery {
             return Err(Error::InvalidPacket);
         }
 
+        // ACK frames that arrive out of order carry older ECN counts, only
+        // the ones that advance the largest acked packet are processed.
+        let largest_acked_advanced = self.largest_acked_pkt[epoch] ==
+            std::u64::MAX ||
+            largest_acked > self.largest_acked_pkt[epoch];
+
         if self.largest_acked_pkt[epoch] == std::u64::MAX {
             self.largest_acked_pkt[epoch] = largest_acked;
         } else {
@@ -386,6 +443,10 @@ impl Recovery {
 
         let mut newly_acked = Vec::new();
 
+        let mut newly_acked_marked = 0;
+
+        let mut pmtu = None;
+
         let mut undo_cwnd = false;
 
         let max_rtt = cmp::max(self.latest_rtt, self.rtt());
@@ -396,18 +457,37 @@ impl Recovery {
             let lowest_acked_in_block = r.start;
             let largest_acked_in_block = r.end - 1;
 
-            let unacked_iter = self.sent[epoch]
-                .iter_mut()
-                // Skip packets that precede the lowest acked packet in the block.
-                .skip_while(|p| p.pkt_num < lowest_acked_in_block)
-                // Skip packets that follow the largest acked packet in the block.
-                .take_while(|p| p.pkt_num <= largest_acked_in_block)
+            // Start from the lowest acked packet in the block, instead of
+            // skipping the packets that precede it.
+            let mut i = self.sent[epoch].lower_bound(lowest_acked_in_block);
+
+            while let Some(unacked) = self.sent[epoch].get_mut(i) {
+                let idx = i;
+
+                i += 1;
+
+                // Stop at the packets that follow the largest acked packet in
+                // the block.
+                if unacked.pkt_num > largest_acked_in_block {
+                    break;
+                }
+
                 // Skip packets that have already been acked or lost.
-                .filter(|p| p.time_acked.is_none());
+                if unacked.time_acked.is_some() {
+                    continue;
+                }
 
-            for unacked in unacked_iter {
                 unacked.time_acked = Some(now);
 
+                // Packets sent on the previous path tell nothing about the
+                // current one.
+                if epoch == packet::EPOCH_APPLICATION &&
+                    unacked.pkt_num < self.path_start
+                {
+                    self.sent[epoch].take_frames(idx, &mut self.acked[epoch]);
+                    continue;
+                }
+
                 // Check if acked packet was already declared lost.
                 if unacked.time_lost.is_some() {
                     // Calculate new packet reordering threshold.
@@ -444,7 +524,20 @@ impl Recovery {
                 largest_newly_acked_pkt_num = unacked.pkt_num;
                 largest_newly_acked_sent_time = unacked.time_sent;
 
-                self.acked[epoch].append(&mut unacked.frames);
+                if unacked.ecn_marked {
+                    newly_acked_marked += 1;
+                }
+
+                // PMTU probes are only sent in the application epoch.
+                if epoch == packet::EPOCH_APPLICATION && self.pmtud.enabled() {
+                    if let Some(v) = self.pmtud.on_packet_acked(
+                        unacked.pkt_num,
+                        unacked.size,
+                        now,
+                    ) {
+                        pmtu = Some(v);
+                    }
+                }
 
                 if unacked.in_flight {
                     self.in_flight_count[epoch] =
@@ -467,9 +560,15 @@ impl Recovery {
                     first_sent_time: unacked.first_sent_time,
 
                     is_app_limited: unacked.is_app_limited,
+
+                    tx_in_flight: unacked.tx_in_flight,
+
+                    lost: unacked.lost,
                 });
 
                 trace!("{} packet newly acked {}", trace_id, unacked.pkt_num);
+
+                self.sent[epoch].take_frames(idx, &mut self.acked[epoch]);
             }
         }
 
@@ -478,6 +577,12 @@ impl Recovery {
             (self.cc_ops.rollback)(self);
         }
 
+        if let Some(pmtu) = pmtu {
+            trace!("{} path MTU raised to {}", trace_id, pmtu);
+
+            self.set_max_datagram_size(pmtu);
+        }
+
         if newly_acked.is_empty() {
             return Ok(());
         }
@@ -497,6 +602,32 @@ impl Recovery {
             self.update_rtt(latest_rtt, ack_delay, now);
         }
 
+        if largest_acked_advanced {
+            let ce_marked = self.ecn.on_ack_received(
+                ecn_counts,
+                newly_acked.len() as u64,
+                newly_acked_marked,
+                largest_acked,
+                self.largest_sent_pkt[epoch],
+                epoch,
+            );
+
+            if ce_marked > 0 {
+                trace!(
+                    "{} {} packets CE-marked on epoch {}",
+                    trace_id,
+                    ce_marked,
+                    epoch
+                );
+
+                self.ecn_congestion_event(
+                    largest_newly_acked_sent_time,
+                    epoch,
+                    now,
+                );
+            }
+        }
+
         // Detect and mark lost packets without removing them from the sent
         // packets list.
         self.detect_lost_packets(epoch, now, trace_id);
@@ -551,13 +682,15 @@ impl Recovery {
             cmp::min(self.pto_count as usize, MAX_PTO_PROBES_COUNT);
 
         let unacked_iter = self.sent[epoch]
-            .iter_mut()
+            .iter()
+            .enumerate()
             // Skip packets that have already been acked or lost, and packets
             // that don't contain either CRYPTO or STREAM frames.
-            .filter(|p| p.has_data && p.time_acked.is_none() && p.time_lost.is_none())
+            .filter(|(_, p)| p.has_data && p.time_acked.is_none() && p.time_lost.is_none())
             // Only return as many packets as the number of probe packets that
             // will be sent.
-            .take(self.loss_probes[epoch]);
+            .take(self.loss_probes[epoch])
+            .map(|(i, _)| i);
 
         // Retransmit the frames from the oldest sent packets on PTO. However
         // the packets are not actually declared lost (so there is no effect to
@@ -566,8 +699,8 @@ impl Recovery {
         // This will also trigger sending an ACK and retransmitting frames like
         // HANDSHAKE_DONE and MAX_DATA / MAX_STREAM_DATA as well, in addition
         // to CRYPTO and STREAM, if the original packet carried them.
-        for unacked in unacked_iter {
-            self.lost[epoch].extend_from_slice(&unacked.frames);
+        for i in unacked_iter {
+            self.lost[epoch].extend(self.sent[epoch].frames(i).cloned());
         }
 
         self.set_loss_detection_timer(handshake_status, now);
@@ -651,6 +784,73 @@ impl Recovery {
         }
 
         self.max_datagram_size = max_datagram_size;
+
+        self.pmtud.update_ceiling(new_max_datagram_size);
+    }
+
+    /// Changes the maximum datagram size to the path MTU found by PMTUD.
+    ///
+    /// The congestion window is kept as is, only its minimum follows the new
+    /// size.
+    fn set_max_datagram_size(&mut self, max_datagram_size: usize) {
+        self.max_datagram_size = max_datagram_size;
+
+        self.congestion_window = cmp::max(
+            self.congestion_window,
+            max_datagram_size * MINIMUM_WINDOW_PACKETS,
+        );
+    }
+
+    /// Starts congestion control and RTT estimation over on a new path.
+    ///
+    /// Packets sent on the previous path stop counting in flight, and their
+    /// acknowledgements only release the frames they carried.
+    pub fn on_path_change(&mut self, trace_id: &str) {
+        let epoch = packet::EPOCH_APPLICATION;
+
+        for i in self.sent[epoch].first_unsettled()..self.sent[epoch].len() {
+            if let Some(p) = self.sent[epoch].get_mut(i) {
+                p.in_flight = false;
+            }
+        }
+
+        self.bytes_in_flight = 0;
+        self.in_flight_count[epoch] = 0;
+        self.path_start = self.largest_sent_pkt[epoch] + 1;
+
+        self.pto_count = 0;
+
+        self.latest_rtt = Duration::ZERO;
+        self.smoothed_rtt = None;
+        self.rttvar = INITIAL_RTT / 2;
+        self.minmax_filter = minmax::Minmax::new(Duration::ZERO);
+        self.min_rtt = Duration::ZERO;
+
+        // The new path might not carry datagrams as large as the old one.
+        if self.pmtud.enabled() {
+            self.pmtud.reset();
+
+            self.max_datagram_size =
+                cmp::min(self.max_datagram_size, pmtud::BASE_PLPMTU);
+        }
+
+        self.congestion_window = self.max_datagram_size * INITIAL_WINDOW_PACKETS;
+        self.ssthresh = std::usize::MAX;
+        self.bytes_acked_sl = 0;
+        self.bytes_acked_ca = 0;
+        self.congestion_recovery_start_time = None;
+
+        self.cubic_state = cubic::State::default();
+        self.bbr2_state = bbr2::State::new();
+        self.hystart.reset();
+        self.prr = prr::PRR::default();
+        self.delivery_rate = delivery_rate::Rate::default();
+        self.pacing_rate = 0;
+        self.send_quantum = self.max_datagram_size * INITIAL_WINDOW_PACKETS;
+
+        self.on_init();
+
+        trace!("{} path changed {:?}", trace_id, self);
     }
 
     fn update_rtt(
@@ -794,26 +994,67 @@ impl Recovery {
 
         let mut largest_lost_pkt = None;
 
-        let unacked_iter = self.sent[epoch]
-            .iter_mut()
-            // Skip packets that follow the largest acked packet.
-            .take_while(|p| p.pkt_num <= largest_acked)
+        let mut marked_lost = 0;
+
+        let mut large_lost = 0;
+        let mut small_lost = 0;
+
+        // Skip the packets at the start of the list that have already been
+        // acked or lost.
+        let mut i = self.sent[epoch].first_unsettled();
+
+        while let Some(unacked) = self.sent[epoch].get_mut(i) {
+            let idx = i;
+
+            i += 1;
+
+            // Stop at the packets that follow the largest acked packet.
+            if unacked.pkt_num > largest_acked {
+                break;
+            }
+
             // Skip packets that have already been acked or lost.
-            .filter(|p| p.time_acked.is_none() && p.time_lost.is_none());
+            if unacked.time_acked.is_some() || unacked.time_lost.is_some() {
+                continue;
+            }
 
-        for unacked in unacked_iter {
             // Mark packet as lost, or set time when it should be marked.
             if unacked.time_sent <= lost_send_time ||
                 largest_acked >= unacked.pkt_num + self.pkt_thresh
             {
-                self.lost[epoch].append(&mut unacked.frames);
-
                 unacked.time_lost = Some(now);
 
+                // Losing a PMTU probe is no sign of congestion, and there is
+                // nothing to retransmit.
+                if epoch == packet::EPOCH_APPLICATION &&
+                    self.pmtud.on_packet_lost(unacked.pkt_num, now)
+                {
+                    trace!(
+                        "{} pmtu probe {} of {} bytes lost",
+                        trace_id,
+                        unacked.pkt_num,
+                        unacked.size
+                    );
+
+                    self.bytes_in_flight =
+                        self.bytes_in_flight.saturating_sub(unacked.size);
+
+                    self.in_flight_count[epoch] =
+                        self.in_flight_count[epoch].saturating_sub(1);
+
+                    continue;
+                }
+
+                if unacked.size > pmtud::BASE_PLPMTU {
+                    large_lost += 1;
+                } else if unacked.size > 0 {
+                    small_lost += 1;
+                }
+
                 if unacked.in_flight {
                     lost_bytes += unacked.size;
 
-                    // Frames have already been removed from the packet, so
+                    // Frames are kept out of the packet by the ledger, so
                     // cloning the whole packet should be relatively cheap.
                     largest_lost_pkt = Some(unacked.clone());
 
@@ -828,7 +1069,13 @@ impl Recovery {
                     );
                 }
 
+                if unacked.ecn_marked {
+                    marked_lost += 1;
+                }
+
                 self.lost_count += 1;
+
+                self.sent[epoch].take_frames(idx, &mut self.lost[epoch]);
             } else {
                 let loss_time = match self.loss_time[epoch] {
                     None => unacked.time_sent + loss_delay,
@@ -843,6 +1090,18 @@ impl Recovery {
 
         self.bytes_lost += lost_bytes as u64;
 
+        if marked_lost > 0 {
+            self.ecn.on_marked_packets_lost(marked_lost);
+        }
+
+        if let Some(pmtu) =
+            self.pmtud.on_packets_lost(large_lost, small_lost, now)
+        {
+            trace!("{} pmtu black hole, falling back to {}", trace_id, pmtu);
+
+            self.set_max_datagram_size(pmtu);
+        }
+
         if let Some(pkt) = largest_lost_pkt {
             self.on_packets_lost(lost_bytes, &pkt, epoch, now);
         }
@@ -878,7 +1137,7 @@ impl Recovery {
         }
 
         // Then remove elements up to the previously found index.
-        self.sent[epoch].drain(..lowest_non_expired_pkt_index);
+        self.sent[epoch].drain_front(lowest_non_expired_pkt_index);
     }
 
     fn on_packets_acked(
@@ -918,6 +1177,8 @@ impl Recovery {
     ) {
         self.bytes_in_flight = self.bytes_in_flight.saturating_sub(lost_bytes);
 
+        (self.cc_ops.on_packets_lost)(self, lost_bytes, largest_lost_pkt, now);
+
         self.congestion_event(lost_bytes, largest_lost_pkt.time_sent, epoch, now);
 
         if self.in_persistent_congestion(largest_lost_pkt.pkt_num) {
@@ -936,6 +1197,18 @@ impl Recovery {
         (self.cc_ops.congestion_event)(self, lost_bytes, time_sent, epoch, now);
     }
 
+    fn ecn_congestion_event(
+        &mut self, time_sent: Instant, epoch: packet::Epoch, now: Instant,
+    ) {
+        let alpha = if self.ecn.is_scalable() {
+            Some(self.ecn.alpha())
+        } else {
+            None
+        };
+
+        (self.cc_ops.ecn_congestion_event)(self, alpha, time_sent, epoch, now);
+    }
+
     fn collapse_cwnd(&mut self) {
         (self.cc_ops.collapse_cwnd)(self);
     }
@@ -970,6 +1243,14 @@ impl Recovery {
     pub fn send_quantum(&self) -> usize {
         self.send_quantum
     }
+
+    /// Sets the urgency, from 0.0 to 1.0, of the most urgent DTP block that
+    /// is waiting to be sent. Only congestion controllers that do their own
+    /// pacing make use of it.
+    #[cfg(feature = "dtp")]
+    pub fn set_dtp_urgency(&mut self, urgency: f64) {
+        self.bbr2_state.set_dtp_urgency(urgency);
+    }
 }
 
 /// Available congestion control algorithms.
@@ -983,6 +1264,8 @@ pub enum CongestionControlAlgorithm {
     Reno  = 0,
     /// CUBIC congestion control algorithm (default). `cubic` in a string form.
     CUBIC = 1,
+    /// BBRv2 congestion control algorithm. `bbr2` in a string form.
+    BBR2  = 2,
 }
 
 impl FromStr for CongestionControlAlgorithm {
@@ -995,6 +1278,7 @@ impl FromStr for CongestionControlAlgorithm {
         match name {
             "reno" => Ok(CongestionControlAlgorithm::Reno),
             "cubic" => Ok(CongestionControlAlgorithm::CUBIC),
+            "bbr2" => Ok(CongestionControlAlgorithm::BBR2),
 
             _ => Err(crate::Error::CongestionControl),
         }
@@ -1013,6 +1297,13 @@ pub struct CongestionControlOps {
         now: Instant,
     ),
 
+    pub on_packets_lost: fn(
+        r: &mut Recovery,
+        lost_bytes: usize,
+        largest_lost_pkt: &Sent,
+        now: Instant,
+    ),
+
     pub congestion_event: fn(
         r: &mut Recovery,
         lost_bytes: usize,
@@ -1021,6 +1312,18 @@ pub struct CongestionControlOps {
         now: Instant,
     ),
 
+    /// Called when the peer reports packets sent after `time_sent` as
+    /// CE-marked. `alpha` is the estimated fraction of marked packets when
+    /// the window should be reduced in proportion to it, or `None` when the
+    /// marks should be treated like a loss.
+    pub ecn_congestion_event: fn(
+        r: &mut Recovery,
+        alpha: Option<f64>,
+        time_sent: Instant,
+        epoch: packet::Epoch,
+        now: Instant,
+    ),
+
     pub collapse_cwnd: fn(r: &mut Recovery),
 
     pub checkpoint: fn(r: &mut Recovery),
@@ -1038,6 +1341,7 @@ impl From<CongestionControlAlgorithm> for &'static CongestionControlOps {
         match algo {
             CongestionControlAlgorithm::Reno => &reno::RENO,
             CongestionControlAlgorithm::CUBIC => &cubic::CUBIC,
+            CongestionControlAlgorithm::BBR2 => &bbr2::BBR2,
         }
     }
 }
@@ -1088,6 +1392,12 @@ impl std::fmt::Debug for Recovery {
             write!(f, "hystart={:?} ", self.hystart)?;
         }
 
+        write!(f, "{:?} ", self.ecn)?;
+
+        if self.pmtud.enabled() {
+            write!(f, "{:?} ", self.pmtud)?;
+        }
+
         // CC-specific debug info
         (self.cc_ops.debug_fmt)(self, f)?;
 
@@ -1122,6 +1432,15 @@ pub struct Sent {
     pub is_app_limited: bool,
 
     pub has_data: bool,
+
+    // Whether the packet was sent with an ECN-Capable Transport codepoint.
+    pub ecn_marked: bool,
+
+    // Bytes in flight when the packet was sent, including the packet itself.
+    pub tx_in_flight: usize,
+
+    // Bytes declared lost when the packet was sent.
+    pub lost: u64,
 }
 
 impl std::fmt::Debug for Sent {
@@ -1134,6 +1453,9 @@ impl std::fmt::Debug for Sent {
         write!(f, "first_sent_time={:?} ", self.first_sent_time.elapsed())?;
         write!(f, "is_app_limited={} ", self.is_app_limited)?;
         write!(f, "has_data={} ", self.has_data)?;
+        write!(f, "ecn_marked={} ", self.ecn_marked)?;
+        write!(f, "tx_in_flight={} ", self.tx_in_flight)?;
+        write!(f, "lost={} ", self.lost)?;
 
         Ok(())
     }
@@ -1156,6 +1478,10 @@ pub struct Acked {
     pub first_sent_time: Instant,
 
     pub is_app_limited: bool,
+
+    pub tx_in_flight: usize,
+
+    pub lost: u64,
 }
 
 #[derive(Clone, Copy, Debug)]
@@ -1349,6 +1675,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         r.on_packet_sent(
@@ -1375,6 +1704,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         r.on_packet_sent(
@@ -1401,6 +1733,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         r.on_packet_sent(
@@ -1427,6 +1762,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         r.on_packet_sent(
@@ -1450,6 +1788,7 @@ mod tests {
             r.on_ack_received(
                 &acked,
                 25,
+                None,
                 packet::EPOCH_APPLICATION,
                 HandshakeStatus::default(),
                 now,
@@ -1485,6 +1824,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         r.on_packet_sent(
@@ -1511,6 +1853,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         r.on_packet_sent(
@@ -1535,6 +1880,7 @@ mod tests {
             r.on_ack_received(
                 &acked,
                 25,
+                None,
                 packet::EPOCH_APPLICATION,
                 HandshakeStatus::default(),
                 now,
@@ -1582,6 +1928,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         r.on_packet_sent(
@@ -1608,6 +1957,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         r.on_packet_sent(
@@ -1634,6 +1986,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         r.on_packet_sent(
@@ -1660,6 +2015,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         r.on_packet_sent(
@@ -1684,6 +2042,7 @@ mod tests {
             r.on_ack_received(
                 &acked,
                 25,
+                None,
                 packet::EPOCH_APPLICATION,
                 HandshakeStatus::default(),
                 now,
@@ -1742,6 +2101,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         r.on_packet_sent(
@@ -1768,6 +2130,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         r.on_packet_sent(
@@ -1794,6 +2159,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         r.on_packet_sent(
@@ -1820,6 +2188,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         r.on_packet_sent(
@@ -1843,6 +2214,7 @@ mod tests {
             r.on_ack_received(
                 &acked,
                 25,
+                None,
                 packet::EPOCH_APPLICATION,
                 HandshakeStatus::default(),
                 now,
@@ -1862,6 +2234,7 @@ mod tests {
             r.on_ack_received(
                 &acked,
                 25,
+                None,
                 packet::EPOCH_APPLICATION,
                 HandshakeStatus::default(),
                 now,
@@ -1914,6 +2287,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         r.on_packet_sent(
@@ -1941,6 +2317,7 @@ mod tests {
             r.on_ack_received(
                 &acked,
                 10,
+                None,
                 packet::EPOCH_APPLICATION,
                 HandshakeStatus::default(),
                 now,
@@ -1968,6 +2345,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         r.on_packet_sent(
@@ -1999,6 +2379,9 @@ mod tests {
             first_sent_time: now,
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         r.on_packet_sent(
@@ -2022,10 +2405,520 @@ mod tests {
             now + Duration::from_secs_f64(6500.0 / pacing_rate as f64)
         );
     }
+
+    // Sends packets carrying 1000 bytes each, marked as the ECN state says.
+    fn send_ecn_flight(
+        r: &mut Recovery, pkt_nums: std::ops::Range<u64>, now: Instant,
+    ) {
+        for pkt_num in pkt_nums {
+            let p = Sent {
+                pkt_num,
+                frames: vec![],
+                time_sent: now,
+                time_acked: None,
+                time_lost: None,
+                size: 1000,
+                ack_eliciting: true,
+                in_flight: true,
+                delivered: 0,
+                delivered_time: now,
+                first_sent_time: now,
+                is_app_limited: false,
+                has_data: false,
+                ecn_marked: r.ecn.codepoint() != ecn::NOT_ECT,
+                tx_in_flight: 0,
+                lost: 0,
+            };
+
+            r.on_packet_sent(
+                p,
+                packet::EPOCH_APPLICATION,
+                HandshakeStatus::default(),
+                now,
+                "",
+            );
+
+            r.ecn.on_datagram_sent();
+        }
+    }
+
+    #[test]
+    fn ecn_ce() {
+        let mut cfg = crate::Config::new(crate::PROTOCOL_VERSION).unwrap();
+        cfg.set_cc_algorithm(CongestionControlAlgorithm::Reno);
+        cfg.enable_ecn(true);
+
+        let mut r = Recovery::new(&cfg);
+
+        let mut now = Instant::now();
+
+        assert_eq!(r.ecn.codepoint(), ecn::ECT0);
+
+        send_ecn_flight(&mut r, 0..10, now);
+
+        now += Duration::from_millis(50);
+
+        // The peer received all the marks.
+        let mut acked = ranges::RangeSet::default();
+        acked.insert(0..10);
+
+        let mut counts = frame::EcnCounts {
+            ect0_count: 10,
+            ect1_count: 0,
+            ecn_ce_count: 0,
+        };
+
+        assert_eq!(
+            r.on_ack_received(
+                &acked,
+                0,
+                Some(&counts),
+                packet::EPOCH_APPLICATION,
+                HandshakeStatus::default(),
+                now,
+                ""
+            ),
+            Ok(())
+        );
+
+        assert!(r.ecn.is_capable());
+
+        let cwnd = r.cwnd();
+
+        now += Duration::from_millis(1);
+
+        send_ecn_flight(&mut r, 10..20, now);
+
+        now += Duration::from_millis(50);
+
+        // A bottleneck marked some of the packets instead of dropping them.
+        acked.insert(10..20);
+
+        counts.ect0_count += 6;
+        counts.ecn_ce_count += 4;
+
+        assert_eq!(
+            r.on_ack_received(
+                &acked,
+                0,
+                Some(&counts),
+                packet::EPOCH_APPLICATION,
+                HandshakeStatus::default(),
+                now,
+                ""
+            ),
+            Ok(())
+        );
+
+        assert_eq!(r.cwnd(), cwnd / 2);
+        assert_eq!(r.lost_count, 0);
+
+        // An older ACK frame that arrives late is ignored.
+        let mut acked = ranges::RangeSet::default();
+        acked.insert(0..10);
+
+        let old_counts = frame::EcnCounts {
+            ect0_count: 10,
+            ect1_count: 0,
+            ecn_ce_count: 0,
+        };
+
+        assert_eq!(
+            r.on_ack_received(
+                &acked,
+                0,
+                Some(&old_counts),
+                packet::EPOCH_APPLICATION,
+                HandshakeStatus::default(),
+                now,
+                ""
+            ),
+            Ok(())
+        );
+
+        assert!(r.ecn.is_capable());
+    }
+
+    #[test]
+    fn ecn_ce_scalable() {
+        let mut cfg = crate::Config::new(crate::PROTOCOL_VERSION).unwrap();
+        cfg.set_cc_algorithm(CongestionControlAlgorithm::Reno);
+        cfg.enable_ecn(true);
+        cfg.enable_l4s(true);
+
+        let mut r = Recovery::new(&cfg);
+
+        let mut now = Instant::now();
+
+        assert_eq!(r.ecn.codepoint(), ecn::ECT1);
+
+        let mut acked = ranges::RangeSet::default();
+
+        let mut counts = frame::EcnCounts::default();
+
+        let mut pkt_num = 0;
+
+        let mut cwnd = r.cwnd();
+
+        // Every round trip, the bottleneck marks one packet in ten.
+        for round in 0..20 {
+            now += Duration::from_millis(1);
+
+            send_ecn_flight(&mut r, pkt_num..pkt_num + 10, now);
+
+            // The flight is paced out, acknowledge it once it's all sent.
+            now = r.get_packet_send_time() + Duration::from_millis(50);
+
+            acked.insert(pkt_num..pkt_num + 10);
+            pkt_num += 10;
+
+            if round > 0 {
+                counts.ect1_count += 9;
+                counts.ecn_ce_count += 1;
+            } else {
+                counts.ect1_count += 10;
+            }
+
+            assert_eq!(
+                r.on_ack_received(
+                    &acked,
+                    0,
+                    Some(&counts),
+                    packet::EPOCH_APPLICATION,
+                    HandshakeStatus::default(),
+                    now,
+                    ""
+                ),
+                Ok(())
+            );
+
+            if round > 0 {
+                // The window is reduced by half the estimated fraction of
+                // marked packets.
+                let expected =
+                    (cwnd as f64 * (1.0 - r.ecn.alpha() / 2.0)) as usize;
+
+                assert_eq!(
+                    r.cwnd(),
+                    cmp::max(
+                        expected,
+                        r.max_datagram_size * MINIMUM_WINDOW_PACKETS
+                    )
+                );
+            }
+
+            cwnd = r.cwnd();
+        }
+
+        // The estimate converges towards the actual fraction.
+        assert!(r.ecn.alpha() > 0.1 && r.ecn.alpha() < 0.5);
+        assert_eq!(r.lost_count, 0);
+    }
+
+    fn send_sized(r: &mut Recovery, pkt_num: u64, size: usize, now: Instant) {
+        let p = Sent {
+            pkt_num,
+            frames: vec![],
+            time_sent: now,
+            time_acked: None,
+            time_lost: None,
+            size,
+            ack_eliciting: true,
+            in_flight: true,
+            delivered: 0,
+            delivered_time: now,
+            first_sent_time: now,
+            is_app_limited: false,
+            has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
+        };
+
+        r.on_packet_sent(
+            p,
+            packet::EPOCH_APPLICATION,
+            HandshakeStatus::default(),
+            now,
+            "",
+        );
+    }
+
+    fn ack_range(r: &mut Recovery, pkt_nums: std::ops::Range<u64>, now: Instant) {
+        let mut acked = ranges::RangeSet::default();
+        acked.insert(pkt_nums);
+
+        assert_eq!(
+            r.on_ack_received(
+                &acked,
+                25,
+                None,
+                packet::EPOCH_APPLICATION,
+                HandshakeStatus::default(),
+                now,
+                ""
+            ),
+            Ok(())
+        );
+    }
+
+    #[test]
+    fn pmtud_probe() {
+        let mut cfg = crate::Config::new(crate::PROTOCOL_VERSION).unwrap();
+        cfg.set_cc_algorithm(CongestionControlAlgorithm::Reno);
+        cfg.set_max_send_udp_payload_size(1500);
+        cfg.discover_pmtu(true);
+
+        let mut r = Recovery::new(&cfg);
+
+        let mut now = Instant::now();
+
+        // Only the base size is used until the path is found to carry more.
+        assert_eq!(r.max_datagram_size(), pmtud::BASE_PLPMTU);
+        assert_eq!(r.cwnd(), pmtud::BASE_PLPMTU * INITIAL_WINDOW_PACKETS);
+
+        assert_eq!(r.pmtud.probe_size(usize::MAX, now), Some(1500));
+
+        send_sized(&mut r, 0, 1500, now);
+        r.pmtud.on_probe_sent(0, 1500);
+
+        for pkt_num in 1..4 {
+            send_sized(&mut r, pkt_num, 1200, now);
+        }
+
+        let cwnd = r.cwnd();
+
+        now += Duration::from_millis(10);
+
+        ack_range(&mut r, 1..4, now);
+
+        // The probe was declared lost, without reducing the window.
+        assert!(r.cwnd() >= cwnd);
+        assert_eq!(r.lost_count, 0);
+        assert_eq!(r.bytes_in_flight, 0);
+        assert_eq!(r.max_datagram_size(), pmtud::BASE_PLPMTU);
+
+        // The next probe gets through.
+        assert_eq!(r.pmtud.probe_size(usize::MAX, now), Some(1500));
+
+        send_sized(&mut r, 4, 1500, now);
+        r.pmtud.on_probe_sent(4, 1500);
+
+        now += Duration::from_millis(10);
+
+        ack_range(&mut r, 4..5, now);
+
+        assert_eq!(r.max_datagram_size(), 1500);
+        assert_eq!(r.pmtud.probe_size(usize::MAX, now), None);
+    }
+
+    #[test]
+    fn pmtud_black_hole() {
+        let mut cfg = crate::Config::new(crate::PROTOCOL_VERSION).unwrap();
+        cfg.set_cc_algorithm(CongestionControlAlgorithm::Reno);
+        cfg.set_max_send_udp_payload_size(1500);
+        cfg.discover_pmtu(true);
+
+        let mut r = Recovery::new(&cfg);
+
+        let mut now = Instant::now();
+
+        send_sized(&mut r, 0, 1500, now);
+        r.pmtud.on_probe_sent(0, 1500);
+
+        now += Duration::from_millis(10);
+
+        ack_range(&mut r, 0..1, now);
+
+        assert_eq!(r.max_datagram_size(), 1500);
+
+        // The path stops carrying full-sized packets, smaller ones still get
+        // through.
+        let mut pkt_num = 1;
+
+        for _ in 0..3 {
+            send_sized(&mut r, pkt_num, 1500, now);
+
+            for i in 1..4 {
+                send_sized(&mut r, pkt_num + i, 100, now);
+            }
+
+            now += Duration::from_millis(10);
+
+            ack_range(&mut r, pkt_num + 1..pkt_num + 4, now);
+
+            pkt_num += 4;
+        }
+
+        assert_eq!(r.lost_count, 3);
+        assert_eq!(r.max_datagram_size(), pmtud::BASE_PLPMTU);
+    }
+
+    #[test]
+    fn path_change() {
+        let mut cfg = crate::Config::new(crate::PROTOCOL_VERSION).unwrap();
+        cfg.set_cc_algorithm(CongestionControlAlgorithm::Reno);
+
+        let mut r = Recovery::new(&cfg);
+
+        let mut now = Instant::now();
+
+        let initial_cwnd = r.cwnd();
+
+        for pkt_num in 0..12 {
+            send_sized(&mut r, pkt_num, 1000, now);
+        }
+
+        now += Duration::from_millis(50);
+
+        ack_range(&mut r, 0..6, now);
+
+        assert_eq!(r.rtt(), Duration::from_millis(50));
+        assert!(r.cwnd() > initial_cwnd);
+        assert_eq!(r.bytes_in_flight, 6000);
+
+        r.on_path_change("");
+
+        assert_eq!(r.rtt(), INITIAL_RTT);
+        assert_eq!(r.cwnd(), initial_cwnd);
+        assert_eq!(r.bytes_in_flight, 0);
+
+        send_sized(&mut r, 12, 1000, now);
+
+        // Packets of the old path acked late don't grow the window or give
+        // RTT samples.
+        now += Duration::from_millis(200);
+
+        ack_range(&mut r, 6..12, now);
+
+        assert_eq!(r.rtt(), INITIAL_RTT);
+        assert_eq!(r.cwnd(), initial_cwnd);
+        assert_eq!(r.bytes_in_flight, 1000);
+
+        ack_range(&mut r, 12..13, now);
+
+        assert_eq!(r.rtt(), Duration::from_millis(200));
+        assert_eq!(r.bytes_in_flight, 0);
+    }
+
+    // Cost of ACK processing at 1M packets/s, with one packet in a hundred
+    // lost and ACK frames carrying the last 256 packet numbers.
+    //
+    // Run with `cargo test --release -- --ignored --nocapture ack_1m_pps`.
+    #[test]
+    #[ignore]
+    fn ack_1m_pps() {
+        const PKTS: u64 = 1_000_000;
+        const ACK_EVERY: u64 = 2;
+        const ACK_WINDOW: u64 = 256;
+
+        let cfg = crate::Config::new(crate::PROTOCOL_VERSION).unwrap();
+
+        let mut r = Recovery::new(&cfg);
+
+        let start = Instant::now();
+        let rtt = Duration::from_millis(10);
+
+        let mut ack_time = Duration::ZERO;
+        let mut acks = 0;
+
+        for pn in 0..PKTS {
+            let now = start + Duration::from_micros(pn);
+
+            let mut frames = r.frames_buf();
+            frames.push(frame::Frame::Ping);
+
+            let p = Sent {
+                pkt_num: pn,
+                frames,
+                time_sent: now,
+                time_acked: None,
+                time_lost: None,
+                size: 1200,
+                ack_eliciting: true,
+                in_flight: true,
+                delivered: 0,
+                delivered_time: now,
+                first_sent_time: now,
+                is_app_limited: false,
+                has_data: true,
+                ecn_marked: false,
+                tx_in_flight: 0,
+                lost: 0,
+            };
+
+            // Keep the sender from being cwnd or pacing limited, so that the
+            // packets leave at the rate they are sent at.
+            r.congestion_window = usize::MAX / 2;
+
+            r.on_packet_sent(
+                p,
+                packet::EPOCH_APPLICATION,
+                HandshakeStatus::default(),
+                now,
+                "",
+            );
+
+            // ACK what the peer received one RTT ago.
+            let largest = match pn.checked_sub(rtt.as_micros() as u64) {
+                Some(v) if v % ACK_EVERY == 0 => v,
+
+                _ => continue,
+            };
+
+            let mut acked = ranges::RangeSet::default();
+            let mut block_start = largest.saturating_sub(ACK_WINDOW);
+
+            for pn in block_start..=largest + 1 {
+                if pn % 100 == 7 || pn == largest + 1 {
+                    if block_start < pn {
+                        acked.insert(block_start..pn);
+                    }
+
+                    block_start = pn + 1;
+                }
+            }
+
+            let t = Instant::now();
+
+            r.on_ack_received(
+                &acked,
+                0,
+                None,
+                packet::EPOCH_APPLICATION,
+                HandshakeStatus::default(),
+                now,
+                "",
+            )
+            .unwrap();
+
+            ack_time += t.elapsed();
+            acks += 1;
+
+            r.acked[packet::EPOCH_APPLICATION].clear();
+            r.lost[packet::EPOCH_APPLICATION].clear();
+        }
+
+        println!(
+            "{} packets, {} ACKs processed in {:?} ({:?} per ACK), {} sent \
+             packets tracked",
+            PKTS,
+            acks,
+            ack_time,
+            ack_time / acks,
+            r.sent[packet::EPOCH_APPLICATION].len()
+        );
+
+        assert!(r.lost_count >= (PKTS / 100 - 100) as usize);
+    }
 }
 
+mod bbr2;
 mod cubic;
 mod delivery_rate;
+pub mod ecn;
 mod hystart;
+mod ledger;
+pub mod pmtud;
 mod prr;
 mod reno;
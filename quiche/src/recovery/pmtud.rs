@@ -0,0 +1,426 @@
+// Copyright (C) 2022, Cloudflare, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+//     * Redistributions of source code must retain the above copyright notice,
+//       this list of conditions and the following disclaimer.
+//
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in the
+//       documentation and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+// IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+// PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+// CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+// EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+// PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+// PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+//! Datagram Packetization Layer Path MTU Discovery.
+//!
+//! Starting from the datagram size every QUIC path supports, larger sizes are
+//! probed with packets made of a PING frame padded to the probed size, as
+//! described in RFC 8899 and RFC 9000 section 14.3. The largest size the
+//! endpoints accept is probed first, so that paths that carry it are used at
+//! full size after a single round trip, then the search narrows down on the
+//! largest size that gets through. Once the search completes, it is started
+//! again after a while, in case the path changed.
+//!
+//! When packets larger than the base size keep being lost while smaller ones
+//! get through, the path is assumed to have become a black hole for them and
+//! the datagram size falls back to the base size.
+
+use std::cmp;
+
+use std::time::Duration;
+use std::time::Instant;
+
+/// The datagram size every QUIC path supports (`BASE_PLPMTU` in RFC 8899).
+pub const BASE_PLPMTU: usize = 1200;
+
+/// Number of probes of a given size lost in a row after which the size is
+/// deemed too large for the path.
+const MAX_PROBES: usize = 3;
+
+/// The search completes once the candidate sizes are closer than this to each
+/// other.
+const MIN_SEARCH_STEP: usize = 16;
+
+/// How long after the search completed to search again for a larger size.
+const RAISE_TIMER: Duration = Duration::from_secs(600);
+
+/// Number of losses of packets larger than the base size, with no such packet
+/// acknowledged in between, after which the path is assumed to be a black
+/// hole for them.
+const BLACK_HOLE_THRESHOLD: usize = 3;
+
+pub struct Pmtud {
+    enabled: bool,
+
+    /// The largest datagram size the path was found to carry.
+    pmtu: usize,
+
+    /// The largest datagram size the endpoints accept.
+    ceiling: usize,
+
+    /// The largest datagram size not yet found too large.
+    max: usize,
+
+    /// The size to probe next, or `None` when not searching.
+    candidate: Option<usize>,
+
+    /// Packet number and size of the probe in flight.
+    probe: Option<(u64, usize)>,
+
+    /// Number of probes of the candidate size lost in a row.
+    probes_lost: usize,
+
+    /// When to search again once the search completed.
+    raise_time: Option<Instant>,
+
+    /// Losses of packets larger than the base size since one was acked.
+    black_hole_losses: usize,
+}
+
+impl Pmtud {
+    pub fn new(enabled: bool, ceiling: usize) -> Self {
+        let ceiling = cmp::max(ceiling, BASE_PLPMTU);
+
+        Pmtud {
+            enabled,
+
+            pmtu: BASE_PLPMTU,
+
+            ceiling,
+
+            max: ceiling,
+
+            candidate: if enabled && ceiling > BASE_PLPMTU {
+                Some(ceiling)
+            } else {
+                None
+            },
+
+            probe: None,
+
+            probes_lost: 0,
+
+            raise_time: None,
+
+            black_hole_losses: 0,
+        }
+    }
+
+    pub fn enabled(&self) -> bool {
+        self.enabled
+    }
+
+    /// Starts the search over, e.g. when the peer moved to another path.
+    pub fn reset(&mut self) {
+        *self = Pmtud::new(self.enabled, self.ceiling);
+    }
+
+    /// Lowers the largest size that is probed, e.g. to the maximum UDP payload
+    /// size of the peer.
+    pub fn update_ceiling(&mut self, ceiling: usize) {
+        self.ceiling = cmp::max(cmp::min(self.ceiling, ceiling), BASE_PLPMTU);
+        self.max = cmp::min(self.max, self.ceiling);
+
+        self.candidate = self
+            .candidate
+            .map(|v| cmp::min(v, self.max))
+            .filter(|v| *v > self.pmtu);
+    }
+
+    /// Returns the size of the probe to send next, if one should be sent.
+    ///
+    /// Probes are never larger than `limit`, which lowers the largest size
+    /// that is probed otherwise.
+    pub fn probe_size(&mut self, limit: usize, now: Instant) -> Option<usize> {
+        if !self.enabled || self.probe.is_some() {
+            return None;
+        }
+
+        if self.candidate.is_none() && self.raise_time.map_or(false, |t| now >= t)
+        {
+            self.raise_time = None;
+
+            self.max = self.ceiling;
+
+            if self.max > self.pmtu {
+                self.candidate = Some(self.max);
+            }
+        }
+
+        if self.candidate? > limit {
+            self.update_ceiling(limit);
+        }
+
+        self.candidate
+    }
+
+    pub fn on_probe_sent(&mut self, pkt_num: u64, size: usize) {
+        self.probe = Some((pkt_num, size));
+    }
+
+    /// Updates the search when the packet with the given number and size is
+    /// acknowledged, and returns the new path MTU if it was a probe.
+    pub fn on_packet_acked(
+        &mut self, pkt_num: u64, size: usize, now: Instant,
+    ) -> Option<usize> {
+        if size > BASE_PLPMTU {
+            self.black_hole_losses = 0;
+        }
+
+        match self.probe {
+            Some((probe_pkt_num, probe_size)) if probe_pkt_num == pkt_num => {
+                self.probe = None;
+                self.probes_lost = 0;
+
+                self.pmtu = cmp::max(self.pmtu, probe_size);
+                self.max = cmp::max(self.max, self.pmtu);
+
+                self.search(now);
+
+                Some(self.pmtu)
+            },
+
+            _ => None,
+        }
+    }
+
+    /// Updates the search when the packet with the given number is declared
+    /// lost, and returns whether it was a probe.
+    pub fn on_packet_lost(&mut self, pkt_num: u64, now: Instant) -> bool {
+        match self.probe {
+            Some((probe_pkt_num, probe_size)) if probe_pkt_num == pkt_num => {
+                self.probe = None;
+                self.probes_lost += 1;
+
+                if self.probes_lost >= MAX_PROBES {
+                    self.probes_lost = 0;
+
+                    self.max = cmp::max(probe_size - 1, self.pmtu);
+
+                    self.search(now);
+                }
+
+                true
+            },
+
+            _ => false,
+        }
+    }
+
+    /// Checks for a black hole after packets that were not probes were
+    /// declared lost, `large` of them larger than the base size and `small`
+    /// of them not, and returns the size to fall back to if one is found.
+    pub fn on_packets_lost(
+        &mut self, large: usize, small: usize, now: Instant,
+    ) -> Option<usize> {
+        if !self.enabled || self.pmtu <= BASE_PLPMTU || large == 0 || small > 0 {
+            return None;
+        }
+
+        self.black_hole_losses += 1;
+
+        if self.black_hole_losses < BLACK_HOLE_THRESHOLD {
+            return None;
+        }
+
+        self.black_hole_losses = 0;
+
+        // The size that stopped getting through is only probed again when
+        // the raise timer expires.
+        self.max = self.pmtu - 1;
+        self.pmtu = BASE_PLPMTU;
+
+        self.probe = None;
+        self.probes_lost = 0;
+
+        self.search(now);
+
+        Some(self.pmtu)
+    }
+
+    /// Picks the next size to probe, halfway between the sizes known to get
+    /// through and not to.
+    fn search(&mut self, now: Instant) {
+        if self.max < self.pmtu + MIN_SEARCH_STEP {
+            self.candidate = None;
+
+            self.raise_time = if self.pmtu < self.ceiling {
+                Some(now + RAISE_TIMER)
+            } else {
+                None
+            };
+
+            return;
+        }
+
+        self.candidate = Some(self.pmtu + (self.max - self.pmtu + 1) / 2);
+    }
+}
+
+impl std::fmt::Debug for Pmtud {
+    fn fmt(&self, f: &mut std::fmt::Formatter) -> std::fmt::Result {
+        write!(f, "pmtu={}", self.pmtu)?;
+
+        if let Some(v) = self.candidate {
+            write!(f, " pmtu_probe={}", v)?;
+        }
+
+        Ok(())
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    // Probes the candidate sizes until the search completes on a path
+    // carrying datagrams up to `path_mtu` bytes, and returns the sizes that
+    // were probed.
+    fn search(p: &mut Pmtud, path_mtu: usize, now: Instant) -> Vec<usize> {
+        let mut probed = Vec::new();
+        let mut pkt_num = 0;
+
+        while let Some(size) = p.probe_size(usize::MAX, now) {
+            p.on_probe_sent(pkt_num, size);
+
+            if size <= path_mtu {
+                assert_eq!(p.on_packet_acked(pkt_num, size, now), Some(p.pmtu));
+            } else {
+                assert!(p.on_packet_lost(pkt_num, now));
+            }
+
+            probed.push(size);
+            pkt_num += 1;
+        }
+
+        probed
+    }
+
+    #[test]
+    fn disabled() {
+        let mut p = Pmtud::new(false, 9000);
+
+        assert_eq!(p.probe_size(usize::MAX, Instant::now()), None);
+        assert_eq!(p.on_packets_lost(10, 0, Instant::now()), None);
+    }
+
+    #[test]
+    fn ceiling_reached() {
+        let now = Instant::now();
+
+        let mut p = Pmtud::new(true, 9000);
+        p.update_ceiling(8952);
+
+        assert_eq!(search(&mut p, 9000, now), vec![8952]);
+        assert_eq!(p.pmtu, 8952);
+
+        // There's nothing larger to search for.
+        assert_eq!(p.raise_time, None);
+    }
+
+    #[test]
+    fn binary_search() {
+        let now = Instant::now();
+
+        let mut p = Pmtud::new(true, 8952);
+
+        let probed = search(&mut p, 1500, now);
+
+        // The ceiling is probed first, until it's lost MAX_PROBES times.
+        assert_eq!(&probed[..MAX_PROBES], &[8952; MAX_PROBES]);
+
+        assert!(p.pmtu <= 1500);
+        assert!(p.pmtu > 1500 - MIN_SEARCH_STEP);
+
+        // Each size that doesn't get through is probed the same number of
+        // times, the ones that do only once.
+        let lost = probed.iter().filter(|v| **v > 1500).count();
+        assert_eq!(lost % MAX_PROBES, 0);
+        assert!(probed.len() - lost < 10);
+
+        // The search completed, it's started again after a while.
+        assert_eq!(p.probe_size(usize::MAX, now), None);
+        assert_eq!(p.probe_size(usize::MAX, now + RAISE_TIMER), Some(8952));
+    }
+
+    #[test]
+    fn limit() {
+        let now = Instant::now();
+
+        let mut p = Pmtud::new(true, 8952);
+
+        // The buffer used to send probes is smaller than the ceiling.
+        assert_eq!(p.probe_size(1500, now), Some(1500));
+        assert_eq!(p.ceiling, 1500);
+
+        // Nothing to search for once the peer is found to accept less than
+        // the base size.
+        p.update_ceiling(1000);
+        assert_eq!(p.probe_size(1500, now), None);
+    }
+
+    #[test]
+    fn probe_in_flight() {
+        let now = Instant::now();
+
+        let mut p = Pmtud::new(true, 1500);
+
+        assert_eq!(p.probe_size(usize::MAX, now), Some(1500));
+        p.on_probe_sent(10, 1500);
+
+        // Only one probe is in flight at a time.
+        assert_eq!(p.probe_size(usize::MAX, now), None);
+
+        // Other packets don't affect the search.
+        assert_eq!(p.on_packet_acked(9, 1200, now), None);
+        assert!(!p.on_packet_lost(11, now));
+
+        assert!(p.on_packet_lost(10, now));
+        assert_eq!(p.probe_size(usize::MAX, now), Some(1500));
+    }
+
+    #[test]
+    fn black_hole() {
+        let now = Instant::now();
+
+        let mut p = Pmtud::new(true, 1500);
+        search(&mut p, 1500, now);
+
+        assert_eq!(p.pmtu, 1500);
+
+        // Losses that also hit small packets are not suspicious.
+        for _ in 0..BLACK_HOLE_THRESHOLD {
+            assert_eq!(p.on_packets_lost(3, 1, now), None);
+        }
+
+        // Neither are losses between which full-sized packets get through.
+        for _ in 0..BLACK_HOLE_THRESHOLD {
+            assert_eq!(p.on_packets_lost(3, 0, now), None);
+            assert_eq!(p.on_packet_acked(100, 1500, now), None);
+        }
+
+        for _ in 0..BLACK_HOLE_THRESHOLD - 1 {
+            assert_eq!(p.on_packets_lost(3, 0, now), None);
+        }
+
+        assert_eq!(p.on_packets_lost(3, 0, now), Some(BASE_PLPMTU));
+        assert_eq!(p.pmtu, BASE_PLPMTU);
+
+        // The search starts again, below the size that stopped working.
+        let size = p.probe_size(usize::MAX, now).unwrap();
+        assert!(size > BASE_PLPMTU && size < 1500);
+    }
+}
@@ -37,12 +37,15 @@ use crate::recovery;
 use crate::recovery::Acked;
 use crate::recovery::CongestionControlOps;
 use crate::recovery::Recovery;
+use crate::recovery::Sent;
 
 pub static RENO: CongestionControlOps = CongestionControlOps {
     on_init,
     on_packet_sent,
     on_packets_acked,
+    on_packets_lost,
     congestion_event,
+    ecn_congestion_event,
     collapse_cwnd,
     checkpoint,
     rollback,
@@ -103,6 +106,12 @@ fn on_packet_acked(
     }
 }
 
+fn on_packets_lost(
+    _r: &mut Recovery, _lost_bytes: usize, _largest_lost_pkt: &Sent,
+    _now: Instant,
+) {
+}
+
 fn congestion_event(
     r: &mut Recovery, _lost_bytes: usize, time_sent: Instant,
     epoch: packet::Epoch, now: Instant,
@@ -132,6 +141,52 @@ fn congestion_event(
     }
 }
 
+fn ecn_congestion_event(
+    r: &mut Recovery, alpha: Option<f64>, time_sent: Instant,
+    epoch: packet::Epoch, now: Instant,
+) {
+    match alpha {
+        Some(alpha) => {
+            scalable_reduction(r, alpha, time_sent, epoch, now);
+        },
+
+        None => congestion_event(r, 0, time_sent, epoch, now),
+    }
+}
+
+/// Reduces the congestion window by `alpha / 2`, at most once per round
+/// trip, as DCTCP (RFC 8257) does when packets are CE-marked.
+///
+/// Returns whether the window was reduced.
+pub fn scalable_reduction(
+    r: &mut Recovery, alpha: f64, time_sent: Instant, epoch: packet::Epoch,
+    now: Instant,
+) -> bool {
+    if r.in_congestion_recovery(time_sent) {
+        return false;
+    }
+
+    r.congestion_recovery_start_time = Some(now);
+
+    r.congestion_window =
+        (r.congestion_window as f64 * (1.0 - alpha / 2.0)) as usize;
+
+    r.congestion_window = cmp::max(
+        r.congestion_window,
+        r.max_datagram_size * recovery::MINIMUM_WINDOW_PACKETS,
+    );
+
+    r.bytes_acked_ca = 0;
+
+    r.ssthresh = r.congestion_window;
+
+    if r.hystart.in_css(epoch) {
+        r.hystart.congestion_event();
+    }
+
+    true
+}
+
 pub fn collapse_cwnd(r: &mut Recovery) {
     r.congestion_window = r.max_datagram_size * recovery::MINIMUM_WINDOW_PACKETS;
     r.bytes_acked_sl = 0;
@@ -210,6 +265,9 @@ mod tests {
             first_sent_time: std::time::Instant::now(),
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         // Send initcwnd full MSS packets to become no longer app limited
@@ -227,6 +285,8 @@ mod tests {
             delivered_time: now,
             first_sent_time: now,
             is_app_limited: false,
+            tx_in_flight: 0,
+            lost: 0,
             rtt: Duration::ZERO,
         }];
 
@@ -259,6 +319,9 @@ mod tests {
             first_sent_time: std::time::Instant::now(),
             is_app_limited: false,
             has_data: false,
+            ecn_marked: false,
+            tx_in_flight: 0,
+            lost: 0,
         };
 
         // Send initcwnd full MSS packets to become no longer app limited
@@ -277,6 +340,8 @@ mod tests {
                 delivered_time: now,
                 first_sent_time: now,
                 is_app_limited: false,
+                tx_in_flight: 0,
+                lost: 0,
                 rtt: Duration::ZERO,
             },
             Acked {
@@ -287,6 +352,8 @@ mod tests {
                 delivered_time: now,
                 first_sent_time: now,
                 is_app_limited: false,
+                tx_in_flight: 0,
+                lost: 0,
                 rtt: Duration::ZERO,
             },
             Acked {
@@ -297,6 +364,8 @@ mod tests {
                 delivered_time: now,
                 first_sent_time: now,
                 is_app_limited: false,
+                tx_in_flight: 0,
+                lost: 0,
                 rtt: Duration::ZERO,
             },
         ];
@@ -366,6 +435,8 @@ mod tests {
             delivered_time: now,
             first_sent_time: now,
             is_app_limited: false,
+            tx_in_flight: 0,
+            lost: 0,
             rtt: Duration::ZERO,
         }];
 
@@ -54,6 +54,13 @@ const SEND_BUFFER_SIZE: usize = 5;
 #[cfg(not(test))]
 const SEND_BUFFER_SIZE: usize = 4096;
 
+// The initial size of the receive ring, small in tests so that it wraps.
+#[cfg(test)]
+const MIN_RECV_RING_SIZE: usize = 8;
+
+#[cfg(not(test))]
+const MIN_RECV_RING_SIZE: usize = 4096;
+
 // The default size of the receiver stream flow control window.
 const DEFAULT_STREAM_WINDOW: u64 = 32 * 1024;
 
@@ -559,6 +566,52 @@ impl StreamMap {
         self.flushable.dtp_scheduler = BinaryHeap::from(flushable);
     }
 
+    /// Returns how close the most urgent DTP block is to its deadline.
+    ///
+    /// The value is 0 when the head of the DTP scheduler can be sent at the
+    /// current `recovery` rate with its whole deadline to spare, and grows to
+    /// 1 as the slack left to it shrinks to nothing. It is 0 when no block is
+    /// queued.
+    #[cfg(feature = "dtp")]
+    pub fn dtp_urgency(&self, recovery: (u64, u64)) -> f64 {
+        let b = match self.flushable.dtp_scheduler.peek() {
+            Some(std::cmp::Reverse(b)) => b,
+
+            None => return 0.0,
+        };
+
+        let stream = match self.streams.get(&b.stream_id) {
+            Some(v) => v,
+
+            None => return 0.0,
+        };
+
+        let block = match stream.block.as_ref() {
+            Some(v) if v.deadline > 0 => v,
+
+            _ => return 0.0,
+        };
+
+        let service_time = stream
+            .send
+            .started_at
+            .and_then(|t| t.elapsed().ok())
+            .map_or(0, |d| d.as_millis() as u64);
+
+        // Same fallback as `Block::real_priority()` before a rate sample.
+        let delivery_rate = if recovery.0 == 0 {
+            100000000000
+        } else {
+            recovery.0
+        };
+
+        let slack = block.deadline.saturating_sub(
+            block.size / delivery_rate + recovery.1 + service_time,
+        );
+
+        1.0 - (slack as f64 / block.deadline as f64).min(1.0)
+    }
+
     /// Adds or removes the stream ID to/from the readable streams set.
     ///
     /// If the stream was already in the list, this does nothing.
@@ -1080,14 +1133,21 @@ impl ExactSizeIterator for StreamIter {
 
 /// Receive-side stream buffer.
 ///
-/// Stream data received by the peer is buffered in a list of data chunks
-/// ordered by offset in ascending order. Contiguous data can then be read
-/// into a slice.
+/// Stream data received by the peer is written at its offset in a ring
+/// buffer, which grows up to the flow control window, and the ranges of
+/// offsets received are tracked to find the holes. Contiguous data can then
+/// be read into a slice, or borrowed from the ring.
 #[derive(Debug, Default)]
 pub struct RecvBuf {
-    /// Chunks of data received from the peer that have not yet been read by
-    /// the application, ordered by offset.
-    data: BinaryHeap<RangeBuf>,
+    /// Data received from the peer that has not yet been read by the
+    /// application. The byte at offset `off` is at index `head`.
+    ring: Vec<u8>,
+
+    /// Index in `ring` of the lowest offset that has yet to be read.
+    head: usize,
+
+    /// Ranges of offsets buffered in `ring`.
+    ranges: ranges::RangeSet,
 
     /// The lowest data offset that has yet to be read by the application.
     off: u64,
@@ -1107,6 +1167,10 @@ pub struct RecvBuf {
     /// Whether incoming data is validated but not buffered.
     drain: bool,
 
+    /// Whether a buffer carrying the final offset was received and not yet
+    /// returned to the application.
+    fin_pending: bool,
+
     /// Corresponding DTP Block info
     #[cfg(feature = "dtp")]
     pub block: Option<Weak<Block>>,
@@ -1211,56 +1275,151 @@ impl RecvBuf {
             }
         }
 
-        let mut tmp_bufs = VecDeque::with_capacity(2);
-        tmp_bufs.push_back(buf);
+        self.len = cmp::max(self.len, buf.max_off());
 
-        'tmp: while let Some(mut buf) = tmp_bufs.pop_front() {
-            // Discard incoming data below current stream offset. Bytes up to
-            // `self.off` have already been received so we should not buffer
-            // them again. This is also important to make sure `ready()` doesn't
-            // get stuck when a buffer with lower offset than the stream's is
-            // buffered.
-            if self.off_front() > buf.off() {
-                buf = buf.split_off((self.off_front() - buf.off()) as usize);
-            }
+        if self.drain {
+            return Ok(());
+        }
 
-            // Handle overlapping data. If the incoming data's starting offset
-            // is above the previous maximum received offset, there is clearly
-            // no overlap so this logic can be skipped. However do still try to
-            // merge an empty final buffer (i.e. an empty buffer with the fin
-            // flag set, which is the only kind of empty buffer that should
-            // reach this point).
-            if buf.off() < self.max_off() || buf.is_empty() {
-                for b in &self.data {
-                    // New buffer is fully contained in existing buffer.
-                    if buf.off() >= b.off() && buf.max_off() <= b.max_off() {
-                        continue 'tmp;
-                    }
+        if buf.fin() {
+            self.fin_pending = true;
+        }
 
-                    // New buffer's start overlaps existing buffer.
-                    if buf.off() >= b.off() && buf.off() < b.max_off() {
-                        buf = buf.split_off((b.max_off() - buf.off()) as usize);
-                    }
+        // Discard incoming data below current stream offset. Bytes up to
+        // `self.off` have already been received so we should not buffer them
+        // again.
+        let start = cmp::max(buf.off(), self.off);
 
-                    // New buffer's end overlaps existing buffer.
-                    if buf.off() < b.off() && buf.max_off() > b.off() {
-                        tmp_bufs.push_back(
-                            buf.split_off((b.off() - buf.off()) as usize),
-                        );
-                    }
-                }
+        if start >= buf.max_off() {
+            return Ok(());
+        }
+
+        self.reserve(buf.max_off());
+
+        // Only fill the holes, data that overlaps what is already buffered
+        // is not written again.
+        let mut hole_start = start;
+
+        for r in self.ranges.iter() {
+            if r.end <= hole_start {
+                continue;
             }
 
-            self.len = cmp::max(self.len, buf.max_off());
+            if r.start >= buf.max_off() {
+                break;
+            }
+
+            if r.start > hole_start {
+                let pos = self.ring_index(hole_start);
 
-            if !self.drain {
-                self.data.push(buf);
+                copy_to_ring(&mut self.ring, pos, &buf, hole_start, r.start);
             }
+
+            hole_start = r.end;
         }
 
+        if hole_start < buf.max_off() {
+            let pos = self.ring_index(hole_start);
+
+            copy_to_ring(&mut self.ring, pos, &buf, hole_start, buf.max_off());
+        }
+
+        self.ranges.insert(start..buf.max_off());
+
         Ok(())
     }
 
+    /// Returns the index in the ring of the given offset.
+    fn ring_index(&self, off: u64) -> usize {
+        let i = self.head + (off - self.off) as usize;
+
+        if i >= self.ring.len() {
+            i - self.ring.len()
+        } else {
+            i
+        }
+    }
+
+    /// Grows the ring so that it can hold data up to offset `max_off`.
+    ///
+    /// The peer can't send beyond the flow control limit, so the ring never
+    /// grows larger than the receive window.
+    fn reserve(&mut self, max_off: u64) {
+        let needed = (max_off - self.off) as usize;
+
+        if needed <= self.ring.len() {
+            return;
+        }
+
+        let cap = cmp::max(needed.next_power_of_two(), MIN_RECV_RING_SIZE);
+
+        // Move the buffered data to the start of the new ring.
+        let buffered = self
+            .ranges
+            .iter()
+            .next_back()
+            .map_or(0, |r| (r.end - self.off) as usize);
+        let mut ring = vec![0; cap];
+
+        let first = cmp::min(buffered, self.ring.len() - self.head);
+
+        ring[..first].copy_from_slice(&self.ring[self.head..self.head + first]);
+        ring[first..buffered].copy_from_slice(&self.ring[..buffered - first]);
+
+        self.ring = ring;
+        self.head = 0;
+    }
+
+    /// Returns the contiguous data that is ready to be read.
+    ///
+    /// The slice ends where the ring wraps around, the rest of the data is
+    /// returned once the slice is consumed. If there is no data at the
+    /// expected read offset, the `Done` error is returned.
+    ///
+    /// On success the data, and a flag indicating if consuming all of it
+    /// reaches the end of the stream, are returned as a tuple.
+    pub fn peek(&self) -> Result<(&[u8], bool)> {
+        if !self.ready() {
+            return Err(Error::Done);
+        }
+
+        // The stream was reset, so return the error code instead.
+        if let Some(e) = self.error {
+            return Err(Error::StreamReset(e));
+        }
+
+        let len = cmp::min(self.ready_len(), self.ring.len() - self.head);
+        let fin = self.fin_off == Some(self.off + len as u64);
+
+        Ok((&self.ring[self.head..self.head + len], fin))
+    }
+
+    /// Marks `len` bytes of the data returned by `peek()` as read.
+    pub fn consume(&mut self, len: usize) {
+        let len = cmp::min(len, self.ready_len());
+
+        if len == 0 {
+            // Reading the final offset, without data.
+            if self.is_fin() {
+                self.fin_pending = false;
+            }
+
+            return;
+        }
+
+        self.head = self.ring_index(self.off + len as u64);
+        self.off += len as u64;
+
+        self.ranges.remove_until(self.off - 1);
+
+        // Update consumed bytes for flow control.
+        self.flow_control.add_consumed(len as u64);
+
+        if self.is_fin() {
+            self.fin_pending = false;
+        }
+    }
+
     /// Writes data from the receive buffer into the given output buffer.
     ///
     /// Only contiguous data is written to the output buffer, starting from
@@ -1272,45 +1431,29 @@ impl RecvBuf {
     /// no more data in the buffer, are returned as a tuple.
     pub fn emit(&mut self, out: &mut [u8]) -> Result<(usize, bool)> {
         let mut len = 0;
-        let mut cap = out.len();
 
-        if !self.ready() {
-            return Err(Error::Done);
-        }
-
-        // The stream was reset, so return the error code instead.
-        if let Some(e) = self.error {
-            return Err(Error::StreamReset(e));
-        }
+        self.peek()?;
 
-        while cap > 0 && self.ready() {
-            let mut buf = match self.data.peek_mut() {
-                Some(v) => v,
+        // At most two copies, when the data wraps around the ring.
+        while len < out.len() {
+            let (buf, _) = match self.peek() {
+                Ok(v) if !v.0.is_empty() => v,
 
-                None => break,
+                _ => break,
             };
 
-            let buf_len = cmp::min(buf.len(), cap);
+            let buf_len = cmp::min(buf.len(), out.len() - len);
 
             out[len..len + buf_len].copy_from_slice(&buf[..buf_len]);
 
-            self.off += buf_len as u64;
+            self.consume(buf_len);
 
             len += buf_len;
-            cap -= buf_len;
-
-            if buf_len < buf.len() {
-                buf.consume(buf_len);
-
-                // We reached the maximum capacity, so end here.
-                break;
-            }
-
-            std::collections::binary_heap::PeekMut::pop(buf);
         }
 
-        // Update consumed bytes for flow control.
-        self.flow_control.add_consumed(len as u64);
+        if len == 0 {
+            self.consume(0);
+        }
 
         Ok((len, self.is_fin()))
     }
@@ -1342,7 +1485,9 @@ impl RecvBuf {
         // Clear all data already buffered.
         self.off = final_size;
 
-        self.data.clear();
+        self.ring = Vec::new();
+        self.head = 0;
+        self.ranges = ranges::RangeSet::default();
 
         // In order to ensure the application is notified when the stream is
         // reset, enqueue a zero-length buffer at the final size offset.
@@ -1385,7 +1530,9 @@ impl RecvBuf {
 
         self.drain = true;
 
-        self.data.clear();
+        self.ring = Vec::new();
+        self.head = 0;
+        self.ranges = ranges::RangeSet::default();
 
         self.off = self.max_off();
 
@@ -1393,6 +1540,7 @@ impl RecvBuf {
     }
 
     /// Returns the lowest offset of data buffered.
+    #[cfg(feature = "qlog")]
     pub fn off_front(&self) -> u64 {
         self.off
     }
@@ -1420,14 +1568,24 @@ impl RecvBuf {
     }
 
     /// Returns true if the stream has data to be read.
+    ///
+    /// This is also the case when the final offset was reached but not yet
+    /// returned to the application.
     fn ready(&self) -> bool {
-        let buf = match self.data.peek() {
-            Some(v) => v,
+        if self.drain {
+            return false;
+        }
 
-            None => return false,
-        };
+        self.ready_len() > 0 || (self.fin_pending && self.is_fin())
+    }
+
+    /// Returns the length of the contiguous data at the read offset.
+    fn ready_len(&self) -> usize {
+        match self.ranges.iter().next() {
+            Some(r) if r.start == self.off => (r.end - r.start) as usize,
 
-        buf.off() == self.off
+            _ => 0,
+        }
     }
 
     /// Returns the completion time of the stream.
@@ -1437,6 +1595,19 @@ impl RecvBuf {
     }
 }
 
+/// Copies the data of `buf` between offsets `start` and `end` to the ring, at
+/// index `pos`.
+fn copy_to_ring(
+    ring: &mut [u8], pos: usize, buf: &RangeBuf, start: u64, end: u64,
+) {
+    let data = &buf[(start - buf.off()) as usize..(end - buf.off()) as usize];
+
+    let first = cmp::min(data.len(), ring.len() - pos);
+
+    ring[pos..pos + first].copy_from_slice(&data[..first]);
+    ring[..data.len() - first].copy_from_slice(&data[first..]);
+}
+
 /// Send-side stream buffer.
 ///
 /// Stream data scheduled to be sent to the peer is buffered in a list of data
@@ -1513,7 +1684,15 @@ impl SendBuf {
     /// The number of bytes that were actually stored in the buffer is returned
     /// (this may be lower than the size of the input buffer, in case of partial
     /// writes).
-    pub fn write(&mut self, mut data: &[u8], mut fin: bool) -> Result<usize> {
+    pub fn write(&mut self, data: &[u8], fin: bool) -> Result<usize> {
+        self.write_data(SendData::Copy(data), fin)
+    }
+
+    /// Inserts the given data at the end of the buffer, either copying it or
+    /// sharing it with the application.
+    pub(crate) fn write_data(
+        &mut self, mut data: SendData, mut fin: bool,
+    ) -> Result<usize> {
         let max_off = self.off + data.len() as u64;
 
         // Get the stream send capacity. This will return an error if the stream
@@ -1523,7 +1702,7 @@ impl SendBuf {
         if data.len() > capacity {
             // Truncate the input buffer according to the stream's capacity.
             let len = capacity;
-            data = &data[..len];
+            data = data.split_at(len).0;
 
             // We are not buffering the full input, so clear the fin flag.
             fin = false;
@@ -1556,6 +1735,25 @@ impl SendBuf {
             return Ok(data.len());
         }
 
+        let data = match data {
+            SendData::Copy(v) => v,
+
+            // Application buffers are queued whole, they are only copied when
+            // written into packets.
+            SendData::Shared(v) => {
+                let len = v.len();
+
+                let buf = RangeBuf::from_shared(&v, self.off, fin);
+
+                self.data.push_back(buf);
+
+                self.off += len as u64;
+                self.len += len as u64;
+
+                return Ok(len);
+            },
+        };
+
         let mut len = 0;
 
         // Split the remaining input data into consistently-sized buffers to
@@ -1899,17 +2097,181 @@ impl SendBuf {
     }
 }
 
+/// Data written by the application to a stream.
+#[derive(Clone)]
+pub(crate) enum SendData<'a> {
+    /// Data copied into the send buffer.
+    Copy(&'a [u8]),
+
+    /// Data shared with the application, see [`ZeroCopyBuf`].
+    Shared(ZeroCopyBuf),
+}
+
+impl<'a> SendData<'a> {
+    pub fn len(&self) -> usize {
+        match self {
+            SendData::Copy(v) => v.len(),
+
+            SendData::Shared(v) => v.len(),
+        }
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.len() == 0
+    }
+
+    /// Splits the data into two at the given index.
+    pub fn split_at(self, mid: usize) -> (SendData<'a>, SendData<'a>) {
+        match self {
+            SendData::Copy(v) => {
+                let (head, tail) = v.split_at(mid);
+
+                (SendData::Copy(head), SendData::Copy(tail))
+            },
+
+            SendData::Shared(v) => {
+                let mut head = v.clone();
+                head.truncate(mid);
+
+                let mut tail = v;
+                tail.advance(mid);
+
+                (SendData::Shared(head), SendData::Shared(tail))
+            },
+        }
+    }
+}
+
+/// Reference-counted storage shared by buffers holding stream data.
+#[derive(Clone)]
+struct SharedData(Arc<dyn AsRef<[u8]> + Send + Sync>);
+
+impl Default for SharedData {
+    fn default() -> SharedData {
+        SharedData(Arc::new(Vec::new()))
+    }
+}
+
+impl std::ops::Deref for SharedData {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        (*self.0).as_ref()
+    }
+}
+
+impl std::fmt::Debug for SharedData {
+    fn fmt(&self, f: &mut std::fmt::Formatter) -> std::fmt::Result {
+        std::fmt::Debug::fmt(&**self, f)
+    }
+}
+
+impl PartialEq for SharedData {
+    fn eq(&self, other: &SharedData) -> bool {
+        **self == **other
+    }
+}
+
+impl Eq for SharedData {}
+
+/// Application-owned data that is sent on a stream without being copied.
+///
+/// Any type that can be viewed as a byte slice can be wrapped, e.g. a
+/// `Vec<u8>`, a `Box<[u8]>` or a reference-counted buffer. The data is
+/// referenced by the stream's send buffer until all of it has been acked by
+/// the peer (or the stream is collected), at which point it is dropped, and it
+/// is only copied when written into packets.
+///
+/// Cloning a `ZeroCopyBuf` doesn't copy the data it holds.
+///
+/// ## Examples:
+///
+/// ```
+/// let mut buf = quiche::ZeroCopyBuf::new(vec![0; 1000]);
+/// assert_eq!(buf.len(), 1000);
+///
+/// buf.advance(400);
+/// assert_eq!(buf.len(), 600);
+/// ```
+#[derive(Clone, Debug)]
+pub struct ZeroCopyBuf {
+    data: SharedData,
+
+    /// The offset of the first byte of the view within `data`.
+    start: usize,
+
+    /// The number of bytes in the view.
+    len: usize,
+}
+
+impl ZeroCopyBuf {
+    /// Creates a new buffer sharing the given data.
+    pub fn new<T>(data: T) -> ZeroCopyBuf
+    where
+        T: AsRef<[u8]> + Send + Sync + 'static,
+    {
+        let len = data.as_ref().len();
+
+        ZeroCopyBuf {
+            data: SharedData(Arc::new(data)),
+            start: 0,
+            len,
+        }
+    }
+
+    /// Returns the length of `self`.
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    /// Returns true if `self` has a length of zero bytes.
+    pub fn is_empty(&self) -> bool {
+        self.len == 0
+    }
+
+    /// Drops the starting `count` bytes of `self`.
+    ///
+    /// This is typically used to skip the bytes that were accepted by a
+    /// stream before retrying the operation.
+    pub fn advance(&mut self, count: usize) {
+        assert!(
+            count <= self.len,
+            "`count` (is {}) should be <= len (is {})",
+            count,
+            self.len
+        );
+
+        self.start += count;
+        self.len -= count;
+    }
+
+    /// Shortens `self`, keeping the starting `len` bytes.
+    fn truncate(&mut self, len: usize) {
+        self.len = cmp::min(self.len, len);
+    }
+}
+
+impl std::ops::Deref for ZeroCopyBuf {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        &self.data[self.start..self.start + self.len]
+    }
+}
+
 /// Buffer holding data at a specific offset.
 ///
-/// The data is stored in a `Vec<u8>` in such a way that it can be shared
-/// between multiple `RangeBuf` objects.
+/// The data is stored in a reference-counted buffer, either allocated when
+/// the `RangeBuf` is created or owned by the application (see
+/// [`ZeroCopyBuf`]), in such a way that it can be shared between multiple
+/// `RangeBuf` objects.
 ///
 /// Each `RangeBuf` will have its own view of that buffer, where the `start`
-/// value indicates the initial offset within the `Vec`, and `len` indicates the
-/// number of bytes, starting from `start` that are included.
+/// value indicates the initial offset within the buffer, and `len` indicates
+/// the number of bytes, starting from `start` that are included.
 ///
-/// In addition, `pos` indicates the current offset within the `Vec`, starting
-/// from the very beginning of the `Vec`.
+/// In addition, `pos` indicates the current offset within the buffer,
+/// starting from the very beginning of the buffer.
 ///
 /// Finally, `off` is the starting offset for the specific `RangeBuf` within the
 /// stream the buffer belongs to.
@@ -1920,7 +2282,7 @@ pub struct RangeBuf {
     /// To avoid needless allocations when a RangeBuf is split, this field is
     /// reference-counted and can be shared between multiple RangeBuf objects,
     /// and sliced using the `start` and `len` values.
-    data: Arc<Vec<u8>>,
+    data: SharedData,
 
     /// The initial offset within the internal buffer.
     start: usize,
@@ -1942,7 +2304,7 @@ impl RangeBuf {
     /// Creates a new `RangeBuf` from the given slice.
     pub fn from(buf: &[u8], off: u64, fin: bool) -> RangeBuf {
         RangeBuf {
-            data: Arc::new(Vec::from(buf)),
+            data: SharedData(Arc::new(Vec::from(buf))),
             start: 0,
             pos: 0,
             len: buf.len(),
@@ -1951,6 +2313,19 @@ impl RangeBuf {
         }
     }
 
+    /// Creates a new `RangeBuf` referencing the data of the given buffer,
+    /// without copying it.
+    pub fn from_shared(buf: &ZeroCopyBuf, off: u64, fin: bool) -> RangeBuf {
+        RangeBuf {
+            data: buf.data.clone(),
+            start: buf.start,
+            pos: buf.start,
+            len: buf.len,
+            off,
+            fin,
+        }
+    }
+
     /// Returns whether `self` holds the final offset in the stream.
     pub fn fin(&self) -> bool {
         self.fin
@@ -2060,7 +2435,7 @@ mod tests {
         assert!(recv.write(buf).is_ok());
         assert_eq!(recv.len, 5);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 1);
+        assert_eq!(recv.ranges.len(), 1);
 
         let mut buf = [0; 32];
         assert_eq!(recv.emit(&mut buf), Ok((5, false)));
@@ -2070,7 +2445,7 @@ mod tests {
         assert!(recv.write(buf).is_ok());
         assert_eq!(recv.len, 5);
         assert_eq!(recv.off, 5);
-        assert_eq!(recv.data.len(), 0);
+        assert_eq!(recv.ranges.len(), 0);
 
         // Check flow control for empty buffer.
         let buf = RangeBuf::from(b"", 16, false);
@@ -2081,21 +2456,21 @@ mod tests {
         assert!(recv.write(buf).is_ok());
         assert_eq!(recv.len, 5);
         assert_eq!(recv.off, 5);
-        assert_eq!(recv.data.len(), 1);
+        assert_eq!(recv.ranges.len(), 0);
 
         // Don't store additional fin empty buffers.
         let buf = RangeBuf::from(b"", 5, true);
         assert!(recv.write(buf).is_ok());
         assert_eq!(recv.len, 5);
         assert_eq!(recv.off, 5);
-        assert_eq!(recv.data.len(), 1);
+        assert_eq!(recv.ranges.len(), 0);
 
         // Don't store additional fin non-empty buffers.
         let buf = RangeBuf::from(b"aa", 3, true);
         assert!(recv.write(buf).is_ok());
         assert_eq!(recv.len, 5);
         assert_eq!(recv.off, 5);
-        assert_eq!(recv.data.len(), 1);
+        assert_eq!(recv.ranges.len(), 0);
 
         // Validate final size with fin empty buffers.
         let buf = RangeBuf::from(b"", 6, true);
@@ -2146,6 +2521,50 @@ mod tests {
         assert_eq!(recv.emit(&mut buf), Err(Error::Done));
     }
 
+    #[test]
+    fn ring_wrap_read() {
+        #[cfg(feature = "dtp")]
+        let mut recv =
+            RecvBuf::new(std::u64::MAX, DEFAULT_STREAM_WINDOW, None, None);
+        assert_eq!(recv.len, 0);
+
+        let mut buf = [0; 32];
+
+        let first = RangeBuf::from(b"abcdef", 0, false);
+        let second = RangeBuf::from(b"ghijkl", 6, false);
+        let third = RangeBuf::from(b"mnopqrstu", 12, true);
+
+        assert!(recv.write(first).is_ok());
+        assert_eq!(recv.ring.len(), MIN_RECV_RING_SIZE);
+
+        let (len, fin) = recv.emit(&mut buf[..5]).unwrap();
+        assert_eq!(len, 5);
+        assert_eq!(fin, false);
+        assert_eq!(&buf[..len], b"abcde");
+
+        // The data wraps around the end of the ring.
+        assert!(recv.write(second).is_ok());
+        assert_eq!(recv.ring.len(), MIN_RECV_RING_SIZE);
+
+        assert_eq!(recv.peek(), Ok((&b"fgh"[..], false)));
+        recv.consume(3);
+        assert_eq!(recv.off, 8);
+
+        assert_eq!(recv.peek(), Ok((&b"ijkl"[..], false)));
+
+        // Growing the ring keeps the data that was not read.
+        assert!(recv.write(third).is_ok());
+        assert_eq!(recv.ring.len(), 16);
+
+        assert_eq!(recv.peek(), Ok((&b"ijklmnopqrstu"[..], true)));
+        recv.consume(13);
+        assert_eq!(recv.off, 21);
+        assert!(recv.is_fin());
+
+        assert_eq!(recv.peek(), Err(Error::Done));
+        assert_eq!(recv.emit(&mut buf), Err(Error::Done));
+    }
+
     #[test]
     fn split_read() {
         #[cfg(feature = "dtp")]
@@ -2233,12 +2652,12 @@ mod tests {
         assert!(recv.write(first).is_ok());
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 1);
+        assert_eq!(recv.ranges.len(), 1);
 
         assert!(recv.write(second).is_ok());
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 1);
+        assert_eq!(recv.ranges.len(), 1);
 
         let (len, fin) = recv.emit(&mut buf).unwrap();
         assert_eq!(len, 9);
@@ -2265,7 +2684,7 @@ mod tests {
         assert!(recv.write(first).is_ok());
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 1);
+        assert_eq!(recv.ranges.len(), 1);
 
         let (len, fin) = recv.emit(&mut buf).unwrap();
         assert_eq!(len, 9);
@@ -2277,14 +2696,14 @@ mod tests {
         assert!(recv.write(second).is_ok());
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 9);
-        assert_eq!(recv.data.len(), 0);
+        assert_eq!(recv.ranges.len(), 0);
 
         assert_eq!(recv.write(third), Err(Error::FinalSize));
 
         assert!(recv.write(fourth).is_ok());
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 9);
-        assert_eq!(recv.data.len(), 0);
+        assert_eq!(recv.ranges.len(), 0);
 
         assert_eq!(recv.emit(&mut buf), Err(Error::Done));
     }
@@ -2304,12 +2723,12 @@ mod tests {
         assert!(recv.write(first).is_ok());
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 1);
+        assert_eq!(recv.ranges.len(), 1);
 
         assert!(recv.write(second).is_ok());
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 1);
+        assert_eq!(recv.ranges.len(), 1);
 
         let (len, fin) = recv.emit(&mut buf).unwrap();
         assert_eq!(len, 9);
@@ -2317,7 +2736,7 @@ mod tests {
         assert_eq!(&buf[..len], b"something");
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 9);
-        assert_eq!(recv.data.len(), 0);
+        assert_eq!(recv.ranges.len(), 0);
 
         assert_eq!(recv.emit(&mut buf), Err(Error::Done));
     }
@@ -2337,12 +2756,12 @@ mod tests {
         assert!(recv.write(second).is_ok());
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 1);
+        assert_eq!(recv.ranges.len(), 1);
 
         assert!(recv.write(first).is_ok());
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 2);
+        assert_eq!(recv.ranges.len(), 1);
 
         let (len, fin) = recv.emit(&mut buf).unwrap();
         assert_eq!(len, 9);
@@ -2350,7 +2769,7 @@ mod tests {
         assert_eq!(&buf[..len], b"somehello");
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 9);
-        assert_eq!(recv.data.len(), 0);
+        assert_eq!(recv.ranges.len(), 0);
 
         assert_eq!(recv.emit(&mut buf), Err(Error::Done));
     }
@@ -2370,12 +2789,12 @@ mod tests {
         assert!(recv.write(second).is_ok());
         assert_eq!(recv.len, 8);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 1);
+        assert_eq!(recv.ranges.len(), 1);
 
         assert!(recv.write(first).is_ok());
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 3);
+        assert_eq!(recv.ranges.len(), 1);
 
         let (len, fin) = recv.emit(&mut buf).unwrap();
         assert_eq!(len, 9);
@@ -2383,7 +2802,7 @@ mod tests {
         assert_eq!(&buf[..len], b"somhellog");
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 9);
-        assert_eq!(recv.data.len(), 0);
+        assert_eq!(recv.ranges.len(), 0);
 
         assert_eq!(recv.emit(&mut buf), Err(Error::Done));
     }
@@ -2404,17 +2823,17 @@ mod tests {
         assert!(recv.write(second).is_ok());
         assert_eq!(recv.len, 8);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 1);
+        assert_eq!(recv.ranges.len(), 1);
 
         assert!(recv.write(third).is_ok());
         assert_eq!(recv.len, 17);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 2);
+        assert_eq!(recv.ranges.len(), 2);
 
         assert!(recv.write(first).is_ok());
         assert_eq!(recv.len, 18);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 5);
+        assert_eq!(recv.ranges.len(), 1);
 
         let (len, fin) = recv.emit(&mut buf).unwrap();
         assert_eq!(len, 18);
@@ -2422,7 +2841,7 @@ mod tests {
         assert_eq!(&buf[..len], b"somhellogsomhellog");
         assert_eq!(recv.len, 18);
         assert_eq!(recv.off, 18);
-        assert_eq!(recv.data.len(), 0);
+        assert_eq!(recv.ranges.len(), 0);
 
         assert_eq!(recv.emit(&mut buf), Err(Error::Done));
     }
@@ -2442,12 +2861,12 @@ mod tests {
         assert!(recv.write(first).is_ok());
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 1);
+        assert_eq!(recv.ranges.len(), 1);
 
         assert!(recv.write(second).is_ok());
         assert_eq!(recv.len, 13);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 2);
+        assert_eq!(recv.ranges.len(), 1);
 
         let (len, fin) = recv.emit(&mut buf).unwrap();
         assert_eq!(len, 13);
@@ -2474,12 +2893,12 @@ mod tests {
         assert!(recv.write(second).is_ok());
         assert_eq!(recv.len, 12);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 1);
+        assert_eq!(recv.ranges.len(), 1);
 
         assert!(recv.write(first).is_ok());
         assert_eq!(recv.len, 12);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 2);
+        assert_eq!(recv.ranges.len(), 1);
 
         let (len, fin) = recv.emit(&mut buf).unwrap();
         assert_eq!(len, 12);
@@ -2508,22 +2927,22 @@ mod tests {
         assert!(recv.write(third).is_ok());
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 1);
+        assert_eq!(recv.ranges.len(), 1);
 
         assert!(recv.write(second).is_ok());
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 2);
+        assert_eq!(recv.ranges.len(), 2);
 
         assert!(recv.write(first).is_ok());
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 3);
+        assert_eq!(recv.ranges.len(), 3);
 
         assert!(recv.write(fourth).is_ok());
         assert_eq!(recv.len, 10);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 6);
+        assert_eq!(recv.ranges.len(), 1);
 
         let (len, fin) = recv.emit(&mut buf).unwrap();
         assert_eq!(len, 10);
@@ -2552,22 +2971,22 @@ mod tests {
         assert!(recv.write(third).is_ok());
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 1);
+        assert_eq!(recv.ranges.len(), 1);
 
         assert!(recv.write(second).is_ok());
         assert_eq!(recv.len, 16);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 2);
+        assert_eq!(recv.ranges.len(), 2);
 
         assert!(recv.write(first).is_ok());
         assert_eq!(recv.len, 16);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 3);
+        assert_eq!(recv.ranges.len(), 3);
 
         assert!(recv.write(fourth).is_ok());
         assert_eq!(recv.len, 16);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 5);
+        assert_eq!(recv.ranges.len(), 1);
 
         let (len, fin) = recv.emit(&mut buf).unwrap();
         assert_eq!(len, 16);
@@ -2595,17 +3014,17 @@ mod tests {
         assert!(recv.write(first).is_ok());
         assert_eq!(recv.len, 13);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 1);
+        assert_eq!(recv.ranges.len(), 1);
 
         assert!(recv.write(second).is_ok());
         assert_eq!(recv.len, 13);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 2);
+        assert_eq!(recv.ranges.len(), 1);
 
         assert!(recv.write(third).is_ok());
         assert_eq!(recv.len, 15);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 3);
+        assert_eq!(recv.ranges.len(), 1);
 
         let (len, fin) = recv.emit(&mut buf).unwrap();
         assert_eq!(len, 15);
@@ -2613,7 +3032,7 @@ mod tests {
         assert_eq!(&buf[..len], b"somethinhelloar");
         assert_eq!(recv.len, 15);
         assert_eq!(recv.off, 15);
-        assert_eq!(recv.data.len(), 0);
+        assert_eq!(recv.ranges.len(), 0);
 
         assert_eq!(recv.emit(&mut buf), Err(Error::Done));
     }
@@ -2637,32 +3056,32 @@ mod tests {
         assert!(recv.write(second).is_ok());
         assert_eq!(recv.len, 5);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 1);
+        assert_eq!(recv.ranges.len(), 1);
 
         assert!(recv.write(fourth).is_ok());
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 2);
+        assert_eq!(recv.ranges.len(), 2);
 
         assert!(recv.write(third).is_ok());
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 3);
+        assert_eq!(recv.ranges.len(), 1);
 
         assert!(recv.write(first).is_ok());
         assert_eq!(recv.len, 9);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 4);
+        assert_eq!(recv.ranges.len(), 1);
 
         assert!(recv.write(sixth).is_ok());
         assert_eq!(recv.len, 14);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 5);
+        assert_eq!(recv.ranges.len(), 2);
 
         assert!(recv.write(fifth).is_ok());
         assert_eq!(recv.len, 14);
         assert_eq!(recv.off, 0);
-        assert_eq!(recv.data.len(), 6);
+        assert_eq!(recv.ranges.len(), 1);
 
         let (len, fin) = recv.emit(&mut buf).unwrap();
         assert_eq!(len, 14);
@@ -2670,7 +3089,7 @@ mod tests {
         assert_eq!(&buf[..len], b"aabbbcdddeefff");
         assert_eq!(recv.len, 14);
         assert_eq!(recv.off, 14);
-        assert_eq!(recv.data.len(), 0);
+        assert_eq!(recv.ranges.len(), 0);
 
         assert_eq!(recv.emit(&mut buf), Err(Error::Done));
     }
@@ -3505,6 +3924,70 @@ mod tests {
         assert_eq!(stream.send.data.len(), 2);
     }
 
+    #[test]
+    fn send_emit_zero_copy() {
+        struct AppData(Arc<Vec<u8>>);
+
+        impl AsRef<[u8]> for AppData {
+            fn as_ref(&self) -> &[u8] {
+                &self.0
+            }
+        }
+
+        let mut buf = [0; 5];
+
+        #[cfg(feature = "dtp")]
+        let mut stream =
+            Stream::new(0, 12, true, true, DEFAULT_STREAM_WINDOW, None);
+
+        let data = Arc::new(b"helloworldolleh".to_vec());
+
+        let mut zc = ZeroCopyBuf::new(AppData(data.clone()));
+
+        // Only part of the buffer fits in the stream's capacity.
+        assert_eq!(
+            stream.send.write_data(SendData::Shared(zc.clone()), true),
+            Ok(12)
+        );
+        assert_eq!(stream.send.data.len(), 1);
+        assert_eq!(stream.send.fin_off, None);
+
+        zc.advance(12);
+        assert_eq!(&zc[..], b"leh");
+        assert_eq!(
+            stream.send.write_data(SendData::Shared(zc.clone()), true),
+            Ok(0)
+        );
+
+        stream.send.update_max_data(20);
+        assert_eq!(
+            stream.send.write_data(SendData::Shared(zc.clone()), true),
+            Ok(3)
+        );
+        assert_eq!(stream.send.data.len(), 2);
+        drop(zc);
+
+        assert_eq!(stream.send.emit(&mut buf), Ok((5, false)));
+        assert_eq!(&buf, b"hello");
+
+        assert_eq!(stream.send.emit(&mut buf), Ok((5, false)));
+        assert_eq!(&buf, b"world");
+
+        assert_eq!(stream.send.emit(&mut buf), Ok((5, true)));
+        assert_eq!(&buf, b"olleh");
+
+        // The application's data is held until all of it is acked.
+        stream.send.ack_and_drop(0, 10);
+        assert_eq!(Arc::strong_count(&data), 2);
+
+        stream.send.ack_and_drop(10, 2);
+        assert_eq!(stream.send.data.len(), 1);
+        assert_eq!(Arc::strong_count(&data), 2);
+
+        stream.send.ack_and_drop(12, 3);
+        assert_eq!(Arc::strong_count(&data), 1);
+    }
+
     #[test]
     fn send_emit_retransmit() {
         let mut buf = [0; 5];
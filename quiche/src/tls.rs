@@ -661,6 +661,28 @@ impl Handshake {
         unsafe { SSL_in_early_data(self.as_ptr()) == 1 }
     }
 
+    /// Fills `out` with keying material exported from the TLS 1.3 exporter
+    /// secret, see RFC 8446 section 7.5. Only valid once the handshake is
+    /// completed.
+    pub fn export_keying_material(
+        &self, label: &[u8], context: &[u8], out: &mut [u8],
+    ) -> Result<()> {
+        let rc = unsafe {
+            SSL_export_keying_material(
+                self.as_ptr(),
+                out.as_mut_ptr(),
+                out.len(),
+                label.as_ptr() as *const c_char,
+                label.len(),
+                context.as_ptr(),
+                context.len(),
+                1,
+            )
+        };
+
+        map_result(rc)
+    }
+
     pub fn clear(&mut self) -> Result<()> {
         let rc = unsafe { SSL_clear(self.as_mut_ptr()) };
         map_result_ssl(self, rc)
@@ -1234,6 +1256,12 @@ extern {
 
     fn SSL_get_servername(ssl: *const SSL, ty: c_int) -> *const c_char;
 
+    fn SSL_export_keying_material(
+        ssl: *const SSL, out: *mut u8, out_len: usize, label: *const c_char,
+        label_len: usize, context: *const u8, context_len: usize,
+        use_context: c_int,
+    ) -> c_int;
+
     fn SSL_provide_quic_data(
         ssl: *mut SSL, level: crypto::Level, data: *const u8, len: usize,
     ) -> c_int;